@@ -241,6 +241,15 @@ FIRFilter * FIRFilter::newInstance()
     else
 #endif // ALLOW_MMX
 
+#ifdef ALLOW_AVX
+    if (uExtensions & SUPPORT_AVX)
+    {
+        // AVX support
+        return ::new FIRFilterAVX;
+    }
+    else
+#endif // ALLOW_AVX
+
 #ifdef ALLOW_SSE
     if (uExtensions & SUPPORT_SSE)
     {
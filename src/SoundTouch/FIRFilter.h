@@ -158,6 +158,18 @@ public:
 
 #endif // ALLOW_SSE
 
+
+#ifdef ALLOW_AVX
+    /// Class that implements AVX optimized functions exclusive for floating point samples type.
+    /// Uses the coefficients arranged by FIRFilterSSE.
+    class FIRFilterAVX : public FIRFilterSSE
+    {
+    protected:
+        virtual uint evaluateFilterStereo(float *dest, const float *src, uint numSamples) const;
+    };
+
+#endif // ALLOW_AVX
+
 }
 
 #endif  // FIRFilter_H
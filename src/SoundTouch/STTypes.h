@@ -98,7 +98,9 @@ namespace soundtouch
     // If defined, allows the SIMD-optimized routines to take minor shortcuts 
     // for improved performance. Undefine to require faithfully similar SIMD 
     // calculations as in normal C implementation.
-    #define ALLOW_NONEXACT_SIMD_OPTIMIZATION    1
+    // jsl - the shortcut skips every other overlap position, unaligned
+    // loads are no longer slow enough to make that worth it
+    //#define ALLOW_NONEXACT_SIMD_OPTIMIZATION    1
 
 
     #ifdef INTEGER_SAMPLES
@@ -136,7 +138,14 @@ namespace soundtouch
             #endif
 
             #if (WIN32 || __i386__ || __x86_64__)
-//                #define ALLOW_SSE       1
+                #define ALLOW_SSE       1
+            #endif
+
+            // jsl - AVX versions of the SSE routines, these are compiled
+            // with a target attribute and selected at runtime so we
+            // don't need -mavx
+            #if (__x86_64__ && (__GNUC__ >= 5 || __clang__))
+                #define ALLOW_AVX       1
             #endif
         #endif
 
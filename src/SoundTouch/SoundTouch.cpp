@@ -416,6 +416,11 @@ BOOL SoundTouch::setSetting(uint settingId, uint value)
             pTDStretch->setParameters(sampleRate, sequenceMs, seekWindowMs, value);
             return TRUE;
 
+        case SETTING_USE_FFTSEEK :
+            // enables / disables tempo routine FFT seeking algorithm
+            pTDStretch->enableFFTSeek((value != 0) ? TRUE : FALSE);
+            return TRUE;
+
         default :
             return FALSE;
     }
@@ -453,6 +458,9 @@ uint SoundTouch::getSetting(uint settingId) const
             pTDStretch->getParameters(NULL, NULL, NULL, &temp);
             return temp;
 
+        case SETTING_USE_FFTSEEK :
+            return pTDStretch->isFFTSeekEnabled();
+
         default :
             return 0;
     }
@@ -115,6 +115,12 @@ namespace soundtouch
 /// See "STTypes.h" or README for more information.
 #define SETTING_OVERLAP_MS          5
 
+/// Enable/disable the FFT seeking algorithm in tempo changer routine for stereo 
+/// sound. Finds the same position as the normal seek, cheaper than the plain C 
+/// search but not the SIMD ones unless the seek window is very long. Quick 
+/// seeking takes precedence when both are enabled.
+#define SETTING_USE_FFTSEEK         6
+
 
 class SoundTouch : public FIFOProcessor
 {
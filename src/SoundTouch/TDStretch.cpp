@@ -89,6 +89,7 @@ int scanOffsets[4][24]={
 TDStretch::TDStretch() : FIFOProcessor(&outputBuffer)
 {
     bQuickseek = FALSE;
+    bFFTSeek = FALSE;
     channels = 2;
     bMidBufferDirty = FALSE;
 
@@ -96,6 +97,12 @@ TDStretch::TDStretch() : FIFOProcessor(&outputBuffer)
     pRefMidBufferUnaligned = NULL;
     overlapLength = 0;
 
+    fftLength = 0;
+    pFFTRef = NULL;
+    pFFTWork = NULL;
+    pFFTTwiddle = NULL;
+    pFFTBitReverse = NULL;
+
     setParameters(44100, DEFAULT_SEQUENCE_MS, DEFAULT_SEEKWINDOW_MS, DEFAULT_OVERLAP_MS);
 
     setTempo(1.0f);
@@ -108,6 +115,7 @@ TDStretch::~TDStretch()
 {
     delete[] pMidBuffer;
     delete[] pRefMidBufferUnaligned;
+    freeFFTSeek();
 }
 
 
@@ -144,6 +152,9 @@ void TDStretch::setParameters(uint aSampleRate, uint aSequenceMS,
 
     calculateOverlapLength(overlapMs);
 
+    // the FFT size depends on both lengths
+    prepareFFTSeek();
+
     // set tempo to recalculate 'sampleReq'
     setTempo(tempo);
 
@@ -234,6 +245,128 @@ BOOL TDStretch::isQuickSeekEnabled() const
 }
 
 
+// Enables/disables the FFT position seeking algorithm. Zero to disable, nonzero
+// to enable
+void TDStretch::enableFFTSeek(BOOL enable)
+{
+    bFFTSeek = enable;
+    prepareFFTSeek();
+}
+
+
+// Returns nonzero if the FFT seeking algorithm is enabled.
+BOOL TDStretch::isFFTSeekEnabled() const
+{
+    return bFFTSeek;
+}
+
+
+// jsl - Allocates the FFT buffers for the current seek and overlap lengths.
+// The transform must hold the whole seek range plus one overlap period so 
+// the circular correlation doesn't wrap around into the positions we look at.
+// Only done when the parameters change, never while processing.
+void TDStretch::prepareFFTSeek()
+{
+    uint newLength, bits, i, j;
+
+    if (!bFFTSeek || seekLength < FFTSEEK_MIN_LENGTH)
+    {
+        freeFFTSeek();
+        return;
+    }
+
+    newLength = 1;
+    bits = 0;
+    while (newLength < seekLength + overlapLength)
+    {
+        newLength <<= 1;
+        bits++;
+    }
+    if (newLength == fftLength) return;
+
+    freeFFTSeek();
+    fftLength = newLength;
+    pFFTRef = new float[fftLength * 2];
+    pFFTWork = new float[fftLength * 2];
+    pFFTTwiddle = new float[fftLength];
+    pFFTBitReverse = new uint[fftLength];
+
+    for (i = 0; i < fftLength / 2; i ++)
+    {
+        double angle = -2.0 * 3.14159265358979323846 * i / fftLength;
+        pFFTTwiddle[2 * i] = (float)cos(angle);
+        pFFTTwiddle[2 * i + 1] = (float)sin(angle);
+    }
+
+    for (i = 0; i < fftLength; i ++)
+    {
+        uint rev = 0;
+        for (j = 0; j < bits; j ++)
+        {
+            if (i & (1 << j)) rev |= 1 << (bits - 1 - j);
+        }
+        pFFTBitReverse[i] = rev;
+    }
+}
+
+
+void TDStretch::freeFFTSeek()
+{
+    delete[] pFFTRef;
+    delete[] pFFTWork;
+    delete[] pFFTTwiddle;
+    delete[] pFFTBitReverse;
+    pFFTRef = NULL;
+    pFFTWork = NULL;
+    pFFTTwiddle = NULL;
+    pFFTBitReverse = NULL;
+    fftLength = 0;
+}
+
+
+// jsl - In-place radix-2 forward transform of 'fftLength' interleaved 
+// complex values.
+void TDStretch::fft(float *data) const
+{
+    uint i, j, size, half, step, start;
+
+    for (i = 0; i < fftLength; i ++)
+    {
+        j = pFFTBitReverse[i];
+        if (j > i)
+        {
+            float re = data[2 * i];
+            float im = data[2 * i + 1];
+            data[2 * i] = data[2 * j];
+            data[2 * i + 1] = data[2 * j + 1];
+            data[2 * j] = re;
+            data[2 * j + 1] = im;
+        }
+    }
+
+    for (size = 2; size <= fftLength; size <<= 1)
+    {
+        half = size >> 1;
+        step = fftLength / size;
+        for (start = 0; start < fftLength; start += size)
+        {
+            for (i = 0; i < half; i ++)
+            {
+                const float *w = pFFTTwiddle + 2 * i * step;
+                float *p = data + 2 * (start + i);
+                float *q = p + 2 * half;
+                float tr = q[0] * w[0] - q[1] * w[1];
+                float ti = q[0] * w[1] + q[1] * w[0];
+                q[0] = p[0] - tr;
+                q[1] = p[1] - ti;
+                p[0] += tr;
+                p[1] += ti;
+            }
+        }
+    }
+}
+
+
 // Seeks for the optimal overlap-mixing position.
 uint TDStretch::seekBestOverlapPosition(const SAMPLETYPE *refPos)
 {
@@ -244,6 +377,12 @@ uint TDStretch::seekBestOverlapPosition(const SAMPLETYPE *refPos)
         {
             return seekBestOverlapPositionStereoQuick(refPos);
         } 
+#ifdef FLOAT_SAMPLES
+        else if (fftLength > 0)
+        {
+            return seekBestOverlapPositionStereoFFT(refPos);
+        }
+#endif
         else 
         {
             return seekBestOverlapPositionStereo(refPos);
@@ -652,7 +791,7 @@ void TDStretch::acceptNewOverlapLength(uint newOverlapLength)
 
         pRefMidBufferUnaligned = new SAMPLETYPE[2 * overlapLength + 16 / sizeof(SAMPLETYPE)];
         // ensure that 'pRefMidBuffer' is aligned to 16 byte boundary for efficiency
-        pRefMidBuffer = (SAMPLETYPE *)((((ulong)pRefMidBufferUnaligned) + 15) & -16);
+        pRefMidBuffer = (SAMPLETYPE *)((((size_t)pRefMidBufferUnaligned) + 15) & -16);
     }
 }
 
@@ -685,6 +824,15 @@ TDStretch * TDStretch::newInstance()
 #endif // ALLOW_MMX
 
 
+#ifdef ALLOW_AVX
+    if (uExtensions & SUPPORT_AVX)
+    {
+        // AVX support
+        return ::new TDStretchAVX;
+    }
+    else
+#endif // ALLOW_AVX
+
 #ifdef ALLOW_SSE
     if (uExtensions & SUPPORT_SSE)
     {
@@ -867,6 +1015,65 @@ void TDStretch::precalcCorrReferenceMono()
 }
 
 
+// Seeks for the optimal overlap-mixing position using FFT. The 'stereo' version 
+// of the routine
+//
+// jsl - The same correlation as seekBestOverlapPositionStereo but computed for
+// every position at once.  Treating each stereo frame as a complex number 
+// L + iR, the real part of conj(ref) * input is the sum of the two channel
+// products calcCrossCorrStereo adds up, so one complex transform of each
+// side gives us both channels.
+uint TDStretch::seekBestOverlapPositionStereoFFT(const float *refPos)
+{
+    uint i, bestOffs;
+    double bestCorr, corr;
+    uint inputLength;
+
+    // Slopes the amplitudes of the 'midBuffer' samples
+    precalcCorrReferenceStereo();
+
+    // the first frame of the reference is always zero after sloping,
+    // the direct routine skips it so we do too
+    memset(pFFTRef, 0, fftLength * 2 * sizeof(float));
+    memcpy(pFFTRef + 2, pRefMidBuffer + 2, (overlapLength - 1) * 2 * sizeof(float));
+    fft(pFFTRef);
+
+    inputLength = seekLength + overlapLength - 1;
+    memcpy(pFFTWork, refPos, inputLength * 2 * sizeof(float));
+    memset(pFFTWork + inputLength * 2, 0, (fftLength - inputLength) * 2 * sizeof(float));
+    fft(pFFTWork);
+
+    // ref * conj(input) is the conjugate of the cross spectrum, 
+    // transforming that forward is the same as the inverse transform 
+    // conjugated, so the correlation ends up in the real part scaled 
+    // by fftLength
+    for (i = 0; i < fftLength; i ++)
+    {
+        float ar = pFFTRef[2 * i];
+        float ai = pFFTRef[2 * i + 1];
+        float br = pFFTWork[2 * i];
+        float bi = pFFTWork[2 * i + 1];
+        pFFTWork[2 * i] = ar * br + ai * bi;
+        pFFTWork[2 * i + 1] = ai * br - ar * bi;
+    }
+    fft(pFFTWork);
+
+    bestCorr = pFFTWork[0];
+    bestOffs = 0;
+    for (i = 1; i < seekLength; i ++) 
+    {
+        corr = pFFTWork[2 * i];
+        if (corr > bestCorr) 
+        {
+            bestCorr = corr;
+            bestOffs = i;
+        }
+    }
+
+    return bestOffs;
+}
+
+
 // SSE-optimized version of the function overlapStereo
 void TDStretch::overlapStereo(float *output, const float *input) const
 {
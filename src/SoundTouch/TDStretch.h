@@ -87,6 +87,10 @@ namespace soundtouch
 /// Increasing this value increases computational burden & vice versa.
 #define DEFAULT_OVERLAP_MS      12
 
+/// jsl - Shortest seek window in samples for which the FFT overlap seek is used
+/// when enabled. Below this the direct correlation is cheaper.
+#define FFTSEEK_MIN_LENGTH      256
+
 
 /// Class that does the time-stretch (tempo change) effect for the processed
 /// sound.
@@ -111,8 +115,16 @@ protected:
     FIFOSampleBuffer outputBuffer;
     FIFOSampleBuffer inputBuffer;
     BOOL bQuickseek;
+    BOOL bFFTSeek;
     BOOL bMidBufferDirty;
 
+    // jsl - FFT overlap seek state, see prepareFFTSeek
+    uint fftLength;
+    float *pFFTRef;
+    float *pFFTWork;
+    float *pFFTTwiddle;
+    uint *pFFTBitReverse;
+
     uint sampleRate;
     uint sequenceMs;
     uint seekWindowMs;
@@ -130,8 +142,13 @@ protected:
     virtual uint seekBestOverlapPositionStereoQuick(const SAMPLETYPE *refPos);
     virtual uint seekBestOverlapPositionMono(const SAMPLETYPE *refPos);
     virtual uint seekBestOverlapPositionMonoQuick(const SAMPLETYPE *refPos);
+    uint seekBestOverlapPositionStereoFFT(const SAMPLETYPE *refPos);
     uint seekBestOverlapPosition(const SAMPLETYPE *refPos);
 
+    void prepareFFTSeek();
+    void freeFFTSeek();
+    void fft(float *data) const;
+
     virtual void overlapStereo(SAMPLETYPE *output, const SAMPLETYPE *input) const;
     virtual void overlapMono(SAMPLETYPE *output, const SAMPLETYPE *input) const;
 
@@ -188,6 +205,17 @@ public:
     /// Returns nonzero if the quick seeking algorithm is enabled.
     BOOL isQuickSeekEnabled() const;
 
+    /// Enables/disables the FFT position seeking algorithm for stereo sound.
+    /// Gives the same result as the full seek, but computes the correlation 
+    /// for every position at once.  Cost grows with N log N rather than N^2 
+    /// in the seek window, but the SSE and AVX direct searches are still faster 
+    /// at the window lengths we use.  Quick seek takes precedence if both are 
+    /// enabled.
+    void enableFFTSeek(BOOL enable);
+
+    /// Returns nonzero if the FFT seeking algorithm is enabled.
+    BOOL isFFTSeekEnabled() const;
+
     /// Sets routine control parameters. These control are certain time constants
     /// defining how the sound is stretched to the desired duration.
     //
@@ -248,9 +276,22 @@ public:
     {
     protected:
         double calcCrossCorrStereo(const float *mixingPos, const float *compare) const;
+        virtual void overlapStereo(float *output, const float *input) const;
     };
 
 #endif /// ALLOW_SSE
 
+
+#ifdef ALLOW_AVX
+    /// Class that implements AVX optimized routines for floating point samples type.
+    class TDStretchAVX : public TDStretchSSE
+    {
+    protected:
+        double calcCrossCorrStereo(const float *mixingPos, const float *compare) const;
+        virtual void overlapStereo(float *output, const float *input) const;
+    };
+
+#endif /// ALLOW_AVX
+
 }
 #endif  /// TDStretch_H
@@ -0,0 +1,193 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+/// AVX optimized routines, the 8 float wide versions of the routines in
+/// sse_optimized.cpp.
+///
+/// The kernels are compiled with a GCC target attribute rather than -mavx so
+/// the rest of the library still runs on CPUs without AVX.  The classes are
+/// only instantiated when detectCPUextensions reports SUPPORT_AVX.  The kernels
+/// are kept in static functions since the member functions can't carry a
+/// different target than their declarations.
+///
+/// Author        : Copyright (c) Olli Parviainen
+/// Author e-mail : oparviai 'at' iki.fi
+/// SoundTouch WWW: http://www.surina.net/soundtouch
+///
+////////////////////////////////////////////////////////////////////////////////
+//
+// License :
+//
+//  SoundTouch audio processing library
+//  Copyright (c) Olli Parviainen
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "cpu_detect.h"
+#include "STTypes.h"
+
+using namespace soundtouch;
+
+#ifdef ALLOW_AVX
+
+// AVX routines available only with float sample type
+
+#include <assert.h>
+#include <immintrin.h>
+
+#define AVX_TARGET __attribute__((target("avx")))
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// implementation of AVX optimized functions of class 'TDStretchAVX'
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "TDStretch.h"
+
+// Sums the eight floats of a register
+static AVX_TARGET inline float avxSum(__m256 v)
+{
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+
+// Cross correlation of 'count' floats, count must be divisible by 16
+static AVX_TARGET float avxCrossCorr(const float *pV1, const float *pV2, uint count)
+{
+    __m256 vSum1 = _mm256_setzero_ps();
+    __m256 vSum2 = _mm256_setzero_ps();
+    uint i;
+
+    for (i = 0; i < count; i += 16)
+    {
+        vSum1 = _mm256_add_ps(vSum1, _mm256_mul_ps(_mm256_loadu_ps(pV1 + i),
+                                                   _mm256_loadu_ps(pV2 + i)));
+        vSum2 = _mm256_add_ps(vSum2, _mm256_mul_ps(_mm256_loadu_ps(pV1 + i + 8),
+                                                   _mm256_loadu_ps(pV2 + i + 8)));
+    }
+
+    return avxSum(_mm256_add_ps(vSum1, vSum2));
+}
+
+// Sliding overlap of 'count' stereo samples, count must be divisible by 4
+static AVX_TARGET void avxOverlapStereo(float *output, const float *input,
+                                        const float *mid, uint count)
+{
+    __m256 vScale = _mm256_set1_ps(1.0f / (float)count);
+    __m256 vOvl = _mm256_set1_ps((float)count);
+    __m256 vStep = _mm256_set1_ps(4.0f);
+    __m256 vI = _mm256_setr_ps(0.0f, 0.0f, 1.0f, 1.0f, 2.0f, 2.0f, 3.0f, 3.0f);
+    uint i;
+
+    for (i = 0; i < 2 * count; i += 8)
+    {
+        __m256 vFi = _mm256_mul_ps(vI, vScale);
+        __m256 vTemp = _mm256_mul_ps(_mm256_sub_ps(vOvl, vI), vScale);
+        _mm256_storeu_ps(output + i,
+                         _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(input + i), vFi),
+                                       _mm256_mul_ps(_mm256_loadu_ps(mid + i), vTemp)));
+        vI = _mm256_add_ps(vI, vStep);
+    }
+}
+
+// Calculates cross correlation of two buffers
+double TDStretchAVX::calcCrossCorrStereo(const float *pV1, const float *pV2) const
+{
+    // ensure overlapLength is divisible by 8
+    assert((overlapLength % 8) == 0);
+
+    return (double)avxCrossCorr(pV1, pV2, 2 * overlapLength);
+}
+
+// AVX-optimized version of the function overlapStereo
+void TDStretchAVX::overlapStereo(float *output, const float *input) const
+{
+    avxOverlapStereo(output, input, pMidBuffer, overlapLength);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// implementation of AVX optimized functions of class 'FIRFilterAVX'
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "FIRFilter.h"
+
+// Filters two stereo samples for each pass like the SSE version, with the
+// coefficients duplicated for both channels.  length must be divisible by 8.
+static AVX_TARGET void avxFilterStereo(float *dest, const float *source,
+                                       const float *coeffs, uint length, int count)
+{
+    int j;
+
+    for (j = 0; j < count; j += 2)
+    {
+        const float *pSrc = source;
+        const float *pFil = coeffs;
+        __m256 sum1 = _mm256_setzero_ps();
+        __m256 sum2 = _mm256_setzero_ps();
+        __m128 s1, s2;
+        uint i;
+
+        for (i = 0; i < length / 8; i ++)
+        {
+            __m256 fil0 = _mm256_load_ps(pFil);
+            __m256 fil1 = _mm256_load_ps(pFil + 8);
+
+            // sum1 accumulates the primary sample offset, sum2 the next one
+            sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(_mm256_loadu_ps(pSrc), fil0));
+            sum2 = _mm256_add_ps(sum2, _mm256_mul_ps(_mm256_loadu_ps(pSrc + 2), fil0));
+
+            sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(_mm256_loadu_ps(pSrc + 8), fil1));
+            sum2 = _mm256_add_ps(sum2, _mm256_mul_ps(_mm256_loadu_ps(pSrc + 10), fil1));
+
+            pSrc += 16;
+            pFil += 16;
+        }
+
+        // fold to four floats and finish like the SSE version
+        s1 = _mm_add_ps(_mm256_castps256_ps128(sum1), _mm256_extractf128_ps(sum1, 1));
+        s2 = _mm_add_ps(_mm256_castps256_ps128(sum2), _mm256_extractf128_ps(sum2, 1));
+
+        _mm_storeu_ps(dest, _mm_add_ps(
+                    _mm_shuffle_ps(s1, s2, _MM_SHUFFLE(1,0,3,2)),   // s2_1 s2_0 s1_3 s1_2
+                    _mm_shuffle_ps(s1, s2, _MM_SHUFFLE(3,2,1,0))    // s2_3 s2_2 s1_1 s1_0
+                    ));
+        source += 4;
+        dest += 4;
+    }
+}
+
+// AVX-optimized version of the filter routine for stereo sound
+uint FIRFilterAVX::evaluateFilterStereo(float *dest, const float *source, uint numSamples) const
+{
+    int count = (numSamples - length) & -2;
+
+    if (count < 2) return 0;
+
+    assert((length % 8) == 0);
+    assert(((size_t)filterCoeffsAlign) % 32 == 0);
+
+    avxFilterStereo(dest, source, filterCoeffsAlign, length, count);
+
+    return (uint)count;
+}
+
+#endif  // ALLOW_AVX
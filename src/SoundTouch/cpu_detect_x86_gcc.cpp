@@ -51,6 +51,10 @@
 using namespace std;
 
 #include <stdio.h>
+
+#ifdef __x86_64__
+#include <cpuid.h>
+#endif
 //////////////////////////////////////////////////////////////////////////////
 //
 // processor instructions extension detection routines
@@ -79,7 +83,31 @@ uint detectCPUextensions(void)
 	return 0;
 #endif
 
-#ifndef __i386__
+#if defined(__x86_64__)
+    // jsl - the asm below is 32-bit only, on x86-64 MMX, SSE and SSE2
+    // are always there so we only have to ask about AVX
+    uint res = SUPPORT_MMX | SUPPORT_SSE | SUPPORT_SSE2;
+    uint eax, ebx, ecx, edx;
+
+    if (_dwDisabledISA == 0xffffffff) return 0;
+
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    {
+        // AVX needs both the CPU and the OS saving the YMM registers,
+        // bit 27 is OSXSAVE and bit 28 is AVX
+        if ((ecx & (1 << 27)) && (ecx & (1 << 28)))
+        {
+            uint xcr0, xcr0High;
+            asm volatile("xgetbv" : "=a" (xcr0), "=d" (xcr0High) : "c" (0));
+            if ((xcr0 & 6) == 6)
+            {
+                res |= SUPPORT_AVX;
+            }
+        }
+    }
+
+    return res & ~_dwDisabledISA;
+#elif !defined(__i386__)
     return 0; // always disable extensions on non-x86 platforms.
 #else
     uint res = 0;
@@ -73,7 +73,7 @@ using namespace soundtouch;
 double TDStretchSSE::calcCrossCorrStereo(const float *pV1, const float *pV2) const
 {
     uint i;
-    __m128 vSum, *pVec2;
+    __m128 vSum, vSum2, *pVec2;
 
     // Note. It means a major slow-down if the routine needs to tolerate 
     // unaligned __m128 memory accesses. It's way faster if we can skip 
@@ -105,29 +105,33 @@ double TDStretchSSE::calcCrossCorrStereo(const float *pV1, const float *pV2) con
     // Note: pV2 _must_ be aligned to 16-bit boundary, pV1 need not.
     pVec2 = (__m128*)pV2;
     vSum = _mm_setzero_ps();
+    vSum2 = _mm_setzero_ps();
 
     // Unroll the loop by factor of 4 * 4 operations
+    // jsl - with two accumulators so the adds don't all wait on each other
     for (i = 0; i < overlapLength / 8; i ++) 
     {
         // vSum += pV1[0..3] * pV2[0..3]
         vSum = _mm_add_ps(vSum, _mm_mul_ps(_MM_LOAD(pV1),pVec2[0]));
 
-        // vSum += pV1[4..7] * pV2[4..7]
-        vSum = _mm_add_ps(vSum, _mm_mul_ps(_MM_LOAD(pV1 + 4), pVec2[1]));
+        // vSum2 += pV1[4..7] * pV2[4..7]
+        vSum2 = _mm_add_ps(vSum2, _mm_mul_ps(_MM_LOAD(pV1 + 4), pVec2[1]));
 
         // vSum += pV1[8..11] * pV2[8..11]
         vSum = _mm_add_ps(vSum, _mm_mul_ps(_MM_LOAD(pV1 + 8), pVec2[2]));
 
-        // vSum += pV1[12..15] * pV2[12..15]
-        vSum = _mm_add_ps(vSum, _mm_mul_ps(_MM_LOAD(pV1 + 12), pVec2[3]));
+        // vSum2 += pV1[12..15] * pV2[12..15]
+        vSum2 = _mm_add_ps(vSum2, _mm_mul_ps(_MM_LOAD(pV1 + 12), pVec2[3]));
 
         pV1 += 16;
         pVec2 += 4;
     }
 
     // return value = vSum[0] + vSum[1] + vSum[2] + vSum[3]
-    float *pvSum = (float*)&vSum;
-    return (double)(pvSum[0] + pvSum[1] + pvSum[2] + pvSum[3]);
+    vSum = _mm_add_ps(vSum, vSum2);
+    vSum = _mm_add_ps(vSum, _mm_movehl_ps(vSum, vSum));
+    vSum = _mm_add_ss(vSum, _mm_shuffle_ps(vSum, vSum, 1));
+    return (double)_mm_cvtss_f32(vSum);
 
     /* This is approximately corresponding routine in C-language:
     double corr;
@@ -229,6 +233,31 @@ double TDStretchSSE::calcCrossCorrStereo(const float *pV1, const float *pV2) con
 }
 
 
+// SSE-optimized version of the function overlapStereo, two stereo samples
+// at a time.  Gives the same result as the C version.
+void TDStretchSSE::overlapStereo(float *output, const float *input) const
+{
+    uint i;
+    __m128 vScale, vOvl, vStep, vI;
+
+    // overlapLength is divisible by 8 so there is no remainder
+    vScale = _mm_set1_ps(1.0f / (float)overlapLength);
+    vOvl = _mm_set1_ps((float)overlapLength);
+    vStep = _mm_set1_ps(2.0f);
+    vI = _mm_setr_ps(0.0f, 0.0f, 1.0f, 1.0f);
+
+    for (i = 0; i < 2 * overlapLength; i += 4)
+    {
+        // output = input * i / overlapLength + mid * (overlapLength - i) / overlapLength
+        __m128 vFi = _mm_mul_ps(vI, vScale);
+        __m128 vTemp = _mm_mul_ps(_mm_sub_ps(vOvl, vI), vScale);
+        _mm_storeu_ps(output + i, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(input + i), vFi),
+                                             _mm_mul_ps(_mm_loadu_ps(pMidBuffer + i), vTemp)));
+        vI = _mm_add_ps(vI, vStep);
+    }
+}
+
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // implementation of SSE optimized functions of class 'FIRFilter'
@@ -260,9 +289,10 @@ void FIRFilterSSE::setCoefficients(const float *coeffs, uint newLength, uint uRe
     // Scale the filter coefficients so that it won't be necessary to scale the filtering result
     // also rearrange coefficients suitably for 3DNow!
     // Ensure that filter coeffs array is aligned to 16-byte boundary
+    // jsl - 32 so FIRFilterAVX can use it too
     delete[] filterCoeffsUnalign;
-    filterCoeffsUnalign = new float[2 * newLength + 4];
-    filterCoeffsAlign = (float *)(((unsigned long)filterCoeffsUnalign + 15) & -16);
+    filterCoeffsUnalign = new float[2 * newLength + 8];
+    filterCoeffsAlign = (float *)(((size_t)filterCoeffsUnalign + 31) & -32);
 
     fDivider = (float)resultDivider;
 
@@ -287,7 +317,7 @@ uint FIRFilterSSE::evaluateFilterStereo(float *dest, const float *source, uint n
     if (count < 2) return 0;
 
     assert((length % 8) == 0);
-    assert(((unsigned long)filterCoeffsAlign) % 16 == 0);
+    assert(((size_t)filterCoeffsAlign) % 16 == 0);
 
     // filter is evaluated for two stereo samples with each iteration, thus use of 'j += 2'
     for (j = 0; j < count; j += 2)
@@ -11,7 +11,7 @@
 
 #include <stdio.h>
 #include <memory.h>
-#include <util.h>
+#include "Util.h"
 #include <string.h>
 #include <math.h>
 
@@ -375,6 +375,22 @@ int AbstractAudioStream::getOutputPorts()
     return mOutputPorts;
 }
 
+int AbstractAudioStream::getInputPortChannels(int port)
+{
+    int channels = 2;
+    if (port >= 0 && port < AUDIO_MAX_PORTS)
+      channels = mInputs[port].getChannels();
+    return channels;
+}
+
+int AbstractAudioStream::getOutputPortChannels(int port)
+{
+    int channels = 2;
+    if (port >= 0 && port < AUDIO_MAX_PORTS)
+      channels = mOutputs[port].getChannels();
+    return channels;
+}
+
 /**
  * If the stream is already opened, it is closed.
  */
@@ -439,6 +439,11 @@ class AudioStream {
     virtual int getOutputPorts() = 0;
     //virtual AudioPort* getOutputPort(int p) = 0;
 
+    // the channels in one port, the buffers from getInterruptBuffers
+    // are interleaved with this many channels
+    virtual int getInputPortChannels(int port) { return 2; }
+    virtual int getOutputPortChannels(int port) { return 2; }
+
 	virtual void setSampleRate(int i) = 0;
 	virtual int getSampleRate() = 0;
 
@@ -497,6 +502,8 @@ class AbstractAudioStream : public AudioStream {
     int getInputPorts();
 	int getOutputChannels();
     int getOutputPorts();
+    int getInputPortChannels(int port);
+    int getOutputPortChannels(int port);
 
 	void setSampleRate(int i);
 	int getSampleRate();
@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2010 Jeffrey S. Larson  <jeff@circularlabs.com>
+ * All rights reserved.
+ * See the LICENSE file for the full copyright and license declaration.
+ *
+ * ---------------------------------------------------------------------
+ *
+ * AudioInterface with no devices, for offline rendering.
+ * See OfflineAudioInterface.h for why.
+ *
+ */
+
+#include <stdio.h>
+#include <memory.h>
+#include <string.h>
+
+#include "Util.h"
+#include "Trace.h"
+
+#include "OfflineAudioInterface.h"
+
+AUDIO_BEGIN_NAMESPACE
+
+//////////////////////////////////////////////////////////////////////
+//
+// Interface Factory
+//
+//////////////////////////////////////////////////////////////////////
+
+/**
+ * There are no exceptions to catch since we're not in a
+ * device callback, but Mobius wants to set this.
+ */
+PUBLIC bool AudioInterfaceCatchExceptions = true;
+
+AudioInterface* AudioInterface::Interface = NULL;
+
+AudioInterface* AudioInterface::getInterface()
+{
+	if (Interface == NULL) {
+		Interface = new OfflineAudioInterface();
+	}
+	return Interface;
+}
+
+void AudioInterface::exit()
+{
+	if (Interface != NULL) {
+		Interface->terminate();
+		delete Interface;
+		Interface = NULL;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// OfflineAudioInterface
+//
+//////////////////////////////////////////////////////////////////////
+
+OfflineAudioInterface::OfflineAudioInterface()
+{
+	mStream = NULL;
+}
+
+OfflineAudioInterface::~OfflineAudioInterface()
+{
+	delete mStream;
+}
+
+/**
+ * Unlike the device interfaces there is only one stream, the
+ * owner needs to get back to the one Recorder is using.
+ */
+AudioStream* OfflineAudioInterface::getStream()
+{
+	if (mStream == NULL)
+	  mStream = new OfflineAudioStream(this);
+	return mStream;
+}
+
+void OfflineAudioInterface::terminate()
+{
+	if (mStream != NULL)
+	  mStream->close();
+}
+
+/**
+ * One stereo device in both directions.
+ */
+AudioDevice** OfflineAudioInterface::getDevices()
+{
+	if (mDevices == NULL) {
+		mDeviceCount = 1;
+		mDevices = new AudioDevice*[mDeviceCount + 1];
+		mDevices[mDeviceCount] = NULL;
+
+		AudioDevice* dev = new AudioDevice();
+		dev->setApi(API_UNKNOWN);
+		dev->setId(0);
+		dev->setName(OFFLINE_DEVICE_NAME);
+		dev->setInputChannels(2);
+		dev->setOutputChannels(2);
+		dev->setDefaultInput(true);
+		dev->setDefaultOutput(true);
+		dev->setDefaultSampleRate((float)CD_SAMPLE_RATE);
+		mDevices[0] = dev;
+	}
+	return mDevices;
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// OfflineAudioStream
+//
+//////////////////////////////////////////////////////////////////////
+
+OfflineAudioStream::OfflineAudioStream(OfflineAudioInterface* ai)
+{
+	mInterface = ai;
+	mTotalFrames = 0;
+	mInterruptFrame = 0;
+	mTime.init();
+
+	// start out bound to the only device
+	mInputDevice = 0;
+	mOutputDevice = 0;
+	setInputChannels(2);
+	setOutputChannels(2);
+}
+
+OfflineAudioStream::~OfflineAudioStream()
+{
+	close();
+}
+
+bool OfflineAudioStream::open()
+{
+	if (!mStreamStarted) {
+		mStreamStarted = true;
+		mTotalFrames = 0;
+		mInterrupts = 0;
+	}
+	return true;
+}
+
+void OfflineAudioStream::close()
+{
+	mStreamStarted = false;
+}
+
+bool OfflineAudioStream::isOpen()
+{
+	return mStreamStarted;
+}
+
+long long OfflineAudioStream::getFrames()
+{
+	return mTotalFrames;
+}
+
+/**
+ * Stream time in seconds, derived from the frames we've
+ * been given rather than the clock.
+ */
+double OfflineAudioStream::getStreamTime()
+{
+	return (double)mTotalFrames / (double)mSampleRate;
+}
+
+double OfflineAudioStream::getLastInterruptStreamTime()
+{
+	return (double)mInterruptFrame / (double)mSampleRate;
+}
+
+/**
+ * Run one interrupt.  Input and output are interleaved stereo
+ * and the frame count must not exceed AUDIO_MAX_FRAMES_PER_BUFFER.
+ * Input may be NULL for silence.  Output is cleared before the
+ * handler is called, same as the device streams.
+ */
+void OfflineAudioStream::processBuffers(float* input, float* output,
+										long frames)
+{
+	if (!mStreamStarted || mHandler == NULL)
+	  return;
+
+	if (frames > AUDIO_MAX_FRAMES_PER_BUFFER) {
+		Trace(1, "OfflineAudioStream: block too large %ld\n", frames);
+		frames = AUDIO_MAX_FRAMES_PER_BUFFER;
+	}
+
+	mInterrupts++;
+	mInterruptFrame = mTotalFrames;
+
+	// the handler expects to always have an input buffer
+	float* in = input;
+	if (in == NULL) {
+		in = mInputs[0].prepare(frames);
+		memset(in, 0, frames * 2 * sizeof(float));
+	}
+
+	mInput = in;
+	mOutput = output;
+	mFrames = frames;
+
+	if (output != NULL)
+	  memset(output, 0, frames * 2 * sizeof(float));
+
+	// this will make calls to getInterruptBuffers
+	mHandler->processAudioBuffers(this);
+
+	mTotalFrames += frames;
+}
+
+long OfflineAudioStream::getInterruptFrames()
+{
+	return mFrames;
+}
+
+/**
+ * There is only one port, everything comes from and goes to
+ * the buffers passed to processBuffers.
+ */
+void OfflineAudioStream::getInterruptBuffers(int inport, float** inbuf,
+											 int outport, float** outbuf)
+{
+	if (inbuf != NULL)
+	  *inbuf = mInput;
+
+	if (outbuf != NULL)
+	  *outbuf = mOutput;
+}
+
+AudioTime* OfflineAudioStream::getTime()
+{
+	return &mTime;
+}
+
+AUDIO_END_NAMESPACE
+
+/****************************************************************************/
+/****************************************************************************/
+/****************************************************************************/
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2010 Jeffrey S. Larson  <jeff@circularlabs.com>
+ * All rights reserved.
+ * See the LICENSE file for the full copyright and license declaration.
+ *
+ * ---------------------------------------------------------------------
+ *
+ * An AudioInterface with no devices.  The stream never receives
+ * interrupts on its own, whoever owns it calls processBuffers with
+ * blocks of input and output as fast as they like.
+ *
+ * Used on Linux for the offline render engine and benchmarks,
+ * this takes the place of the PortAudio interfaces so only one
+ * may be linked.
+ *
+ */
+
+#ifndef OFFLINE_AUDIO_INTERFACE_H
+#define OFFLINE_AUDIO_INTERFACE_H
+
+#include "AudioInterface.h"
+
+AUDIO_BEGIN_NAMESPACE
+
+/**
+ * Name of the one device we pretend to have.
+ */
+#define OFFLINE_DEVICE_NAME "Offline"
+
+class OfflineAudioInterface : public AbstractAudioInterface {
+  public:
+
+	OfflineAudioInterface();
+	~OfflineAudioInterface();
+
+	AudioDevice** getDevices();
+	AudioStream* getStream();
+	void terminate();
+
+  private:
+
+	class OfflineAudioStream* mStream;
+
+};
+
+class OfflineAudioStream : public AbstractAudioStream {
+
+  public:
+
+	OfflineAudioStream(OfflineAudioInterface* ai);
+	~OfflineAudioStream();
+
+	bool open();
+	void close();
+
+    double getStreamTime();
+    double getLastInterruptStreamTime();
+
+	// AudioHandler callbacks
+
+	long getInterruptFrames();
+	void getInterruptBuffers(int inport, float** inbuf,
+							 int outport, float** outbuf);
+	AudioTime* getTime();
+
+	// extended operations
+
+	void processBuffers(float* input, float* output, long frames);
+	long long getFrames();
+	bool isOpen();
+
+  private:
+
+	/**
+	 * Time info passed to the handler.  There is no host so this
+	 * is always stopped.
+	 */
+	AudioTime mTime;
+
+	/**
+	 * Total frames processed since the stream was opened.
+	 */
+	long long mTotalFrames;
+
+	/**
+	 * Frame count at the start of the current interrupt.
+	 */
+	long long mInterruptFrame;
+
+};
+
+AUDIO_END_NAMESPACE
+
+/****************************************************************************/
+/****************************************************************************/
+/****************************************************************************/
+#endif
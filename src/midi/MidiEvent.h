@@ -15,7 +15,7 @@
 #define MIDI_EVENT_H
 
 // need this for some inline methods
-#include "midibyte.h"
+#include "MidiByte.h"
 
 /**
  * Interface of something that owns the event, used when freeing events.
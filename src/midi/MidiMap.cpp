@@ -15,10 +15,10 @@
 #include <stdio.h>
 #include <string.h>
 
-#include "port.h"
+#include "Port.h"
 #include "List.h"
 
-#include "midibyte.h"
+#include "MidiByte.h"
 #include "MidiMap.h"
 
 /****************************************************************************
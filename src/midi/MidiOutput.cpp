@@ -12,7 +12,7 @@
 
 #include <stdio.h>
 
-#include "util.h"
+#include "Util.h"
 #include "Trace.h"
 
 #include "MidiEnv.h"
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2010 Jeffrey S. Larson  <jeff@circularlabs.com>
+ * All rights reserved.
+ * See the LICENSE file for the full copyright and license declaration.
+ *
+ * ---------------------------------------------------------------------
+ *
+ * Headless implementation of MidiEnv.
+ * See NullMidiEnv.h for why.
+ *
+ */
+
+#include <stdio.h>
+
+#include "Port.h"
+#include "Util.h"
+#include "Thread.h"
+#include "Trace.h"
+
+#include "NullMidiEnv.h"
+
+//////////////////////////////////////////////////////////////////////
+//
+// NullMidiEnv
+//
+//////////////////////////////////////////////////////////////////////
+
+/**
+ * This is a singleton factory method that creates a platform-specific
+ * subclass of MidiEnv.  Only one of the platform files may be linked.
+ */
+PUBLIC MidiEnv* MidiEnv::getEnv()
+{
+    if (mSingleton == NULL)
+      mSingleton = new NullMidiEnv();
+    return mSingleton;
+}
+
+PRIVATE NullMidiEnv::NullMidiEnv()
+{
+}
+
+PRIVATE NullMidiEnv::~NullMidiEnv()
+{
+}
+
+/**
+ * There are no devices.
+ */
+PUBLIC void NullMidiEnv::loadDevices()
+{
+}
+
+PUBLIC MidiTimer* NullMidiEnv::newMidiTimer()
+{
+	return new NullMidiTimer(this);
+}
+
+/**
+ * These shouldn't be called since we have no ports.
+ */
+PUBLIC MidiInput* NullMidiEnv::newMidiInput(MidiPort* port)
+{
+	Trace(1, "NullMidiEnv: no MIDI input devices\n");
+	return NULL;
+}
+
+PUBLIC MidiOutput* NullMidiEnv::newMidiOutput(MidiPort* port)
+{
+	Trace(1, "NullMidiEnv: no MIDI output devices\n");
+	return NULL;
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// NullMidiTimer
+//
+//////////////////////////////////////////////////////////////////////
+
+PUBLIC NullMidiTimer::NullMidiTimer(NullMidiEnv* env) : MidiTimer(env)
+{
+	mRunning = false;
+}
+
+PUBLIC NullMidiTimer::~NullMidiTimer()
+{
+	stop();
+}
+
+/**
+ * MidiTimer overload to get the timer started.
+ * There is no thread, we just start accepting advance() calls.
+ */
+PUBLIC bool NullMidiTimer::start()
+{
+	mRunning = true;
+	return true;
+}
+
+PUBLIC void NullMidiTimer::stop(void)
+{
+	mRunning = false;
+}
+
+PUBLIC bool NullMidiTimer::isRunning(void)
+{
+    return mRunning;
+}
+
+/**
+ * Simulate the passage of time.  This is what the timer thread
+ * would have done on the other platforms, one interrupt per
+ * millisecond.
+ */
+PUBLIC void NullMidiTimer::advance(int millis)
+{
+	if (mRunning) {
+		for (int i = 0 ; i < millis ; i++)
+		  interrupt();
+	}
+}
+
+/****************************************************************************/
+/****************************************************************************/
+/****************************************************************************/
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2010 Jeffrey S. Larson  <jeff@circularlabs.com>
+ * All rights reserved.
+ * See the LICENSE file for the full copyright and license declaration.
+ *
+ * ---------------------------------------------------------------------
+ *
+ * Headless implementation of the MidiEnv with no devices.
+ *
+ * Used on Linux for the offline render engine.  There are no ports
+ * and the timer has no thread, whoever is driving the application
+ * calls NullMidiTimer::advance to move the millisecond clock forward.
+ * This keeps MIDI clock sync deterministic when we're running
+ * faster than real time.
+ *
+ */
+
+#ifndef NULL_MIDI_ENV_H
+#define NULL_MIDI_ENV_H
+
+#include "MidiEnv.h"
+#include "MidiPort.h"
+#include "MidiTimer.h"
+
+class NullMidiEnv : public MidiEnv {
+
+	friend class MidiEnv;
+
+  public:
+
+	// the required virtual overloads
+
+	void loadDevices();
+	class MidiTimer* newMidiTimer();
+	class MidiInput* newMidiInput(class MidiPort* port);
+	class MidiOutput* newMidiOutput(class MidiPort* port);
+
+  protected:
+
+	NullMidiEnv();
+	~NullMidiEnv();
+
+};
+
+class NullMidiTimer : public MidiTimer
+{
+  public:
+
+	NullMidiTimer(NullMidiEnv* env);
+	~NullMidiTimer();
+
+	bool start();
+	void stop();
+	bool isRunning();
+
+	// extended operations
+
+	void advance(int millis);
+
+  private:
+
+	bool mRunning;
+
+};
+
+/****************************************************************************/
+/****************************************************************************/
+/****************************************************************************/
+#endif
@@ -18,6 +18,7 @@
 #include "Util.h"
 #include "Trace.h"
 #include "List.h"
+#include "Thread.h"
 #include "MessageCatalog.h"
 
 #include "MidiByte.h"
@@ -970,20 +971,67 @@ PUBLIC void Action::detachEvent()
 
 ActionPool::ActionPool()
 {
-    mActions = NULL;
+    // each pool has its own key, freed with the pool
+    mCacheKey = ThreadLocalAlloc();
+    mSharedCsect = new CriticalSection("ActionPool");
+    mInterruptSaved = NULL;
+
+    for (int i = 0 ; i < ACTION_POOL_MAX_CACHES ; i++) {
+        ActionCache* cache = &mCaches[i];
+        cache->owned = 0;
+        cache->actions = NULL;
+        cache->count = 0;
+    }
+
+    for (int i = 0 ; i < ACTION_POOL_MAX_BATCHES ; i++)
+      mBatches[i] = NULL;
+
     mAllocated = 0;
+    mHeapAllocs = 0;
+    mRefills = 0;
+    mSpills = 0;
+
+    // construct the initial actions now so nobody has to later
+    Action* batch = NULL;
+    int count = 0;
+    for (int i = 0 ; i < ACTION_POOL_INITIAL ; i++) {
+        Action* action = new Action();
+        action->setPool(this);
+        action->setPooled(true);
+        action->setNext(batch);
+        batch = action;
+        mAllocated++;
+        count++;
+        if (count == ACTION_POOL_BATCH || i == ACTION_POOL_INITIAL - 1) {
+            if (!addBatch(batch))
+              delete batch;
+            batch = NULL;
+            count = 0;
+        }
+    }
 }
 
+/**
+ * Deleting the first action deletes the chain.
+ * Actions still in use are not ours to delete.
+ */
 ActionPool::~ActionPool()
 {
-    delete mActions;
+    for (int i = 0 ; i < ACTION_POOL_MAX_CACHES ; i++)
+      delete mCaches[i].actions;
+
+    for (int i = 0 ; i < ACTION_POOL_MAX_BATCHES ; i++)
+      delete mBatches[i];
+
+    delete mSharedCsect;
+
+    // threads that still point to our caches forget them
+    ThreadLocalFree(mCacheKey);
 }
 
 /**
  * Allocate a new action, using the pool if possible.
- * Note that this is not managed a csect, it should only be called
- * by Mobius which uses maintains a single app/interrupt coordination
- * csect.
+ * This may be called by any thread including the interrupt.
  */
 PUBLIC Action* ActionPool::newAction()
 {
@@ -995,17 +1043,135 @@ PUBLIC Action* ActionPool::newAction(Action* src)
     return allocAction(src);
 }
 
+/**
+ * Locate the cache for this thread, claiming one the first time.
+ * The interrupt and the workers have theirs set before they get here.
+ */
+PRIVATE ActionCache* ActionPool::getCache()
+{
+    ActionCache* cache = NULL;
+
+    if (mCacheKey >= 0) {
+        cache = (ActionCache*)ThreadLocalGet(mCacheKey);
+        if (cache == NULL) {
+            cache = claimCache();
+            ThreadLocalSet(mCacheKey, cache);
+        }
+    }
+
+    if (cache == NULL)
+      cache = &mCaches[ACTION_CACHE_SHARED];
+
+    return cache;
+}
+
+/**
+ * Claim one of the caches not reserved for the interrupt.
+ * If they're all taken we use the shared cache and must
+ * enter the csect, it is remembered so we don't search every time.
+ */
+PRIVATE ActionCache* ActionPool::claimCache()
+{
+    ActionCache* cache = NULL;
+
+    for (int i = ACTION_CACHE_THREADS ; i < ACTION_POOL_MAX_CACHES && cache == NULL ; i++) {
+        ActionCache* c = &mCaches[i];
+        if (c->owned == 0 && AtomicCompareAndSwap(&(c->owned), 0, 1))
+          cache = c;
+    }
+
+    if (cache == NULL) {
+        Trace(2, "ActionPool: Out of caches, sharing\n");
+        cache = &mCaches[ACTION_CACHE_SHARED];
+    }
+
+    return cache;
+}
+
+/**
+ * Called by Mobius at the start of the interrupt.  The host may 
+ * call us from a different thread each time, so rather than 
+ * claiming a cache the interrupt cache is lent to whichever thread 
+ * this is until exitInterrupt, and the cache it had is put back then.
+ */
+PUBLIC void ActionPool::enterInterrupt()
+{
+    if (mCacheKey >= 0) {
+        mInterruptSaved = ThreadLocalGet(mCacheKey);
+        ThreadLocalSet(mCacheKey, &mCaches[ACTION_CACHE_INTERRUPT]);
+    }
+}
+
+PUBLIC void ActionPool::exitInterrupt()
+{
+    if (mCacheKey >= 0 && 
+        ThreadLocalGet(mCacheKey) == &mCaches[ACTION_CACHE_INTERRUPT]) {
+        ThreadLocalSet(mCacheKey, mInterruptSaved);
+        mInterruptSaved = NULL;
+    }
+}
+
+/**
+ * Called by a RecorderWorker before it processes tracks for the 
+ * first time.  There is one cache reserved for each.
+ */
+PUBLIC void ActionPool::claimWorker(int number)
+{
+    if (number < 1 || number > ACTION_POOL_WORKER_CACHES)
+      Trace(1, "ActionPool: Invalid worker %ld\n", (long)number);
+    else if (mCacheKey >= 0)
+      ThreadLocalSet(mCacheKey, &mCaches[ACTION_CACHE_WORKERS + number - 1]);
+}
+
+/**
+ * Called by threads we start as they end.  A claimed cache is 
+ * released with whatever actions are still in it, the next thread
+ * to claim it takes those too.  Reserved caches just stop being
+ * ours.
+ */
+PUBLIC void ActionPool::threadEnding()
+{
+    if (mCacheKey >= 0) {
+        ActionCache* cache = (ActionCache*)ThreadLocalGet(mCacheKey);
+        if (cache != NULL) {
+            ThreadLocalSet(mCacheKey, NULL);
+            if (cache >= &mCaches[ACTION_CACHE_THREADS]) {
+                AtomicBarrier();
+                cache->owned = 0;
+            }
+        }
+    }
+}
+
 PRIVATE Action* ActionPool::allocAction(Action* src)
 {
-    Action* action = mActions;
+    ActionCache* cache = getCache();
+    bool shared = (cache == &mCaches[ACTION_CACHE_SHARED]);
+    Action* action = NULL;
+
+    if (shared)
+      mSharedCsect->enter("allocAction");
+
+    if (cache->actions == NULL)
+      refill(cache);
+
+    action = cache->actions;
+    if (action != NULL) {
+        cache->actions = action->getNext();
+        cache->count--;
+    }
+
+    if (shared)
+      mSharedCsect->leave("allocAction");
 
     if (action == NULL) {
+        // shared pool is empty too
         action = new Action(src);
         action->setPool(this);
-        mAllocated++;
+        AtomicIncrement(&mAllocated);
+        AtomicIncrement(&mHeapAllocs);
     }
     else {
-        mActions = action->getNext();
         action->setNext(NULL);
         action->setPooled(false);
         if (src != NULL)
@@ -1017,14 +1183,16 @@ PRIVATE Action* ActionPool::allocAction(Action* src)
     return action;
 }
 
+/**
+ * Return an action to this thread's cache, it may have been
+ * allocated by a different thread.
+ */
 PUBLIC void ActionPool::freeAction(Action* action)
 {
     if (action != NULL) {
         if (action->isPooled())
           Trace(1, "Ignoring attempt to free pooled action\n");
         else {
-            action->setNext(mActions);
-            mActions = action;
             action->setPooled(true);
 
             // Release script args now or wait till it is brought
@@ -1033,19 +1201,272 @@ PUBLIC void ActionPool::freeAction(Action* action)
             action->scriptArgs = NULL;
             // this is transient
             action->setTargetTrack(NULL);
+
+            ActionCache* cache = getCache();
+            bool shared = (cache == &mCaches[ACTION_CACHE_SHARED]);
+            if (shared)
+              mSharedCsect->enter("freeAction");
+
+            action->setNext(cache->actions);
+            cache->actions = action;
+            cache->count++;
+
+            // threads that mostly free, like the interrupt, give back
+            if (cache->count >= ACTION_POOL_BATCH * 3)
+              spill(cache);
+
+            if (shared)
+              mSharedCsect->leave("freeAction");
         }
     }
 }
 
+/**
+ * Take a batch from the shared pool.
+ */
+PRIVATE bool ActionPool::refill(ActionCache* cache)
+{
+    bool refilled = false;
+
+    for (int i = 0 ; i < ACTION_POOL_MAX_BATCHES && !refilled ; i++) {
+        if (mBatches[i] != NULL) {
+            Action* batch = (Action*)
+                AtomicExchangePointer((void* volatile*)&mBatches[i], NULL);
+            if (batch != NULL) {
+                Action* last = batch;
+                int count = 1;
+                while (last->getNext() != NULL) {
+                    last = last->getNext();
+                    count++;
+                }
+                last->setNext(cache->actions);
+                cache->actions = batch;
+                cache->count += count;
+                AtomicIncrement(&mRefills);
+                refilled = true;
+            }
+        }
+    }
+
+    return refilled;
+}
+
+/**
+ * Give a batch back to the shared pool.  If the pool is full 
+ * we keep them.
+ */
+PRIVATE void ActionPool::spill(ActionCache* cache)
+{
+    Action* batch = cache->actions;
+    Action* last = batch;
+    for (int i = 1 ; i < ACTION_POOL_BATCH ; i++)
+      last = last->getNext();
+
+    Action* rest = last->getNext();
+    last->setNext(NULL);
+
+    if (addBatch(batch)) {
+        cache->actions = rest;
+        cache->count -= ACTION_POOL_BATCH;
+        AtomicIncrement(&mSpills);
+    }
+    else
+      last->setNext(rest);
+}
+
+/**
+ * Put a batch in an empty slot.
+ */
+PRIVATE bool ActionPool::addBatch(Action* batch)
+{
+    bool added = false;
+
+    for (int i = 0 ; i < ACTION_POOL_MAX_BATCHES && !added ; i++) {
+        if (mBatches[i] == NULL &&
+            AtomicCompareAndSwapPointer((void* volatile*)&mBatches[i], 
+                                        NULL, batch))
+          added = true;
+    }
+
+    return added;
+}
+
+/**
+ * Called at shutdown, the counts may be off if other threads
+ * are still using the pool.
+ */
 PUBLIC void ActionPool::dump()
 {
     int count = 0;
 
-    for (Action* a = mActions ; a != NULL ; a = a->getNext())
-      count++;
+    for (int i = 0 ; i < ACTION_POOL_MAX_CACHES ; i++)
+      count += mCaches[i].count;
+
+    for (int i = 0 ; i < ACTION_POOL_MAX_BATCHES ; i++) {
+        for (Action* a = mBatches[i] ; a != NULL ; a = a->getNext())
+          count++;
+    }
+
+    printf("ActionPool: %d allocated, %d in the pool, %d in use, %d heap allocations, %d refills, %d spills\n", 
+           mAllocated, count, mAllocated - count, mHeapAllocs, 
+           mRefills, mSpills);
+}
+
+/****************************************************************************
+ *                                                                          *
+ *                               ACTION QUEUE                               *
+ *                                                                          *
+ ****************************************************************************/
+
+/*
+ * This is the usual bounded queue with a sequence number in each cell.
+ * Producers claim a position with a compare and swap on mAddPosition,
+ * fill the cell, then publish it by advancing the cell sequence.
+ * The consumer only looks at the cell sequence so it never waits on
+ * a producer, if the next cell is claimed but not yet published we
+ * stop there and pick it up on the next interrupt.
+ *
+ * Positions are free running counters, differences are computed
+ * unsigned so they survive wrapping.
+ */
+
+PUBLIC ActionQueue::ActionQueue()
+{
+    init(ACTION_QUEUE_SIZE);
+}
+
+PUBLIC ActionQueue::ActionQueue(int size)
+{
+    init(size);
+}
+
+PRIVATE void ActionQueue::init(int size)
+{
+    // round up to a power of two
+    mSize = 2;
+    while (mSize < size)
+      mSize *= 2;
+    mMask = mSize - 1;
+
+    mCells = new ActionCell[mSize];
+    for (int i = 0 ; i < mSize ; i++) {
+        mCells[i].sequence = i;
+        mCells[i].action = NULL;
+    }
+
+    mAddPosition = 0;
+    mRemovePosition = 0;
+    mOverflows = 0;
+    mHighWater = 0;
+}
+
+/**
+ * The owner is expected to have removed and freed the actions,
+ * they belong to an ActionPool.
+ */
+PUBLIC ActionQueue::~ActionQueue()
+{
+    delete mCells;
+}
+
+/**
+ * Add an action to the queue.  May be called from any thread.
+ * Returns false if the queue is full, the caller still owns the action.
+ */
+PUBLIC bool ActionQueue::add(Action* a)
+{
+    bool added = false;
+    bool full = false;
+    ActionCell* cell = NULL;
+    int pos = mAddPosition;
+
+    while (!added && !full) {
+        cell = &mCells[pos & mMask];
+        int seq = cell->sequence;
+        int dif = (int)((unsigned int)seq - (unsigned int)pos);
+        if (dif == 0) {
+            // cell is free, try to claim it
+            if (AtomicCompareAndSwap(&mAddPosition, pos, 
+                                     (int)((unsigned int)pos + 1)))
+              added = true;
+            else
+              pos = mAddPosition;
+        }
+        else if (dif < 0) {
+            // the consumer hasn't gotten to this one yet
+            full = true;
+        }
+        else {
+            // another producer got here first
+            pos = mAddPosition;
+        }
+    }
+
+    if (added) {
+        cell->action = a;
+        // action must be visible before the sequence
+        AtomicBarrier();
+        cell->sequence = (int)((unsigned int)pos + 1);
+    }
+    else {
+        AtomicIncrement(&mOverflows);
+    }
+
+    return added;
+}
+
+/**
+ * Remove the next action.  Only called by the interrupt.
+ * Returns NULL if the queue is empty or the next action
+ * is still being added.
+ */
+PUBLIC Action* ActionQueue::remove()
+{
+    Action* action = NULL;
+    int pos = mRemovePosition;
+    ActionCell* cell = &mCells[pos & mMask];
+    int seq = cell->sequence;
+
+    if (seq == (int)((unsigned int)pos + 1)) {
+        // don't read the action until we've seen the sequence
+        AtomicBarrier();
+        action = cell->action;
+        cell->action = NULL;
+
+        // depth includes the one we're taking
+        int depth = (int)((unsigned int)mAddPosition - (unsigned int)pos);
+        if (depth > mHighWater)
+          mHighWater = depth;
+
+        mRemovePosition = (int)((unsigned int)pos + 1);
+        AtomicBarrier();
+        // free for the producer that wraps around to it
+        cell->sequence = (int)((unsigned int)pos + mSize);
+    }
+
+    return action;
+}
+
+/**
+ * Number of actions rejected because the queue was full.
+ */
+PUBLIC int ActionQueue::getOverflows()
+{
+    return mOverflows;
+}
+
+/**
+ * Largest number of actions seen waiting at one time.
+ */
+PUBLIC int ActionQueue::getHighWater()
+{
+    return mHighWater;
+}
 
-    printf("ActionPool: %d allocated, %d in the pool, %d in use\n", 
-           mAllocated, count, mAllocated - count);
+PUBLIC void ActionQueue::dump()
+{
+    printf("ActionQueue: %d size, %d high water, %d overflows\n",
+           mSize, mHighWater, (int)mOverflows);
 }
 
 /****************************************************************************/
@@ -638,6 +638,86 @@ class Action {
  *                                                                          *
  ****************************************************************************/
 
+/**
+ * Number of actions constructed when the pool is created.
+ */
+#define ACTION_POOL_INITIAL 256
+
+/**
+ * Number of actions moved between a thread's cache and the
+ * shared pool at once.
+ */
+#define ACTION_POOL_BATCH 16
+
+/**
+ * Maximum number of batches held by the shared pool, 
+ * beyond this the caches keep what they have.
+ */
+#define ACTION_POOL_MAX_BATCHES 64
+
+/**
+ * The cache shared under a csect by threads that couldn't
+ * get one of their own.
+ */
+#define ACTION_CACHE_SHARED 0
+
+/**
+ * The cache used by whichever thread is running the interrupt,
+ * only for the duration of the interrupt.
+ */
+#define ACTION_CACHE_INTERRUPT 1
+
+/**
+ * The first of the caches reserved for RecorderWorkers, which
+ * process tracks for the interrupt.  Worker n uses
+ * ACTION_CACHE_WORKERS + n - 1.  This must be at least
+ * MAX_RECORDER_WORKERS.
+ */
+#define ACTION_CACHE_WORKERS 2
+#define ACTION_POOL_WORKER_CACHES 16
+
+/**
+ * The first of the caches claimed by other threads, the MIDI,
+ * OSC, UI and MobiusThread threads and whatever else the host
+ * calls us from.
+ */
+#define ACTION_CACHE_THREADS (ACTION_CACHE_WORKERS + ACTION_POOL_WORKER_CACHES)
+
+/**
+ * Number of caches claimed by other threads.  Threads we start 
+ * give theirs back when they end, beyond this the others share
+ * ACTION_CACHE_SHARED.
+ */
+#define ACTION_POOL_THREAD_CACHES 10
+
+#define ACTION_POOL_MAX_CACHES (ACTION_CACHE_THREADS + ACTION_POOL_THREAD_CACHES)
+
+/**
+ * Actions owned by one thread.  Only the owner touches the
+ * list so there is no locking.  A thread that ends leaves its
+ * actions for the next one to claim the cache.
+ */
+typedef struct {
+
+    volatile int owned;
+    Action* actions;
+    int count;
+
+} ActionCache;
+
+/**
+ * Pool of actions shared by all threads.
+ *
+ * Each thread that allocates or frees actions claims its own 
+ * ActionCache the first time and allocates from that without 
+ * a lock.  The interrupt and the RecorderWorkers have caches
+ * reserved for them so they never wait for the shared one.
+ * When a cache runs dry it takes a whole batch from the
+ * shared pool, and when it has two batches too many it gives one 
+ * back.  Batches are held in slots that are taken and filled with
+ * atomic exchange so nobody waits, only when the shared pool is
+ * empty do we go to the heap.
+ */
 class ActionPool {
 
   public:
@@ -649,15 +729,101 @@ class ActionPool {
     Action* newAction(Action* src);
     void freeAction(Action* a);
 
+    // interrupt
+    void enterInterrupt();
+    void exitInterrupt();
+
+    // RecorderWorker n, starting from 1
+    void claimWorker(int number);
+
+    // any thread we started, as it ends
+    void threadEnding();
+
     void dump();
 
   private:
 
     Action* allocAction(Action* src);
+    ActionCache* getCache();
+    ActionCache* claimCache();
+    bool refill(ActionCache* cache);
+    void spill(ActionCache* cache);
+    bool addBatch(Action* batch);
+
+    // thread local key holding the thread's cache
+    int mCacheKey;
+    ActionCache mCaches[ACTION_POOL_MAX_CACHES];
+    class CriticalSection* mSharedCsect;
+
+    // what the interrupt thread was using outside the interrupt
+    void* mInterruptSaved;
+
+    Action* volatile mBatches[ACTION_POOL_MAX_BATCHES];
+
+    // statistics
+    volatile int mAllocated;
+    volatile int mHeapAllocs;
+    volatile int mRefills;
+    volatile int mSpills;
+
+};
+
+/****************************************************************************
+ *                                                                          *
+ *                               ACTION QUEUE                               *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * Default number of actions that can be waiting for the interrupt.
+ * Must be a power of two.
+ */
+#define ACTION_QUEUE_SIZE 256
+
+/**
+ * Bounded lock free queue of actions waiting for the interrupt.
+ * Any number of threads may add, only the interrupt removes.
+ * Actions from one thread are removed in the order they were added.
+ */
+class ActionQueue {
+
+  public:
+
+    ActionQueue();
+    ActionQueue(int size);
+    ~ActionQueue();
+
+    bool add(Action* a);
+    Action* remove();
+
+    int getOverflows();
+    int getHighWater();
+    void dump();
+
+  private:
+
+    void init(int size);
+
+    /**
+     * Each cell has a sequence number that tells producers and the
+     * consumer whose turn it is.  A cell at position p is free for
+     * a producer when the sequence is p, and ready for the consumer
+     * when it is p+1.
+     */
+    typedef struct {
+        volatile int sequence;
+        Action* action;
+    } ActionCell;
+
+    ActionCell* mCells;
+    int mSize;
+    int mMask;
 
-    Action* mActions;
-    int mAllocated;
+    volatile int mAddPosition;
+    int mRemovePosition;
 
+    volatile int mOverflows;
+    int mHighWater;
 
 };
 
@@ -15,7 +15,7 @@
 #include <memory.h>
 
 #include "Trace.h"
-#include "util.h"
+#include "Util.h"
 #include "Thread.h"
 #include "WaveFile.h"
 
@@ -26,6 +26,7 @@
 
 #include "Audio.h"
 #include "ObjectPool.h"
+#include "Reclaimer.h"
 
 /****************************************************************************
  *                                                                          *
@@ -137,12 +138,23 @@ void Audio::init()
 	mPlay = new AudioCursor("Play", this);
 	mRecord = new AudioCursor("Record", this);
 	mRecord->setAutoExtend(true);
+
+	mSource = NULL;
+	mSourceIndex = 0;
+	mSourceBlocks = 0;
+	mSourceStates = NULL;
+	mSourceStateSize = 0;
+	mSourcePending = 0;
+
+	mRetired = NULL;
+	mRetiredEpoch = 0;
 }
 
 PUBLIC Audio::~Audio() 
 {
 	freeBuffers();
 	delete mBuffers;
+	delete mSourceStates;
 	delete mPlay;
 	delete mRecord;
 }
@@ -190,7 +202,8 @@ PUBLIC void Audio::setChannels(int i)
  */
 PUBLIC bool Audio::isEmpty()
 {
-	bool empty = true;
+	// source blocks are only pending if they have something in them
+	bool empty = (mSourcePending == 0);
 	for (int i = 0 ; i < mBufferCount && empty ; i++) {
 		if (mBuffers[i] != NULL)
 		  empty = false;
@@ -219,6 +232,7 @@ PUBLIC void Audio::reset()
  */
 PUBLIC void Audio::zero() 
 {
+	releaseSource();
 	for (int i = 0 ; i < mBufferCount ; i++) {
 		freeBuffer(mBuffers[i]);
 		mBuffers[i] = NULL;
@@ -279,6 +293,7 @@ void Audio::initIndex()
  */
 void Audio::freeBuffers() 
 {
+	releaseSource();
 	if (mBuffers != NULL) {
 		for (int i = 0 ; i < mBufferCount ; i++) {
 			freeBuffer(mBuffers[i]);
@@ -324,8 +339,10 @@ void Audio::growIndex(int count, bool up)
 		mBuffers = buffers;
 
 		// when growing up, the current content range must also be adjusted
-		if (up)
-		  mStartFrame += (count * (mBufferSize / mChannels));
+		if (up) {
+			mStartFrame += (count * (mBufferSize / mChannels));
+			mSourceIndex += count;
+		}
 
 		mVersion++;
 	}
@@ -364,27 +381,81 @@ void Audio::prepareIndexFrame(long frame)
  */
 float* Audio::getBuffer(int i) 
 {
-	return ((i >= 0 && i < mBufferCount) ? mBuffers[i] : NULL);
+	float* buffer = NULL;
+	if (i >= 0 && i < mBufferCount) {
+		buffer = mBuffers[i];
+		if (buffer == NULL && mSourcePending > 0) {
+			faultBuffer(i);
+			buffer = mBuffers[i];
+		}
+	}
+	return buffer;
 }
 
 /**
  * Return the buffer at a given index, allocating one if necessary.
+ * The buffer returned may be modified, if it was shared we make
+ * a private copy.
  */
 float *Audio::allocBuffer(int index) 
 {
 	float* buffer;
 
 	prepareIndex(index);
-	buffer = mBuffers[index];
+	buffer = getBuffer(index);
 	if (buffer == NULL) {
 		buffer = allocBuffer();
 		mBuffers[index] = buffer;
 		mVersion++;
 	}
+	else if (isShared(buffer)) {
+		buffer = getWritableBuffer(index);
+	}
 
 	return buffer;
 }
 
+/**
+ * Return the existing buffer at a given index so that it can be
+ * modified.  If it is being shared with another Audio, we replace
+ * it with a copy and drop our reference to the shared one.  Since
+ * this changes the index, cursors will have to relocate.
+ *
+ * This may be called in the interrupt.  Record layers start out
+ * with their own empty Audio so they never have shared buffers, the
+ * copies happen when a deferred fade or a truncation touches a
+ * finalized layer whose buffers were shared with a project save
+ * or LayerCompressor.  That is normally just the edge buffers, but
+ * it is a memcpy of a whole buffer so the pool counts them.
+ */
+float* Audio::getWritableBuffer(int index)
+{
+	float* buffer = getBuffer(index);
+
+	if (buffer != NULL && isShared(buffer)) {
+		int copies = mPool->countWriteCopy();
+		Trace(2, "Audio: Copying shared buffer %ld, %ld copies\n",
+			  (long)index, (long)copies);
+		float* copy = allocBuffer();
+		memcpy(copy, buffer, mBufferSize * sizeof(float));
+		freeBuffer(buffer);
+		mBuffers[index] = copy;
+		mVersion++;
+		buffer = copy;
+	}
+
+	return buffer;
+}
+
+/**
+ * True if a buffer is also being used by another Audio.
+ * Buffers allocated without a pool are never shared.
+ */
+bool Audio::isShared(float* buffer)
+{
+	return (mPool != NULL && mPool->isShared(buffer));
+}
+
 /**
  * Add a buffer at the specified index. 
  * Used only in the implementation of file reading.
@@ -428,7 +499,25 @@ float* Audio::allocBuffer()
 }
 
 /**
- * Release one buffer.
+ * Allocate one buffer for reading a file.  Files are never read
+ * in the interrupt and may need thousands of buffers, so these don't
+ * come from the allocation ring the interrupt depends on.
+ */
+float* Audio::allocFileBuffer()
+{
+    float* buffer = NULL;
+
+    if (mPool != NULL)
+      buffer = mPool->newBufferDirect();
+    else
+      buffer = allocBuffer();
+
+    return buffer;
+}
+
+/**
+ * Release one buffer.  If the buffer is shared this just
+ * removes our reference.
  */
 void Audio::freeBuffer(float* buffer)
 {
@@ -441,6 +530,282 @@ void Audio::freeBuffer(float* buffer)
     }
 }
 
+/****************************************************************************
+ *                                                                          *
+ *   							SOURCE BLOCKS                               *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * Give the Audio a source for its content.  Nothing is copied now,
+ * each buffer is filled from the source the first time getBuffer
+ * or allocBuffer asks for it.  We take ownership of the source,
+ * it is released when the Audio is reset.
+ *
+ * The source blocks must be the same size as our buffers.
+ * If they aren't the source is released and we return false.
+ */
+PUBLIC bool Audio::setSource(AudioSource* src)
+{
+	reset();
+
+	if (src->getBlockFrames() * mChannels != mBufferSize ||
+		src->getChannels() != mChannels) {
+		Trace(1, "Audio::setSource mismatched block size\n");
+		src->release();
+		return false;
+	}
+
+	// initIndex put the start frame on a buffer boundary
+	int index, offset;
+	locate(0, &index, &offset);
+
+	int blocks = src->getBlockCount();
+	if (blocks > 0)
+	  prepareIndex(index + blocks - 1);
+
+	mSampleRate = src->getSampleRate();
+	mSource = src;
+	mSourceIndex = index;
+	mSourceBlocks = blocks;
+	if (mSourceStateSize < blocks || mSourceStates == NULL) {
+		delete mSourceStates;
+		mSourceStateSize = (blocks > 0) ? blocks : 1;
+		mSourceStates = new int[mSourceStateSize];
+	}
+
+	int pending = 0;
+	for (int i = 0 ; i < blocks ; i++) {
+		if (src->isZeroBlock(i))
+		  mSourceStates[i] = AUDIO_BLOCK_RESIDENT;
+		else {
+			mSourceStates[i] = AUDIO_BLOCK_PENDING;
+			pending++;
+		}
+	}
+
+	mFrames = src->getFrames();
+	AtomicBarrier();
+	mSourcePending = pending;
+	mVersion++;
+
+	return true;
+}
+
+/**
+ * The number of source blocks that haven't been touched yet.
+ */
+PUBLIC int Audio::getPendingBlocks()
+{
+	return mSourcePending;
+}
+
+/**
+ * Touch every block that is still pending so the Audio no longer
+ * depends on the source.  Used by LayerCompressor to decompress layers
+ * outside the interrupt before they are played.
+ */
+PUBLIC void Audio::loadPendingBlocks()
+{
+	loadPendingBlocks(0, mSourceBlocks);
+}
+
+/**
+ * Touch up to max blocks starting with the one containing a frame,
+ * wrapping around to the front.  Used to load the blocks just ahead
+ * of the play frame before the interrupt gets to them.
+ */
+PUBLIC void Audio::loadPendingBlocks(long frame, int max)
+{
+	int blocks = mSourceBlocks;
+	if (blocks > 0) {
+		int first = (int)(frame / getBlockFrames());
+		if (first < 0 || first >= blocks)
+		  first = 0;
+		if (max > blocks)
+		  max = blocks;
+		for (int i = 0 ; i < max && mSourcePending > 0 ; i++)
+		  getBuffer(mSourceIndex + ((first + i) % blocks));
+	}
+}
+
+/**
+ * Give the buffers loaded from the source back to the pool and
+ * make their blocks PENDING again, the next touch decodes them.
+ * Used by LayerCompressor to evict decompressed layers that have
+ * gone cold.  Called in the interrupt, the caller makes sure
+ * nothing else is reading the Audio and that it hasn't been
+ * modified since the source was set.  Returns the number of
+ * blocks unloaded.
+ */
+PUBLIC int Audio::unloadSourceBlocks()
+{
+	int unloaded = 0;
+
+	if (mSource != NULL) {
+		for (int i = 0 ; i < mSourceBlocks ; i++) {
+			int index = mSourceIndex + i;
+			if (mSourceStates[i] == AUDIO_BLOCK_RESIDENT &&
+				!mSource->isZeroBlock(i) && mBuffers[index] != NULL) {
+				freeBuffer(mBuffers[index]);
+				mBuffers[index] = NULL;
+				mSourceStates[i] = AUDIO_BLOCK_PENDING;
+				unloaded++;
+			}
+		}
+		if (unloaded > 0) {
+			// cursors must find the buffers again
+			mVersion++;
+			AtomicBarrier();
+			AtomicAdd(&mSourcePending, unloaded);
+		}
+	}
+
+	return unloaded;
+}
+
+/**
+ * The number of frames in one of our buffers, which is also the
+ * size of a source block.
+ */
+PUBLIC long Audio::getBlockFrames()
+{
+	return mBufferSize / mChannels;
+}
+
+/**
+ * The number of buffer sized blocks needed to hold the frames.
+ * Block zero starts at the first frame, which is not necessarily
+ * at the start of a buffer.
+ */
+PUBLIC int Audio::getBlockCount()
+{
+	long blockFrames = getBlockFrames();
+	return (int)((mFrames + blockFrames - 1) / blockFrames);
+}
+
+/**
+ * Return the samples of one block.  If the first frame is on
+ * a buffer boundary this is our buffer, which may be shared and
+ * must not be modified.  Otherwise the block straddles two buffers
+ * and is copied into the array passed in, which must be as large
+ * as a buffer.  NULL means the block is silent.
+ */
+PUBLIC float* Audio::getBlock(int block, float* copy)
+{
+	float* samples = NULL;
+	int index, offset;
+
+	locate(block * getBlockFrames(), &index, &offset);
+
+	if (offset == 0) {
+		samples = getBuffer(index);
+	}
+	else {
+		float* first = getBuffer(index);
+		float* second = getBuffer(index + 1);
+		if (first != NULL || second != NULL) {
+			int head = mBufferSize - offset;
+			if (first != NULL)
+			  memcpy(copy, &first[offset], head * sizeof(float));
+			else
+			  memset(copy, 0, head * sizeof(float));
+			if (second != NULL)
+			  memcpy(&copy[head], second, offset * sizeof(float));
+			else
+			  memset(&copy[head], 0, offset * sizeof(float));
+			samples = copy;
+		}
+	}
+
+	return samples;
+}
+
+/**
+ * Fill the buffer at this index from the source if it hasn't been.
+ * This can be called from the interrupt and from threads reading
+ * the Audio at the same time, one of them claims the block and the
+ * others wait for the copy to finish.  It's only a memcpy so
+ * we spin rather than sleep.
+ *
+ * Only the interrupt takes the buffer from the allocation ring.
+ * Other threads may fault in a whole layer (LayerCompressor prefetch,
+ * the project preload, a save) and would drain the ring out from
+ * under it.
+ */
+void Audio::faultBuffer(int index)
+{
+	int block = index - mSourceIndex;
+	if (block >= 0 && block < mSourceBlocks) {
+		volatile int* state = &mSourceStates[block];
+
+		if (*state == AUDIO_BLOCK_PENDING &&
+			AtomicCompareAndSwap(state, AUDIO_BLOCK_PENDING, 
+								 AUDIO_BLOCK_LOADING)) {
+
+			// pool buffers come back zeroed, readBlock fills all of it
+			float* buffer = NULL;
+			if (mPool != NULL && !mPool->isInterrupt())
+			  buffer = mPool->newBufferDirect();
+			else
+			  buffer = allocBuffer();
+			mSource->readBlock(block, buffer);
+
+			mBuffers[index] = buffer;
+			mVersion++;
+			AtomicBarrier();
+			*state = AUDIO_BLOCK_RESIDENT;
+			AtomicDecrement(&mSourcePending);
+		}
+		else {
+			while (*state == AUDIO_BLOCK_LOADING)
+			  AtomicBarrier();
+		}
+	}
+}
+
+/**
+ * Forget a source block we're about to throw away without
+ * copying it.  If someone else is loading it let them finish,
+ * the caller will free the buffer.
+ */
+void Audio::discardBuffer(int index)
+{
+	int block = index - mSourceIndex;
+	if (mSourcePending > 0 && block >= 0 && block < mSourceBlocks) {
+		volatile int* state = &mSourceStates[block];
+		if (AtomicCompareAndSwap(state, AUDIO_BLOCK_PENDING,
+								 AUDIO_BLOCK_RESIDENT))
+		  AtomicDecrement(&mSourcePending);
+		else {
+			while (*state == AUDIO_BLOCK_LOADING)
+			  AtomicBarrier();
+		}
+	}
+}
+
+/**
+ * Drop the source and any blocks we didn't get to.
+ * Called on reset, nothing should be reading the Audio.
+ * This may be in the interrupt, the pool hands the source to its
+ * Reclaimer since releasing the last source from a project file
+ * unmaps the file.
+ */
+void Audio::releaseSource()
+{
+	if (mSource != NULL) {
+		mSourcePending = 0;
+		mSourceBlocks = 0;
+		mSourceIndex = 0;
+		AtomicBarrier();
+		if (mPool != NULL)
+		  mPool->releaseSource(mSource);
+		else
+		  mSource->release();
+		mSource = NULL;
+	}
+}
+
 /****************************************************************************
  *                                                                          *
  *   							 FRAME RANGES                               *
@@ -507,14 +872,25 @@ PUBLIC void Audio::setFrames(long frames)
 			locate(frames, &index, &offset);
 			if (index < mBufferCount) {
 
-				// partially clear the new last buffer
-				float* buffer = mBuffers[index];
+				// partially clear the new last buffer, if there is
+				// nothing left in it let it go
+				if (offset == 0)
+				  discardBuffer(index);
+				float* buffer = getBuffer(index);
 				if (buffer != NULL) {
-					// may be more than we need if we're in the same
-					// buffer as the current last frame, but this shouldn't
-					// happen very often
-					int bytes = (mBufferSize - offset) * sizeof(float);
-					memset(&buffer[offset], 0, bytes);
+					if (offset == 0) {
+						freeBuffer(buffer);
+						mBuffers[index] = NULL;
+						mVersion++;
+					}
+					else {
+						// may be more than we need if we're in the same
+						// buffer as the current last frame, but this
+						// shouldn't happen very often
+						buffer = getWritableBuffer(index);
+						int bytes = (mBufferSize - offset) * sizeof(float);
+						memset(&buffer[offset], 0, bytes);
+					}
 				}
 
 				// then release any remaining buffers
@@ -526,6 +902,7 @@ PUBLIC void Audio::setFrames(long frames)
 				  lastIndex = mBufferCount - 1;
 
 				for (int i = index + 1 ; i <= lastIndex ; i++) {
+					discardBuffer(i);
 					freeBuffer(mBuffers[i]);
 					mBuffers[i] = NULL;
 					mVersion++;
@@ -611,11 +988,12 @@ void Audio::setStartFrame(long frame)
 
 			if (index < mBufferCount) {
 				// partially clear the new first buffer
-				float* buffer = mBuffers[index];
-				if (buffer != NULL) {
+				float* buffer = getBuffer(index);
+				if (buffer != NULL && offset > 0) {
 					// may be more than we need if we're in the same
 					// buffer as the current start frame, but this shouldn't
 					// happen often enough to be worth optimizing?
+					buffer = getWritableBuffer(index);
 					int bytes = offset * sizeof(float);
 					memset(buffer, 0, bytes);
 				}
@@ -629,6 +1007,7 @@ void Audio::setStartFrame(long frame)
 				  lastIndex = mBufferCount - 1;
 
 				for (int i = firstIndex ; i <= lastIndex ; i++) {
+					discardBuffer(i);
 					freeBuffer(mBuffers[i]);
 					mBuffers[i] = NULL;
 					mVersion++;
@@ -733,25 +1112,26 @@ long Audio::prepareFrame(long frame, int* retIndex,
 /**
  * Load a wave file.
  * Formerly used libsndfile, now have WaveFile.
- * Only supporting 16 bit PCM or IEEE single float, 2 channel, 44.1Khz.
- * 
- * If we were smarter we could read directly into buffers rather than
- * one large one then splitting it up.  In this context, I like
- * libsndfile's interface better we can read in the chunk size we want.
+ * Supports 16, 24 and 32 bit PCM or IEEE float, the file is
+ * always converted to stereo.
+ *
+ * The start frame is on a buffer boundary so we can decode one
+ * buffer's worth at a time directly into a pooled buffer, allocated
+ * outside the ring, see allocFileBuffer.  Buffers
+ * that come out all zero are not added to the index so silence in
+ * the file stays sparse, the buffer is reused for the next chunk.
  */
 PUBLIC int Audio::read(const char *name) 
 {
 	int error = 0;
 
 	WaveFile* wav = new WaveFile();
-	error = wav->read(name);
+	error = wav->readStart(name);
 	if (error) {
 		Trace(1, "Error reading file %s %s\n", name, 
 			  wav->getErrorMessage(error));
 	}
 	else {
-		AudioBuffer b;
-
 		reset();
 		mSampleRate = wav->getSampleRate();
         // ignore channels until we can support variable buffer size
@@ -761,29 +1141,66 @@ PUBLIC int Audio::read(const char *name)
 
 		initIndex();
 
-		// !! Another disadvantage with this interface relative to 
-        // libsndfile is that we can't call isEmpty to detect blocks of
-        // zero and skip them
+		long frames = wav->getFrames();
+		long chunk = mBufferSize / mChannels;
+		float* buffer = NULL;
+		int index, offset;
+		locateStart(&index, &offset);
+
+		for (long frame = 0 ; frame < frames ; frame += chunk, index++) {
+			long count = frames - frame;
+			if (count > chunk)
+			  count = chunk;
+
+			if (buffer == NULL)
+			  buffer = allocFileBuffer();
+
+			if (wav->read(buffer, count) != count) {
+				error = wav->getError();
+				Trace(1, "Error reading file %s %s\n", name,
+					  wav->getErrorMessage(error));
+				break;
+			}
 
-		b.buffer = wav->getData();
-		b.frames = wav->getFrames();
-		b.channels = mChannels;
-		append(&b);
+			// the last chunk may leave a tail from a reused buffer
+			if (count < chunk)
+			  memset(&buffer[count * mChannels], 0, 
+					 (chunk - count) * mChannels * sizeof(float));
 
+			if (!isEmpty(buffer, count * mChannels)) {
+				addBuffer(buffer, index);
+				buffer = NULL;
+			}
+		}
+
+		if (buffer != NULL)
+		  freeBuffer(buffer);
+
+		if (error)
+		  reset();
+		else
+		  mFrames = frames;
 	}
+
+	wav->readFinish();
 	delete wav;
 
 	return error;
 }
 
 /**
- * Helper for read().  Return true if this buffer contains
- * no non-zero frames.  Used to create sparse Audio objects.
+ * Return true if this buffer contains no non-zero frames.
+ * Used to create sparse Audio objects.
  */
 bool Audio::isEmpty(float* buffer)
+{
+	return isEmpty(buffer, mBufferSize);
+}
+
+bool Audio::isEmpty(float* buffer, long samples)
 {
 	bool empty = true;
-	for (int i = 0 ; i < mBufferSize ; i++) {
+	for (long i = 0 ; i < samples ; i++) {
 		if (buffer[i] != 0.0f) {
 			empty = false;
 			break;
@@ -830,20 +1247,28 @@ int Audio::write(const char *name, int format)
 			  wav->getErrorMessage(error));
 	}
 	else {
-		// write one frame at a time not terribly effecient but messing
-		// with blocking at this level isn't going to save much
-		AudioBuffer b;
-		float buffer[AUDIO_MAX_CHANNELS];
-		b.buffer = buffer;
-		b.frames = 1;
-		b.channels = mChannels;
-
-		for (long i = 0 ; i < mFrames ; i++) {
-			memset(buffer, 0, sizeof(buffer));
-			get(&b, i);
-			wav->write(buffer, 1);
+		// write directly from the buffers, the first may start
+		// in the middle, missing buffers are silence
+		int index, offset;
+		locateStart(&index, &offset);
+
+		long frame = 0;
+		while (frame < mFrames && !error) {
+			long count = (mBufferSize - offset) / mChannels;
+			if (count > mFrames - frame)
+			  count = mFrames - frame;
+
+			float* buffer = getBuffer(index);
+			if (buffer != NULL)
+			  buffer = &buffer[offset];
+
+			error = wav->write(buffer, count);
+			frame += count;
+			index++;
+			offset = 0;
 		}
 
+		// this returns the first write error if there was one
 		error = wav->writeFinish();
 		if (error) {
 			Trace(1, "Error finishing file %s: %s\n", name, 
@@ -870,6 +1295,12 @@ int Audio::write(const char *name, int format)
  * Copy the contents of one Audio into another.
  * Note that this assumes the buffer doesn't have a lot of wasted
  * space at the front or back, could check that and compress.
+ *
+ * If we're from the same pool and not applying feedback the
+ * buffers are shared rather than copied, either side will make
+ * a private copy if it needs to modify one.  Buffers of silence
+ * are left out.  The source may belong to the interrupt, a buffer
+ * it freed after we found it is copied rather than shared.
  */
 void Audio::copy(Audio* src)
 {
@@ -884,16 +1315,23 @@ void Audio::copy(Audio* src, int feedback)
 		if (src->mBufferSize != mBufferSize)
 		  Trace(1, "Mismatched Audio buffer size!\n");
 		else {
+			bool share = (mPool != NULL && mPool == src->mPool &&
+						  (feedback >= 127 || feedback < 0));
+
 			int srcmax = src->mBufferCount;
 			for (int i = 0 ; i < srcmax ; i++) {
 				float* srcb = src->getBuffer(i);
-				if (srcb != NULL) {
-					// !! todo: if the buffer is empty don't bother allocating
-
-					float* destb = allocBuffer(i);
-
-					memcpy(destb, srcb, mBufferSize * sizeof(float));
-					applyFeedback(destb, feedback);
+				if (srcb != NULL && feedback != 0 && !src->isEmpty(srcb)) {
+					if (share && mPool->shareLiveBuffer(srcb)) {
+						prepareIndex(i);
+						mBuffers[i] = srcb;
+						mVersion++;
+					}
+					else {
+						float* destb = allocBuffer(i);
+						memcpy(destb, srcb, mBufferSize * sizeof(float));
+						applyFeedback(destb, feedback);
+					}
 				}
 			}
 		}
@@ -923,38 +1361,49 @@ void Audio::applyFeedback(float* buffer, int feedback)
  *                                                                          *
  ****************************************************************************/
 
-void Audio::dump() 
+/**
+ * Count the buffers we have, and how many of those are shared
+ * with another Audio.
+ */
+void Audio::getBufferCounts(int* retAllocated, int* retShared)
 {
-	printf("Audio\n");
-	printf("Sample rate %d, Channels %d, Frames %ld StartFrame %ld\n",
-		   mSampleRate, mChannels, mFrames, mStartFrame);
-
 	int allocated = 0;
+	int shared = 0;
 	if (mBuffers != NULL) {
 		for (int i = 0 ; i < mBufferCount ; i++) {
-			if (mBuffers[i] != NULL)
-			  allocated++;
+			if (mBuffers[i] != NULL) {
+				allocated++;
+				if (isShared(mBuffers[i]))
+				  shared++;
+			}
 		}
 	}
+	*retAllocated = allocated;
+	*retShared = shared;
+}
+
+void Audio::dump() 
+{
+	printf("Audio\n");
+	printf("Sample rate %d, Channels %d, Frames %ld StartFrame %ld\n",
+		   mSampleRate, mChannels, mFrames, mStartFrame);
+
+	int allocated, shared;
+	getBufferCounts(&allocated, &shared);
 
-	printf("Buffer size %d, Buffers reserved %d Buffers allocated %d\n",
-		   mBufferSize, mBufferCount, allocated);
+	printf("Buffer size %d, Buffers reserved %d Buffers allocated %d shared %d\n",
+		   mBufferSize, mBufferCount, allocated, shared);
 
 	fflush(stdout);
 }
 
 void Audio::dump(TraceBuffer* b) 
 {
-	int allocated = 0;
-	if (mBuffers != NULL) {
-		for (int i = 0 ; i < mBufferCount ; i++) {
-			if (mBuffers[i] != NULL)
-			  allocated++;
-		}
-	}
+	int allocated, shared;
+	getBufferCounts(&allocated, &shared);
 
-	b->add("Audio: start %ld length %ld index %d, buffers %d\n",
-		   mStartFrame, mFrames, mBufferCount, allocated);
+	b->add("Audio: start %ld length %ld index %d, buffers %d shared %d\n",
+		   mStartFrame, mFrames, mBufferCount, allocated, shared);
 }
 
 /**
@@ -1164,7 +1613,7 @@ void Audio::insert(Audio* audio, long insertFrame)
 			destSample += (mChannels - 1);
 
 			int shiftSamples = (mFrames - insertFrame) * mChannels;
-            float* src = mBuffers[srcBuffer];
+            float* src = getBuffer(srcBuffer);
 
             // todo: could try to be smart about sparse copying
             // a buffer that happens to be empty but it's hard
@@ -1186,7 +1635,7 @@ void Audio::insert(Audio* audio, long insertFrame)
                 srcSample--;
                 if (srcSample < 0) {
                     srcBuffer--;
-                    src = mBuffers[srcBuffer];
+                    src = getBuffer(srcBuffer);
                     srcSample = mBufferSize - 1;
                 }
             }
@@ -1211,34 +1660,67 @@ void Audio::insert(Audio* audio, long insertFrame)
 /**
  * Create an initially empty audio pool.
  * There is normally only one of these in a Mobius instance.
- * Should have another list for all buffers outstanding?
+ * !! channels
  */
 PUBLIC AudioPool::AudioPool()
 {
-    mCsect = new CriticalSection("AudioPool");
-    mPool = NULL;
-    mAllocated = 0;
-    mInUse = 0;
-
-    // needs more testing
-    // !! channels
-    //mNewPool = new SampleBufferPool(FRAMES_PER_BUFFER * 2);
-    mNewPool = NULL;
+    mPool = new SampleBufferPool(BUFFER_SIZE, AUDIO_POOL_DEFAULT_BUFFERS);
+    mReclaimer = NULL;
+    mInterruptKey = ThreadLocalAlloc();
+    mWriteCopies = 0;
 }
 
 /**
  * Release the kracken.
+ * The pool must have been removed from the ObjectPoolManager.
  */
 PUBLIC AudioPool::~AudioPool()
 {
-    delete mCsect;
-    delete mNewPool;
+    ThreadLocalFree(mInterruptKey);
+    delete mPool;
+}
 
-    OldPooledBuffer* next = NULL;
-    for (OldPooledBuffer* p = mPool ; p != NULL ; p = next) {
-        next = p->next;
-        delete p;
-    }
+/**
+ * Return the underlying object pool so it can be registered
+ * with an ObjectPoolManager for maintenance.
+ */
+PUBLIC ObjectPool* AudioPool::getSamplePool()
+{
+    return mPool;
+}
+
+/**
+ * Give freed Audio to a Reclaimer rather than deleting it here,
+ * freeAudio may be called from the interrupt.
+ */
+PUBLIC void AudioPool::setReclaimer(Reclaimer* r)
+{
+    mReclaimer = r;
+}
+
+/**
+ * Called by Mobius around each interrupt, and by the RecorderWorkers
+ * for as long as they run.  The host may call the interrupt from a
+ * different thread each time so this is cleared at the end.
+ */
+PUBLIC void AudioPool::enterInterrupt()
+{
+    if (mInterruptKey >= 0)
+      ThreadLocalSet(mInterruptKey, this);
+}
+
+PUBLIC void AudioPool::exitInterrupt()
+{
+    if (mInterruptKey >= 0)
+      ThreadLocalSet(mInterruptKey, NULL);
+}
+
+/**
+ * True if this thread is working for the interrupt.
+ */
+PUBLIC bool AudioPool::isInterrupt()
+{
+    return (mInterruptKey >= 0 && ThreadLocalGet(mInterruptKey) != NULL);
 }
 
 /**
@@ -1262,117 +1744,160 @@ PUBLIC Audio* AudioPool::newAudio(const char* file)
 /**
  * Return an Audio to the pool.
  * These aren't actually pooled, just free the buffers which
- * will happen in the destructor.
+ * will happen in the destructor.  If we have a Reclaimer it is
+ * deleted later by MobiusThread.
  */
 PUBLIC void AudioPool::freeAudio(Audio* a)
 {
-    a->free();
+    if (a != NULL) {
+        if (mReclaimer != NULL)
+          mReclaimer->retire(a);
+        else
+          a->free();
+    }
 }
 
 /**
- * Allocate a new buffer, using the pool if available.
+ * Allocate a new buffer from the pool.
+ * Buffers are always zeroed, either by the maintenance thread
+ * or by the heap allocator if the ring was empty.
  * In theory have to have a different pool for each size, assume only
  * one for now.
  * !! channels
  */
 PUBLIC float* AudioPool::newBuffer()
 {
-	float* buffer;
-
-	if (mNewPool) {
-		buffer = mNewPool->allocSamples();
-	}
-	else {
-		mCsect->enter();
-		if (mPool == NULL) {
-			int bytesize = sizeof(OldPooledBuffer) + (BUFFER_SIZE * sizeof(float));
-			char* bytes = new char[bytesize];
-			OldPooledBuffer* pb = (OldPooledBuffer*)bytes;
-			pb->next = NULL;
-			pb->pooled = 0;
-			buffer = (float*)(bytes + sizeof(OldPooledBuffer));
-            mAllocated++;
-		}
-		else {
-			buffer = (float*)(((char*)mPool) + sizeof(OldPooledBuffer));
-			if (!mPool->pooled)
-			  Trace(1, "Audio buffer in pool not marked as pooled!\n");
-			mPool->pooled = 0;
-			mPool = mPool->next;
-		}
-		mInUse++;
-		mCsect->leave();
-
-		// in both cases, make sure its empty
-		// !! these are big, need to keep the list clean and do it
-		// in a worker thread
-		memset(buffer, 0, BUFFER_SIZE * sizeof(float));
-	}
+    return mPool->allocSamples();
+}
 
-	return buffer;
+/**
+ * Allocate a new zeroed buffer without taking it from the 
+ * allocation ring.  For threads that may need many buffers 
+ * at once, like the SampleWorkers.
+ */
+PUBLIC float* AudioPool::newBufferDirect()
+{
+    return mPool->allocSamplesDirect();
 }
 
 /**
  * Return a buffer to the pool.
+ * This may be called from the interrupt, the buffer is pushed
+ * on the return list and zeroed later by the maintenance thread.
+ * If the buffer is shared, this just removes one reference.
+ *
+ * If we have a Reclaimer the last reference going away retires the
+ * buffer instead.  The interrupt frees buffers from Audio that a
+ * save or LayerFlattener may be reading, they stay out of the pool
+ * until those are done.
  */
 PUBLIC void AudioPool::freeBuffer(float* buffer)
 {
 	if (buffer != NULL) {
+        if (mReclaimer == NULL)
+          mPool->freeSamples(buffer);
+        else {
+            SampleBuffer* released = mPool->releaseSamples(buffer);
+            if (released != NULL)
+              mReclaimer->retire(released);
+        }
+    }
+}
 
-		if (mNewPool != NULL) {
-			mNewPool->freeSamples(buffer);
-		}
-		else {
-			OldPooledBuffer* pb = (OldPooledBuffer*)
-				(((char*)buffer) - sizeof(OldPooledBuffer));
-
-			if (pb->pooled)
-			  Trace(1, "Audio buffer already in pool!\n");
-			else {
-				mCsect->enter();
-				pb->next = mPool;
-				pb->pooled = 1;
-				mPool = pb;
-				mInUse--;
-                mCsect->leave();
-			}
-		}
-	}
+/**
+ * Release the source of an Audio that was reset.
+ * This may be called from the interrupt.  If we have a Reclaimer
+ * the source is released later by MobiusThread.
+ */
+PUBLIC void AudioPool::releaseSource(AudioSource* src)
+{
+    if (src != NULL) {
+        if (mReclaimer != NULL)
+          mReclaimer->retire(src);
+        else
+          src->release();
+    }
 }
 
-PUBLIC void AudioPool::dump()
+/**
+ * Add a reference to a buffer so it can be used by another Audio.
+ * Returns the buffer for convenience.
+ */
+PUBLIC float* AudioPool::shareBuffer(float* buffer)
 {
-	if (mNewPool != NULL) {
-        // need a dump method for the new one
-		printf("NewBufferPool: %d in use ?? in pool\n", mInUse);
-	}
-	else {
-        int pooled = 0;
-		mCsect->enter();
-		for (OldPooledBuffer* p = mPool ; p != NULL ; p = p->next)
-		  pooled++;
-		mCsect->leave();
+	if (buffer != NULL)
+	  mPool->shareSamples(buffer);
+	return buffer;
+}
 
-        int used = mAllocated - pooled;
+/**
+ * Add a reference to a buffer found in an Audio the interrupt
+ * may be changing.  Returns false if the interrupt already let go of
+ * it, it stays readable until the Reclaimer is done with it but
+ * can't be shared.
+ */
+PUBLIC bool AudioPool::shareLiveBuffer(float* buffer)
+{
+	return (buffer != NULL && mPool->shareLiveSamples(buffer));
+}
 
-		printf("AudioPool: %d buffers allocated, %d in the pool, %d in use\n",
-               mAllocated, pooled, used);
+/**
+ * True if the buffer is used by more than one Audio and must
+ * be copied before it is modified.
+ */
+PUBLIC bool AudioPool::isShared(float* buffer)
+{
+	return (buffer != NULL && mPool->isShared(buffer));
+}
 
-        // this should match
-        if (used != mInUse)
-          printf("AudioPool: Unmatched usage counters %d %d\n",
-                 used, mInUse);
+/**
+ * Called by Audio::getWritableBuffer when it copies a shared buffer.
+ * Returns the new count.
+ */
+PUBLIC int AudioPool::countWriteCopy()
+{
+    return AtomicIncrement(&mWriteCopies);
+}
 
-		fflush(stdout);
-	}
+/**
+ * Number of shared buffers copied so they could be modified.
+ */
+PUBLIC int AudioPool::getWriteCopies()
+{
+    return mWriteCopies;
+}
+
+PUBLIC void AudioPool::dump()
+{
+    printf("AudioPool: %d in use, high water %d, low water %d, misses %d, direct %d, write copies %d\n",
+           mPool->getInUse(), mPool->getHighWater(), 
+           mPool->getLowWater(), mPool->getMisses(), mPool->getDirect(),
+           mWriteCopies);
+    fflush(stdout);
 }
 
 /**
  * Warm the buffer pool with some number of buffers.
- * Was never implemented.
+ * This also sets the size of the allocation ring so it must
+ * be called before any buffers are allocated, and before the
+ * pool is registered with an ObjectPoolManager.
  */
 PUBLIC void AudioPool::init(int buffers)
 {
+    if (buffers > 0) {
+        if (mPool->getInUse() > 0) {
+            Trace(1, "AudioPool: Unable to resize pool with %ld buffers in use\n",
+                  (long)mPool->getInUse());
+        }
+        else {
+            delete mPool;
+            mPool = new SampleBufferPool(BUFFER_SIZE, buffers);
+        }
+    }
+
+    // fill the allocation ring now so the interrupt doesn't 
+    // start out missing
+    mPool->maintain();
 }
 
 /****************************************************************************/
@@ -236,6 +236,8 @@ class AudioCursor {
 
   public:
 
+	static bool BlockTransfer;
+
 	AudioCursor();
 	AudioCursor(const char* name);
 	AudioCursor(const char* name, class Audio* a);
@@ -281,9 +283,17 @@ class AudioCursor {
 	void init();
 	void decache();
 	void prepareFrame();
+	void prepareWrite();
 	void locateFrame();
 	void incFrame();
 	void get(AudioBuffer* buf, float* dest, float modifier);
+	void put(AudioBuffer* buf, float* src, AudioOp op);
+
+	bool isBlockable(int channels);
+	long getBlock(float* dest, long frames, float level);
+	long putBlock(float* src, long frames, AudioOp op);
+	long skipBlock(float* src, long frames);
+	void advanceBlock(int index, int offset, long frames);
 
 	char* mName;
 	class Audio* mAudio;
@@ -319,6 +329,75 @@ class AudioCursor {
 
 };
 
+/****************************************************************************
+ *                                                                          *
+ *                                AUDIO SOURCE                              *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * States of one source block in an Audio.
+ * A block is PENDING until something touches it, the thread
+ * that wins the race moves it to LOADING, copies the samples,
+ * then moves it to RESIDENT.  Blocks that are all zero start out
+ * RESIDENT, they are missing buffers like any other silence.
+ */
+#define AUDIO_BLOCK_RESIDENT 0
+#define AUDIO_BLOCK_PENDING 1
+#define AUDIO_BLOCK_LOADING 2
+
+/**
+ * Sample data an Audio copies into its buffers the first time
+ * they are touched rather than when the Audio is created.
+ * Used for project files that are mapped into memory, see ProjectFile.
+ *
+ * A block has the same number of frames as an Audio buffer and
+ * block zero lines up with the first frame of the Audio.
+ * readBlock may be called from the interrupt or from any thread
+ * that reads the Audio, it must not allocate or lock.
+ */
+class AudioSource {
+
+	friend class Reclaimer;
+
+  public:
+
+	AudioSource() { mRetired = NULL; mRetiredEpoch = 0; }
+	virtual ~AudioSource() {}
+
+	virtual int getSampleRate() = 0;
+	virtual int getChannels() = 0;
+	virtual long getFrames() = 0;
+	virtual long getBlockFrames() = 0;
+	virtual int getBlockCount() = 0;
+
+	/**
+	 * True if the block contains nothing but zeros.
+	 */
+	virtual bool isZeroBlock(int block) = 0;
+
+	/**
+	 * Copy one block of interleaved samples.
+	 */
+	virtual void readBlock(int block, float* dest) = 0;
+
+	/**
+	 * Called when the Audio no longer needs the source.
+	 * If the Audio has a pool with a Reclaimer this is called later
+	 * by MobiusThread, otherwise by the thread that reset the Audio.
+	 */
+	virtual void release() = 0;
+
+  private:
+
+	/**
+	 * Chain and epoch when waiting in a Reclaimer.
+	 */
+	AudioSource* mRetired;
+	int mRetiredEpoch;
+
+};
+
 /****************************************************************************
  *                                                                          *
  *                                   AUDIO                                  *
@@ -335,6 +414,7 @@ class AudioCursor {
 class Audio { 
 
 	friend class AudioCursor;
+	friend class Reclaimer;
 
   public:
 
@@ -377,6 +457,11 @@ class Audio {
 	// FIle IO
 
 	int read(const char *filename);
+	bool setSource(AudioSource* src);
+	int getPendingBlocks();
+	void loadPendingBlocks();
+	void loadPendingBlocks(long frame, int max);
+	int unloadSourceBlocks();
 	int write(const char *filename);
 	int write(const char *filename, int format);
 
@@ -401,8 +486,15 @@ class Audio {
 
 	void fadeEdges();
 
+	// Whole buffers, used by LayerCompressor
+
+	long getBlockFrames();
+	int getBlockCount();
+	float* getBlock(int block, float* copy);
+
 	// Diagnostics
 
+	void getBufferCounts(int* allocated, int* shared);
 	void dump();
 	void dump(class TraceBuffer* b);
 	void diff(Audio* a);
@@ -428,10 +520,18 @@ class Audio {
 	void addBuffer(float* buffer, int index);
 	float* allocBuffer();
 	float* allocBuffer(int index);
+	float* allocFileBuffer();
+	float* getWritableBuffer(int index);
+	bool isShared(float* buffer);
 	bool isEmpty(float* buffer);
+	bool isEmpty(float* buffer, long samples);
 	void setStartFrame(long frame);
 	void applyFeedback(float* buffer, int feedback);
 
+	void faultBuffer(int index);
+	void discardBuffer(int index);
+	void releaseSource();
+
 	// allow these to be directly accessible by AudioCursor
 
 	float* getBuffer(int i);
@@ -468,7 +568,12 @@ class Audio {
 	 * The buffer index array.  This may be a sparse array, meaning that
 	 * there may be a NULL pointer in any given element.  On playback
 	 * this is to be treated as silence.  On record, buffers are normally
-	 * allocated incrementally.
+	 * allocated incrementally.  Buffers that would be entirely zero
+	 * are not allocated.
+	 *
+	 * Buffers may be shared with other Audio objects from the same pool.
+	 * They are reference counted by the pool and must be copied with
+	 * getWritableBuffer before they are modified.
 	 */
 	float **mBuffers;
 
@@ -510,6 +615,30 @@ class Audio {
 	AudioCursor* mPlay;
 	AudioCursor* mRecord;
 
+	/**
+	 * Where buffers that haven't been touched yet come from.
+	 * mSourceIndex is the buffer index of source block zero,
+	 * mSourceStates has an AUDIO_BLOCK_ state for each block and
+	 * mSourcePending is the number still PENDING or LOADING.
+	 * Once that reaches zero this is an ordinary Audio, the source
+	 * is kept until the next reset so threads that raced us for
+	 * the last block can't see it disappear.  The state array
+	 * is kept until we're deleted since reset may be in the interrupt,
+	 * mSourceStateSize is its length.
+	 */
+	AudioSource* mSource;
+	int mSourceIndex;
+	int mSourceBlocks;
+	volatile int* mSourceStates;
+	int mSourceStateSize;
+	volatile int mSourcePending;
+
+	/**
+	 * Chain and epoch when waiting in a Reclaimer.
+	 */
+	Audio* mRetired;
+	int mRetiredEpoch;
+
 };
 
 /****************************************************************************
@@ -519,19 +648,21 @@ class Audio {
  ****************************************************************************/
 
 /**
- * This structure is allocated at the top of every Audio buffer.
+ * Default number of buffers kept ready for the interrupt.
+ * Can be changed with AudioPool::init before the pool is used.
  */
-struct OldPooledBuffer {
-
-	// todo, pool status, statistics
-	OldPooledBuffer* next;
-	int pooled;
-
-};
+#define AUDIO_POOL_DEFAULT_BUFFERS 16
 
 /**
  * Maintains a pool of audio buffers.
  * There is normally only one of these in a Mobius instance.
+ *
+ * Buffers come from a lock free SampleBufferPool.  The interrupt 
+ * takes zeroed buffers from the allocation ring and returns them
+ * without locking, the ObjectPoolManager thread zeroes returned
+ * buffers and gives the excess back to the heap.  Mobius registers
+ * the sample pool with its ObjectPoolManager, until that happens
+ * buffers are allocated from the heap and counted as misses.
  */
 class AudioPool {
     
@@ -543,20 +674,44 @@ class AudioPool {
     void init(int buffers);
     void dump();
 
+    class ObjectPool* getSamplePool();
+
+    void setReclaimer(class Reclaimer* r);
+
+    // the interrupt and the RecorderWorkers
+    void enterInterrupt();
+    void exitInterrupt();
+    bool isInterrupt();
+
     Audio* newAudio();
     Audio* newAudio(const char* file);
     void freeAudio(Audio* a);
 
     float* newBuffer();
+    float* newBufferDirect();
     void freeBuffer(float* b);
+    float* shareBuffer(float* b);
+    bool shareLiveBuffer(float* b);
+    bool isShared(float* b);
+
+    void releaseSource(class AudioSource* src);
+
+    int countWriteCopy();
+    int getWriteCopies();
 
   private:
 
-    class CriticalSection* mCsect;
-    OldPooledBuffer* mPool;
-    class SampleBufferPool* mNewPool;
-    int mAllocated;
-	int mInUse;
+    class SampleBufferPool* mPool;
+    class Reclaimer* mReclaimer;
+
+    /**
+     * Thread local key set on threads doing work for the interrupt,
+     * only those take buffers from the allocation ring.
+     */
+    int mInterruptKey;
+
+    // shared buffers copied by Audio::getWritableBuffer
+    volatile int mWriteCopies;
 
 };
 
@@ -17,6 +17,7 @@
 #include "Util.h"
 #include "Trace.h"
 #include "Audio.h"
+#include "AudioKernel.h"
 
 /****************************************************************************
  *                                                                          *
@@ -449,6 +450,15 @@ PUBLIC void AudioFade::fadePartial(float* buffer, int channels,
  *                                                                          *
  ****************************************************************************/
 
+/**
+ * When true, get() and put() move runs of frames up to the next
+ * buffer boundary with the AudioKernel functions whenever the cursor
+ * is moving forward and is not fading.  Turning this off forces
+ * everything through the old frame-at-a-time path, which is only
+ * useful for testing and for comparing performance.
+ */
+bool AudioCursor::BlockTransfer = true;
+
 AudioCursor::AudioCursor()
 {
 	init();
@@ -644,6 +654,21 @@ PRIVATE void AudioCursor::prepareFrame()
         // incFrame located the frame after the end of the range
         mAudio->mFrames = mFrame + 1;
     }
+
+	prepareWrite();
+}
+
+/**
+ * Called before modifying the current buffer.  If incFrame left
+ * us on a buffer that is shared with another Audio, have the
+ * Audio make a private copy.
+ */
+PRIVATE void AudioCursor::prepareWrite()
+{
+	if (mBuffer != NULL && mAudio->isShared(mBuffer)) {
+		mBuffer = mAudio->getWritableBuffer(mBufferIndex);
+		mVersion = mAudio->mVersion;
+	}
 }
 
 /**
@@ -693,7 +718,7 @@ PRIVATE void AudioCursor::incFrame()
                     // may or may not be a buffer here, 
                     // wait and let prepareFrame allocate it, since
                     // we may not need it
-                    mBuffer = mAudio->mBuffers[mBufferIndex];
+                    mBuffer = mAudio->getBuffer(mBufferIndex);
                 }
                 else {
                     // fell off the edge of the index
@@ -728,7 +753,7 @@ PRIVATE void AudioCursor::incFrame()
                 mBufferIndex++;
                 mBufferOffset = 0;
                 if (mBufferIndex < mAudio->mBufferCount)
-                    mBuffer = mAudio->mBuffers[mBufferIndex];
+                    mBuffer = mAudio->getBuffer(mBufferIndex);
                 else {
                     // fell off the edge of the index
                     // let prepareFrame handle it
@@ -765,10 +790,24 @@ PUBLIC void AudioCursor::get(AudioBuffer* buf, float level)
 
 	locateFrame();
 
-	for (int i = 0 ; i < length ; i++) {
-		get(buf, dest, level);
-		if (dest != NULL)
-		  dest += channels;
+	long i = 0;
+	while (i < length) {
+		long run = 0;
+		if (isBlockable(channels) && mFrame >= 0 && mFrame < mAudio->mFrames)
+		  run = getBlock(dest, length - i, level);
+
+		if (run > 0) {
+			i += run;
+			if (dest != NULL)
+			  dest += (run * channels);
+		}
+		else {
+			// reverse, fading, or past the end
+			get(buf, dest, level);
+			if (dest != NULL)
+			  dest += channels;
+			i++;
+		}
 	}
 }
 
@@ -840,29 +879,49 @@ PUBLIC void AudioCursor::put(AudioBuffer* buf, AudioOp op)
 	if (mVersion != mAudio->mVersion)
 	  decache();
 
-	for (int i = 0 ; i < frames ; i++) {
+	long i = 0;
+	while (i < frames) {
+		long run = 0;
+		if (isBlockable(channels) && mFrame >= 0)
+		  run = putBlock(src, frames - i, op);
 
-		// since we're recording, have to flesh out the buffers as we go
-		prepareFrame();
+		if (run > 0) {
+			i += run;
+			if (src != NULL)
+			  src += (run * channels);
+		}
+		else {
+			// reverse or fading
+			put(buf, src, op);
+			if (src != NULL)
+			  src += channels;
+			i++;
+		}
+	}
+}
 
-		for (int j = 0 ; j < channels ; j++) {
-			float sample = (src != NULL) ? src[j] : 0.0f;
+/**
+ * Transfer one frame into the Audio and increment the frame position.
+ */
+PRIVATE void AudioCursor::put(AudioBuffer* buf, float* src, AudioOp op)
+{
+	// since we're recording, have to flesh out the buffers as we go
+	prepareFrame();
 
-			sample = mFade.fade(sample);
+	for (int j = 0 ; j < buf->channels ; j++) {
+		float sample = (src != NULL) ? src[j] : 0.0f;
 
-			if (op == OpReplace)
-			  mBuffer[mBufferOffset + j] = sample;
-			else if (op == OpRemove)
-			  mBuffer[mBufferOffset + j] -= sample;
-			else
-			  mBuffer[mBufferOffset + j] += sample;
-		}
-		
-		incFrame();
+		sample = mFade.fade(sample);
 
-		if (src != NULL)
-		  src += channels;
+		if (op == OpReplace)
+		  mBuffer[mBufferOffset + j] = sample;
+		else if (op == OpRemove)
+		  mBuffer[mBufferOffset + j] -= sample;
+		else
+		  mBuffer[mBufferOffset + j] += sample;
 	}
+		
+	incFrame();
 }
 
 PUBLIC void AudioCursor::put(AudioBuffer* buf, AudioOp op, long frame)
@@ -879,6 +938,199 @@ PUBLIC void AudioCursor::put(AudioBuffer* buf, AudioOp op, Audio* a,
 	put(buf, op);
 }
 
+/****************************************************************************
+ *                                                                          *
+ *   							BLOCK TRANSFER                              *
+ *                                                                          *
+ ****************************************************************************/
+/*
+ * The frame-at-a-time get and put above have to call incFrame and
+ * AudioFade::fade for every frame, which is most of the cost of
+ * layer playback and recording.  When the cursor is moving forward
+ * and there is no fade in progress or pending, every frame up to the
+ * next buffer boundary is handled identically so we can transfer the
+ * whole run with one of the AudioKernel functions and then leave the
+ * cursor exactly where incFrame would have left it.
+ *
+ * Reverse is left on the per-frame path since the frames have to be
+ * reordered without swapping channels, it isn't common enough to 
+ * bother with.
+ */
+
+/**
+ * Return true if the next transfer may be done in blocks.
+ * Checking enabled as well as active catches scheduled fades 
+ * that haven't reached their start frame yet.
+ */
+PRIVATE bool AudioCursor::isBlockable(int channels)
+{
+	return (BlockTransfer &&
+			!mReverse &&
+			!mFade.enabled &&
+			!mFade.active &&
+			channels == mAudio->mChannels);
+}
+
+/**
+ * Add a run of frames into the destination buffer, stopping at
+ * the next Audio buffer boundary or the end of the Audio.
+ * The caller must have verified that mFrame is within range.
+ * Returns the number of frames transferred.
+ *
+ * Unlike locateFrame we always recalculate the buffer location
+ * since we may have decached after reaching the end of a sparse
+ * region, it's only a divide per run.
+ */
+PRIVATE long AudioCursor::getBlock(float* dest, long frames, float level)
+{
+	int channels = mAudio->mChannels;
+	int index, offset;
+
+	mAudio->locate(mFrame, &index, &offset);
+
+	long run = (mAudio->mBufferSize - offset) / channels;
+	long remaining = mAudio->mFrames - mFrame;
+	if (run > remaining)
+	  run = remaining;
+	if (run > frames)
+	  run = frames;
+
+	if (run > 0) {
+		// a missing buffer is silence, nothing to add
+		float* buffer = mAudio->getBuffer(index);
+		if (buffer != NULL && dest != NULL) {
+			long samples = run * channels;
+			if (level == 1.0f)
+			  SampleAdd(dest, &buffer[offset], samples);
+			else
+			  SampleAddScaled(dest, &buffer[offset], samples, level);
+		}
+		advanceBlock(index, offset, run);
+	}
+
+	return run;
+}
+
+/**
+ * Transfer a run of frames into the Audio, stopping at the next
+ * buffer boundary.  prepareFrame handles the allocation of the buffer
+ * and extension of the Audio for the first frame, we extend the 
+ * frame count for the rest of the run the same way it would have.
+ */
+PRIVATE long AudioCursor::putBlock(float* src, long frames, AudioOp op)
+{
+	long run = 0;
+
+	// silence going where there is no buffer yet doesn't need one
+	if (mBuffer == NULL)
+	  run = skipBlock(src, frames);
+
+	if (run == 0) {
+		prepareFrame();
+
+		if (mBuffer != NULL) {
+			int channels = mAudio->mChannels;
+			int index = mBufferIndex;
+			int offset = mBufferOffset;
+
+			run = (mAudio->mBufferSize - offset) / channels;
+			if (run > frames)
+			  run = frames;
+
+			float* dest = &mBuffer[offset];
+			long samples = run * channels;
+
+			if (src == NULL) {
+				// a null source is silence, only matters for replace
+				if (op == OpReplace)
+				  SampleZero(dest, samples);
+			}
+			else if (op == OpReplace)
+			  SampleCopy(dest, src, samples);
+			else if (op == OpRemove)
+			  SampleSubtract(dest, src, samples);
+			else
+			  SampleAdd(dest, src, samples);
+
+			// prepareFrame extended to cover the first frame
+			long last = mFrame + run;
+			if (last > mAudio->mFrames)
+			  mAudio->mFrames = last;
+
+			advanceBlock(index, offset, run);
+		}
+	}
+
+	return run;
+}
+
+/**
+ * Helper for putBlock.  If the buffer containing the current frame
+ * has not been allocated and the run up to the next buffer boundary
+ * is silent, extend the frame count without allocating a buffer.
+ * A null source is silence.  Adding, removing, or replacing zeros
+ * in a missing buffer leaves zeros so the op doesn't matter.
+ * Returns the number of frames skipped, zero if a buffer is needed.
+ */
+PRIVATE long AudioCursor::skipBlock(float* src, long frames)
+{
+	int channels = mAudio->mChannels;
+	int index, offset;
+	long run = 0;
+
+	mAudio->locate(mFrame, &index, &offset);
+
+	if (mAudio->getBuffer(index) == NULL) {
+		run = (mAudio->mBufferSize - offset) / channels;
+		if (run > frames)
+		  run = frames;
+
+		if (src != NULL && !mAudio->isEmpty(src, run * channels))
+		  run = 0;
+		else {
+			long last = mFrame + run;
+			if (last > mAudio->mFrames)
+			  mAudio->mFrames = last;
+			advanceBlock(index, offset, run);
+		}
+	}
+
+	return run;
+}
+
+/**
+ * Advance the cursor after a block transfer, leaving the location
+ * state as it would have been after the equivalent number of
+ * incFrame calls.  
+ */
+PRIVATE void AudioCursor::advanceBlock(int index, int offset, long frames)
+{
+	mFrame += frames;
+	mVersion = mAudio->mVersion;
+
+	if (mFrame >= mAudio->mFrames && !mAutoExtend) {
+		// fell off the end of a non-extendable cursor
+		decache();
+	}
+	else {
+		offset += (frames * mAudio->mChannels);
+		if (offset >= mAudio->mBufferSize) {
+			index++;
+			offset = 0;
+		}
+
+		if (index < mAudio->mBufferCount) {
+			mBufferIndex = index;
+			mBufferOffset = offset;
+			mBuffer = mAudio->getBuffer(index);
+		}
+		else {
+			// fell off the edge of the index
+			decache();
+		}
+	}
+}
+
 /****************************************************************************
  *                                                                          *
  *   								 FADE                                   *
@@ -954,6 +1206,7 @@ PUBLIC void AudioCursor::fade(int offset, int frames, bool up, float baseLevel)
 			for (int j = 0 ; j < channels ; j++) {
 				// if mBuffer goes null, we fell off the end
 				if (mBuffer != NULL) {
+					prepareWrite();
 					float* loc = &(mBuffer[mBufferOffset + j]);
 					*loc = mFade.fade(*loc);
 				}
@@ -0,0 +1,529 @@
+/*
+ * Copyright (c) 2010 Jeffrey S. Larson  <jeff@circularlabs.com>
+ * All rights reserved.
+ * See the LICENSE file for the full copyright and license declaration.
+ *
+ * ---------------------------------------------------------------------
+ *
+ * Block transfer kernels for interleaved float sample buffers.
+ * See AudioKernel.h for the SIMD selection rules.
+ *
+ * Each kernel does the widest vector loop it can, then a narrower
+ * one, then finishes the tail one sample at a time.  The order of
+ * operations is the same as the scalar loops they replace so the
+ * results are identical, we only multiply and add.  The peak 
+ * tracking in the mix kernels is exact since max doesn't round.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "AudioKernel.h"
+
+#ifdef AUDIO_KERNEL_SSE
+#include <xmmintrin.h>
+#endif
+
+#ifdef AUDIO_KERNEL_AVX
+#include <immintrin.h>
+#include "cpu_detect.h"
+
+#define AVX_TARGET __attribute__((target("avx")))
+#endif
+
+/****************************************************************************
+ *                                                                          *
+ *                                    AVX                                   *
+ *                                                                          *
+ ****************************************************************************/
+
+/*
+ * The 8 float wide loops.  Each one does as much of the buffer as it
+ * can and returns the index where the SSE loop picks up.  They take
+ * and return plain floats, never vectors, so nothing AVX crosses into
+ * code compiled without it.
+ */
+
+#ifdef AUDIO_KERNEL_AVX
+
+/**
+ * 1 if the CPU and OS support AVX, -1 until we've asked.  Two threads
+ * asking at once get the same answer so this isn't locked.
+ */
+static int AvxSupport = -1;
+
+static bool IsAvx()
+{
+	if (AvxSupport < 0)
+	  AvxSupport = (detectCPUextensions() & SUPPORT_AVX) ? 1 : 0;
+	return (AvxSupport > 0);
+}
+
+/**
+ * Fold the largest lane of a vector of absolute values into max.
+ */
+static AVX_TARGET float AvxMaxLane(__m256 v, float max)
+{
+	float lanes[8];
+	_mm256_storeu_ps(lanes, v);
+	for (int i = 0 ; i < 8 ; i++) {
+		if (lanes[i] > max)
+		  max = lanes[i];
+	}
+	return max;
+}
+
+static AVX_TARGET long AvxCopyScaled(float* dest, const float* src,
+									 long samples, float level)
+{
+	__m256 vlevel = _mm256_set1_ps(level);
+	long i = 0;
+	for ( ; i + 8 <= samples ; i += 8) {
+		__m256 s = _mm256_loadu_ps(&src[i]);
+		_mm256_storeu_ps(&dest[i], _mm256_mul_ps(s, vlevel));
+	}
+	return i;
+}
+
+static AVX_TARGET long AvxAdd(float* dest, const float* src, long samples)
+{
+	long i = 0;
+	for ( ; i + 8 <= samples ; i += 8) {
+		__m256 d = _mm256_loadu_ps(&dest[i]);
+		__m256 s = _mm256_loadu_ps(&src[i]);
+		_mm256_storeu_ps(&dest[i], _mm256_add_ps(d, s));
+	}
+	return i;
+}
+
+static AVX_TARGET long AvxAddScaled(float* dest, const float* src,
+									long samples, float level)
+{
+	__m256 vlevel = _mm256_set1_ps(level);
+	long i = 0;
+	for ( ; i + 8 <= samples ; i += 8) {
+		__m256 d = _mm256_loadu_ps(&dest[i]);
+		__m256 s = _mm256_mul_ps(_mm256_loadu_ps(&src[i]), vlevel);
+		_mm256_storeu_ps(&dest[i], _mm256_add_ps(d, s));
+	}
+	return i;
+}
+
+static AVX_TARGET long AvxSubtract(float* dest, const float* src, long samples)
+{
+	long i = 0;
+	for ( ; i + 8 <= samples ; i += 8) {
+		__m256 d = _mm256_loadu_ps(&dest[i]);
+		__m256 s = _mm256_loadu_ps(&src[i]);
+		_mm256_storeu_ps(&dest[i], _mm256_sub_ps(d, s));
+	}
+	return i;
+}
+
+static AVX_TARGET long AvxMix(float* dest, const float* src, long samples,
+							  float* max)
+{
+	__m256 sign = _mm256_set1_ps(-0.0f);
+	__m256 peak = _mm256_setzero_ps();
+	long i = 0;
+	for ( ; i + 8 <= samples ; i += 8) {
+		__m256 s = _mm256_loadu_ps(&src[i]);
+		__m256 d = _mm256_loadu_ps(&dest[i]);
+		peak = _mm256_max_ps(peak, _mm256_andnot_ps(sign, s));
+		_mm256_storeu_ps(&dest[i], _mm256_add_ps(d, s));
+	}
+	*max = AvxMaxLane(peak, *max);
+	return i;
+}
+
+static AVX_TARGET long AvxMixStereo(float* dest, const float* src,
+									long samples, float left, float right,
+									float* max)
+{
+	__m256 sign = _mm256_set1_ps(-0.0f);
+	__m256 peak = _mm256_setzero_ps();
+	__m256 gains = _mm256_setr_ps(left, right, left, right,
+								  left, right, left, right);
+	long i = 0;
+	for ( ; i + 8 <= samples ; i += 8) {
+		__m256 s = _mm256_mul_ps(_mm256_loadu_ps(&src[i]), gains);
+		__m256 d = _mm256_loadu_ps(&dest[i]);
+		peak = _mm256_max_ps(peak, _mm256_andnot_ps(sign, s));
+		_mm256_storeu_ps(&dest[i], _mm256_add_ps(d, s));
+	}
+	*max = AvxMaxLane(peak, *max);
+	return i;
+}
+
+static AVX_TARGET long AvxMixGains(float* dest, const float* src,
+								   const float* gains, long samples,
+								   float* max)
+{
+	__m256 sign = _mm256_set1_ps(-0.0f);
+	__m256 peak = _mm256_setzero_ps();
+	long i = 0;
+	for ( ; i + 8 <= samples ; i += 8) {
+		__m256 s = _mm256_mul_ps(_mm256_loadu_ps(&src[i]),
+								 _mm256_loadu_ps(&gains[i]));
+		__m256 d = _mm256_loadu_ps(&dest[i]);
+		peak = _mm256_max_ps(peak, _mm256_andnot_ps(sign, s));
+		_mm256_storeu_ps(&dest[i], _mm256_add_ps(d, s));
+	}
+	*max = AvxMaxLane(peak, *max);
+	return i;
+}
+
+#endif
+
+/****************************************************************************
+ *                                                                          *
+ *                                    COPY                                  *
+ *                                                                          *
+ ****************************************************************************/
+
+void SampleCopy(float* dest, const float* src, long samples)
+{
+	if (samples > 0)
+	  memmove(dest, src, samples * sizeof(float));
+}
+
+void SampleZero(float* dest, long samples)
+{
+	if (samples > 0)
+	  memset(dest, 0, samples * sizeof(float));
+}
+
+void SampleCopyScaled(float* dest, const float* src, long samples,
+                      float level)
+{
+	long i = 0;
+
+#ifdef AUDIO_KERNEL_AVX
+	if (IsAvx())
+	  i = AvxCopyScaled(dest, src, samples, level);
+#endif
+
+#ifdef AUDIO_KERNEL_SSE
+	__m128 vlevel = _mm_set1_ps(level);
+	for ( ; i + 4 <= samples ; i += 4) {
+		__m128 s = _mm_loadu_ps(&src[i]);
+		_mm_storeu_ps(&dest[i], _mm_mul_ps(s, vlevel));
+	}
+#endif
+
+	for ( ; i < samples ; i++)
+	  dest[i] = src[i] * level;
+}
+
+/****************************************************************************
+ *                                                                          *
+ *                                    ADD                                   *
+ *                                                                          *
+ ****************************************************************************/
+
+void SampleAdd(float* dest, const float* src, long samples)
+{
+	long i = 0;
+
+#ifdef AUDIO_KERNEL_AVX
+	if (IsAvx())
+	  i = AvxAdd(dest, src, samples);
+#endif
+
+#ifdef AUDIO_KERNEL_SSE
+	for ( ; i + 4 <= samples ; i += 4) {
+		__m128 d = _mm_loadu_ps(&dest[i]);
+		__m128 s = _mm_loadu_ps(&src[i]);
+		_mm_storeu_ps(&dest[i], _mm_add_ps(d, s));
+	}
+#endif
+
+	for ( ; i < samples ; i++)
+	  dest[i] += src[i];
+}
+
+/**
+ * The multiply happens before the add, same as the old
+ * per-sample loop in AudioCursor, so we don't introduce
+ * rounding differences.  Don't let the compiler fuse these.
+ */
+void SampleAddScaled(float* dest, const float* src, long samples,
+                     float level)
+{
+	long i = 0;
+
+#ifdef AUDIO_KERNEL_AVX
+	if (IsAvx())
+	  i = AvxAddScaled(dest, src, samples, level);
+#endif
+
+#ifdef AUDIO_KERNEL_SSE
+	__m128 vlevel = _mm_set1_ps(level);
+	for ( ; i + 4 <= samples ; i += 4) {
+		__m128 d = _mm_loadu_ps(&dest[i]);
+		__m128 s = _mm_mul_ps(_mm_loadu_ps(&src[i]), vlevel);
+		_mm_storeu_ps(&dest[i], _mm_add_ps(d, s));
+	}
+#endif
+
+	for ( ; i < samples ; i++) {
+		float sample = src[i] * level;
+		dest[i] += sample;
+	}
+}
+
+/****************************************************************************
+ *                                                                          *
+ *                                  SUBTRACT                                *
+ *                                                                          *
+ ****************************************************************************/
+
+void SampleSubtract(float* dest, const float* src, long samples)
+{
+	long i = 0;
+
+#ifdef AUDIO_KERNEL_AVX
+	if (IsAvx())
+	  i = AvxSubtract(dest, src, samples);
+#endif
+
+#ifdef AUDIO_KERNEL_SSE
+	for ( ; i + 4 <= samples ; i += 4) {
+		__m128 d = _mm_loadu_ps(&dest[i]);
+		__m128 s = _mm_loadu_ps(&src[i]);
+		_mm_storeu_ps(&dest[i], _mm_sub_ps(d, s));
+	}
+#endif
+
+	for ( ; i < samples ; i++)
+	  dest[i] -= src[i];
+}
+
+/****************************************************************************
+ *                                                                          *
+ *                                    MIX                                   *
+ *                                                                          *
+ ****************************************************************************/
+
+#ifdef AUDIO_KERNEL_SSE
+/**
+ * Largest lane of a vector of absolute values.
+ */
+static float MaxLane(__m128 v)
+{
+	float lanes[4];
+	_mm_storeu_ps(lanes, v);
+	float max = lanes[0];
+	for (int i = 1 ; i < 4 ; i++) {
+		if (lanes[i] > max)
+		  max = lanes[i];
+	}
+	return max;
+}
+#endif
+
+/**
+ * Scalar peak tracking, same as OutputStream::checkMax.
+ */
+static float CheckMax(float sample, float max)
+{
+	if (sample < 0)
+	  sample = -sample;
+	return (sample > max) ? sample : max;
+}
+
+float SampleMix(float* dest, const float* src, long samples, float max)
+{
+	long i = 0;
+
+#ifdef AUDIO_KERNEL_AVX
+	if (IsAvx())
+	  i = AvxMix(dest, src, samples, &max);
+#endif
+
+#ifdef AUDIO_KERNEL_SSE
+	__m128 sign = _mm_set1_ps(-0.0f);
+	__m128 peak = _mm_setzero_ps();
+
+	for ( ; i + 4 <= samples ; i += 4) {
+		__m128 s = _mm_loadu_ps(&src[i]);
+		__m128 d = _mm_loadu_ps(&dest[i]);
+		peak = _mm_max_ps(peak, _mm_andnot_ps(sign, s));
+		_mm_storeu_ps(&dest[i], _mm_add_ps(d, s));
+	}
+	max = CheckMax(MaxLane(peak), max);
+#endif
+
+	for ( ; i < samples ; i++) {
+		float sample = src[i];
+		max = CheckMax(sample, max);
+		dest[i] += sample;
+	}
+
+	return max;
+}
+
+float SampleMixStereo(float* dest, const float* src, long frames,
+					  float left, float right, float max)
+{
+	long samples = frames * 2;
+	long i = 0;
+
+#ifdef AUDIO_KERNEL_AVX
+	if (IsAvx())
+	  i = AvxMixStereo(dest, src, samples, left, right, &max);
+#endif
+
+#ifdef AUDIO_KERNEL_SSE
+	__m128 sign = _mm_set1_ps(-0.0f);
+	__m128 peak = _mm_setzero_ps();
+
+	__m128 gains = _mm_setr_ps(left, right, left, right);
+	for ( ; i + 4 <= samples ; i += 4) {
+		__m128 s = _mm_mul_ps(_mm_loadu_ps(&src[i]), gains);
+		__m128 d = _mm_loadu_ps(&dest[i]);
+		peak = _mm_max_ps(peak, _mm_andnot_ps(sign, s));
+		_mm_storeu_ps(&dest[i], _mm_add_ps(d, s));
+	}
+	max = CheckMax(MaxLane(peak), max);
+#endif
+
+	// i is always even here
+	for ( ; i < samples ; i += 2) {
+		float sample = src[i] * left;
+		max = CheckMax(sample, max);
+		dest[i] += sample;
+		sample = src[i+1] * right;
+		max = CheckMax(sample, max);
+		dest[i+1] += sample;
+	}
+
+	return max;
+}
+
+float SampleMixGains(float* dest, const float* src, const float* gains,
+					 long samples, float max)
+{
+	long i = 0;
+
+#ifdef AUDIO_KERNEL_AVX
+	if (IsAvx())
+	  i = AvxMixGains(dest, src, gains, samples, &max);
+#endif
+
+#ifdef AUDIO_KERNEL_SSE
+	__m128 sign = _mm_set1_ps(-0.0f);
+	__m128 peak = _mm_setzero_ps();
+
+	for ( ; i + 4 <= samples ; i += 4) {
+		__m128 s = _mm_mul_ps(_mm_loadu_ps(&src[i]), _mm_loadu_ps(&gains[i]));
+		__m128 d = _mm_loadu_ps(&dest[i]);
+		peak = _mm_max_ps(peak, _mm_andnot_ps(sign, s));
+		_mm_storeu_ps(&dest[i], _mm_add_ps(d, s));
+	}
+	max = CheckMax(MaxLane(peak), max);
+#endif
+
+	for ( ; i < samples ; i++) {
+		float sample = src[i] * gains[i];
+		max = CheckMax(sample, max);
+		dest[i] += sample;
+	}
+
+	return max;
+}
+
+/**
+ * Two frames at a time with SSE, the shuffles line up the left
+ * and right samples of each frame so the sum happens in both lanes.
+ * Not worth an AVX version, the shuffles don't cross lanes nicely.
+ */
+float SampleMixMono(float* dest, const float* src, const float* levels,
+					long frames, float max)
+{
+	long f = 0;
+
+#ifdef AUDIO_KERNEL_SSE
+	__m128 sign = _mm_set1_ps(-0.0f);
+	__m128 peak = _mm_setzero_ps();
+	__m128 half = _mm_set1_ps(0.5f);
+
+	for ( ; f + 2 <= frames ; f += 2) {
+		__m128 v = _mm_loadu_ps(&src[f * 2]);
+		__m128 l = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 0, 0));
+		__m128 r = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 1, 1));
+		__m128 lv = _mm_setr_ps(levels[f], levels[f], 
+								levels[f+1], levels[f+1]);
+		__m128 s = _mm_mul_ps(_mm_mul_ps(_mm_add_ps(l, r), lv), half);
+		__m128 d = _mm_loadu_ps(&dest[f * 2]);
+		peak = _mm_max_ps(peak, _mm_andnot_ps(sign, s));
+		_mm_storeu_ps(&dest[f * 2], _mm_add_ps(d, s));
+	}
+	max = CheckMax(MaxLane(peak), max);
+#endif
+
+	for ( ; f < frames ; f++) {
+		float sample = src[f * 2];
+		sample += src[(f * 2) + 1];
+		sample *= levels[f];
+		sample *= 0.5f;
+		max = CheckMax(sample, max);
+		dest[f * 2] += sample;
+		dest[(f * 2) + 1] += sample;
+	}
+
+	return max;
+}
+
+/****************************************************************************
+ *                                                                          *
+ *                               FILTER KERNELS                             *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * The vector loop keeps four partial sums for each channel so unlike 
+ * the other kernels the result can differ from the scalar loop in the
+ * last bit.  Each coefficient is duplicated for the two channels of 
+ * its frame.
+ */
+void SampleDotStereo(const float* src, const float* coeffs, long taps,
+					 float* left, float* right)
+{
+	float lsum = 0.0f;
+	float rsum = 0.0f;
+	long t = 0;
+
+#ifdef AUDIO_KERNEL_SSE
+	__m128 sum1 = _mm_setzero_ps();
+	__m128 sum2 = _mm_setzero_ps();
+
+	for ( ; t + 4 <= taps ; t += 4) {
+		__m128 c = _mm_loadu_ps(&coeffs[t]);
+		__m128 f1 = _mm_loadu_ps(&src[t * 2]);
+		__m128 f2 = _mm_loadu_ps(&src[(t * 2) + 4]);
+		sum1 = _mm_add_ps(sum1, _mm_mul_ps(f1, _mm_unpacklo_ps(c, c)));
+		sum2 = _mm_add_ps(sum2, _mm_mul_ps(f2, _mm_unpackhi_ps(c, c)));
+	}
+
+	// L R L R, fold the halves together
+	float lanes[4];
+	sum1 = _mm_add_ps(sum1, sum2);
+	_mm_storeu_ps(lanes, _mm_add_ps(sum1, _mm_movehl_ps(sum1, sum1)));
+	lsum = lanes[0];
+	rsum = lanes[1];
+#endif
+
+	for ( ; t < taps ; t++) {
+		lsum += src[t * 2] * coeffs[t];
+		rsum += src[(t * 2) + 1] * coeffs[t];
+	}
+
+	*left = lsum;
+	*right = rsum;
+}
+
+/****************************************************************************/
+/****************************************************************************/
+/****************************************************************************/
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2010 Jeffrey S. Larson  <jeff@circularlabs.com>
+ * All rights reserved.
+ * See the LICENSE file for the full copyright and license declaration.
+ *
+ * ---------------------------------------------------------------------
+ *
+ * Block transfer kernels for interleaved float sample buffers.
+ * These are the inner loops used by AudioCursor when it can move
+ * a run of frames without per-frame fade or reverse handling,
+ * and by OutputStream when it mixes a track into the interrupt buffer.
+ *
+ * Where the compiler tells us SSE is available we use intrinsics,
+ * with AVX loops on top when the CPU has it, otherwise there is
+ * a plain loop that the compiler is free to unroll.  All kernels work on unaligned buffers since
+ * the cursors can start anywhere within an Audio buffer.
+ *
+ */
+
+#ifndef AUDIO_KERNEL_H
+#define AUDIO_KERNEL_H
+
+/****************************************************************************
+ *                                                                          *
+ *                                 SIMD FLAGS                               *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * MSVC doesn't define __SSE__ so we have to infer it from the
+ * architecture flags.  x64 always has SSE2, for x86 we need /arch:SSE2.
+ * OSX Intel builds always have SSE.
+ */
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define AUDIO_KERNEL_SSE
+#endif
+
+/**
+ * AVX loops are compiled with a GCC target attribute rather than -mavx
+ * so the build still runs on CPUs without it, and are only called
+ * when detectCPUextensions reports SUPPORT_AVX.  Same conditions as
+ * ALLOW_AVX in SoundTouch's STTypes.h.
+ */
+#if defined(AUDIO_KERNEL_SSE) && defined(__x86_64__) && \
+    (__GNUC__ >= 5 || defined(__clang__))
+#define AUDIO_KERNEL_AVX
+#endif
+
+/****************************************************************************
+ *                                                                          *
+ *                                  KERNELS                                 *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * dest[i] = src[i]
+ */
+extern void SampleCopy(float* dest, const float* src, long samples);
+
+/**
+ * dest[i] = src[i] * level
+ */
+extern void SampleCopyScaled(float* dest, const float* src, long samples,
+                             float level);
+
+/**
+ * dest[i] = 0
+ */
+extern void SampleZero(float* dest, long samples);
+
+/**
+ * dest[i] += src[i]
+ */
+extern void SampleAdd(float* dest, const float* src, long samples);
+
+/**
+ * dest[i] += src[i] * level
+ */
+extern void SampleAddScaled(float* dest, const float* src, long samples,
+                            float level);
+
+/**
+ * dest[i] -= src[i]
+ */
+extern void SampleSubtract(float* dest, const float* src, long samples);
+
+/****************************************************************************
+ *                                                                          *
+ *                                MIX KERNELS                               *
+ *                                                                          *
+ ****************************************************************************/
+
+/*
+ * These add a block to the interrupt buffer and return the larger of
+ * the max argument and the largest absolute value added, which is
+ * how OutputStream tracks the output level meter.
+ */
+
+/**
+ * dest[i] += src[i]
+ */
+extern float SampleMix(float* dest, const float* src, long samples,
+                       float max);
+
+/**
+ * Interleaved stereo with a constant gain for each channel.
+ * dest[2f] += src[2f] * left, dest[2f+1] += src[2f+1] * right
+ */
+extern float SampleMixStereo(float* dest, const float* src, long frames,
+                             float left, float right, float max);
+
+/**
+ * A gain for every sample, used when a level or pan is ramping.
+ * dest[i] += src[i] * gains[i]
+ */
+extern float SampleMixGains(float* dest, const float* src, 
+                            const float* gains, long samples, float max);
+
+/**
+ * Interleaved stereo folded to mono and split evenly between the
+ * channels, with a level for every frame.
+ * dest[2f] += ((src[2f] + src[2f+1]) * levels[f]) * 0.5, same for dest[2f+1]
+ */
+extern float SampleMixMono(float* dest, const float* src, 
+                           const float* levels, long frames, float max);
+
+/****************************************************************************
+ *                                                                          *
+ *                               FILTER KERNELS                             *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * Dot product of a run of interleaved stereo frames with one set of
+ * filter coefficients, used by Resampler for each output frame.
+ * left = sum(src[2t] * coeffs[t]), right = sum(src[2t+1] * coeffs[t])
+ */
+extern void SampleDotStereo(const float* src, const float* coeffs, long taps,
+                            float* left, float* right);
+
+#endif
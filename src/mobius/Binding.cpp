@@ -324,6 +324,8 @@ PRIVATE void Binding::init()
 
     // arguments
 	mArgs = NULL;
+
+    mExportEpsilon = -1;
 }
 
 Binding::Binding()
@@ -553,6 +555,16 @@ const char* Binding::getArgs()
 	return mArgs;
 }
 
+void Binding::setExportEpsilon(int i)
+{
+	mExportEpsilon = i;
+}
+
+int Binding::getExportEpsilon()
+{
+	return mExportEpsilon;
+}
+
 //
 // Utilities
 //
@@ -651,6 +663,7 @@ PUBLIC void Binding::getKeyString(char* buffer, int max)
 #define ATT_SCOPE "scope"
 #define ATT_TRACK "track"
 #define ATT_GROUP "group"
+#define ATT_EXPORT_EPSILON "exportEpsilon"
 
 void Binding::parseXml(XmlElement* e) 
 {
@@ -680,6 +693,8 @@ void Binding::parseXml(XmlElement* e)
 
     // arguments
 	setArgs(e->getAttribute(ATT_ARGS));
+
+	mExportEpsilon = e->getIntAttribute(ATT_EXPORT_EPSILON, -1);
 }
 
 /**
@@ -759,6 +774,9 @@ void Binding::toXml(XmlBuffer* b)
 
 		b->addAttribute(ATT_ARGS, mArgs);
 
+		if (mExportEpsilon >= 0)
+		  b->addAttribute(ATT_EXPORT_EPSILON, mExportEpsilon);
+
 		b->add("/>\n");
 	}
 }
@@ -451,6 +451,10 @@ class Binding {
 	void setArgs(const char* c);
 	const char* getArgs();
 
+    // only for exported OSC bindings
+    void setExportEpsilon(int i);
+    int getExportEpsilon();
+
 	//
 	// scope
 	//
@@ -502,6 +506,10 @@ class Binding {
     // arguments
 	char* mArgs;
 
+    // how far an exported value moves before it is sent,
+    // negative to use the default for the target
+    int mExportEpsilon;
+
 };
 
 /****************************************************************************
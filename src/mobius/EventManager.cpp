@@ -2145,6 +2145,47 @@ PRIVATE long EventManager::reflectFrame(Loop* loop, long frame)
  *                                                                          *
  ****************************************************************************/
 
+/**
+ * Return true if getNextEvent could return something during the next
+ * block of frames.  Used by Recorder to decide whether the track can
+ * be processed in parallel with other tracks, so this errs on the side
+ * of saying yes.  Any scheduled event counts, including pending script
+ * waits, as do the pseudo events for loop, cycle and subcycle boundaries.
+ * Sync events are checked by the caller.
+ */
+PUBLIC bool EventManager::isEventInRange(long frames)
+{
+    bool inRange = false;
+
+    if (mEvents->getEvents() != NULL || mSwitch != NULL) {
+        inRange = true;
+    }
+    else {
+        Loop* loop = mTrack->getLoop();
+        long loopFrames = loop->getFrames();
+        if (loopFrames > 0) {
+            // same extra frame range as getNextScheduledEvent,
+            // plus one more for speed rounding
+            InputStream* istream = mTrack->getInputStream();
+            long scaled = (long)((float)frames * istream->getSpeed()) + 1;
+            long startFrame = loop->getFrame();
+            long lastFrame = startFrame + scaled;
+
+            if (loopFrames >= startFrame && loopFrames <= lastFrame)
+              inRange = true;
+            else {
+                // cycles are also subcycles
+                long next = getQuantizedFrame(loop, startFrame, 
+                                              Preset::QUANTIZE_SUBCYCLE, false);
+                if (next >= startFrame && next <= lastFrame)
+                  inRange = true;
+            }
+        }
+    }
+
+    return inRange;
+}
+
 /**
  * Return the next event in this track.
  */
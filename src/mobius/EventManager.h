@@ -109,6 +109,7 @@ class EventManager {
     // Selection
 
 	Event* getNextEvent();
+    bool isEventInRange(long frames);
 
     // Processing
 
@@ -20,6 +20,7 @@
 #include "Action.h"
 #include "Binding.h"
 #include "Mobius.h"
+#include "MobiusState.h"
 #include "Parameter.h"
 #include "Track.h"
 
@@ -54,6 +55,9 @@ PUBLIC void Export::init()
     mLast = -1;
     mMidiChannel = 0;
     mMidiNumber = 0;
+    mStateTrack = -1;
+    mStateVersion = 0;
+    mStateValue = -1;
 }
 
 Export::~Export()
@@ -304,6 +308,25 @@ bool Export::isDisplayable()
     return displayable;
 }
 
+/**
+ * Return true if the export has a range of values like a level
+ * rather than a few like an enumeration or boolean.
+ */
+bool Export::isContinuous()
+{
+    bool continuous = false;
+
+    if (mTarget != NULL) {
+        Target* type = mTarget->getTarget();
+        if (type == TargetParameter) {
+            Parameter* p = (Parameter*)mTarget->getObject();
+            continuous = (p != NULL && p->type == TYPE_INT);
+        }
+    }
+
+    return continuous;
+}
+
 //////////////////////////////////////////////////////////////////////
 //
 // Target Value
@@ -341,6 +364,31 @@ PRIVATE Track* Export::getTargetTrack()
     return found;
 }
 
+/**
+ * Select the target track index in a state snapshot.
+ */
+PRIVATE int Export::getTargetTrack(StateSnapshot* state)
+{
+    int found = -1;
+
+    if (mTarget->getTrack() > 0) {
+        found = mTarget->getTrack() - 1;
+    }
+    else if (mTarget->getGroup() > 0) {
+        for (int i = 0 ; i < state->trackCount ; i++) {
+            if (state->tracks[i].group == mTarget->getGroup()) {
+                found = i;
+                break;
+            }
+        }
+    }
+    else {
+        found = mMobius->getActiveTrack();
+    }
+
+    return found;
+}
+
 /**
  * Get the current value of the export as an ordinal.
  * Used for interfaces like OSC that only support 
@@ -368,6 +416,47 @@ PUBLIC int Export::getOrdinalValue()
     return value;
 }
 
+/**
+ * Get the current value of the export as an ordinal from a 
+ * snapshot published by the interrupt rather than the live tracks.
+ * The value is remembered and only read again after the track
+ * changes.  Parameters that aren't kept in TrackState fall back
+ * to the live value, as does everything when there is no snapshot.
+ */
+PUBLIC int Export::getOrdinalValue(StateSnapshot* state)
+{
+    int value = -1;
+    bool found = false;
+
+    if (mTarget != NULL && state != NULL && 
+        mTarget->getTarget() == TargetParameter) {
+
+        int tracknum = getTargetTrack(state);
+        if (tracknum >= 0 && tracknum < state->trackCount) {
+
+            if (tracknum == mStateTrack &&
+                state->trackVersions[tracknum] <= mStateVersion) {
+                value = mStateValue;
+                found = true;
+            }
+            else {
+                Parameter* p = (Parameter*)mTarget->getObject();
+                found = p->getStateValue(&(state->tracks[tracknum]), &value);
+                if (found) {
+                    mStateTrack = tracknum;
+                    mStateVersion = state->version;
+                    mStateValue = value;
+                }
+            }
+        }
+    }
+
+    if (!found)
+      value = getOrdinalValue();
+
+    return value;
+}
+
 /**
  * Get the current value of the export in "natural" form.
  * This may be an enumeration symbol or a string.
@@ -92,11 +92,13 @@ class Export {
     int getMinimum();
     int getMaximum();
     int getOrdinalValue();
+    int getOrdinalValue(class StateSnapshot* state);
     void getOrdinalLabel(int ordinal, class ExValue* value);
     void getValue(class ExValue* value);
     const char** getValueLabels();
     const char* getDisplayName();
     bool isDisplayable();
+    bool isContinuous();
 
     //
     // Client specific properties
@@ -123,6 +125,7 @@ class Export {
 
     void init();
     class Track* getTargetTrack();
+    int getTargetTrack(class StateSnapshot* state);
 
     /**
      * Exports are usually on a list maintained by the client.
@@ -165,6 +168,14 @@ class Export {
     int mMidiChannel;
     int mMidiNumber;
 
+    /**
+     * The track, snapshot version and value of the last ordinal
+     * read from a StateSnapshot.
+     */
+    int mStateTrack;
+    long mStateVersion;
+    int mStateValue;
+
     // TODO: for OSC exports, the path
 
 };
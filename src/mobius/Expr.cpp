@@ -65,14 +65,126 @@
 #include <memory.h>
 #include <string.h>
 #include <ctype.h>
+#include <new>
 
 #include "Util.h"
 #include "Vbuf.h"
 #include "Trace.h"
+#include "Thread.h"
 #include "List.h"
 
 #include "Expr.h"
 
+//////////////////////////////////////////////////////////////////////
+//
+// ExStringTable
+//
+//////////////////////////////////////////////////////////////////////
+
+/**
+ * Slots and arena size for the interned string literals.
+ * Slots must be a power of two.
+ */
+#define EX_STRING_SLOTS 4096
+#define EX_STRING_ARENA (1024 * 256)
+
+PUBLIC ExStringTable ExStrings(EX_STRING_SLOTS, EX_STRING_ARENA);
+
+PUBLIC ExStringTable::ExStringTable(int slots, int arena)
+{
+	mSlots = slots;
+	mStrings = new char*[slots];
+	for (int i = 0 ; i < slots ; i++)
+	  mStrings[i] = NULL;
+	mArenaSize = arena;
+	mArena = new char[arena];
+	mArenaUsed = 0;
+}
+
+PUBLIC ExStringTable::~ExStringTable()
+{
+	delete mStrings;
+	delete mArena;
+}
+
+PUBLIC int ExStringTable::getSlots()
+{
+	return mSlots;
+}
+
+/**
+ * Return the interned copy of a string, adding it if necessary.
+ * Strings are truncated to EX_MAX_STRING - 1 like they are when
+ * copied into a value.  Returns NULL if the table is full.
+ */
+PUBLIC const char* ExStringTable::intern(const char* src)
+{
+	const char* interned = NULL;
+	int slot = find(src);
+	if (slot >= 0)
+	  interned = mStrings[slot];
+	return interned;
+}
+
+/**
+ * Return the position of a string in the table, adding it if
+ * necessary.  Returns -1 if the table is full.
+ */
+PUBLIC int ExStringTable::getSlot(const char* src)
+{
+	return find(src);
+}
+
+/**
+ * Open addressing with linear probing.  Slots are only ever set
+ * once, if we lose the CAS the slot may hold the same string so
+ * compare before moving on.
+ */
+PRIVATE int ExStringTable::find(const char* src)
+{
+	int found = -1;
+
+	if (src == NULL)
+	  src = "";
+
+	int len = 0;
+	unsigned int hash = 2166136261u;
+	while (len < EX_MAX_STRING - 1 && src[len] != 0) {
+		hash = (hash ^ (unsigned char)src[len]) * 16777619u;
+		len++;
+	}
+
+	for (int i = 0 ; i < mSlots && found < 0 ; i++) {
+		int slot = (int)((hash + i) & (mSlots - 1));
+		char* s = mStrings[slot];
+		if (s == NULL) {
+			if (mArenaUsed >= mArenaSize)
+			  break;
+			int end = AtomicAdd(&mArenaUsed, len + 1);
+			if (end > mArenaSize) {
+				// arena is full, stop trying
+				break;
+			}
+			char* copy = &mArena[end - len - 1];
+			memcpy(copy, src, len);
+			copy[len] = 0;
+			if (AtomicCompareAndSwapPointer((void* volatile*)&mStrings[slot], NULL, copy))
+			  found = slot;
+			else {
+				// someone beat us to it, the copy is wasted
+				// but it could be the same string
+				s = mStrings[slot];
+			}
+		}
+
+		if (found < 0 && s != NULL && 
+			memcmp(s, src, len) == 0 && s[len] == 0)
+		  found = slot;
+	}
+
+	return found;
+}
+
 //////////////////////////////////////////////////////////////////////
 //
 // ExValueList
@@ -171,9 +283,8 @@ ExValue::ExValue()
 {
 	mType = EX_STRING;
 	mInt = 0;
-	mFloat = 0.0;
-	mBool = false;
 	mList = NULL;
+	mInterned = NULL;
 	strcpy(mString, "");
 }
 
@@ -202,29 +313,64 @@ void ExValue::setType(ExType t)
 	mType = t;
 }
 
-char* ExValue::getBuffer()
-{
-	return mString;
-}
-
-int ExValue::getBufferMax()
-{
-	return EX_MAX_STRING;
-}
-
 void ExValue::setNull()
 {
 	mType = EX_STRING;
     mInt = 0;   
-    mFloat = 0.0;
-    mBool = false;
+	mInterned = NULL;
 	strcpy(mString, "");
     releaseList();
 }
 
 bool ExValue::isNull()
 {
-	return ((mType == EX_STRING) && (strlen(mString) == 0));
+	// interned strings are never empty
+	return ((mType == EX_STRING) && (mInterned == NULL) && 
+			(strlen(mString) == 0));
+}
+
+/**
+ * Copy a string into the value.  The caller sets the type.
+ * These are never interned, they may be made in the interrupt and
+ * nothing would take them out of ExStrings.
+ */
+PRIVATE void ExValue::storeString(const char* src)
+{
+	if (src == NULL) {
+		mInterned = NULL;
+		strcpy(mString, "");
+	}
+	else if (src == mString) {
+		// coerce may call us with our own buffer
+		mInterned = NULL;
+	}
+	else if (src != mInterned) {
+		mInterned = NULL;
+		CopyString(src, mString, EX_MAX_STRING);
+	}
+}
+
+/**
+ * The characters of a string value wherever they are.
+ */
+PRIVATE const char* ExValue::getChars()
+{
+	return (mInterned != NULL) ? mInterned : mString;
+}
+
+/**
+ * Move a long string into ExStrings so copying the value is a
+ * pointer copy.  Only for literals, which there are a bounded number
+ * of, the table is never emptied.  If it is full the string stays here.
+ */
+void ExValue::intern()
+{
+	if (mType == EX_STRING && mInterned == NULL && 
+		strlen(mString) > EX_INTERN_STRING) {
+		mInterned = ExStrings.intern(mString);
+		if (mInterned == NULL)
+		  Trace(2, "ExValue: string table full\n");
+	}
 }
 
 int ExValue::getInt()
@@ -245,7 +391,7 @@ int ExValue::getInt()
 		case EX_STRING: { 
 			// if empty, it won't set this
             ival = 0;
-			sscanf(mString, "%d", &ival);
+			sscanf(getChars(), "%d", &ival);
 		}
 		break;
  
@@ -305,7 +451,9 @@ float ExValue::getFloat()
 		break;
 
 		case EX_STRING: {
-			sscanf(mString, "%f", &fval);
+			// like getInt, don't let a stale value through
+			fval = 0.0f;
+			sscanf(getChars(), "%f", &fval);
 		}
 		break;
 
@@ -351,10 +499,11 @@ bool ExValue::getBool()
 		break;
 
 		case EX_STRING: {
-			bval = (StringEqualNoCase(mString, "true") ||
-					StringEqualNoCase(mString, "yes") ||
-					StringEqualNoCase(mString, "on") ||
-					StringEqualNoCase(mString, "1"));
+			const char* chars = getChars();
+			bval = (StringEqualNoCase(chars, "true") ||
+					StringEqualNoCase(chars, "yes") ||
+					StringEqualNoCase(chars, "on") ||
+					StringEqualNoCase(chars, "1"));
 		}
 		break;
 
@@ -385,32 +534,38 @@ void ExValue::setBool(bool b)
 
 const char* ExValue::getString() 
 {
+	char buffer[EX_MAX_STRING + 4];
+
 	switch (mType) {
 
 		case EX_INT: {
-			sprintf(mString, "%d", mInt);
+			sprintf(buffer, "%d", mInt);
+			storeString(buffer);
 		}
 		break;
 
 		case EX_FLOAT: {
-			sprintf(mString, "%f", mFloat);
+			sprintf(buffer, "%f", mFloat);
+			storeString(buffer);
 		}
 		break;
 
 		case EX_BOOL: {
 			if (mBool)
-			  strcpy(mString, "true");
+			  storeString("true");
 			else
-			  strcpy(mString, "false");
+			  storeString("false");
         }
         break;
 
 		case EX_LIST: {
 			ExValue* el = getList(0);
-			if (el != NULL)
-			  el->getString(mString, EX_MAX_STRING);
+			if (el != NULL) {
+				el->getString(buffer, EX_MAX_STRING);
+				storeString(buffer);
+			}
 			else
-			  strcpy(mString, "");
+			  storeString(NULL);
 			break;
 		}
 		break;
@@ -421,7 +576,7 @@ const char* ExValue::getString()
 		break;
 	}
 
-	return mString;
+	return getChars();
 }
 
 /**
@@ -451,7 +606,7 @@ void ExValue::getString(char* buffer, int max)
         break;
 
         case EX_STRING: {
-            CopyString(mString, buffer, max);
+            CopyString(getChars(), buffer, max);
 		}
         break;
 
@@ -472,9 +627,7 @@ void ExValue::getString(char* buffer, int max)
 void ExValue::setString(const char* src)
 {
 	mType = EX_STRING;
-	// coerce may call us with our own buffer
-	if (src != mString)
-	  CopyString(src, mString, EX_MAX_STRING);
+	storeString(src);
     releaseList();
 }
 
@@ -483,8 +636,13 @@ void ExValue::addString(const char* src)
     if (mType != EX_STRING)
       setString(src);
 
-    else if (src != mString) 
-      AppendString(src, mString, EX_MAX_STRING);
+    else if (src != NULL && src != mString && src != mInterned) {
+		if (mInterned != NULL) {
+			CopyString(mInterned, mString, EX_MAX_STRING);
+			mInterned = NULL;
+		}
+		AppendString(src, mString, EX_MAX_STRING);
+	}
 }
 
 ExValueList* ExValue::getList() 
@@ -514,7 +672,7 @@ ExValueList* ExValue::getList()
 
 		case EX_STRING: {
 			first = new ExValue();
-			first->setString(mString);
+			first->set(this);
 		}
 		break;
 
@@ -581,27 +739,34 @@ void ExValue::setOwnedList(ExValueList* src)
 
 void ExValue::set(ExValue* src, bool owned)
 {
-    setNull();
-    if (src != NULL) {
+    if (src == NULL || src == this)
+      setNull();
+    else {
 		ExType otype = src->getType();
 		switch (otype) {
 			case EX_INT:
-				setInt(src->getInt());
+				setInt(src->mInt);
 				break;
 
 			case EX_FLOAT:
-				setFloat(src->getFloat());
+				setFloat(src->mFloat);
 				break;
 
 			case EX_BOOL:
-				setBool(src->getBool());
+				setBool(src->mBool);
 				break;
 
 			case EX_STRING:
-				setString(src->getString());
+				// interned strings don't need another lookup
+				mType = EX_STRING;
+				mInterned = src->mInterned;
+				if (mInterned == NULL)
+				  strcpy(mString, src->mString);
+				releaseList();
 				break;
 
 			case EX_LIST:
+				setNull();
                 if (owned)
                   setOwnedList(src->takeList());
                 else
@@ -830,7 +995,7 @@ void ExValue::toString(Vbuf* b)
             b->add("]");
         }
     }
-    else if (mType == EX_STRING && strlen(mString) == 0) {
+    else if (isNull()) {
         b->add("null");
     }
     else {
@@ -1102,6 +1267,42 @@ PRIVATE void ExNode::evaln(ExContext* context, ExValue* values, int max)
 	}
 }
 
+/**
+ * Nodes that don't know how to compile themselves leave the
+ * whole expression as a tree.
+ */
+bool ExNode::compile(ExProgram* p)
+{
+	return false;
+}
+
+/**
+ * Compile the first few children like eval1 and eval2, missing
+ * operands are null.
+ */
+PRIVATE bool ExNode::compileOperands(ExProgram* p, int count)
+{
+	bool ok = true;
+	ExNode* c = mChildren;
+	for (int i = 0 ; i < count && ok ; i++) {
+		if (c == NULL)
+		  ok = p->add(EX_OP_NULL, 0);
+		else {
+			ok = c->compile(p);
+			c = c->getNext();
+		}
+	}
+	return ok;
+}
+
+PRIVATE bool ExNode::compileChildren(ExProgram* p)
+{
+	bool ok = true;
+	for (ExNode* c = mChildren ; c != NULL && ok ; c = c->getNext())
+	  ok = c->compile(p);
+	return ok;
+}
+
 void ExNode::toString(Vbuf* b)
 {
 	b->add("?");
@@ -1126,6 +1327,7 @@ ExLiteral::ExLiteral(float f)
 ExLiteral::ExLiteral(const char* str)
 {
 	mValue.setString(str);
+	mValue.intern();
 }
 
 void ExLiteral::eval(ExContext* context, ExValue* value)
@@ -1133,6 +1335,11 @@ void ExLiteral::eval(ExContext* context, ExValue* value)
 	value->set(&mValue);
 }
 
+bool ExLiteral::compile(ExProgram* p)
+{
+	return p->addConstant(&mValue);
+}
+
 void ExLiteral::toString(Vbuf* b)
 {
 	mValue.toString(b);
@@ -1186,6 +1393,11 @@ void ExSymbol::eval(ExContext* context, ExValue* value)
 	  mResolver->getExValue(context, value);
 }
 
+bool ExSymbol::compile(ExProgram* p)
+{
+	return p->addSymbol(this);
+}
+
 void ExSymbol::toString(Vbuf* b)
 {
 	b->add(mName);
@@ -1278,6 +1490,16 @@ void ExNot::eval(ExContext* context, ExValue* value)
 	}
 }
 
+bool ExNot::compile(ExProgram* p)
+{
+	bool ok;
+	if (mChildren == NULL)
+	  ok = p->add(EX_OP_TRUE, 0);
+	else
+	  ok = (mChildren->compile(p) && p->add(EX_OP_NOT, 0));
+	return ok;
+}
+
 const char* ExNegate::getOperator()
 {
 	return "-";
@@ -1304,6 +1526,19 @@ void ExNegate::eval(ExContext* context, ExValue* value)
 	}
 }
 
+bool ExNegate::compile(ExProgram* p)
+{
+	bool ok;
+	if (mChildren == NULL) {
+		ExValue zero;
+		zero.setInt(0);
+		ok = p->addConstant(&zero);
+	}
+	else
+	  ok = (mChildren->compile(p) && p->add(EX_OP_NEGATE, 0));
+	return ok;
+}
+
 /****************************************************************************
  *                                                                          *
  *   						 RELATIONAL OPERATORS                           *
@@ -1327,6 +1562,11 @@ void ExEqual::eval(ExContext* context, ExValue* value)
 	value->setBool(v1.compare(&v2) == 0);
 }
 
+bool ExEqual::compile(ExProgram* p)
+{
+	return (compileOperands(p, 2) && p->add(EX_OP_EQUAL, 0));
+}
+
 const char* ExNotEqual::getOperator()
 {
 	return "!=";
@@ -1344,6 +1584,11 @@ void ExNotEqual::eval(ExContext* context, ExValue* value)
 	value->setBool(v1.compare(&v2) != 0);
 }
 
+bool ExNotEqual::compile(ExProgram* p)
+{
+	return (compileOperands(p, 2) && p->add(EX_OP_NOT_EQUAL, 0));
+}
+
 const char* ExGreater::getOperator()
 {
 	return ">";
@@ -1369,6 +1614,11 @@ void ExGreater::eval(ExContext* context, ExValue* value)
 	value->setBool(v1.compare(&v2) > 0);
 }
 
+bool ExGreater::compile(ExProgram* p)
+{
+	return (compileOperands(p, 2) && p->add(EX_OP_GREATER, 0));
+}
+
 const char* ExLess::getOperator()
 {
 	return "<";
@@ -1388,6 +1638,11 @@ void ExLess::eval(ExContext* context, ExValue* value)
 	value->setBool(v1.compare(&v2) < 0);
 }
 
+bool ExLess::compile(ExProgram* p)
+{
+	return (compileOperands(p, 2) && p->add(EX_OP_LESS, 0));
+}
+
 const char* ExGreaterEqual::getOperator()
 {
 	return ">=";
@@ -1407,6 +1662,11 @@ void ExGreaterEqual::eval(ExContext* context, ExValue* value)
 	value->setBool(v1.compare(&v2) >= 0);
 }
 
+bool ExGreaterEqual::compile(ExProgram* p)
+{
+	return (compileOperands(p, 2) && p->add(EX_OP_GREATER_EQUAL, 0));
+}
+
 const char* ExLessEqual::getOperator()
 {
 	return "<=";
@@ -1426,6 +1686,11 @@ void ExLessEqual::eval(ExContext* context, ExValue* value)
 	value->setBool(v1.compare(&v2) <= 0);
 }
 
+bool ExLessEqual::compile(ExProgram* p)
+{
+	return (compileOperands(p, 2) && p->add(EX_OP_LESS_EQUAL, 0));
+}
+
 /****************************************************************************
  *                                                                          *
  *   						 ARITHMETIC OPERATORS                           *
@@ -1472,6 +1737,11 @@ void ExAdd::eval(ExContext* context, ExValue* value)
 	  value->setInt(ival);
 }
 
+bool ExAdd::compile(ExProgram* p)
+{
+	return (compileChildren(p) && p->add(EX_OP_ADD, countChildren()));
+}
+
 const char* ExSubtract::getOperator()
 {
 	return "-";
@@ -1515,6 +1785,11 @@ void ExSubtract::eval(ExContext* context, ExValue* value)
 	  value->setInt(ival);
 }
 
+bool ExSubtract::compile(ExProgram* p)
+{
+	return (compileChildren(p) && p->add(EX_OP_SUBTRACT, countChildren()));
+}
+
 const char* ExMultiply::getOperator()
 {
 	return "*";
@@ -1548,6 +1823,11 @@ void ExMultiply::eval(ExContext* context, ExValue* value)
 	  value->setInt(ival);
 }
 
+bool ExMultiply::compile(ExProgram* p)
+{
+	return (compileChildren(p) && p->add(EX_OP_MULTIPLY, countChildren()));
+}
+
 const char* ExDivide::getOperator()
 {
 	return "/";
@@ -1601,6 +1881,11 @@ void ExDivide::eval(ExContext* context, ExValue* value)
 	  value->setInt(ival);
 }
 
+bool ExDivide::compile(ExProgram* p)
+{
+	return (compileChildren(p) && p->add(EX_OP_DIVIDE, countChildren()));
+}
+
 const char* ExModulo::getOperator()
 {
 	return "%";
@@ -1624,6 +1909,11 @@ void ExModulo::eval(ExContext* context, ExValue* value)
 	  value->setInt(ival1 % ival2);
 }
 
+bool ExModulo::compile(ExProgram* p)
+{
+	return (compileOperands(p, 2) && p->add(EX_OP_MODULO, 0));
+}
+
 /****************************************************************************
  *                                                                          *
  *   						  LOGICAL OPERATORS                             *
@@ -1656,6 +1946,33 @@ void ExAnd::eval(ExContext* context, ExValue* value)
 	value->setBool(result);
 }
 
+/**
+ * Each child is followed by a test that leaves the result and
+ * jumps to the end if it can stop early.  The tests are chained
+ * through their arguments until we know where the end is.
+ */
+bool ExAnd::compile(ExProgram* p)
+{
+	bool ok = true;
+	int chain = -1;
+
+	for (ExNode* c = mChildren ; c != NULL && ok ; c = c->getNext()) {
+		ok = c->compile(p);
+		if (ok) {
+			int test = p->getLocation();
+			ok = p->add(EX_OP_AND, chain);
+			chain = test;
+		}
+	}
+
+	if (ok) {
+		ok = p->add(EX_OP_TRUE, 0);
+		p->setTargets(chain);
+	}
+
+	return ok;
+}
+
 const char* ExOr::getOperator()
 {
 	return "||";
@@ -1681,6 +1998,33 @@ void ExOr::eval(ExContext* context, ExValue* value)
 	value->setBool(result);
 }
 
+/**
+ * Each child is followed by a test that leaves the result and
+ * jumps to the end if it can stop early.  The tests are chained
+ * through their arguments until we know where the end is.
+ */
+bool ExOr::compile(ExProgram* p)
+{
+	bool ok = true;
+	int chain = -1;
+
+	for (ExNode* c = mChildren ; c != NULL && ok ; c = c->getNext()) {
+		ok = c->compile(p);
+		if (ok) {
+			int test = p->getLocation();
+			ok = p->add(EX_OP_OR, chain);
+			chain = test;
+		}
+	}
+
+	if (ok) {
+		ok = p->add(EX_OP_FALSE, 0);
+		p->setTargets(chain);
+	}
+
+	return ok;
+}
+
 /****************************************************************************
  *                                                                          *
  *   								BLOCKS                                  *
@@ -1745,6 +2089,22 @@ void ExBlock::eval(ExContext* context, ExValue* value)
 	  c->eval(context, value);
 }
 
+/**
+ * The leading values are popped.  Empty blocks leave the value
+ * alone which we can't do on a stack, leave those as trees.
+ */
+bool ExBlock::compile(ExProgram* p)
+{
+	bool ok = (mChildren != NULL);
+	for (ExNode* c = mChildren ; c != NULL && ok ; c = c->getNext()) {
+		if (c != mChildren)
+		  ok = p->add(EX_OP_POP, 0);
+		if (ok)
+		  ok = c->compile(p);
+	}
+	return ok;
+}
+
 /**
  * Shouldn't see any of these yet.
  */
@@ -1806,6 +2166,14 @@ void ExFunction::toString(Vbuf* b)
 	b->add(")");
 }
 
+/**
+ * Functions compile only if they say so.
+ */
+bool ExFunction::compile(ExProgram* p)
+{
+	return false;
+}
+
 //
 // ExList
 //
@@ -1843,6 +2211,11 @@ void ExList::eval(ExContext* context, ExValue* value)
     }
 }
 
+bool ExList::compile(ExProgram* p)
+{
+	return (compileChildren(p) && p->add(EX_OP_LIST, countChildren()));
+}
+
 //
 // ExArray
 //
@@ -1877,6 +2250,11 @@ void ExArray::eval(ExContext* context, ExValue* value)
     }
 }
 
+bool ExArray::compile(ExProgram* p)
+{
+	return (compileChildren(p) && p->add(EX_OP_LIST, countChildren()));
+}
+
 //
 // ExIndex
 //
@@ -1977,6 +2355,15 @@ void ExIndex::eval(ExContext* context, ExValue* value)
     }
 }
 
+/**
+ * The indexes aren't reliably set by the parser, leave these
+ * as trees.
+ */
+bool ExIndex::compile(ExProgram* p)
+{
+	return false;
+}
+
 /****************************************************************************
  *                                                                          *
  *   							  FUNCTIONS                                 *
@@ -1999,6 +2386,11 @@ void ExInt::eval(ExContext* context, ExValue* value)
 	value->setInt(v.getInt());
 }
 
+bool ExInt::compile(ExProgram* p)
+{
+	return (compileOperands(p, 1) && p->add(EX_OP_INT, 0));
+}
+
 //
 // float(value)
 //
@@ -2015,6 +2407,11 @@ void ExFloat::eval(ExContext* context, ExValue* value)
 	value->setFloat(v.getFloat());
 }
 
+bool ExFloat::compile(ExProgram* p)
+{
+	return (compileOperands(p, 1) && p->add(EX_OP_FLOAT, 0));
+}
+
 //
 // string(value)
 //
@@ -2031,6 +2428,11 @@ void ExString::eval(ExContext* context, ExValue* value)
 	value->setString(v.getString());
 }
 
+bool ExString::compile(ExProgram* p)
+{
+	return (compileOperands(p, 1) && p->add(EX_OP_STRING, 0));
+}
+
 //
 // abs(value)
 //
@@ -2049,6 +2451,11 @@ void ExAbs::eval(ExContext* context, ExValue* value)
 	value->setInt(ival);
 }
 
+bool ExAbs::compile(ExProgram* p)
+{
+	return (compileOperands(p, 1) && p->add(EX_OP_ABS, 0));
+}
+
 //
 // rand(low,high)
 //
@@ -2078,6 +2485,11 @@ void ExRand::eval(ExContext* context, ExValue* value)
 	value->setInt(rvalue);
 }
 
+bool ExRand::compile(ExProgram* p)
+{
+	return (compileOperands(p, 2) && p->add(EX_OP_RAND, 0));
+}
+
 //
 // scale(value,low,high,newLow,newHigh
 //
@@ -2124,6 +2536,504 @@ void ExCustom::eval(ExContext* context, ExValue* value)
 	value->setNull();
 }
 
+/****************************************************************************
+ *                                                                          *
+ *   							   PROGRAM                                  *
+ *                                                                          *
+ ****************************************************************************/
+
+bool ExProgram::Compiled = true;
+
+/**
+ * Names for toString, in ExOpcode order.
+ */
+PRIVATE const char* ExOpcodeNames[] = {
+	"null", "true", "false", "const", "symbol", "pop", "not", "negate",
+	"==", "!=", ">", "<", ">=", "<=", "+", "-", "*", "/", "%",
+	"and", "or", "list", "int", "float", "string", "abs", "rand"
+};
+
+PRIVATE int CountNodes(ExNode* node)
+{
+	int count = 0;
+	for (ExNode* n = node ; n != NULL ; n = n->getNext())
+	  count += 1 + CountNodes(n->getChildren());
+	return count;
+}
+
+ExProgram::ExProgram(ExNode* tree)
+{
+	mTree = tree;
+	mCompiled = false;
+	mInstructions = NULL;
+	mLength = 0;
+	mMaxLength = 0;
+	mConstants = NULL;
+	mConstantCount = 0;
+	mSymbols = NULL;
+	mSymbolCount = 0;
+	mDepth = 0;
+	mMaxDepth = 0;
+
+	if (mTree != NULL)
+	  compile();
+}
+
+ExProgram::~ExProgram()
+{
+	delete mTree;
+	delete mInstructions;
+	delete[] mConstants;
+	delete mSymbols;
+}
+
+ExNode* ExProgram::getTree()
+{
+	return mTree;
+}
+
+bool ExProgram::isCompiled()
+{
+	return mCompiled;
+}
+
+/**
+ * No node emits more than three instructions, one constant or
+ * one symbol so we can size everything up front.
+ */
+PRIVATE void ExProgram::compile()
+{
+	int nodes = CountNodes(mTree);
+
+	mMaxLength = (nodes * 3) + 1;
+	mInstructions = new ExInstruction[mMaxLength];
+	mConstants = new ExValue[nodes];
+	mSymbols = new ExSymbol*[nodes];
+
+	mCompiled = (mTree->compile(this) && mDepth == 1);
+
+	if (!mCompiled) {
+		delete mInstructions;
+		delete[] mConstants;
+		delete mSymbols;
+		mInstructions = NULL;
+		mConstants = NULL;
+		mSymbols = NULL;
+		mLength = 0;
+		mConstantCount = 0;
+		mSymbolCount = 0;
+	}
+}
+
+/**
+ * Add an instruction, keeping track of the stack depth.
+ * Returns false if the program is too large to run.
+ */
+bool ExProgram::add(ExOpcode op, int arg)
+{
+	bool ok = (mLength < mMaxLength && arg < 32768);
+
+	if (ok) {
+		ExInstruction* i = &mInstructions[mLength++];
+		i->op = (short)op;
+		i->arg = (short)arg;
+
+		switch (op) {
+			case EX_OP_NULL:
+			case EX_OP_TRUE:
+			case EX_OP_FALSE:
+			case EX_OP_CONST:
+			case EX_OP_SYMBOL:
+				mDepth++;
+				break;
+			case EX_OP_POP:
+			case EX_OP_EQUAL:
+			case EX_OP_NOT_EQUAL:
+			case EX_OP_GREATER:
+			case EX_OP_LESS:
+			case EX_OP_GREATER_EQUAL:
+			case EX_OP_LESS_EQUAL:
+			case EX_OP_MODULO:
+			case EX_OP_RAND:
+			case EX_OP_AND:
+			case EX_OP_OR:
+				// the tests only leave a value when they jump
+				mDepth--;
+				break;
+			case EX_OP_ADD:
+			case EX_OP_SUBTRACT:
+			case EX_OP_MULTIPLY:
+			case EX_OP_DIVIDE:
+			case EX_OP_LIST:
+				mDepth += 1 - arg;
+				break;
+			default:
+				break;
+		}
+
+		if (mDepth > mMaxDepth)
+		  mMaxDepth = mDepth;
+
+		ok = (mDepth >= 0 && mMaxDepth <= EX_PROGRAM_STACK);
+	}
+
+	return ok;
+}
+
+bool ExProgram::addConstant(ExValue* value)
+{
+	bool ok = add(EX_OP_CONST, mConstantCount);
+	if (ok)
+	  mConstants[mConstantCount++].set(value);
+	return ok;
+}
+
+bool ExProgram::addSymbol(ExSymbol* symbol)
+{
+	bool ok = add(EX_OP_SYMBOL, mSymbolCount);
+	if (ok)
+	  mSymbols[mSymbolCount++] = symbol;
+	return ok;
+}
+
+int ExProgram::getLocation()
+{
+	return mLength;
+}
+
+/**
+ * Point a chain of jumps at the next instruction.  Each jump
+ * has the location of the previous one in its argument.
+ */
+void ExProgram::setTargets(int chain)
+{
+	while (chain >= 0) {
+		ExInstruction* i = &mInstructions[chain];
+		chain = i->arg;
+		i->arg = (short)mLength;
+	}
+}
+
+void ExProgram::eval(ExContext* context, ExValue* value)
+{
+	if (mCompiled && Compiled)
+	  run(context, value);
+	else if (mTree != NULL)
+	  mTree->eval(context, value);
+	else
+	  value->setNull();
+}
+
+int ExProgram::evalToInt(ExContext* context)
+{
+	ExValue v;
+	eval(context, &v);
+	return v.getInt();
+}
+
+bool ExProgram::evalToBool(ExContext* context)
+{
+	ExValue v;
+	eval(context, &v);
+	return v.getBool();
+}
+
+void ExProgram::evalToString(ExContext* context, char* buffer, int max)
+{
+	ExValue v;
+	eval(context, &v);
+	CopyString(v.getString(), buffer, max);
+}
+
+/**
+ * The returned list is owned by the caller and must be freed.
+ */
+ExValueList* ExProgram::evalToList(ExContext* context)
+{
+	ExValue v;
+	eval(context, &v);
+    return v.takeList();
+}
+
+/**
+ * Move a value off the stack.  A list the stack value owns goes
+ * with it, others stay references like they would have been if the
+ * node had been evaluated directly into the destination.
+ */
+PRIVATE void MoveValue(ExValue* src, ExValue* dest)
+{
+	bool owned = false;
+	if (src->getType() == EX_LIST)
+	  owned = (src->getList()->getOwner() == src);
+	dest->set(src, owned);
+}
+
+/**
+ * The arithmetic operators, see ExAdd and friends.
+ */
+PRIVATE void Arithmetic(int op, ExValue* args, int count, ExValue* result)
+{
+	int ival = (op == EX_OP_MULTIPLY) ? 1 : 0;
+	float fval = (op == EX_OP_MULTIPLY) ? 1.0f : 0.0f;
+	bool floating = false;
+
+	for (int i = 0 ; i < count ; i++) {
+		ExValue* v = &args[i];
+		if (!floating && v->getType() == EX_FLOAT) {
+			fval = (float)ival;
+			floating = true;
+		}
+		if (floating) {
+			float fv = v->getFloat();
+			switch (op) {
+				case EX_OP_ADD: fval += fv; break;
+				case EX_OP_SUBTRACT: fval = (i == 0) ? fv : fval - fv; break;
+				case EX_OP_MULTIPLY: fval *= fv; break;
+				case EX_OP_DIVIDE: 
+					if (i == 0)
+					  fval = fv;
+					else if (fv == 0.0)
+					  fval = 0.0;
+					else
+					  fval /= fv;
+					break;
+			}
+		}
+		else {
+			int iv = v->getInt();
+			switch (op) {
+				case EX_OP_ADD: ival += iv; break;
+				case EX_OP_SUBTRACT: ival = (i == 0) ? iv : ival - iv; break;
+				case EX_OP_MULTIPLY: ival *= iv; break;
+				case EX_OP_DIVIDE: 
+					if (i == 0)
+					  ival = iv;
+					else if (iv == 0)
+					  ival = 0;
+					else
+					  ival /= iv;
+					break;
+			}
+		}
+	}
+
+	if (floating)
+	  result->setFloat(fval);
+	else
+	  result->setInt(ival);
+}
+
+/**
+ * Run the program.  The compiler made sure the stack is deep
+ * enough and that we finish with one value on it.
+ */
+PRIVATE void ExProgram::run(ExContext* context, ExValue* value)
+{
+	// only construct as many values as the program uses
+	double storage[(EX_PROGRAM_STACK * sizeof(ExValue)) / sizeof(double) + 1];
+	ExValue* stack = (ExValue*)storage;
+	int sp = 0;
+	int pc = 0;
+
+	for (int i = 0 ; i < mMaxDepth ; i++)
+	  new (&stack[i]) ExValue();
+
+	while (pc < mLength) {
+		ExInstruction* i = &mInstructions[pc++];
+		switch (i->op) {
+
+			case EX_OP_NULL:
+				stack[sp++].setNull();
+				break;
+
+			case EX_OP_TRUE:
+				stack[sp++].setBool(true);
+				break;
+
+			case EX_OP_FALSE:
+				stack[sp++].setBool(false);
+				break;
+
+			case EX_OP_CONST:
+				stack[sp++].set(&mConstants[i->arg]);
+				break;
+
+			case EX_OP_SYMBOL:
+				mSymbols[i->arg]->eval(context, &stack[sp++]);
+				break;
+
+			case EX_OP_POP:
+				sp--;
+				break;
+
+			case EX_OP_NOT: {
+				ExValue* v = &stack[sp - 1];
+				v->setBool(!v->getBool());
+			}
+			break;
+
+			case EX_OP_NEGATE: {
+				ExValue* v = &stack[sp - 1];
+				v->setInt(-v->getInt());
+			}
+			break;
+
+			case EX_OP_EQUAL: {
+				ExValue* v1 = &stack[--sp - 1];
+				v1->setBool(v1->compare(&stack[sp]) == 0);
+			}
+			break;
+
+			case EX_OP_NOT_EQUAL: {
+				ExValue* v1 = &stack[--sp - 1];
+				v1->setBool(v1->compare(&stack[sp]) != 0);
+			}
+			break;
+
+			case EX_OP_GREATER:
+			case EX_OP_LESS:
+			case EX_OP_GREATER_EQUAL:
+			case EX_OP_LESS_EQUAL: {
+				ExValue* v1 = &stack[--sp - 1];
+				ExValue* v2 = &stack[sp];
+				// like the nodes, always numeric
+				v1->coerce(EX_INT);
+				v2->coerce(EX_INT);
+				int cmp = v1->compare(v2);
+				if (i->op == EX_OP_GREATER)
+				  v1->setBool(cmp > 0);
+				else if (i->op == EX_OP_LESS)
+				  v1->setBool(cmp < 0);
+				else if (i->op == EX_OP_GREATER_EQUAL)
+				  v1->setBool(cmp >= 0);
+				else
+				  v1->setBool(cmp <= 0);
+			}
+			break;
+
+			case EX_OP_ADD:
+			case EX_OP_SUBTRACT:
+			case EX_OP_MULTIPLY:
+			case EX_OP_DIVIDE:
+				sp -= i->arg;
+				Arithmetic(i->op, &stack[sp], i->arg, &stack[sp]);
+				sp++;
+				break;
+
+			case EX_OP_MODULO: {
+				ExValue* v1 = &stack[--sp - 1];
+				int ival1 = v1->getInt();
+				int ival2 = stack[sp].getInt();
+				v1->setInt((ival2 == 0) ? 0 : ival1 % ival2);
+			}
+			break;
+
+			case EX_OP_AND:
+				if (!stack[--sp].getBool()) {
+					stack[sp++].setBool(false);
+					pc = i->arg;
+				}
+				break;
+
+			case EX_OP_OR:
+				if (stack[--sp].getBool()) {
+					stack[sp++].setBool(true);
+					pc = i->arg;
+				}
+				break;
+
+			case EX_OP_LIST: {
+				ExValueList* list = NULL;
+				sp -= i->arg;
+				if (i->arg > 0) {
+					list = new ExValueList();
+					for (int j = 0 ; j < i->arg ; j++) {
+						ExValue* el = new ExValue();
+						MoveValue(&stack[sp + j], el);
+						list->add(el);
+					}
+				}
+				ExValue* v = &stack[sp++];
+				v->setNull();
+				if (list != NULL)
+				  v->setOwnedList(list);
+			}
+			break;
+
+			case EX_OP_INT: {
+				ExValue* v = &stack[sp - 1];
+				v->setInt(v->getInt());
+			}
+			break;
+
+			case EX_OP_FLOAT: {
+				ExValue* v = &stack[sp - 1];
+				v->setFloat(v->getFloat());
+			}
+			break;
+
+			case EX_OP_STRING: {
+				ExValue* v = &stack[sp - 1];
+				v->setString(v->getString());
+			}
+			break;
+
+			case EX_OP_ABS: {
+				ExValue* v = &stack[sp - 1];
+				int ival = v->getInt();
+				if (ival < 0) ival = -ival;
+				v->setInt(ival);
+			}
+			break;
+
+			case EX_OP_RAND: {
+				ExValue* v1 = &stack[--sp - 1];
+				int low = v1->getInt();
+				int high = stack[sp].getInt();
+				v1->setInt((low >= high) ? low : Random(low, high));
+			}
+			break;
+		}
+	}
+
+	MoveValue(&stack[0], value);
+
+	for (int i = 0 ; i < mMaxDepth ; i++)
+	  stack[i].~ExValue();
+}
+
+void ExProgram::toString(Vbuf* b)
+{
+	if (!mCompiled)
+	  b->add("tree");
+	else {
+		for (int i = 0 ; i < mLength ; i++) {
+			ExInstruction* ins = &mInstructions[i];
+			if (i > 0)
+			  b->add(" ");
+			b->add(ExOpcodeNames[ins->op]);
+			if (ins->op == EX_OP_CONST) {
+				b->add("(");
+				mConstants[ins->arg].toString(b);
+				b->add(")");
+			}
+			else if (ins->op == EX_OP_SYMBOL) {
+				b->add("(");
+				b->add(mSymbols[ins->arg]->getName());
+				b->add(")");
+			}
+			else if ((ins->op >= EX_OP_ADD && ins->op <= EX_OP_DIVIDE) ||
+					 ins->op == EX_OP_AND || ins->op == EX_OP_OR ||
+					 ins->op == EX_OP_LIST) {
+				// operand count or jump
+				b->add("(");
+				b->add(ins->arg);
+				b->add(")");
+			}
+		}
+	}
+}
+
 /****************************************************************************
  *                                                                          *
  *   							   PARSING                                  *
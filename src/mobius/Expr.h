@@ -34,6 +34,45 @@
  */
 #define EX_MAX_STRING 128
 
+/**
+ * String literals longer than this are interned in ExStrings when
+ * they are parsed so evaluating them is a pointer copy.  Shorter
+ * ones, and every string made while evaluating, are copied.
+ */
+#define EX_INTERN_STRING 24
+
+/**
+ * A table of interned strings.  Strings are added with a CAS so any
+ * thread may add them without locking, though searching a full
+ * table is slow.  The table and the arena the strings are copied into
+ * have a fixed size and nothing is ever removed, once either fills
+ * intern returns NULL.  Only add strings there are a bounded number of.
+ *
+ * A string never moves once it is in the table, so its position is
+ * also a small unique number for the string.
+ */
+class ExStringTable {
+
+  public:
+
+	ExStringTable(int slots, int arena);
+	~ExStringTable();
+
+	const char* intern(const char* src);
+	int getSlot(const char* src);
+	int getSlots();
+
+  private:
+
+	int find(const char* src);
+
+	char* volatile* mStrings;
+	int mSlots;
+	char* mArena;
+	int mArenaSize;
+	volatile int mArenaUsed;
+};
+
 /**
  * An enumeration of the types of values we may hold in an ExValue.
  */
@@ -50,7 +89,8 @@ typedef enum {
 /**
  * Expressions generate values.
  * String values have an upper bound so we don't have to deal with
- * dynamic allocation during evaluation.
+ * dynamic allocation during evaluation.  A long literal may point
+ * into ExStrings instead, see intern.
  */
 class ExValue {
 
@@ -82,15 +122,13 @@ class ExValue {
 	void getString(char *buffer, int max);
 	void setString(const char* src);
     void addString(const char* src);
+	void intern();
 
 	class ExValueList* getList();
 	class ExValueList* takeList();
 	void setList(class ExValueList* l);
 	void setOwnedList(class ExValueList* l);
 
-	char* getBuffer();
-	int getBufferMax();
-
 	int compare(ExValue* other);
     void set(ExValue* src, bool owned);
 	void set(ExValue* other);
@@ -104,6 +142,8 @@ class ExValue {
     void releaseList();
 	void copyList(class ExValueList* src, class ExValueList* dest);
 	ExValue* getList(int index);
+	void storeString(const char* src);
+	const char* getChars();
 
 	int compareInt(ExValue *other);
 	int compareFloat(ExValue *other);
@@ -111,13 +151,22 @@ class ExValue {
 	int compareString(ExValue *other);
 
 	ExType mType;
-	int mInt;
-	float mFloat;
-	bool mBool;
-	char mString[EX_MAX_STRING + 4];
+	union {
+		int mInt;
+		float mFloat;
+		bool mBool;
+	};
+	// set by intern, mString is not used
+	const char* mInterned;
+	char mString[EX_MAX_STRING];
 	class ExValueList* mList;
 };
 
+/**
+ * The long string literals.
+ */
+extern ExStringTable ExStrings;
+
 //////////////////////////////////////////////////////////////////////
 //
 // ExValueList
@@ -284,9 +333,14 @@ class ExNode {
 	void evalToString(ExContext* context, char* buffer, int max);
     ExValueList* evalToList(ExContext * con);
 
+	// bytecode, false if the node can't be compiled
+	virtual bool compile(class ExProgram* p);
+
   protected:
 	
     ExNode* getLastChild(ExNode* first);
+	bool compileOperands(class ExProgram* p, int count);
+	bool compileChildren(class ExProgram* p);
 
 	void eval1(ExContext* context, ExValue* v1);
 	void eval2(ExContext* context, ExValue* v1, ExValue* v2);
@@ -314,6 +368,7 @@ class ExLiteral : public ExNode {
 
 	void toString(class Vbuf* b);
 	void eval(ExContext* context, ExValue *value);
+	bool compile(class ExProgram* p);
 
   private:
 
@@ -337,6 +392,7 @@ class ExSymbol : public ExNode {
 	bool isSymbol();
 	void toString(class Vbuf* b);
 	void eval(ExContext* context, ExValue *value);
+	bool compile(class ExProgram* p);
 
   private:
 
@@ -373,6 +429,7 @@ class ExNot : public ExOperator {
 	int getDesiredOperands();
 	int getPrecedence();
 	void eval(ExContext* context, ExValue* value);
+	bool compile(class ExProgram* p);
 };
 
 class ExEqual : public ExOperator {
@@ -380,6 +437,7 @@ class ExEqual : public ExOperator {
 	const char* getOperator();
 	int getPrecedence();
 	void eval(ExContext* context, ExValue* value);
+	bool compile(class ExProgram* p);
 };
 
 class ExNotEqual : public ExOperator {
@@ -387,6 +445,7 @@ class ExNotEqual : public ExOperator {
 	const char* getOperator();
 	int getPrecedence();
 	void eval(ExContext* context, ExValue* value);
+	bool compile(class ExProgram* p);
 };
 
 class ExGreater : public ExOperator {
@@ -394,6 +453,7 @@ class ExGreater : public ExOperator {
 	const char* getOperator();
 	int getPrecedence();
 	void eval(ExContext* context, ExValue* value);
+	bool compile(class ExProgram* p);
 };
 
 class ExLess : public ExOperator {
@@ -401,6 +461,7 @@ class ExLess : public ExOperator {
 	const char* getOperator();
 	int getPrecedence();
 	void eval(ExContext* context, ExValue* value);
+	bool compile(class ExProgram* p);
 };
 
 class ExGreaterEqual : public ExOperator {
@@ -408,6 +469,7 @@ class ExGreaterEqual : public ExOperator {
 	const char* getOperator();
 	int getPrecedence();
 	void eval(ExContext* context, ExValue* value);
+	bool compile(class ExProgram* p);
 };
 
 class ExLessEqual : public ExOperator {
@@ -415,6 +477,7 @@ class ExLessEqual : public ExOperator {
 	const char* getOperator();
 	int getPrecedence();
 	void eval(ExContext* context, ExValue* value);
+	bool compile(class ExProgram* p);
 };
 
 /****************************************************************************
@@ -428,6 +491,7 @@ class ExAdd : public ExOperator {
 	const char* getOperator();
 	int getPrecedence();
 	void eval(ExContext* context, ExValue* value);
+	bool compile(class ExProgram* p);
 };
 
 class ExSubtract : public ExOperator {
@@ -435,6 +499,7 @@ class ExSubtract : public ExOperator {
 	const char* getOperator();
 	int getPrecedence();
 	void eval(ExContext* context, ExValue* value);
+	bool compile(class ExProgram* p);
 };
 
 class ExNegate : public ExOperator {
@@ -443,6 +508,7 @@ class ExNegate : public ExOperator {
 	int getDesiredOperands();
 	int getPrecedence();
 	void eval(ExContext* context, ExValue* value);
+	bool compile(class ExProgram* p);
 };
 
 class ExMultiply : public ExOperator {
@@ -450,6 +516,7 @@ class ExMultiply : public ExOperator {
 	const char* getOperator();
 	int getPrecedence();
 	void eval(ExContext* context, ExValue* value);
+	bool compile(class ExProgram* p);
 };
 
 class ExDivide : public ExOperator {
@@ -457,6 +524,7 @@ class ExDivide : public ExOperator {
 	const char* getOperator();
 	int getPrecedence();
 	void eval(ExContext* context, ExValue* value);
+	bool compile(class ExProgram* p);
 };
 
 class ExModulo : public ExOperator {
@@ -464,6 +532,7 @@ class ExModulo : public ExOperator {
 	const char* getOperator();
 	int getPrecedence();
 	void eval(ExContext* context, ExValue* value);
+	bool compile(class ExProgram* p);
 };
 
 /****************************************************************************
@@ -477,6 +546,7 @@ class ExAnd : public ExOperator {
 	const char* getOperator();
 	int getPrecedence();
 	void eval(ExContext* context, ExValue* value);
+	bool compile(class ExProgram* p);
 };
 
 class ExOr : public ExOperator {
@@ -484,6 +554,7 @@ class ExOr : public ExOperator {
 	const char* getOperator();
 	int getPrecedence();
 	void eval(ExContext* context, ExValue* value);
+	bool compile(class ExProgram* p);
 };
 
 /****************************************************************************
@@ -515,6 +586,7 @@ class ExBlock : public ExNode {
 
     virtual void toString(class Vbuf* b);
 	virtual void eval(ExContext* context, ExValue *value);
+	virtual bool compile(class ExProgram* p);
 };
 
 class ExParenthesis : public ExBlock {
@@ -533,6 +605,7 @@ class ExFunction : public ExBlock {
 	virtual const char* getFunction() = 0;
 	bool isFunction();
 	void toString(class Vbuf* b);
+	virtual bool compile(class ExProgram* p);
 };
 
 class ExList : public ExBlock {
@@ -542,6 +615,7 @@ class ExList : public ExBlock {
     bool isList();
 	void toString(class Vbuf* b);
     void eval(ExContext* context, ExValue* value);
+    bool compile(class ExProgram* p);
 };
 
 /**
@@ -556,6 +630,7 @@ class ExArray : public ExBlock {
     bool isArray();
 	void toString(class Vbuf* b);
     void eval(ExContext* context, ExValue* value);
+    bool compile(class ExProgram* p);
 };
 
 class ExIndex : public ExBlock {
@@ -565,6 +640,7 @@ class ExIndex : public ExBlock {
     bool isIndex();
 	void toString(class Vbuf* b);
     void eval(ExContext* context, ExValue* value);
+    bool compile(class ExProgram* p);
 
 	ExNode* getIndexes();
 	void setIndexes(ExNode* n);
@@ -588,6 +664,7 @@ class ExInt : public ExFunction {
   public:
 	const char* getFunction();
 	void eval(ExContext* context, ExValue* value);
+	bool compile(class ExProgram* p);
 };
 
 /**
@@ -597,6 +674,7 @@ class ExFloat : public ExFunction {
   public:
 	const char* getFunction();
 	void eval(ExContext* context, ExValue* value);
+	bool compile(class ExProgram* p);
 };
 
 /**
@@ -606,6 +684,7 @@ class ExString : public ExFunction {
   public:
 	const char* getFunction();
 	void eval(ExContext* context, ExValue* value);
+	bool compile(class ExProgram* p);
 };
 
 /**
@@ -616,6 +695,7 @@ class ExRand : public ExFunction {
   public:
 	const char* getFunction();
 	void eval(ExContext* context, ExValue* value);
+	bool compile(class ExProgram* p);
 };
 
 /**
@@ -626,6 +706,7 @@ class ExAbs : public ExFunction {
   public:
 	const char* getFunction();
 	void eval(ExContext* context, ExValue* value);
+	bool compile(class ExProgram* p);
 };
 
 /**
@@ -661,6 +742,124 @@ class ExFoo : public ExFunction {
 	void eval(ExContext* context, ExValue* value);
 };
 
+/****************************************************************************
+ *                                                                          *
+ *   								PROGRAM                                 *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * Instructions for the expression stack machine.
+ * The arithmetic operators and list constructors take the number
+ * of operands from the instruction argument, like the nodes they
+ * are n-ary.
+ */
+typedef enum {
+
+	EX_OP_NULL,
+	EX_OP_TRUE,
+	EX_OP_FALSE,
+	EX_OP_CONST,
+	EX_OP_SYMBOL,
+	EX_OP_POP,
+	EX_OP_NOT,
+	EX_OP_NEGATE,
+	EX_OP_EQUAL,
+	EX_OP_NOT_EQUAL,
+	EX_OP_GREATER,
+	EX_OP_LESS,
+	EX_OP_GREATER_EQUAL,
+	EX_OP_LESS_EQUAL,
+	EX_OP_ADD,
+	EX_OP_SUBTRACT,
+	EX_OP_MULTIPLY,
+	EX_OP_DIVIDE,
+	EX_OP_MODULO,
+	EX_OP_AND,
+	EX_OP_OR,
+	EX_OP_LIST,
+	EX_OP_INT,
+	EX_OP_FLOAT,
+	EX_OP_STRING,
+	EX_OP_ABS,
+	EX_OP_RAND
+
+} ExOpcode;
+
+typedef struct {
+
+	short op;
+	short arg;
+
+} ExInstruction;
+
+/**
+ * The deepest value stack a program may use.  The stack lives
+ * on the C stack while the program runs, expressions that
+ * need more are left as node trees.
+ */
+#define EX_PROGRAM_STACK 16
+
+/**
+ * A parsed expression compiled to a postfix instruction list run on
+ * a small value stack.  Symbols are still resolved through the
+ * ExSymbol nodes so the program owns the tree it was compiled from.
+ * If any node in the tree can't be compiled the program evaluates
+ * the tree instead, results are the same either way.
+ */
+class ExProgram {
+
+  public:
+
+	/**
+	 * When false programs evaluate their node trees.
+	 * For testing the compiler.
+	 */
+	static bool Compiled;
+
+	ExProgram(ExNode* tree);
+	~ExProgram();
+
+	ExNode* getTree();
+	bool isCompiled();
+
+	void eval(ExContext* context, ExValue* value);
+	int evalToInt(ExContext* context);
+	bool evalToBool(ExContext* context);
+	void evalToString(ExContext* context, char* buffer, int max);
+	ExValueList* evalToList(ExContext* context);
+
+	void toString(class Vbuf* b);
+
+	// compiler interface for the nodes
+	bool add(ExOpcode op, int arg);
+	bool addConstant(ExValue* value);
+	bool addSymbol(ExSymbol* symbol);
+	int getLocation();
+	void setTargets(int chain);
+
+  private:
+
+	void compile();
+	void run(ExContext* context, ExValue* value);
+
+	ExNode* mTree;
+	bool mCompiled;
+
+	ExInstruction* mInstructions;
+	int mLength;
+	int mMaxLength;
+
+	ExValue* mConstants;
+	int mConstantCount;
+
+	ExSymbol** mSymbols;
+	int mSymbolCount;
+
+	int mDepth;
+	int mMaxDepth;
+};
+
 /****************************************************************************
  *                                                                          *
  *   								PARSER                                  *
@@ -22,6 +22,7 @@
 
 #include "List.h"
 #include "MessageCatalog.h"
+#include "SymbolTable.h"
 #include "Util.h"
 
 #include "Action.h"
@@ -1248,6 +1249,12 @@ PUBLIC Function* StaticFunctions[MAX_STATIC_FUNCTIONS];
 PUBLIC Function* HiddenFunctions[MAX_STATIC_FUNCTIONS];
 PRIVATE int FunctionIndex = 0;
 
+/**
+ * The names of the static and hidden functions for getStaticFunction.
+ * Rebuilt after localization since that changes the display names.
+ */
+PRIVATE SymbolTable* StaticFunctionTable = NULL;
+
 PRIVATE void add(Function** array, Function* func)
 {
 	if (FunctionIndex >= MAX_STATIC_FUNCTIONS - 1) {
@@ -1430,6 +1437,10 @@ PUBLIC void Function::initStaticFunctions()
         add(HiddenFunctions, Debug);
         add(HiddenFunctions, InitCoverage);
         add(HiddenFunctions, Surface);
+
+        StaticFunctionTable = new SymbolTable();
+        addSymbols(StaticFunctionTable, StaticFunctions);
+        addSymbols(StaticFunctionTable, HiddenFunctions);
     }
 }
 
@@ -1464,16 +1475,41 @@ PUBLIC bool Function::isMatch(const char* xname)
 			StringEqualNoCase(xname, getDisplayName()));
 }
 
+/**
+ * Add the names of the functions in an array to a symbol table.
+ * Every name isMatch would accept is added, when a name is shared
+ * the first function keeps it, which is what a search of the array
+ * would find.  Searching the table is then the same as getFunction.
+ */
+PUBLIC void Function::addSymbols(SymbolTable* table, Function** functions)
+{
+    if (functions != NULL) {
+        for (int i = 0 ; functions[i] != NULL ; i++) {
+            Function* f = functions[i];
+            table->intern(f->getName(), f);
+            table->intern(f->alias1, f);
+            table->intern(f->alias2, f);
+            table->intern(f->getDisplayName(), f);
+        }
+    }
+}
+
 /**
  * Search for one of the static functions.
+ * For script resolution, we allow access to the hidden functions,
+ * they're in the table after the static functions.
  */
 PUBLIC Function* Function::getStaticFunction(const char * name)
 {
-    Function* found = getFunction(StaticFunctions, name);
+    Function* found = NULL;
 
-    // for script resolution, we allow access to the hidden functions
-    if (found == NULL)
-      found = getFunction(HiddenFunctions, name);
+    if (StaticFunctionTable != NULL)
+      found = (Function*)StaticFunctionTable->get(name);
+    else {
+        found = getFunction(StaticFunctions, name);
+        if (found == NULL)
+          found = getFunction(HiddenFunctions, name);
+    }
 
     return found;
 }
@@ -1486,6 +1522,15 @@ PUBLIC void Function::localizeAll(MessageCatalog* cat)
 {
     for (int i = 0 ; StaticFunctions[i] != NULL ; i++)
       StaticFunctions[i]->localize(cat);
+
+    // the display names changed
+    SymbolTable* table = new SymbolTable();
+    addSymbols(table, StaticFunctions);
+    addSymbols(table, HiddenFunctions);
+
+    SymbolTable* old = StaticFunctionTable;
+    StaticFunctionTable = table;
+    delete old;
 }
 
 /****************************************************************************/
@@ -248,6 +248,7 @@ class Function : public SystemConstant {
 	static void localizeAll(class MessageCatalog* cat);
 
     static Function* getFunction(Function** functions, const char * name);
+    static void addSymbols(class SymbolTable* table, Function** functions);
 
   private:
 
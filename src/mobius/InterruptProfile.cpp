@@ -0,0 +1,307 @@
+/*
+ * Copyright (c) 2010 Jeffrey S. Larson  <jeff@circularlabs.com>
+ * All rights reserved.
+ * See the LICENSE file for the full copyright and license declaration.
+ *
+ * ---------------------------------------------------------------------
+ *
+ * Timing histograms for the phases of the audio interrupt.
+ * See InterruptProfile.h for the phases.
+ *
+ * Adding a sample is a handful of integer operations so this is left
+ * on all the time.  The clock calls are GetClockTicks which is the
+ * performance counter on Windows and mach_absolute_time on OSX, both
+ * are cheap enough to call several times per track per interrupt.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "Util.h"
+#include "Thread.h"
+#include "Trace.h"
+
+#include "InterruptProfile.h"
+
+/****************************************************************************
+ *                                                                          *
+ *                                 HISTOGRAM                                *
+ *                                                                          *
+ ****************************************************************************/
+
+PUBLIC ProfileHistogram::ProfileHistogram()
+{
+    reset();
+}
+
+PUBLIC ProfileHistogram::~ProfileHistogram()
+{
+}
+
+PUBLIC void ProfileHistogram::reset()
+{
+    count = 0;
+    misses = 0;
+    total = 0;
+    max = 0;
+    for (int i = 0 ; i < PROFILE_BUCKETS ; i++)
+      buckets[i] = 0;
+}
+
+/**
+ * Add a sample.  The bucket is the number of bits in the
+ * sample measured in 1/128ths of the budget.
+ */
+PUBLIC void ProfileHistogram::add(long long ticks, long long budget)
+{
+    int bucket = 0;
+    if (budget > 0) {
+        long long scaled = (ticks * 128) / budget;
+        while (scaled > 0 && bucket < PROFILE_BUCKETS - 1) {
+            scaled >>= 1;
+            bucket++;
+        }
+    }
+
+    buckets[bucket]++;
+    if (bucket >= PROFILE_MISS_BUCKET)
+      misses++;
+
+    total += ticks;
+    if (ticks > max)
+      max = ticks;
+
+    count++;
+}
+
+PUBLIC void ProfileHistogram::merge(ProfileHistogram* src)
+{
+    count += src->count;
+    misses += src->misses;
+    total += src->total;
+    if (src->max > max)
+      max = src->max;
+    for (int i = 0 ; i < PROFILE_BUCKETS ; i++)
+      buckets[i] += src->buckets[i];
+}
+
+/****************************************************************************
+ *                                                                          *
+ *                                  PROFILE                                 *
+ *                                                                          *
+ ****************************************************************************/
+
+PUBLIC InterruptProfile::InterruptProfile()
+{
+    resetInternal();
+    mResetPending = false;
+}
+
+PUBLIC InterruptProfile::~InterruptProfile()
+{
+}
+
+PRIVATE void InterruptProfile::resetInternal()
+{
+    int i;
+
+    for (i = 0 ; i < PROFILE_PHASES ; i++)
+      mPhases[i].reset();
+
+    for (i = 0 ; i < PROFILE_MAX_TRACKS ; i++) {
+        for (int j = 0 ; j < PROFILE_PHASES ; j++)
+          mTracks[i][j].reset();
+    }
+
+    mBudget = 0;
+    mStart = 0;
+    mLastStart = 0;
+    mInterrupts = 0;
+    mLateInterrupts = 0;
+}
+
+/**
+ * Request that the statistics be cleared.  This happens at the
+ * start of the next interrupt.
+ */
+PUBLIC void InterruptProfile::reset()
+{
+    mResetPending = true;
+}
+
+/**
+ * Called at the top of recorderMonitorEnter.
+ */
+PUBLIC void InterruptProfile::startInterrupt(long frames, int sampleRate)
+{
+    if (mResetPending) {
+        resetInternal();
+        mResetPending = false;
+    }
+
+    mStart = GetClockTicks();
+
+    if (sampleRate > 0)
+      mBudget = (GetClockFrequency() * frames) / sampleRate;
+
+    if (mLastStart > 0 && mBudget > 0) {
+        long long delta = mStart - mLastStart;
+        if (delta > mBudget + (mBudget / 2))
+          mLateInterrupts++;
+    }
+    mLastStart = mStart;
+
+    mInterrupts++;
+}
+
+/**
+ * Called at the end of recorderMonitorExit.
+ */
+PUBLIC void InterruptProfile::endInterrupt()
+{
+    add(ProfileInterrupt, GetClockTicks() - mStart);
+}
+
+PUBLIC long long InterruptProfile::getInterruptStart()
+{
+    return mStart;
+}
+
+PUBLIC void InterruptProfile::add(ProfilePhase phase, long long ticks)
+{
+    mPhases[phase].add(ticks, mBudget);
+}
+
+PUBLIC void InterruptProfile::addTrack(int track, ProfilePhase phase,
+                                       long long ticks)
+{
+    if (track >= 0 && track < PROFILE_MAX_TRACKS)
+      mTracks[track][phase].add(ticks, mBudget);
+}
+
+PUBLIC long InterruptProfile::getInterrupts()
+{
+    return mInterrupts;
+}
+
+PUBLIC long InterruptProfile::getLateInterrupts()
+{
+    return mLateInterrupts;
+}
+
+PUBLIC long long InterruptProfile::getBudget()
+{
+    return mBudget;
+}
+
+/**
+ * Return the histogram for a phase.  For track phases this
+ * is the sum of all tracks.
+ */
+PUBLIC void InterruptProfile::getHistogram(ProfilePhase phase,
+                                           ProfileHistogram* h)
+{
+    h->reset();
+    if (phase < PROFILE_FIRST_TRACK_PHASE)
+      h->merge(&mPhases[phase]);
+    else {
+        for (int i = 0 ; i < PROFILE_MAX_TRACKS ; i++)
+          h->merge(&mTracks[i][phase]);
+    }
+}
+
+PUBLIC void InterruptProfile::getTrackHistogram(int track, ProfilePhase phase,
+                                                ProfileHistogram* h)
+{
+    h->reset();
+    if (track >= 0 && track < PROFILE_MAX_TRACKS)
+      h->merge(&mTracks[track][phase]);
+}
+
+PUBLIC const char* InterruptProfile::getPhaseName(ProfilePhase phase)
+{
+    const char* name = "???";
+    switch (phase) {
+        case ProfileInterrupt: name = "Interrupt"; break;
+        case ProfileConfig: name = "Config"; break;
+        case ProfileSyncStart: name = "SyncStart"; break;
+        case ProfileActions: name = "Actions"; break;
+        case ProfileTriggers: name = "Triggers"; break;
+        case ProfileScripts: name = "Scripts"; break;
+        case ProfileTracks: name = "Tracks"; break;
+        case ProfileExit: name = "Exit"; break;
+        case ProfileTrackEvents: name = "Events"; break;
+        case ProfileTrackRecord: name = "Record"; break;
+        case ProfileTrackPlay: name = "Play"; break;
+        case ProfileTrackMix: name = "Mix"; break;
+    }
+    return name;
+}
+
+/**
+ * Dump the histograms, called periodically by MobiusThread
+ * from Mobius::logStatus.
+ */
+PUBLIC void InterruptProfile::dump(TraceBuffer* b)
+{
+    char name[128];
+    ProfileHistogram h;
+    int i;
+
+    double budget = ClockTicksToMicros(mBudget);
+
+    b->add("Interrupt profile: %ld interrupts, %ld late, budget %d usec\n",
+           mInterrupts, mLateInterrupts, (int)budget);
+
+    // bucket headings, percentages of the budget
+    b->add("%-16s %8s %6s %8s %8s ", "phase", "count", "miss", "avg", "max");
+    for (i = 0 ; i < PROFILE_BUCKETS - 1 ; i++)
+      b->add("<%-5d ", (int)((100.0 * (1 << i)) / 128.0 + 0.5));
+    b->add("more\n");
+
+    for (i = 0 ; i < PROFILE_PHASES ; i++) {
+        ProfilePhase phase = (ProfilePhase)i;
+        getHistogram(phase, &h);
+        dump(b, getPhaseName(phase), &h);
+    }
+
+    // tracks that have been doing something
+    for (int t = 0 ; t < PROFILE_MAX_TRACKS ; t++) {
+        for (i = PROFILE_FIRST_TRACK_PHASE ; i < PROFILE_PHASES ; i++) {
+            ProfilePhase phase = (ProfilePhase)i;
+            getTrackHistogram(t, phase, &h);
+            if (h.count > 0) {
+                sprintf(name, "  %d %s", t + 1, getPhaseName(phase));
+                dump(b, name, &h);
+            }
+        }
+    }
+}
+
+/**
+ * Times are in microseconds, bucket counts are percentages of
+ * the samples.
+ */
+PRIVATE void InterruptProfile::dump(TraceBuffer* b, const char* name,
+                                    ProfileHistogram* h)
+{
+    double avg = 0.0;
+    if (h->count > 0)
+      avg = ClockTicksToMicros(h->total) / (double)h->count;
+
+    b->add("%-16s %8d %6d %8.1f %8.1f ", name, h->count, h->misses,
+           avg, ClockTicksToMicros(h->max));
+
+    for (int i = 0 ; i < PROFILE_BUCKETS ; i++) {
+        int percent = 0;
+        if (h->count > 0)
+          percent = (int)((100.0 * h->buckets[i]) / h->count);
+        b->add("%-6d ", percent);
+    }
+    b->add("\n");
+}
+
+/****************************************************************************/
+/****************************************************************************/
+/****************************************************************************/
@@ -0,0 +1,232 @@
+/*
+ * Copyright (c) 2010 Jeffrey S. Larson  <jeff@circularlabs.com>
+ * All rights reserved.
+ * See the LICENSE file for the full copyright and license declaration.
+ *
+ * ---------------------------------------------------------------------
+ *
+ * Timing histograms for the phases of the audio interrupt.
+ *
+ */
+
+#ifndef INTERRUPT_PROFILE_H
+#define INTERRUPT_PROFILE_H
+
+/****************************************************************************
+ *                                                                          *
+ *                                   PHASES                                 *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * The parts of the interrupt we time.  The first group is measured
+ * once per interrupt by Mobius, the second group once per interrupt
+ * for each Track.
+ */
+typedef enum {
+
+    // everything from recorderMonitorEnter to the end of recorderMonitorExit
+    ProfileInterrupt,
+
+    // shifting in configs, setups, samples and projects
+    ProfileConfig,
+
+    // Synchronizer::interruptStart and Track::prepareForInterrupt
+    ProfileSyncStart,
+
+    // doInterruptActions
+    ProfileActions,
+
+    // TriggerState::advance
+    ProfileTriggers,
+
+    // doScriptMaintenance
+    ProfileScripts,
+
+    // Recorder processing all tracks, including the parallel track mix
+    ProfileTracks,
+
+    // recorderMonitorExit
+    ProfileExit,
+
+    // Track event loop excluding record and play
+    ProfileTrackEvents,
+
+    // InputStream::record into the loop
+    ProfileTrackRecord,
+
+    // OutputStream::play excluding the mix
+    ProfileTrackPlay,
+
+    // OutputStream level, pan, and mix into the interrupt buffer
+    ProfileTrackMix
+
+} ProfilePhase;
+
+#define PROFILE_PHASES 12
+
+/**
+ * The first phase measured per track.
+ */
+#define PROFILE_FIRST_TRACK_PHASE ProfileTrackEvents
+
+/**
+ * Tracks we'll keep histograms for.  Tracks beyond this
+ * are not profiled.
+ */
+#define PROFILE_MAX_TRACKS 32
+
+/**
+ * Histogram buckets.  Bucket zero is for samples under 1/128
+ * of the interrupt budget, each bucket after that doubles,
+ * so bucket 7 is under the full budget, bucket 8 is under twice
+ * the budget, and bucket 9 is everything else.
+ */
+#define PROFILE_BUCKETS 10
+
+/**
+ * Bucket holding samples that equaled or exceeded the budget.
+ */
+#define PROFILE_MISS_BUCKET 8
+
+/****************************************************************************
+ *                                                                          *
+ *                                 HISTOGRAM                                *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * Timing statistics for one phase.  Each histogram has only
+ * one writer at a time so no locking is done, readers may see
+ * a sample half-added, which is fine for display.
+ */
+class ProfileHistogram {
+
+  public:
+
+    ProfileHistogram();
+    ~ProfileHistogram();
+
+    void reset();
+    void add(long long ticks, long long budget);
+    void merge(ProfileHistogram* src);
+
+    /**
+     * Number of samples.
+     */
+    int count;
+
+    /**
+     * Samples that took as long or longer than the interrupt budget.
+     * For ProfileInterrupt these are deadline misses.
+     */
+    int misses;
+
+    /**
+     * Total ticks for all samples, for the average.
+     */
+    long long total;
+
+    /**
+     * Longest sample in ticks.
+     */
+    long long max;
+
+    /**
+     * Sample counts by fraction of the budget.
+     */
+    int buckets[PROFILE_BUCKETS];
+
+};
+
+/****************************************************************************
+ *                                                                          *
+ *                                  PROFILE                                 *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * Always on profiler for the audio interrupt, maintained by Mobius
+ * and exposed through MobiusState.  Timings are in GetClockTicks
+ * units and are bucketed relative to the interrupt budget, the
+ * time it takes the device to consume one block.
+ *
+ * The interrupt phases are written only by the interrupt thread.
+ * The track phases are written by whichever thread is processing
+ * that track, which may be a Recorder worker but there is only one
+ * per track per interrupt.
+ */
+class InterruptProfile {
+
+  public:
+
+    InterruptProfile();
+    ~InterruptProfile();
+
+    // called in the interrupt
+
+    void startInterrupt(long frames, int sampleRate);
+    void endInterrupt();
+    void add(ProfilePhase phase, long long ticks);
+    void addTrack(int track, ProfilePhase phase, long long ticks);
+    long long getInterruptStart();
+
+    // called outside the interrupt
+
+    void reset();
+    long getInterrupts();
+    long getLateInterrupts();
+    long long getBudget();
+    void getHistogram(ProfilePhase phase, ProfileHistogram* h);
+    void getTrackHistogram(int track, ProfilePhase phase,
+                           ProfileHistogram* h);
+    void dump(class TraceBuffer* b);
+
+    static const char* getPhaseName(ProfilePhase phase);
+
+  private:
+
+    void resetInternal();
+    void dump(class TraceBuffer* b, const char* name, ProfileHistogram* h);
+
+    ProfileHistogram mPhases[PROFILE_PHASES];
+    ProfileHistogram mTracks[PROFILE_MAX_TRACKS][PROFILE_PHASES];
+
+    /**
+     * Ticks per interrupt block.
+     */
+    long long mBudget;
+
+    /**
+     * GetClockTicks at the start of the current interrupt.
+     */
+    long long mStart;
+
+    /**
+     * GetClockTicks at the start of the last interrupt.
+     */
+    long long mLastStart;
+
+    /**
+     * Number of interrupts profiled.
+     */
+    long mInterrupts;
+
+    /**
+     * Interrupts that started more than one and a half blocks
+     * after the last one, the device probably dropped one.
+     */
+    long mLateInterrupts;
+
+    /**
+     * Set by reset() and handled at the start of the next interrupt
+     * so we don't have two writers.
+     */
+    bool mResetPending;
+
+};
+
+/****************************************************************************/
+/****************************************************************************/
+/****************************************************************************/
+#endif
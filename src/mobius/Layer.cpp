@@ -315,6 +315,7 @@
 #include <memory.h>
 
 #include "Util.h"
+#include "Thread.h"
 
 #include "Audio.h"
 #include "FadeWindow.h"
@@ -325,6 +326,7 @@
 #include "MobiusState.h"
 #include "Mode.h"
 #include "Project.h"
+#include "Reclaimer.h"
 #include "Script.h"
 #include "Segment.h"
 #include "Stream.h"
@@ -528,6 +530,9 @@ Layer::Layer(LayerPool* lpool, AudioPool* apool)
     mWindowOffset = -1;
     mWindowSubcycleFrames = 0;
 	mCheckpoint = CHECKPOINT_UNSPECIFIED;
+    mGeneration = 0;
+    mRetired = NULL;
+    mRetiredEpoch = 0;
 
 	mSmoother = new Smoother();
     mHeadWindow = new FadeWindow();
@@ -579,6 +584,7 @@ Layer::~Layer()
  */
 void Layer::reset()
 {
+    mGeneration++;
 	mAudio->reset();
 	mOverdub->reset();
     mHeadWindow->reset();
@@ -746,20 +752,25 @@ int Layer::getReferences()
     return mReferences;
 }
 
+/**
+ * These are atomic since the Reclaimer may release references
+ * held by the Segments of the layers it resets.
+ */
 void Layer::incReferences()
 {
-    mReferences++;
+    AtomicIncrement(&mReferences);
 }
 
 int Layer::decReferences()
 {
-	if (mReferences > 0)
-	  mReferences--;
-	else {
+	int refs = AtomicDecrement(&mReferences);
+	if (refs < 0) {
 		printf("Layer::decReferences: invalid reference count %d\n", 
-			   mReferences);
+			   refs + 1);
+		AtomicIncrement(&mReferences);
+		refs = 0;
 	}
-    return mReferences;
+    return refs;
 }
 
 void Layer::setReferences(int i)
@@ -1050,6 +1061,7 @@ long Layer::getSegmentFrames()
  */
 void Layer::setFrames(LayerContext* con, long frames)
 {
+    mGeneration++;
 	if (con == NULL || !con->isReverse()) {
 		mAudio->setFrames(frames);
 		mOverdub->setFrames(frames);
@@ -1069,6 +1081,7 @@ void Layer::setFrames(LayerContext* con, long frames)
  */
 void Layer::resize(long frames)
 {
+    mGeneration++;
 	mAudio->setFrames(frames);
 	mOverdub->setFrames(frames);
 	mFrames = frames;
@@ -1179,6 +1192,7 @@ Audio* Layer::getOverdub()
  */
 void Layer::setAudio(Audio* a)
 {
+    mGeneration++;
     delete mAudio;
     mAudio = a;
     mRecordCursor->setAudio(mAudio);
@@ -1363,6 +1377,8 @@ void Layer::resetSegments()
 {
     Segment* next = NULL;
 
+    mGeneration++;
+
     for (Segment* seg = mSegments ; seg != NULL ; seg = next) {
         next = seg->getNext();
         delete seg;
@@ -1517,6 +1533,8 @@ PRIVATE void Layer::fadeLeft(bool foreground, bool background, float baseLevel)
 {
     int fadeFrames = AudioFade::getRange();
 
+    mGeneration++;
+
 	if (foreground && background) {
 
         CovFadeLeftBoth = true;
@@ -1649,6 +1667,8 @@ PRIVATE void Layer::fadeRight(bool foreground, bool background, float baseLevel)
 	int fadeFrames = AudioFade::getRange();
     int fadeOffset = 0;
 
+    mGeneration++;
+
 	startFrame -= fadeFrames;
 	if (startFrame < 0) {
 		// it would have to be an impossibly short loop to get here
@@ -1985,6 +2005,8 @@ PRIVATE void Layer::startRecordFade(LayerContext* con)
  */
 PUBLIC void Layer::fadeOut(LayerContext* con)
 {
+    mGeneration++;
+
 	if (ScriptBreak) {
 		int x = 0;
 	}
@@ -2054,6 +2076,8 @@ PUBLIC void Layer::fadeOut(LayerContext* con)
  */
 PRIVATE void Layer::fadeOut(LayerContext* con, long frames)
 {
+    mGeneration++;
+
 	// This should only happen if we had a deferred fade out, which
 	// means the tail window must be all the way to the end
 	if (mTailWindow->getLastExternalFrame() != getFrames())
@@ -2133,6 +2157,8 @@ void Layer::compileSegmentFades(bool checkConsistency)
 	int fadeRange = AudioFade::getRange();
     Segment* s;
 
+    mGeneration++;
+
 	if (ScriptBreak) {
 		int x = 0;
 	}
@@ -2473,6 +2499,8 @@ PUBLIC void Layer::prepare(LayerContext* con)
  */
 PUBLIC void Layer::restore(bool undo)
 {
+    mGeneration++;
+
     if (undo) {
         // always apply the trailing deferred fade
         if (mReverseRecord)
@@ -2921,6 +2949,109 @@ PUBLIC Audio* Layer::flatten()
 	return flat;
 }
 
+PUBLIC int Layer::getGeneration()
+{
+    return mGeneration;
+}
+
+/**
+ * Combine the generations of this layer and every layer reachable
+ * through its Segments.  A flat copy takes content from all of them,
+ * so a deferred fade applied to any one of them makes the copy stale,
+ * not just a change to this layer.  A layer reached by more than
+ * one segment is only counted once.
+ *
+ * Called in the interrupt, or while the structure is pinned so the
+ * Segments can't change while we walk them.
+ */
+PUBLIC int Layer::getContentGeneration()
+{
+    Layer* visited[LAYER_MAX_CONTENT_LAYERS];
+    int count = 0;
+    unsigned int generation = 0;
+
+    addContentGeneration(visited, &count, &generation);
+
+    return (int)generation;
+}
+
+PRIVATE void Layer::addContentGeneration(Layer** visited, int* count,
+                                         unsigned int* generation)
+{
+    bool found = false;
+    for (int i = 0 ; i < *count && !found ; i++)
+      found = (visited[i] == this);
+
+    if (!found && *count < LAYER_MAX_CONTENT_LAYERS) {
+        visited[*count] = this;
+        (*count)++;
+        *generation = (*generation * 31) + (unsigned int)mGeneration;
+
+        for (Segment* seg = mSegments ; seg != NULL ; seg = seg->getNext()) {
+            Layer* ref = seg->getLayer();
+            if (ref != NULL)
+              ref->addContentGeneration(visited, count, generation);
+        }
+    }
+}
+
+/**
+ * Calculate how many levels of layer we have to descend through
+ * to play this one, a layer with no segments has a depth of one.
+ * The number of segments visited at all levels is accumulated 
+ * in the segments argument.
+ *
+ * This is called in the interrupt so we stop as soon as we exceed
+ * either limit, without that this costs as much as playing
+ * a block from the layer.
+ */
+PUBLIC int Layer::getSegmentDepth(int maxDepth, int maxSegments, 
+                                  int* segments)
+{
+    int depth = 1;
+
+    for (Segment* seg = mSegments ; seg != NULL ; seg = seg->getNext()) {
+        (*segments)++;
+        if (depth > maxDepth || *segments > maxSegments)
+          break;
+
+        Layer* ref = seg->getLayer();
+        if (ref != NULL) {
+            int refDepth = ref->getSegmentDepth(maxDepth - 1, maxSegments, 
+                                                segments) + 1;
+            if (refDepth > depth)
+              depth = refDepth;
+        }
+    }
+
+    return depth;
+}
+
+/**
+ * Install a flattened copy of this layer made by flatten().
+ * The segments are no longer needed and are released, which may
+ * return the layers they referenced to the pool.  The previous local
+ * Audio is returned so it can be deleted outside the interrupt.
+ * 
+ * The caller must have checked getContentGeneration to make sure nothing
+ * changed since the copy was made.
+ */
+PUBLIC Audio* Layer::swapFlattened(Audio* flat)
+{
+    Audio* old = mAudio;
+
+    mAudio = flat;
+    mRecordCursor->setAudio(mAudio);
+    mFeedbackCursor->setAudio(mAudio);
+    mPlayCursor->setAudio(mAudio);
+    mCopyCursor->setAudio(mAudio);
+
+    // this also increments the generation
+    resetSegments();
+
+    return old;
+}
+
 /**
  * Capture a fade tail from a specified location.
  * The supplied buffer will be at least as long as 
@@ -3611,6 +3742,8 @@ PRIVATE void Layer::adjustSegmentFades(Segment* s)
 PUBLIC void Layer::splice(LayerContext* con, long startFrame, long frames, 
 						  int cycles)
 {
+    mGeneration++;
+
 	// Loop will already have emitted trace mesages
 	int fadeRange = AudioFade::getRange();
 
@@ -4748,7 +4881,9 @@ PRIVATE void Layer::checkMaxUndo()
 PUBLIC LayerPool::LayerPool(AudioPool* aupool)
 {
     mAudioPool = aupool;
+    mReclaimer = NULL;
     mLayers = NULL;
+    mReturned = NULL;
     mCounter = 0;
     mAllocated = 0;
     mMuteLayer = NULL;
@@ -4769,6 +4904,17 @@ PUBLIC LayerPool::~LayerPool()
 
     // this will delete the prev pointer chain
     delete mLayers;
+    delete mReturned;
+}
+
+/**
+ * Give layers whose last reference goes away to a Reclaimer
+ * rather than resetting them here, freeLayer is usually called
+ * from the interrupt.
+ */
+PUBLIC void LayerPool::setReclaimer(Reclaimer* r)
+{
+    mReclaimer = r;
 }
 
 /**
@@ -4814,6 +4960,9 @@ PUBLIC Layer* LayerPool::getMuteLayer()
  */
 Layer* LayerPool::newLayer(Loop* loop)
 {
+	if (mLayers == NULL)
+	  mLayers = (Layer*)AtomicExchangePointer((void* volatile*)&mReturned, NULL);
+
 	Layer* layer = mLayers;
 
 	if (layer == NULL) {
@@ -4865,7 +5014,12 @@ void LayerPool::freeLayer(Layer* layer)
 		  Trace(1, "Layer: Attempt to free layer already in the pool!\n");
 		else {
 			int refs = layer->decReferences();
-			if (refs <= 0) {
+			if (refs <= 0 && mReclaimer != NULL) {
+				// reset and returned to us later by MobiusThread
+				layer->mPooled = true;
+				mReclaimer->retire(layer);
+			}
+			else if (refs <= 0) {
 				layer->reset();
 				layer->setPrev(mLayers);
 				layer->mPooled = true;
@@ -4909,6 +5063,21 @@ void LayerPool::freeLayerList(Layer* list)
     }
 }
 
+/**
+ * Called by the Reclaimer after it resets a layer.
+ */
+PUBLIC void LayerPool::returnLayer(Layer* layer)
+{
+	if (layer != NULL) {
+		Layer* head;
+		do {
+			head = mReturned;
+			layer->setPrev(head);
+		} while (!AtomicCompareAndSwapPointer((void* volatile*)&mReturned,
+											  head, layer));
+	}
+}
+
 void LayerPool::resetCounter()
 {
     mCounter = 0;
@@ -4920,6 +5089,8 @@ PUBLIC void LayerPool::dump()
 
     for (Layer* l = mLayers ; l != NULL ; l = l->getPrev())
       count++;
+    for (Layer* l = mReturned ; l != NULL ; l = l->getPrev())
+      count++;
 
     printf("LayerPool: %d allocated, %d in the pool, %d in use\n", 
            mAllocated, count, mAllocated - count);
@@ -16,6 +16,12 @@
 #include "Audio.h"
 #include "MobiusState.h"
 
+/**
+ * The most layers getContentGeneration will visit.  Flattening keeps
+ * Segment chains much shorter than this, layers past it aren't checked.
+ */
+#define LAYER_MAX_CONTENT_LAYERS 64
+
 /****************************************************************************
  *                                                                          *
  *   							LAYER CONTEXT                               *
@@ -82,6 +88,7 @@ class Layer : public TraceContext
 {
     friend class LayerPool;
 	friend class Segment;
+	friend class Reclaimer;
 
   public:
 
@@ -144,6 +151,13 @@ class Layer : public TraceContext
 	Audio* getOverdub();
 	Audio* flatten();
 
+    // Background flattening, see LayerFlattener
+    int getGeneration();
+    int getContentGeneration();
+    int getSegmentDepth(int maxDepth, int maxSegments, int* segments);
+    Audio* swapFlattened(Audio* flat);
+
+
 	CheckpointState getCheckpoint();
 	bool isCheckpoint();
 	void setCheckpoint(CheckpointState c);
@@ -259,6 +273,8 @@ class Layer : public TraceContext
 
 	void pruneSegments();
 	void removeSegment(Segment* seg);
+    void addContentGeneration(Layer** visited, int* count,
+                              unsigned int* generation);
 	Segment* addSegment(Layer* src);
 
 	void checkRecording(LayerContext* con, long startFrame);
@@ -307,7 +323,7 @@ class Layer : public TraceContext
 	Layer*		mRedo;		// only for the redo list
 	int			mNumber;
     int         mAllocation;
-    int         mReferences;
+    volatile int mReferences;
 	Loop*		mLoop;
     Segment*    mSegments;
 	Audio*		mAudio;
@@ -436,6 +452,21 @@ class Layer : public TraceContext
      */
     long mWindowSubcycleFrames;
 
+    /**
+     * Incremented whenever something happens that could change the
+     * content of the layer, or the segment list, outside of the
+     * usual recording into the record layer.  Used by LayerFlattener
+     * to detect when a layer changed while it was being flattened.
+     * Only the interrupt changes it, other threads read it.
+     */
+    volatile int mGeneration;
+
+    /**
+     * Chain and epoch when waiting in a Reclaimer.
+     */
+    Layer* mRetired;
+    int mRetiredEpoch;
+
 };
 
 /****************************************************************************
@@ -455,9 +486,12 @@ class LayerPool {
     LayerPool(class AudioPool* aupool);
     ~LayerPool();
 
+    void setReclaimer(class Reclaimer* r);
+
     Layer* newLayer(class Loop* l);
     void freeLayer(Layer* l);
     void freeLayerList(Layer* l);
+    void returnLayer(Layer* l);
     
     Layer* getMuteLayer();
 
@@ -471,9 +505,16 @@ class LayerPool {
 	void flush();
 
     class AudioPool* mAudioPool;
+    class Reclaimer* mReclaimer;
     Layer* mLayers;
     int mCounter;
     int mAllocated;
+
+    /**
+     * Layers reset by the Reclaimer.  Any thread may push,
+     * newLayer takes the whole list when mLayers runs out.
+     */
+    Layer* volatile mReturned;
     
     Layer* mMuteLayer;
     LayerContext* mCopyContext;
@@ -0,0 +1,1422 @@
+/*
+ * Copyright (c) 2010 Jeffrey S. Larson  <jeff@circularlabs.com>
+ * All rights reserved.
+ * See the LICENSE file for the full copyright and license declaration.
+ *
+ * ---------------------------------------------------------------------
+ *
+ * Background lossless compression of undo layers that are
+ * unlikely to be played soon.
+ *
+ * With a long loop and a deep undo history most of the memory in use
+ * is in layers nobody will hear again unless they Undo a long way.
+ * Whenever a loop starts playing a different layer Loop calls check().
+ * The play layer, the COMPRESS_WARM_LAYERS layers behind it, as many
+ * on the redo list, and the layers their Segments reference are warm.
+ * Layers further back that aren't warm are given an extra reference
+ * and queued for MobiusThread, which codes each buffer of the layer's
+ * Audio and makes a new Audio with the result as its AudioSource.  At the start of a later
+ * interrupt the new Audio is swapped in with Layer::swapFlattened, the
+ * same way LayerFlattener installs flat copies, and the old Audio
+ * goes to the Reclaimer.
+ *
+ * Nothing is decompressed until a block is touched.  If one of the
+ * warm layers is still compressed, usually because an Undo moved the
+ * play layer back, check() queues it for MobiusThread which loads all
+ * of its blocks, starting with the one at the play frame, before the
+ * interrupt gets there.  The same is done for warm layers read from
+ * a project file so the interrupt doesn't copy from the mapping.
+ * If the interrupt touches a block first it is loaded in the
+ * interrupt.  The time decoding takes is kept in the statistics
+ * printed at shutdown.  Window calls check() too, whenever it moves,
+ * so the layers its segments reach into are loaded from the frame
+ * the window will play first.
+ *
+ * A compressed layer that has been loaded is as big as it was before
+ * it was compressed.  The layers we installed are kept in a table
+ * with an extra reference, and check() notes which of them are warm.
+ * When the loaded blocks of the cold ones add up to more than the
+ * cache budget install() gives the buffers of the least recently
+ * warm one back to the pool, one layer per interrupt, and the Audio
+ * goes back to decoding them from its source.  The coded data is
+ * still there so nothing has to be coded again.
+ *
+ * The codec works on one channel of a buffer at a time in groups of
+ * COMPRESS_GROUP_FRAMES.  Each group is coded one of three ways,
+ * whichever is smallest:
+ *
+ *   DELTA - The float bits are mapped to unsigned integers that
+ *   sort in the same order as the floats and we code the difference
+ *   from the previous sample.  Neighboring samples are close in value
+ *   so the sign, the exponent, and the high mantissa bits cancel.
+ *
+ *   INTEGER - Everything in the group is an integer multiple of 2^-S,
+ *   which is the case for anything that came from a 16 or 24 bit
+ *   converter and has only been mixed without level changes.
+ *   We code the difference between the integers.
+ *
+ *   RAW - The float bits as is, for noise that doesn't code well.
+ *
+ *   ZERO - Nothing but positive zeros, the group is only a header.
+ *
+ * Differences are zigzagged to make them positive and Rice coded
+ * with a parameter chosen for each group.
+ *
+ * Buffers that are shared with another Audio are left alone.  They
+ * stay in memory as long as the other Audio has them and coding them
+ * would only add memory.
+ *
+ */
+
+#include <stdio.h>
+#include <memory.h>
+#include <math.h>
+
+#include "Util.h"
+#include "Trace.h"
+#include "Thread.h"
+
+#include "Audio.h"
+#include "Layer.h"
+#include "LayerFlattener.h"
+#include "Loop.h"
+#include "Mobius.h"
+#include "MobiusThread.h"
+#include "Segment.h"
+
+#include "LayerCompressor.h"
+
+/****************************************************************************
+ *                                                                          *
+ *                                   CODEC                                  *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * Group coding methods, stored in two bits.
+ */
+#define CODE_DELTA 0
+#define CODE_INTEGER 1
+#define CODE_RAW 2
+#define CODE_ZERO 3
+
+/**
+ * Quotients this large are followed by the value in 32 bits.
+ */
+#define RICE_ESCAPE 24
+
+/**
+ * Zero bytes after the coded data so the reader can fill
+ * ahead without checking for the end.
+ */
+#define CODE_PAD 16
+
+/**
+ * Layers referenced by Segments are warm to this depth, deeper
+ * chains are flattened by LayerFlattener.
+ */
+#define COMPRESS_SEGMENT_DEPTH 4
+
+/**
+ * For counting the trailing zeros of a word with one bit set.
+ */
+static int DeBruijnBits[32] = {
+    0, 1, 28, 2, 29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4, 8,
+    31, 27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6, 11, 5, 10, 9
+};
+
+typedef union {
+    float f;
+    unsigned int i;
+} FloatBits;
+
+typedef struct {
+    unsigned char* ptr;
+    unsigned long long acc;
+    int bits;
+} BitWriter;
+
+typedef struct {
+    const unsigned char* ptr;
+    unsigned long long acc;
+    int bits;
+} BitReader;
+
+/**
+ * Map float bits to an unsigned integer with the same order.
+ * Positive floats get the high bit, negative floats are inverted.
+ */
+inline unsigned int FloatToOrdered(float f)
+{
+    FloatBits b;
+    b.f = f;
+    return (b.i & 0x80000000) ? ~b.i : (b.i | 0x80000000);
+}
+
+inline float OrderedToFloat(unsigned int i)
+{
+    FloatBits b;
+    b.i = (i & 0x80000000) ? (i & 0x7fffffff) : ~i;
+    return b.f;
+}
+
+inline unsigned int ZigZag(int i)
+{
+    return ((unsigned int)i << 1) ^ (unsigned int)(i >> 31);
+}
+
+inline int UnZigZag(unsigned int z)
+{
+    return (int)((z >> 1) ^ (0u - (z & 1)));
+}
+
+inline void PutBits(BitWriter* w, unsigned int value, int count)
+{
+    w->acc |= (unsigned long long)value << w->bits;
+    w->bits += count;
+    while (w->bits >= 8) {
+        *(w->ptr)++ = (unsigned char)w->acc;
+        w->acc >>= 8;
+        w->bits -= 8;
+    }
+}
+
+inline void PutRice(BitWriter* w, unsigned int value, int k)
+{
+    unsigned int q = value >> k;
+    if (q < RICE_ESCAPE) {
+        // q ones and a zero
+        PutBits(w, (1u << q) - 1, q + 1);
+        if (k > 0)
+          PutBits(w, value & ((1u << k) - 1), k);
+    }
+    else {
+        PutBits(w, (1u << RICE_ESCAPE) - 1, RICE_ESCAPE);
+        PutBits(w, value, 32);
+    }
+}
+
+inline void FlushBits(BitWriter* w)
+{
+    if (w->bits > 0)
+      PutBits(w, 0, 8 - w->bits);
+}
+
+/**
+ * Make sure there are at least 56 bits in the accumulator,
+ * enough for the longest Rice code.  Load eight bytes and keep
+ * the ones that fit rather than looping a byte at a time.
+ */
+inline void FillBits(BitReader* r)
+{
+    const unsigned char* p = r->ptr;
+    unsigned long long next =
+        (unsigned long long)p[0] |
+        ((unsigned long long)p[1] << 8) |
+        ((unsigned long long)p[2] << 16) |
+        ((unsigned long long)p[3] << 24) |
+        ((unsigned long long)p[4] << 32) |
+        ((unsigned long long)p[5] << 40) |
+        ((unsigned long long)p[6] << 48) |
+        ((unsigned long long)p[7] << 56);
+
+    r->acc |= next << r->bits;
+    r->ptr += (63 - r->bits) >> 3;
+    r->bits |= 56;
+}
+
+inline unsigned int GetBits(BitReader* r, int count)
+{
+    unsigned int value =
+        (unsigned int)(r->acc & ((1ull << count) - 1));
+    r->acc >>= count;
+    r->bits -= count;
+    return value;
+}
+
+inline unsigned int GetRice(BitReader* r, int k)
+{
+    unsigned int value;
+    int q = RICE_ESCAPE;
+
+    FillBits(r);
+
+    // count the ones by finding the lowest zero
+    unsigned int zeros = ~(unsigned int)r->acc & ((1u << RICE_ESCAPE) - 1);
+    if (zeros != 0)
+      q = DeBruijnBits[((zeros & (0u - zeros)) * 0x077CB531u) >> 27];
+    r->acc >>= q;
+    r->bits -= q;
+
+    if (q == RICE_ESCAPE)
+      value = GetBits(r, 32);
+    else {
+        // the zero
+        r->acc >>= 1;
+        r->bits--;
+        value = ((unsigned int)q << k);
+        if (k > 0)
+          value |= GetBits(r, k);
+    }
+    return value;
+}
+
+/**
+ * Bits needed to Rice code the values with a parameter.
+ */
+static long GetRiceBits(unsigned int* values, int count, int k)
+{
+    long bits = 0;
+    for (int i = 0 ; i < count ; i++) {
+        unsigned int q = values[i] >> k;
+        bits += (q < RICE_ESCAPE) ? (q + 1 + k) : (RICE_ESCAPE + 32);
+    }
+    return bits;
+}
+
+/**
+ * Pick the Rice parameter for a group.  Start near the log of the
+ * mean and look on either side.
+ */
+static int GetRiceParameter(unsigned int* values, int count, long* retBits)
+{
+    unsigned long long sum = 0;
+    for (int i = 0 ; i < count ; i++)
+      sum += values[i];
+
+    int k = 0;
+    while (k < 31 && ((unsigned long long)count << (k + 1)) <= sum)
+      k++;
+
+    long bits = GetRiceBits(values, count, k);
+    if (k > 0) {
+        long lower = GetRiceBits(values, count, k - 1);
+        if (lower < bits) {
+            bits = lower;
+            k--;
+        }
+    }
+    if (k < 31) {
+        long higher = GetRiceBits(values, count, k + 1);
+        if (higher < bits) {
+            bits = higher;
+            k++;
+        }
+    }
+
+    *retBits = bits;
+    return k;
+}
+
+/**
+ * Find the smallest S for which every sample in a group is an
+ * integer multiple of 2^-S whose magnitude is less than 2^30.
+ * Returns false if there isn't one.  Negative zero, denormals,
+ * infinities and NaNs can't be represented.
+ */
+static bool GetIntegerScale(float* src, int count, int channels, int* retScale)
+{
+    int scale = 0;
+    int maxExponent = 0;
+
+    for (int i = 0 ; i < count ; i++) {
+        FloatBits b;
+        b.f = src[i * channels];
+        if (b.i != 0) {
+            int exponent = (b.i >> 23) & 0xff;
+            if (exponent == 0 || exponent == 0xff)
+              return false;
+
+            unsigned int mantissa = (b.i & 0x7fffff) | 0x800000;
+            int zeros = DeBruijnBits[((mantissa & (0u - mantissa)) * 0x077CB531u) >> 27];
+
+            // the sample is mantissa * 2^(exponent - 150)
+            int needed = 150 - exponent - zeros;
+            if (needed > scale)
+              scale = needed;
+            if (exponent > maxExponent)
+              maxExponent = exponent;
+        }
+    }
+
+    // magnitudes are less than 2^(maxExponent - 126)
+    if (scale > 31 || (maxExponent - 126 + scale) > 30)
+      return false;
+
+    *retScale = scale;
+    return true;
+}
+
+/**
+ * The most bytes encode() can produce for a block, including
+ * the padding the decoder needs.
+ */
+PUBLIC long CompressedAudio::getMaxEncodedSize(long samples)
+{
+    long groups = (samples / COMPRESS_GROUP_FRAMES) + 2;
+    return (samples * 4) + (groups * 2) + CODE_PAD + 8;
+}
+
+/**
+ * Code a block of interleaved samples.  Returns the number of bytes
+ * used, not including the padding which is zeroed.
+ */
+PUBLIC long CompressedAudio::encode(float* src, long samples, int channels,
+                                    unsigned char* dest)
+{
+    unsigned int delta[COMPRESS_GROUP_FRAMES];
+    unsigned int integer[COMPRESS_GROUP_FRAMES];
+    long frames = samples / channels;
+
+    BitWriter w;
+    w.ptr = dest;
+    w.acc = 0;
+    w.bits = 0;
+
+    for (int c = 0 ; c < channels ; c++) {
+        unsigned int prev = FloatToOrdered(0.0f);
+
+        for (long g = 0 ; g < frames ; g += COMPRESS_GROUP_FRAMES) {
+            float* group = &src[(g * channels) + c];
+            int count = (int)(frames - g);
+            if (count > COMPRESS_GROUP_FRAMES)
+              count = COMPRESS_GROUP_FRAMES;
+
+            for (int i = 0 ; i < count ; i++) {
+                unsigned int ordered = FloatToOrdered(group[i * channels]);
+                delta[i] = ZigZag((int)(ordered - prev));
+                prev = ordered;
+            }
+
+            long deltaBits;
+            int deltaK = GetRiceParameter(delta, count, &deltaBits);
+            int method = CODE_DELTA;
+            long bits = deltaBits + 5;
+
+            int scale;
+            int integerK = 0;
+            if (GetIntegerScale(group, count, channels, &scale)) {
+                double multiplier = ldexp(1.0, scale);
+                int last = 0;
+                for (int i = 0 ; i < count ; i++) {
+                    int value = (int)((double)group[i * channels] * multiplier);
+                    integer[i] = ZigZag(value - last);
+                    last = value;
+                }
+                long integerBits;
+                integerK = GetRiceParameter(integer, count, &integerBits);
+                if (integerBits + 10 < bits) {
+                    method = CODE_INTEGER;
+                    bits = integerBits + 10;
+                }
+            }
+
+            if ((long)count * 32 < bits)
+              method = CODE_RAW;
+
+            if (deltaBits == count && prev == FloatToOrdered(0.0f)) {
+                // a zero delta from zero all the way through
+                method = CODE_ZERO;
+            }
+
+            PutBits(&w, method, 2);
+            if (method == CODE_ZERO) {
+                // nothing more
+            }
+            else if (method == CODE_RAW) {
+                for (int i = 0 ; i < count ; i++) {
+                    FloatBits b;
+                    b.f = group[i * channels];
+                    PutBits(&w, b.i, 32);
+                }
+            }
+            else if (method == CODE_INTEGER) {
+                PutBits(&w, scale, 5);
+                PutBits(&w, integerK, 5);
+                for (int i = 0 ; i < count ; i++)
+                  PutRice(&w, integer[i], integerK);
+            }
+            else {
+                PutBits(&w, deltaK, 5);
+                for (int i = 0 ; i < count ; i++)
+                  PutRice(&w, delta[i], deltaK);
+            }
+        }
+    }
+
+    FlushBits(&w);
+    long size = (long)(w.ptr - dest);
+    memset(w.ptr, 0, CODE_PAD);
+
+    return size;
+}
+
+/**
+ * Decode a block made by encode().
+ */
+PUBLIC void CompressedAudio::decode(unsigned char* src, long samples,
+                                    int channels, float* dest)
+{
+    long frames = samples / channels;
+
+    BitReader r;
+    r.ptr = src;
+    r.acc = 0;
+    r.bits = 0;
+
+    for (int c = 0 ; c < channels ; c++) {
+        unsigned int prev = FloatToOrdered(0.0f);
+
+        for (long g = 0 ; g < frames ; g += COMPRESS_GROUP_FRAMES) {
+            float* group = &dest[(g * channels) + c];
+            int count = (int)(frames - g);
+            if (count > COMPRESS_GROUP_FRAMES)
+              count = COMPRESS_GROUP_FRAMES;
+
+            FillBits(&r);
+            int method = GetBits(&r, 2);
+
+            if (method == CODE_ZERO) {
+                for (int i = 0 ; i < count ; i++)
+                  group[i * channels] = 0.0f;
+            }
+            else if (method == CODE_RAW) {
+                for (int i = 0 ; i < count ; i++) {
+                    FloatBits b;
+                    FillBits(&r);
+                    b.i = GetBits(&r, 32);
+                    group[i * channels] = b.f;
+                }
+            }
+            else if (method == CODE_INTEGER) {
+                int scale = GetBits(&r, 5);
+                int k = GetBits(&r, 5);
+                double multiplier = ldexp(1.0, -scale);
+                int value = 0;
+                for (int i = 0 ; i < count ; i++) {
+                    value += UnZigZag(GetRice(&r, k));
+                    group[i * channels] = (float)((double)value * multiplier);
+                }
+            }
+            else {
+                int k = GetBits(&r, 5);
+                for (int i = 0 ; i < count ; i++) {
+                    prev += (unsigned int)UnZigZag(GetRice(&r, k));
+                    group[i * channels] = OrderedToFloat(prev);
+                }
+            }
+
+            prev = FloatToOrdered(group[(count - 1) * channels]);
+        }
+    }
+}
+
+/****************************************************************************
+ *                                                                          *
+ *                             COMPRESSED AUDIO                             *
+ *                                                                          *
+ ****************************************************************************/
+
+PUBLIC CompressedAudio::CompressedAudio(LayerCompressor* c, Audio* src)
+{
+    mCompressor = c;
+    mPool = src->getPool();
+    mSampleRate = src->getSampleRate();
+    mChannels = src->getChannels();
+    mFrames = src->getFrames();
+    mBlockFrames = src->getBlockFrames();
+    mBlockCount = src->getBlockCount();
+    mShareTaken = false;
+
+    int count = (mBlockCount > 0) ? mBlockCount : 1;
+    mData = new unsigned char*[count];
+    mSizes = new long[count];
+    mShared = new float*[count];
+    for (int i = 0 ; i < count ; i++) {
+        mData[i] = NULL;
+        mSizes[i] = 0;
+        mShared[i] = NULL;
+    }
+}
+
+PUBLIC CompressedAudio::~CompressedAudio()
+{
+    for (int i = 0 ; i < mBlockCount ; i++)
+      delete mData[i];
+    delete mData;
+    delete mSizes;
+    delete mShared;
+}
+
+/**
+ * Give us the coded data for a block, it must have been
+ * allocated with CODE_PAD bytes after the size.
+ */
+PUBLIC void CompressedAudio::setBlock(int block, unsigned char* data, long size)
+{
+    if (block >= 0 && block < mBlockCount) {
+        mData[block] = data;
+        mSizes[block] = size;
+    }
+}
+
+PUBLIC void CompressedAudio::setSharedBlock(int block, float* buffer)
+{
+    if (block >= 0 && block < mBlockCount)
+      mShared[block] = buffer;
+}
+
+/**
+ * Called in the interrupt before the Audio is installed, while
+ * the old Audio still has the shared buffers.
+ */
+PUBLIC void CompressedAudio::share()
+{
+    if (!mShareTaken && mPool != NULL) {
+        for (int i = 0 ; i < mBlockCount ; i++) {
+            if (mShared[i] != NULL)
+              mPool->shareBuffer(mShared[i]);
+        }
+        mShareTaken = true;
+    }
+}
+
+PUBLIC long CompressedAudio::getCompressedSize()
+{
+    long size = 0;
+    for (int i = 0 ; i < mBlockCount ; i++)
+      size += mSizes[i];
+    return size;
+}
+
+PUBLIC int CompressedAudio::getCodedBlocks()
+{
+    int count = 0;
+    for (int i = 0 ; i < mBlockCount ; i++) {
+        if (mData[i] != NULL)
+          count++;
+    }
+    return count;
+}
+
+PUBLIC int CompressedAudio::getSharedBlocks()
+{
+    int count = 0;
+    for (int i = 0 ; i < mBlockCount ; i++) {
+        if (mShared[i] != NULL)
+          count++;
+    }
+    return count;
+}
+
+PUBLIC int CompressedAudio::getSampleRate()
+{
+    return mSampleRate;
+}
+
+PUBLIC int CompressedAudio::getChannels()
+{
+    return mChannels;
+}
+
+PUBLIC long CompressedAudio::getFrames()
+{
+    return mFrames;
+}
+
+PUBLIC long CompressedAudio::getBlockFrames()
+{
+    return mBlockFrames;
+}
+
+PUBLIC int CompressedAudio::getBlockCount()
+{
+    return mBlockCount;
+}
+
+PUBLIC bool CompressedAudio::isZeroBlock(int block)
+{
+    return (mData[block] == NULL && mShared[block] == NULL);
+}
+
+/**
+ * May be called from the interrupt.
+ */
+PUBLIC void CompressedAudio::readBlock(int block, float* dest)
+{
+    long samples = mBlockFrames * mChannels;
+
+    if (mShared[block] != NULL) {
+        memcpy(dest, mShared[block], samples * sizeof(float));
+    }
+    else if (mData[block] != NULL) {
+        long long start = GetClockTicks();
+        decode(mData[block], samples, mChannels, dest);
+        if (mCompressor != NULL)
+          mCompressor->addDecode((int)ClockTicksToMicros(GetClockTicks() - start));
+    }
+}
+
+/**
+ * Called by Audio when it is reset, which for a layer happens in
+ * MobiusThread after the Reclaimer is done with it.
+ */
+PUBLIC void CompressedAudio::release()
+{
+    if (mShareTaken) {
+        for (int i = 0 ; i < mBlockCount ; i++)
+          mPool->freeBuffer(mShared[i]);
+    }
+    delete this;
+}
+
+/****************************************************************************
+ *                                                                          *
+ *                             LAYER COMPRESSOR                             *
+ *                                                                          *
+ ****************************************************************************/
+
+PUBLIC bool LayerCompressor::Enabled = true;
+
+PUBLIC LayerCompressor::LayerCompressor(Mobius* m)
+{
+    mMobius = m;
+    mSuspended = 0;
+    mCacheBudget = COMPRESS_CACHE_BYTES;
+    mCacheBytes = 0;
+    mInstalls = 0;
+    mRequested = 0;
+    mInstalled = 0;
+    mDiscarded = 0;
+    mOverflows = 0;
+    mPrefetched = 0;
+    mEvicted = 0;
+    mUntracked = 0;
+    mSharedBlocks = 0;
+    mBytesIn = 0;
+    mBytesOut = 0;
+    mEncodeMicros = 0;
+    mDecodes = 0;
+    mDecodesAhead = 0;
+    mDecodeMicros = 0;
+    mMaxDecodeMicros = 0;
+    mLastBlock = 0;
+    mCopy = NULL;
+    mWork = NULL;
+    mWorkSamples = 0;
+
+    for (int i = 0 ; i < COMPRESS_MAX_REQUESTS ; i++) {
+        CompressRequest* req = &mRequests[i];
+        req->state = COMPRESS_FREE;
+        req->type = COMPRESS_LAYER;
+        req->layer = NULL;
+        req->generation = 0;
+        req->block = 0;
+        req->frame = 0;
+        req->audio = NULL;
+        req->source = NULL;
+    }
+
+    for (int i = 0 ; i < COMPRESS_MAX_CACHED ; i++) {
+        CompressCache* cache = &mCache[i];
+        cache->layer = NULL;
+        cache->audio = NULL;
+        cache->source = NULL;
+        cache->generation = 0;
+        cache->blocks = 0;
+        cache->blockBytes = 0;
+        cache->warm = false;
+        cache->used = 0;
+    }
+}
+
+PUBLIC LayerCompressor::~LayerCompressor()
+{
+    flush();
+    delete mCopy;
+    delete mWork;
+}
+
+/**
+ * Set the number of bytes of decompressed audio we keep for
+ * cold layers.  Zero evicts them as soon as they go cold.
+ */
+PUBLIC void LayerCompressor::setCacheBudget(long bytes)
+{
+    mCacheBudget = (bytes > 0) ? bytes : 0;
+}
+
+/**
+ * Add a layer and the layers its Segments reference to the warm list,
+ * with the frame in each layer that will be played first.
+ * Returns the new count, or -1 if the list overflowed.
+ */
+PRIVATE int LayerCompressor::addWarm(Layer** warm, long* frames, int count,
+                                     Layer* layer, long frame, int depth)
+{
+    if (count >= 0 && !isWarm(warm, count, layer)) {
+        if (count >= COMPRESS_MAX_WARM)
+          count = -1;
+        else {
+            warm[count] = layer;
+            frames[count] = frame;
+            count++;
+            if (depth < COMPRESS_SEGMENT_DEPTH) {
+                for (Segment* seg = layer->getSegments() ;
+                     seg != NULL && count >= 0 ; seg = seg->getNext()) {
+                    Layer* ref = seg->getLayer();
+                    if (ref != NULL) {
+                        // where the frame falls in the segment, or
+                        // the start if we haven't reached it yet
+                        long refFrame = seg->getStartFrame();
+                        long offset = frame - seg->getOffset();
+                        if (offset >= 0 && offset < seg->getFrames())
+                          refFrame += offset;
+                        count = addWarm(warm, frames, count, ref, refFrame,
+                                        depth + 1);
+                    }
+                }
+            }
+        }
+    }
+    return count;
+}
+
+PRIVATE bool LayerCompressor::isWarm(Layer** warm, int count, Layer* layer)
+{
+    bool found = false;
+    for (int i = 0 ; i < count && !found ; i++)
+      found = (warm[i] == layer);
+    return found;
+}
+
+/**
+ * A layer may be compressed if nothing is going to change it,
+ * it isn't already compressed, and there is something in it.
+ * Layers with Segments are left for LayerFlattener, once it has
+ * flattened them we'll get them the next time.  Layers we compressed
+ * before and have since been loaded are evicted rather than
+ * coded again.
+ */
+PRIVATE bool LayerCompressor::isCandidate(Layer* layer)
+{
+    bool candidate = false;
+    if (layer->isFinalized() && layer->getSegments() == NULL &&
+        getCache(layer) == NULL) {
+        Audio* audio = layer->getAudio();
+        candidate = (audio != NULL && audio->getPendingBlocks() == 0 &&
+                     !audio->isEmpty());
+    }
+    return candidate;
+}
+
+/**
+ * Return true if the layer is already waiting.
+ */
+PRIVATE bool LayerCompressor::isPending(Layer* layer)
+{
+    bool pending = false;
+    for (int i = 0 ; i < COMPRESS_MAX_REQUESTS && !pending ; i++) {
+        CompressRequest* req = &mRequests[i];
+        int state = req->state;
+        pending = (state != COMPRESS_FREE && state != COMPRESS_CLAIMED &&
+                   req->layer == layer);
+    }
+    return pending;
+}
+
+/**
+ * Called in the interrupt by Loop when it starts playing a layer,
+ * and by Window when it moves the window.
+ * Load the warm layers that are compressed or still in a project
+ * file, and compress the cold layers that aren't.
+ */
+PUBLIC void LayerCompressor::check(Layer* play, long frame)
+{
+    Layer* warm[COMPRESS_MAX_WARM];
+    long frames[COMPRESS_MAX_WARM];
+    int count = 0;
+
+    if (!Enabled)
+      return;
+
+    // the layers a Redo would bring back
+    Loop* loop = play->getLoop();
+    Layer* redo = (loop != NULL) ? loop->getRedoLayer() : NULL;
+    for (int i = 0 ; i < COMPRESS_WARM_LAYERS && redo != NULL ; i++) {
+        count = addWarm(warm, frames, count, redo, frame, 0);
+        redo = redo->getRedo();
+    }
+
+    Layer* layer = play;
+    for (int i = 0 ; i <= COMPRESS_WARM_LAYERS && layer != NULL ; i++) {
+        count = addWarm(warm, frames, count, layer, frame, 0);
+        layer = layer->getPrev();
+    }
+
+    // a window moving back reaches the layers behind the ones
+    // it is showing now
+    if (play->getWindowOffset() >= 0) {
+        for (Segment* seg = play->getSegments() ; seg != NULL ; 
+             seg = seg->getNext()) {
+            Layer* behind = (seg->getLayer() != NULL) ? 
+                seg->getLayer()->getPrev() : NULL;
+            for (int i = 0 ; i < COMPRESS_WARM_LAYERS && behind != NULL ; i++) {
+                count = addWarm(warm, frames, count, behind, 0, 0);
+                behind = behind->getPrev();
+            }
+        }
+    }
+
+    if (count < 0) {
+        // something very fragmented, wait until it is flattened
+        Trace(2, "LayerCompressor: Too many warm layers\n");
+    }
+    else {
+        for (int i = 0 ; i < count ; i++) {
+            Layer* l = warm[i];
+            if (l->getAudio()->getPendingBlocks() > 0 && !isPending(l))
+              request(l, COMPRESS_PREFETCH, frames[i]);
+        }
+
+        touch(play, warm, count);
+
+        bool full = false;
+        for ( ; layer != NULL && !full ; layer = layer->getPrev()) {
+            if (isCandidate(layer) && !isWarm(warm, count, layer) &&
+                !isPending(layer)) {
+                if (request(layer, COMPRESS_LAYER, 0)) {
+                    Trace(layer, 2, "LayerCompressor: Compressing layer %ld\n",
+                          (long)layer->getNumber());
+                }
+                else
+                  full = true;
+            }
+        }
+    }
+}
+
+/**
+ * Claim a request and wake up MobiusThread.
+ * Prefetch looks from the end where its reserved requests are so it
+ * leaves the others for compression, compression stops short of them.
+ * Returns false if they're all taken.
+ */
+PRIVATE bool LayerCompressor::request(Layer* layer, int type, long frame)
+{
+    CompressRequest* req = NULL;
+
+    if (type == COMPRESS_PREFETCH) {
+        for (int i = COMPRESS_MAX_REQUESTS - 1 ; i >= 0 && req == NULL ; i--) {
+            CompressRequest* r = &mRequests[i];
+            if (r->state == COMPRESS_FREE &&
+                AtomicCompareAndSwap(&r->state, COMPRESS_FREE, COMPRESS_CLAIMED))
+              req = r;
+        }
+    }
+    else {
+        int max = COMPRESS_MAX_REQUESTS - COMPRESS_PREFETCH_REQUESTS;
+        for (int i = 0 ; i < max && req == NULL ; i++) {
+            CompressRequest* r = &mRequests[i];
+            if (r->state == COMPRESS_FREE &&
+                AtomicCompareAndSwap(&r->state, COMPRESS_FREE, COMPRESS_CLAIMED))
+              req = r;
+        }
+    }
+
+    if (req == NULL) {
+        // compression waits for the next check, that's not an overflow
+        if (type == COMPRESS_PREFETCH) {
+            Trace(layer, 2, "LayerCompressor: No room to prefetch layer %ld\n",
+                  (long)layer->getNumber());
+            AtomicIncrement(&mOverflows);
+        }
+    }
+    else {
+        // keep it out of the pool until we're done
+        layer->incReferences();
+        req->type = type;
+        req->layer = layer;
+        req->generation = layer->getGeneration();
+        req->block = 0;
+        req->frame = frame;
+        req->audio = NULL;
+        req->source = NULL;
+        if (type == COMPRESS_LAYER)
+          AtomicIncrement(&mRequested);
+
+        // everything must be visible before the state
+        AtomicBarrier();
+        req->state = COMPRESS_REQUESTED;
+
+        MobiusThread* thread = mMobius->getThread();
+        if (thread != NULL)
+          thread->signal();
+    }
+
+    return (req != NULL);
+}
+
+/**
+ * Called at the start of every interrupt to install the finished
+ * requests.  This is only called from the interrupt thread.
+ * The Audio we replace, or the one we couldn't use, goes to the
+ * Reclaimer through AudioPool::freeAudio.
+ */
+PUBLIC void LayerCompressor::install()
+{
+    // a project save or LayerFlattener is reading the layers,
+    // leave them alone
+    if (mSuspended > 0 || mMobius->getLayerFlattener()->isPinned())
+      return;
+
+    mInstalls++;
+
+    for (int i = 0 ; i < COMPRESS_MAX_REQUESTS ; i++) {
+        CompressRequest* req = &mRequests[i];
+        if (req->state == COMPRESS_DONE) {
+            Layer* layer = req->layer;
+            Audio* audio = req->audio;
+
+            if (req->type == COMPRESS_PREFETCH) {
+                mPrefetched++;
+            }
+            else if (audio == NULL) {
+                // nothing worth compressing
+                mDiscarded++;
+            }
+            else if (layer->getReferences() <= 1 ||
+                     layer->getGeneration() != req->generation) {
+                // released or changed while we were working
+                mDiscarded++;
+                audio->getPool()->freeAudio(audio);
+            }
+            else {
+                req->source->share();
+                Audio* old = layer->swapFlattened(audio);
+                old->getPool()->freeAudio(old);
+                mInstalled++;
+                addCache(req);
+            }
+
+            // this may return it to the pool
+            layer->free();
+
+            req->layer = NULL;
+            req->audio = NULL;
+            req->source = NULL;
+            AtomicBarrier();
+            req->state = COMPRESS_FREE;
+        }
+    }
+
+    evict();
+}
+
+/****************************************************************************
+ *                                                                          *
+ *                                   CACHE                                  *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * Find the cache entry for a layer.
+ */
+PRIVATE CompressCache* LayerCompressor::getCache(Layer* layer)
+{
+    CompressCache* found = NULL;
+    for (int i = 0 ; i < COMPRESS_MAX_CACHED && found == NULL ; i++) {
+        if (mCache[i].layer == layer)
+          found = &mCache[i];
+    }
+    return found;
+}
+
+/**
+ * Called by check() with the warm layers of the loop that is
+ * playing a new layer.  Only entries for that loop are touched,
+ * another track may be checking its own loop at the same time.
+ */
+PRIVATE void LayerCompressor::touch(Layer* play, Layer** warm, int count)
+{
+    Loop* loop = play->getLoop();
+
+    for (int i = 0 ; i < COMPRESS_MAX_CACHED ; i++) {
+        CompressCache* cache = &mCache[i];
+        Layer* layer = cache->layer;
+        if (layer != NULL && layer->getLoop() == loop) {
+            cache->warm = isWarm(warm, count, layer);
+            if (cache->warm)
+              cache->used = mInstalls;
+        }
+    }
+}
+
+/**
+ * Remember a layer install() just gave compressed Audio.
+ */
+PRIVATE void LayerCompressor::addCache(CompressRequest* req)
+{
+    CompressCache* cache = getCache(NULL);
+    if (cache == NULL) {
+        // it stays compressed until played, then it's just a layer
+        mUntracked++;
+    }
+    else {
+        Layer* layer = req->layer;
+        Audio* audio = req->audio;
+        CompressedAudio* source = req->source;
+
+        layer->incReferences();
+        cache->layer = layer;
+        cache->audio = audio;
+        cache->source = source;
+        cache->generation = layer->getGeneration();
+        cache->blocks = source->getCodedBlocks() + source->getSharedBlocks();
+        cache->blockBytes = audio->getBlockFrames() * audio->getChannels() *
+            sizeof(float);
+        cache->warm = false;
+        cache->used = mInstalls;
+    }
+}
+
+/**
+ * Drop a cache entry, this may return the layer to the pool.
+ */
+PRIVATE void LayerCompressor::freeCache(CompressCache* cache)
+{
+    cache->layer->free();
+    cache->layer = NULL;
+    cache->audio = NULL;
+    cache->source = NULL;
+}
+
+/**
+ * Called by install() after the requests.  Drop the layers that
+ * were released or changed, add up what the rest have loaded, and
+ * if that is over the budget unload the cold layer that was warm
+ * longest ago.  Only one layer is unloaded each interrupt, returning
+ * buffers to the pool is quick but a long layer has many of them.
+ */
+PRIVATE void LayerCompressor::evict()
+{
+    CompressCache* victim = NULL;
+    long bytes = 0;
+
+    for (int i = 0 ; i < COMPRESS_MAX_CACHED ; i++) {
+        CompressCache* cache = &mCache[i];
+        Layer* layer = cache->layer;
+        if (layer == NULL) {
+            // empty
+        }
+        else if (layer->getReferences() <= 1 ||
+                 layer->getAudio() != cache->audio ||
+                 layer->getGeneration() != cache->generation) {
+            // released, or it isn't what we compressed any more
+            freeCache(cache);
+        }
+        else {
+            int loaded = cache->blocks - cache->audio->getPendingBlocks();
+            if (loaded > 0) {
+                bytes += loaded * cache->blockBytes;
+                if (!cache->warm && !isPending(layer) &&
+                    (victim == NULL || cache->used < victim->used))
+                  victim = cache;
+            }
+        }
+    }
+
+    if (victim != NULL && bytes > mCacheBudget) {
+        int unloaded = victim->audio->unloadSourceBlocks();
+        bytes -= unloaded * victim->blockBytes;
+        mEvicted++;
+        Trace(victim->layer, 2, "LayerCompressor: Evicted layer %ld %ld blocks\n",
+              (long)victim->layer->getNumber(), (long)unloaded);
+    }
+
+    mCacheBytes = bytes;
+}
+
+/**
+ * Called in the interrupt by ProjectSnapshot when it pins layers
+ * for a project save.  Requests wait in the DONE state until
+ * we're resumed.
+ */
+PUBLIC void LayerCompressor::suspend()
+{
+    mSuspended++;
+}
+
+PUBLIC void LayerCompressor::resume()
+{
+    if (mSuspended > 0)
+      mSuspended--;
+    else
+      Trace(1, "LayerCompressor: resume without suspend!\n");
+}
+
+/**
+ * Called by MobiusThread whenever it wakes up.
+ */
+PUBLIC void LayerCompressor::process()
+{
+    bool ready = (ClockTicksToMicros(GetClockTicks() - mLastBlock) >=
+                  (COMPRESS_BLOCK_MILLIS * 1000));
+
+    for (int i = 0 ; i < COMPRESS_MAX_REQUESTS ; i++) {
+        CompressRequest* req = &mRequests[i];
+        int state = req->state;
+        if (state == COMPRESS_REQUESTED && req->type == COMPRESS_PREFETCH) {
+            // these are needed soon, do them all at once
+            req->state = COMPRESS_WORKING;
+            prefetch(req);
+            AtomicBarrier();
+            req->state = COMPRESS_DONE;
+        }
+        else if ((state == COMPRESS_REQUESTED || state == COMPRESS_WORKING) &&
+                 ready) {
+            long long last = mLastBlock;
+            req->state = COMPRESS_WORKING;
+            if (compress(req)) {
+                AtomicBarrier();
+                req->state = COMPRESS_DONE;
+            }
+            // if it coded a block the rest wait
+            if (mLastBlock != last)
+              ready = false;
+        }
+    }
+}
+
+/**
+ * Code the next block of the layer's Audio, skipping over the
+ * silent and shared ones.  Returns true when the request is finished,
+ * with a new Audio that will decode it if there was anything worth
+ * coding.  If the generation changes we stop and throw away what
+ * we have.
+ */
+PRIVATE bool LayerCompressor::compress(CompressRequest* req)
+{
+    Layer* layer = req->layer;
+    Audio* audio = layer->getAudio();
+    AudioPool* pool = audio->getPool();
+    int channels = audio->getChannels();
+    long samples = audio->getBlockFrames() * channels;
+    int blocks = audio->getBlockCount();
+
+    if (layer->getGeneration() != req->generation) {
+        if (req->source != NULL) {
+            req->source->release();
+            req->source = NULL;
+        }
+        return true;
+    }
+
+    if (req->source == NULL) {
+        req->source = new CompressedAudio(this, audio);
+        req->block = 0;
+    }
+    CompressedAudio* source = req->source;
+
+    if (samples > mWorkSamples) {
+        delete mCopy;
+        delete mWork;
+        mCopy = new float[samples];
+        mWork = new unsigned char[CompressedAudio::getMaxEncodedSize(samples)];
+        mWorkSamples = samples;
+    }
+
+    bool coded = false;
+    while (req->block < blocks && !coded) {
+        int i = req->block++;
+        float* block = audio->getBlock(i, mCopy);
+        if (block == NULL) {
+            // missing buffer, silence
+        }
+        else if (block != mCopy && pool != NULL && pool->isShared(block)) {
+            source->setSharedBlock(i, block);
+        }
+        else {
+            bool zero = true;
+            for (long j = 0 ; j < samples && zero ; j++)
+              zero = (block[j] == 0.0f);
+
+            if (!zero) {
+                long long blockStart = GetClockTicks();
+                long bytes = CompressedAudio::encode(block, samples,
+                                                     channels, mWork);
+                unsigned char* data = new unsigned char[bytes + CODE_PAD];
+                memcpy(data, mWork, bytes + CODE_PAD);
+                source->setBlock(i, data, bytes);
+
+                mLastBlock = GetClockTicks();
+                mEncodeMicros += (int)ClockTicksToMicros(mLastBlock - blockStart);
+                coded = true;
+            }
+        }
+    }
+
+    if (req->block < blocks)
+      return false;
+
+    req->source = NULL;
+    int count = source->getCodedBlocks();
+
+    if (count == 0) {
+        // all shared or silent, leave it alone
+        source->release();
+    }
+    else {
+        Audio* compressed = (pool != NULL) ? pool->newAudio() : new Audio();
+        if (!compressed->setSource(source)) {
+            // setSource released it
+            delete compressed;
+        }
+        else {
+            req->audio = compressed;
+            req->source = source;
+
+            long size = source->getCompressedSize();
+            long long bytesIn = (long long)count * samples * sizeof(float);
+            mBytesIn += bytesIn;
+            mBytesOut += size;
+            mSharedBlocks += source->getSharedBlocks();
+
+            Trace(layer, 2, "LayerCompressor: Layer %ld %ld blocks to %ld bytes, ratio %ld%%\n",
+                  (long)layer->getNumber(), (long)count, size,
+                  (long)((bytesIn * 100) / ((size > 0) ? size : 1)));
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Load a warm layer before the interrupt needs it, starting at the
+ * play frame.  The Audio can't be replaced while we have the request, only
+ * install() does that and only for layers we're compressing.
+ */
+PRIVATE void LayerCompressor::prefetch(CompressRequest* req)
+{
+    Audio* audio = req->layer->getAudio();
+    if (audio != NULL) {
+        // the interrupt may decode a block of this layer while
+        // we're here, if so it's counted as ours
+        int decodes = mDecodes;
+        audio->loadPendingBlocks(req->frame, audio->getBlockCount());
+        mDecodesAhead += mDecodes - decodes;
+    }
+}
+
+/**
+ * Called by CompressedAudio whenever a block is decoded.
+ */
+PUBLIC void LayerCompressor::addDecode(int micros)
+{
+    AtomicIncrement(&mDecodes);
+    AtomicAdd(&mDecodeMicros, micros);
+
+    int max = mMaxDecodeMicros;
+    while (micros > max &&
+           !AtomicCompareAndSwap(&mMaxDecodeMicros, max, micros))
+      max = mMaxDecodeMicros;
+}
+
+/**
+ * Called during shutdown after MobiusThread and the interrupt
+ * have stopped, and before the pools are deleted.
+ */
+PUBLIC void LayerCompressor::flush()
+{
+    for (int i = 0 ; i < COMPRESS_MAX_CACHED ; i++) {
+        if (mCache[i].layer != NULL)
+          freeCache(&mCache[i]);
+    }
+    mCacheBytes = 0;
+
+    for (int i = 0 ; i < COMPRESS_MAX_REQUESTS ; i++) {
+        CompressRequest* req = &mRequests[i];
+        if (req->state != COMPRESS_FREE) {
+            // never installed so the source has no shared references,
+            // if there is an Audio it owns the source
+            if (req->audio != NULL)
+              delete req->audio;
+            else if (req->source != NULL)
+              req->source->release();
+            req->audio = NULL;
+            req->source = NULL;
+            if (req->layer != NULL) {
+                req->layer->free();
+                req->layer = NULL;
+            }
+            req->state = COMPRESS_FREE;
+        }
+    }
+}
+
+PUBLIC void LayerCompressor::dump()
+{
+    int ratio = (mBytesOut > 0) ? (int)((mBytesIn * 100) / mBytesOut) : 0;
+    int average = (mDecodes > 0) ? (mDecodeMicros / mDecodes) : 0;
+
+    printf("LayerCompressor: %d requested, %d installed, %d discarded, %d overflows, %d prefetched\n",
+           mRequested, mInstalled, mDiscarded, mOverflows, mPrefetched);
+    printf("LayerCompressor: %lld bytes to %lld, ratio %d.%02d, %d shared blocks, %d usec encoding\n",
+           mBytesIn, mBytesOut, ratio / 100, ratio % 100, mSharedBlocks,
+           mEncodeMicros);
+    printf("LayerCompressor: %d blocks decoded, %d ahead of the interrupt, average %d usec, max %d usec\n",
+           mDecodes, mDecodesAhead, average, mMaxDecodeMicros);
+    printf("LayerCompressor: %ld bytes loaded, budget %ld, %d evicted, %d untracked\n",
+           mCacheBytes, mCacheBudget, mEvicted, mUntracked);
+}
+
+/**
+ * True if MobiusThread has nothing left to code or load.
+ * Finished requests may still be waiting for install().
+ */
+PUBLIC bool LayerCompressor::isIdle()
+{
+    bool idle = true;
+    for (int i = 0 ; i < COMPRESS_MAX_REQUESTS && idle ; i++) {
+        int state = mRequests[i].state;
+        idle = (state == COMPRESS_FREE || state == COMPRESS_DONE);
+    }
+    return idle;
+}
+
+PUBLIC int LayerCompressor::getInstalled()
+{
+    return mInstalled;
+}
+
+PUBLIC int LayerCompressor::getPrefetched()
+{
+    return mPrefetched;
+}
+
+PUBLIC int LayerCompressor::getOverflows()
+{
+    return mOverflows;
+}
+
+PUBLIC int LayerCompressor::getDecodes()
+{
+    return mDecodes;
+}
+
+/**
+ * Blocks decoded by MobiusThread before the interrupt reached them.
+ */
+PUBLIC int LayerCompressor::getDecodesAhead()
+{
+    return mDecodesAhead;
+}
+
+PUBLIC int LayerCompressor::getEvicted()
+{
+    return mEvicted;
+}
+
+/****************************************************************************/
+/****************************************************************************/
+/****************************************************************************/
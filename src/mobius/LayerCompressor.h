@@ -0,0 +1,371 @@
+/*
+ * Copyright (c) 2010 Jeffrey S. Larson  <jeff@circularlabs.com>
+ * All rights reserved.
+ * See the LICENSE file for the full copyright and license declaration.
+ *
+ * ---------------------------------------------------------------------
+ *
+ * Background lossless compression of undo layers that are
+ * unlikely to be played soon.
+ *
+ */
+
+#ifndef LAYER_COMPRESSOR_H
+#define LAYER_COMPRESSOR_H
+
+#include "Audio.h"
+
+/****************************************************************************
+ *                                                                          *
+ *                                 CONSTANTS                                *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * The number of layers behind the play layer, and on the redo
+ * list, that are kept decompressed.  These are the ones a few Undos,
+ * Redos or a Window would reach, if one of them is still compressed
+ * it is decompressed in MobiusThread before we get there.  Everything
+ * further back is compressed.
+ */
+#define COMPRESS_WARM_LAYERS 2
+
+/**
+ * The maximum number of layers we collect while deciding which
+ * ones are warm, this includes the layers referenced by Segments.
+ * If there are more we don't compress anything this time.
+ */
+#define COMPRESS_MAX_WARM 32
+
+/**
+ * The maximum number of layers that may be waiting to be
+ * compressed or decompressed at once.
+ */
+#define COMPRESS_MAX_REQUESTS 8
+
+/**
+ * The number of requests at the end of the list only prefetch may
+ * use.  Compressing a layer takes a few seconds and is retried the
+ * next time around if there is no room, a warm layer has to start
+ * loading now.
+ */
+#define COMPRESS_PREFETCH_REQUESTS 4
+
+/**
+ * Default number of bytes of decompressed audio kept for layers
+ * that have gone cold again.  Above this the least recently warm
+ * layers give their buffers back and are decoded again if
+ * they are reached.
+ */
+#define COMPRESS_CACHE_BYTES (64 * 1024 * 1024)
+
+/**
+ * The maximum number of compressed layers we track for eviction.
+ * Layers installed when this is full stay compressed until they
+ * are played, after that they are ordinary layers.
+ */
+#define COMPRESS_MAX_CACHED 64
+
+/**
+ * MobiusThread codes one block at a time and waits at least this
+ * long before coding the next, there is no hurry.  A long layer
+ * takes a few seconds but the thread stays responsive and doesn't
+ * take the processor away from the interrupt for long on machines
+ * with few cores.
+ */
+#define COMPRESS_BLOCK_MILLIS 20
+
+/**
+ * Frames in one channel coded with the same method and
+ * Rice parameter.
+ */
+#define COMPRESS_GROUP_FRAMES 256
+
+/**
+ * Request types.
+ */
+#define COMPRESS_LAYER 0
+#define COMPRESS_PREFETCH 1
+
+/**
+ * States of a CompressRequest.
+ * The interrupt moves FREE to REQUESTED and DONE to FREE,
+ * MobiusThread moves REQUESTED to WORKING to DONE.  CLAIMED is
+ * transient, a large layer may stay WORKING for several passes.
+ */
+#define COMPRESS_FREE 0
+#define COMPRESS_CLAIMED 1
+#define COMPRESS_REQUESTED 2
+#define COMPRESS_WORKING 3
+#define COMPRESS_DONE 4
+
+/****************************************************************************
+ *                                                                          *
+ *                             COMPRESSED AUDIO                             *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * The compressed content of an Audio, given to a new Audio as its
+ * source so blocks are decompressed the first time they are touched.
+ *
+ * Each block is coded separately.  Buffers that were shared with
+ * another Audio aren't coded, we keep a reference to the buffer
+ * and copy it when the block is read, compressing them would
+ * use more memory not less.
+ */
+class CompressedAudio : public AudioSource {
+
+  public:
+
+    CompressedAudio(class LayerCompressor* c, Audio* src);
+    ~CompressedAudio();
+
+    void setBlock(int block, unsigned char* data, long size);
+    void setSharedBlock(int block, float* buffer);
+    void share();
+
+    long getCompressedSize();
+    int getCodedBlocks();
+    int getSharedBlocks();
+
+    // AudioSource
+    int getSampleRate();
+    int getChannels();
+    long getFrames();
+    long getBlockFrames();
+    int getBlockCount();
+    bool isZeroBlock(int block);
+    void readBlock(int block, float* dest);
+    void release();
+
+    // the codec
+    static long getMaxEncodedSize(long samples);
+    static long encode(float* src, long samples, int channels,
+                       unsigned char* dest);
+    static void decode(unsigned char* src, long samples, int channels,
+                       float* dest);
+
+  private:
+
+    class LayerCompressor* mCompressor;
+    class AudioPool* mPool;
+
+    int mSampleRate;
+    int mChannels;
+    long mFrames;
+    long mBlockFrames;
+    int mBlockCount;
+
+    /**
+     * Coded blocks, NULL if the block is silent or shared.
+     */
+    unsigned char** mData;
+    long* mSizes;
+
+    /**
+     * Blocks that were shared buffers.  The reference is taken
+     * in the interrupt by share() when the Audio is installed, if
+     * we're discarded before that mShareTaken is false and there
+     * is nothing to give back.
+     */
+    float** mShared;
+    bool mShareTaken;
+
+};
+
+/****************************************************************************
+ *                                                                          *
+ *                             COMPRESS REQUEST                             *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * One layer being compressed or decompressed.
+ * The layer has an extra reference while it is here.
+ */
+typedef struct {
+
+    volatile int state;
+
+    int type;
+
+    class Layer* layer;
+
+    /**
+     * Layer::getGeneration when the request was made, if it changes
+     * before we can install the result the result is discarded.
+     */
+    int generation;
+
+    /**
+     * The next block to code while WORKING.
+     */
+    int block;
+
+    /**
+     * For COMPRESS_PREFETCH, the play frame when the request was
+     * made.  Blocks are loaded from here on so the ones the interrupt
+     * will reach first are loaded first.
+     */
+    long frame;
+
+    /**
+     * The source being built while WORKING, and the Audio that
+     * owns it when DONE.
+     */
+    class Audio* audio;
+    class CompressedAudio* source;
+
+} CompressRequest;
+
+/**
+ * A layer we installed compressed Audio in.
+ * The layer has an extra reference while it is here.  Entries are
+ * added and removed only by install() in the interrupt, check()
+ * updates warm and used for the layers of the loop calling it.
+ */
+typedef struct {
+
+    class Layer* layer;
+
+    /**
+     * The Audio we installed and its source, if the layer has a
+     * different Audio now the entry is dropped.
+     */
+    class Audio* audio;
+    class CompressedAudio* source;
+
+    /**
+     * Layer::getGeneration when installed, if it changes the
+     * buffers may not match the source any more and we can't evict.
+     */
+    int generation;
+
+    /**
+     * Blocks that aren't silent, and the bytes in one of them.
+     */
+    int blocks;
+    long blockBytes;
+
+    /**
+     * True if the layer was warm the last time its loop was checked,
+     * and the install() count when it last was.
+     */
+    bool warm;
+    long used;
+
+} CompressCache;
+
+/****************************************************************************
+ *                                                                          *
+ *                             LAYER COMPRESSOR                             *
+ *                                                                          *
+ ****************************************************************************/
+
+class LayerCompressor {
+
+  public:
+
+    /**
+     * When false check() does nothing, for tests that compare
+     * against uncompressed layers.
+     */
+    static bool Enabled;
+
+    LayerCompressor(class Mobius* m);
+    ~LayerCompressor();
+
+    void setCacheBudget(long bytes);
+
+    // interrupt, called by Loop
+    void check(class Layer* play, long frame);
+
+    // interrupt, called by Mobius at the start of each interrupt
+    void install();
+
+    // interrupt, called by ProjectSnapshot while it holds layers
+    void suspend();
+    void resume();
+
+    // MobiusThread
+    void process();
+
+    // any thread, called by CompressedAudio
+    void addDecode(int micros);
+
+    // shutdown, after MobiusThread and the interrupt have stopped
+    void flush();
+
+    void dump();
+
+    // statistics for tests
+    bool isIdle();
+    int getInstalled();
+    int getPrefetched();
+    int getOverflows();
+    int getDecodes();
+    int getDecodesAhead();
+    int getEvicted();
+
+  private:
+
+    int addWarm(class Layer** warm, long* frames, int count,
+                class Layer* layer, long frame, int depth);
+    bool isWarm(class Layer** warm, int count, class Layer* layer);
+    bool isCandidate(class Layer* layer);
+    bool isPending(class Layer* layer);
+    bool request(class Layer* layer, int type, long frame);
+    bool compress(CompressRequest* req);
+    void prefetch(CompressRequest* req);
+    void touch(class Layer* play, class Layer** warm, int count);
+    CompressCache* getCache(class Layer* layer);
+    void addCache(CompressRequest* req);
+    void freeCache(CompressCache* cache);
+    void evict();
+
+    class Mobius* mMobius;
+
+    CompressRequest mRequests[COMPRESS_MAX_REQUESTS];
+
+    // compressed layers that may be evicted once decoded
+    CompressCache mCache[COMPRESS_MAX_CACHED];
+    long mCacheBudget;
+    long mCacheBytes;
+    long mInstalls;
+
+    // finished requests are held until this goes to zero
+    int mSuspended;
+
+    // when MobiusThread last coded a block
+    long long mLastBlock;
+
+    // MobiusThread's block sized work areas
+    float* mCopy;
+    unsigned char* mWork;
+    long mWorkSamples;
+
+    // statistics
+    int mRequested;
+    int mInstalled;
+    int mDiscarded;
+    // warm layers we couldn't prefetch
+    int mOverflows;
+    int mPrefetched;
+    int mEvicted;
+    int mUntracked;
+    int mSharedBlocks;
+    long long mBytesIn;
+    long long mBytesOut;
+    int mEncodeMicros;
+    volatile int mDecodes;
+    int mDecodesAhead;
+    volatile int mDecodeMicros;
+    volatile int mMaxDecodeMicros;
+
+};
+
+/****************************************************************************/
+/****************************************************************************/
+/****************************************************************************/
+#endif
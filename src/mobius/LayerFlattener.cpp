@@ -0,0 +1,350 @@
+/*
+ * Copyright (c) 2010 Jeffrey S. Larson  <jeff@circularlabs.com>
+ * All rights reserved.
+ * See the LICENSE file for the full copyright and license declaration.
+ *
+ * ---------------------------------------------------------------------
+ *
+ * Background flattening of layers with deep Segment chains.
+ *
+ * Normally a layer is flattened incrementally as the next layer is
+ * recorded, once a full pass has been made the backing layer is
+ * entirely in the local Audio and the Segments go away.  If we switch
+ * loops or retrigger in the middle of a layer the pass is never
+ * completed, the layer is shifted with its Segments and the next layer
+ * references it with more Segments.  Do this enough and playing a
+ * block has to descend through many layers, see the commentary at
+ * the top of Layer.cpp for why that hurts.
+ *
+ * Whenever a loop starts playing a different layer Loop calls check().
+ * If the layer has gotten too deep we give it an extra reference and
+ * queue a request for MobiusThread.  The thread makes a flat copy
+ * of the layer with Layer::flatten, the same thing Save Loop does.
+ * At the start of a later interrupt we swap the new Audio in and release
+ * the segments.  The old Audio goes back to MobiusThread to be deleted.
+ *
+ * The layers we flatten have been finalized and are no longer being
+ * recorded into, but the interrupt can still change their structure.
+ * Installing a flattened or compressed Audio replaces a layer's
+ * Audio and deletes its Segments, and the layer we're flattening
+ * may reach that layer through its own Segments.  So the structure
+ * is pinned for the length of the flatten, the same way ProjectSnapshot
+ * pins layers for a save.  A request isn't flattened until the
+ * interrupt has moved it to PINNED at the start of a block, and
+ * from then until it is DONE neither we nor LayerCompressor install
+ * anything.  Since the interrupt does the pinning there is no window
+ * where an install is half done when we start reading.
+ *
+ * The content can still change, mostly deferred fades applied when
+ * the next layer starts recording or after an undo.  Layer maintains
+ * a generation number that is incremented when that happens.  The copy
+ * takes content from every layer the Segments reach, so we compare
+ * the combined generation of all of them.  If it changed while we
+ * were flattening, the copy is thrown away and we try again.
+ *
+ * Layers with the noLayerFlattening preset option are left alone,
+ * their local Audio has only the new overdub and the runtime
+ * segment feedback is what they're asking for.
+ *
+ * The interrupt side may run on Recorder worker threads when
+ * parallelTracks is on, requests are claimed with a compare and swap.
+ *
+ */
+
+#include <stdio.h>
+#include <memory.h>
+
+#include "Util.h"
+#include "Trace.h"
+#include "Thread.h"
+
+#include "Audio.h"
+#include "Layer.h"
+#include "Mobius.h"
+#include "MobiusThread.h"
+
+#include "LayerFlattener.h"
+
+/****************************************************************************
+ *                                                                          *
+ *                              LAYER FLATTENER                             *
+ *                                                                          *
+ ****************************************************************************/
+
+PUBLIC LayerFlattener::LayerFlattener(Mobius* m)
+{
+    mMobius = m;
+    mRequested = 0;
+    mInstalled = 0;
+    mDiscarded = 0;
+    mOverflows = 0;
+    mSuspended = 0;
+
+    for (int i = 0 ; i < FLATTEN_MAX_REQUESTS ; i++) {
+        FlattenRequest* req = &mRequests[i];
+        req->state = FLATTEN_FREE;
+        req->layer = NULL;
+        req->generation = 0;
+        req->audio = NULL;
+    }
+}
+
+PUBLIC LayerFlattener::~LayerFlattener()
+{
+    flush();
+}
+
+/**
+ * Return true if the layer is already being flattened.
+ * Only the track that owns the layer will ask about it so
+ * we don't have to worry about two threads requesting the same one.
+ */
+PRIVATE bool LayerFlattener::isPending(Layer* layer)
+{
+    bool pending = false;
+    for (int i = 0 ; i < FLATTEN_MAX_REQUESTS && !pending ; i++) {
+        FlattenRequest* req = &mRequests[i];
+        int state = req->state;
+        pending = (state != FLATTEN_FREE && state != FLATTEN_CLAIMED &&
+                   state != FLATTEN_RETIRED && req->layer == layer);
+    }
+    return pending;
+}
+
+/**
+ * Called in the interrupt by Loop when it starts playing a layer.
+ */
+PUBLIC void LayerFlattener::check(Layer* layer)
+{
+    if (layer != NULL && layer->isFinalized() && !layer->isNoFlattening() &&
+        layer->getSegments() != NULL && !isPending(layer)) {
+
+        int segments = 0;
+        int depth = layer->getSegmentDepth(FLATTEN_MAX_DEPTH,
+                                           FLATTEN_MAX_SEGMENTS, &segments);
+
+        if (depth > FLATTEN_MAX_DEPTH || segments > FLATTEN_MAX_SEGMENTS) {
+            if (request(layer)) {
+                Trace(layer, 2, "LayerFlattener: Flattening layer %ld depth %ld segments %ld\n",
+                      (long)layer->getNumber(), (long)depth, (long)segments);
+            }
+        }
+    }
+}
+
+/**
+ * Claim a request and wake up MobiusThread.
+ */
+PRIVATE bool LayerFlattener::request(Layer* layer)
+{
+    FlattenRequest* req = NULL;
+
+    for (int i = 0 ; i < FLATTEN_MAX_REQUESTS && req == NULL ; i++) {
+        FlattenRequest* r = &mRequests[i];
+        if (r->state == FLATTEN_FREE &&
+            AtomicCompareAndSwap(&r->state, FLATTEN_FREE, FLATTEN_CLAIMED))
+          req = r;
+    }
+
+    if (req == NULL) {
+        AtomicIncrement(&mOverflows);
+    }
+    else {
+        // keep it out of the pool until we're done
+        layer->incReferences();
+        req->layer = layer;
+        req->generation = layer->getContentGeneration();
+        req->audio = NULL;
+        AtomicIncrement(&mRequested);
+
+        // everything must be visible before the state
+        AtomicBarrier();
+        req->state = FLATTEN_REQUESTED;
+
+        MobiusThread* thread = mMobius->getThread();
+        if (thread != NULL)
+          thread->signal();
+    }
+
+    return (req != NULL);
+}
+
+/**
+ * True if MobiusThread may be reading layers, nothing may replace
+ * the Audio or Segments of any layer until this goes false.
+ */
+PUBLIC bool LayerFlattener::isPinned()
+{
+    bool pinned = false;
+    for (int i = 0 ; i < FLATTEN_MAX_REQUESTS && !pinned ; i++) {
+        int state = mRequests[i].state;
+        pinned = (state == FLATTEN_PINNED || state == FLATTEN_WORKING);
+    }
+    return pinned;
+}
+
+/**
+ * Called at the start of every interrupt to install the finished
+ * requests, then pin the new ones.  This is only called from the
+ * interrupt thread.
+ *
+ * Finished requests wait while another one is pinned.  MobiusThread
+ * does them in order so it won't be long.
+ */
+PUBLIC void LayerFlattener::install()
+{
+    bool retired = false;
+    bool pinned = false;
+    int i;
+
+    // a project save is reading the layers, leave them alone
+    if (mSuspended > 0)
+      return;
+
+    for (i = 0 ; i < FLATTEN_MAX_REQUESTS ; i++) {
+        FlattenRequest* req = &mRequests[i];
+        if (req->state == FLATTEN_DONE && !isPinned()) {
+            Layer* layer = req->layer;
+            Audio* flat = req->audio;
+            Audio* old = flat;
+
+            if (flat == NULL) {
+                // couldn't flatten it, let Loop try again later
+                mDiscarded++;
+            }
+            else if (layer->getReferences() <= 1) {
+                // everyone else let go of it while we were working
+                mDiscarded++;
+            }
+            else if (layer->getContentGeneration() != req->generation) {
+                // changed while we were working, we'll be asked again
+                // when the loop next changes layers
+                Trace(layer, 2, "LayerFlattener: Layer %ld changed during flattening\n",
+                      (long)layer->getNumber());
+                mDiscarded++;
+            }
+            else {
+                old = layer->swapFlattened(flat);
+                mInstalled++;
+            }
+
+            // this may return it to the pool
+            layer->free();
+
+            req->layer = NULL;
+            req->audio = old;
+            AtomicBarrier();
+            req->state = FLATTEN_RETIRED;
+            retired = true;
+        }
+    }
+
+    // installs are over for this interrupt, it is safe to read
+    for (i = 0 ; i < FLATTEN_MAX_REQUESTS ; i++) {
+        FlattenRequest* req = &mRequests[i];
+        if (req->state == FLATTEN_REQUESTED) {
+            AtomicBarrier();
+            req->state = FLATTEN_PINNED;
+            pinned = true;
+        }
+    }
+
+    if (retired || pinned) {
+        MobiusThread* thread = mMobius->getThread();
+        if (thread != NULL)
+          thread->signal();
+    }
+}
+
+/**
+ * Called in the interrupt by ProjectSnapshot when it pins layers
+ * for a project save.  Installing a flattened Audio would delete
+ * the Segments and hand the old Audio to MobiusThread while
+ * the save is still reading them.  Requests continue to be flattened,
+ * they wait in the DONE state until we're resumed.
+ */
+PUBLIC void LayerFlattener::suspend()
+{
+    mSuspended++;
+}
+
+PUBLIC void LayerFlattener::resume()
+{
+    if (mSuspended > 0)
+      mSuspended--;
+    else
+      Trace(1, "LayerFlattener: resume without suspend!\n");
+}
+
+/**
+ * Called by MobiusThread whenever it wakes up.  Make flat copies
+ * of the requested layers and delete the Audio we no longer need.
+ */
+PUBLIC void LayerFlattener::process()
+{
+    for (int i = 0 ; i < FLATTEN_MAX_REQUESTS ; i++) {
+        FlattenRequest* req = &mRequests[i];
+        int state = req->state;
+        if (state == FLATTEN_PINNED) {
+            req->state = FLATTEN_WORKING;
+            flatten(req);
+            AtomicBarrier();
+            req->state = FLATTEN_DONE;
+        }
+        else if (state == FLATTEN_RETIRED) {
+            delete req->audio;
+            req->audio = NULL;
+            AtomicBarrier();
+            req->state = FLATTEN_FREE;
+        }
+    }
+}
+
+/**
+ * Make the flat copy.  If the generation has already changed
+ * don't bother.
+ */
+PRIVATE void LayerFlattener::flatten(FlattenRequest* req)
+{
+    Layer* layer = req->layer;
+
+    if (layer->getContentGeneration() == req->generation) {
+        long long start = GetClockTicks();
+
+        req->audio = layer->flatten();
+
+        Trace(2, "LayerFlattener: Flattened layer %ld, %ld frames in %ld usec\n",
+              (long)layer->getNumber(), layer->getFrames(),
+              (long)ClockTicksToMicros(GetClockTicks() - start));
+    }
+}
+
+/**
+ * Called during shutdown after MobiusThread and the interrupt
+ * have stopped, and before the pools are deleted.
+ */
+PUBLIC void LayerFlattener::flush()
+{
+    for (int i = 0 ; i < FLATTEN_MAX_REQUESTS ; i++) {
+        FlattenRequest* req = &mRequests[i];
+        if (req->state != FLATTEN_FREE) {
+            delete req->audio;
+            req->audio = NULL;
+            if (req->layer != NULL) {
+                req->layer->free();
+                req->layer = NULL;
+            }
+            req->state = FLATTEN_FREE;
+        }
+    }
+}
+
+PUBLIC void LayerFlattener::dump()
+{
+    printf("LayerFlattener: %d requested, %d installed, %d discarded, %d overflows\n",
+           mRequested, mInstalled, mDiscarded, mOverflows);
+}
+
+/****************************************************************************/
+/****************************************************************************/
+/****************************************************************************/
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2010 Jeffrey S. Larson  <jeff@circularlabs.com>
+ * All rights reserved.
+ * See the LICENSE file for the full copyright and license declaration.
+ *
+ * ---------------------------------------------------------------------
+ *
+ * Background flattening of layers with deep Segment chains.
+ *
+ */
+
+#ifndef LAYER_FLATTENER_H
+#define LAYER_FLATTENER_H
+
+/****************************************************************************
+ *                                                                          *
+ *                                 CONSTANTS                                *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * A layer is flattened when playing it would have to descend
+ * through more than this many layers.  A layer with no segments
+ * has a depth of 1, a record layer still copying from the play layer
+ * has a depth of 2.
+ */
+#define FLATTEN_MAX_DEPTH 3
+
+/**
+ * A layer is also flattened when playing it would have to visit
+ * more than this many segments at all levels.  Retriggering in the
+ * middle of a layer leaves one or two segments behind, insert and
+ * multiply can leave more.
+ */
+#define FLATTEN_MAX_SEGMENTS 8
+
+/**
+ * The maximum number of layers that may be waiting to be
+ * flattened at once.  If we run out we'll try again the next time
+ * the loop changes play layers.
+ */
+#define FLATTEN_MAX_REQUESTS 8
+
+/**
+ * States of a FlattenRequest.
+ * The interrupt moves FREE to REQUESTED, REQUESTED to PINNED at the
+ * start of the next interrupt, and DONE to RETIRED.  MobiusThread moves
+ * PINNED to DONE and RETIRED to FREE.  CLAIMED and WORKING are transient.
+ * While any request is PINNED or WORKING nothing replaces the Audio or
+ * Segments of a layer, see install.
+ */
+#define FLATTEN_FREE 0
+#define FLATTEN_CLAIMED 1
+#define FLATTEN_REQUESTED 2
+#define FLATTEN_PINNED 3
+#define FLATTEN_WORKING 4
+#define FLATTEN_DONE 5
+#define FLATTEN_RETIRED 6
+
+/****************************************************************************
+ *                                                                          *
+ *                              FLATTEN REQUEST                             *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * One layer being flattened.
+ * The layer has an extra reference while it is here so it can't be
+ * returned to the pool out from under MobiusThread.
+ */
+typedef struct {
+
+    volatile int state;
+
+    class Layer* layer;
+
+    /**
+     * Layer::getContentGeneration when the request was made, if it
+     * changes before we can install the result the result is discarded.
+     */
+    int generation;
+
+    /**
+     * The flattened Audio when DONE, the Audio to be deleted
+     * when RETIRED.
+     */
+    class Audio* audio;
+
+} FlattenRequest;
+
+/****************************************************************************
+ *                                                                          *
+ *                              LAYER FLATTENER                             *
+ *                                                                          *
+ ****************************************************************************/
+
+class LayerFlattener {
+
+  public:
+
+    LayerFlattener(class Mobius* m);
+    ~LayerFlattener();
+
+    // interrupt, called by Loop
+    void check(class Layer* layer);
+
+    // interrupt, called by Mobius at the start of each interrupt
+    void install();
+
+    // interrupt, called by ProjectSnapshot while it holds layers
+    void suspend();
+    void resume();
+
+    // interrupt, true while MobiusThread is reading pinned layers
+    bool isPinned();
+
+    // MobiusThread
+    void process();
+
+    // shutdown, after MobiusThread and the interrupt have stopped
+    void flush();
+
+    void dump();
+
+  private:
+
+    bool isPending(class Layer* layer);
+    bool request(class Layer* layer);
+    void flatten(FlattenRequest* req);
+
+    class Mobius* mMobius;
+
+    FlattenRequest mRequests[FLATTEN_MAX_REQUESTS];
+
+    // finished requests are held until this goes to zero
+    int mSuspended;
+
+    // statistics
+    int mRequested;
+    int mInstalled;
+    int mDiscarded;
+    int mOverflows;
+
+};
+
+/****************************************************************************/
+/****************************************************************************/
+/****************************************************************************/
+#endif
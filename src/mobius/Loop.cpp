@@ -52,6 +52,8 @@
 #include "EventManager.h"
 #include "Function.h"
 #include "Layer.h"
+#include "LayerCompressor.h"
+#include "LayerFlattener.h"
 #include "Mobius.h"
 #include "Mode.h"
 #include "Project.h"
@@ -162,6 +164,7 @@ PRIVATE void Loop::init(Mobius* m, Track* track,
     mPlay = NULL;
     mPrePlay = NULL;
 	mRedo = NULL;
+    mFlattenCheck = NULL;
 
 	mNumber = 0;
     mFrame = 0;
@@ -181,10 +184,11 @@ PRIVATE void Loop::init(Mobius* m, Track* track,
     mBeatLoop = false;
     mBeatCycle = false;
     mBeatSubCycle = false;
+    mBeatLoops = 0;
+    mBeatCycles = 0;
+    mBeatSubCycles = 0;
 	mBreak = false;
 
-	mState.init();
-
 	// since we're in Reset, this has to start here
 	setFrame(-(mInput->latency));
 }
@@ -893,10 +897,12 @@ PUBLIC long Loop::wrapFrame(long frame, long loopFrames)
  *                                                                          *
  ****************************************************************************/
 
-PUBLIC LoopState* Loop::getState()
+/**
+ * Called by Track when the interrupt publishes state.
+ */
+PUBLIC void Loop::getState(LoopState* s)
 {
-	refreshState(&mState);
-	return &mState;
+	refreshState(s);
 }
 
 
@@ -907,11 +913,8 @@ PUBLIC StreamState* Loop::getRestoreState()
 
 /**
  * Return a batch of state.  
- * This is intended to be called by applications periodically to
- * gather all the interesting state they might want to display.
- * Note that we are in the UI thread, so becareful of race conditions.
- * !! Actually, there are race conditions all over here, mRecord, 
- * and mRedo are all assumed to be stable.
+ * This is called at the end of an interrupt when Mobius publishes
+ * a StateSnapshot so mRecord and mRedo are stable.
  */
 PRIVATE void Loop::refreshState(LoopState* s)
 {
@@ -923,20 +926,22 @@ PRIVATE void Loop::refreshState(LoopState* s)
 	s->overdub = mOverdub;
 	s->mute = mMuteMode;
 
-	// these are set during buffer processing, and are cleared when
-	// the application requests them, avoid having to have a callback
-	// or asynchronous event
-	s->beatLoop = mBeatLoop;
+	// these are set during buffer processing and counted when we're
+	// published, a reader that skips a snapshot still sees the count
+	// change and sets the flags in its copy
+	if (mBeatLoop) mBeatLoops++;
+	if (mBeatCycle) mBeatCycles++;
+	if (mBeatSubCycle) mBeatSubCycles++;
 	mBeatLoop = false;
-	s->beatCycle = mBeatCycle;
 	mBeatCycle = false;
-	s->beatSubCycle = mBeatSubCycle;
 	mBeatSubCycle = false;
+	s->beatLoops = mBeatLoops;
+	s->beatCycles = mBeatCycles;
+	s->beatSubCycles = mBeatSubCycles;
 
 	// this will be zero while recording, may be interesting
 	// to return the true value but there is too much sensitive
 	// logic around this being zero to mean the initial record
-	// !race condition, assumes mRecord stable
 	s->frames = getFrames();
 
     s->windowOffset = -1;
@@ -965,7 +970,6 @@ PRIVATE void Loop::refreshState(LoopState* s)
     else
       s->historyFrames = 0;
 
-	// !! race condition, assumes mRecord stable
 	s->cycles = getCycles();
 
 	// The frame number should be the "realtime" frame that matches what
@@ -1344,6 +1348,20 @@ PUBLIC void Loop::play()
 	}
 
 	playLocal();
+
+    // when we start playing a different layer see if it has gotten
+    // too deep, it may not be finalized on the first block
+    if (mPlay != mFlattenCheck && mPlay != NULL && mPlay->isFinalized()) {
+        mFlattenCheck = mPlay;
+        LayerFlattener* flattener = mMobius->getLayerFlattener();
+        if (flattener != NULL)
+          flattener->check(mPlay);
+
+        // and if the undo layers behind it should be compressed
+        LayerCompressor* compressor = mMobius->getLayerCompressor();
+        if (compressor != NULL)
+          compressor->check(mPlay, mPlayFrame);
+    }
 }
 
 /**
@@ -2013,6 +2031,7 @@ PUBLIC void Loop::reset(Action* action)
 	mMuteMode = false;
 	mModeStartFrame = 0;
     mRestoreState.init();
+    mFlattenCheck = NULL;
 
 	// returning to Reset cancels Reverse, though you can arm it again
 	mInput->reset();
@@ -149,7 +149,7 @@ class Loop : public TraceContext {
     // Status
     //
 
-    class LoopState* getState();
+    void getState(class LoopState* s);
     class StreamState* getRestoreState();
 	void getSummary(class LoopSummary* s, bool active);
 	class MobiusMode* getMode();
@@ -355,6 +355,9 @@ class Loop : public TraceContext {
     class Layer* mPrePlay;
 	class Layer* mRedo;
 
+    // the last play layer we gave to LayerFlattener
+    class Layer* mFlattenCheck;
+
 	int mNumber;
     long mFrame;
 	long mPlayFrame;
@@ -383,7 +386,10 @@ class Loop : public TraceContext {
 	bool	mBeatCycle;
 	bool 	mBeatSubCycle;
 
-	LoopState mState;
+    // counts of the above for the published state
+    int     mBeatLoops;
+    int     mBeatCycles;
+    int     mBeatSubCycles;
 };
 
 /****************************************************************************/
@@ -509,6 +509,8 @@
 #define MSG_PARAM_WINDOW_EDGE_UNIT      2145
 #define MSG_PARAM_WINDOW_EDGE_AMOUNT    2146
 
+#define MSG_PARAM_RESAMPLE_QUALITY      2147
+
 //
 // Parameter value enumerations
 //
@@ -668,6 +670,11 @@
 #define MSG_VALUE_TRACK_UNIT_CYCLE      3142
 #define MSG_VALUE_TRACK_UNIT_LOOP       3143
 
+// ResampleQuality
+#define MSG_VALUE_RESAMPLE_LINEAR       3145
+#define MSG_VALUE_RESAMPLE_SINC8        3146
+#define MSG_VALUE_RESAMPLE_SINC32       3147
+
 // Booleans
 
 #define MSG_VALUE_BOOLEAN_FALSE			3998
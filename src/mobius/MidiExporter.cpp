@@ -53,6 +53,7 @@
 #include "Mobius.h"
 #include "Binding.h"
 #include "Export.h"
+#include "MobiusState.h"
 #include "MobiusConfig.h"
 
 #include "MidiExporter.h"
@@ -163,7 +164,8 @@ MidiExporter::~MidiExporter()
 
 /**
  * Here's where the magic happens.
- * Called from MobiusThread.
+ * Called from MobiusThread with the last state published by the
+ * interrupt, values kept in TrackState come from there.
  *
  * MidiInterface sucks!!
  *
@@ -177,7 +179,7 @@ MidiExporter::~MidiExporter()
  * events.
  * 
  */
-void MidiExporter::sendEvents()
+void MidiExporter::sendEvents(StateSnapshot* state)
 {
     MobiusConfig* config = mMobius->getConfiguration();
     if (config->isMidiExport() || config->isHostMidiExport()) {
@@ -190,7 +192,7 @@ void MidiExporter::sendEvents()
 
         for (Export* exp = mExports ; exp != NULL ; exp = exp->getNext()) {
 
-            int newValue = exp->getOrdinalValue();
+            int newValue = exp->getOrdinalValue(state);
 
             if (newValue >= 0) {
                 int last = exp->getLast();
@@ -39,7 +39,7 @@ class MidiExporter {
     void setHistory(MidiExporter* me);
     MidiExporter* getHistory();
 
-    void sendEvents();
+    void sendEvents(class StateSnapshot* state);
 
   private:
 
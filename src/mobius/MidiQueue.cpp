@@ -233,6 +233,9 @@ PUBLIC MidiQueue::MidiQueue()
 {
     // MidiState self initializes
 	mOverflows = 0;
+	mBlockTicks = 0;
+	mLastBlockTicks = 0;
+	mSampleRate = 0;
 	mHead = 0;
 	mTail = 0;
 	memset(&mEvents, 0, sizeof(mEvents));
@@ -269,6 +272,7 @@ PRIVATE void MidiQueue::add(MidiEvent* e)
 
 	mEvents[mHead].status = status;
 	mEvents[mHead].clock = e->getClock();
+	mEvents[mHead].ticks = GetClockTicks();
 	if (status == MS_SONGPOSITION)
 	  mEvents[mHead].songpos = e->getSongPosition();
 	else
@@ -295,6 +299,7 @@ PUBLIC void MidiQueue::add(int status, long clock)
 
 	mEvents[mHead].status = status;
 	mEvents[mHead].clock = clock;
+	mEvents[mHead].ticks = GetClockTicks();
 	mEvents[mHead].songpos = 0;
 	
 	if (next != mTail)
@@ -311,10 +316,19 @@ PUBLIC void MidiQueue::add(int status, long clock)
  * Called by Synchronizer at the beginning of a new audio interrupt.
  * Pass the current millisecond counter along to the MidiState so 
  * it can detect sudden clock stopages.
+ *
+ * The block ticks are remembered so getEvents can place the events
+ * that arrived during the last block at the same relative position
+ * in this one.  Zero leaves them all at the front of the buffer.
  */
-PUBLIC void MidiQueue::interruptStart(long millisecond)
+PUBLIC void MidiQueue::interruptStart(long millisecond, long long blockTicks,
+									  int sampleRate)
 {
 	mState.tick(millisecond);
+
+	mLastBlockTicks = mBlockTicks;
+	mBlockTicks = blockTicks;
+	mSampleRate = sampleRate;
 }
 
 /****************************************************************************
@@ -339,25 +353,28 @@ PUBLIC void MidiQueue::interruptStart(long millisecond)
  * a script might be expecting us to be started.  I really hope
  * this isn't important, if so we'll have to annotate the Events.
  *
- * !! We should try to offset these into the buffer based on when they
- * were received, but I think we need a finer resolution clock.  See
- * See Synchronizer::adjustEventFrame for an earlier attempt at this.
- * If we do adjust these we can only return ones that fit within
- * the given interruptFrames.  As it stands now, we process all of them
- * at the beginning of the buffer.
+ * Events are offset into the buffer by when they were received
+ * relative to the start of the previous block, see getEventOffset.
+ * This delays them by one block but the delay is constant, where
+ * putting them all at the front of the buffer gave us up to a block
+ * of jitter on every pulse.  Events that arrived after the current
+ * block started are left for the next interrupt.
  */
 PUBLIC Event* MidiQueue::getEvents(EventPool* pool, long interruptFrames)
 {
     Event* events = NULL;
     Event* lastEvent = NULL;
 
-    // in theory we should try to offset these into the buffer
-    // based on when they were received...need a finer resolution clock
-    long offset = 0;
-
 	while (mTail != mHead) {
 
 		MidiSyncEvent* e = &(mEvents[mTail]);
+
+		// this one belongs to the next block
+		if (mBlockTicks > 0 && e->ticks >= mBlockTicks)
+		  break;
+
+		int offset = getEventOffset(e, interruptFrames);
+
 		mTail++;
 		if (mTail >= MAX_SYNC_EVENTS)
 		  mTail = 0;
@@ -407,9 +424,8 @@ PUBLIC Event* MidiQueue::getEvents(EventPool* pool, long interruptFrames)
             newEvent->type = SyncEvent;
 			// squirell this away for trace debugging
             newEvent->fields.sync.millisecond = e->clock;
+            newEvent->frame = offset;
 
-            // TODO: set event->frame to buffer offset!1
-            
             if (lastEvent == NULL)
               events = newEvent;
             else
@@ -427,6 +443,38 @@ PUBLIC bool MidiQueue::hasEvents()
     return (mHead != mTail);
 }
 
+/**
+ * Calculate the buffer offset of an event from the time it was
+ * queued.  The distance from the start of the previous block is
+ * converted to frames.  If the interrupts were late the previous
+ * block will have taken longer than the nominal block time, in that
+ * case the events are scaled down to fit so they stay in order
+ * and within the buffer.
+ *
+ * See Synchronizer::adjustEventFrame for an earlier attempt at this
+ * with the millisecond timer.
+ */
+PRIVATE int MidiQueue::getEventOffset(MidiSyncEvent* e, long interruptFrames)
+{
+	int offset = 0;
+
+	if (mLastBlockTicks > 0 && mSampleRate > 0 && interruptFrames > 0 &&
+		e->ticks > mLastBlockTicks) {
+
+		long long period = mBlockTicks - mLastBlockTicks;
+		long long nominal = (interruptFrames * GetClockFrequency()) / mSampleRate;
+		if (period < nominal)
+		  period = nominal;
+
+		long long delta = e->ticks - mLastBlockTicks;
+		offset = (int)((delta * interruptFrames) / period);
+		if (offset >= interruptFrames)
+		  offset = interruptFrames - 1;
+	}
+
+	return offset;
+}
+
 /****************************************************************************/
 /****************************************************************************/
 /****************************************************************************/
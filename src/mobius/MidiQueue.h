@@ -43,6 +43,7 @@ class MidiSyncEvent {
 	int status;		// one of the MS_ constants (START, STOP, CLOCK, etc.)
 	int songpos;	// valid if MS_SONG_POSITION
 	long clock;		// millisecond timer clock
+	long long ticks;	// GetClockTicks when it was queued
 };
 
 /****************************************************************************
@@ -166,8 +167,11 @@ class MidiQueue {
 
 	/**
 	 * Prepare for an audio interrupt.
+	 * If blockTicks is non-zero it is the GetClockTicks time at the
+	 * start of the block and events will be given buffer offsets.
 	 */
-	void interruptStart(long millisecond);
+	void interruptStart(long millisecond, long long blockTicks, 
+						int sampleRate);
 
     /**
      * Convert the queued MidiSyncEvents into a list of Event
@@ -191,6 +195,14 @@ class MidiQueue {
 	// number of events we couldn't process
 	long mOverflows;
 
+	// clock ticks at the start of the current and previous blocks
+	// used to calculate event offsets
+	long long mBlockTicks;
+	long long mLastBlockTicks;
+	int mSampleRate;
+
+	int getEventOffset(MidiSyncEvent* e, long interruptFrames);
+
 	// counters incremented by the MIDI thread
 	int mHead;
 	int mTail;
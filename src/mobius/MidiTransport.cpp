@@ -499,7 +499,8 @@ PUBLIC void MidiTransport::interruptStart(long millisecond)
 {
     // remember for a few adjusments
     mInterruptMsec = millisecond;
-    mQueue.interruptStart(millisecond);
+    // clocks we send are left at the front of the buffer
+    mQueue.interruptStart(millisecond, 0, 0);
 }
 
 /**
@@ -19,6 +19,7 @@
 #include "Thread.h"
 #include "List.h"
 #include "MessageCatalog.h"
+#include "SymbolTable.h"
 
 #include "MidiByte.h"
 #include "MidiEvent.h"
@@ -33,6 +34,9 @@
 #include "Export.h"
 #include "Function.h"
 #include "HostConfig.h"
+#include "InterruptProfile.h"
+#include "LayerCompressor.h"
+#include "LayerFlattener.h"
 #include "Launchpad.h"
 #include "Layer.h"
 #include "Loop.h"
@@ -42,6 +46,8 @@
 #include "OscConfig.h"
 #include "Parameter.h"
 #include "Project.h"
+#include "ProjectSnapshot.h"
+#include "Reclaimer.h"
 #include "Sample.h"
 #include "Script.h"
 #include "Setup.h"
@@ -49,6 +55,7 @@
 #include "Track.h"
 #include "TriggerState.h"
 #include "UserVariable.h"
+#include "Variable.h"
 #include "WatchPoint.h"
 
 // temporary
@@ -283,16 +290,26 @@ PUBLIC Mobius::Mobius(MobiusContext* context)
 	mSampleTrack = NULL;
 	mVariables = new UserVariables();
     mFunctions = NULL;
+    mFunctionTable = NULL;
 	mScriptEnv = NULL;
 	mScripts = NULL;
-    mActions = NULL;
-    mLastAction = NULL;
+    mActionQueue = new ActionQueue();
+    mProfile = new InterruptProfile();
+    mProfileTicks = 0;
+    mFlattener = new LayerFlattener(this);
+    mCompressor = new LayerCompressor(this);
+    mReclaimer = new Reclaimer(this);
+    mLayerPool->setReclaimer(mReclaimer);
+    mAudioPool->setReclaimer(mReclaimer);
+    mSampleCache = new SampleCache(mAudioPool);
 	mInterruptStream = NULL;
 	mInterrupts = 0;
 	mCustomMode[0] = 0;
 	mPendingProject = NULL;
 	mPendingSamples = NULL;
 	mSaveProject = NULL;
+    mPendingSnapshot = NULL;
+    mSaveProgress = new ProjectProgress();
 	mAudio = NULL;
 	mCapturing = false;
 	mCaptureOffset = 0;
@@ -301,11 +318,18 @@ PUBLIC Mobius::Mobius(MobiusContext* context)
 	mNoExternalInput = false;
 	mCatalog = NULL;
     mWatchers = new Watchers();
-    mNewWatchers = new List();
+    mWatchDispatcher = NULL;
 
 	// need this to manage the action list
 	mCsect = new CriticalSection("Mobius");
 
+    // the publisher is created when we know how many tracks there are
+    mPublisher = NULL;
+    mStateCopy = NULL;
+    mExportState = NULL;
+    mStateCsect = new CriticalSection("MobiusState");
+    mStateBlocks = 0;
+
     // let's turn debug stream output on for now, what uses this??
     TraceToDebug = true;
     
@@ -313,6 +337,7 @@ PUBLIC Mobius::Mobius(MobiusContext* context)
     MobiusMode::initModes();
     Function::initStaticFunctions();
     Parameter::initParameters();
+    ScriptInternalVariable::initVariables();
 
 	parseCommandLine();
 
@@ -468,6 +493,10 @@ PUBLIC void Mobius::start()
 		mThread = new MobiusThread(this);
 		mThread->start();
 
+		// watch point listeners are called from here
+		mWatchDispatcher = new WatchDispatcher(mWatchers);
+		mWatchDispatcher->start();
+
 		// once the thread starts we can start queueing trace messages
 		if (!mContext->isDebugging())
 		  mThread->setTraceListener(true);
@@ -752,6 +781,11 @@ PRIVATE void Mobius::stop()
 		}
 	}
 
+	if (mWatchDispatcher != NULL && mWatchDispatcher->isRunning()) {
+		if (!mWatchDispatcher->stopAndWait())
+		  Trace(1, "Mobius: Unable to stop watch point dispatcher!\n");
+	}
+
 	// shutting down the Recorder will stop the timer which will send
 	// a final MIDI stop event if the timer has a MidiOutput port,
 	// not sure how necessary that is if we're being deleted, but
@@ -813,9 +847,29 @@ PUBLIC Mobius::~Mobius()
     // Assume mUIControls was set from a static array
     // and does not need to be freed.
 
+    // the listeners go with the watchers
+    if (mWatchDispatcher != NULL) {
+        mWatchDispatcher->dump();
+        delete mWatchDispatcher;
+    }
     delete mWatchers;
     delete mTriggerState;
+    // release the layers it is holding before the tracks go
+    mFlattener->dump();
+    delete mFlattener;
+    mCompressor->dump();
+    delete mCompressor;
+    delete mSaveProgress;
+    delete mPublisher;
+    delete mStateCopy;
+    delete mExportState;
+    delete mStateCsect;
 	delete mRecorder;	// will delete the Tracks too
+    // the players release their files
+    delete mPendingSamples;
+    mSampleCache->dump();
+    delete mSampleCache;
+    delete mProfile;
 	delete mThread;
 	delete mContext;
 	delete mConfig;
@@ -826,12 +880,21 @@ PUBLIC Mobius::~Mobius()
 	delete mOsc;
     delete mControlSurfaces;
     delete mFunctions;
+    delete mFunctionTable;
 	delete mScriptEnv;
 	delete mTracks;
 	delete mSynchronizer;
 	delete mCatalog;
     delete mVariables;
 
+    // reset the layers released by the tracks and the flattener,
+    // anything released after this is reset immediately
+    mLayerPool->setReclaimer(NULL);
+    mAudioPool->setReclaimer(NULL);
+    mReclaimer->flush();
+    mReclaimer->dump();
+    delete mReclaimer;
+
     // avoid a warning message
     for (ResolvedTarget* t = mResolvedTargets ; t != NULL ; t = t->getNext())
       t->setInterned(false);
@@ -839,6 +902,13 @@ PUBLIC Mobius::~Mobius()
 
 	flushObjectPools();
     
+    // anything left in the queue came from the pool
+    Action* queued = NULL;
+    while ((queued = mActionQueue->remove()) != NULL)
+      mActionPool->freeAction(queued);
+    mActionQueue->dump();
+    delete mActionQueue;
+
     mActionPool->dump();
     delete mActionPool;
 
@@ -1542,11 +1612,10 @@ PRIVATE void Mobius::installConfiguration(MobiusConfig* config, bool doBindings)
     SamplePack* newSamples = NULL;
 	Samples* samples = config->getSamples();
     if (samples != NULL) {
-        // only reload if there was a difference in order or files 
-        // we could be smarter and only reread things that are new
-        // but this isn't a commonly used features
+        // only rebuild if there was a difference, the cache
+        // rereads just the files that are new or changed
         if (mSampleTrack->isDifference(samples))
-          newSamples = new SamplePack(mAudioPool, getHomeDirectory(), samples);
+          newSamples = new SamplePack(mSampleCache, getHomeDirectory(), samples);
     }
     else {
         // in order to remove current samples we need a non-null
@@ -1606,6 +1675,10 @@ PRIVATE void Mobius::installConfiguration(MobiusConfig* config, bool doBindings)
     // a project?  Would need to coordinate this with MobiusThread
 	Audio::setWriteFormatPCM(config->isIntegerWaveFile());
 
+    // Recorder waits for the interrupt if it has to replace the workers
+    if (mRecorder != NULL)
+      mRecorder->setParallelTracks(config->getParallelTracks());
+
     // Open devices 
 	// Avoid messing with actual devices if we're in test mode
     // Recorder is smart to not open/close devices if nothing changed
@@ -1737,6 +1810,14 @@ PRIVATE void Mobius::buildTracks(int count)
         mTracks = tracks;
         mTrackCount = count;
         mTrack = tracks[0];
+
+        // interrupts haven't started so we can publish the initial
+        // state from here, the UI may ask for it before the first one
+        mStateCopy = new StateSnapshot();
+        mStateCopy->init(count);
+        StatePublisher* publisher = new StatePublisher(count);
+        mPublisher = publisher;
+        publishState();
     }
 }
 
@@ -1997,6 +2078,74 @@ PUBLIC EventPool* Mobius::getEventPool()
     return mEventPool;
 }
 
+/**
+ * Timing statistics for the audio interrupt.
+ * Also available in MobiusState.
+ */
+PUBLIC InterruptProfile* Mobius::getProfile()
+{
+    return mProfile;
+}
+
+/**
+ * Flattens layers with deep segment chains in MobiusThread.
+ */
+PUBLIC LayerFlattener* Mobius::getLayerFlattener()
+{
+    return mFlattener;
+}
+
+/**
+ * Compresses old undo layers in MobiusThread.
+ */
+PUBLIC LayerCompressor* Mobius::getLayerCompressor()
+{
+    return mCompressor;
+}
+
+/**
+ * Resets layers and deletes Audio released in the interrupt
+ * in MobiusThread.
+ */
+PUBLIC Reclaimer* Mobius::getReclaimer()
+{
+    return mReclaimer;
+}
+
+/**
+ * Threads we start give back their action cache when they end.
+ */
+PUBLIC ActionPool* Mobius::getActionPool()
+{
+    return mActionPool;
+}
+
+/**
+ * Deletes sample files released in the interrupt in MobiusThread.
+ */
+PUBLIC SampleCache* Mobius::getSampleCache()
+{
+    return mSampleCache;
+}
+
+/**
+ * Give a ProjectSnapshot to the next interrupt.
+ * Returns false if another one is still waiting.
+ */
+PUBLIC bool Mobius::postSnapshot(ProjectSnapshot* snap)
+{
+    return AtomicCompareAndSwapPointer(&mPendingSnapshot, NULL, snap);
+}
+
+/**
+ * Take back a ProjectSnapshot the interrupt hasn't gotten to.
+ * Returns false if the interrupt already has it.
+ */
+PUBLIC bool Mobius::cancelSnapshot(ProjectSnapshot* snap)
+{
+    return AtomicCompareAndSwapPointer(&mPendingSnapshot, snap, NULL);
+}
+
 /**
  * Return the list of all functions.
  * Should only be used by the binding UI.
@@ -2039,16 +2188,24 @@ PUBLIC MobiusMode* Mobius::getMode(const char* name)
 
 /**
  * Search the dynamic function list.
+ * The table has the hidden functions after the others.
  */
 PUBLIC Function* Mobius::getFunction(const char * name)
 {
-    Function* found = Function::getFunction(mFunctions, name);
+    Function* found = NULL;
+
+    SymbolTable* table = mFunctionTable;
+    if (table != NULL)
+      found = (Function*)table->get(name);
+    else {
+        found = Function::getFunction(mFunctions, name);
     
-    // one last try with hidden functions
-    // can't we just have a hidden flag for these rather than
-    // two arrays?
-    if (found == NULL)
-      found = Function::getFunction(HiddenFunctions, name);
+        // one last try with hidden functions
+        // can't we just have a hidden flag for these rather than
+        // two arrays?
+        if (found == NULL)
+          found = Function::getFunction(HiddenFunctions, name);
+    }
 
     return found;
 }
@@ -2114,9 +2271,28 @@ PRIVATE void Mobius::initFunctions()
     // pause for a moment?
 	delete old;
 
+    initFunctionTable();
+
 	updateGlobalFunctionPreferences();
 }
 
+/**
+ * Build the symbol table getFunction searches from the function list.
+ * Called whenever the list changes and after localization since that
+ * changes the display names.  Same caveats as initFunctions about
+ * someone still using the old one.
+ */
+PRIVATE void Mobius::initFunctionTable()
+{
+    SymbolTable* table = new SymbolTable();
+    Function::addSymbols(table, mFunctions);
+    Function::addSymbols(table, HiddenFunctions);
+
+    SymbolTable* old = mFunctionTable;
+    mFunctionTable = table;
+    delete old;
+}
+
 /**
  * Check the global configuration for functions that are
  * designated as obeying focus lock and track groups.
@@ -2340,31 +2516,16 @@ PRIVATE void Mobius::loadProjectInternal(Project* p)
 /**
  * Capture the state of the Mobius in a Project.
  * Tried to do this in the interupt handler, but if we have to flatten
- * layers it's too time consuming.  In theory we could have contention
- * with functions being applied while the save is in progress, but 
- * that would be rare.  
- * !! At least ensure that we won't crash.
- * 
- * Note that we're getting copies of Audio objects that are still
- * technically owned by the Layers.  As long as you save the project
- * before any radical change, like a Reset, it will be ok.  But if
- * you Reset or TrackReset and start recording a new loop before
- * the Project is saved, the Audio's that end up being saved may
- * not be what you started with.  
+ * layers it's too time consuming.
  *
- * The most important thing is that they remain valid heap objects, which
- * will be true since we always pool Layer objects.  So, while you
- * may get the wrong audio, you at least won't crash.  
+ * Instead the interrupt gives the layers we want to save an extra
+ * reference in a ProjectSnapshot, which is cheap, and we flatten
+ * them here with Project's worker threads.  A Reset or Undo
+ * while this is happening removes the layers from the loop but they
+ * won't go back to the pool until the snapshot is released.
  *
- * Providing an absolutely accurate snapshot requires that we make a copy
- * of all the Audio objects when building the Project, this may be
- * a very expensive operation which would cause us to miss interrupts.
- * 
- * So, we compromise and give you pointers to "live" objects that will
- * usuallly remain valid until the project is saved.  The only time
- * the objects would be modified is if you were running a script that
- * didn't wait for the save, or if you were using MIDI control at the
- * same time you were saving the project.  Both are unlikely and avoidable.
+ * The flattened Audio is owned by the Project, it is written later
+ * by Project::write.
  */
 PUBLIC Project* Mobius::saveProject()
 {
@@ -2378,7 +2539,23 @@ PUBLIC Project* Mobius::saveProject()
 	if (s != NULL)
 	  p->setSetup(s->getName());
 
-	p->setTracks(this);
+    ProjectSnapshot* snap = new ProjectSnapshot(this);
+    snap->capture();
+
+    // the pinned layers can lead through Segments to layers the
+    // interrupt is releasing, keep those out of the pool until we're done
+    int reader = mReclaimer->enter();
+
+    mSaveProgress->reset();
+    p->setProgress(mSaveProgress);
+	p->setTracks(this, snap);
+    p->flatten();
+
+    mReclaimer->leave(reader);
+
+    snap->release();
+    delete snap;
+
 	p->setFinished(true);
 
     return p;
@@ -2390,27 +2567,72 @@ PUBLIC Project* Mobius::saveProject()
  *                                                                          *
  ****************************************************************************/
 
+/**
+ * Return the state of the engine with the given track selected.
+ *
+ * Track and loop state comes from the last StateSnapshot published
+ * by the interrupt, copied into mStateCopy when there is a new one.
+ * Nothing here touches the live tracks so it can't see anything
+ * half changed or freed.  The UI timer and MobiusThread can both
+ * be in here, the csect keeps them from refreshing the copy at the
+ * same time, the interrupt never waits on it.
+ *
+ * The returned object is shared and changes on the next call.
+ */
 PUBLIC MobiusState* Mobius::getState(int track)
 {
 	MobiusState* s = &mState;
 
 	// don't like returning structures, can we return just the name?
     // it doesn't look like anyone uses this 
-	mState.bindings = mConfig->getOverlayBindingConfig();
+	s->bindings = mConfig->getOverlayBindingConfig();
 
-	// why not just keep it here?
-	strcpy(mState.customMode, mCustomMode);
+    s->profile = mProfile;
+	s->saveTotal = mSaveProgress->total;
+	s->saveDone = mSaveProgress->done;
+    s->track = NULL;
 
-	mState.globalRecording = mCapturing;
+    mStateCsect->enter("getState");
+    StatePublisher* publisher = mPublisher;
+    if (publisher != NULL) {
+        if (mStateCopy->version != publisher->getVersion())
+          publisher->read(mStateCopy);
 
-    if (track >= 0 && track < mTrackCount)
-	  mState.track = mTracks[track]->getState();
-	else {
-		// else, fake something up so the UI doesn't get a NULL pointer?
-		mState.track = NULL;
-	}
+        // beat flags are on for the first caller after they happen
+        mStateCopy->detectBeats();
 
-	return &mState;
+        strcpy(s->customMode, mStateCopy->customMode);
+        s->globalRecording = mStateCopy->globalRecording;
+        s->version = mStateCopy->version;
+        s->trackCount = mStateCopy->trackCount;
+        s->trackVersions = mStateCopy->trackVersions;
+
+        if (track >= 0 && track < mStateCopy->trackCount)
+          s->track = &(mStateCopy->tracks[track]);
+    }
+    mStateCsect->leave("getState");
+
+	return s;
+}
+
+/**
+ * Capture the state of every track into the next StateSnapshot.
+ * Called at the end of an interrupt, and once when the tracks
+ * are built before interrupts start.
+ */
+PRIVATE void Mobius::publishState()
+{
+    if (mPublisher != NULL) {
+        StateSnapshot* s = mPublisher->startPublish();
+
+        CopyString(mCustomMode, s->customMode, sizeof(s->customMode));
+        s->globalRecording = mCapturing;
+
+        for (int i = 0 ; i < mTrackCount ; i++)
+          mTracks[i]->getState(s->prepareTrack(i));
+
+        mPublisher->finishPublish();
+    }
 }
 
 PUBLIC int Mobius::getReportedInputLatency()
@@ -2483,10 +2705,14 @@ PUBLIC void Mobius::logStatus()
     mLayerPool->dump();
     mAudioPool->dump();
 
+    if (mOsc != NULL)
+      mOsc->dump();
+
     // this has never been used and looks confusing
     //dumpObjectPools();
 
     TraceBuffer* b = new TraceBuffer();
+    mProfile->dump(b);
 	for (int i = 0 ; i < mTrackCount ; i++) {
 		Track* t = mTracks[i];
 		t->dump(b);
@@ -3269,6 +3495,21 @@ PUBLIC Export* Mobius::resolveExport(ResolvedTarget* resolved)
  */
 PUBLIC void Mobius::exportStatus(bool inThread)
 {
+    // exporters read from their own copy of the last published
+    // state so they don't take beats from the UI, the Exports
+    // only look at tracks that changed since they last looked
+    StateSnapshot* state = NULL;
+    StatePublisher* publisher = mPublisher;
+    if (publisher != NULL) {
+        if (mExportState == NULL) {
+            mExportState = new StateSnapshot();
+            mExportState->init(mTrackCount);
+        }
+        if (mExportState->version == publisher->getVersion() ||
+            publisher->read(mExportState))
+          state = mExportState;
+    }
+
     // nab a copy to it doesn't change out from under us
     // maybe it would be better if MobiusThread managed it's own copy
     // and we just posted a new version 
@@ -3284,7 +3525,7 @@ PUBLIC void Mobius::exportStatus(bool inThread)
             }
         }
 
-        exporter->sendEvents();
+        exporter->sendEvents(state);
     }
 
 	// don't have a mechanism for editing these yet so we don't
@@ -3299,7 +3540,7 @@ PUBLIC void Mobius::exportStatus(bool inThread)
     // the thread starts running before we're fully initialized so
     // always check for null here
     if (mOsc != NULL)
-      mOsc->exportStatus();
+      mOsc->exportStatus(state);
 }
 
 /****************************************************************************
@@ -3313,6 +3554,9 @@ PUBLIC void Mobius::exportStatus(bool inThread)
  * The listener object becomes owned by Mobius and must not be deleted
  * by the caller.  If the caller no longer wants the listener it
  * must call the remove() method on the listener.
+ *
+ * The new listener array is published immediately, the interrupt
+ * never sees the listeners so there is nothing to transition.
  */
 PUBLIC WatchPoint* Mobius::addWatcher(WatchPointListener* l)
 {
@@ -3320,64 +3564,21 @@ PUBLIC WatchPoint* Mobius::addWatcher(WatchPointListener* l)
     WatchPoint* wp = WatchPoint::getWatchPoint(name);
     if (wp == NULL)
       Trace(1, "Invalid watch point name: %s\n", name);
-    else {
-        mCsect->enter("addWatchPoint");
-        mNewWatchers->add(l);
-        mCsect->leave();
-    }
+    else
+      mWatchers->add(wp, l);
     return wp;
 }
 
 /**
- * Called inside the interrupt to transition in new watch point listeners.
- */
-PRIVATE void Mobius::installWatchers()
-{
-    if (mNewWatchers->size() > 0) {
-        mCsect->enter("installWatcher");
-        // need to check the size again once we're in the csect
-        int max = mNewWatchers->size();
-        for (int i = 0 ; i < max ; i++) {
-            WatchPointListener* l = (WatchPointListener*)mNewWatchers->get(i);
-            // it won't have made it to the list if the name was bad
-            const char* name = l->getWatchPointName();
-            WatchPoint* wp = WatchPoint::getWatchPoint(name);
-            if (wp != NULL) {
-                List* list = wp->getListeners(mWatchers);
-                if (list != NULL) {
-                    Trace(2, "Adding watch point listener for %s\n",
-                          l->getWatchPointName());
-                    list->add(l);
-                }
-            }
-        }
-        mNewWatchers->reset();
-        mCsect->leave();
-    }
-}
-
-/**
- * Called internally to notify the watch point listeners.
- * This is IN THE INTERRUPT.
+ * Called internally when a watch point changes.
+ * This is IN THE INTERRUPT, or in a Recorder worker processing
+ * the track.  The change is queued and the listeners are called
+ * by the WatchDispatcher thread.
  */
-PUBLIC void Mobius::notifyWatchers(WatchPoint* wp, int value)
+PUBLIC void Mobius::notifyWatchers(WatchPoint* wp, int track, int value)
 {
-    List* listeners = wp->getListeners(mWatchers);
-    if (listeners != NULL) {
-        int max = listeners->size();
-        for (int i = 0 ; i < max ; i++) {
-            WatchPointListener* l = (WatchPointListener*)listeners->get(i);
-            // gc listeners marked removable
-            if (!l->isRemoving())
-              l->watchPointEvent(value);
-            else {
-                Trace(2, "Removing watch point listener for %s\n",
-                      l->getWatchPointName());
-                listeners->remove(i);
-                max--;
-            }
-        }
-    }
+    if (mWatchDispatcher != NULL && mWatchers->isWatched(wp))
+      mWatchDispatcher->add(wp, track, value);
 }
 
 /****************************************************************************
@@ -3391,15 +3592,12 @@ PUBLIC void Mobius::notifyWatchers(WatchPoint* wp, int value)
  * The caller is expected to fill this out and execute it with doAction.
  * If the caller doesn't want it they must call freeAction.
  * These are maintained in a pool that both the application threads
- * and the interrupt threads can access so have to use a Csect.
+ * and the interrupt threads can access, each thread allocates from
+ * its own cache in the pool without a Csect.
  */
 PUBLIC Action* Mobius::newAction()
 {
-    Action* action = NULL;
-
-    mCsect->enter("newAction");
-    action = mActionPool->newAction();
-    mCsect->leave("newAction");
+    Action* action = mActionPool->newAction();
 
     // always need this
     action->mobius = this;
@@ -3413,18 +3611,12 @@ PUBLIC void Mobius::freeAction(Action* a)
     if (a->isRegistered())
       Trace(1, "Freeing a registered action!\n");
 
-    mCsect->enter("newAction");
     mActionPool->freeAction(a);
-    mCsect->leave("newAction");
 }
 
 PUBLIC Action* Mobius::cloneAction(Action* src)
 {
-    Action* action = NULL;
-
-    mCsect->enter("cloneAction");
-    action = mActionPool->newAction(src);
-    mCsect->leave("cloneAction");
+    Action* action = mActionPool->newAction(src);
 
     // not always set if allocated outside
     action->mobius = this;
@@ -3566,16 +3758,12 @@ PUBLIC void Mobius::doAction(Action* a)
     }
     
     if (!ignore && defer) {
-        // pre 2.0 we used a ring buffer in Track for this that
-        // didn't require a csect, consider resurecting that?
-        // !! should have a maximum on this list?
-        mCsect->enter("doAction");
-        if (mLastAction == NULL)
-          mActions = a;
-        else 
-          mLastAction->setNext(a);
-        mLastAction = a;
-        mCsect->leave("doAction");
+        // pre 2.0 we used a ring buffer in Track for this, now it's
+        // a lock free queue shared by all the trigger threads
+        if (!mActionQueue->add(a)) {
+            Trace(1, "Mobius: Action queue overflow, ignoring action\n");
+            completeAction(a);
+        }
     }
     else if (!a->isRegistered()) {
         completeAction(a);
@@ -3584,21 +3772,17 @@ PUBLIC void Mobius::doAction(Action* a)
 }
 
 /**
- * Process the action list when we're inside the interrupt.
+ * Process the action queue when we're inside the interrupt.
+ * To keep a burst of actions from blowing the interrupt we only
+ * do MAX_INTERRUPT_ACTIONS at a time, the rest wait for the next one.
  */
 PRIVATE void Mobius::doInterruptActions()
 {
-    Action* actions = NULL;
-    Action* next = NULL;
-
-    mCsect->enter("doAction");
-    actions = mActions;
-    mActions = NULL;
-    mLastAction = NULL;
-    mCsect->leave("doAction");
+    Action* action = NULL;
+    int count = 0;
 
-    for (Action* action = actions ; action != NULL ; action = next) {
-        next = action->getNext();
+    while (count < MAX_INTERRUPT_ACTIONS &&
+           (action = mActionQueue->remove()) != NULL) {
 
         action->setNext(NULL);
         action->inInterrupt = true;
@@ -3606,7 +3790,11 @@ PRIVATE void Mobius::doInterruptActions()
         doActionNow(action);
 
         completeAction(action);
+        count++;
     }
+
+    if (count == MAX_INTERRUPT_ACTIONS)
+      Trace(2, "Mobius: Action budget exhausted, deferring to next interrupt\n");
 }
 
 /**
@@ -4921,7 +5109,11 @@ PUBLIC void Mobius::saveLoop(Action* action)
  */
 Audio* Mobius::getPlaybackAudio()
 {
+    // we don't have a reference to the play layer, if the interrupt
+    // releases it while we're flattening it stays out of the pool
+    int reader = mReclaimer->enter();
     Audio* audio = mTrack->getPlaybackAudio();
+    mReclaimer->leave(reader);
 
     // since this might be saved to a file make sure the
     // sample rate is correct
@@ -5477,6 +5669,21 @@ void Mobius::recorderMonitorEnter(AudioStream* stream)
 {
 	if (mHalting) return;
 
+    // nothing released from here on is reclaimed until we leave
+    mReclaimer->enterInterrupt();
+
+    // actions come from the interrupt's own cache, whatever thread this is
+    mActionPool->enterInterrupt();
+
+    // and buffers from the allocation ring
+    mAudioPool->enterInterrupt();
+
+    mProfile->startInterrupt(stream->getInterruptFrames(), 
+                             stream->getSampleRate());
+    mProfileTicks = 0;
+    long long ticks = mProfile->getInterruptStart();
+    long long now;
+
 	// this turns out to be useful for a few special testing
 	// operations eventually performed during track processing, so save it
 	// it also serves as the "in an interrupt" flag
@@ -5493,13 +5700,10 @@ void Mobius::recorderMonitorEnter(AudioStream* stream)
     if (mPendingInterruptConfig != NULL) {
         Trace(2, "Mobius: Installing interrupt MobiusConfig\n");
         // Have to maintain the old config on the history list because
-        // getState() needs to get information about the track preset and
-        // if we delete it now it could be at the exact moment that the
-        // UI thread is refreshing state.  The easiest way to prevent this
-        // is to keep a history but ideally we should be pushing status
-        // at the UI rather than having it poll us for it.
-        // The length of the history needs to be at least as long as the UI
-        // polling interval.  Once we start using ObjectPool we could free it
+        // the UI thread can still be looking at it through
+        // getInterruptConfiguration and getActiveSetup.  getState no
+        // longer needs it, track state is published in StateSnapshots.
+        // Once we start using ObjectPool we could free it
         // with a "keepalive" value of a second or more.
         mPendingInterruptConfig->setHistory(mInterruptConfig);
         mInterruptConfig = mPendingInterruptConfig;
@@ -5518,9 +5722,6 @@ void Mobius::recorderMonitorEnter(AudioStream* stream)
         return;
     }
 
-    // install new watchers
-    installWatchers();
-
     // change setups
     if (mPendingSetup >= 0) {
         setSetupInternal(mPendingSetup);
@@ -5541,6 +5742,17 @@ void Mobius::recorderMonitorEnter(AudioStream* stream)
 	if (p != NULL)
       loadProjectInternal(p);
 
+    // pin or release layers for a project save, this may suspend
+    // the flattener so do it first
+    ProjectSnapshot* snap = (ProjectSnapshot*)
+        AtomicExchangePointer(&mPendingSnapshot, NULL);
+    if (snap != NULL)
+      snap->interrupt();
+
+    // swap in layers flattened or compressed since the last interrupt
+    mFlattener->install();
+    mCompressor->install();
+
 	// Hack for testing, when this flag is set remove all external input
 	// and only pass through sample content.  Necessary for repeatable
 	// tests so we don't get random noise in the input.
@@ -5553,6 +5765,10 @@ void Mobius::recorderMonitorEnter(AudioStream* stream)
 		memset(input, 0, sizeof(float) * samples);
 	}
 
+    now = GetClockTicks();
+    mProfile->add(ProfileConfig, now - ticks);
+    ticks = now;
+
 	mSynchronizer->interruptStart(stream);
 
 	// prepare the tracks before running scripts
@@ -5562,15 +5778,31 @@ void Mobius::recorderMonitorEnter(AudioStream* stream)
 		t->prepareForInterrupt();
 	}
 
+    now = GetClockTicks();
+    mProfile->add(ProfileSyncStart, now - ticks);
+    ticks = now;
+
     // do the queued actions
     doInterruptActions();
 
+    now = GetClockTicks();
+    mProfile->add(ProfileActions, now - ticks);
+    ticks = now;
+
     // Advance the long-press tracker too, this may cause other 
     // actions to fire.
     mTriggerState->advance(this, stream->getInterruptFrames());
 
+    now = GetClockTicks();
+    mProfile->add(ProfileTriggers, now - ticks);
+    ticks = now;
+
 	// process scripts
     doScriptMaintenance();
+
+    // Recorder processes the tracks between here and recorderMonitorExit
+    mProfileTicks = GetClockTicks();
+    mProfile->add(ProfileScripts, mProfileTicks - ticks);
 }
 
 /**
@@ -5701,7 +5933,16 @@ PRIVATE void Mobius::propagateSetupGlobals(Setup* setup)
  */
 PUBLIC void Mobius::recorderMonitorExit(AudioStream* stream)
 {
-	if (mHalting) return;
+	if (mHalting) {
+        // we may have started the interrupt before halting
+        mActionPool->exitInterrupt();
+        mAudioPool->exitInterrupt();
+        return;
+    }
+
+    long long ticks = GetClockTicks();
+    if (mProfileTicks > 0)
+      mProfile->add(ProfileTracks, ticks - mProfileTicks);
 
 	long frames = stream->getInterruptFrames();
 	mSynchronizer->interruptEnd();
@@ -5750,11 +5991,47 @@ PUBLIC void Mobius::recorderMonitorExit(AudioStream* stream)
 		if (mTracks[i]->isUISignal())
 		  uiSignal = true;
 	}
+
+    // publish state every few interrupts, or now if the UI is
+    // about to be told to redraw
+    mStateBlocks++;
+    if (uiSignal || mStateBlocks >= STATE_PUBLISH_BLOCKS) {
+        publishState();
+        mStateBlocks = 0;
+    }
+
 	if (uiSignal)
 	  mThread->addEvent(TE_TIME_BOUNDARY);
 
     // turn off the "in an interrupt" flag
 	mInterruptStream = NULL;
+
+    // let MobiusThread reclaim what we released
+    mReclaimer->leaveInterrupt();
+
+    mActionPool->exitInterrupt();
+    mAudioPool->exitInterrupt();
+
+    mProfile->add(ProfileExit, GetClockTicks() - ticks);
+    mProfile->endInterrupt();
+}
+
+/**
+ * Called by a RecorderWorker before it first processes tracks.
+ * Tracks can allocate actions, the worker gets a cache of its own
+ * so it never waits for the shared one.  Buffers come from the 
+ * allocation ring like they do in the interrupt.
+ */
+PUBLIC void Mobius::recorderMonitorWorkerStart(int number)
+{
+    mActionPool->claimWorker(number);
+    mAudioPool->enterInterrupt();
+}
+
+PUBLIC void Mobius::recorderMonitorWorkerEnd(int number)
+{
+    mActionPool->threadEnding();
+    mAudioPool->exitInterrupt();
 }
 
 /**
@@ -5904,6 +6181,10 @@ PRIVATE void Mobius::localize()
 		Function::localizeAll(mCatalog);
         WatchPoint::localizeAll(mCatalog);
 
+        // display names are in the function table
+        if (mFunctions != NULL)
+          initFunctionTable();
+
         localizeUIControls();
 	}
 }
@@ -31,6 +31,18 @@
 #define UNIT_TEST_SETUP_NAME "Unit Test Setup"
 #define UNIT_TEST_PRESET_NAME "Unit Test Preset"
 
+/**
+ * Maximum number of queued actions processed in one interrupt.
+ */
+#define MAX_INTERRUPT_ACTIONS 32
+
+/**
+ * Number of interrupts between state snapshots for the UI.
+ * State is also published on any interrupt that crosses a
+ * beat or other boundary the UI needs to show right away.
+ */
+#define STATE_PUBLISH_BLOCKS 4
+
 /****************************************************************************
  *                                                                          *
  *                                   MOBIUS                                 *
@@ -54,6 +66,9 @@ class Mobius :
 	friend class EventManager;
     friend class Function;
     friend class Parameter;
+    friend class LayerFlattener;
+    friend class LayerCompressor;
+    friend class Reclaimer;
 
   public:
 
@@ -112,7 +127,7 @@ class Mobius :
 	void finishPrompt(Prompt* p);
 
     WatchPoint* addWatcher(class WatchPointListener* l);
-    void notifyWatchers(class WatchPoint* wp, int value);
+    void notifyWatchers(class WatchPoint* wp, int track, int value);
 
     // Status
 
@@ -156,6 +171,34 @@ class Mobius :
     class LayerPool* getLayerPool();
     class EventPool* getEventPool();
 
+    // Profiling
+
+    class InterruptProfile* getProfile();
+
+    // Background layer flattening
+
+    class LayerFlattener* getLayerFlattener();
+
+    // Background compression of old undo layers
+
+    class LayerCompressor* getLayerCompressor();
+
+    // Deferred freeing of layers released in the interrupt
+
+    class Reclaimer* getReclaimer();
+
+    // Actions cached for each thread
+
+    class ActionPool* getActionPool();
+
+    // Sample files shared between SamplePacks
+
+    class SampleCache* getSampleCache();
+
+    // Project save snapshots, see ProjectSnapshot
+    bool postSnapshot(class ProjectSnapshot* snap);
+    bool cancelSnapshot(class ProjectSnapshot* snap);
+
     //////////////////////////////////////////////////////////////////////
     //
     // Semi-protected methods for function invocation
@@ -189,6 +232,8 @@ class Mobius :
 	// RecorderMonitor interface
 	void recorderMonitorEnter(AudioStream* stream);
 	void recorderMonitorExit(AudioStream* stream);
+    void recorderMonitorWorkerStart(int number);
+    void recorderMonitorWorkerEnd(int number);
 
     // Object constants
 
@@ -291,7 +336,6 @@ class Mobius :
 
 	void stop();
     bool installScripts(class ScriptConfig* config, bool force);
-    void installWatchers();
 	void localize();
 	class MessageCatalog* readCatalog(const char* language);
     void localizeUIControls();
@@ -299,6 +343,7 @@ class Mobius :
     void propagateInterruptConfig();
     void propagateSetupGlobals(class Setup* setup);
     bool unitTestSetup(MobiusConfig* config);
+    void publishState();
 
     bool isFocused(class Track* t);
     bool isBindableDifference(Bindable* orig, Bindable* neu);
@@ -311,6 +356,7 @@ class Mobius :
     class OscConfig* loadOscConfiguration();
 	void updateControlSurfaces();
     void initFunctions();
+    void initFunctionTable();
     void initScriptParameters();
     void addScriptParameter(class ScriptParamStatement* s);
 	void initObjectPools();
@@ -358,7 +404,7 @@ class Mobius :
 	bool mLocalized;
 	MobiusListener* mListener;
     Watchers* mWatchers;
-    class List* mNewWatchers;
+    class WatchDispatcher* mWatchDispatcher;
     UIControl** mUIControls;
     UIParameter** mUIParameters;
 	char* mConfigFile;
@@ -386,10 +432,16 @@ class Mobius :
 	class UserVariables* mVariables;
 	class ScriptEnv* mScriptEnv;
     class Function** mFunctions;
+    class SymbolTable* mFunctionTable;
 	class ScriptInterpreter* mScripts;
     class Action* mRegisteredActions;
-    class Action *mActions;
-    class Action *mLastAction;
+    class ActionQueue* mActionQueue;
+    class InterruptProfile* mProfile;
+    class LayerFlattener* mFlattener;
+    class LayerCompressor* mCompressor;
+    class Reclaimer* mReclaimer;
+    class SampleCache* mSampleCache;
+    long long mProfileTicks;
 	bool mHalting;
 	bool mNoExternalInput;
 	AudioStream* mInterruptStream;
@@ -406,6 +458,13 @@ class Mobius :
 
 	// pending project to be saved
 	class Project* mSaveProject;
+
+    // ProjectSnapshot waiting for the interrupt, void so we
+    // can compare and swap it
+    void* volatile mPendingSnapshot;
+
+    // layers flattened and written by the last project save
+    class ProjectProgress* mSaveProgress;
 	
     // pending setup to switch to
     int mPendingSetup;
@@ -420,6 +479,14 @@ class Mobius :
 	
 	// state exposed to the outside world
 	MobiusState mState;
+
+    // snapshots published by the interrupt and the copy getState
+    // returns from, the csect is only used by the readers
+    class StatePublisher* mPublisher;
+    class StateSnapshot* mStateCopy;
+    class StateSnapshot* mExportState;
+    class CriticalSection* mStateCsect;
+    int mStateBlocks;
     MobiusAlerts mAlerts;
 
 };
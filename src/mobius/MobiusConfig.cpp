@@ -74,6 +74,7 @@
 #define EL_OSC_CONFIG "OscConfig"
 
 #define ATT_LOG_STATUS "logStatus"
+#define ATT_PARALLEL_TRACKS "parallelTracks"
 #define ATT_EDPISMS "edpisms"
 
 /****************************************************************************
@@ -218,6 +219,7 @@ PUBLIC void MobiusConfig::init()
 
     mNoSyncBeatRounding = false;
     mLogStatus = false;
+    mParallelTracks = 0;
 
     mEdpisms = false;
 }
@@ -949,6 +951,14 @@ PUBLIC bool MobiusConfig::isLogStatus() {
 	return mLogStatus;
 }
 
+PUBLIC void MobiusConfig::setParallelTracks(int i) {
+	mParallelTracks = i;
+}
+
+PUBLIC int MobiusConfig::getParallelTracks() {
+	return mParallelTracks;
+}
+
 PUBLIC void MobiusConfig::setEdpisms(bool b) {
 	mEdpisms = b;
 }
@@ -1594,6 +1604,7 @@ PUBLIC void MobiusConfig::parseXml(XmlElement* e)
     // this isn't a parameter yet
     setNoSyncBeatRounding(e->getBoolAttribute(ATT_NO_SYNC_BEAT_ROUNDING));
     setLogStatus(e->getBoolAttribute(ATT_LOG_STATUS));
+    setParallelTracks(e->getIntAttribute(ATT_PARALLEL_TRACKS));
 
     // not an official parameter yet
     setEdpisms(e->getBoolAttribute(ATT_EDPISMS));
@@ -1753,6 +1764,7 @@ PUBLIC void MobiusConfig::toXml(XmlBuffer* b)
 
     b->addAttribute(ATT_NO_SYNC_BEAT_ROUNDING, mNoSyncBeatRounding);
     b->addAttribute(ATT_LOG_STATUS, mLogStatus);
+    b->addAttribute(ATT_PARALLEL_TRACKS, mParallelTracks);
 
 	b->addAttribute(OscInputPortParameter->getName(), mOscInputPort);
 	b->addAttribute(OscOutputPortParameter->getName(), mOscOutputPort);
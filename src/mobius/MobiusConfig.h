@@ -523,6 +523,9 @@ class MobiusConfig {
     void setLogStatus(bool b);
     bool isLogStatus();
 
+    void setParallelTracks(int i);
+    int getParallelTracks();
+
     void setEdpisms(bool b);
     bool isEdpisms();
 
@@ -830,6 +833,13 @@ class MobiusConfig {
      */
     bool mLogStatus;
 
+    /**
+     * Number of worker threads used to process independent tracks
+     * in parallel during the audio interrupt.  Zero processes all 
+     * tracks in the interrupt thread.  Experimental and not exposed.
+     */
+    int mParallelTracks;
+
     /**
      * Enable a few EDPisms:
      *  Mute+Multiply = Realign
@@ -625,8 +625,9 @@ class MobiusInterface {
      * was successful and the listener must not be deleted.  Mobius
      * owns the WatchPointListener and it will be deleted when Mobius
      * desctructs.  If you no longer need the listener, call 
-     * WatchPointListener::remove() and it will be deactivated and
-     * reclaimed on the next audio interrupt.
+     * WatchPointListener::remove() and it will be deactivated the
+     * next time the watch point changes.  Listeners are called by
+     * a Mobius thread, never in the audio interrupt.
      */
     virtual class WatchPoint* addWatcher(class WatchPointListener* listener) = 0;
 
@@ -6,7 +6,8 @@
  * ---------------------------------------------------------------------
  * 
  * ObjectPool extensions for Mobius objects.
- * This has never been used.
+ * The Event pool has never been used, the AudioPool sample buffers
+ * are maintained here.
  *
  */
 
@@ -16,6 +17,7 @@
 #include "Util.h"
 #include "ObjectPool.h"
 
+#include "Audio.h"
 #include "Event.h"
 #include "Mobius.h"
 
@@ -59,6 +61,12 @@ PUBLIC void EventObjectPool::prepareObject(PooledObject* obj)
  *                                                                          *
  ****************************************************************************/
 
+/**
+ * Number of audio buffers to keep zeroed and ready for the interrupt.
+ * At 64K frames each this is about 16MB.
+ */
+#define MOBIUS_AUDIO_POOL_BUFFERS 32
+
 PUBLIC void Mobius::initObjectPools()
 {
 	// !! Tried to use a singleton, but if we leave the pool thread
@@ -69,6 +77,12 @@ PUBLIC void Mobius::initObjectPools()
 		Trace(this, 2, "Creating object pools\n");
 		mPools = new ObjectPoolManager();
 		mPools->add(new EventObjectPool());
+
+        // fill the audio buffer ring before the interrupt starts,
+        // then let the pool thread keep it full
+        mAudioPool->init(MOBIUS_AUDIO_POOL_BUFFERS);
+        mPools->add(mAudioPool->getSamplePool());
+        mPools->startThread();
 	}
 }
 
@@ -78,6 +92,12 @@ PUBLIC void Mobius::flushObjectPools()
 		Trace(this, 2, "Flushing object pools\n");
         // we've never used this and tracing looks confusing
 		//mPools->dump();
+
+        // the AudioPool owns its sample pool, it must be
+        // detached after the thread stops
+        if (mPools->stopThread())
+          mPools->remove(mAudioPool->getSamplePool());
+
 		delete mPools;
 		mPools = NULL;
 	}
@@ -12,6 +12,9 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "Thread.h"
+#include "Trace.h"
+
 #include "Mode.h"
 #include "MobiusState.h"
 
@@ -41,8 +44,30 @@ void MobiusState::init()
 	globalRecording = false;
 	strcpy(customMode, "");
 	track = NULL;
+	profile = NULL;
+	saveTotal = 0;
+	saveDone = 0;
+	version = 0;
+	trackCount = 0;
+	trackVersions = NULL;
 };
 
+unsigned int MobiusState::getChanges(long since)
+{
+	unsigned int changes = 0;
+	for (int i = 0 ; i < trackCount ; i++) {
+		if (trackVersions[i] > since)
+		  changes |= getChangeBit(i);
+	}
+	return changes;
+}
+
+unsigned int MobiusState::getChangeBit(int track)
+{
+	int bit = (track < STATE_CHANGE_BITS) ? track : STATE_CHANGE_BITS - 1;
+	return (1 << bit);
+}
+
 /****************************************************************************
  *                                                                          *
  *   							 TRACK STATE                                *
@@ -149,8 +174,248 @@ void LoopState::init()
 	beatLoop = false;
 	beatCycle = false;
 	beatSubCycle = false;
+	beatLoops = 0;
+	beatCycles = 0;
+	beatSubCycles = 0;
 };
 
+/****************************************************************************
+ *                                                                          *
+ *                              STATE SNAPSHOT                              *
+ *                                                                          *
+ ****************************************************************************/
+
+StateSnapshot::StateSnapshot()
+{
+	version = 0;
+	trackVersions = NULL;
+	trackCount = 0;
+	tracks = NULL;
+	loops = NULL;
+	names = NULL;
+	strcpy(customMode, "");
+	globalRecording = false;
+	mBeats = NULL;
+}
+
+StateSnapshot::~StateSnapshot()
+{
+	delete[] trackVersions;
+	delete[] tracks;
+	delete[] loops;
+	delete[] names;
+	delete[] mBeats;
+}
+
+/**
+ * Allocate the arrays, this is done once when the tracks are built.
+ */
+void StateSnapshot::init(int count)
+{
+	trackCount = count;
+	trackVersions = new long[count];
+	tracks = new TrackState[count];
+	loops = new LoopState[count];
+	names = new char[count * STATE_MAX_NAME];
+	mBeats = new int[count * 3];
+
+	for (int i = 0 ; i < count ; i++) {
+		trackVersions[i] = 0;
+		prepareTrack(i);
+	}
+	memset(mBeats, 0, count * 3 * sizeof(int));
+}
+
+/**
+ * Point the TrackStates at our loop and name arrays.
+ */
+void StateSnapshot::link()
+{
+	for (int i = 0 ; i < trackCount ; i++) {
+		tracks[i].loop = &loops[i];
+		tracks[i].name = &names[i * STATE_MAX_NAME];
+	}
+}
+
+/**
+ * Clear the state for one track before the interrupt fills it in.
+ * Everything is zeroed including the unused parts of the event and
+ * layer arrays so isTrackEqual can compare the memory.
+ */
+TrackState* StateSnapshot::prepareTrack(int track)
+{
+	TrackState* t = &tracks[track];
+	LoopState* l = &loops[track];
+
+	memset(t, 0, sizeof(TrackState));
+	t->init();
+	memset(l, 0, sizeof(LoopState));
+	l->init();
+	names[track * STATE_MAX_NAME] = 0;
+
+	t->loop = l;
+	t->name = &names[track * STATE_MAX_NAME];
+	return t;
+}
+
+/**
+ * Copy another snapshot with the same number of tracks.
+ */
+void StateSnapshot::copy(StateSnapshot* src)
+{
+	if (src->trackCount != trackCount) {
+		Trace(1, "StateSnapshot: Track count mismatch\n");
+	}
+	else {
+		version = src->version;
+		memcpy(trackVersions, src->trackVersions, trackCount * sizeof(long));
+		memcpy(tracks, src->tracks, trackCount * sizeof(TrackState));
+		memcpy(loops, src->loops, trackCount * sizeof(LoopState));
+		memcpy(names, src->names, trackCount * STATE_MAX_NAME);
+		memcpy(customMode, src->customMode, sizeof(customMode));
+		globalRecording = src->globalRecording;
+		link();
+	}
+}
+
+/**
+ * True if the state of a track is the same as another snapshot.
+ * The loop and name pointers always differ so compare copies
+ * without them.
+ */
+bool StateSnapshot::isTrackEqual(int track, StateSnapshot* other)
+{
+	TrackState t1;
+	TrackState t2;
+
+	memcpy(&t1, &tracks[track], sizeof(TrackState));
+	memcpy(&t2, &other->tracks[track], sizeof(TrackState));
+	t1.loop = NULL;
+	t1.name = NULL;
+	t2.loop = NULL;
+	t2.name = NULL;
+
+	return (!memcmp(&t1, &t2, sizeof(TrackState)) &&
+			!memcmp(&loops[track], &other->loops[track], sizeof(LoopState)) &&
+			!strcmp(&names[track * STATE_MAX_NAME], 
+					&other->names[track * STATE_MAX_NAME]));
+}
+
+/**
+ * Set the beat flags for the loops whose beat counts changed since
+ * the last time this was called.  Only meaningful for a reader's copy.
+ */
+void StateSnapshot::detectBeats()
+{
+	for (int i = 0 ; i < trackCount ; i++) {
+		LoopState* l = &loops[i];
+		int* last = &mBeats[i * 3];
+
+		l->beatLoop = (l->beatLoops != last[0]);
+		l->beatCycle = (l->beatCycles != last[1]);
+		l->beatSubCycle = (l->beatSubCycles != last[2]);
+
+		last[0] = l->beatLoops;
+		last[1] = l->beatCycles;
+		last[2] = l->beatSubCycles;
+	}
+}
+
+/****************************************************************************
+ *                                                                          *
+ *                              STATE PUBLISHER                             *
+ *                                                                          *
+ ****************************************************************************/
+
+StatePublisher::StatePublisher(int tracks)
+{
+	for (int i = 0 ; i < 3 ; i++) {
+		mSlots[i].init(tracks);
+		mSequence[i] = 0;
+	}
+	mPublished = -1;
+	mVersion = 0;
+	mWriting = 0;
+}
+
+StatePublisher::~StatePublisher()
+{
+}
+
+/**
+ * Called by the interrupt to get the slot to fill.
+ */
+StateSnapshot* StatePublisher::startPublish()
+{
+	mWriting = (mPublished < 0) ? 0 : ((mPublished + 1) % 3);
+	mSequence[mWriting]++;
+	AtomicBarrier();
+	return &mSlots[mWriting];
+}
+
+/**
+ * Called by the interrupt when the slot has been filled.
+ * Compare each track with the last snapshot to find the ones
+ * that changed, then make this one the newest.
+ */
+void StatePublisher::finishPublish()
+{
+	StateSnapshot* slot = &mSlots[mWriting];
+	StateSnapshot* last = (mPublished < 0) ? NULL : &mSlots[mPublished];
+	long version = mVersion + 1;
+
+	slot->version = version;
+	for (int i = 0 ; i < slot->trackCount ; i++) {
+		if (last != NULL && slot->isTrackEqual(i, last))
+		  slot->trackVersions[i] = last->trackVersions[i];
+		else
+		  slot->trackVersions[i] = version;
+	}
+
+	AtomicBarrier();
+	mSequence[mWriting]++;
+	AtomicBarrier();
+	mPublished = mWriting;
+	mVersion = version;
+}
+
+/**
+ * Version of the newest snapshot, zero if nothing has been published.
+ */
+long StatePublisher::getVersion()
+{
+	return mVersion;
+}
+
+/**
+ * Copy the newest snapshot.  Returns false if nothing has been
+ * published yet, or in the unlikely event that we couldn't get a
+ * consistent copy after several tries.
+ */
+bool StatePublisher::read(StateSnapshot* dest)
+{
+	bool consistent = false;
+
+	for (int i = 0 ; i < 10 && !consistent ; i++) {
+		int index = mPublished;
+		if (index < 0)
+		  break;
+
+		int sequence = mSequence[index];
+		AtomicBarrier();
+		if ((sequence & 1) == 0) {
+			dest->copy(&mSlots[index]);
+			AtomicBarrier();
+			consistent = (mSequence[index] == sequence);
+		}
+	}
+
+	if (!consistent && mPublished >= 0)
+	  Trace(1, "StatePublisher: Unable to read a consistent snapshot\n");
+
+	return consistent;
+}
+
 /****************************************************************************/
 /****************************************************************************/
 /****************************************************************************/
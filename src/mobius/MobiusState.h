@@ -117,6 +117,12 @@ class LoopState {
 	bool	beatCycle;
 	bool 	beatSubCycle;
 
+    // running counts of the beats above, these are what is published,
+    // the flags are set by the reader when a count changes
+    int     beatLoops;
+    int     beatCycles;
+    int     beatSubCycles;
+
     long    windowOffset;
     long    historyFrames;
 };
@@ -278,6 +284,143 @@ class MobiusState {
 	 */
 	TrackState* track;
 
+	/**
+	 * Interrupt timing histograms.  This is live, the counters
+	 * change as you look at them.
+	 */
+	class InterruptProfile* profile;
+
+	/**
+	 * Progress of the last project save, the number of layers
+	 * flattened and written out of the total.  A save is in
+	 * progress while saveDone is less than saveTotal.
+	 */
+	int saveTotal;
+	int saveDone;
+
+	/**
+	 * Version of the published snapshot this state came from.
+	 * Save it and pass it to getChanges on the next call to
+	 * find the tracks that need refreshing.
+	 */
+	long version;
+
+	/**
+	 * Bit mask of tracks whose state changed after the given version.
+	 */
+	unsigned int getChanges(long since);
+
+	/**
+	 * The bit for a track in the change mask.
+	 */
+	unsigned int getChangeBit(int track);
+
+	/**
+	 * Set by Mobius, the version each track last changed in.
+	 */
+	int trackCount;
+	long* trackVersions;
+
+};
+
+/****************************************************************************
+ *                                                                          *
+ *                              STATE SNAPSHOT                              *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * Number of tracks with their own bit in the change mask,
+ * tracks beyond this share the last bit.
+ */
+#define STATE_CHANGE_BITS 32
+
+/**
+ * Maximum length of a track name in a snapshot, same as Track.
+ */
+#define STATE_MAX_NAME 128
+
+/**
+ * A copy of the state of every track, published by the interrupt
+ * at the end of a block.  The TrackStates point into the arrays
+ * owned by the snapshot so it can be copied and read without
+ * touching anything in the engine.
+ */
+class StateSnapshot {
+
+  public:
+
+	StateSnapshot();
+	~StateSnapshot();
+
+	void init(int tracks);
+	void copy(StateSnapshot* src);
+	TrackState* prepareTrack(int track);
+	bool isTrackEqual(int track, StateSnapshot* other);
+	void detectBeats();
+
+	/**
+	 * Incremented each time the interrupt publishes.
+	 */
+	long version;
+
+	/**
+	 * The version in which each track last changed.
+	 */
+	long* trackVersions;
+
+	int trackCount;
+	TrackState* tracks;
+	LoopState* loops;
+	char* names;
+
+	char customMode[MAX_CUSTOM_MODE];
+	bool globalRecording;
+
+  private:
+
+	void link();
+
+	// beat counts last seen by the reader, not copied
+	int* mBeats;
+
+};
+
+/**
+ * Hands snapshots from the interrupt to any number of readers
+ * without locks.
+ *
+ * There are three slots.  The interrupt always writes the one after
+ * the last published, so readers copying the newest one are almost
+ * never disturbed.  Each slot has a sequence number that is odd
+ * while it is being written.  A reader checks it before and after
+ * its copy and tries again if it changed, which only happens if
+ * the interrupt came all the way around while the reader was
+ * copying.
+ */
+class StatePublisher {
+
+  public:
+
+	StatePublisher(int tracks);
+	~StatePublisher();
+
+	// interrupt
+	StateSnapshot* startPublish();
+	void finishPublish();
+
+	// readers
+	long getVersion();
+	bool read(StateSnapshot* dest);
+
+  private:
+
+	StateSnapshot mSlots[3];
+	volatile int mSequence[3];
+	volatile int mPublished;
+	volatile long mVersion;
+	int mWriting;
+
 };
 
 /****************************************************************************/
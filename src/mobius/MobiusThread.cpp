@@ -20,10 +20,15 @@
 #include "Thread.h"
 
 #include "Action.h"
+#include "LayerCompressor.h"
+#include "LayerFlattener.h"
 #include "Mobius.h"
 #include "MobiusConfig.h"
 #include "MobiusThread.h"
 #include "Project.h"
+#include "ProjectFile.h"
+#include "Reclaimer.h"
+#include "Sample.h"
 #include "Script.h"
 
 /****************************************************************************
@@ -316,6 +321,9 @@ void MobiusThread::threadEnding()
 {
 	if (NewTraceListener == this)
 	  NewTraceListener = NULL;
+
+    // give back our action cache
+    mMobius->getActionPool()->threadEnding();
 }
 
 void MobiusThread::flushEvents()
@@ -439,6 +447,23 @@ void MobiusThread::eventTimeout()
     // this exports changes to parameters/controls to MIDI control surfaces
     mMobius->exportStatus(true);
 
+    // in case we missed a signal
+    LayerFlattener* flattener = mMobius->getLayerFlattener();
+    if (flattener != NULL)
+      flattener->process();
+
+    LayerCompressor* compressor = mMobius->getLayerCompressor();
+    if (compressor != NULL)
+      compressor->process();
+
+    Reclaimer* reclaimer = mMobius->getReclaimer();
+    if (reclaimer != NULL)
+      reclaimer->process();
+
+    SampleCache* samples = mMobius->getSampleCache();
+    if (samples != NULL)
+      samples->prune();
+
 	if (mCheckInterrupt) {
 		long interrupts = mMobius->getInterrupts();
 		if (mInterrupts > 0 && mInterrupts == interrupts) {
@@ -458,6 +483,26 @@ void MobiusThread::processEvent()
 	// always flush any pending trace messages
 	if (NewTraceListener == this) FlushTrace();
 
+    // flatten layers the interrupt asked for
+    LayerFlattener* flattener = mMobius->getLayerFlattener();
+    if (flattener != NULL)
+      flattener->process();
+
+    // compress old layers and decompress the ones we're approaching
+    LayerCompressor* compressor = mMobius->getLayerCompressor();
+    if (compressor != NULL)
+      compressor->process();
+
+    // reset layers the interrupt released
+    Reclaimer* reclaimer = mMobius->getReclaimer();
+    if (reclaimer != NULL)
+      reclaimer->process();
+
+    // delete sample files the interrupt stopped using
+    SampleCache* samples = mMobius->getSampleCache();
+    if (samples != NULL)
+      samples->prune();
+
 	ThreadEvent* e = popEvent();
 	while (e != NULL) {
         ThreadEventType type = e->getType();
@@ -503,10 +548,18 @@ void MobiusThread::processEvent()
 				const char* path = getFullPath(e, NULL, ".mob");
 				if (path != NULL) {
 					Project* p = mMobius->saveProject();
-					p->setPath(path);
-					p->write();
+					if (!p->isError()) {
+						p->setPath(path);
+						p->write();
+						Trace(2, "Saved project to %s\n", path);
+					}
+					else {
+						Trace(1, "%s\n", p->getErrorMessage());
+						MobiusListener* ml = mMobius->getListener();
+						if (ml != NULL)
+						  ml->MobiusAlert(p->getErrorMessage());
+					}
 					delete p;
-					Trace(2, "Saved project to %s\n", path);
 				}
 			}
 			break;
@@ -514,7 +567,8 @@ void MobiusThread::processEvent()
 			case TE_LOAD: {
 				const char* path = getFullPath(e, NULL, ".mob");
 				if (path != NULL) {
-					if (EndsWithNoCase(path, ".mob")) {
+					if (EndsWithNoCase(path, ".mob") ||
+                        EndsWithNoCase(path, PROJECT_FILE_EXTENSION)) {
 
 						Project* p = new Project(path);
                         p->read(mMobius->getAudioPool());
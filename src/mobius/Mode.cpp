@@ -14,7 +14,7 @@
 #include <memory.h>
 #include <string.h>
 
-#include "util.h"
+#include "Util.h"
 #include "List.h"
 #include "Trace.h"
 
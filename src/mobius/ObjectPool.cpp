@@ -22,12 +22,16 @@
  * crossing where possible.  The pool thread is expected to keep
  * the pool full of objects so the interrupt handler will never starve.
  *
- * An object pool maintains two linked lists and two ring buffers.
+ * An object pool maintains three linked lists and a ring buffer.
  * 
  *   Allocation Ring
  *     A ring buffer of pooled objects available to the interrupt.
  *     The interrupt handler will remove objects from the tail of the ring,
  *     the pool thread will add objects to the head of the ring.
+ *     The head and tail are free running counters and the tail is
+ *     advanced with a compare and swap, so threads other than the 
+ *     interrupt (e.g. MobiusThread loading a project) may also 
+ *     allocate without a critical section.
  *
  *   Allocation List
  *     A list of pooled objects that the pool thread may add to the
@@ -38,28 +42,22 @@
  *     needs to add something to the allocation ring, it first uses
  *     objects from the allocation list, then allocates new objects.
  *
- *   Free Ring
- *     A ring buffer of pooled objects available to be reclaimed.
- *     The interrupt handler will add objects to the head of the ring.
- *     The pool thread will remove objects from the tail of the ring.
- *     Objects removed from the tail will be placed back on the
- *     head of the allocation ring if it is not full, otherwise on
- *     the allocation list.
+ *   Return List
+ *     A lock free stack of pooled objects available to be reclaimed.
+ *     Any thread may push objects onto the stack with a compare and swap.
+ *     The pool thread takes the entire stack at once with an atomic
+ *     exchange, prepares each object, and places it on the allocation
+ *     list or returns it to the heap.  This used to be a ring but
+ *     Audio buffers can be freed from more than one thread.
  *
  *   Free List
- *     A list of objects ready to be put on the free ring by the interrupt
- *     handler.  Like the allocation ring, the free ring is not necessarily
- *     large enough to hold all objects that have ever been allocated.  If the
- *     free ring is full when the interrupt handler frees an object, 
- *     it will be added to the free list.  The interrupt handler will
- *     periodically check to see if space is available on the free ring
- *     and move the free list objects to the ring.
+ *     A list of freed objects owned by the interrupt handler, used
+ *     only by pools that don't use the return list (see below).
  *
  * Only the pool thread is allowed to touch the allocation list, the head
- * of the allocation ring, and the tail of the free ring.
+ * of the allocation ring, and the consuming end of the return list.
  *
- * Only the interrupt handler is allowed to touch the free list, the head
- * of the free ring, and the tail of the allocation ring.
+ * Only the interrupt handler is allowed to touch the free list.
  * 
  * A pool may decide not to return objects in the free list to the
  * free ring, and instead allocate directly from the free list.  This
@@ -69,17 +67,18 @@
  * This is useful for most small objects that are allocated and freed
  * frequently.  
  *
- * The free ring is useful for very large objects such as audio buffers.
+ * The return list is useful for very large objects such as audio buffers.
  * Since the free list is "owned" by the interrupt handler and the 
  * interrupt handler is not allowed to return objects to the heap, 
  * everything on the free list will remain allocated for the lifetime
  * of the application.  If large buffers are allowed to accumulate, 
  * the memory size of the process will steadily increase.  This is not
  * necessarily a bad thing, but may lead to increased paging.  Instead,
- * the interrupt may periodically return buffers to the free ring
- * (such as after a GlobalReset), and the maintenance thread may
- * then choose to return them to the heap rather than accumulating
- * them on the allocation list.
+ * the interrupt returns buffers to the return list and the maintenance
+ * thread does the expensive work: zeroing them with prepareObject
+ * and returning them to the heap once the allocation list has more
+ * than mMaxPooled objects.  The interrupt only ever sees objects
+ * that are ready to use.
  *
  * Some pooled objects, notably Audio objects, contain a hierarchy
  * of other objects which may also be pooled.  The interrupt handler
@@ -241,17 +240,24 @@ PRIVATE void ObjectPool::initObjectPool(const char* name)
 	mName = CopyString(name);
     mThread = NULL;
 	mAllocList = NULL;
+	mAllocListSize = 0;
 	mAllocRing = NULL;
 	mAllocHead = 0;
 	mAllocTail = 0;
 	mAllocSize = 0;
+	mAllocMask = 0;
     mAllocWarning = 0;
+	mMaxPooled = 0;
 	mFreeList = NULL;
-	mFreeRing = NULL;
-	mFreeHead = 0;
-	mFreeTail = 0;
-	mFreeSize = 0;
+	mReturnList = NULL;
     mUseFreeRing = false;
+	mInUse = 0;
+	mMisses = 0;
+	mDirect = 0;
+	mLowWater = 0;
+	mHighWater = 0;
+	mCreated = 0;
+	mDeleted = 0;
 }
 
 /**
@@ -262,30 +268,26 @@ PRIVATE void ObjectPool::prepare()
     if (mName == NULL)
       mName = CopyString("unspecified");
 
-    // rings must be at least 2 elements
-
 	if (mAllocSize < 2)
 	  mAllocSize = OBJECT_POOL_DEFAULT_RING_SIZE;
 
-	if (mFreeSize < 2)
-	  mFreeSize = OBJECT_POOL_DEFAULT_RING_SIZE;
+	// slots are found by masking the free running counters
+	// so round up to a power of two
+	int size = 2;
+	while (size < mAllocSize)
+	  size *= 2;
+	mAllocSize = size;
+	mAllocMask = size - 1;
 
     // when the number of objects falls below this threshold
     // signal the maintenance thread
     if (mAllocWarning <= 0)
       mAllocWarning = mAllocSize / 2;
 
-	// the way rings work, the head must always be pointing
-	// to "empty" space so the rings have to be one larger
-	// than the desired number of objects
-	mAllocSize++;
-	mFreeSize++;
+	mLowWater = mAllocSize;
 
 	mAllocRing = new PooledObject*[mAllocSize];
 	memset(mAllocRing, 0, sizeof(PooledObject*) * mAllocSize);
-
-	mFreeRing = new PooledObject*[mFreeSize];
-	memset(mFreeRing, 0, sizeof(PooledObject*) * mFreeSize);
 }
 
 PUBLIC ObjectPool::~ObjectPool()
@@ -299,29 +301,21 @@ PUBLIC ObjectPool::~ObjectPool()
 
     // free the allocation ring
     while (mAllocTail != mAllocHead) {
-        PooledObject* obj = mAllocRing[mAllocTail];
+        PooledObject* obj = mAllocRing[mAllocTail & mAllocMask];
         if (obj == NULL)
           Trace(1, "Corrupted allocation ring %s\n", mName);
         else
           deleteObject(obj);
-        mAllocTail++;
-        if (mAllocTail >= mAllocSize)
-          mAllocTail = 0;
+        mAllocTail = (int)((unsigned int)mAllocTail + 1);
     }
     delete mAllocRing;
 
-    // free the free ring
-    while (mFreeTail != mFreeHead) {
-        PooledObject* obj = mFreeRing[mFreeTail];
-        if (obj == NULL)
-          Trace(1, "Corrupted free ring %s\n", mName);
-        else
-          deleteObject(obj);
-        mFreeTail++;
-        if (mFreeTail >= mFreeSize)
-          mFreeTail = 0;
+    // free the return list
+    while (mReturnList != NULL) {
+        PooledObject* obj = mReturnList;
+        mReturnList = obj->getPoolChain();
+        deleteObject(obj);
     }
-    delete mFreeRing;
 
     // free the free list
     while (mFreeList != NULL) {
@@ -362,11 +356,15 @@ PUBLIC void ObjectPool::setThread(Thread* t)
 /**
  * Called internally to allocate a new object from the heap.
  * The newObject method must be overloaded in the subclass.
+ * Some pools can't make objects on their own so this may return null.
  */
 PRIVATE PooledObject* ObjectPool::allocNew()
 {
     PooledObject* obj = newObject();
-    obj->setPool(this);
+    if (obj != NULL) {
+        obj->setPool(this);
+        AtomicIncrement(&mCreated);
+    }
     return obj;
 }
 
@@ -380,6 +378,52 @@ PRIVATE void ObjectPool::requestMaintenance()
       mThread->signal();
 }
 
+/**
+ * Return the number of objects in the allocation ring.
+ * This is only a snapshot, the maintenance thread may be adding
+ * more as we speak.
+ */
+PRIVATE int ObjectPool::getRingAvailable()
+{
+    int tail = mAllocTail;
+    int head = mAllocHead;
+    return (int)((unsigned int)head - (unsigned int)tail);
+}
+
+/**
+ * Remove an object from the tail of the allocation ring.
+ * Since the counters are free running, a consumer that loses the 
+ * race will see the tail move and try again, it can't mistake a 
+ * refilled slot for the one it read.  Returns null if the ring is empty.
+ */
+PRIVATE PooledObject* ObjectPool::allocRing()
+{
+    PooledObject* obj = NULL;
+    bool done = false;
+
+    while (!done) {
+        int tail = mAllocTail;
+        int head = mAllocHead;
+        if (tail == head) {
+            // the ring has been consumed, the maintenance thread 
+            // must not be keeping up
+            done = true;
+        }
+        else {
+            // don't read the slot until we've seen the head that covers it
+            AtomicBarrier();
+            obj = mAllocRing[tail & mAllocMask];
+            int next = (int)((unsigned int)tail + 1);
+            if (AtomicCompareAndSwap(&mAllocTail, tail, next))
+              done = true;
+            else
+              obj = NULL;
+        }
+    }
+
+    return obj;
+}
+
 /**
  * Called by the interrupt handler to allocate an object.
  */
@@ -387,43 +431,40 @@ PUBLIC PooledObject* ObjectPool::alloc()
 {
 	PooledObject* obj = NULL;
 
-    if (mFreeList != NULL) {
+    if (!mUseFreeRing && mFreeList != NULL) {
         // first use the free list if we have one
         obj = mFreeList;
         mFreeList = obj->getPoolChain();
     }
-    else if (mAllocTail == mAllocHead) {
-        // the ring has been consumed, the maintenance thread 
-        // must not be running
-        Trace(1, "Empty allocation ring in pool %s\n", mName);
-    }
     else {
-        obj = mAllocRing[mAllocTail];
-        if (obj == NULL)
-          Trace(1, "Corrupted allocation ring in pool %s\n", mName);
-        mAllocTail++;
-        if (mAllocTail >= mAllocSize)
-          mAllocTail = 0;
+        obj = allocRing();
+        // without a thread, falling through to the heap is expected
+        if (obj == NULL && mThread != NULL)
+          Trace(1, "Empty allocation ring in pool %s\n", mName);
     }
 
     if (obj == NULL) {
         // This should never happen but on windows we can call the factory
         // and have a very good chance of success.  On Mac this will crash.
+        AtomicIncrement(&mMisses);
         obj = allocNew();
     }
 
-    obj->setPooled(false);
-    obj->setPoolChain(NULL);
+    if (obj != NULL) {
+        obj->setPooled(false);
+        obj->setPoolChain(NULL);
+
+        int inUse = AtomicIncrement(&mInUse);
+        if (inUse > mHighWater)
+          mHighWater = inUse;
+    }
 
     if (mUseFreeRing || mFreeList == NULL) {
         // capture current for threshold detection, it doesn't matter if the
         // maintenance thread advances the head after this
-        int available = 0;
-        int head = mAllocHead;
-        if (head > mAllocTail)
-          available = head - mAllocTail;
-        else if (head < mAllocTail)
-          available = mAllocSize - (mAllocTail - head);
+        int available = getRingAvailable();
+        if (available < mLowWater)
+          mLowWater = available;
 
         if (available < mAllocWarning)
           requestMaintenance();
@@ -432,6 +473,49 @@ PUBLIC PooledObject* ObjectPool::alloc()
     return obj;
 }
 
+/**
+ * Allocate an object without touching the allocation ring.
+ * Used by threads that may need a lot of objects at once, like
+ * the ones reading files, so they don't take what the interrupt
+ * is depending on.  The object is made and prepared here, when it
+ * is freed it goes back to the pool like any other.
+ */
+PUBLIC PooledObject* ObjectPool::allocDirect()
+{
+    PooledObject* obj = allocNew();
+
+    if (obj != NULL) {
+        prepareObject(obj);
+        obj->setPooled(false);
+        obj->setPoolChain(NULL);
+        AtomicIncrement(&mDirect);
+
+        int inUse = AtomicIncrement(&mInUse);
+        if (inUse > mHighWater)
+          mHighWater = inUse;
+    }
+
+    return obj;
+}
+
+/**
+ * Push an object on the lock free return list.
+ * Pushing is safe from any number of threads since the consumer
+ * always takes the entire list, so we don't have to worry about
+ * the usual ABA problem with lock free stacks.
+ */
+PRIVATE void ObjectPool::pushReturnList(PooledObject* obj)
+{
+    obj->setPooled(true);
+
+    PooledObject* top;
+    do {
+        top = mReturnList;
+        obj->setPoolChain(top);
+    } while (!AtomicCompareAndSwapPointer((void* volatile*)&mReturnList,
+                                          top, obj));
+}
+
 /**
  * Called by the interrupt handler to free an object.
  */
@@ -446,33 +530,16 @@ PUBLIC void ObjectPool::free(PooledObject* obj)
               obj->getPool()->getName(), mName);
         // let it leak
     }
-    else if (!mUseFreeRing) {
-        
-        // TODO: If the number of objects on the free list exceeds
-        // a threshold, return them to the ring so they may be returned
-        // to the heap.
-
-        obj->setPoolChain(mFreeList);
-        mFreeList = obj;
-        obj->setPooled(true);
-    }
     else {
-        int nextHead = mFreeHead + 1;
-        if (nextHead >= mFreeSize)
-          nextHead = 0;
-
-        else if (nextHead == mFreeTail) {
-            // management thread isn't keeping up, this usually indicates
-            // a problem since we don't normally free large numbers of things
-            Trace(2, "Free ring overflow, spilling to free list\n");
+        AtomicDecrement(&mInUse);
+
+        if (!mUseFreeRing) {
             obj->setPoolChain(mFreeList);
             mFreeList = obj;
             obj->setPooled(true);
         }
         else {
-            mFreeRing[mFreeHead] = obj;
-            mFreeHead = nextHead;
-            obj->setPooled(true);
+            pushReturnList(obj);
         }
     }
 }
@@ -482,48 +549,70 @@ PUBLIC void ObjectPool::free(PooledObject* obj)
  */
 PUBLIC void ObjectPool::maintain()
 {
-    // consume the free ring
+    // consume the return list
 	int freed = 0;
-    while (mFreeTail != mFreeHead) {
-        PooledObject* obj = mFreeRing[mFreeTail];
-        if (obj == NULL)
-          Trace(1, "Corrupted free ring %s\n", mName);
+	int deleted = 0;
+    PooledObject* returned = (PooledObject*)
+        AtomicExchangePointer((void* volatile*)&mReturnList, NULL);
+
+    while (returned != NULL) {
+        PooledObject* obj = returned;
+        returned = obj->getPoolChain();
+
+        if (mMaxPooled > 0 && mAllocListSize >= mMaxPooled) {
+            // we have enough, give it back to the heap
+            deleteObject(obj);
+            mDeleted++;
+            deleted++;
+        }
         else {
+            // do the expensive initialization out here rather
+            // than in the interrupt
+            prepareObject(obj);
             obj->setPoolChain(mAllocList);
             mAllocList = obj;
+            mAllocListSize++;
         }
-        mFreeTail++;
 		freed++;
-        if (mFreeTail >= mFreeSize)
-          mFreeTail = 0;
     }
 
 	if (freed > 0)
-	  Trace(2, "ObjectPool: consumed %ld objects from the free ring\n", (long)freed);
-
-    // TODO: If the number of objects on the free list exceeds a threshold
-    // return them to the heap
+	  Trace(2, "ObjectPool: consumed %ld objects from the return list, %ld deleted\n", 
+            (long)freed, (long)deleted);
 
     // fill the allocation ring
 
-    int nextHead = mAllocHead + 1;
-    if (nextHead >= mAllocSize) nextHead = 0;
 	int added = 0;
+    bool full = false;
 
-    while (nextHead != mAllocTail) {
-        PooledObject* obj;
-        if (mAllocList == NULL)
-          obj = allocNew();
+    while (!full) {
+        int head = mAllocHead;
+        int tail = mAllocTail;
+        if ((int)((unsigned int)head - (unsigned int)tail) >= mAllocSize)
+          full = true;
         else {
-            obj = mAllocList;
-            mAllocList = obj->getPoolChain();
-            obj->setPoolChain(NULL);
+            PooledObject* obj;
+            if (mAllocList == NULL)
+              obj = allocNew();
+            else {
+                obj = mAllocList;
+                mAllocList = obj->getPoolChain();
+                mAllocListSize--;
+                obj->setPoolChain(NULL);
+            }
+
+            if (obj == NULL) {
+                // pool can't make its own objects
+                full = true;
+            }
+            else {
+                mAllocRing[head & mAllocMask] = obj;
+                // slot must be visible before the head moves
+                AtomicBarrier();
+                mAllocHead = (int)((unsigned int)head + 1);
+                added++;
+            }
         }
-        mAllocRing[mAllocHead] = obj;
-        mAllocHead = nextHead;
-        nextHead = mAllocHead + 1;
-		added++;
-        if (nextHead >= mAllocSize) nextHead = 0;
     }
 
 	if (added > 0)
@@ -531,6 +620,62 @@ PUBLIC void ObjectPool::maintain()
 			(long)added);
 }
 
+/****************************************************************************
+ *                                                                          *
+ *                                 STATISTICS                               *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * Number of objects allocated and not yet returned.
+ */
+PUBLIC int ObjectPool::getInUse()
+{
+    return mInUse;
+}
+
+/**
+ * The smallest number of objects seen in the allocation ring 
+ * after an allocation.  If this gets near zero the ring is too
+ * small or the maintenance thread isn't running often enough.
+ */
+PUBLIC int ObjectPool::getLowWater()
+{
+    return mLowWater;
+}
+
+/**
+ * The largest number of objects in use at one time.
+ */
+PUBLIC int ObjectPool::getHighWater()
+{
+    return mHighWater;
+}
+
+/**
+ * The number of allocations that found the ring empty and had
+ * to go to the heap.
+ */
+PUBLIC int ObjectPool::getMisses()
+{
+    return mMisses;
+}
+
+/**
+ * The number of objects allocated with allocDirect.
+ */
+PUBLIC int ObjectPool::getDirect()
+{
+    return mDirect;
+}
+
+PUBLIC void ObjectPool::resetStatistics()
+{
+    mMisses = 0;
+    mLowWater = mAllocSize;
+    mHighWater = mInUse;
+}
+
 PUBLIC void ObjectPool::dump()
 {
 	PooledObject* o;
@@ -538,9 +683,8 @@ PUBLIC void ObjectPool::dump()
 	printf("%s\n", mName);
 	
 	int allocListCount = 0;
-	int allocRingCount = 0;
 	int freeListCount = 0;
-	int freeRingCount = 0;
+	int returnListCount = 0;
 
 	for (o = mAllocList ; o != NULL ; o = o->getPoolChain())
 	  allocListCount++;
@@ -548,27 +692,25 @@ PUBLIC void ObjectPool::dump()
 	for (o = mFreeList ; o != NULL ; o = o->getPoolChain())
 	  freeListCount++;
 
-	if (mAllocHead > mAllocTail)
-	  allocRingCount = mAllocHead - mAllocTail;
-	else if (mAllocHead < mAllocTail)
-	  allocRingCount = mAllocSize - (mAllocTail - mAllocHead);
+	for (o = mReturnList ; o != NULL ; o = o->getPoolChain())
+	  returnListCount++;
 
-	if (mFreeHead > mFreeTail)
-	  freeRingCount = mFreeHead - mFreeTail;
-	else if (mFreeHead < mFreeTail)
-	  allocRingCount = mFreeSize - (mFreeTail - mFreeHead);
+	int allocRingCount = getRingAvailable();
 
-	// remember that the internal sizes are 1+ the requested 
-	// size because the head must always point to "free" space
 	char msg[1024];
 
 	// formerly used Trace(1 here, why?
 	sprintf(msg, "  %d objects on the allocation list, allocation ring has %d of %d\n", 
-			allocListCount, allocRingCount, mAllocSize - 1);
+			allocListCount, allocRingCount, mAllocSize);
+	printf("%s", msg);
+
+	sprintf(msg, "  %d objects on the free list, %d on the return list\n", 
+			freeListCount, returnListCount);
 	printf("%s", msg);
 
-	sprintf(msg, "  %d objects on the free list, free ring has %d of %d\n", 
-			freeListCount, freeRingCount, mFreeSize - 1);
+	sprintf(msg, "  %d in use, high water %d, low water %d, misses %d, direct %d, created %d, deleted %d\n",
+			(int)mInUse, mHighWater, mLowWater, (int)mMisses, 
+            (int)mDirect, (int)mCreated, mDeleted);
 	printf("%s", msg);
 }
 
@@ -665,27 +807,51 @@ void ObjectPoolManager::startThread()
 		mExternalThread = false;
 		mThread = new PoolThread(this);
 		mThread->start();
+
+		// pools added before the thread was started need to know
+		// who to signal
+		for (ObjectPool* p = mPools ; p != NULL ; p = p->getNext())
+		  p->setThread(mThread);
 	}
 }
 
-ObjectPoolManager::~ObjectPoolManager()
+/**
+ * Stop the thread we started.  Call this before removing pools
+ * that are owned by something else.  Returns false if the thread
+ * could not be stopped, in which case it isn't safe to touch the pools.
+ */
+bool ObjectPoolManager::stopThread()
 {
+	bool stopped = true;
+
 	if (mThread != NULL && !mExternalThread) {
 		if (mThread->stopAndWait()) {
-			ObjectPool* next = NULL;
-			for (ObjectPool* p = mPools ; p != NULL ; p = next) {
-				next = p->getNext();
-				delete p;
-			}
-
 			delete mThread;
+			mThread = NULL;
+			for (ObjectPool* p = mPools ; p != NULL ; p = p->getNext())
+			  p->setThread(NULL);
 		}
 		else {
 			// thread not responding, or really busy
-			// may crash if we delete the pools now, better to leak
 			Trace(1, "Unable to halt pool thread!\n");
+			stopped = false;
+		}
+	}
+	return stopped;
+}
+
+ObjectPoolManager::~ObjectPoolManager()
+{
+	if (mExternalThread || stopThread()) {
+		ObjectPool* next = NULL;
+		for (ObjectPool* p = mPools ; p != NULL ; p = next) {
+			next = p->getNext();
+			delete p;
 		}
 	}
+	else {
+		// may crash if we delete the pools now, better to leak
+	}
 	mThread = NULL;
 	mExternalThread = false;
 }
@@ -730,6 +896,28 @@ PUBLIC void ObjectPoolManager::add(ObjectPool* p)
     mPools = p;
 }
 
+/**
+ * Remove a pool without deleting it.  Used by pools that are
+ * owned by something else, the maintenance thread must not be 
+ * touching the pool when this is called.
+ */
+PUBLIC void ObjectPoolManager::remove(ObjectPool* pool)
+{
+    ObjectPool* prev = NULL;
+    for (ObjectPool* p = mPools ; p != NULL ; p = p->getNext()) {
+        if (p == pool) {
+            if (prev == NULL)
+              mPools = p->getNext();
+            else
+              prev->setNext(p->getNext());
+            p->setNext(NULL);
+            p->setThread(NULL);
+            break;
+        }
+        prev = p;
+    }
+}
+
 PUBLIC ObjectPool* ObjectPoolManager::get(const char* name)
 {
     ObjectPool* found = NULL;
@@ -764,6 +952,8 @@ PUBLIC void ObjectPoolManager::maintain()
 PUBLIC SampleBuffer::SampleBuffer(long samples)
 {
     mSamples = samples;
+    mReferences = 0;
+    mRetiredEpoch = 0;
     alloc();
 }
 
@@ -781,13 +971,76 @@ PUBLIC float* SampleBuffer::getSamples()
     return (float*)getBuffer();
 }
 
+PUBLIC void SampleBuffer::setReferences(int i)
+{
+    mReferences = i;
+}
+
+PUBLIC int SampleBuffer::getReferences()
+{
+    return mReferences;
+}
+
+/**
+ * References may be added and removed by the interrupt and
+ * MobiusThread at the same time so these must be atomic.
+ */
+PUBLIC void SampleBuffer::incReferences()
+{
+    AtomicIncrement(&mReferences);
+}
+
+/**
+ * Add a reference only if there still is one.  A thread that found
+ * the buffer in an Audio the interrupt is changing may get here after
+ * the last reference went away, it must not bring the buffer back.
+ */
+PUBLIC bool SampleBuffer::incLiveReferences()
+{
+    bool added = false;
+    int refs = mReferences;
+    while (refs > 0 && !added) {
+        if (AtomicCompareAndSwap(&mReferences, refs, refs + 1))
+          added = true;
+        else
+          refs = mReferences;
+    }
+    return added;
+}
+
+PUBLIC int SampleBuffer::decReferences()
+{
+    return AtomicDecrement(&mReferences);
+}
+
 //
 // Pool
 //
 
 PUBLIC SampleBufferPool::SampleBufferPool(long samples)
 {
+    initSampleBufferPool(samples, OBJECT_POOL_DEFAULT_RING_SIZE);
+}
+
+PUBLIC SampleBufferPool::SampleBufferPool(long samples, int ringSize)
+{
+    initSampleBufferPool(samples, ringSize);
+}
+
+/**
+ * Sample buffers are large and may be freed by the interrupt in bursts
+ * (e.g. GlobalReset) so they always go through the return list where 
+ * the maintenance thread can zero them and return the excess to the heap.
+ * We keep at most one ring's worth on the allocation list.
+ */
+PRIVATE void SampleBufferPool::initSampleBufferPool(long samples, int ringSize)
+{
+    initObjectPool("SampleBuffer");
     mSamples = samples;
+    mUseFreeRing = true;
+    mAllocSize = ringSize;
+    mMaxPooled = ringSize;
+    prepare();
 }
 
 PUBLIC SampleBufferPool::~SampleBufferPool()
@@ -812,18 +1065,105 @@ PUBLIC void SampleBufferPool::prepareObject(PooledObject* o)
     memset(samples, 0, sizeof(float) * mSamples);
 }
 
+/**
+ * Allocate a buffer outside the allocation ring, see allocDirect.
+ */
+PUBLIC float* SampleBufferPool::allocSamplesDirect()
+{
+    SampleBuffer* sb = (SampleBuffer*)allocDirect();
+    float* samples = NULL;
+    if (sb != NULL) {
+        sb->setReferences(1);
+        samples = sb->getSamples();
+    }
+    return samples;
+}
+
 PUBLIC float* SampleBufferPool::allocSamples()
 {
     // machinery inherited from ObjectPool, downcast the result
     SampleBuffer* sb = (SampleBuffer*)alloc();
-    return sb->getSamples();
+    float* samples = NULL;
+    if (sb != NULL) {
+        sb->setReferences(1);
+        samples = sb->getSamples();
+    }
+    return samples;
 }
 
+/**
+ * Remove a reference to a buffer, it goes back to the pool
+ * when the last one is removed.
+ */
 PUBLIC void SampleBufferPool::freeSamples(float* buffer)
 {
     // extract the PooledBuffer pointer from the block prefix
-    PooledBuffer* pb = PooledBuffer::getPooledBuffer((unsigned char*)buffer);
-    free(pb);
+    SampleBuffer* sb = (SampleBuffer*)
+        PooledBuffer::getPooledBuffer((unsigned char*)buffer);
+
+    if (sb != NULL) {
+        int refs = sb->decReferences();
+        if (refs == 0)
+          free(sb);
+        else if (refs < 0)
+          Trace(1, "SampleBufferPool: buffer freed too many times!\n");
+    }
+}
+
+/**
+ * Remove a reference to a buffer like freeSamples, but rather than
+ * returning it to the pool when the last one is removed, give it
+ * back to the caller.  AudioPool uses this to hold buffers until
+ * other threads that may be reading them are done.  The caller 
+ * frees it with PooledObject::free.
+ */
+PUBLIC SampleBuffer* SampleBufferPool::releaseSamples(float* buffer)
+{
+    SampleBuffer* released = NULL;
+    SampleBuffer* sb = (SampleBuffer*)
+        PooledBuffer::getPooledBuffer((unsigned char*)buffer);
+
+    if (sb != NULL) {
+        int refs = sb->decReferences();
+        if (refs == 0)
+          released = sb;
+        else if (refs < 0)
+          Trace(1, "SampleBufferPool: buffer freed too many times!\n");
+    }
+    return released;
+}
+
+/**
+ * Add a reference to a buffer so it may be used by another Audio.
+ */
+PUBLIC void SampleBufferPool::shareSamples(float* buffer)
+{
+    SampleBuffer* sb = (SampleBuffer*)
+        PooledBuffer::getPooledBuffer((unsigned char*)buffer);
+    if (sb != NULL)
+      sb->incReferences();
+}
+
+/**
+ * Add a reference to a buffer we don't have a reference to yet,
+ * found in an Audio another thread may be changing.  Returns false
+ * if the last reference is already gone.
+ */
+PUBLIC bool SampleBufferPool::shareLiveSamples(float* buffer)
+{
+    SampleBuffer* sb = (SampleBuffer*)
+        PooledBuffer::getPooledBuffer((unsigned char*)buffer);
+    return (sb != NULL && sb->incLiveReferences());
+}
+
+/**
+ * True if more than one Audio is using this buffer.
+ */
+PUBLIC bool SampleBufferPool::isShared(float* buffer)
+{
+    SampleBuffer* sb = (SampleBuffer*)
+        PooledBuffer::getPooledBuffer((unsigned char*)buffer);
+    return (sb != NULL && sb->getReferences() > 1);
 }
 
 /****************************************************************************/
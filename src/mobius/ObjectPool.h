@@ -133,6 +133,19 @@ class ObjectPool {
     PooledObject* alloc();
     void free(PooledObject* o);
 
+    // called by threads that must leave the ring to the interrupt
+
+    PooledObject* allocDirect();
+
+    // statistics
+
+    int getInUse();
+    int getLowWater();
+    int getHighWater();
+    int getMisses();
+    int getDirect();
+    void resetStatistics();
+
   protected:
 
     void initObjectPool(const char* name);
@@ -141,25 +154,64 @@ class ObjectPool {
     PooledObject* allocNew();
 	void deleteObject(PooledObject* obj);
     void requestMaintenance();
+    PooledObject* allocRing();
+    int getRingAvailable();
+    void pushReturnList(PooledObject* obj);
 
     ObjectPool* mNext;          // ObjectPoolManager chain
     Thread* mThread;
     char* mName;
 
+    /**
+     * Objects that have been prepared and are waiting to go into
+     * the allocation ring.  Only touched by the maintenance thread.
+     */
     PooledObject* mAllocList;
+    int mAllocListSize;
+
+    /**
+     * The allocation ring.  mAllocHead and mAllocTail are
+     * free running counters, the slot is the counter masked by 
+     * mAllocMask so the ring size must be a power of two.
+     * Only the maintenance thread advances the head, consumers
+     * advance the tail with a compare and swap.
+     */
     PooledObject** mAllocRing;
-    int mAllocHead;
-    int mAllocTail;
+    volatile int mAllocHead;
+    volatile int mAllocTail;
     int mAllocSize;
+    int mAllocMask;
     int mAllocWarning;
 
+    /**
+     * Maximum number of objects to keep on the allocation list.
+     * Returned objects beyond this are deleted by the maintenance
+     * thread.  Zero means keep everything.
+     */
+    int mMaxPooled;
+
+    /**
+     * Interrupt owned free list used when mUseFreeRing is false.
+     */
     PooledObject* mFreeList;
-    PooledObject** mFreeRing;
-    int mFreeHead;
-    int mFreeTail;
-    int mFreeSize;
+
+    /**
+     * Lock free stack of returned objects used when mUseFreeRing
+     * is true.  Any thread may push, the maintenance thread takes
+     * the entire list at once.
+     */
+    PooledObject* volatile mReturnList;
     bool mUseFreeRing;
 
+    // statistics
+    volatile int mInUse;
+    volatile int mMisses;
+    volatile int mDirect;
+    int mLowWater;
+    int mHighWater;
+    volatile int mCreated;
+    int mDeleted;
+
 };
 
 /****************************************************************************
@@ -181,8 +233,10 @@ class ObjectPoolManager {
 
 	void setThread(Thread* t);
     void startThread();
+    bool stopThread();
 
     void add(ObjectPool* pool);
+    void remove(ObjectPool* pool);
     ObjectPool* get(const char* name);
 
     void maintain();
@@ -206,9 +260,16 @@ class ObjectPoolManager {
 
 /**
  * Concrete implementation of a frequently used buffer type.
+ *
+ * Sample buffers may be shared by more than one Audio, the reference
+ * count is one when allocated and the buffer goes back to the pool
+ * when it reaches zero.  A shared buffer must not be modified,
+ * see Audio::getWritableBuffer.
  */
 class SampleBuffer : public PooledBuffer {
 
+	friend class Reclaimer;
+
   public:
 
     SampleBuffer(long samples);
@@ -218,9 +279,22 @@ class SampleBuffer : public PooledBuffer {
 
     float* getSamples();
 
+    void setReferences(int i);
+    int getReferences();
+    void incReferences();
+    bool incLiveReferences();
+    int decReferences();
+
   private:
 
     long mSamples;
+    volatile int mReferences;
+
+    /**
+     * The Reclaimer epoch the last reference went away in.
+     * While retired the buffer is chained through the pool chain.
+     */
+    int mRetiredEpoch;
 
 };
 
@@ -232,6 +306,7 @@ class SampleBufferPool : public ObjectPool {
   public:
 
 	SampleBufferPool(long samples);
+	SampleBufferPool(long samples, int ringSize);
     ~SampleBufferPool();
     
     // ObjectPool implementations
@@ -239,10 +314,17 @@ class SampleBufferPool : public ObjectPool {
     void prepareObject(PooledObject* o);
 
     float* allocSamples();
+    float* allocSamplesDirect();
     void freeSamples(float* b);
+    SampleBuffer* releaseSamples(float* b);
+    void shareSamples(float* b);
+    bool shareLiveSamples(float* b);
+    bool isShared(float* b);
 
   protected:
 
+    void initSampleBufferPool(long samples, int ringSize);
+
     /**
      * The number of samples in the buffers returned by this pool.
      */
@@ -0,0 +1,360 @@
+/*
+ * Copyright (c) 2010 Jeffrey S. Larson  <jeff@circularlabs.com>
+ * All rights reserved.
+ * See the LICENSE file for the full copyright and license declaration.
+ *
+ * ---------------------------------------------------------------------
+ *
+ * Headless Mobius for offline rendering and benchmarks.
+ * See OfflineEngine.h
+ *
+ * Mobius is started the usual way with a MobiusContext, the only
+ * difference is the AudioInterface never calls back on its own.
+ * Each call to process() runs one interrupt on the calling thread
+ * then advances the MIDI timer by the number of milliseconds those
+ * frames represent.  Nothing depends on the wall clock so a render
+ * is repeatable no matter how fast the machine is.
+ *
+ * MobiusThread still runs, scripts that wait on it will see it
+ * running in real time, not in stream time.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "Util.h"
+#include "Trace.h"
+
+#include "AudioInterface.h"
+#include "OfflineAudioInterface.h"
+#include "MidiInterface.h"
+#include "MidiEnv.h"
+#include "NullMidiEnv.h"
+
+#include "Action.h"
+#include "Binding.h"
+#include "Function.h"
+#include "Mobius.h"
+#include "MobiusConfig.h"
+#include "MobiusInterface.h"
+#include "Parameter.h"
+
+#include "OfflineEngine.h"
+
+/****************************************************************************
+ *                                                                          *
+ *                                   ENGINE                                 *
+ *                                                                          *
+ ****************************************************************************/
+
+PUBLIC OfflineEngine::OfflineEngine()
+{
+    mContext = NULL;
+    mMidi = NULL;
+    mAudio = NULL;
+    mStream = NULL;
+    mTimer = NULL;
+    mMobius = NULL;
+    mScripts = new ScriptConfig();
+    mInstallationDirectory = NULL;
+    mConfigurationDirectory = NULL;
+    mSampleRate = CD_SAMPLE_RATE;
+    mBlockFrames = AUDIO_FRAMES_PER_BUFFER;
+    mTracks = 0;
+    mParallelTracks = -1;
+    mTraceLevel = 1;
+    mMillis = 0;
+}
+
+PUBLIC OfflineEngine::~OfflineEngine()
+{
+    stop();
+    delete mScripts;
+    delete mInstallationDirectory;
+    delete mConfigurationDirectory;
+}
+
+PUBLIC void OfflineEngine::setInstallationDirectory(const char* s)
+{
+    delete mInstallationDirectory;
+    mInstallationDirectory = CopyString(s);
+}
+
+PUBLIC void OfflineEngine::setConfigurationDirectory(const char* s)
+{
+    delete mConfigurationDirectory;
+    mConfigurationDirectory = CopyString(s);
+}
+
+/**
+ * Mobius only supports 44100 and 48000.
+ */
+PUBLIC void OfflineEngine::setSampleRate(int rate)
+{
+    mSampleRate = (rate == 48000) ? 48000 : CD_SAMPLE_RATE;
+}
+
+PUBLIC void OfflineEngine::setBlockFrames(long frames)
+{
+    if (frames < 1)
+      frames = 1;
+    else if (frames > AUDIO_MAX_FRAMES_PER_BUFFER)
+      frames = AUDIO_MAX_FRAMES_PER_BUFFER;
+    mBlockFrames = frames;
+}
+
+/**
+ * Override the track count in mobius.xml, zero leaves it alone.
+ */
+PUBLIC void OfflineEngine::setTracks(int tracks)
+{
+    mTracks = tracks;
+}
+
+/**
+ * Override the parallel track workers in mobius.xml, 
+ * negative leaves it alone.
+ */
+PUBLIC void OfflineEngine::setParallelTracks(int workers)
+{
+    mParallelTracks = workers;
+}
+
+/**
+ * Trace print level, messages go to stdout.  The levels in
+ * mobius.xml are ignored since the debug stream is stderr here.
+ */
+PUBLIC void OfflineEngine::setTraceLevel(int level)
+{
+    mTraceLevel = level;
+}
+
+/**
+ * Add a script file to the ScriptConfig.  The script may then
+ * be called with doFunction using its name.
+ */
+PUBLIC void OfflineEngine::addScript(const char* path)
+{
+    mScripts->add(path);
+}
+
+PUBLIC Mobius* OfflineEngine::getMobius()
+{
+    return mMobius;
+}
+
+PUBLIC int OfflineEngine::getSampleRate()
+{
+    return mSampleRate;
+}
+
+PUBLIC long OfflineEngine::getBlockFrames()
+{
+    return mBlockFrames;
+}
+
+PUBLIC long long OfflineEngine::getFrames()
+{
+    return (mStream != NULL) ? mStream->getFrames() : 0;
+}
+
+/**
+ * Bring up Mobius.  The configuration is read from mobius.xml in
+ * the configuration directory as usual, then adjusted for
+ * offline use: no devices, no OSC, our sample rate.
+ */
+PUBLIC bool OfflineEngine::start()
+{
+    if (mMobius != NULL)
+      return true;
+
+    mAudio = (OfflineAudioInterface*)AudioInterface::getInterface();
+    mStream = (OfflineAudioStream*)mAudio->getStream();
+
+    mMidi = MidiInterface::getInterface("OfflineEngine");
+    mTimer = (NullMidiTimer*)MidiEnv::getEnv()->getTimer();
+
+    // Mobius owns this once it is constructed
+	mContext = new MobiusContext();
+	mContext->setInstallationDirectory(mInstallationDirectory);
+	mContext->setConfigurationDirectory(mConfigurationDirectory);
+    mContext->setMidiInterface(mMidi);
+    mContext->setAudioInterface(mAudio);
+
+    mMobius = new Mobius(mContext);
+
+    MobiusConfig* config = mMobius->getConfiguration();
+    if (config == NULL) {
+        Trace(1, "OfflineEngine: unable to read configuration\n");
+        stop();
+        return false;
+    }
+
+    config->setSampleRate((mSampleRate == 48000) ? SAMPLE_RATE_48000 :
+                          SAMPLE_RATE_44100);
+    config->setAudioInput(NULL);
+    config->setAudioOutput(NULL);
+    config->setMidiInput(NULL);
+    config->setMidiOutput(NULL);
+    config->setMidiThrough(NULL);
+    config->setOscEnable(false);
+    if (mTracks > 0)
+      config->setTracks(mTracks);
+    if (mParallelTracks >= 0)
+      config->setParallelTracks(mParallelTracks);
+
+    config->setTracePrintLevel(mTraceLevel);
+    config->setTraceDebugLevel(0);
+    TracePrintLevel = mTraceLevel;
+    TraceDebugLevel = 0;
+
+    ScriptRef* refs = mScripts->getScripts();
+    if (refs != NULL) {
+        ScriptConfig* sc = config->getScriptConfig();
+        if (sc == NULL) {
+            sc = new ScriptConfig();
+            config->setScriptConfig(sc);
+        }
+        for (ScriptRef* ref = refs ; ref != NULL ; ref = ref->getNext())
+          sc->add(ref->getFile());
+    }
+
+    mMobius->start();
+
+    // we may be stopped in a debugger or run much slower than real
+    // time under a profiler, don't let MobiusThread panic
+    mMobius->setCheckInterrupt(false);
+
+    mMillis = 0;
+
+    return true;
+}
+
+/**
+ * Shut down Mobius.  The interfaces are left in place,
+ * there can only be one of each.
+ */
+PUBLIC void OfflineEngine::stop()
+{
+    if (mMobius != NULL) {
+        // this will also delete the context
+        delete mMobius;
+        mMobius = NULL;
+        mContext = NULL;
+    }
+    else {
+        delete mContext;
+        mContext = NULL;
+    }
+
+    if (mMidi != NULL) {
+        MidiInterface::release(mMidi);
+        mMidi = NULL;
+    }
+
+    mTimer = NULL;
+    mStream = NULL;
+    mAudio = NULL;
+}
+
+/****************************************************************************
+ *                                                                          *
+ *                                  ACTIONS                                 *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * Queue a function for the next interrupt.  Track numbers start
+ * from 1, zero means the active track.  This is a simple press,
+ * there is no up transition.
+ */
+PUBLIC bool OfflineEngine::doFunction(const char* name, int track)
+{
+    return doFunction(name, track, true, false);
+}
+
+/**
+ * Queue one transition of a sustained function.  The down transition
+ * must be followed by an up transition some time later, in between
+ * the function may see a long press.
+ */
+PUBLIC bool OfflineEngine::doFunction(const char* name, int track, bool down)
+{
+    return doFunction(name, track, down, true);
+}
+
+PRIVATE bool OfflineEngine::doFunction(const char* name, int track, bool down,
+                                       bool sustain)
+{
+    bool done = false;
+
+    if (mMobius != NULL) {
+        Function* f = mMobius->getFunction(name);
+        if (f == NULL) {
+            Trace(1, "OfflineEngine: unknown function %s\n", name);
+        }
+        else {
+            Action* a = mMobius->newAction();
+            a->setFunction(f);
+            a->setTargetTrack(track);
+            a->trigger = TriggerHost;
+            a->triggerMode = (sustain && f->isSustainable()) ?
+                TriggerModeMomentary : TriggerModeOnce;
+            a->down = down;
+            mMobius->doAction(a);
+            done = true;
+        }
+    }
+    return done;
+}
+
+PUBLIC bool OfflineEngine::setParameter(const char* name, const char* value,
+                                        int track)
+{
+    bool done = false;
+
+    if (mMobius != NULL) {
+        Parameter* p = mMobius->getParameter(name);
+        if (p == NULL) {
+            Trace(1, "OfflineEngine: unknown parameter %s\n", name);
+        }
+        else {
+            Action* a = mMobius->newAction();
+            a->setParameter(p);
+            a->setTargetTrack(track);
+            a->trigger = TriggerHost;
+            a->triggerMode = TriggerModeOnce;
+            a->arg.setString(value);
+            mMobius->doAction(a);
+            done = true;
+        }
+    }
+    return done;
+}
+
+/****************************************************************************
+ *                                                                          *
+ *                                 PROCESSING                               *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * Run one interrupt.  Input may be NULL for silence.
+ */
+PUBLIC void OfflineEngine::process(float* input, float* output)
+{
+    if (mStream != NULL) {
+        mStream->processBuffers(input, output, mBlockFrames);
+
+        long long millis = (mStream->getFrames() * 1000) / mSampleRate;
+        if (millis > mMillis) {
+            mTimer->advance((int)(millis - mMillis));
+            mMillis = millis;
+        }
+    }
+}
+
+/****************************************************************************/
+/****************************************************************************/
+/****************************************************************************/
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2010 Jeffrey S. Larson  <jeff@circularlabs.com>
+ * All rights reserved.
+ * See the LICENSE file for the full copyright and license declaration.
+ *
+ * ---------------------------------------------------------------------
+ *
+ * Headless Mobius driven by blocks of audio supplied by the caller
+ * rather than an audio device.  Used by the offline renderer and
+ * the benchmarks.
+ *
+ * This requires the OfflineAudioInterface and NullMidiEnv so
+ * it is only built on Linux, see makefile.linux.
+ *
+ */
+
+#ifndef OFFLINE_ENGINE_H
+#define OFFLINE_ENGINE_H
+
+class OfflineEngine {
+
+  public:
+
+	OfflineEngine();
+	~OfflineEngine();
+
+    // configuration, before start()
+
+	void setInstallationDirectory(const char* s);
+	void setConfigurationDirectory(const char* s);
+    void setSampleRate(int rate);
+    void setBlockFrames(long frames);
+    void setTracks(int tracks);
+    void setParallelTracks(int workers);
+    void setTraceLevel(int level);
+    void addScript(const char* path);
+
+	bool start();
+	void stop();
+
+    class Mobius* getMobius();
+    int getSampleRate();
+    long getBlockFrames();
+    long long getFrames();
+
+    // actions, applied at the start of the next block
+
+    bool doFunction(const char* name, int track);
+    bool doFunction(const char* name, int track, bool down);
+    bool setParameter(const char* name, const char* value, int track);
+
+  private:
+
+    bool doFunction(const char* name, int track, bool down, bool sustain);
+
+  public:
+
+    // run one block of getBlockFrames() interleaved stereo frames
+
+    void process(float* input, float* output);
+
+  private:
+
+    class MobiusContext* mContext;
+    class MidiInterface* mMidi;
+    class OfflineAudioInterface* mAudio;
+    class OfflineAudioStream* mStream;
+    class NullMidiTimer* mTimer;
+    class Mobius* mMobius;
+    class ScriptConfig* mScripts;
+
+    char* mInstallationDirectory;
+    char* mConfigurationDirectory;
+    int mSampleRate;
+    long mBlockFrames;
+    int mTracks;
+    int mParallelTracks;
+    int mTraceLevel;
+
+    /**
+     * Milliseconds we've advanced the MIDI timer, kept in step
+     * with the frames we've processed.
+     */
+    long long mMillis;
+
+};
+
+/****************************************************************************/
+/****************************************************************************/
+/****************************************************************************/
+#endif
@@ -52,6 +52,7 @@
 #include <math.h>
 
 #include "Util.h"
+#include "Thread.h"
 #include "Map.h"
 #include "XmlModel.h"
 #include "XmlBuffer.h"
@@ -61,6 +62,7 @@
 #include "Action.h"
 #include "MobiusInterface.h"
 #include "Export.h"
+#include "MobiusState.h"
 #include "Expr.h"
 
 // these should be refactored
@@ -81,6 +83,7 @@
 #define ATT_INPUT_PORT "inputPort"
 #define ATT_OUTPUT_PORT "outputPort"
 #define ATT_OUTPUT_HOST "outputHost"
+#define ATT_EXPORT_INTERVAL "exportInterval"
 #define ATT_TRACE "trace" 
 #define EL_BINDING_SET "OscBindingSet"
 #define EL_OSC_CONFIG "OscConfig"
@@ -189,6 +192,7 @@ PRIVATE void OscConfig::init()
 	mInputPort = 0;
 	mOutputHost = NULL;
 	mOutputPort = 0;
+    mExportInterval = 0;
 	mBindings = NULL;
     mWatchers = NULL;
 }
@@ -236,6 +240,16 @@ PUBLIC void OscConfig::setOutputPort(int i)
 	mOutputPort = i;
 }
 
+PUBLIC int OscConfig::getExportInterval()
+{
+	return mExportInterval;
+}
+
+PUBLIC void OscConfig::setExportInterval(int i)
+{
+	mExportInterval = i;
+}
+
 PUBLIC OscBindingSet* OscConfig::getBindings()
 {
 	return mBindings;
@@ -254,6 +268,7 @@ PRIVATE void OscConfig::parseXml(XmlElement* e)
 	mInputPort = e->getIntAttribute(ATT_INPUT_PORT);
 	mOutputPort = e->getIntAttribute(ATT_OUTPUT_PORT);
 	setOutputHost(e->getAttribute(ATT_OUTPUT_HOST));
+	mExportInterval = e->getIntAttribute(ATT_EXPORT_INTERVAL);
 
 	for (XmlElement* child = e->getChildElement() ; child != NULL ; 
 		 child = child->getNextElement()) {
@@ -283,6 +298,7 @@ PRIVATE void OscConfig::toXml(XmlBuffer* b)
 	b->addAttribute(ATT_INPUT_PORT, mInputPort);
 	b->addAttribute(ATT_OUTPUT_PORT, mOutputPort);
 	b->addAttribute(ATT_OUTPUT_HOST, mOutputHost);
+	b->addAttribute(ATT_EXPORT_INTERVAL, mExportInterval);
 	b->add(">\n");
 	b->incIndent();
 
@@ -323,6 +339,7 @@ PRIVATE void OscBindingSet::init()
 	mInputPort = 0;
 	mOutputHost = NULL;
 	mOutputPort = 0;
+    mExportInterval = 0;
 	mBindings = NULL;
 }
 
@@ -416,6 +433,16 @@ PUBLIC void OscBindingSet::setOutputPort(int i)
 	mOutputPort = i;
 }
 
+PUBLIC int OscBindingSet::getExportInterval()
+{
+	return mExportInterval;
+}
+
+PUBLIC void OscBindingSet::setExportInterval(int i)
+{
+	mExportInterval = i;
+}
+
 PUBLIC Binding* OscBindingSet::getBindings()
 {
 	return mBindings;
@@ -428,6 +455,7 @@ PRIVATE void OscBindingSet::parseXml(XmlElement* e)
 	mInputPort = e->getIntAttribute(ATT_INPUT_PORT);
 	mOutputPort = e->getIntAttribute(ATT_OUTPUT_PORT);
 	setOutputHost(e->getAttribute(ATT_OUTPUT_HOST));
+	mExportInterval = e->getIntAttribute(ATT_EXPORT_INTERVAL);
 
     setName(e->getAttribute(ATT_NAME));
 
@@ -454,6 +482,7 @@ PRIVATE void OscBindingSet::toXml(XmlBuffer* b)
 	b->addAttribute(ATT_INPUT_PORT, mInputPort);
 	b->addAttribute(ATT_OUTPUT_PORT, mOutputPort);
 	b->addAttribute(ATT_OUTPUT_HOST, mOutputHost);
+	b->addAttribute(ATT_EXPORT_INTERVAL, mExportInterval);
 	b->add(">\n");
 	b->incIndent();
 
@@ -508,6 +537,12 @@ PUBLIC OscBinding::OscBinding(MobiusInterface* m, Binding* b, Action* a)
         if (mExport != NULL) {
             mMin = mExport->getMinimum();
             mMax = mExport->getMaximum();
+
+            // enumerations and booleans send every change
+            mExportEpsilon = b->getExportEpsilon();
+            if (mExportEpsilon < 0)
+              mExportEpsilon = (mExport->isContinuous()) ? 
+                OSC_EXPORT_EPSILON : 0;
         }
     }
 }
@@ -524,6 +559,13 @@ PUBLIC void OscBinding::init()
     mMin = 0;
     mMax = 0;
     mId = 0;
+    mExportMessage = NULL;
+    mExportEpsilon = 0;
+    mExportedValue = 0;
+    mExported = false;
+    mHolding = false;
+    mHeldValue = 0;
+    mHoldStart = 0;
 }
 
 PUBLIC OscBinding::~OscBinding()
@@ -531,6 +573,7 @@ PUBLIC OscBinding::~OscBinding()
     delete mAction;
     delete mExport;
     delete mExportAddress;
+    delete mExportMessage;
     
 	OscBinding *el, *next;
 	for (el = mNext ; el != NULL ; el = next) {
@@ -649,17 +692,52 @@ PUBLIC void OscBinding::setValue(float value)
 //
 
 /**
- * Refresh the exported value and return true if it changed
- * since the last export
+ * Refresh the exported value and return true if it needs to be sent.
+ * It does if it moved more than the epsilon since the last time it
+ * was sent.  Reaching either end of the range is always sent so
+ * faders don't stop just short of it.
+ *
+ * A smaller change is held back while the value is still moving.
+ * It is sent once the value stops changing between refreshes, or
+ * after it has been held for OSC_EXPORT_MAX_HOLD milliseconds, so
+ * the last value always gets out.
+ *
+ * The state is the last one published by the interrupt, it is
+ * NULL during initialization and the value is read from the tracks.
  */
-PUBLIC bool OscBinding::refreshValue()
+PUBLIC bool OscBinding::refreshValue(StateSnapshot* state, bool force)
 {
 	bool changed = false;
     if (mExport != NULL) {
-        int value = mExport->getOrdinalValue();
-        if (value != mExport->getLast()) {
-            changed = true;
-            mExport->setLast(value);
+        int value = mExport->getOrdinalValue(state);
+        mExport->setLast(value);
+
+        if (force || !mExported)
+          changed = true;
+        else if (value != mExportedValue) {
+            int delta = value - mExportedValue;
+            if (delta < 0)
+              delta = -delta;
+            changed = (delta > mExportEpsilon || 
+                       value == mMin || value == mMax);
+
+            if (!changed) {
+                long long now = GetClockTicks();
+                if (!mHolding) {
+                    mHolding = true;
+                    mHoldStart = now;
+                }
+                else if (value == mHeldValue ||
+                         ClockTicksToMicros(now - mHoldStart) >= 
+                         OSC_EXPORT_MAX_HOLD * 1000) {
+                    changed = true;
+                }
+                mHeldValue = value;
+            }
+        }
+        else {
+            // came back to what was sent, nothing to hold
+            mHolding = false;
         }
     }
 	return changed;
@@ -673,6 +751,31 @@ PUBLIC float OscBinding::getExportValue()
     return OscScaleValueOut(mExport->getLast(), mMin, mMax);
 }
 
+/**
+ * Return the message to send the refreshed value.
+ * We keep one so they don't have to be built on every refresh.
+ */
+PUBLIC OscMessage* OscBinding::getExportMessage()
+{
+    if (mExportMessage == NULL) {
+        mExportMessage = new OscMessage();
+        mExportMessage->setAddress(mExportAddress);
+    }
+    // TODO: more flexible on arg placement...
+    mExportMessage->setArg(0, getExportValue());
+    return mExportMessage;
+}
+
+/**
+ * Called after the refreshed value was sent.
+ */
+PUBLIC void OscBinding::setExported()
+{
+    mExportedValue = mExport->getLast();
+    mExported = true;
+    mHolding = false;
+}
+
 //////////////////////////////////////////////////////////////////////
 //
 // OscWatcher
@@ -904,6 +1007,129 @@ void OscRuntimeWatcher::send(float value)
     }
 }
 
+//////////////////////////////////////////////////////////////////////
+//
+// OscExportDevice
+//
+//////////////////////////////////////////////////////////////////////
+
+PUBLIC OscExportDevice::OscExportDevice(OscDevice* device)
+{
+    mNext = NULL;
+    mDevice = device;
+    mBindings = new List();
+    mChanged = NULL;
+    mMessages = NULL;
+    mMaxChanged = 0;
+    mInterval = 0;
+    mLastExport = 0;
+    mExported = false;
+}
+
+PUBLIC OscExportDevice::~OscExportDevice()
+{
+    // we don't own the device or the bindings
+    delete mBindings;
+    delete mChanged;
+    delete mMessages;
+
+	OscExportDevice *el, *next;
+	for (el = mNext ; el != NULL ; el = next) {
+		next = el->getNext();
+		el->setNext(NULL);
+		delete el;
+	}
+}
+
+PUBLIC OscExportDevice* OscExportDevice::getNext()
+{
+    return mNext;
+}
+
+PUBLIC void OscExportDevice::setNext(OscExportDevice* d)
+{
+    mNext = d;
+}
+
+PUBLIC OscDevice* OscExportDevice::getDevice()
+{
+    return mDevice;
+}
+
+/**
+ * Bindings from different sets may go to the same device,
+ * if they disagree use the shortest interval.
+ */
+PUBLIC void OscExportDevice::setInterval(int millis)
+{
+    if (millis > 0 && (mInterval == 0 || millis < mInterval))
+      mInterval = millis;
+}
+
+PUBLIC void OscExportDevice::add(OscBinding* b)
+{
+    mBindings->add(b);
+}
+
+/**
+ * Send the bindings that changed enough since they were last sent.
+ * If we sent something less than the interval ago, wait for a later
+ * refresh.  The bindings remember what they last sent so changes made
+ * while we wait go out then.
+ */
+PUBLIC void OscExportDevice::exportStatus(OscInterface* osc, 
+                                          StateSnapshot* state,
+                                          bool force, bool trace)
+{
+    long long now = GetClockTicks();
+    bool ready = true;
+
+    if (!force && mExported && mInterval > 0) {
+        double millis = ClockTicksToMicros(now - mLastExport) / 1000.0;
+        ready = (millis >= mInterval);
+    }
+
+    if (ready) {
+        int count = mBindings->size();
+        if (count > mMaxChanged) {
+            delete mChanged;
+            delete mMessages;
+            mChanged = new OscBinding*[count];
+            mMessages = new OscMessage*[count];
+            mMaxChanged = count;
+        }
+
+        int changes = 0;
+        for (int i = 0 ; i < count ; i++) {
+            OscBinding* b = (OscBinding*)mBindings->get(i);
+            if (b->refreshValue(state, force)) {
+                OscMessage* msg = b->getExportMessage();
+                mChanged[changes] = b;
+                mMessages[changes] = msg;
+                changes++;
+
+                if (trace) {
+                    printf("OSC send: %s %f\n", msg->getAddress(), 
+                           msg->getArg(0));
+                    fflush(stdout);
+                        
+                    char buf[80];
+                    sprintf(buf, "%f", msg->getArg(0));
+                    Trace(2, "OSC send: %s %s\n", msg->getAddress(), buf);
+                }
+            }
+        }
+
+        if (changes > 0) {
+            osc->send(mDevice, mMessages, changes);
+            for (int i = 0 ; i < changes ; i++)
+              mChanged[i]->setExported();
+            mLastExport = now;
+            mExported = true;
+        }
+    }
+}
+
 //////////////////////////////////////////////////////////////////////
 //
 // OscResolver
@@ -1066,7 +1292,8 @@ PRIVATE OscBinding* OscResolver::getBinding(const char* trigger)
 
 /**
  * After creating an OscBinding either from the OscConfig or dynamically,
- * see if it can be added to the exports list.
+ * see if it can be added to the exports list.  Exports are grouped
+ * by device so their changes can be sent together.
  */
 PRIVATE void OscResolver::addExport(OscBindingSet* set, OscBinding* ob)
 {
@@ -1075,11 +1302,13 @@ PRIVATE void OscResolver::addExport(OscBindingSet* set, OscBinding* ob)
         OscDevice* device = NULL;
         const char* host = NULL;
         int port = 0;
+        int interval = 0;
 
         // first check the bindingset
         if (set != NULL) {
             host = set->getOutputHost();
             port = set->getOutputPort();
+            interval = set->getExportInterval();
         }
 
         // then the OscConfig
@@ -1088,6 +1317,8 @@ PRIVATE void OscResolver::addExport(OscBindingSet* set, OscBinding* ob)
               host = mConfig->getOutputHost();
             if (port <= 0)
               port = mConfig->getOutputPort();
+            if (interval <= 0)
+              interval = mConfig->getExportInterval();
         }
 
         // finally fall back to global config
@@ -1111,9 +1342,18 @@ PRIVATE void OscResolver::addExport(OscBindingSet* set, OscBinding* ob)
 
             ob->setExportDevice(device);
 
-            if (mExports == NULL)
-              mExports = new List();
-            mExports->add(ob);
+            OscExportDevice* exp = mExports;
+            while (exp != NULL && exp->getDevice() != device)
+              exp = exp->getNext();
+
+            if (exp == NULL) {
+                exp = new OscExportDevice(device);
+                exp->setNext(mExports);
+                mExports = exp;
+            }
+
+            exp->setInterval(interval);
+            exp->add(ob);
         }
     }
 }
@@ -1200,42 +1440,14 @@ PUBLIC void OscResolver::oscMessage(OscMessage* msg)
 }
 
 /**
- * Send messages for each exportable binding.
+ * Send messages for each exportable binding that changed.
  * Called once during initialization to send initial state,
  * and periodically by MobiusThread.
  */
-PUBLIC void OscResolver::exportStatus(bool force)
+PUBLIC void OscResolver::exportStatus(StateSnapshot* state, bool force)
 {
-    if (mExports != NULL) {
-        for (int i = 0 ; i < mExports->size() ; i++) {
-            OscBinding* exp = (OscBinding*)mExports->get(i);
-
-            if (exp->refreshValue() || force) {
-
-                OscDevice* dev = exp->getExportDevice();
-                if (dev != NULL) {
-                    OscMessage msg;
-                    const char* address = exp->getExportAddress();
-                    float neu = exp->getExportValue();
-
-                    msg.setAddress(address);
-                    // TODO: more flexible on arg placement...
-                    msg.setArg(0, neu);
-
-                    if (mTrace) {
-                        printf("OSC send: %s %f\n", address, neu);
-                        fflush(stdout);
-                        
-                        char buf[80];
-                        sprintf(buf, "%f", neu);
-                        Trace(2, "OSC send: %s %s\n", address, buf);
-                    }
-
-                    mOsc->send(dev, &msg);
-                }
-            }
-        }
-    }
+    for (OscExportDevice* exp = mExports ; exp != NULL ; exp = exp->getNext())
+      exp->exportStatus(mOsc, state, force, mTrace);
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -1419,7 +1631,7 @@ PUBLIC void OscRuntime::reloadConfigurationFile(MobiusInterface* m)
                 mResolver = res;
 
                 // since the outputs may have changed, export
-                mResolver->exportStatus(true);
+                mResolver->exportStatus(NULL, true);
 
                 // register the watchers    
                 registerWatchers(config);
@@ -1502,13 +1714,27 @@ PUBLIC void OscRuntime::oscMessage(OscMessage* msg)
     msg->free();
 }
 
+/**
+ * Print what we've sent, the number of packets is what matters
+ * most to a wireless network.
+ */
+PUBLIC void OscRuntime::dump()
+{
+    OscStatistics stats;
+    mOsc->getStatistics(&stats);
+
+    printf("OSC: %ld messages, %ld bundles, %ld packets, %lld bytes\n",
+           stats.messages, stats.bundles, stats.packets, stats.bytes);
+    fflush(stdout);
+}
+
 /**
  * Called by MobiusThread periodically to export status.
  */
-PUBLIC void OscRuntime::exportStatus()
+PUBLIC void OscRuntime::exportStatus(StateSnapshot* state)
 {
     if (mResolver != NULL)
-      mResolver->exportStatus(false);
+      mResolver->exportStatus(state, false);
 
     // let each of the watchers know, in case they want to do something
     // that happens outside of an interrupt
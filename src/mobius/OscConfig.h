@@ -41,6 +41,8 @@ class OscConfig {
 	void setOutputHost(const char* s);
 	int getOutputPort();
 	void setOutputPort(int i);
+	int getExportInterval();
+	void setExportInterval(int i);
 
 	class OscBindingSet* getBindings();
     class OscWatcher* getWatchers();
@@ -71,6 +73,12 @@ class OscConfig {
 	 */
 	int mOutputPort;
 
+	/**
+	 * The default minimum number of milliseconds between
+	 * exports to one device.  Zero sends on every refresh.
+	 */
+	int mExportInterval;
+
 	/**
 	 * Binding sets.  Unlike BindinConfigs several of these can be
 	 * active at a time.
@@ -126,6 +134,8 @@ class OscBindingSet {
 	void setOutputHost(const char* s);
 	int getOutputPort();
 	void setOutputPort(int i);
+	int getExportInterval();
+	void setExportInterval(int i);
 
 	Binding* getBindings();
 	void setBindings(Binding* b);
@@ -180,6 +190,12 @@ class OscBindingSet {
 	 */
 	int mOutputPort;
 
+	/**
+	 * Export interval for the bindings in this set,
+	 * overrides the default in the OscConfig.
+	 */
+	int mExportInterval;
+
 	/**
 	 * Bindings for this set.
 	 * You can mix bindings from different devices but if you
@@ -197,6 +213,19 @@ class OscBindingSet {
 //
 ////////////////////////////////////////////////////////////////////////
 
+/**
+ * The default amount a continuous value has to move before it is
+ * exported again, in the units of the parameter.  The exportEpsilon
+ * attribute of the Binding overrides it.
+ */
+#define OSC_EXPORT_EPSILON 2
+
+/**
+ * The longest an exported value may be held back by the epsilon
+ * while it is still changing, in milliseconds.
+ */
+#define OSC_EXPORT_MAX_HOLD 250
+
 /**
  * This wraps an Action to add some extra intellence for OSC.
  * 
@@ -232,11 +261,10 @@ class OscBinding {
 
     const char* getExportAddress();
 
-    int getLast();
-    void setLast(int f);
-
-    bool refreshValue();
+    bool refreshValue(class StateSnapshot* state, bool force);
     float getExportValue();
+    class OscMessage* getExportMessage();
+    void setExported();
 
     void setValue(float value);
 
@@ -255,6 +283,18 @@ class OscBinding {
     int mMax;
     int mId;
 
+    // the value last sent and how far it has to move to send again
+    class OscMessage* mExportMessage;
+    int mExportEpsilon;
+    int mExportedValue;
+    bool mExported;
+
+    // a value held back by the epsilon, the value seen on the
+    // last refresh and when we started holding it
+    bool mHolding;
+    int mHeldValue;
+    long long mHoldStart;
+
 	// value state for function bindings
 	int mFunctionValue;
 	bool mFunctionDown;
@@ -352,6 +392,50 @@ class OscRuntimeWatcher : public WatchPointListener
     bool mTrace;
 };
 
+//////////////////////////////////////////////////////////////////////
+//
+// OscExportDevice
+//
+////////////////////////////////////////////////////////////////////////
+
+/**
+ * The exported bindings going to one OscDevice.  Changes are
+ * collected on each refresh and sent together in bundles, no more
+ * often than the export interval.
+ */
+class OscExportDevice {
+
+  public:
+
+    OscExportDevice(class OscDevice* device);
+    ~OscExportDevice();
+
+    OscExportDevice* getNext();
+    void setNext(OscExportDevice* d);
+
+    class OscDevice* getDevice();
+    void setInterval(int millis);
+    void add(OscBinding* b);
+
+    void exportStatus(class OscInterface* osc, class StateSnapshot* state,
+                      bool force, bool trace);
+
+  private:
+
+    OscExportDevice* mNext;
+    class OscDevice* mDevice;
+    List* mBindings;
+
+    // bindings with changes and their messages, sized to mBindings
+    OscBinding** mChanged;
+    class OscMessage** mMessages;
+    int mMaxChanged;
+
+    int mInterval;
+    long long mLastExport;
+    bool mExported;
+};
+
 //////////////////////////////////////////////////////////////////////
 //
 // OscResolver
@@ -380,7 +464,7 @@ class OscResolver {
     void setTrace(bool b);
 
     void oscMessage(OscMessage* msg);
-	void exportStatus(bool force);
+	void exportStatus(class StateSnapshot* state, bool force);
 
   private:
 
@@ -395,7 +479,7 @@ class OscResolver {
     class OscConfig* mConfig;
     OscBinding* mBindings;
     class Map* mBindingMap;
-    List* mExports;
+    OscExportDevice* mExports;
 
     bool mTrace;
 };
@@ -434,7 +518,12 @@ class OscRuntime : public OscListener {
     /**
      * Periodically called by MobiusThread to send out status messages.
      */
-	void exportStatus();
+	void exportStatus(class StateSnapshot* state);
+
+    /**
+     * Print what has been sent for Mobius::logStatus.
+     */
+    void dump();
 
   private:
 
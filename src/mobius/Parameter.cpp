@@ -24,6 +24,7 @@
 #include "Util.h"
 #include "List.h"
 #include "MessageCatalog.h"
+#include "SymbolTable.h"
 #include "XmlModel.h"
 #include "XmlBuffer.h"
 
@@ -154,6 +155,14 @@ PUBLIC int Parameter::getOrdinalValue(Export* exp)
     return -1;
 }
 
+/**
+ * Only the track parameters published in TrackState overload this.
+ */
+PUBLIC bool Parameter::getStateValue(TrackState* state, int* value)
+{
+    return false;
+}
+
 PUBLIC void Parameter::setValue(Action* action)
 {
     Trace(1, "Parameter %s: setValue not overloaded!\n",
@@ -492,27 +501,39 @@ PUBLIC int Parameter::getEnum(ExValue *value)
 //
 //////////////////////////////////////////////////////////////////////
 
+/**
+ * Symbol tables for the Parameters array, built by initParameters
+ * and localizeAll.  Other groups are still searched.
+ */
+PRIVATE SymbolTable* ParameterTable = NULL;
+PRIVATE SymbolTable* ParameterDisplayTable = NULL;
+
 PUBLIC Parameter* Parameter::getParameter(Parameter** group, 
 										  const char* name)
 {
 	Parameter* found = NULL;
-	
-	for (int i = 0 ; group[i] != NULL && found == NULL ; i++) {
-		Parameter* p = group[i];
-		if (StringEqualNoCase(p->getName(), name))
-		  found = p;
-	}
 
-	if (found == NULL) {
-		// not a name match, try aliases
+	if (group == Parameters && ParameterTable != NULL) {
+		found = (Parameter*)ParameterTable->get(name);
+	}
+	else {
 		for (int i = 0 ; group[i] != NULL && found == NULL ; i++) {
 			Parameter* p = group[i];
-			for (int j = 0 ; 
-				 j < MAX_PARAMETER_ALIAS && p->aliases[j] != NULL ; 
-				 j++) {
-				if (StringEqualNoCase(p->aliases[j], name)) {
-					found = p;
-					break;
+			if (StringEqualNoCase(p->getName(), name))
+			  found = p;
+		}
+
+		if (found == NULL) {
+			// not a name match, try aliases
+			for (int i = 0 ; group[i] != NULL && found == NULL ; i++) {
+				Parameter* p = group[i];
+				for (int j = 0 ; 
+					 j < MAX_PARAMETER_ALIAS && p->aliases[j] != NULL ; 
+					 j++) {
+					if (StringEqualNoCase(p->aliases[j], name)) {
+						found = p;
+						break;
+					}
 				}
 			}
 		}
@@ -525,12 +546,17 @@ PUBLIC Parameter* Parameter::getParameterWithDisplayName(Parameter** group,
 														 const char* name)
 {
 	Parameter* found = NULL;
-	
-	for (int i = 0 ; group[i] != NULL ; i++) {
-		Parameter* p = group[i];
-		if (StringEqualNoCase(p->getDisplayName(), name)) {
-			found = p;
-			break;	
+
+	if (group == Parameters && ParameterDisplayTable != NULL) {
+		found = (Parameter*)ParameterDisplayTable->get(name);
+	}
+	else {
+		for (int i = 0 ; group[i] != NULL ; i++) {
+			Parameter* p = group[i];
+			if (StringEqualNoCase(p->getDisplayName(), name)) {
+				found = p;
+				break;	
+			}
 		}
 	}
 	return found;
@@ -625,6 +651,7 @@ PUBLIC void Parameter::initParameters()
         add(RecordResetsFeedbackParameter);
         add(RecordThresholdParameter);
         add(RecordTransferParameter);
+        add(ResampleQualityParameter);
         add(ReturnLocationParameter);
         add(ReverseTransferParameter);
         add(RoundingOverdubParameter);
@@ -765,6 +792,20 @@ PUBLIC void Parameter::initParameters()
                       Parameters[i]->getName());
             }
         }
+
+        // names win over aliases like the old search
+        SymbolTable* table = new SymbolTable();
+        int i;
+        for (i = 0 ; Parameters[i] != NULL ; i++)
+          table->intern(Parameters[i]->getName(), Parameters[i]);
+        for (i = 0 ; Parameters[i] != NULL ; i++) {
+            Parameter* p = Parameters[i];
+            for (int j = 0 ; 
+                 j < MAX_PARAMETER_ALIAS && p->aliases[j] != NULL ; 
+                 j++)
+              table->intern(p->aliases[j], p);
+        }
+        ParameterTable = table;
     }
 }
 
@@ -778,6 +819,14 @@ PUBLIC void Parameter::localizeAll(MessageCatalog* cat)
 	for (i = 0 ; Parameters[i] != NULL ; i++)
 	  Parameters[i]->localize(cat);
 
+	// display names changed, rebuild the table
+	SymbolTable* table = new SymbolTable();
+	for (i = 0 ; Parameters[i] != NULL ; i++)
+	  table->intern(Parameters[i]->getDisplayName(), Parameters[i]);
+	SymbolTable* old = ParameterDisplayTable;
+	ParameterDisplayTable = table;
+	delete old;
+
 	// these are shared by all
 	for (i = 0 ; BOOLEAN_VALUE_NAMES[i] != NULL; i++) {
 		const char* msg = cat->get(BOOLEAN_VALUE_KEYS[i]);
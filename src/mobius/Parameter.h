@@ -137,6 +137,13 @@ class Parameter : public SystemConstant {
     // maybe this can be a quality of the Export?
     virtual int getOrdinalValue(class Export* exp);
 
+    /**
+     * Get the ordinal value from a published TrackState.
+     * Returns false if the parameter isn't kept there and the
+     * live value must be used.
+     */
+    virtual bool getStateValue(class TrackState* state, int* value);
+
 	//
 	// Coercion helpers
 	//
@@ -249,6 +256,7 @@ extern Parameter* TimeStretchRangeParameter;
 extern Parameter* RecordResetsFeedbackParameter;
 extern Parameter* RecordThresholdParameter;
 extern Parameter* RecordTransferParameter;
+extern Parameter* ResampleQualityParameter;
 extern Parameter* ReturnLocationParameter;
 extern Parameter* ReverseTransferParameter;
 extern Parameter* RoundingOverdubParameter;
@@ -1805,6 +1805,58 @@ void TimeStretchRangeParameterType::setValue(Preset* p, ExValue* value)
 
 PUBLIC Parameter* TimeStretchRangeParameter = new TimeStretchRangeParameterType();
 
+//////////////////////////////////////////////////////////////////////
+//
+// ResampleQuality
+//
+//////////////////////////////////////////////////////////////////////
+
+class ResampleQualityParameterType : public PresetParameter
+{
+  public:
+	ResampleQualityParameterType();
+    int getOrdinalValue(Preset* p);
+	void getValue(Preset* p, ExValue* value);
+	void setValue(Preset* p, ExValue* value);
+};
+
+const char* RESAMPLE_QUALITY_NAMES[] = {
+	"linear", "sinc8", "sinc32", NULL
+};
+
+int RESAMPLE_QUALITY_KEYS[] = {
+	MSG_VALUE_RESAMPLE_LINEAR,
+	MSG_VALUE_RESAMPLE_SINC8,
+	MSG_VALUE_RESAMPLE_SINC32,
+	0
+};
+
+ResampleQualityParameterType::ResampleQualityParameterType() :
+    PresetParameter("resampleQuality", MSG_PARAM_RESAMPLE_QUALITY)
+{
+	bindable = true;
+	type = TYPE_ENUM;
+	values = RESAMPLE_QUALITY_NAMES;
+	valueKeys = RESAMPLE_QUALITY_KEYS;
+}
+
+int ResampleQualityParameterType::getOrdinalValue(Preset* p)
+{
+	return p->getResampleQuality();
+}
+
+void ResampleQualityParameterType::getValue(Preset* p, ExValue* value)
+{
+	value->setString(values[p->getResampleQuality()]);
+}
+
+void ResampleQualityParameterType::setValue(Preset* p, ExValue* value)
+{
+	p->setResampleQuality((Preset::ResampleQuality)getEnum(value));
+}
+
+PUBLIC Parameter* ResampleQualityParameter = new ResampleQualityParameterType();
+
 //////////////////////////////////////////////////////////////////////
 //
 // SlipMode
@@ -36,6 +36,7 @@
 #include "Messages.h"
 #include "Mobius.h"
 #include "MobiusConfig.h"
+#include "MobiusState.h"
 #include "Mode.h"
 #include "Project.h"
 #include "Recorder.h"
@@ -237,6 +238,7 @@ class FocusParameterType : public TrackParameter
 	void getValue(Track* t, ExValue* value);
 	void setValue(Track* t, ExValue* value);
     int getOrdinalValue(Track* t);
+    bool getStateValue(TrackState* s, int* value);
 };
 
 FocusParameterType::FocusParameterType() :
@@ -273,6 +275,12 @@ int FocusParameterType::getOrdinalValue(Track* t)
     return (int)t->isFocusLock();
 }
 
+bool FocusParameterType::getStateValue(TrackState* s, int* value)
+{
+    *value = (int)s->focusLock;
+    return true;
+}
+
 PUBLIC Parameter* FocusParameter = new FocusParameterType();
 
 //////////////////////////////////////////////////////////////////////
@@ -288,6 +296,7 @@ class GroupParameterType : public TrackParameter
 	void getValue(SetupTrack* t, ExValue* value);
 	void setValue(SetupTrack* t, ExValue* value);
     int getOrdinalValue(Track* t);
+    bool getStateValue(TrackState* s, int* value);
 	void getValue(Track* t, ExValue* value);
 	void setValue(Track* t, ExValue* value);
 
@@ -319,6 +328,12 @@ int GroupParameterType::getOrdinalValue(Track* t)
     return t->getGroup();
 }
 
+bool GroupParameterType::getStateValue(TrackState* s, int* value)
+{
+    *value = s->group;
+    return true;
+}
+
 void GroupParameterType::getValue(Track* t, ExValue* value)
 {
     value->setInt(t->getGroup());
@@ -454,6 +469,7 @@ class FeedbackLevelParameterType : public TrackParameter
 	void getValue(Track* t, ExValue* value);
 	void setValue(Track* t, ExValue* value);
     int getOrdinalValue(Track* t);
+    bool getStateValue(TrackState* s, int* value);
 };
 
 FeedbackLevelParameterType::FeedbackLevelParameterType() :
@@ -493,6 +509,12 @@ int FeedbackLevelParameterType::getOrdinalValue(Track* t)
     return t->getFeedback();
 }
 
+bool FeedbackLevelParameterType::getStateValue(TrackState* s, int* value)
+{
+    *value = s->feedback;
+    return true;
+}
+
 PUBLIC Parameter* FeedbackLevelParameter = new FeedbackLevelParameterType();
 
 //////////////////////////////////////////////////////////////////////
@@ -512,6 +534,7 @@ class AltFeedbackLevelParameterType : public TrackParameter
 	void getValue(Track* t, ExValue* value);
 	void setValue(Track* t, ExValue* value);
     int getOrdinalValue(Track* t);
+    bool getStateValue(TrackState* s, int* value);
 };
 
 AltFeedbackLevelParameterType::AltFeedbackLevelParameterType() :
@@ -551,6 +574,12 @@ int AltFeedbackLevelParameterType::getOrdinalValue(Track* t)
     return t->getAltFeedback();
 }
 
+bool AltFeedbackLevelParameterType::getStateValue(TrackState* s, int* value)
+{
+    *value = s->altFeedback;
+    return true;
+}
+
 PUBLIC Parameter* AltFeedbackLevelParameter = new AltFeedbackLevelParameterType();
 
 //////////////////////////////////////////////////////////////////////
@@ -568,6 +597,7 @@ class InputLevelParameterType : public TrackParameter
 	void getValue(Track* t, ExValue* value);
 	void setValue(Track* t, ExValue* value);
     int getOrdinalValue(Track* t);
+    bool getStateValue(TrackState* s, int* value);
 };
 
 InputLevelParameterType::InputLevelParameterType() :
@@ -607,6 +637,12 @@ int InputLevelParameterType::getOrdinalValue(Track* t)
     return t->getInputLevel();
 }
 
+bool InputLevelParameterType::getStateValue(TrackState* s, int* value)
+{
+    *value = s->inputLevel;
+    return true;
+}
+
 PUBLIC Parameter* InputLevelParameter = new InputLevelParameterType();
 
 //////////////////////////////////////////////////////////////////////
@@ -624,6 +660,7 @@ class OutputLevelParameterType : public TrackParameter
 	void getValue(Track* t, ExValue* value);
 	void setValue(Track* t, ExValue* value);
     int getOrdinalValue(Track* t);
+    bool getStateValue(TrackState* s, int* value);
 };
 
 OutputLevelParameterType::OutputLevelParameterType() :
@@ -663,6 +700,12 @@ int OutputLevelParameterType::getOrdinalValue(Track* t)
     return t->getOutputLevel();
 }
 
+bool OutputLevelParameterType::getStateValue(TrackState* s, int* value)
+{
+    *value = s->outputLevel;
+    return true;
+}
+
 PUBLIC Parameter* OutputLevelParameter = new OutputLevelParameterType();
 
 //////////////////////////////////////////////////////////////////////
@@ -680,6 +723,7 @@ class PanParameterType : public TrackParameter
 	void getValue(Track* t, ExValue* value);
 	void setValue(Track* t, ExValue* value);
     int getOrdinalValue(Track* t);
+    bool getStateValue(TrackState* s, int* value);
 };
 
 PanParameterType::PanParameterType() :
@@ -723,6 +767,12 @@ int PanParameterType::getOrdinalValue(Track* t)
     return t->getPan();
 }
 
+bool PanParameterType::getStateValue(TrackState* s, int* value)
+{
+    *value = s->pan;
+    return true;
+}
+
 PUBLIC Parameter* PanParameter = new PanParameterType();
 
 //////////////////////////////////////////////////////////////////////
@@ -743,6 +793,7 @@ class SpeedOctaveParameterType : public TrackParameter
 	void getValue(Track* t, ExValue* value);
     void setValue(Action* action);
     int getOrdinalValue(Track* t);
+    bool getStateValue(TrackState* s, int* value);
 };
 
 SpeedOctaveParameterType::SpeedOctaveParameterType() :
@@ -788,6 +839,12 @@ int SpeedOctaveParameterType::getOrdinalValue(Track* t)
     return t->getSpeedOctave();
 }
 
+bool SpeedOctaveParameterType::getStateValue(TrackState* s, int* value)
+{
+    *value = s->speedOctave;
+    return true;
+}
+
 PUBLIC Parameter* SpeedOctaveParameter = new SpeedOctaveParameterType();
 
 //////////////////////////////////////////////////////////////////////
@@ -805,6 +862,7 @@ class SpeedStepParameterType : public TrackParameter
 	void getValue(Track* t, ExValue* value);
     void setValue(Action* action);
     int getOrdinalValue(Track* t);
+    bool getStateValue(TrackState* s, int* value);
 };
 
 /**
@@ -861,6 +919,12 @@ int SpeedStepParameterType::getOrdinalValue(Track* t)
     return t->getSpeedStep();
 }
 
+bool SpeedStepParameterType::getStateValue(TrackState* s, int* value)
+{
+    *value = s->speedStep;
+    return true;
+}
+
 PUBLIC Parameter* SpeedStepParameter = new SpeedStepParameterType();
 
 //////////////////////////////////////////////////////////////////////
@@ -878,6 +942,7 @@ class SpeedBendParameterType : public TrackParameter
 	void getValue(Track* t, ExValue* value);
 	void setValue(Action* action);
     int getOrdinalValue(Track* t);
+    bool getStateValue(TrackState* s, int* value);
 };
 
 SpeedBendParameterType::SpeedBendParameterType() :
@@ -921,6 +986,12 @@ int SpeedBendParameterType::getOrdinalValue(Track* t)
     return t->getSpeedBend();
 }
 
+bool SpeedBendParameterType::getStateValue(TrackState* s, int* value)
+{
+    *value = s->speedBend;
+    return true;
+}
+
 PUBLIC Parameter* SpeedBendParameter = new SpeedBendParameterType();
 
 //////////////////////////////////////////////////////////////////////
@@ -941,6 +1012,7 @@ class PitchOctaveParameterType : public TrackParameter
 	void getValue(Track* t, ExValue* value);
 	void setValue(Action* action);
     int getOrdinalValue(Track* t);
+    bool getStateValue(TrackState* s, int* value);
 };
 
 PitchOctaveParameterType::PitchOctaveParameterType() :
@@ -987,6 +1059,12 @@ int PitchOctaveParameterType::getOrdinalValue(Track* t)
     return t->getPitchOctave();
 }
 
+bool PitchOctaveParameterType::getStateValue(TrackState* s, int* value)
+{
+    *value = s->pitchOctave;
+    return true;
+}
+
 PUBLIC Parameter* PitchOctaveParameter = new PitchOctaveParameterType();
 
 //////////////////////////////////////////////////////////////////////
@@ -1004,6 +1082,7 @@ class PitchStepParameterType : public TrackParameter
 	void getValue(Track* t, ExValue* value);
 	void setValue(Action* action);
     int getOrdinalValue(Track* t);
+    bool getStateValue(TrackState* s, int* value);
 };
 
 /**
@@ -1059,6 +1138,12 @@ int PitchStepParameterType::getOrdinalValue(Track* t)
     return t->getPitchStep();
 }
 
+bool PitchStepParameterType::getStateValue(TrackState* s, int* value)
+{
+    *value = s->pitchStep;
+    return true;
+}
+
 PUBLIC Parameter* PitchStepParameter = new PitchStepParameterType();
 
 //////////////////////////////////////////////////////////////////////
@@ -1076,6 +1161,7 @@ class PitchBendParameterType : public TrackParameter
 	void getValue(Track* t, ExValue* value);
 	void setValue(Action* action);
     int getOrdinalValue(Track* t);
+    bool getStateValue(TrackState* s, int* value);
 };
 
 PitchBendParameterType::PitchBendParameterType() :
@@ -1119,6 +1205,12 @@ int PitchBendParameterType::getOrdinalValue(Track* t)
     return t->getPitchBend();
 }
 
+bool PitchBendParameterType::getStateValue(TrackState* s, int* value)
+{
+    *value = s->pitchBend;
+    return true;
+}
+
 PUBLIC Parameter* PitchBendParameter = new PitchBendParameterType();
 
 //////////////////////////////////////////////////////////////////////
@@ -1136,6 +1228,7 @@ class TimeStretchParameterType : public TrackParameter
 	void getValue(Track* t, ExValue* value);
 	void setValue(Action* action);
     int getOrdinalValue(Track* t);
+    bool getStateValue(TrackState* s, int* value);
 };
 
 TimeStretchParameterType::TimeStretchParameterType() :
@@ -1184,6 +1277,12 @@ int TimeStretchParameterType::getOrdinalValue(Track* t)
     return t->getTimeStretch();
 }
 
+bool TimeStretchParameterType::getStateValue(TrackState* s, int* value)
+{
+    *value = s->timeStretch;
+    return true;
+}
+
 PUBLIC Parameter* TimeStretchParameter = new TimeStretchParameterType();
 
 //////////////////////////////////////////////////////////////////////
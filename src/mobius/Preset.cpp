@@ -134,6 +134,7 @@ PUBLIC void Preset::reset()
     mPitchStepRange     = DEFAULT_STEP_RANGE;
     mPitchBendRange     = DEFAULT_BEND_RANGE;
     mTimeStretchRange   = DEFAULT_BEND_RANGE;
+    mResampleQuality    = RESAMPLE_LINEAR;
 
     // Loop Switch
 	mSwitchVelocity		= false;
@@ -218,6 +219,7 @@ PUBLIC void Preset::copy(Preset* src)
     mPitchStepRange     = src->mPitchStepRange;
     mPitchBendRange     = src->mPitchBendRange;
     mTimeStretchRange   = src->mTimeStretchRange;
+    mResampleQuality    = src->mResampleQuality;
 
     // Loop Switch
     mEmptyLoopAction = src->mEmptyLoopAction;
@@ -789,6 +791,18 @@ int Preset::getTimeStretchRange()
     return mTimeStretchRange;
 }
 
+void Preset::setResampleQuality(ResampleQuality q) {
+	mResampleQuality = q;
+}
+
+void Preset::setResampleQuality(int i) {
+	setResampleQuality((ResampleQuality)i);
+}
+
+Preset::ResampleQuality Preset::getResampleQuality() {
+	return mResampleQuality;
+}
+
 void Preset::setSlipMode(SlipMode sm) {
 	mSlipMode = sm;
 }
@@ -318,6 +318,16 @@ class Preset : public Bindable {
     int getTimeStretchRange();
     void setTimeStretchRange(int i);
 
+	typedef enum {
+		RESAMPLE_LINEAR,
+		RESAMPLE_SINC8,
+		RESAMPLE_SINC32
+	} ResampleQuality;
+
+	void setResampleQuality(ResampleQuality q);
+	void setResampleQuality(int i);
+	ResampleQuality getResampleQuality();
+
     //
     // Loop Switch
     //
@@ -724,6 +734,14 @@ class Preset : public Bindable {
      */
     int mTimeStretchRange;
 
+    /**
+     * The interpolation used by the Resampler when the speed is
+     * shifted.  Linear is the cheapest, the sinc filters avoid
+     * aliasing at large shifts at the cost of some CPU and a small
+     * fixed delay.
+     */
+    ResampleQuality mResampleQuality;
+
     //
     // Loop Switch
     //
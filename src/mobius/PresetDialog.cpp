@@ -280,6 +280,7 @@ PUBLIC PresetDialog::PresetDialog(Window* parent, MobiusInterface* mob,
     mPitchStep =  addNumber(form, PitchStepRangeParameter);
     mPitchBend =  addNumber(form, PitchBendRangeParameter);
     mTimeStretch =  addNumber(form, TimeStretchRangeParameter);
+    mResampleQuality = addCombo(form, ResampleQualityParameter);
 
     // Sustain tab
 
@@ -426,6 +427,7 @@ void PresetDialog::refreshFields()
     mPitchStep->setValue(mPreset->getPitchStepRange());
     mPitchBend->setValue(mPreset->getPitchBendRange());
     mTimeStretch->setValue(mPreset->getTimeStretchRange());
+    mResampleQuality->setValue((int)mPreset->getResampleQuality());
 
     const char* susfuncs = mPreset->getSustainFunctions();
     if (susfuncs != NULL) {
@@ -509,6 +511,7 @@ void PresetDialog::captureFields()
     mPreset->setPitchStepRange(mPitchStep->getValue());
     mPreset->setPitchBendRange(mPitchBend->getValue());
     mPreset->setTimeStretchRange(mTimeStretch->getValue());
+    mPreset->setResampleQuality(mResampleQuality->getSelectedIndex());
 
 	StringList* dispnames = mSustainFunctions->getValues();
 	if (dispnames != NULL) {
@@ -17,6 +17,7 @@
 #include <math.h>
 
 #include "Util.h"
+#include "Thread.h"
 #include "List.h"
 #include "XmlModel.h"
 #include "XmlBuffer.h"
@@ -28,6 +29,8 @@
 #include "MobiusConfig.h"
 #include "Layer.h"
 #include "Project.h"
+#include "ProjectFile.h"
+#include "ProjectSnapshot.h"
 #include "Setup.h"
 #include "Segment.h"
 #include "Track.h"
@@ -88,6 +91,78 @@
 #define ATT_CONTAINS_DEFERRED_FADE_RIGHT "containsDeferredFadeRight"
 #define ATT_REVERSE_RECORD "reverseRecord"
 
+/****************************************************************************
+ *                                                                          *
+ *                                 PROGRESS                                 *
+ *                                                                          *
+ ****************************************************************************/
+
+PUBLIC ProjectProgress::ProjectProgress()
+{
+    reset();
+}
+
+PUBLIC ProjectProgress::~ProjectProgress()
+{
+}
+
+PUBLIC void ProjectProgress::reset()
+{
+    total = 0;
+    done = 0;
+}
+
+/****************************************************************************
+ *                                                                          *
+ *                              PROJECT WORKER                              *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * Thread that helps a Project flatten or write its layers.
+ * Workers are signaled after they start and claim layers until there
+ * are none left, see Project::runLayers.  A signal sent before the
+ * thread is waiting is lost so we also look on a short timeout.
+ */
+class ProjectWorker : public Thread {
+
+  public:
+
+    ProjectWorker(Project* p, int number);
+	~ProjectWorker();
+
+    void processEvent();
+    void eventTimeout();
+
+  private:
+
+    Project* mProject;
+
+};
+
+PUBLIC ProjectWorker::ProjectWorker(Project* p, int number)
+{
+    char name[64];
+    sprintf(name, "ProjectWorker %d", number);
+    setName(name);
+    setTimeout(PROJECT_WORKER_TIMEOUT);
+    mProject = p;
+}
+
+PUBLIC ProjectWorker::~ProjectWorker()
+{
+}
+
+void ProjectWorker::processEvent()
+{
+    mProject->processLayers();
+}
+
+void ProjectWorker::eventTimeout()
+{
+    mProject->processLayers();
+}
+
 
 /****************************************************************************
  *                                                                          *
@@ -279,42 +354,12 @@ PUBLIC ProjectLayer::ProjectLayer(MobiusConfig* config, Project* p, Layer* l)
 	mContainsDeferredFadeRight = l->isContainsDeferredFadeRight();
 	mReverseRecord = l->isReverseRecord();
 
-    // if NoFlattening is on then we must save segments
-    if (!l->isNoFlattening()) {
-
-        // this will make a copy we own
-        setAudio(l->flatten());
-
-        // the Isolated Overdubs global parameter was experimental
-        // and is no longer exposed, so this should never be true
-        // and we won't have an mOverdub object or an mOverdubPath
-		if (l->isIsolatedOverdub()) {
-			Audio* a = l->getOverdub();
-			if (a != NULL && !a->isEmpty()) {
-                // have to copy this since the mExternalAudio flag
-                // must apply to both mAudio and mOverdub
-                AudioPool* pool = a->getPool();
-                if (pool == NULL)
-                  Trace(1, "ProjectLayer: no audio pool!\n");
-                else {
-                    Audio* ov = pool->newAudio();
-                    ov->copy(a);
-                    setOverdub(ov);
-                    // since we're going to save this in a file, 
-                    // set the correct sample rate
-                    ov->setSampleRate(l->getLoop()->getMobius()->getSampleRate());
-                }
-            }
-		}
-    }
-	else {
-		// we don't own the Audio objects so don't delete them
-		mExternalAudio = true;
-
-		Audio* a = l->getAudio();
-		if (!a->isEmpty())
-		  setAudio(a);
+    // the Audio is copied later by flatten, the layer is held
+    // by a ProjectSnapshot until then
+    mSource = l;
 
+    // if NoFlattening is on then we must save segments
+    if (l->isNoFlattening()) {
 		for (Segment* seg = l->getSegments() ; seg != NULL ; 
 			 seg = seg->getNext()) {
 			ProjectSegment* ps = new ProjectSegment(config, seg);
@@ -346,6 +391,7 @@ PUBLIC void ProjectLayer::init()
 	mDeferredFadeLeft = false;
 	mDeferredFadeRight = false;
 	mReverseRecord = false;
+    mSource = NULL;
 	mLayer = NULL;
 }
 
@@ -556,6 +602,98 @@ PUBLIC void ProjectLayer::add(ProjectSegment* seg)
 	mSegments->add(seg);
 }
 
+/**
+ * True if we were built from a Layer that hasn't been flattened yet.
+ */
+PUBLIC bool ProjectLayer::isFlattenPending()
+{
+    return (mSource != NULL);
+}
+
+/**
+ * Copy the Audio from the layer we were built from.
+ * This is called by Project worker threads while the interrupt
+ * keeps running.  The layer is finalized but it may still get
+ * a deferred fade, here or in one of the layers its Segments reach.
+ * If the combined generation changes while we're flattening we try
+ * again.
+ *
+ * Returns false if it kept changing, we don't keep a copy that
+ * may have half a fade in it and the project can't be saved.
+ */
+PUBLIC bool ProjectLayer::flatten()
+{
+    bool stable = true;
+    Layer* l = mSource;
+    if (l == NULL)
+      return true;
+
+    int sampleRate = l->getLoop()->getMobius()->getSampleRate();
+
+    if (!l->isNoFlattening()) {
+
+        stable = false;
+        for (int i = 0 ; i < PROJECT_FLATTEN_RETRIES && !stable ; i++) {
+            int generation = l->getContentGeneration();
+
+            // this will make a copy we own
+            setAudio(l->flatten());
+
+            stable = (l->getContentGeneration() == generation);
+            if (!stable)
+              Trace(2, "ProjectLayer: Layer %ld changed during flattening\n",
+                    (long)l->getNumber());
+        }
+
+        if (!stable) {
+            Trace(1, "ProjectLayer: Layer %ld still changing after %ld flattens\n",
+                  (long)l->getNumber(), (long)PROJECT_FLATTEN_RETRIES);
+            setAudio(NULL);
+        }
+
+        // the Isolated Overdubs global parameter was experimental
+        // and is no longer exposed, so this should never be true
+        // and we won't have an mOverdub object or an mOverdubPath
+		if (l->isIsolatedOverdub()) {
+			Audio* a = l->getOverdub();
+			if (a != NULL && !a->isEmpty()) {
+                AudioPool* pool = a->getPool();
+                if (pool == NULL)
+                  Trace(1, "ProjectLayer: no audio pool!\n");
+                else {
+                    Audio* ov = pool->newAudio();
+                    ov->copy(a);
+                    setOverdub(ov);
+                    // since we're going to save this in a file, 
+                    // set the correct sample rate
+                    ov->setSampleRate(sampleRate);
+                }
+            }
+		}
+    }
+	else {
+        // The segments reference the layer Audio so we can't flatten,
+        // but we still make our own copy.  The buffers are shared
+        // with the layer so this is cheap, and we don't depend on the
+        // layer surviving until the project is written.
+		Audio* a = l->getAudio();
+		if (a != NULL && !a->isEmpty()) {
+            AudioPool* pool = a->getPool();
+            if (pool == NULL)
+              Trace(1, "ProjectLayer: no audio pool!\n");
+            else {
+                Audio* copy = pool->newAudio();
+                copy->copy(a);
+                copy->setSampleRate(sampleRate);
+                setAudio(copy);
+            }
+        }
+	}
+
+    mSource = NULL;
+    return stable;
+}
+
 void ProjectLayer::writeAudio(const char* baseName, int tracknum, int loopnum,
 							  int layernum)
 {
@@ -584,6 +722,30 @@ void ProjectLayer::writeAudio(const char* baseName, int tracknum, int loopnum,
 
 }
 
+/**
+ * Add our Audio to a project container and remember where it went.
+ * Protected layers normally reference a file we don't own, but if
+ * they came from a container we have to carry them along since the
+ * old numbers won't mean anything in the new one.
+ */
+void ProjectLayer::packAudio(ProjectFile* file)
+{
+	char path[64];
+
+    bool packed = (mPath != NULL && 
+                   StartsWith(mPath, PROJECT_FILE_AUDIO_PREFIX));
+
+    if (mAudio != NULL && !mAudio->isEmpty() && (!mProtected || packed)) {
+        sprintf(path, "%s%d", PROJECT_FILE_AUDIO_PREFIX, file->add(mAudio));
+        setPath(path);
+    }
+
+	if (mOverdub != NULL && !mOverdub->isEmpty()) {
+        sprintf(path, "%s%d", PROJECT_FILE_AUDIO_PREFIX, file->add(mOverdub));
+		setOverdubPath(path);
+	}
+}
+
 
 void ProjectLayer::toXml(XmlBuffer* b)
 {
@@ -660,7 +822,13 @@ PUBLIC ProjectLoop::ProjectLoop(XmlElement* e)
 	parseXml(e);
 }
 
-PUBLIC ProjectLoop::ProjectLoop(MobiusConfig* config, Project* p, Loop* l)
+/**
+ * Build the loop from the layers captured in a snapshot.
+ * The snapshot has the play layer followed by the undo layers
+ * if saveLayers is on.
+ */
+PUBLIC ProjectLoop::ProjectLoop(MobiusConfig* config, Project* p,
+                                ProjectSnapshot* snap, int track, int loop)
 {
 	init();
 
@@ -670,14 +838,12 @@ PUBLIC ProjectLoop::ProjectLoop(MobiusConfig* config, Project* p, Loop* l)
     // to prevent saving it in some cases
 	//setFrame(l->getFrame());
 
-	Layer* layer = l->getPlayLayer();
-	while (layer != NULL) {
-		add(new ProjectLayer(config, p, layer));
-		if (config->isSaveLayers())
-		  layer = layer->getPrev();
-		else
-		  layer = NULL;
-	}
+    int count = snap->getLayerCount();
+    for (int i = 0 ; i < count ; i++) {
+        SnapshotLayer* sl = snap->getLayer(i);
+        if (sl->track == track && sl->loop == loop)
+          add(new ProjectLayer(config, p, sl->layer));
+    }
 }
 
 PUBLIC void ProjectLoop::init()
@@ -777,19 +943,6 @@ void ProjectLoop::resolveLayers(Project* p)
 	}
 }
 
-void ProjectLoop::writeAudio(const char* baseName, int tracknum, int loopnum)
-{
-	if (mLayers != NULL) {
-		for (int i = 0 ; i < mLayers->size() ; i++) {
-			ProjectLayer* layer = (ProjectLayer*)mLayers->get(i);
-			// use the layer id, it makes more sense
-			//int layernum = i + 1;
-			int layernum = layer->getId();
-			layer->writeAudio(baseName, tracknum, loopnum, layernum);
-		}
-	}
-}
-
 void ProjectLoop::toXml(XmlBuffer* b)
 {
 	b->addOpenStartTag(EL_LOOP);
@@ -843,7 +996,8 @@ PUBLIC ProjectTrack::ProjectTrack(XmlElement* e)
 	parseXml(e);
 }
 
-PUBLIC ProjectTrack::ProjectTrack(MobiusConfig* config, Project* p, Track* t)
+PUBLIC ProjectTrack::ProjectTrack(MobiusConfig* config, Project* p, Track* t,
+                                  ProjectSnapshot* snap)
 {
 	int i;
 
@@ -877,17 +1031,14 @@ PUBLIC ProjectTrack::ProjectTrack(MobiusConfig* config, Project* p, Track* t)
           setPreset(pre->getName());
     }
 
-	// suppress emitting XML for empty loops at the end
-	int last = t->getLoopCount();
-	for (i = last - 1 ; i >= 0 ; i--) {
-		if (t->getLoop(i)->isEmpty())
-		  last--;
-	}
+	// the snapshot suppresses empty loops at the end
+    int track = t->getRawNumber();
+	int last = snap->getLoopCount(track);
+    int active = snap->getActiveLoop(track);
 
 	for (i = 0 ; i < last ; i++) {
-		Loop* l = t->getLoop(i);
-		ProjectLoop* pl = new ProjectLoop(config, p, l);
-		if (l == t->getLoop())
+		ProjectLoop* pl = new ProjectLoop(config, p, snap, track, i);
+		if (i == active)
 		  pl->setActive(true);
 		add(pl);
 	}
@@ -1150,16 +1301,6 @@ PUBLIC void ProjectTrack::getVariable(const char* name, ExValue* value)
 	  mVariables->get(name, value);
 }
 
-void ProjectTrack::writeAudio(const char* baseName, int tracknum)
-{
-	if (mLoops != NULL) {
-		for (int i = 0 ; i < mLoops->size() ; i++) {
-			ProjectLoop* loop = (ProjectLoop*)mLoops->get(i);
-			loop->writeAudio(baseName, tracknum, i + 1);
-		}
-	}
-}
-
 Layer* ProjectTrack::findLayer(int id)
 {
 	Layer* found = NULL;
@@ -1342,6 +1483,15 @@ PRIVATE void Project::init()
 	mNumTokens = 0;
 
 	mFinished = false;
+    mProgress = NULL;
+
+    mJobs = NULL;
+    mJobCount = 0;
+    mNextJob = 0;
+    mJobsDone = 0;
+    mJobsFailed = 0;
+    mJobOp = PROJECT_OP_FLATTEN;
+    mJobBaseName = NULL;
 }
 
 PUBLIC Project::~Project()
@@ -1432,7 +1582,12 @@ PUBLIC void Project::getVariable(const char* name, ExValue* value)
 	  mVariables->get(name, value);
 }
 
-PUBLIC void Project::setTracks(Mobius* m)
+/**
+ * Build the track hierarchy from the layers captured in a snapshot.
+ * The layers are not flattened until flatten is called, which
+ * must happen before the snapshot is released.
+ */
+PUBLIC void Project::setTracks(Mobius* m, ProjectSnapshot* snap)
 {
 	int i;
 
@@ -1453,13 +1608,36 @@ PUBLIC void Project::setTracks(Mobius* m)
 
 	for (i = 0 ; i < last ; i++) {
 		Track* t = m->getTrack(i);
-		ProjectTrack* pt = new ProjectTrack(config, this, t);
-		if (t == m->getTrack())
+		ProjectTrack* pt = new ProjectTrack(config, this, t, snap);
+		if (i == snap->getActiveTrack())
 		  pt->setActive(true);
 		add(pt);
 	}
 }
 
+/**
+ * Copy the Audio from the layers set by setTracks.
+ * If a layer couldn't be copied the project is in error
+ * and must not be written.
+ */
+PUBLIC void Project::flatten()
+{
+    runLayers(PROJECT_OP_FLATTEN, NULL);
+
+    if (mJobsFailed > 0) {
+        // localize!!
+        char msg[128];
+        sprintf(msg, "Unable to save %d layers, they changed while saving", 
+                mJobsFailed);
+        setErrorMessage(msg);
+    }
+}
+
+PUBLIC void Project::setProgress(ProjectProgress* p)
+{
+    mProgress = p;
+}
+
 PUBLIC void Project::setPath(const char* path)
 {
 	delete mPath;
@@ -1690,8 +1868,23 @@ PRIVATE void Project::read(AudioPool* pool, const char* file)
 	else {
 		fclose(fp);
         
+        // the container has the XML and the audio in one file,
+        // otherwise it is an XML file and a wave file for each layer
+        ProjectFile* container = NULL;
         XomParser* p = new XomParser();
-        XmlDocument* d = p->parseFile(path);
+        XmlDocument* d = NULL;
+        if (!EndsWithNoCase(path, PROJECT_FILE_EXTENSION))
+          d = p->parseFile(path);
+        else {
+            container = new ProjectFile();
+            if (container->read(path))
+              d = p->parse(container->getXml(), container->getXmlLength());
+            else {
+                strcpy(mMessage, container->getError());
+                mError = true;
+            }
+        }
+
         if (d != NULL) {
             XmlElement* e = d->getChildElement();
             if (e != NULL) {
@@ -1700,7 +1893,7 @@ PRIVATE void Project::read(AudioPool* pool, const char* file)
             }
             delete d;
         }
-        else {
+        else if (!mError) {
             // there was a syntax error in the file
             sprintf(mMessage, "Unable to read file %s: %s\n", 
                     path, p->getError());
@@ -1708,15 +1901,25 @@ PRIVATE void Project::read(AudioPool* pool, const char* file)
         }
         delete p;
 
-        readAudio(pool);
+        readAudio(pool, container);
+
+        // the Audio we made hold their own references
+        if (container != NULL)
+          container->decReferences();
     }
 }
 
 /**
  * After reading the Project structure from XML, traverse the hierarhcy
  * and load any referenced Audio files.
+ *
+ * Paths starting with PROJECT_FILE_AUDIO_PREFIX are in the container
+ * we were read from.  These Audios are empty until they are played,
+ * the buffers are filled from the mapped file as they are touched.
+ * The front of the layers that will be played first is loaded now
+ * so the interrupt doesn't start by copying from the mapping.
  */
-PRIVATE void Project::readAudio(AudioPool* pool)
+PRIVATE void Project::readAudio(AudioPool* pool, ProjectFile* file)
 {
     if (pool != NULL && mTracks != NULL) {
         for (int i = 0 ; i < mTracks->size() ; i++) {
@@ -1730,11 +1933,15 @@ PRIVATE void Project::readAudio(AudioPool* pool)
                         for (int k = 0 ; k < layers->size() ; k++) {
                             ProjectLayer* layer = (ProjectLayer*)layers->get(k);
                             const char* path = layer->getPath();
-                            if (path != NULL)
-							  layer->setAudio(pool->newAudio(path));
+                            if (path != NULL) {
+                                Audio* audio = newAudio(pool, file, path);
+                                if (audio != NULL && k < PROJECT_PRELOAD_LAYERS)
+                                  audio->loadPendingBlocks(0, PROJECT_PRELOAD_BLOCKS);
+                                layer->setAudio(audio);
+                            }
                             path = layer->getOverdubPath();
                             if (path != NULL)
-							  layer->setOverdub(pool->newAudio(path));
+							  layer->setOverdub(newAudio(pool, file, path));
                         }
                     }
                 }
@@ -1743,6 +1950,18 @@ PRIVATE void Project::readAudio(AudioPool* pool)
     }
 }
 
+/**
+ * Make the Audio for one layer path.
+ */
+PRIVATE Audio* Project::newAudio(AudioPool* pool, ProjectFile* file,
+                                 const char* path)
+{
+    if (file != NULL && StartsWith(path, PROJECT_FILE_AUDIO_PREFIX))
+      return file->newAudio(pool, ToInt(&path[strlen(PROJECT_FILE_AUDIO_PREFIX)]));
+
+    return pool->newAudio(path);
+}
+
 PUBLIC void Project::write()
 {
     if (mPath != NULL)
@@ -1757,11 +1976,17 @@ PUBLIC void Project::write(const char* file, bool isTemplate)
 	mError = false;
 	strcpy(mMessage, "");
 
-	if (EndsWithNoCase(file, ".mob"))
+	if (EndsWithNoCase(file, ".mob") || 
+        EndsWithNoCase(file, PROJECT_FILE_EXTENSION))
 	  strcpy(path, file);
 	else
 	  sprintf(path, "%s.mob", file);
 
+    if (EndsWithNoCase(path, PROJECT_FILE_EXTENSION)) {
+        writePacked(path, isTemplate);
+        return;
+    }
+
 	// calculate the base file name to be used for Audio files
 	strcpy(baseName, path);
 	int psn = LastIndexOf(baseName, ".");
@@ -1800,12 +2025,187 @@ PUBLIC void Project::write(const char* file, bool isTemplate)
 
 void Project::writeAudio(const char* baseName)
 {
-	if (mTracks != NULL) {
-		for (int i = 0 ; i < mTracks->size() ; i++) {
-			ProjectTrack* track = (ProjectTrack*)mTracks->get(i);
-			track->writeAudio(baseName, i + 1);
-		}
-	}
+    runLayers(PROJECT_OP_WRITE, baseName);
+}
+
+/**
+ * Write the project and all of its Audio to a single container file.
+ * There are no layer files to clean up, the old container
+ * is replaced when the new one is complete.
+ */
+PRIVATE void Project::writePacked(const char* path, bool isTemplate)
+{
+    ProjectFile* file = new ProjectFile();
+
+    // first add the Audio and assign Layer paths
+    if (!isTemplate)
+      packAudio(file);
+
+    XmlBuffer* b = new XmlBuffer();
+    toXml(b, isTemplate);
+    if (!file->write(path, b->getString())) {
+        strcpy(mMessage, file->getError());
+        mError = true;
+    }
+    delete b;
+
+    file->decReferences();
+}
+
+PRIVATE void Project::packAudio(ProjectFile* file)
+{
+    if (mTracks != NULL) {
+        for (int i = 0 ; i < mTracks->size() ; i++) {
+            ProjectTrack* track = (ProjectTrack*)mTracks->get(i);
+            List* loops = track->getLoops();
+            if (loops != NULL) {
+                for (int j = 0 ; j < loops->size() ; j++) {
+                    ProjectLoop* loop = (ProjectLoop*)loops->get(j);
+                    List* layers = loop->getLayers();
+                    if (layers != NULL) {
+                        for (int k = 0 ; k < layers->size() ; k++) {
+                            ProjectLayer* layer = (ProjectLayer*)layers->get(k);
+                            layer->packAudio(file);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Flatten or write every layer in the project using worker threads.
+ * Layers are independent so we just hand them out in order,
+ * a worker claims the next one with an atomic increment.  We work
+ * too and return when every layer has been done.
+ */
+PRIVATE void Project::runLayers(int op, const char* baseName)
+{
+	int i, j, k;
+
+    if (mTracks == NULL)
+      return;
+
+    int count = 0;
+    for (i = 0 ; i < mTracks->size() ; i++) {
+        ProjectTrack* track = (ProjectTrack*)mTracks->get(i);
+        List* loops = track->getLoops();
+        if (loops != NULL) {
+            for (j = 0 ; j < loops->size() ; j++) {
+                ProjectLoop* loop = (ProjectLoop*)loops->get(j);
+                List* layers = loop->getLayers();
+                if (layers != NULL)
+                  count += layers->size();
+            }
+        }
+    }
+
+    mJobs = new ProjectLayerJob[(count > 0) ? count : 1];
+    mJobCount = 0;
+
+    for (i = 0 ; i < mTracks->size() ; i++) {
+        ProjectTrack* track = (ProjectTrack*)mTracks->get(i);
+        List* loops = track->getLoops();
+        if (loops != NULL) {
+            for (j = 0 ; j < loops->size() ; j++) {
+                ProjectLoop* loop = (ProjectLoop*)loops->get(j);
+                List* layers = loop->getLayers();
+                if (layers != NULL) {
+                    for (k = 0 ; k < layers->size() ; k++) {
+                        ProjectLayer* layer = (ProjectLayer*)layers->get(k);
+                        if (op == PROJECT_OP_WRITE || 
+                            layer->isFlattenPending()) {
+                            ProjectLayerJob* job = &mJobs[mJobCount++];
+                            job->layer = layer;
+                            job->track = i + 1;
+                            job->loop = j + 1;
+                            // use the layer id, it makes more sense,
+                            // but it is only set when we're saving
+                            // segments, don't let the files collide
+                            job->number = layer->getId();
+                            if (job->number == 0)
+                              job->number = k + 1;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    if (mJobCount > 0) {
+        long long start = GetClockTicks();
+
+        mJobOp = op;
+        mJobBaseName = baseName;
+        mNextJob = 0;
+        mJobsDone = 0;
+        mJobsFailed = 0;
+        if (mProgress != NULL)
+          AtomicAdd(&mProgress->total, mJobCount);
+        AtomicBarrier();
+
+        ProjectWorker* workers[PROJECT_MAX_WORKERS];
+        int workerCount = mJobCount - 1;
+        if (workerCount > PROJECT_MAX_WORKERS)
+          workerCount = PROJECT_MAX_WORKERS;
+
+        for (i = 0 ; i < workerCount ; i++) {
+            workers[i] = new ProjectWorker(this, i + 1);
+            workers[i]->start();
+            workers[i]->signal();
+        }
+
+        processLayers();
+
+        // wait for the workers to finish the ones they claimed
+        while (mJobsDone < mJobCount)
+          SleepMillis(1);
+
+        // ask them all to stop before waiting on any of them
+        for (i = 0 ; i < workerCount ; i++)
+          workers[i]->stop();
+
+        for (i = 0 ; i < workerCount ; i++) {
+            if (workers[i]->stopAndWait())
+              delete workers[i];
+            else
+              Trace(1, "Project: Unable to stop worker thread!\n");
+        }
+
+        Trace(2, "Project: %s %ld layers with %ld workers in %ld usec\n",
+              ((op == PROJECT_OP_WRITE) ? "Wrote" : "Flattened"),
+              (long)mJobCount, (long)workerCount,
+              (long)ClockTicksToMicros(GetClockTicks() - start));
+    }
+
+    delete mJobs;
+    mJobs = NULL;
+    mJobCount = 0;
+    mJobBaseName = NULL;
+}
+
+/**
+ * Claim layers until there are none left.
+ * Called by runLayers and the worker threads.
+ */
+PRIVATE void Project::processLayers()
+{
+    int next;
+
+    while ((next = AtomicIncrement(&mNextJob) - 1) < mJobCount) {
+        ProjectLayerJob* job = &mJobs[next];
+
+        if (mJobOp == PROJECT_OP_WRITE)
+          job->layer->writeAudio(mJobBaseName, job->track, job->loop,
+                                 job->number);
+        else if (!job->layer->flatten())
+          AtomicIncrement(&mJobsFailed);
+
+        if (mProgress != NULL)
+          AtomicIncrement(&mProgress->done);
+        AtomicIncrement(&mJobsDone);
+    }
 }
 
 /****************************************************************************/
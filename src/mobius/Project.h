@@ -14,6 +14,87 @@
 #ifndef PROJECT_H
 #define PROJECT_H
 
+/****************************************************************************
+ *                                                                          *
+ *                                 CONSTANTS                                *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * The maximum number of worker threads used to flatten and write
+ * layers.  The thread that started the save works too.
+ */
+#define PROJECT_MAX_WORKERS 4
+
+/**
+ * Milliseconds a worker thread waits before looking for layers
+ * if it missed the signal.
+ */
+#define PROJECT_WORKER_TIMEOUT 10
+
+/**
+ * The number of times we'll flatten a layer that was changed
+ * by the interrupt while we were flattening it.
+ */
+#define PROJECT_FLATTEN_RETRIES 3
+
+/**
+ * The number of blocks at the front of the play and undo layers
+ * that are loaded from a project file as it is read.  A loaded loop
+ * starts playing at the front, LayerCompressor loads the rest
+ * in MobiusThread ahead of the play frame.
+ */
+#define PROJECT_PRELOAD_BLOCKS 2
+
+/**
+ * The number of layers in each loop that are preloaded.
+ */
+#define PROJECT_PRELOAD_LAYERS 2
+
+/**
+ * Operations performed on layers by the worker threads.
+ */
+#define PROJECT_OP_FLATTEN 0
+#define PROJECT_OP_WRITE 1
+
+/****************************************************************************
+ *                                                                          *
+ *                                 PROGRESS                                 *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * Counters updated as the layers of a project are flattened
+ * and written.  Mobius keeps one for the last save and copies
+ * it into MobiusState for the UI.
+ */
+class ProjectProgress {
+
+  public:
+
+    ProjectProgress();
+    ~ProjectProgress();
+
+    void reset();
+
+    volatile int total;
+    volatile int done;
+
+};
+
+/**
+ * A layer waiting for a worker thread, with the numbers used
+ * to name its Audio file.
+ */
+typedef struct {
+
+    class ProjectLayer* layer;
+    int track;
+    int loop;
+    int number;
+
+} ProjectLayerJob;
+
 /****************************************************************************
  *                                                                          *
  *   							   PROJECT                                  *
@@ -104,8 +185,11 @@ class ProjectLayer {
 
 	void add(ProjectSegment* seg);
 
+    bool isFlattenPending();
+    bool flatten();
 	void writeAudio(const char* baseName, int tracknum, int loopnum, 
 					int layernum);
+    void packAudio(class ProjectFile* file);
 	void toXml(XmlBuffer* b);
 	void parseXml(XmlElement* e);
 
@@ -151,6 +235,13 @@ class ProjectLayer {
 	 */
 	bool mExternalAudio;
 
+    /**
+     * Transient, set during project saving.
+     * The layer we were built from, held by a ProjectSnapshot until
+     * flatten copies its Audio.
+     */
+    Layer* mSource;
+
 	/**
 	 * Transient, set during project loading.
 	 * Segments can reference layers by id, and the layers can appear
@@ -171,7 +262,7 @@ class ProjectLoop {
 	ProjectLoop();
 	ProjectLoop(XmlElement* e);
 	ProjectLoop(class MobiusConfig* config, class Project* proj, 
-				class Loop* loop);
+				class ProjectSnapshot* snap, int track, int loop);
 	~ProjectLoop();
 
 	void add(ProjectLayer* a);
@@ -189,7 +280,6 @@ class ProjectLoop {
 	void setActive(bool b);
 	bool isActive();
 
-	void writeAudio(const char* baseName, int tracknum, int loopnum);
 	void toXml(XmlBuffer* b);
 	void parseXml(XmlElement* e);
 
@@ -231,7 +321,7 @@ class ProjectTrack {
 	ProjectTrack();
 	ProjectTrack(XmlElement* e);
 	ProjectTrack(class MobiusConfig* config, class Project* proj, 
-				 class Track* track);
+				 class Track* track, class ProjectSnapshot* snap);
 	~ProjectTrack();
 
     void setNumber(int n);
@@ -301,7 +391,6 @@ class ProjectTrack {
 	void allocLayers(class LayerPool* pool);
 	void resolveLayers(Project* p);
 
-	void writeAudio(const char* baseName, int tracknum);
 	void toXml(XmlBuffer* b);
 	void toXml(XmlBuffer* b, bool isTemplate);
 	void parseXml(XmlElement* e);
@@ -377,6 +466,8 @@ class ProjectTrack {
  */
 class Project {
 
+    friend class ProjectWorker;
+
   public:
 
 	Project();
@@ -395,7 +486,8 @@ class Project {
 	void clear();
 	Layer* findLayer(int id);
 	void resolveLayers(class LayerPool* pool);
-	void setTracks(Mobius* m);
+	void setTracks(Mobius* m, class ProjectSnapshot* snap);
+    void flatten();
 	void add(ProjectTrack* t);
 	class List* getTracks();
 
@@ -445,6 +537,8 @@ class Project {
 
     void deleteAudioFiles();
 
+    void setProgress(ProjectProgress* p);
+
 	void toXml(XmlBuffer* b);
 	void toXml(XmlBuffer* b, bool isTemplate);
 	void parseXml(XmlElement* e);
@@ -453,8 +547,14 @@ class Project {
 
 	void init();
     void read(class AudioPool* pool, const char* file);
-	void readAudio(class AudioPool* pool);
+	void readAudio(class AudioPool* pool, class ProjectFile* file);
+    Audio* newAudio(class AudioPool* pool, class ProjectFile* file, 
+                    const char* path);
 	void writeAudio(const char* baseName);
+    void writePacked(const char* path, bool isTemplate);
+    void packAudio(class ProjectFile* file);
+    void runLayers(int op, const char* baseName);
+    void processLayers();
 
 	//
 	// Persistent fields
@@ -545,6 +645,22 @@ class Project {
 	 */
 	bool mFinished;
 
+    /**
+     * Where we report layers flattened and written, may be NULL.
+     */
+    ProjectProgress* mProgress;
+
+    //
+    // Worker state, see runLayers
+    //
+
+    ProjectLayerJob* mJobs;
+    int mJobCount;
+    volatile int mNextJob;
+    volatile int mJobsDone;
+    volatile int mJobsFailed;
+    int mJobOp;
+    const char* mJobBaseName;
 
 };
 
@@ -0,0 +1,630 @@
+/*
+ * Copyright (c) 2010 Jeffrey S. Larson  <jeff@circularlabs.com>
+ * All rights reserved.
+ * See the LICENSE file for the full copyright and license declaration.
+ *
+ * ---------------------------------------------------------------------
+ *
+ * Single file container for a project.
+ *
+ * The old project format is an XML file with one wave file for every
+ * layer, and every one of them was read completely into the AudioPool
+ * before the project could be loaded.  For big projects that took a
+ * long time and needed memory for layers that might never be played.
+ *
+ * Here the audio is stored in blocks the size of an Audio buffer with
+ * the all zero blocks left out.  When reading we map the file and
+ * give each layer Audio a ProjectFileSource, a block is copied into
+ * a buffer the first time something touches it.  Loading is just
+ * reading the index and the XML.
+ *
+ * The first touch may happen in the interrupt, which makes it a
+ * memcpy out of the file cache.  We ask the OS to start reading the
+ * file in the background as soon as it is mapped so that is usually
+ * all it is.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "Util.h"
+#include "Trace.h"
+#include "Thread.h"
+#include "List.h"
+#include "MappedFile.h"
+
+#include "Audio.h"
+#include "ProjectFile.h"
+
+/**
+ * Size of the fixed part of the header.
+ */
+#define HEADER_SIZE 56
+
+#define BLOCK_SAMPLES (PROJECT_FILE_BLOCK_FRAMES * PROJECT_FILE_CHANNELS)
+#define BLOCK_BYTES (BLOCK_SAMPLES * sizeof(float))
+
+/****************************************************************************
+ *                                                                          *
+ *                                PROJECT FILE                              *
+ *                                                                          *
+ ****************************************************************************/
+
+PUBLIC ProjectFile::ProjectFile()
+{
+    mReferences = 1;
+    strcpy(mError, "");
+
+    mAudios = NULL;
+    mOffset = 0;
+
+    mFile = NULL;
+    mEntries = NULL;
+    mEntryCount = 0;
+    mIndexEnd = 0;
+    mCorrupt = false;
+    mXmlOffset = 0;
+    mXmlLength = 0;
+}
+
+PRIVATE ProjectFile::~ProjectFile()
+{
+    if (mEntries != NULL) {
+        for (int i = 0 ; i < mEntryCount ; i++) {
+            delete mEntries[i].zeroBlocks;
+            delete mEntries[i].offsets;
+        }
+        delete mEntries;
+    }
+    delete mFile;
+    delete mAudios;
+}
+
+PUBLIC void ProjectFile::incReferences()
+{
+    AtomicIncrement(&mReferences);
+}
+
+/**
+ * Called by Project when it is done and by ProjectFileSource::release.
+ * When the last one goes the file is unmapped.  An Audio reset in the
+ * interrupt gives its source to the Reclaimer so this is never called
+ * in the interrupt.
+ */
+PUBLIC void ProjectFile::decReferences()
+{
+    if (AtomicDecrement(&mReferences) == 0)
+      delete this;
+}
+
+PUBLIC const char* ProjectFile::getError()
+{
+    return mError;
+}
+
+/****************************************************************************
+ *                                                                          *
+ *                                   WRITE                                  *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * Add an Audio to be written and return its number.
+ * The Audio is not copied, it must not change until we're written.
+ */
+PUBLIC int ProjectFile::add(Audio* a)
+{
+    if (mAudios == NULL)
+      mAudios = new List();
+    mAudios->add(a);
+    return mAudios->size() - 1;
+}
+
+PRIVATE void ProjectFile::writeInt(FILE* fp, int value)
+{
+    writeBytes(fp, &value, sizeof(value));
+}
+
+PRIVATE void ProjectFile::writeLong(FILE* fp, long long value)
+{
+    writeBytes(fp, &value, sizeof(value));
+}
+
+PRIVATE void ProjectFile::writeBytes(FILE* fp, const void* bytes,
+                                     long long length)
+{
+    if (length > 0) {
+        fwrite(bytes, 1, (size_t)length, fp);
+        mOffset += length;
+    }
+}
+
+PRIVATE void ProjectFile::writeHeader(FILE* fp, long long indexOffset,
+                                      long long indexLength)
+{
+    int count = (mAudios != NULL) ? mAudios->size() : 0;
+
+    writeBytes(fp, PROJECT_FILE_MAGIC, 4);
+    writeInt(fp, PROJECT_FILE_VERSION);
+    writeInt(fp, PROJECT_FILE_BLOCK_FRAMES);
+    writeInt(fp, PROJECT_FILE_CHANNELS);
+    writeInt(fp, count);
+    writeInt(fp, 0);
+    writeLong(fp, indexOffset);
+    writeLong(fp, indexLength);
+    writeLong(fp, mXmlOffset);
+    writeLong(fp, mXmlLength);
+}
+
+/**
+ * True if a block is all zero and doesn't need to be stored.
+ */
+PRIVATE bool ProjectFile::isZero(float* block)
+{
+    for (int i = 0 ; i < BLOCK_SAMPLES ; i++) {
+        if (block[i] != 0.0f)
+          return false;
+    }
+    return true;
+}
+
+/**
+ * Write the added Audio and the XML.
+ *
+ * The file we're replacing may still be mapped by the Audio we loaded
+ * from it, truncating it would pull the pages out from under them.
+ * We write a new file and rename it over the old one, the mapping
+ * keeps the old one alive until the last Audio lets go.
+ */
+PUBLIC bool ProjectFile::write(const char* path, const char* xml)
+{
+    char temp[1024];
+    int i, b;
+
+    if (strlen(path) + 5 > sizeof(temp)) {
+        sprintf(mError, "File name too long\n");
+        return false;
+    }
+    sprintf(temp, "%s.tmp", path);
+
+    FILE* fp = fopen(temp, "wb");
+    if (fp == NULL) {
+        sprintf(mError, "Unable to open output file: %s\n", temp);
+        return false;
+    }
+
+    int count = (mAudios != NULL) ? mAudios->size() : 0;
+    ProjectFileAudio* entries = new ProjectFileAudio[(count > 0) ? count : 1];
+    float* block = new float[BLOCK_SAMPLES];
+
+    // the header is written again when we know where things are
+    mOffset = 0;
+    mXmlOffset = 0;
+    mXmlLength = 0;
+    writeHeader(fp, 0, 0);
+
+    char pad[PROJECT_FILE_ALIGNMENT];
+    memset(pad, 0, sizeof(pad));
+    writeBytes(fp, pad, PROJECT_FILE_ALIGNMENT - mOffset);
+
+    for (i = 0 ; i < count ; i++) {
+        Audio* a = (Audio*)mAudios->get(i);
+        ProjectFileAudio* e = &entries[i];
+        e->sampleRate = a->getSampleRate();
+        e->channels = PROJECT_FILE_CHANNELS;
+        e->frames = a->getFrames();
+        e->blockCount = (int)((e->frames + PROJECT_FILE_BLOCK_FRAMES - 1) /
+                              PROJECT_FILE_BLOCK_FRAMES);
+
+        int bitmapSize = (e->blockCount + 7) / 8;
+        e->zeroBlocks = new unsigned char[(bitmapSize > 0) ? bitmapSize : 1];
+        memset(e->zeroBlocks, 0, (bitmapSize > 0) ? bitmapSize : 1);
+        e->offsets = new long long[(e->blockCount > 0) ? e->blockCount : 1];
+
+        for (b = 0 ; b < e->blockCount ; b++) {
+            long frame = (long)b * PROJECT_FILE_BLOCK_FRAMES;
+            long frames = e->frames - frame;
+            if (frames > PROJECT_FILE_BLOCK_FRAMES)
+              frames = PROJECT_FILE_BLOCK_FRAMES;
+
+            // get adds to what is already there
+            memset(block, 0, BLOCK_BYTES);
+            a->get(block, frames, frame);
+
+            if (isZero(block)) {
+                e->zeroBlocks[b / 8] |= (1 << (b % 8));
+                e->offsets[b] = 0;
+            }
+            else {
+                e->offsets[b] = mOffset;
+                writeBytes(fp, block, BLOCK_BYTES);
+            }
+        }
+    }
+
+    long long indexOffset = mOffset;
+    for (i = 0 ; i < count ; i++) {
+        ProjectFileAudio* e = &entries[i];
+        int stored = 0;
+        for (b = 0 ; b < e->blockCount ; b++) {
+            if (e->offsets[b] != 0)
+              stored++;
+        }
+
+        writeInt(fp, e->sampleRate);
+        writeInt(fp, e->channels);
+        writeLong(fp, e->frames);
+        writeInt(fp, e->blockCount);
+        writeInt(fp, stored);
+        writeBytes(fp, e->zeroBlocks, (e->blockCount + 7) / 8);
+        for (b = 0 ; b < e->blockCount ; b++) {
+            if (e->offsets[b] != 0)
+              writeLong(fp, e->offsets[b]);
+        }
+    }
+    long long indexLength = mOffset - indexOffset;
+
+    if (xml == NULL)
+      xml = "";
+    mXmlOffset = mOffset;
+    mXmlLength = strlen(xml);
+    writeBytes(fp, xml, mXmlLength + 1);
+
+    fseek(fp, 0, SEEK_SET);
+    writeHeader(fp, indexOffset, indexLength);
+
+    bool ok = (ferror(fp) == 0);
+    if (fclose(fp) != 0)
+      ok = false;
+
+    if (!ok) {
+        sprintf(mError, "Error writing file: %s\n", temp);
+        remove(temp);
+    }
+    else {
+        if (!replace(temp, path)) {
+            sprintf(mError, "Unable to replace %s, project saved as %s\n", 
+                    path, temp);
+            ok = false;
+        }
+    }
+
+    for (i = 0 ; i < count ; i++) {
+        delete entries[i].zeroBlocks;
+        delete entries[i].offsets;
+    }
+    delete entries;
+    delete block;
+
+    return ok;
+}
+
+/**
+ * Move the file we just wrote over the one we're saving to.
+ *
+ * Windows won't rename over an existing file, or remove one that
+ * is mapped.  MappedFile opens with FILE_SHARE_DELETE so we can
+ * move the old file aside and delete it, it stays around under the
+ * other name until the last mapping is closed.  The name is unique
+ * in case the one from the last save is still mapped.
+ */
+PRIVATE bool ProjectFile::replace(const char* temp, const char* path)
+{
+    bool replaced = false;
+
+#ifdef _WIN32
+    if (!IsFile(path))
+      replaced = (rename(temp, path) == 0);
+    else {
+        char old[1100];
+        sprintf(old, "%s.%lu.old", path, (unsigned long)GetTickCount());
+        if (ReplaceFile(path, temp, old, REPLACEFILE_IGNORE_MERGE_ERRORS,
+                        NULL, NULL)) {
+            replaced = true;
+            if (!DeleteFile(old))
+              Trace(1, "ProjectFile: Unable to delete %s\n", old);
+        }
+    }
+#else
+    replaced = (rename(temp, path) == 0);
+#endif
+
+    return replaced;
+}
+
+/****************************************************************************
+ *                                                                          *
+ *                                    READ                                  *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * Map the file and read the index.  The blocks aren't touched.
+ */
+PUBLIC bool ProjectFile::read(const char* path)
+{
+    delete mFile;
+    mFile = new MappedFile();
+
+    if (!mFile->open(path)) {
+        sprintf(mError, "Unable to open file %s\n", path);
+        return false;
+    }
+
+    if (!readIndex()) {
+        sprintf(mError, "Invalid project file %s\n", path);
+        return false;
+    }
+
+    mFile->prefetch();
+    return true;
+}
+
+/**
+ * Read a number from the index, anything that would run off
+ * the end of the index marks the file corrupt.
+ */
+PRIVATE int ProjectFile::readInt(long long* offset)
+{
+    int value = 0;
+    if (*offset + (long long)sizeof(value) > mIndexEnd)
+      mCorrupt = true;
+    else
+      memcpy(&value, mFile->getData() + *offset, sizeof(value));
+    *offset += sizeof(value);
+    return value;
+}
+
+PRIVATE long long ProjectFile::readLong(long long* offset)
+{
+    long long value = 0;
+    if (*offset + (long long)sizeof(value) > mIndexEnd)
+      mCorrupt = true;
+    else
+      memcpy(&value, mFile->getData() + *offset, sizeof(value));
+    *offset += sizeof(value);
+    return value;
+}
+
+/**
+ * Check the header and build the block offset table for each Audio.
+ */
+PRIVATE bool ProjectFile::readIndex()
+{
+    const char* data = mFile->getData();
+    long long size = mFile->getSize();
+    int i, b;
+
+    if (size < HEADER_SIZE || memcmp(data, PROJECT_FILE_MAGIC, 4)) {
+        Trace(1, "ProjectFile: Not a project file\n");
+        return false;
+    }
+
+    // the header is read with the same bounds checks as the index
+    long long offset = 4;
+    mIndexEnd = HEADER_SIZE;
+    mCorrupt = false;
+    int version = readInt(&offset);
+    int blockFrames = readInt(&offset);
+    int channels = readInt(&offset);
+    int count = readInt(&offset);
+    readInt(&offset);
+    long long indexOffset = readLong(&offset);
+    long long indexLength = readLong(&offset);
+    mXmlOffset = readLong(&offset);
+    mXmlLength = readLong(&offset);
+
+    if (version != PROJECT_FILE_VERSION) {
+        Trace(1, "ProjectFile: Unsupported version %ld\n", (long)version);
+        return false;
+    }
+
+    if (blockFrames != PROJECT_FILE_BLOCK_FRAMES ||
+        channels != PROJECT_FILE_CHANNELS) {
+        Trace(1, "ProjectFile: Unsupported block format\n");
+        return false;
+    }
+
+    // the XML is followed by a null, the parser doesn't need it
+    // but we check it is there so a truncated file is caught here
+    if (count < 0 || indexOffset < HEADER_SIZE || indexLength < 0 ||
+        indexOffset + indexLength > size ||
+        mXmlOffset < HEADER_SIZE || mXmlLength < 0 ||
+        mXmlOffset + mXmlLength >= size ||
+        data[mXmlOffset + mXmlLength] != 0) {
+        Trace(1, "ProjectFile: Invalid header\n");
+        return false;
+    }
+
+    mEntries = new ProjectFileAudio[(count > 0) ? count : 1];
+    mEntryCount = 0;
+
+    offset = indexOffset;
+    mIndexEnd = indexOffset + indexLength;
+
+    for (i = 0 ; i < count && !mCorrupt ; i++) {
+        ProjectFileAudio* e = &mEntries[i];
+        e->sampleRate = readInt(&offset);
+        e->channels = readInt(&offset);
+        e->frames = (long)readLong(&offset);
+        e->blockCount = readInt(&offset);
+        int stored = readInt(&offset);
+
+        long long maxBlocks = ((long long)e->frames + PROJECT_FILE_BLOCK_FRAMES - 1) /
+            PROJECT_FILE_BLOCK_FRAMES;
+
+        int bitmapSize = (e->blockCount + 7) / 8;
+        if (mCorrupt || e->frames < 0 || e->blockCount < 0 ||
+            e->blockCount != maxBlocks ||
+            e->channels != PROJECT_FILE_CHANNELS ||
+            stored < 0 || stored > e->blockCount ||
+            offset + bitmapSize > mIndexEnd) {
+            mCorrupt = true;
+            break;
+        }
+
+        e->zeroBlocks = new unsigned char[(bitmapSize > 0) ? bitmapSize : 1];
+        if (bitmapSize > 0)
+          memcpy(e->zeroBlocks, data + offset, bitmapSize);
+        offset += bitmapSize;
+
+        e->offsets = new long long[(e->blockCount > 0) ? e->blockCount : 1];
+        mEntryCount++;
+
+        int found = 0;
+        for (b = 0 ; b < e->blockCount && !mCorrupt ; b++) {
+            if (e->zeroBlocks[b / 8] & (1 << (b % 8)))
+              e->offsets[b] = 0;
+            else {
+                long long blockOffset = readLong(&offset);
+                if (blockOffset < HEADER_SIZE ||
+                    blockOffset + (long long)BLOCK_BYTES > size)
+                  mCorrupt = true;
+                e->offsets[b] = blockOffset;
+                found++;
+            }
+        }
+
+        if (found != stored)
+          mCorrupt = true;
+    }
+
+    if (mCorrupt) {
+        Trace(1, "ProjectFile: Invalid index\n");
+        return false;
+    }
+
+    return true;
+}
+
+PUBLIC const char* ProjectFile::getXml()
+{
+    return (mFile != NULL) ? mFile->getData() + mXmlOffset : NULL;
+}
+
+PUBLIC int ProjectFile::getXmlLength()
+{
+    return (int)mXmlLength;
+}
+
+PUBLIC int ProjectFile::getAudioCount()
+{
+    return mEntryCount;
+}
+
+PUBLIC ProjectFileAudio* ProjectFile::getAudio(int index)
+{
+    return (index >= 0 && index < mEntryCount) ? &mEntries[index] : NULL;
+}
+
+/**
+ * Make an Audio whose buffers will be filled from one of ours
+ * as they are used.  The Audio holds a reference to us through
+ * its source.
+ */
+PUBLIC Audio* ProjectFile::newAudio(AudioPool* pool, int index)
+{
+    Audio* a = NULL;
+
+    if (index < 0 || index >= mEntryCount)
+      Trace(1, "ProjectFile: Invalid audio number %ld\n", (long)index);
+    else {
+        a = pool->newAudio();
+        incReferences();
+        // if the sizes don't match the source is released and we're
+        // left with an empty Audio
+        a->setSource(new ProjectFileSource(this, index));
+    }
+
+    return a;
+}
+
+/**
+ * Copy one block.  Called by ProjectFileSource, usually in the
+ * interrupt.
+ */
+PUBLIC void ProjectFile::readBlock(int index, int block, float* dest)
+{
+    long long offset = mEntries[index].offsets[block];
+    if (offset == 0)
+      memset(dest, 0, BLOCK_BYTES);
+    else
+      memcpy(dest, mFile->getData() + offset, BLOCK_BYTES);
+}
+
+/****************************************************************************
+ *                                                                          *
+ *                             PROJECT FILE SOURCE                          *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * The caller must have added a reference to the file for us.
+ */
+PUBLIC ProjectFileSource::ProjectFileSource(ProjectFile* file, int index)
+{
+    mFile = file;
+    mIndex = index;
+    mAudio = file->getAudio(index);
+}
+
+PUBLIC ProjectFileSource::~ProjectFileSource()
+{
+}
+
+PUBLIC int ProjectFileSource::getSampleRate()
+{
+    return mAudio->sampleRate;
+}
+
+PUBLIC int ProjectFileSource::getChannels()
+{
+    return mAudio->channels;
+}
+
+PUBLIC long ProjectFileSource::getFrames()
+{
+    return mAudio->frames;
+}
+
+PUBLIC long ProjectFileSource::getBlockFrames()
+{
+    return PROJECT_FILE_BLOCK_FRAMES;
+}
+
+PUBLIC int ProjectFileSource::getBlockCount()
+{
+    return mAudio->blockCount;
+}
+
+PUBLIC bool ProjectFileSource::isZeroBlock(int block)
+{
+    return ((mAudio->zeroBlocks[block / 8] & (1 << (block % 8))) != 0);
+}
+
+PUBLIC void ProjectFileSource::readBlock(int block, float* dest)
+{
+    mFile->readBlock(mIndex, block, dest);
+}
+
+/**
+ * The Audio is done with us.
+ * Called by MobiusThread when the Audio was reset in the interrupt,
+ * see AudioPool::releaseSource.
+ */
+PUBLIC void ProjectFileSource::release()
+{
+    mFile->decReferences();
+    delete this;
+}
+
+/****************************************************************************/
+/****************************************************************************/
+/****************************************************************************/
@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2010 Jeffrey S. Larson  <jeff@circularlabs.com>
+ * All rights reserved.
+ * See the LICENSE file for the full copyright and license declaration.
+ *
+ * ---------------------------------------------------------------------
+ *
+ * Single file container for a project, the XML and all of the
+ * layer audio in one place.
+ *
+ */
+
+#ifndef PROJECT_FILE_H
+#define PROJECT_FILE_H
+
+#include "Audio.h"
+
+/****************************************************************************
+ *                                                                          *
+ *                                 CONSTANTS                                *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * Extension for the container, ".mob" is still the XML
+ * directory with one wave file per layer.
+ */
+#define PROJECT_FILE_EXTENSION ".mobp"
+
+#define PROJECT_FILE_MAGIC "MOBP"
+#define PROJECT_FILE_VERSION 1
+
+/**
+ * Frames in one block.  This must be the same as the Audio buffer
+ * size so a block can be copied directly into a buffer.
+ */
+#define PROJECT_FILE_BLOCK_FRAMES (1024 * 64)
+#define PROJECT_FILE_CHANNELS 2
+
+/**
+ * Blocks start on a page boundary, the header is padded to this.
+ * A block is 512K so the ones after the first stay aligned.
+ */
+#define PROJECT_FILE_ALIGNMENT 4096
+
+/**
+ * Prefix of the layer audio path in the XML when the audio is
+ * in the container, followed by the audio number.
+ */
+#define PROJECT_FILE_AUDIO_PREFIX "#"
+
+/****************************************************************************
+ *                                                                          *
+ *                                PROJECT FILE                              *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * One Audio in the container.
+ * Offsets are zero for blocks that are all zero, they aren't stored.
+ */
+typedef struct {
+
+    int sampleRate;
+    int channels;
+    long frames;
+    int blockCount;
+    unsigned char* zeroBlocks;
+    long long* offsets;
+
+} ProjectFileAudio;
+
+/**
+ * The file is laid out like this, numbers are in host byte order:
+ *
+ *   header    magic, version, block frames, channels, audio count,
+ *             index offset and length, XML offset and length,
+ *             padded to PROJECT_FILE_ALIGNMENT
+ *   blocks    interleaved float samples, PROJECT_FILE_BLOCK_FRAMES each
+ *   index     for each audio: sample rate, channels, frames, block count,
+ *             stored block count, a bitmap with a bit set for every
+ *             block that is all zero, and the offset of each stored block
+ *   XML       the Project, terminated with a null
+ *
+ * When reading, the file is mapped and each Audio gets a source that
+ * copies blocks into its buffers when they are first touched.  The
+ * Audios keep a reference to us and the file stays mapped until the
+ * last one is reset.
+ */
+class ProjectFile {
+
+  public:
+
+    ProjectFile();
+
+    void incReferences();
+    void decReferences();
+
+    const char* getError();
+
+    // writing
+    int add(class Audio* a);
+    bool write(const char* path, const char* xml);
+
+    // reading
+    bool read(const char* path);
+    const char* getXml();
+    int getXmlLength();
+    int getAudioCount();
+    ProjectFileAudio* getAudio(int index);
+    class Audio* newAudio(class AudioPool* pool, int index);
+    void readBlock(int index, int block, float* dest);
+
+  private:
+
+    ~ProjectFile();
+    bool readIndex();
+    bool isZero(float* block);
+    void writeHeader(FILE* fp, long long indexOffset, long long indexLength);
+    void writeInt(FILE* fp, int value);
+    void writeLong(FILE* fp, long long value);
+    void writeBytes(FILE* fp, const void* bytes, long long length);
+    bool replace(const char* temp, const char* path);
+    int readInt(long long* offset);
+    long long readLong(long long* offset);
+
+    volatile int mReferences;
+    char mError[1024];
+
+    // writing
+    class List* mAudios;
+    long long mOffset;
+
+    // reading
+    class MappedFile* mFile;
+    ProjectFileAudio* mEntries;
+    int mEntryCount;
+    long long mIndexEnd;
+    bool mCorrupt;
+    long long mXmlOffset;
+    long long mXmlLength;
+
+};
+
+/****************************************************************************
+ *                                                                          *
+ *                             PROJECT FILE SOURCE                          *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * The AudioSource for one Audio in a ProjectFile.
+ */
+class ProjectFileSource : public AudioSource {
+
+  public:
+
+    ProjectFileSource(ProjectFile* file, int index);
+    ~ProjectFileSource();
+
+    int getSampleRate();
+    int getChannels();
+    long getFrames();
+    long getBlockFrames();
+    int getBlockCount();
+    bool isZeroBlock(int block);
+    void readBlock(int block, float* dest);
+    void release();
+
+  private:
+
+    ProjectFile* mFile;
+    int mIndex;
+    ProjectFileAudio* mAudio;
+
+};
+
+/****************************************************************************/
+/****************************************************************************/
+/****************************************************************************/
+#endif
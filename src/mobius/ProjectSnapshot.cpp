@@ -0,0 +1,316 @@
+/*
+ * Copyright (c) 2010 Jeffrey S. Larson  <jeff@circularlabs.com>
+ * All rights reserved.
+ * See the LICENSE file for the full copyright and license declaration.
+ *
+ * ---------------------------------------------------------------------
+ *
+ * A consistent set of layers captured by the interrupt for
+ * saving a project.
+ *
+ * Saving a project used to walk the loops and flatten each layer from
+ * MobiusThread while the interrupt kept going.  If a loop was Reset
+ * or Undone during the save, the layers could be returned to the
+ * pool and reused out from under us, see the warning on Layer::flatten.
+ *
+ * Now the thread doing the save posts one of these to Mobius and
+ * waits.  At the start of the next interrupt we walk the tracks and
+ * give every layer we want to save an extra reference.  That is only
+ * a pointer and a counter per layer, the audio is not copied.  The
+ * layers are finalized so the only thing that can change them now is
+ * a deferred fade, ProjectLayer watches the layer generation for that.
+ * Background flattening is suspended while we hold the layers since
+ * it would replace their Audio and Segments.
+ *
+ * When the Project has been flattened the snapshot is posted again and
+ * the interrupt releases the references, which may return the
+ * layers to the pool.  LayerPool is not thread safe so this can't
+ * be done by the thread doing the save.
+ *
+ * If the interrupt doesn't respond the audio stream isn't running,
+ * we withdraw the request and do the work ourselves.
+ *
+ */
+
+#include <stdio.h>
+#include <memory.h>
+
+#include "Util.h"
+#include "Trace.h"
+#include "Thread.h"
+
+#include "Layer.h"
+#include "LayerCompressor.h"
+#include "LayerFlattener.h"
+#include "Loop.h"
+#include "Mobius.h"
+#include "MobiusConfig.h"
+#include "Track.h"
+
+#include "ProjectSnapshot.h"
+
+/****************************************************************************
+ *                                                                          *
+ *                             PROJECT SNAPSHOT                             *
+ *                                                                          *
+ ****************************************************************************/
+
+PUBLIC ProjectSnapshot::ProjectSnapshot(Mobius* m)
+{
+    mMobius = m;
+    mState = SNAPSHOT_IDLE;
+    mSaveLayers = m->getConfiguration()->isSaveLayers();
+
+    mTrackCount = m->getTrackCount();
+    mActiveTrack = 0;
+    mLoopCounts = new int[mTrackCount];
+    mActiveLoops = new int[mTrackCount];
+    for (int i = 0 ; i < mTrackCount ; i++) {
+        mLoopCounts[i] = 0;
+        mActiveLoops[i] = 0;
+    }
+
+    mLayers = NULL;
+    mLayerCount = 0;
+    mMaxLayers = 0;
+    mNeeded = 0;
+    allocLayers(SNAPSHOT_INITIAL_LAYERS);
+}
+
+PUBLIC ProjectSnapshot::~ProjectSnapshot()
+{
+    if (mLayerCount > 0)
+      Trace(1, "ProjectSnapshot: Deleting snapshot without releasing layers!\n");
+
+    delete mLoopCounts;
+    delete mActiveLoops;
+    delete mLayers;
+}
+
+PRIVATE void ProjectSnapshot::allocLayers(int max)
+{
+    delete mLayers;
+    mLayers = new SnapshotLayer[max];
+    mMaxLayers = max;
+    mLayerCount = 0;
+}
+
+/**
+ * Capture the layers.  Called by the thread saving the project,
+ * we return when the interrupt has pinned them.
+ */
+PUBLIC void ProjectSnapshot::capture()
+{
+    if (mState != SNAPSHOT_IDLE)
+      Trace(1, "ProjectSnapshot: capture in state %ld\n", (long)mState);
+    else {
+        post(SNAPSHOT_REQUESTED);
+        while (mState == SNAPSHOT_OVERFLOW) {
+            // leave some room for layers added before the next interrupt
+            allocLayers(mNeeded + SNAPSHOT_INITIAL_LAYERS);
+            post(SNAPSHOT_REQUESTED);
+        }
+
+        Trace(2, "ProjectSnapshot: Captured %ld layers\n", (long)mLayerCount);
+    }
+}
+
+/**
+ * Release the layers.  Called by the thread saving the project
+ * after everything we need has been flattened.
+ */
+PUBLIC void ProjectSnapshot::release()
+{
+    if (mState == SNAPSHOT_CAPTURED)
+      post(SNAPSHOT_RELEASING);
+}
+
+/**
+ * Hand ourselves to the interrupt and wait for it to move us
+ * out of the given state.
+ */
+PRIVATE void ProjectSnapshot::post(int state)
+{
+    mState = state;
+    AtomicBarrier();
+
+    // only one save at a time, wait for the last one to finish
+    while (!mMobius->postSnapshot(this))
+      SleepMillis(1);
+
+    int waited = 0;
+    while (mState == state && waited < SNAPSHOT_WAIT_MSEC) {
+        SleepMillis(1);
+        waited++;
+    }
+
+    if (mState == state) {
+        if (mMobius->cancelSnapshot(this)) {
+            // interrupts aren't running, it's safe to do it here
+            Trace(2, "ProjectSnapshot: No interrupts, capturing layers directly\n");
+            interrupt();
+        }
+        else {
+            // the interrupt got it at the last moment
+            while (mState == state)
+              SleepMillis(1);
+        }
+    }
+}
+
+/**
+ * Called by Mobius at the start of an interrupt after we've been posted.
+ */
+PUBLIC void ProjectSnapshot::interrupt()
+{
+    int state = mState;
+
+    if (state == SNAPSHOT_REQUESTED) {
+        int needed = countLayers();
+        if (needed > mMaxLayers) {
+            mNeeded = needed;
+            AtomicBarrier();
+            mState = SNAPSHOT_OVERFLOW;
+        }
+        else {
+            pin();
+            mMobius->getLayerFlattener()->suspend();
+            mMobius->getLayerCompressor()->suspend();
+            AtomicBarrier();
+            mState = SNAPSHOT_CAPTURED;
+        }
+    }
+    else if (state == SNAPSHOT_RELEASING) {
+        unpin();
+        mMobius->getLayerFlattener()->resume();
+        mMobius->getLayerCompressor()->resume();
+        AtomicBarrier();
+        mState = SNAPSHOT_IDLE;
+    }
+    else {
+        Trace(1, "ProjectSnapshot: posted in state %ld\n", (long)state);
+    }
+}
+
+/**
+ * Return the number of loops in a track we want to save.
+ * Empty loops at the end are not saved.
+ */
+PRIVATE int ProjectSnapshot::countLoops(Track* t)
+{
+    int last = t->getLoopCount();
+    while (last > 0 && t->getLoop(last - 1)->isEmpty())
+      last--;
+    return last;
+}
+
+/**
+ * Count the layers we would pin.
+ */
+PRIVATE int ProjectSnapshot::countLayers()
+{
+    int count = 0;
+
+    for (int i = 0 ; i < mTrackCount ; i++) {
+        Track* t = mMobius->getTrack(i);
+        int loops = countLoops(t);
+        for (int j = 0 ; j < loops ; j++) {
+            Layer* layer = t->getLoop(j)->getPlayLayer();
+            while (layer != NULL) {
+                count++;
+                layer = (mSaveLayers) ? layer->getPrev() : NULL;
+            }
+        }
+    }
+
+    return count;
+}
+
+/**
+ * Capture the loop structure and add a reference to the layers.
+ * countLayers must have been called first in the same interrupt.
+ */
+PRIVATE void ProjectSnapshot::pin()
+{
+    mLayerCount = 0;
+    mActiveTrack = 0;
+
+    Track* active = mMobius->getTrack();
+
+    for (int i = 0 ; i < mTrackCount ; i++) {
+        Track* t = mMobius->getTrack(i);
+        if (t == active)
+          mActiveTrack = i;
+
+        int loops = countLoops(t);
+        mLoopCounts[i] = loops;
+        mActiveLoops[i] = -1;
+
+        for (int j = 0 ; j < loops ; j++) {
+            Loop* l = t->getLoop(j);
+            if (l == t->getLoop())
+              mActiveLoops[i] = j;
+
+            Layer* layer = l->getPlayLayer();
+            while (layer != NULL) {
+                layer->incReferences();
+                SnapshotLayer* sl = &mLayers[mLayerCount++];
+                sl->layer = layer;
+                sl->track = i;
+                sl->loop = j;
+                layer = (mSaveLayers) ? layer->getPrev() : NULL;
+            }
+        }
+    }
+}
+
+/**
+ * Remove our references, this may return layers to the pool.
+ */
+PRIVATE void ProjectSnapshot::unpin()
+{
+    for (int i = 0 ; i < mLayerCount ; i++) {
+        SnapshotLayer* sl = &mLayers[i];
+        sl->layer->free();
+        sl->layer = NULL;
+    }
+    mLayerCount = 0;
+}
+
+PUBLIC int ProjectSnapshot::getTrackCount()
+{
+    return mTrackCount;
+}
+
+PUBLIC int ProjectSnapshot::getActiveTrack()
+{
+    return mActiveTrack;
+}
+
+PUBLIC int ProjectSnapshot::getLoopCount(int track)
+{
+    return (track >= 0 && track < mTrackCount) ? mLoopCounts[track] : 0;
+}
+
+/**
+ * Returns -1 if the active loop was an empty loop at the end
+ * that we didn't capture.
+ */
+PUBLIC int ProjectSnapshot::getActiveLoop(int track)
+{
+    return (track >= 0 && track < mTrackCount) ? mActiveLoops[track] : -1;
+}
+
+PUBLIC int ProjectSnapshot::getLayerCount()
+{
+    return mLayerCount;
+}
+
+PUBLIC SnapshotLayer* ProjectSnapshot::getLayer(int index)
+{
+    return (index >= 0 && index < mLayerCount) ? &mLayers[index] : NULL;
+}
+
+/****************************************************************************/
+/****************************************************************************/
+/****************************************************************************/
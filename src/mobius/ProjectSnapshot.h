@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2010 Jeffrey S. Larson  <jeff@circularlabs.com>
+ * All rights reserved.
+ * See the LICENSE file for the full copyright and license declaration.
+ *
+ * ---------------------------------------------------------------------
+ *
+ * A consistent set of layers captured by the interrupt for
+ * saving a project.
+ *
+ */
+
+#ifndef PROJECT_SNAPSHOT_H
+#define PROJECT_SNAPSHOT_H
+
+/****************************************************************************
+ *                                                                          *
+ *                                 CONSTANTS                                *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * How long we wait for the interrupt to respond before assuming
+ * the audio stream isn't running and doing it ourselves.
+ */
+#define SNAPSHOT_WAIT_MSEC 250
+
+/**
+ * The initial size of the layer array, it will grow if
+ * there are more layers with saveLayers on.
+ */
+#define SNAPSHOT_INITIAL_LAYERS 64
+
+/**
+ * States of a ProjectSnapshot.
+ * The requesting thread moves IDLE to REQUESTED and CAPTURED to
+ * RELEASING, the interrupt moves REQUESTED to CAPTURED or OVERFLOW
+ * and RELEASING to IDLE.
+ */
+#define SNAPSHOT_IDLE 0
+#define SNAPSHOT_REQUESTED 1
+#define SNAPSHOT_OVERFLOW 2
+#define SNAPSHOT_CAPTURED 3
+#define SNAPSHOT_RELEASING 4
+
+/****************************************************************************
+ *                                                                          *
+ *                              SNAPSHOT LAYER                              *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * One layer in the snapshot.
+ * The layer has an extra reference while it is here so a Reset
+ * or Undo can't return it to the pool while it is being saved.
+ */
+typedef struct {
+
+    class Layer* layer;
+
+    // zero based track and loop numbers
+    int track;
+    int loop;
+
+} SnapshotLayer;
+
+/****************************************************************************
+ *                                                                          *
+ *                             PROJECT SNAPSHOT                             *
+ *                                                                          *
+ ****************************************************************************/
+
+class ProjectSnapshot {
+
+  public:
+
+    ProjectSnapshot(class Mobius* m);
+    ~ProjectSnapshot();
+
+    // requesting thread
+    void capture();
+    void release();
+
+    // interrupt, called by Mobius at the start of an interrupt
+    void interrupt();
+
+    // results
+    int getTrackCount();
+    int getActiveTrack();
+    int getLoopCount(int track);
+    int getActiveLoop(int track);
+    int getLayerCount();
+    SnapshotLayer* getLayer(int index);
+
+  private:
+
+    void post(int state);
+    int countLoops(class Track* t);
+    int countLayers();
+    void pin();
+    void unpin();
+    void allocLayers(int max);
+
+    class Mobius* mMobius;
+
+    volatile int mState;
+
+    // MobiusConfig::isSaveLayers when we were created
+    bool mSaveLayers;
+
+    int mTrackCount;
+    int mActiveTrack;
+    int* mLoopCounts;
+    int* mActiveLoops;
+
+    SnapshotLayer* mLayers;
+    int mLayerCount;
+    int mMaxLayers;
+
+    // set by the interrupt when mLayers was too small
+    int mNeeded;
+
+};
+
+/****************************************************************************/
+/****************************************************************************/
+/****************************************************************************/
+#endif
@@ -0,0 +1,429 @@
+/*
+ * Copyright (c) 2010 Jeffrey S. Larson  <jeff@circularlabs.com>
+ * All rights reserved.
+ * See the LICENSE file for the full copyright and license declaration.
+ *
+ * ---------------------------------------------------------------------
+ *
+ * Deferred reclamation of layers, audio and sample buffers released
+ * in the interrupt.
+ *
+ * When the last reference to a layer goes away LayerPool used to reset
+ * it immediately and put it back in the pool.  Resetting a layer returns
+ * every buffer in its Audio to the AudioPool and deletes its Segments,
+ * which may release more layers.  Freeing a long loop on Reset, or the
+ * layers past maxUndo, could walk tens of thousands of buffers
+ * in one interrupt.
+ *
+ * Now LayerPool gives those layers to us instead.  The interrupt only
+ * pushes them on a lock free list and MobiusThread does the reset later
+ * and hands them back to LayerPool.  AudioPool::freeAudio does the same
+ * for whole Audio objects, and AudioPool::releaseSource for the
+ * AudioSource of an Audio that was reset.  Releasing the last source
+ * from a project file unmaps the file and a compressed source frees
+ * its coded blocks, neither belongs in the interrupt.
+ *
+ * AudioPool::freeBuffer gives us sample buffers whose last reference
+ * went away.  The interrupt frees buffers as it trims and replaces
+ * them in an Audio it keeps (Audio::setFrames, setStartFrame,
+ * getWritableBuffer).  Once a returned buffer is in the pool the
+ * maintenance thread may zero it, hand it back out, or delete it,
+ * so the ones another thread might still be reading wait here too.
+ *
+ * Something other than the interrupt may still be looking at a layer
+ * after the interrupt let go of it.  Save Loop flattens the play layer
+ * without holding a reference, and a project save can follow Segments
+ * from the layers it has pinned to layers the interrupt is releasing.
+ * So reclamation uses epochs.  The epoch advances every time
+ * MobiusThread takes the retired lists, objects are tagged with the
+ * epoch they were retired in.  Readers announce the epoch they started
+ * in, and an object is only reclaimed when every active reader started
+ * in a later epoch, meaning it started after the object was unlinked
+ * and can't have found it.
+ *
+ * The interrupt is always reader zero, it enters at the start of each
+ * interrupt and leaves at the end.  Recorder worker threads run inside
+ * that window so they don't need their own.
+ *
+ */
+
+#include <stdio.h>
+#include <memory.h>
+
+#include "Util.h"
+#include "Trace.h"
+#include "Thread.h"
+
+#include "Audio.h"
+#include "Layer.h"
+#include "ObjectPool.h"
+#include "Mobius.h"
+#include "MobiusThread.h"
+
+#include "Reclaimer.h"
+
+/****************************************************************************
+ *                                                                          *
+ *                                 RECLAIMER                                *
+ *                                                                          *
+ ****************************************************************************/
+
+PUBLIC Reclaimer::Reclaimer(Mobius* m)
+{
+    mMobius = m;
+
+    // zero means a free reader slot so start at one
+    mEpoch = 1;
+    for (int i = 0 ; i < RECLAIM_MAX_READERS ; i++)
+      mReaders[i] = 0;
+
+    mRetiredLayers = NULL;
+    mRetiredAudio = NULL;
+    mRetiredSources = NULL;
+    mRetiredBuffers = NULL;
+    mLayers = NULL;
+    mAudio = NULL;
+    mSources = NULL;
+    mBuffers = NULL;
+
+    mLayersRetired = 0;
+    mAudioRetired = 0;
+    mSourcesRetired = 0;
+    mBuffersRetired = 0;
+    mLayersReclaimed = 0;
+    mAudioReclaimed = 0;
+    mSourcesReclaimed = 0;
+    mBuffersReclaimed = 0;
+    mMaxMicros = 0;
+}
+
+PUBLIC Reclaimer::~Reclaimer()
+{
+    flush();
+}
+
+/**
+ * Called when the last reference to a layer goes away.
+ * The layer has been marked as pooled but is otherwise untouched.
+ */
+PUBLIC void Reclaimer::retire(Layer* layer)
+{
+    if (layer != NULL) {
+        layer->mRetiredEpoch = mEpoch;
+        Layer* head;
+        do {
+            head = mRetiredLayers;
+            layer->mRetired = head;
+        } while (!AtomicCompareAndSwapPointer((void* volatile*)&mRetiredLayers,
+                                              head, layer));
+        AtomicIncrement(&mLayersRetired);
+    }
+}
+
+/**
+ * Called by AudioPool::freeAudio.
+ */
+PUBLIC void Reclaimer::retire(Audio* audio)
+{
+    if (audio != NULL) {
+        audio->mRetiredEpoch = mEpoch;
+        Audio* head;
+        do {
+            head = mRetiredAudio;
+            audio->mRetired = head;
+        } while (!AtomicCompareAndSwapPointer((void* volatile*)&mRetiredAudio,
+                                              head, audio));
+        AtomicIncrement(&mAudioRetired);
+    }
+}
+
+/**
+ * Called by AudioPool::releaseSource.
+ */
+PUBLIC void Reclaimer::retire(AudioSource* source)
+{
+    if (source != NULL) {
+        source->mRetiredEpoch = mEpoch;
+        AudioSource* head;
+        do {
+            head = mRetiredSources;
+            source->mRetired = head;
+        } while (!AtomicCompareAndSwapPointer((void* volatile*)&mRetiredSources,
+                                              head, source));
+        AtomicIncrement(&mSourcesRetired);
+    }
+}
+
+/**
+ * Called by AudioPool::freeBuffer when the last reference to a
+ * buffer goes away.
+ */
+PUBLIC void Reclaimer::retire(SampleBuffer* buffer)
+{
+    if (buffer != NULL) {
+        buffer->mRetiredEpoch = mEpoch;
+        SampleBuffer* head;
+        do {
+            head = mRetiredBuffers;
+            buffer->setPoolChain(head);
+        } while (!AtomicCompareAndSwapPointer((void* volatile*)&mRetiredBuffers,
+                                              head, buffer));
+        AtomicIncrement(&mBuffersRetired);
+    }
+}
+
+/**
+ * Called by Mobius at the start of every interrupt.
+ */
+PUBLIC void Reclaimer::enterInterrupt()
+{
+    mReaders[0] = mEpoch;
+    AtomicBarrier();
+}
+
+/**
+ * Called by Mobius at the end of every interrupt.  If anything
+ * was retired wake up MobiusThread, otherwise it will get to it
+ * the next time its timer goes off.
+ */
+PUBLIC void Reclaimer::leaveInterrupt()
+{
+    AtomicBarrier();
+    mReaders[0] = 0;
+
+    if (mRetiredLayers != NULL || mRetiredAudio != NULL ||
+        mRetiredSources != NULL || mRetiredBuffers != NULL) {
+        MobiusThread* thread = mMobius->getThread();
+        if (thread != NULL)
+          thread->signal();
+    }
+}
+
+/**
+ * Called by a thread that is about to look at layers outside the
+ * interrupt without holding references to all of them.  Returns
+ * the reader number to pass to leave().
+ */
+PUBLIC int Reclaimer::enter()
+{
+    int reader = -1;
+
+    while (reader < 0) {
+        int epoch = mEpoch;
+        for (int i = 1 ; i < RECLAIM_MAX_READERS && reader < 0 ; i++) {
+            if (mReaders[i] == 0 &&
+                AtomicCompareAndSwap(&mReaders[i], 0, epoch))
+              reader = i;
+        }
+        if (reader < 0) {
+            Trace(2, "Reclaimer: Waiting for a reader slot\n");
+            SleepMillis(10);
+        }
+    }
+
+    return reader;
+}
+
+PUBLIC void Reclaimer::leave(int reader)
+{
+    if (reader > 0 && reader < RECLAIM_MAX_READERS) {
+        AtomicBarrier();
+        mReaders[reader] = 0;
+    }
+    else
+      Trace(1, "Reclaimer: Invalid reader %ld\n", (long)reader);
+}
+
+/**
+ * Return the epoch of the oldest active reader, zero if there
+ * are no readers.
+ */
+PRIVATE int Reclaimer::getOldestReader()
+{
+    int oldest = 0;
+    for (int i = 0 ; i < RECLAIM_MAX_READERS ; i++) {
+        int epoch = mReaders[i];
+        if (epoch != 0 && (oldest == 0 || epoch < oldest))
+          oldest = epoch;
+    }
+    return oldest;
+}
+
+/**
+ * Called by MobiusThread whenever it wakes up.
+ * Take what has been retired since the last time, start a new epoch,
+ * and reclaim anything the readers are done with.
+ */
+PUBLIC void Reclaimer::process()
+{
+    Layer* layers = (Layer*)
+        AtomicExchangePointer((void* volatile*)&mRetiredLayers, NULL);
+    Audio* audio = (Audio*)
+        AtomicExchangePointer((void* volatile*)&mRetiredAudio, NULL);
+    AudioSource* sources = (AudioSource*)
+        AtomicExchangePointer((void* volatile*)&mRetiredSources, NULL);
+    SampleBuffer* buffers = (SampleBuffer*)
+        AtomicExchangePointer((void* volatile*)&mRetiredBuffers, NULL);
+
+    if (layers != NULL || audio != NULL || sources != NULL ||
+        buffers != NULL || mLayers != NULL || mAudio != NULL || 
+        mSources != NULL || mBuffers != NULL) {
+
+        Layer* nextLayer = NULL;
+        for (Layer* l = layers ; l != NULL ; l = nextLayer) {
+            nextLayer = l->mRetired;
+            l->mRetired = mLayers;
+            mLayers = l;
+        }
+
+        Audio* nextAudio = NULL;
+        for (Audio* a = audio ; a != NULL ; a = nextAudio) {
+            nextAudio = a->mRetired;
+            a->mRetired = mAudio;
+            mAudio = a;
+        }
+
+        AudioSource* nextSource = NULL;
+        for (AudioSource* s = sources ; s != NULL ; s = nextSource) {
+            nextSource = s->mRetired;
+            s->mRetired = mSources;
+            mSources = s;
+        }
+
+        SampleBuffer* nextBuffer = NULL;
+        for (SampleBuffer* b = buffers ; b != NULL ; b = nextBuffer) {
+            nextBuffer = (SampleBuffer*)b->getPoolChain();
+            b->setPoolChain(mBuffers);
+            mBuffers = b;
+        }
+
+        // readers that start now can't find anything we have
+        AtomicIncrement(&mEpoch);
+
+        reclaim(getOldestReader());
+    }
+}
+
+/**
+ * Reclaim the objects retired before the given epoch, or everything
+ * if the epoch is zero.  Resetting a layer releases its Segments
+ * which may retire more layers, and frees its buffers, those wait 
+ * for the next time.
+ */
+PRIVATE void Reclaimer::reclaim(int oldest)
+{
+    long long start = GetClockTicks();
+    int layers = 0;
+    int audio = 0;
+    int sources = 0;
+    int buffers = 0;
+
+    Layer* keepLayers = NULL;
+    Layer* nextLayer = NULL;
+    for (Layer* l = mLayers ; l != NULL ; l = nextLayer) {
+        nextLayer = l->mRetired;
+        if (oldest != 0 && l->mRetiredEpoch >= oldest) {
+            l->mRetired = keepLayers;
+            keepLayers = l;
+        }
+        else {
+            l->mRetired = NULL;
+            l->reset();
+            l->mLayerPool->returnLayer(l);
+            layers++;
+        }
+    }
+    mLayers = keepLayers;
+
+    Audio* keepAudio = NULL;
+    Audio* nextAudio = NULL;
+    for (Audio* a = mAudio ; a != NULL ; a = nextAudio) {
+        nextAudio = a->mRetired;
+        if (oldest != 0 && a->mRetiredEpoch >= oldest) {
+            a->mRetired = keepAudio;
+            keepAudio = a;
+        }
+        else {
+            a->mRetired = NULL;
+            delete a;
+            audio++;
+        }
+    }
+    mAudio = keepAudio;
+
+    AudioSource* keepSources = NULL;
+    AudioSource* nextSource = NULL;
+    for (AudioSource* s = mSources ; s != NULL ; s = nextSource) {
+        nextSource = s->mRetired;
+        if (oldest != 0 && s->mRetiredEpoch >= oldest) {
+            s->mRetired = keepSources;
+            keepSources = s;
+        }
+        else {
+            s->mRetired = NULL;
+            s->release();
+            sources++;
+        }
+    }
+    mSources = keepSources;
+
+    // back to the pool, the maintenance thread zeroes them
+    SampleBuffer* keepBuffers = NULL;
+    SampleBuffer* nextBuffer = NULL;
+    for (SampleBuffer* b = mBuffers ; b != NULL ; b = nextBuffer) {
+        nextBuffer = (SampleBuffer*)b->getPoolChain();
+        if (oldest != 0 && b->mRetiredEpoch >= oldest) {
+            b->setPoolChain(keepBuffers);
+            keepBuffers = b;
+        }
+        else {
+            b->setPoolChain(NULL);
+            b->free();
+            buffers++;
+        }
+    }
+    mBuffers = keepBuffers;
+
+    if (layers > 0 || audio > 0 || sources > 0 || buffers > 0) {
+        mLayersReclaimed += layers;
+        mAudioReclaimed += audio;
+        mSourcesReclaimed += sources;
+        mBuffersReclaimed += buffers;
+
+        int micros = (int)ClockTicksToMicros(GetClockTicks() - start);
+        if (micros > mMaxMicros)
+          mMaxMicros = micros;
+
+        Trace(3, "Reclaimer: Reclaimed %ld layers %ld audio %ld sources %ld buffers in %ld usec\n",
+              (long)layers, (long)audio, (long)sources, (long)buffers,
+              (long)micros);
+    }
+}
+
+/**
+ * Called during shutdown after MobiusThread and the interrupt
+ * have stopped, and before the pools are deleted.  Keep going
+ * until resetting layers stops retiring more of them.
+ */
+PUBLIC void Reclaimer::flush()
+{
+    for (int i = 0 ; i < RECLAIM_MAX_READERS ; i++)
+      mReaders[i] = 0;
+
+    do {
+        process();
+    } while (mRetiredLayers != NULL || mRetiredAudio != NULL ||
+             mRetiredSources != NULL || mRetiredBuffers != NULL);
+}
+
+PUBLIC void Reclaimer::dump()
+{
+    printf("Reclaimer: %d layers retired %d reclaimed, %d audio retired %d reclaimed, %d sources retired %d reclaimed, %d buffers retired %d reclaimed, max %d usec\n",
+           mLayersRetired, mLayersReclaimed, mAudioRetired, mAudioReclaimed,
+           mSourcesRetired, mSourcesReclaimed, mBuffersRetired,
+           mBuffersReclaimed, mMaxMicros);
+}
+
+/****************************************************************************/
+/****************************************************************************/
+/****************************************************************************/
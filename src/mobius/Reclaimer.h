@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2010 Jeffrey S. Larson  <jeff@circularlabs.com>
+ * All rights reserved.
+ * See the LICENSE file for the full copyright and license declaration.
+ *
+ * ---------------------------------------------------------------------
+ *
+ * Deferred reclamation of layers, audio and sample buffers released
+ * in the interrupt.
+ *
+ */
+
+#ifndef RECLAIMER_H
+#define RECLAIMER_H
+
+/****************************************************************************
+ *                                                                          *
+ *                                 CONSTANTS                                *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * The maximum number of threads that may be reading layers outside
+ * the interrupt at the same time.  Slot zero is the interrupt.
+ * If they're all in use enter() waits for one.
+ */
+#define RECLAIM_MAX_READERS 8
+
+/****************************************************************************
+ *                                                                          *
+ *                                 RECLAIMER                                *
+ *                                                                          *
+ ****************************************************************************/
+
+class Reclaimer {
+
+  public:
+
+    Reclaimer(class Mobius* m);
+    ~Reclaimer();
+
+    // any thread, usually the interrupt
+    void retire(class Layer* layer);
+    void retire(class Audio* audio);
+    void retire(class AudioSource* source);
+    void retire(class SampleBuffer* buffer);
+
+    // interrupt, called by Mobius around each interrupt
+    void enterInterrupt();
+    void leaveInterrupt();
+
+    // threads that read layers outside the interrupt
+    int enter();
+    void leave(int reader);
+
+    // MobiusThread
+    void process();
+
+    // shutdown, after MobiusThread and the interrupt have stopped
+    void flush();
+
+    void dump();
+
+  private:
+
+    int getOldestReader();
+    void reclaim(int oldest);
+
+    class Mobius* mMobius;
+
+    /**
+     * Advanced by MobiusThread each time it takes the retired lists.
+     * Things retired in an epoch may be reclaimed once every reader
+     * has entered a later one.
+     */
+    volatile int mEpoch;
+
+    /**
+     * The epoch each reader entered, zero if the slot is free.
+     */
+    volatile int mReaders[RECLAIM_MAX_READERS];
+
+    /**
+     * Lock free stacks of retired objects, any thread may push,
+     * MobiusThread takes the entire list at once.
+     */
+    class Layer* volatile mRetiredLayers;
+    class Audio* volatile mRetiredAudio;
+    class AudioSource* volatile mRetiredSources;
+    class SampleBuffer* volatile mRetiredBuffers;
+
+    /**
+     * Objects taken from the retired lists still waiting for readers.
+     * Only touched by MobiusThread.
+     */
+    class Layer* mLayers;
+    class Audio* mAudio;
+    class AudioSource* mSources;
+    class SampleBuffer* mBuffers;
+
+    // statistics
+    volatile int mLayersRetired;
+    volatile int mAudioRetired;
+    volatile int mSourcesRetired;
+    volatile int mBuffersRetired;
+    int mLayersReclaimed;
+    int mAudioReclaimed;
+    int mSourcesReclaimed;
+    int mBuffersReclaimed;
+    int mMaxMicros;
+
+};
+
+/****************************************************************************/
+/****************************************************************************/
+/****************************************************************************/
+#endif
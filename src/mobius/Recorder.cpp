@@ -25,6 +25,7 @@
 
 #include "Audio.h"
 #include "AudioInterface.h"
+#include "AudioKernel.h"
 #include "MidiInterface.h"
 
 #include "Recorder.h"
@@ -38,6 +39,70 @@
  */
 static bool TraceInterruptTime = false;
 
+/****************************************************************************
+ *                                                                          *
+ *   							RECORDER WORKER                             *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * Thread that helps the interrupt process independent tracks.
+ * The interrupt signals every worker at the start of the parallel
+ * pass, they claim tracks until there are none left then go back
+ * to waiting.  A worker that wakes up late finds nothing to claim,
+ * the interrupt does the work itself if the workers are slow.
+ */
+class RecorderWorker : public Thread {
+
+  public:
+
+    RecorderWorker(Recorder* r, int number);
+	~RecorderWorker();
+
+    void processEvent();
+    void threadEnding();
+
+  private:
+
+    Recorder* mRecorder;
+    int mNumber;
+    bool mStarted;
+
+};
+
+PUBLIC RecorderWorker::RecorderWorker(Recorder* r, int number)
+{
+    char name[64];
+    sprintf(name, "RecorderWorker %d", number);
+    setName(name);
+    // the interrupt waits for us, run like it does
+    setPriority(1);
+    mRecorder = r;
+    mNumber = number;
+    mStarted = false;
+}
+
+PUBLIC RecorderWorker::~RecorderWorker()
+{
+}
+
+void RecorderWorker::processEvent()
+{
+    if (!mStarted) {
+        if (mRecorder->mMonitor != NULL)
+          mRecorder->mMonitor->recorderMonitorWorkerStart(mNumber);
+        mStarted = true;
+    }
+
+    mRecorder->processParallelTracks();
+}
+
+void RecorderWorker::threadEnding()
+{
+    if (mStarted && mRecorder->mMonitor != NULL)
+      mRecorder->mMonitor->recorderMonitorWorkerEnd(mNumber);
+}
+
 /****************************************************************************
  *                                                                          *
  *   							AUDIO HANDLER                               *
@@ -108,29 +173,27 @@ void Recorder::processAudioBuffers(AudioStream* stream)
  * for both passes, since processing one track can result modifications
  * to other tracks (via scripts for example).  So have to keep
  * a processed flag of our own.
+ *
+ * If parallel processing is enabled, the non-priority tracks that
+ * say they are independent are deferred until all the others have
+ * been processed serially, then spread over the worker threads.
+ * Independence is checked again after the serial tracks since they
+ * may have scheduled something in the deferred tracks.
  */
 PRIVATE void Recorder::processTracks(AudioStream* stream)
 {
-	RecorderTrack* selected = NULL;
 	bool allFinished = true;
 	long frames = stream->getInterruptFrames();
+	int workers = mWorkerCount;
+	int parallel = 0;
     int i;
 
     // process all priority tracks first
 	for (i = 0 ; i < mTrackCount ; i++) {
 		RecorderTrack* track = mTracks[i];
-		float* input = NULL;
-		float* output = NULL;
 
         if (track->isPriority()) {
-            stream->getInterruptBuffers(track->getInputPort(), &input, 
-                                        track->getOutputPort(), &output);
-
-            track->processBuffers(stream, input, output, frames, mFrame);
-
-            if (!track->isFinished() || track->isRecording())
-              allFinished = false;
-
+            processTrack(stream, track, frames);
             track->setProcessed(true);
         }
         else {
@@ -139,22 +202,53 @@ PRIVATE void Recorder::processTracks(AudioStream* stream)
         }
     }
 
-    // then the rest
+    // then the rest, deferring the independent ones
 	for (i = 0 ; i < mTrackCount ; i++) {
 		RecorderTrack* track = mTracks[i];
-		float* input = NULL;
-		float* output = NULL;
 
         if (!track->isProcessed()) {
-            stream->getInterruptBuffers(track->getInputPort(), &input, 
-                                        track->getOutputPort(), &output);
-
-            track->processBuffers(stream, input, output, frames, mFrame);
-            track->setProcessed(true);
+            if (workers > 0 && track->isIndependent(frames))
+              parallel++;
+            else {
+                processTrack(stream, track, frames);
+                track->setProcessed(true);
+            }
+        }
+    }
 
-            if (!track->isFinished() || track->isRecording())
-              allFinished = false;
+    if (parallel > 0) {
+        parallel = 0;
+        for (i = 0 ; i < mTrackCount ; i++) {
+            RecorderTrack* track = mTracks[i];
+            if (!track->isProcessed()) {
+                if (track->isIndependent(frames)) {
+                    float* input = NULL;
+                    float* output = NULL;
+                    stream->getInterruptBuffers(track->getInputPort(), &input,
+                                                track->getOutputPort(), &output);
+                    mParallelTracks[parallel] = track;
+                    mParallelInputs[parallel] = input;
+                    mParallelPorts[parallel] = output;
+                    mParallelChannels[parallel] = 
+                        stream->getOutputPortChannels(track->getOutputPort());
+                    parallel++;
+                }
+                else {
+                    // something changed, back to the serial path
+                    processTrack(stream, track, frames);
+                }
+                track->setProcessed(true);
+            }
         }
+
+        if (parallel > 0)
+          runParallelTracks(stream, parallel, frames, workers);
+    }
+
+	for (i = 0 ; i < mTrackCount ; i++) {
+		RecorderTrack* track = mTracks[i];
+        if (!track->isFinished() || track->isRecording())
+          allFinished = false;
     }
 
 	// stop automatically if we're not recording, and all the tracks
@@ -163,6 +257,149 @@ PRIVATE void Recorder::processTracks(AudioStream* stream)
 	  mRunning = false;
 }
 
+/**
+ * Process one track on the interrupt thread.
+ */
+PRIVATE void Recorder::processTrack(AudioStream* stream, RecorderTrack* track,
+                                    long frames)
+{
+    float* input = NULL;
+    float* output = NULL;
+
+    stream->getInterruptBuffers(track->getInputPort(), &input, 
+                                track->getOutputPort(), &output);
+
+    track->processBuffers(stream, input, output, frames, mFrame);
+}
+
+/**
+ * Process the deferred independent tracks with the help of the
+ * workers.  Each track gets a private output buffer since several
+ * may share a port.  The interrupt claims tracks too so anything a
+ * worker hasn't picked up by the time we get to it is done here,
+ * a worker that is slow to wake up just finds nothing left.
+ * We then wait for the tracks the workers did claim.  No locks 
+ * are taken here.
+ *
+ * The wait spins until RECORDER_PARALLEL_SPIN_PERCENT of the block
+ * has gone by, then yields so a worker that lost the processor can
+ * finish, we can't take over a track that is half processed.
+ *
+ * Tracks are mixed into the port buffers in track order so the result
+ * doesn't depend on which thread finished first.
+ */
+PRIVATE void Recorder::runParallelTracks(AudioStream* stream, int count,
+                                         long frames, int workers)
+{
+    long maxSamples = 0;
+    int i;
+
+    for (i = 0 ; i < count ; i++) {
+        long samples = frames * mParallelChannels[i];
+        if (samples > maxSamples)
+          maxSamples = samples;
+    }
+
+    if (maxSamples > AUDIO_MAX_SAMPLES_PER_BUFFER) {
+        // shouldn't happen, do them serially rather than overflow
+        Trace(1, "Recorder: Interrupt block too large for parallel tracks\n");
+        for (i = 0 ; i < count ; i++)
+          processTrack(stream, mParallelTracks[i], frames);
+    }
+    else {
+        long long start = GetClockTicks();
+        int rate = stream->getSampleRate();
+        if (rate <= 0)
+          rate = CD_SAMPLE_RATE;
+        long long spin = (long long)frames * GetClockFrequency() / rate *
+            RECORDER_PARALLEL_SPIN_PERCENT / 100;
+
+        for (i = 0 ; i < count ; i++)
+          SampleZero(mParallelOutputs[i], frames * mParallelChannels[i]);
+
+        mParallelStream = stream;
+        mParallelFrames = frames;
+        mParallelFrame = mFrame;
+        mParallelDone = 0;
+        mParallelGeneration = (mParallelGeneration + 1) & 0xFFFF;
+
+        // everything above must be visible before the work is published
+        AtomicBarrier();
+        mParallelWork = (int)(((unsigned int)mParallelGeneration << 16) | 
+                              (unsigned int)(count << 8));
+        AtomicBarrier();
+
+        // no sense waking more workers than there are tracks
+        // beyond the one we do ourselves
+        if (workers > count - 1)
+          workers = count - 1;
+        for (i = 0 ; i < workers ; i++)
+          mWorkers[i]->signal();
+
+        processParallelTracks();
+
+        // barrier, everything is claimed so we're only waiting
+        // for workers in the middle of a track
+        bool late = false;
+        while (mParallelDone < count) {
+            if (late)
+              YieldThread();
+            else if (GetClockTicks() - start > spin)
+              late = true;
+            else
+              AtomicBarrier();
+        }
+
+        if (late) {
+            int micros = (int)ClockTicksToMicros(GetClockTicks() - start);
+            if (micros > mParallelMaxWait)
+              mParallelMaxWait = micros;
+            mParallelLate++;
+            Trace(2, "Recorder: Waited %ld usec for parallel tracks\n",
+                  (long)micros);
+        }
+
+        for (i = 0 ; i < count ; i++) {
+            float* port = mParallelPorts[i];
+            if (port != NULL)
+              SampleAdd(port, mParallelOutputs[i], 
+                        frames * mParallelChannels[i]);
+        }
+    }
+}
+
+/**
+ * Claim and process deferred tracks until there are none left.
+ * Called by the interrupt and by the worker threads.
+ */
+PRIVATE void Recorder::processParallelTracks()
+{
+    bool done = false;
+
+    while (!done) {
+        int work = mParallelWork;
+        int index = work & 0xFF;
+        int count = (work >> 8) & 0xFF;
+
+        if (index >= count)
+          done = true;
+        else if (AtomicCompareAndSwap(&mParallelWork, work, work + 1)) {
+            // once claimed the interrupt can't move on until we finish,
+            // so the slot is stable
+            float* output = NULL;
+            if (mParallelPorts[index] != NULL)
+              output = mParallelOutputs[index];
+
+            mParallelTracks[index]->processBuffers(mParallelStream, 
+                                                   mParallelInputs[index],
+                                                   output,
+                                                   mParallelFrames,
+                                                   mParallelFrame);
+            AtomicIncrement(&mParallelDone);
+        }
+    }
+}
+
 /**
  * Hack for testing.  In Mobius there is a special track class SampleTrack
  * that can inject pre-recorded audio into the input stream when called
@@ -192,8 +429,8 @@ PUBLIC void Recorder::inputBufferModified(RecorderTrack* track, float* buffer)
 
 void Recorder::calibrateInterrupt(float *input, float *output, long frames)
 {
-    // !! assuming 2 channel ports
-	int channels = 2;
+	// calibration is always on the first port
+	int channels = mStream->getInputPortChannels(0);
 	int rate = mStream->getSampleRate();
 	long samples = frames * channels;
 
@@ -336,8 +573,7 @@ void RecorderTrack::initAudio()
 		AudioStream* s = mRecorder->getStream();
         AudioPool* p = mRecorder->getAudioPool();
 		mAudio = p->newAudio();
-        // !! assuming 2 channel ports
-		mAudio->setChannels(2);
+		mAudio->setChannels(s->getInputPortChannels(mInputPort));
 		mAudio->setSampleRate(s->getSampleRate());
 	}
 }
@@ -358,8 +594,7 @@ void RecorderTrack::setRecording(bool b)
 		AudioStream* s = mRecorder->getStream();
         AudioPool* p = mRecorder->getAudioPool();
 		mAudio = p->newAudio();
-        // !! assuming 2 channel ports
-		mAudio->setChannels(2);
+		mAudio->setChannels(s->getInputPortChannels(mInputPort));
 		mAudio->setSampleRate(s->getSampleRate());
 	}
 }
@@ -379,6 +614,18 @@ bool RecorderTrack::isPriority()
     return false;
 }
 
+/**
+ * Return true if this track can be processed on a worker thread
+ * concurrently with other independent tracks.  This must only be
+ * true if processBuffers won't touch anything shared with other
+ * tracks during this interrupt.  Must be overloaded in the subclass
+ * if it wants to participate.
+ */
+bool RecorderTrack::isIndependent(long bufferFrames)
+{
+    return false;
+}
+
 /**
  * Must be overloaded in the subclass if it cares.
  */
@@ -550,8 +797,26 @@ Recorder::Recorder(AudioInterface* ai, MidiInterface* midi, AudioPool* pool)
 	mLastInterruptTime = 0;
 
 	mTrackCount = 0;
-	for (i = 0 ; i < MAX_RECORDER_TRACKS ; i++)
-	  mTracks[i] = NULL;
+	for (i = 0 ; i < MAX_RECORDER_TRACKS ; i++) {
+		mTracks[i] = NULL;
+		mParallelTracks[i] = NULL;
+		mParallelInputs[i] = NULL;
+		mParallelPorts[i] = NULL;
+		mParallelOutputs[i] = NULL;
+		mParallelChannels[i] = 0;
+	}
+
+	mWorkerCount = 0;
+	for (i = 0 ; i < MAX_RECORDER_WORKERS ; i++)
+	  mWorkers[i] = NULL;
+	mParallelStream = NULL;
+	mParallelFrames = 0;
+	mParallelFrame = 0;
+	mParallelGeneration = 0;
+	mParallelWork = 0;
+	mParallelDone = 0;
+	mParallelLate = 0;
+	mParallelMaxWait = 0;
 }
 
 Recorder::~Recorder() 
@@ -563,6 +828,8 @@ Recorder::~Recorder()
 			delete mTracks[i];
 			mTracks[i] = NULL;
 		}
+		delete mParallelOutputs[i];
+		mParallelOutputs[i] = NULL;
 	}
 }
 
@@ -573,6 +840,7 @@ Recorder::~Recorder()
 void Recorder::shutdown() 
 {
 	stop();
+	setParallelTracks(0);
 
 	mMonitor = NULL;
 
@@ -589,6 +857,69 @@ PUBLIC void Recorder::setMonitor(RecorderMonitor* m)
 	mMonitor = m;
 }
 
+/**
+ * Set the number of worker threads used to process independent
+ * tracks in parallel.  Zero disables parallel processing.
+ * This must not be called from the interrupt.
+ */
+PUBLIC void Recorder::setParallelTracks(int workers)
+{
+    int i;
+
+    if (workers < 0)
+      workers = 0;
+    else if (workers > MAX_RECORDER_WORKERS)
+      workers = MAX_RECORDER_WORKERS;
+
+    if (workers != mWorkerCount) {
+
+        // stop the interrupt from using the current workers, if we
+        // caught it in the middle of an interrupt wait for it to finish
+        mWorkerCount = 0;
+        AtomicBarrier();
+        for (i = 0 ; i < 100 && mInInterrupt ; i++)
+          Thread::sleep(1);
+
+        if (mParallelLate > 0)
+          Trace(2, "Recorder: %ld interrupts waited past the spin deadline, max %ld usec\n",
+                (long)mParallelLate, (long)mParallelMaxWait);
+
+        for (i = 0 ; i < MAX_RECORDER_WORKERS ; i++) {
+            RecorderWorker* w = mWorkers[i];
+            if (w != NULL) {
+                if (w->stopAndWait())
+                  delete w;
+                else
+                  Trace(1, "Recorder: Unable to stop worker thread!\n");
+                mWorkers[i] = NULL;
+            }
+        }
+
+        if (workers > 0) {
+            // the private output buffers are kept once allocated
+            for (i = 0 ; i < MAX_RECORDER_TRACKS ; i++) {
+                if (mParallelOutputs[i] == NULL)
+                  mParallelOutputs[i] = new float[AUDIO_MAX_SAMPLES_PER_BUFFER];
+            }
+
+            for (i = 0 ; i < workers ; i++) {
+                mWorkers[i] = new RecorderWorker(this, i + 1);
+                mWorkers[i]->start();
+            }
+
+            AtomicBarrier();
+            mWorkerCount = workers;
+        }
+
+        Trace(2, "Recorder: %ld parallel track workers\n", (long)workers);
+    }
+}
+
+PUBLIC int Recorder::getParallelTracks()
+{
+    return mWorkerCount;
+}
+
 PUBLIC AudioPool* Recorder::getAudioPool()
 {
     return mAudioPool;
@@ -694,7 +1025,7 @@ bool Recorder::add(RecorderTrack *t)
     bool added = false;
 	if (t != NULL && mTrackCount < MAX_RECORDER_TRACKS) {
         Audio* audio = t->getAudio();
-        if (audio == NULL || checkAudio(audio)) {
+        if (audio == NULL || checkAudio(audio, t->getOutputPort())) {
             t->setRecorder(this);
             mTracks[mTrackCount] = t;
             mTrackCount++;
@@ -705,22 +1036,23 @@ bool Recorder::add(RecorderTrack *t)
 }
 
 /**
- * Verify that an Audio can be played by this recorder configuration.
+ * Verify that an Audio can be played by this recorder configuration
+ * through an output port.
  */
-bool Recorder::checkAudio(Audio *a) 
+bool Recorder::checkAudio(Audio *a, int port) 
 {
     bool ok = true;
+    int channels = mStream->getOutputPortChannels(port);
 
     if (mTrackCount == 0) {
         // first one in gets to determine the configuration
-        // !! assuming 2 channel ports
-        if (a->getChannels() != 2) {
+        if (a->getChannels() != channels) {
             printf("ERROR: Audio with %d channels!!\n", a->getChannels());
             fflush(stdout);
         }
 		mStream->setSampleRate(a->getSampleRate());
     }
-    else if (a->getChannels() != 2) {
+    else if (a->getChannels() != channels) {
         printf("Unable to load audio, incompatible channels.\n");
         fflush(stdout);
         ok = false;
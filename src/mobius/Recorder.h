@@ -96,6 +96,19 @@
  */
 #define MAX_OUTPUT_PORTS 8
 
+/**
+ * Maximum number of worker threads for parallel track processing.
+ */
+#define MAX_RECORDER_WORKERS 16
+
+/**
+ * How long the interrupt spins waiting for the workers to finish the
+ * tracks they claimed, as a percentage of the block duration.  After
+ * this it yields the processor while it waits so a worker that was
+ * descheduled can run, even on a single core.
+ */
+#define RECORDER_PARALLEL_SPIN_PERCENT 25
+
 /****************************************************************************
  *                                                                          *
  *   							RECORDER TRACK                              *
@@ -188,6 +201,9 @@ class RecorderTrack {
     // indicates that this track should be processed before others
     virtual bool isPriority();
 
+    // indicates that this track may be processed on a worker thread
+    virtual bool isIndependent(long bufferFrames);
+
 	// to be called only by Recorder
 	virtual void processBuffers(class AudioStream* stream, 
 								float* input, float* output, 
@@ -269,6 +285,11 @@ class RecorderMonitor {
 	virtual void recorderMonitorEnter(AudioStream* stream) = 0;
 	virtual void recorderMonitorExit(AudioStream* stream) = 0;
 
+    // RecorderWorker threads, numbered from 1, before they process
+    // tracks for the first time and as they end
+    virtual void recorderMonitorWorkerStart(int number) = 0;
+    virtual void recorderMonitorWorkerEnd(int number) = 0;
+
 };
 
 /****************************************************************************
@@ -316,6 +337,8 @@ class Recorder : public AudioHandler {
 	void setAutoStop(bool b);
 	void setEcho(bool b);
 	void setMonitor(RecorderMonitor* m);
+    void setParallelTracks(int workers);
+    int getParallelTracks();
 
     // Audio device specification
 
@@ -364,9 +387,15 @@ class Recorder : public AudioHandler {
 
  private:
 
-    bool checkAudio(Audio* audio);
+	friend class RecorderWorker;
+
+    bool checkAudio(Audio* audio, int port);
 	bool removeTrack(int n);
 	void processTracks(AudioStream* stream);
+	void processTrack(AudioStream* stream, RecorderTrack* track, long frames);
+	void runParallelTracks(AudioStream* stream, int count, long frames, 
+                           int workers);
+	void processParallelTracks();
 	void calibrateInterrupt(float *input, float *output, long frames);
 
 	class AudioInterface* mAudio;
@@ -399,6 +428,39 @@ class Recorder : public AudioHandler {
 
 	long mLastInterruptTime;
 
+    //
+    // Parallel track processing
+    // Tracks that have no dependencies on other tracks during this
+    // interrupt may be processed by worker threads.  Each one renders
+    // into a private output buffer which is mixed into the port buffer 
+    // in track order after all of them finish.
+    //
+
+	class RecorderWorker* mWorkers[MAX_RECORDER_WORKERS];
+	volatile int mWorkerCount;
+
+	RecorderTrack* mParallelTracks[MAX_RECORDER_TRACKS];
+	float* mParallelInputs[MAX_RECORDER_TRACKS];
+	float* mParallelPorts[MAX_RECORDER_TRACKS];
+	float* mParallelOutputs[MAX_RECORDER_TRACKS];
+	int mParallelChannels[MAX_RECORDER_TRACKS];
+	AudioStream* mParallelStream;
+	long mParallelFrames;
+	long mParallelFrame;
+	int mParallelGeneration;
+
+	/**
+	 * Generation, track count, and next track index packed into
+	 * one word so claiming a track is a single compare and swap
+	 * that fails if a late worker is looking at a previous interrupt.
+	 */
+	volatile int mParallelWork;
+	volatile int mParallelDone;
+
+    // interrupts that waited past the spin deadline
+	int mParallelLate;
+	int mParallelMaxWait;
+
 };
 
 /****************************************************************************/
@@ -14,6 +14,32 @@
  * Can eventually factor this out into a set of utility classes, but
  * for now I want to keep everything encapsulated.
  *
+ * SINC FILTERS
+ *
+ * Linear interpolation is cheap but dulls the highs when slowing down
+ * and folds everything above the new Nyquist frequency back down when
+ * speeding up.  The higher quality levels replace the interpolation
+ * with a windowed sinc filter evaluated at the same fractional
+ * position.  The threshold stepping is the same for all qualities so
+ * the frame counts calculated by the scale methods don't change.
+ *
+ * The filter for each output frame may not extend past the same "next"
+ * frame linear interpolation uses so we never need frames beyond the
+ * end of the block.  The price is a fixed delay of RESAMPLER_DELAY
+ * frames, the earlier frames come from a history of the previous blocks.
+ * When decimating the filter is widened to lower the cutoff, up to
+ * RESAMPLER_MAX_TAPS input frames.  The delay is the same for every
+ * width so it does not jump when the speed changes.  For the same
+ * reason normal speed is delayed by the same amount whenever a sinc
+ * quality is selected, and Stream adds the delay to its latency.
+ *
+ * The coefficients are tabulated for RESAMPLER_PHASES positions
+ * between two frames.  A pitch bend changes the speed and therefore
+ * the cutoff on every interrupt, so the tables are built ahead of time
+ * for RESAMPLER_CUTOFF_STEPS cutoffs per octave and shared by all
+ * Resamplers.  The cutoff is rounded down to the next step, changing
+ * the speed only selects a different table.
+ *
  */
 
 #include <stdio.h>
@@ -22,6 +48,7 @@
 #include "Util.h"
 #include "Trace.h"
 
+#include "AudioKernel.h"
 #include "Resampler.h"
 
 /****************************************************************************
@@ -144,6 +171,144 @@ PUBLIC float Resampler::getSpeed(int octave, int step, int bend, int stretch)
     return speed;
 }
 
+/****************************************************************************
+ *                                                                          *
+ *                             PROTOTYPE FILTERS                            *
+ *                                                                          *
+ ****************************************************************************/
+
+#define PI (3.141592653589793)
+
+/**
+ * The number of taps for each quality, this is also the number
+ * of zero crossings of the sinc covered by the window.
+ */
+static int QualityTaps[RESAMPLER_QUALITIES] = {2, 8, 32};
+
+/**
+ * One side of the windowed sinc for each quality, sampled at
+ * RESAMPLER_PROTOTYPE_RESOLUTION points per zero crossing
+ * with an extra zero at the end for interpolation.
+ */
+static float Prototype8[(4 * RESAMPLER_PROTOTYPE_RESOLUTION) + 2];
+static float Prototype32[(16 * RESAMPLER_PROTOTYPE_RESOLUTION) + 2];
+
+static float* Prototypes[RESAMPLER_QUALITIES] = {NULL, Prototype8, Prototype32};
+
+static bool PrototypesInitialized = false;
+
+/**
+ * Filter tables for each quality and cutoff step.  Once the filter
+ * reaches RESAMPLER_MAX_TAPS the cutoff can't go lower and the
+ * remaining steps share the last table.
+ */
+static float* Filters[RESAMPLER_QUALITIES][RESAMPLER_CUTOFFS];
+static int FilterWidths[RESAMPLER_QUALITIES][RESAMPLER_CUTOFFS];
+
+/**
+ * Build the prototype tables, a sinc with a Blackman window.
+ * This is called when a Resampler is constructed which won't be
+ * in the interrupt.
+ */
+PRIVATE void Resampler::initPrototypes()
+{
+	if (!PrototypesInitialized) {
+		for (int q = 1 ; q < RESAMPLER_QUALITIES ; q++) {
+			float* proto = Prototypes[q];
+			int half = QualityTaps[q] / 2;
+			int points = half * RESAMPLER_PROTOTYPE_RESOLUTION;
+
+			for (int i = 0 ; i <= points ; i++) {
+				double x = (double)i / RESAMPLER_PROTOTYPE_RESOLUTION;
+				double sinc = (i == 0) ? 1.0 : sin(PI * x) / (PI * x);
+				double window = 0.42 + (0.5 * cos(PI * x / half)) + 
+					(0.08 * cos(2.0 * PI * x / half));
+				proto[i] = (float)(sinc * window);
+			}
+			proto[points] = 0.0f;
+			proto[points + 1] = 0.0f;
+		}
+		initFilters();
+		PrototypesInitialized = true;
+	}
+}
+
+/**
+ * Build the filter tables for each cutoff step.  
+ * Step zero is the full bandwidth filter used when we aren't
+ * decimating.
+ */
+PRIVATE void Resampler::initFilters()
+{
+	for (int q = 1 ; q < RESAMPLER_QUALITIES ; q++) {
+		int taps = QualityTaps[q];
+		float* last = NULL;
+
+		for (int step = 0 ; step < RESAMPLER_CUTOFFS ; step++) {
+			if (last != NULL) {
+				Filters[q][step] = last;
+				FilterWidths[q][step] = RESAMPLER_MAX_TAPS;
+			}
+			else {
+				double cutoff = pow(2.0, -(double)step / RESAMPLER_CUTOFF_STEPS);
+
+				// widen to cover the same number of zero crossings
+				// at the lower cutoff, keeping it even
+				int width = (int)ceil((taps / cutoff) - 0.0001);
+				width += (width & 1);
+				if (width >= RESAMPLER_MAX_TAPS) {
+					width = RESAMPLER_MAX_TAPS;
+					cutoff = (double)taps / (double)width;
+				}
+
+				float* coeffs = new float[(RESAMPLER_PHASES + 1) * width];
+				buildFilter(q, (float)cutoff, width, coeffs);
+				Filters[q][step] = coeffs;
+				FilterWidths[q][step] = width;
+				if (width == RESAMPLER_MAX_TAPS)
+				  last = coeffs;
+			}
+		}
+	}
+}
+
+/**
+ * Sample the prototype for one quality at a cutoff into a table
+ * of width coefficients for each phase.
+ */
+PRIVATE void Resampler::buildFilter(int quality, float cutoff, int width,
+									float* coeffs)
+{
+	float* proto = Prototypes[quality];
+	int points = (QualityTaps[quality] / 2) * RESAMPLER_PROTOTYPE_RESOLUTION;
+	int half = width / 2;
+
+	for (int phase = 0 ; phase <= RESAMPLER_PHASES ; phase++) {
+		float* phaseCoeffs = &coeffs[phase * width];
+		double t = (double)phase / RESAMPLER_PHASES;
+		double sum = 0.0;
+
+		for (int k = 0 ; k < width ; k++) {
+			double distance = fabs((k - half + 1) - t);
+			double pos = distance * cutoff * RESAMPLER_PROTOTYPE_RESOLUTION;
+			int index = (int)pos;
+			double c = 0.0;
+			if (index < points) {
+				double frac = pos - index;
+				c = proto[index] + (frac * (proto[index + 1] - proto[index]));
+			}
+			phaseCoeffs[k] = (float)c;
+			sum += c;
+		}
+
+		// normalize so DC passes at unity for every phase
+		if (sum != 0.0) {
+			for (int k = 0 ; k < width ; k++)
+			  phaseCoeffs[k] = (float)(phaseCoeffs[k] / sum);
+		}
+	}
+}
+
 /****************************************************************************
  *                                                                          *
  *                                 RESAMPLER                                *
@@ -169,6 +334,17 @@ PUBLIC void Resampler::init()
 	mInverseSpeed = (float)(1.0f / mSpeed);
     mChannels = 2;
 
+	mQuality = 0;
+	mFilterQuality = -1;
+	mFilterCutoff = 0;
+	mFilterTaps = 2;
+	mFilterWidth = 2;
+	SampleZero(mHistory, RESAMPLER_MAX_TAPS * AUDIO_MAX_CHANNELS);
+	SampleZero(mSplice, RESAMPLER_MAX_TAPS * 2 * AUDIO_MAX_CHANNELS);
+	mCoefficients = NULL;
+
+	initPrototypes();
+
 	reset();
 
 	for (int i = 0 ; i < mChannels ; i++)
@@ -214,6 +390,136 @@ PUBLIC void Resampler::setSpeed(float speed)
 	}
 }
 
+/**
+ * Set the quality, an ordinal of Preset::ResampleQuality.
+ * This is called on every interrupt, the filter is rebuilt
+ * the next time we transpose if it changed.
+ */
+PUBLIC void Resampler::setQuality(int quality)
+{
+	if (quality < 0 || quality >= RESAMPLER_QUALITIES)
+	  quality = 0;
+	mQuality = quality;
+}
+
+PUBLIC int Resampler::getQuality()
+{
+	return mQuality;
+}
+
+PUBLIC bool Resampler::isInput()
+{
+	return mInput;
+}
+
+/**
+ * The delay in source frames the selected quality adds to the stream,
+ * whatever the speed.  prepareFilter falls back to linear for anything
+ * but stereo.
+ */
+PUBLIC int Resampler::getDelay()
+{
+	return (mQuality > 0 && mChannels == 2) ? RESAMPLER_DELAY : 0;
+}
+
+/**
+ * Select the filter table for the quality and the speed.  Speed is
+ * the transposition speed, if greater than 1 we're decimating and the
+ * cutoff has to come down.  The tables were built by initFilters so
+ * this is safe to call in the interrupt.
+ */
+PRIVATE void Resampler::prepareFilter(float speed)
+{
+	int quality = mQuality;
+	int cutoff = 0;
+
+	// the dot product kernels only handle stereo
+	if (mChannels != 2)
+	  quality = 0;
+
+	if (quality > 0 && speed > 1.0f) {
+		// round up to the next step so the cutoff is never too high
+		cutoff = (int)ceil((log(speed) * RESAMPLER_CUTOFF_STEPS / log(2.0)) -
+						   0.0001);
+		if (cutoff >= RESAMPLER_CUTOFFS)
+		  cutoff = RESAMPLER_CUTOFFS - 1;
+	}
+
+	if (quality != mFilterQuality || cutoff != mFilterCutoff) {
+		mFilterQuality = quality;
+		mFilterCutoff = cutoff;
+		mFilterTaps = QualityTaps[quality];
+		if (quality > 0) {
+			mFilterWidth = FilterWidths[quality][cutoff];
+			mCoefficients = Filters[quality][cutoff];
+		}
+		else {
+			mFilterWidth = mFilterTaps;
+			mCoefficients = NULL;
+		}
+	}
+}
+
+/**
+ * Calculate one output frame with the sinc filter.
+ * Next is the index of the "next" frame in the source block as
+ * used by linear interpolation, it may be zero in which case the
+ * "current" frame is the last one from the previous block.  The
+ * position between the two frames is mThreshold.
+ */
+PRIVATE void Resampler::filter(float* src, long next, float* dest)
+{
+	long first = next - RESAMPLER_DELAY - (mFilterWidth / 2);
+	float* frames;
+
+	// at the front of the block the filter reaches into the history
+	if (first < 0)
+	  frames = &mSplice[(first + RESAMPLER_MAX_TAPS) * 2];
+	else
+	  frames = &src[first * 2];
+
+	float pos = mThreshold * RESAMPLER_PHASES;
+	int phase = (int)pos;
+	if (phase >= RESAMPLER_PHASES)
+	  phase = RESAMPLER_PHASES - 1;
+	float frac = pos - phase;
+
+	float l1, r1, l2, r2;
+	SampleDotStereo(frames, &mCoefficients[phase * mFilterWidth],
+					mFilterWidth, &l1, &r1);
+	SampleDotStereo(frames, &mCoefficients[(phase + 1) * mFilterWidth],
+					mFilterWidth, &l2, &r2);
+
+	dest[0] = l1 + (frac * (l2 - l1));
+	dest[1] = r1 + (frac * (r2 - r1));
+}
+
+/**
+ * Remember the last RESAMPLER_MAX_TAPS frames of the source blocks
+ * for the sinc filters.  This is done for every block even when we're
+ * using linear interpolation so we can switch at any time.
+ */
+PRIVATE void Resampler::saveHistory(float* src, long srcFrames)
+{
+	if (srcFrames > 0) {
+		int historySamples = RESAMPLER_MAX_TAPS * mChannels;
+		int samples = srcFrames * mChannels;
+
+		if (samples >= historySamples) {
+			float* last = &src[samples - historySamples];
+			for (int i = 0 ; i < historySamples ; i++)
+			  mHistory[i] = last[i];
+		}
+		else {
+			int keep = historySamples - samples;
+			for (int i = 0 ; i < keep ; i++)
+			  mHistory[i] = mHistory[i + samples];
+			for (int i = 0 ; i < samples ; i++)
+			  mHistory[keep + i] = src[i];
+		}
+	}
+}
+
 /**
  * Set the speed as a scale degree.
  */
@@ -277,6 +583,10 @@ PUBLIC long Resampler::addRemainder(float* buffer, long maxFrames)
  * If speed is 1.0, just do a copy, otherwise call the tranpose() method
  * with the appropriate speed.  If we're the input stream, the speed
  * we use for transposition has to be the inverse of the play speed.
+ *
+ * Stream only calls this at 1.0 when a sinc quality is selected,
+ * the copy is then delayed the same as the filters so we neither
+ * replay nor skip frames when the speed starts or stops changing.
  */
 PUBLIC long Resampler::resample(float* src, long srcFrames, 
                                 float* dest, long destFrames)
@@ -284,7 +594,6 @@ PUBLIC long Resampler::resample(float* src, long srcFrames,
 	long actual = 0;
 
     if (mSpeed == 1.0) {
-        // shouldn't get here, but pass through
         long samples = srcFrames * mChannels;
 		if (destFrames <= 0)
 		  actual = srcFrames;
@@ -300,8 +609,14 @@ PUBLIC long Resampler::resample(float* src, long srcFrames,
 			}
 		}
 
-        for (int i = 0 ; i < samples ; i++)
-          *dest++ = *src++;
+        // the first frames come from the history
+        int delay = getDelay();
+        long frames = samples / mChannels;
+        long delayed = (frames < delay) ? frames : delay;
+        SampleCopy(dest, &mHistory[(RESAMPLER_MAX_TAPS - delay) * mChannels],
+                   delayed * mChannels);
+        SampleCopy(&dest[delayed * mChannels], src, 
+                   (frames - delayed) * mChannels);
 
         mRemainderFrames = 0;
 		mThreshold = 1.0;
@@ -318,6 +633,9 @@ PUBLIC long Resampler::resample(float* src, long srcFrames,
 		actual = transpose(src, srcFrames, dest, destFrames, speed);
 	}
 
+	// the sinc filters will need these if the speed starts changing
+	saveHistory(src, srcFrames);
+
 	return actual;
 }
 
@@ -498,13 +816,32 @@ PUBLIC long Resampler::transpose(float* src, long srcFrames,
 
 	mRemainderFrames = 0;
 
+	prepareFilter(speed);
+	bool sinc = (mFilterQuality > 0);
+	if (sinc) {
+		// history followed by the front of this block so the filters
+		// that straddle the boundary see contiguous frames
+		int historySamples = RESAMPLER_MAX_TAPS * 2;
+		long front = (srcFrames < RESAMPLER_MAX_TAPS) ? 
+			srcFrames : RESAMPLER_MAX_TAPS;
+		for (int i = 0 ; i < historySamples ; i++)
+		  mSplice[i] = mHistory[i];
+		for (int i = 0 ; i < front * 2 ; i++)
+		  mSplice[historySamples + i] = src[i];
+	}
+
     // combine last frame from previous block with first frame of this block
     while (mThreshold <= 1.0f) {
-		for (int i = 0 ; i < mChannels ; i++) {
-			float f1 = (1.0f - mThreshold) * mLastFrame[i];
-			float f2 = mThreshold * srcFrame[i];
-			*destFrame++ = f1 + f2;
+		if (sinc)
+		  filter(src, 0, destFrame);
+		else {
+			for (int i = 0 ; i < mChannels ; i++) {
+				float f1 = (1.0f - mThreshold) * mLastFrame[i];
+				float f2 = mThreshold * srcFrame[i];
+				destFrame[i] = f1 + f2;
+			}
 		}
+		destFrame += mChannels;
 		advance++;
         mThreshold += speed;
     }
@@ -534,11 +871,16 @@ PUBLIC long Resampler::transpose(float* src, long srcFrames,
 			Trace(1, "Transposition remainder overflow!\n");
 		}
 		else { 
-			for (int i = 0 ; i < mChannels ; i++) {
-				float f1 = (1.0f - mThreshold) * srcFrame[i];
-				float f2 = mThreshold * nextFrame[i];
-				*destFrame++ = f1 + f2;
+			if (sinc)
+			  filter(src, (nextFrame - src) / mChannels, destFrame);
+			else {
+				for (int i = 0 ; i < mChannels ; i++) {
+					float f1 = (1.0f - mThreshold) * srcFrame[i];
+					float f2 = mThreshold * nextFrame[i];
+					destFrame[i] = f1 + f2;
+				}
 			}
+			destFrame += mChannels;
 			advance++;
 
 			if (remainder)
@@ -581,6 +923,7 @@ PUBLIC void Resampler::transposeOnce(float* src, float* dest,
 	mThreshold = 1.0f;
 	for (int i = 0 ; i < mChannels ; i++)
 	  mLastFrame[i] = 0.0;
+	SampleZero(mHistory, RESAMPLER_MAX_TAPS * AUDIO_MAX_CHANNELS);
 
     transpose(src, frames, dest, 0, speed);
 }
@@ -110,6 +110,51 @@
  */
 #define BEND_FACTOR 1.000085f
 
+/**
+ * The number of resampling quality levels, these are the ordinals
+ * of Preset::ResampleQuality.  The first is linear interpolation
+ * the others are windowed sinc filters with 8 and 32 taps.
+ */
+#define RESAMPLER_QUALITIES 3
+
+/**
+ * The maximum number of input frames a sinc filter may cover.
+ * When decimating the filter is stretched to lower its cutoff,
+ * beyond this we let the cutoff rise and accept some aliasing.
+ * This is also the number of frames of history we keep.
+ */
+#define RESAMPLER_MAX_TAPS 64
+
+/**
+ * The delay in frames added by the sinc filters.  The filter centers
+ * are moved back this far so the widest filter never needs a frame
+ * beyond the "next" frame used by linear interpolation.
+ */
+#define RESAMPLER_DELAY ((RESAMPLER_MAX_TAPS / 2) - 1)
+
+/**
+ * The number of filter phases between two input frames.  
+ * We interpolate between the two nearest phases.
+ */
+#define RESAMPLER_PHASES 64
+
+/**
+ * The resolution of the prototype filters in points per zero crossing.
+ */
+#define RESAMPLER_PROTOTYPE_RESOLUTION 256
+
+/**
+ * The number of filter cutoffs per octave of decimation.  The
+ * filters for each are built once when the first Resampler is
+ * constructed, the cutoff for a speed is rounded down to one of these.
+ */
+#define RESAMPLER_CUTOFF_STEPS 24
+
+/**
+ * The number of filter cutoffs for each quality.
+ */
+#define RESAMPLER_CUTOFFS ((MAX_RATE_OCTAVE * RESAMPLER_CUTOFF_STEPS) + 1)
+
 //////////////////////////////////////////////////////////////////////
 // 
 // Resampler
@@ -136,6 +181,10 @@ class Resampler {
     
 	void reset();
     void setSpeed(float speed);
+	void setQuality(int quality);
+	int getQuality();
+	int getDelay();
+	bool isInput();
     long addRemainder(float* buffer, long maxFrames);
 	float getThreshold();
 
@@ -174,6 +223,14 @@ class Resampler {
 	long scaleToDestFrames(float speed, float threshold, long srcFrames);
 	long scaleToSourceFrames(float speed, float threshold, long destFrames);
 
+	static void initPrototypes();
+	static void initFilters();
+	static void buildFilter(int quality, float cutoff, int width, 
+							float* coeffs);
+	void prepareFilter(float speed);
+	void filter(float* src, long frame, float* dest);
+	void saveHistory(float* src, long srcFrames);
+
 	//
 	// Fields
 	//
@@ -188,6 +245,22 @@ class Resampler {
 	float mLastFrame[AUDIO_MAX_CHANNELS];
 	float mThreshold;
 
+	//
+	// Sinc filter state, the last frames from the previous blocks
+	// and the coefficients for each phase
+	//
+
+	int mQuality;
+	int mFilterQuality;
+	int mFilterCutoff;
+	int mFilterTaps;
+	int mFilterWidth;
+	float mHistory[RESAMPLER_MAX_TAPS * AUDIO_MAX_CHANNELS];
+	float mSplice[RESAMPLER_MAX_TAPS * 2 * AUDIO_MAX_CHANNELS];
+
+	// shared filter table, mFilterWidth coefficients for each phase
+	float* mCoefficients;
+
 };
 
 /****************************************************************************/
@@ -14,9 +14,12 @@
 
 #include <stdio.h>
 #include <memory.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #include "Trace.h"
 #include "Util.h"
+#include "Thread.h"
 #include "XmlBuffer.h"
 #include "XmlModel.h"
 
@@ -225,13 +228,411 @@ void Samples::parseXml(XmlElement* e)
 	}
 }
 
+//////////////////////////////////////////////////////////////////////
+//
+// SampleFile
+//
+//////////////////////////////////////////////////////////////////////
+
+/**
+ * Get the size and modification time that identify a version of a file.
+ * A missing file has a size of -1, if it appears later it is different.
+ */
+static void GetFileStamp(const char* path, long long* size, 
+                         long long* modified)
+{
+	struct stat sb;
+
+	if (stat(path, &sb) == 0) {
+        *size = sb.st_size;
+        *modified = sb.st_mtime;
+    }
+    else {
+        *size = -1;
+        *modified = 0;
+    }
+}
+
+/**
+ * Created with one reference by SampleCache::acquire, the Audio
+ * is read after the file is on the list.
+ */
+SampleFile::SampleFile(SampleCache* cache, const char* path,
+                       long long size, long long modified)
+{
+    mCache = cache;
+    mNext = NULL;
+    mPath = CopyString(path);
+    mSize = size;
+    mModified = modified;
+    mAudio = NULL;
+    mReferences = 1;
+    mStale = false;
+}
+
+SampleFile::~SampleFile()
+{
+    delete mPath;
+    delete mAudio;
+}
+
+const char* SampleFile::getPath()
+{
+    return mPath;
+}
+
+Audio* SampleFile::getAudio()
+{
+    return mAudio;
+}
+
+/**
+ * True if the file on disk is no longer the one we read.
+ */
+bool SampleFile::isModified()
+{
+    long long size;
+    long long modified;
+    GetFileStamp(mPath, &size, &modified);
+    return (size != mSize || modified != mModified);
+}
+
+/**
+ * Called when a SamplePlayer is deleted, usually in the interrupt.
+ * Don't touch the file after the last reference is gone, 
+ * MobiusThread may already be deleting it.
+ */
+void SampleFile::release()
+{
+    SampleCache* cache = mCache;
+    if (AtomicDecrement(&mReferences) == 0)
+      cache->mReleased = 1;
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// SampleWorker
+//
+//////////////////////////////////////////////////////////////////////
+
+/**
+ * Thread that helps SampleCache decode new files.
+ * Workers are signaled after they start and claim files until there
+ * are none left, see SampleCache::acquire.  A signal sent before the
+ * thread is waiting is lost so we also look on a short timeout.
+ */
+class SampleWorker : public Thread {
+
+  public:
+
+    SampleWorker(SampleCache* c, int number);
+	~SampleWorker();
+
+    void processEvent();
+    void eventTimeout();
+
+  private:
+
+    SampleCache* mCache;
+
+};
+
+SampleWorker::SampleWorker(SampleCache* c, int number)
+{
+    char name[64];
+    sprintf(name, "SampleWorker %d", number);
+    setName(name);
+    setTimeout(SAMPLE_WORKER_TIMEOUT);
+    mCache = c;
+}
+
+SampleWorker::~SampleWorker()
+{
+}
+
+void SampleWorker::processEvent()
+{
+    mCache->processFiles();
+}
+
+void SampleWorker::eventTimeout()
+{
+    mCache->processFiles();
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// SampleCache
+//
+//////////////////////////////////////////////////////////////////////
+
+SampleCache::SampleCache(AudioPool* pool)
+{
+    mPool = pool;
+    mLoadCsect = new CriticalSection("SampleCache load");
+    mCsect = new CriticalSection("SampleCache");
+    mFiles = NULL;
+    mReleased = 0;
+    mJobs = NULL;
+    mJobCount = 0;
+    mNextJob = 0;
+    mJobsDone = 0;
+    mReused = 0;
+    mDecoded = 0;
+    mPruned = 0;
+}
+
+/**
+ * The SamplePlayers must be gone by now, if something still has
+ * a reference we delete it anyway.
+ */
+SampleCache::~SampleCache()
+{
+    SampleFile* next = NULL;
+    for (SampleFile* f = mFiles ; f != NULL ; f = next) {
+        next = f->mNext;
+        if (f->mReferences > 0)
+          Trace(1, "SampleCache: Deleting referenced sample %s\n", f->mPath);
+        delete f;
+    }
+
+    delete mLoadCsect;
+    delete mCsect;
+}
+
+/**
+ * Find the current version of a file.
+ * Must be called within mCsect.
+ */
+SampleFile* SampleCache::find(const char* path, long long size, 
+                              long long modified)
+{
+    SampleFile* found = NULL;
+    for (SampleFile* f = mFiles ; f != NULL && found == NULL ; f = f->mNext) {
+        if (!f->mStale && StringEqual(f->mPath, path)) {
+            if (f->mSize == size && f->mModified == modified)
+              found = f;
+            else {
+                // it changed on disk, the players that have it
+                // keep it until they're replaced
+                f->mStale = true;
+            }
+        }
+    }
+    return found;
+}
+
+/**
+ * Add a reference to the file for each Sample in the list,
+ * reading the ones we don't have.  New files are decoded in parallel,
+ * the files array is left in the same order as the Samples with
+ * NULL for Samples without a file name.
+ *
+ * This may take a while, mCsect is only held while we look
+ * at the list so MobiusThread can still prune.  The new files already
+ * have a reference so they won't be pruned while we read them.
+ */
+void SampleCache::acquire(const char* homedir, Samples* samples, 
+                          SampleFile** files)
+{
+    int count = 0;
+    for (Sample* s = samples->getSamples() ; s != NULL ; s = s->getNext())
+      count++;
+
+    if (count > 0) {
+        long long start = GetClockTicks();
+        int reused = 0;
+        int i = 0;
+
+        mLoadCsect->enter();
+        mJobs = new SampleFile*[count];
+        mJobCount = 0;
+
+        mCsect->enter();
+        for (Sample* s = samples->getSamples() ; s != NULL ; 
+             s = s->getNext()) {
+
+            SampleFile* file = NULL;
+            const char* filename = s->getFilename();
+            if (filename != NULL) {
+                // always check CWD or always relative to homedir?
+                char path[1024 * 8];
+                long long size;
+                long long modified;
+                MergePaths(homedir, filename, path, sizeof(path));
+                GetFileStamp(path, &size, &modified);
+
+                file = find(path, size, modified);
+                if (file != NULL) {
+                    AtomicIncrement(&file->mReferences);
+                    // the same file may be used more than once
+                    if (file->mAudio != NULL)
+                      reused++;
+                }
+                else {
+                    file = new SampleFile(this, path, size, modified);
+                    file->mNext = mFiles;
+                    mFiles = file;
+                    mJobs[mJobCount++] = file;
+                }
+            }
+            files[i++] = file;
+        }
+        mCsect->leave();
+
+        int workerCount = 0;
+        if (mJobCount > 0) {
+            mNextJob = 0;
+            mJobsDone = 0;
+            AtomicBarrier();
+
+            SampleWorker* workers[SAMPLE_MAX_WORKERS];
+            workerCount = mJobCount - 1;
+            if (workerCount > SAMPLE_MAX_WORKERS)
+              workerCount = SAMPLE_MAX_WORKERS;
+
+            for (i = 0 ; i < workerCount ; i++) {
+                workers[i] = new SampleWorker(this, i + 1);
+                workers[i]->start();
+                workers[i]->signal();
+            }
+
+            processFiles();
+
+            // wait for the workers to finish the ones they claimed
+            while (mJobsDone < mJobCount)
+              SleepMillis(1);
+
+            // ask them all to stop before waiting on any of them
+            for (i = 0 ; i < workerCount ; i++)
+              workers[i]->stop();
+
+            for (i = 0 ; i < workerCount ; i++) {
+                if (workers[i]->stopAndWait())
+                  delete workers[i];
+                else
+                  Trace(1, "SampleCache: Unable to stop worker thread!\n");
+            }
+        }
+
+        mReused += reused;
+        mDecoded += mJobCount;
+
+        Trace(2, "SampleCache: Reused %ld decoded %ld samples with %ld workers in %ld usec\n",
+              (long)reused, (long)mJobCount, (long)workerCount,
+              (long)ClockTicksToMicros(GetClockTicks() - start));
+
+        delete mJobs;
+        mJobs = NULL;
+        mJobCount = 0;
+        mLoadCsect->leave();
+    }
+}
+
+/**
+ * Claim files until there are none left.
+ * Called by acquire and the worker threads.
+ */
+void SampleCache::processFiles()
+{
+    int next;
+
+    while ((next = AtomicIncrement(&mNextJob) - 1) < mJobCount) {
+        SampleFile* file = mJobs[next];
+        Trace(2, "Loading sample %s\n", file->mPath);
+        // the buffers don't come from the ring, see Audio::allocFileBuffer
+        file->mAudio = mPool->newAudio(file->mPath);
+        AtomicIncrement(&mJobsDone);
+    }
+}
+
+/**
+ * Called by MobiusThread whenever it wakes up.
+ * Delete the files the interrupt let go of when it installed
+ * a new SamplePack.
+ */
+void SampleCache::prune()
+{
+    if (mReleased) {
+        int pruned = 0;
+
+        mCsect->enter();
+        // clear it first, a release after this will set it again
+        mReleased = 0;
+        AtomicBarrier();
+
+        SampleFile* prev = NULL;
+        SampleFile* next = NULL;
+        for (SampleFile* f = mFiles ; f != NULL ; f = next) {
+            next = f->mNext;
+            if (f->mReferences > 0)
+              prev = f;
+            else {
+                if (prev == NULL)
+                  mFiles = next;
+                else
+                  prev->mNext = next;
+                delete f;
+                pruned++;
+            }
+        }
+        mCsect->leave();
+
+        if (pruned > 0) {
+            mPruned += pruned;
+            Trace(2, "SampleCache: Pruned %ld samples\n", (long)pruned);
+        }
+    }
+}
+
+/**
+ * Number of files on the list, including stale files still
+ * held by a SamplePlayer.
+ */
+int SampleCache::getFileCount()
+{
+    int files = 0;
+
+    mCsect->enter();
+    for (SampleFile* f = mFiles ; f != NULL ; f = f->mNext)
+      files++;
+    mCsect->leave();
+
+    return files;
+}
+
+int SampleCache::getReused()
+{
+    return mReused;
+}
+
+int SampleCache::getDecoded()
+{
+    return mDecoded;
+}
+
+int SampleCache::getPruned()
+{
+    return mPruned;
+}
+
+void SampleCache::dump()
+{
+    printf("SampleCache: %d files, %d reused, %d decoded, %d pruned\n",
+           getFileCount(), mReused, mDecoded, mPruned);
+    fflush(stdout);
+}
+
 //////////////////////////////////////////////////////////////////////
 //
 // SamplePlayer
 //
 //////////////////////////////////////////////////////////////////////
 
-SamplePlayer::SamplePlayer(AudioPool* pool, const char* homedir, Sample* src)
+/**
+ * The file reference from SampleCache::acquire becomes ours.
+ */
+SamplePlayer::SamplePlayer(Sample* src, SampleFile* file)
 {
 	init();
 	
@@ -240,19 +641,16 @@ SamplePlayer::SamplePlayer(AudioPool* pool, const char* homedir, Sample* src)
 	mLoop = src->isLoop();
 	mConcurrent = src->isConcurrent();
 
-	if (mFilename != NULL) {
-		// always check CWD or always relative to homedir?
-		char buffer[1024 * 8];
-		MergePaths(homedir, mFilename, buffer, sizeof(buffer));
-		Trace(2, "Loading sample %s\n", buffer);
-		mAudio = pool->newAudio(buffer);
-	}
+	mFile = file;
+	if (mFile != NULL)
+	  mAudio = mFile->getAudio();
 }
 
 void SamplePlayer::init()
 {
 	mNext = NULL;
     mFilename = NULL;
+    mFile = NULL;
 	mAudio = NULL;
 	mSustain = false;
 	mLoop = false;
@@ -272,7 +670,13 @@ void SamplePlayer::init()
 SamplePlayer::~SamplePlayer()
 {
     delete mFilename;
-	delete mAudio;
+
+    // the Audio is shared, SampleCache deletes it when
+    // the last player is gone
+    if (mFile != NULL)
+      mFile->release();
+    else
+      delete mAudio;
 
     // if we had a global cursor pool, this should
     // return it to the pool instead of deleting
@@ -293,6 +697,20 @@ const char* SamplePlayer::getFilename()
     return mFilename;
 }
 
+/**
+ * True if this player would be built differently from the Sample.
+ * Note that we're comparing against the relative path
+ * not the absolute path SampleCache built.
+ */
+bool SamplePlayer::isDifference(Sample* s)
+{
+    return (!StringEqual(s->getFilename(), mFilename) ||
+            s->isSustain() != mSustain ||
+            s->isLoop() != mLoop ||
+            s->isConcurrent() != mConcurrent ||
+            (mFile != NULL && mFile->isModified()));
+}
+
 void SamplePlayer::setNext(SamplePlayer* sp)
 {
 	mNext = sp;
@@ -545,20 +963,36 @@ SamplePack::SamplePack()
     mSamples = NULL;
 }
 
-SamplePack::SamplePack(AudioPool* pool, const char* homedir, Samples* samples)
+/**
+ * Build players for the Samples.  Files that haven't changed since
+ * the last pack are shared with it rather than read again.
+ */
+SamplePack::SamplePack(SampleCache* cache, const char* homedir, Samples* samples)
 {
     mSamples = NULL;
 
 	SamplePlayer* last = NULL;
 
     if (samples != NULL) {
-        for (Sample* s = samples->getSamples() ; s != NULL ; s = s->getNext()) {
-            SamplePlayer* p = new SamplePlayer(pool, homedir, s);
-            if (last == NULL)
-              mSamples = p;
-            else
-              last->setNext(p);
-            last = p;
+        int count = 0;
+        for (Sample* s = samples->getSamples() ; s != NULL ; s = s->getNext())
+          count++;
+
+        if (count > 0) {
+            SampleFile** files = new SampleFile*[count];
+            cache->acquire(homedir, samples, files);
+
+            int i = 0;
+            for (Sample* s = samples->getSamples() ; s != NULL ; 
+                 s = s->getNext()) {
+                SamplePlayer* p = new SamplePlayer(s, files[i++]);
+                if (last == NULL)
+                  mSamples = p;
+                else
+                  last->setNext(p);
+                last = p;
+            }
+            delete files;
         }
     }
 }
@@ -909,9 +1343,10 @@ bool SampleTrack::isPriority()
  * the caller to reload the samples and phase them in to the next interrupt.
  *
  * Differencing is relatively crude, any order or length difference is
- * considered to be enough to reload the samples.  In theory if we have lots
- * of samples and people make small add/remove actions we could optimize
- * the rereading but for now that's not very important.
+ * considered to be enough to rebuild the samples.  This used to reread
+ * every file, now SampleCache only reads the ones that are new or
+ * have changed on disk, so we also look for option changes and files
+ * that were modified since they were read.
  *
  */
 bool SampleTrack::isDifference(Samples* samples)
@@ -937,13 +1372,12 @@ bool SampleTrack::isDifference(Samples* samples)
             difference = true;
         }
         else {
+            // unchanged files are reused so it is cheap to rebuild
+            // the pack when only the options or file contents change
             Sample* s = samples->getSamples();
             SamplePlayer* p = mPlayerList;
             while (s != NULL && !difference) {
-                // note that we're comparing against the relative path
-                // not the absolute path we built in the SamplePlayer
-                // constructor 
-                if (!StringEqual(s->getFilename(), p->getFilename())) {
+                if (p->isDifference(s)) {
                     difference = true;
                 }
                 else {
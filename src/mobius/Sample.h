@@ -182,6 +182,128 @@ typedef struct {
 
 } SampleTrigger;
 
+//////////////////////////////////////////////////////////////////////
+//
+// SampleCache
+//
+//////////////////////////////////////////////////////////////////////
+
+/**
+ * The maximum number of worker threads used to decode new sample
+ * files.  The thread installing the configuration works too.
+ */
+#define SAMPLE_MAX_WORKERS 4
+
+/**
+ * Milliseconds a worker thread waits before looking for files
+ * if it missed the signal.
+ */
+#define SAMPLE_WORKER_TIMEOUT 10
+
+/**
+ * One decoded sample file, shared by every SamplePlayer that uses it.
+ * A file is identified by its absolute path, size and modification
+ * time, if the file changes on disk the next SamplePack gets a new
+ * SampleFile and this one is marked stale.
+ *
+ * SamplePlayers hold a reference.  The last one to let go may be
+ * in the interrupt so the Audio isn't deleted there, SampleCache
+ * deletes unreferenced files later in MobiusThread.
+ */
+class SampleFile
+{
+    friend class SampleCache;
+
+  public:
+
+    const char* getPath();
+    Audio* getAudio();
+    bool isModified();
+
+    // any thread, called by SamplePlayer
+    void release();
+
+  private:
+
+    SampleFile(class SampleCache* cache, const char* path,
+               long long size, long long modified);
+    ~SampleFile();
+
+    class SampleCache* mCache;
+    SampleFile* mNext;
+    char* mPath;
+    long long mSize;
+    long long mModified;
+    Audio* mAudio;
+    volatile int mReferences;
+    bool mStale;
+
+};
+
+/**
+ * Keeps the files used by the current and pending SamplePacks so
+ * a configuration change only decodes the files that are new or
+ * have changed on disk.  Files that still match are given to the
+ * new SamplePlayers by reference.  There is one of these in
+ * a Mobius instance.
+ *
+ * New files are read into buffers allocated outside the AudioPool's
+ * allocation ring so a large pack doesn't empty the ring while the
+ * interrupt is running.
+ */
+class SampleCache
+{
+    friend class SampleFile;
+    friend class SampleWorker;
+
+  public:
+
+    SampleCache(class AudioPool* pool);
+    ~SampleCache();
+
+    // called by SamplePack, files must have one entry per Sample
+    void acquire(const char* homedir, Samples* samples, SampleFile** files);
+
+    // MobiusThread
+    void prune();
+
+    int getFileCount();
+    int getReused();
+    int getDecoded();
+    int getPruned();
+    void dump();
+
+  private:
+
+    SampleFile* find(const char* path, long long size, long long modified);
+    void processFiles();
+
+    class AudioPool* mPool;
+
+    // held for all of acquire so only one pack loads at a time
+    class CriticalSection* mLoadCsect;
+
+    // guards the file list between acquire and prune
+    class CriticalSection* mCsect;
+
+    SampleFile* mFiles;
+
+    // set when a reference goes to zero
+    volatile int mReleased;
+
+    // worker state, see acquire
+    SampleFile** mJobs;
+    int mJobCount;
+    volatile int mNextJob;
+    volatile int mJobsDone;
+
+    // statistics
+    int mReused;
+    int mDecoded;
+    int mPruned;
+
+};
+
 //////////////////////////////////////////////////////////////////////
 //
 // SamplePlayer
@@ -193,7 +315,9 @@ typedef struct {
  * 
  * These are built from the Samples list in the MobiusConfig and do not
  * retain any references to it.  A list of these is phased into the
- * audio interrupt handler with a SamplePack object.
+ * audio interrupt handler with a SamplePack object.  The Audio
+ * belongs to a SampleFile which may be shared with the players
+ * in the previous SamplePack.
  *
  * TODO: Might be interesting to give this capabilities like Segemnt
  * or Layer so we could dynamically define samples from loop material.
@@ -205,7 +329,7 @@ class SamplePlayer
 
   public:
 
-	SamplePlayer(class AudioPool* pool, const char* homedir, Sample* s);
+	SamplePlayer(Sample* s, SampleFile* file);
 	~SamplePlayer();
 
     void updateConfiguration(int inputLatency, int outputLatency);
@@ -214,6 +338,7 @@ class SamplePlayer
 	SamplePlayer* getNext();
 
     const char* getFilename();
+    bool isDifference(Sample* s);
 
 	void setAudio(Audio* a);
 	Audio* getAudio();
@@ -265,6 +390,7 @@ class SamplePlayer
 
 	SamplePlayer* mNext;
     char* mFilename;
+    SampleFile* mFile;
 	Audio* mAudio;
 
 	// flags copied from the Sample
@@ -314,7 +440,7 @@ class SamplePack {
   public:
 
     SamplePack();
-    SamplePack(class AudioPool* pool, const char* homedir, Samples* samples);
+    SamplePack(SampleCache* cache, const char* homedir, Samples* samples);
 
     ~SamplePack();
 
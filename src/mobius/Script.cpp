@@ -227,7 +227,7 @@ PUBLIC void ScriptResolver::getExValue(ExContext* exContext, ExValue* value)
 		}
         
         if (vars != NULL)
-          vars->get(name, value);
+          vars->get(mVariable->getSlot(), name, value);
 	}
     else if (mParameter != NULL) {
         // reuse an export 
@@ -375,7 +375,7 @@ PUBLIC void ScriptArgument::get(ScriptInterpreter* si, ExValue* value)
 		}
 
         if (vars != NULL)
-          vars->get(name, value);
+          vars->get(mVariable->getSlot(), name, value);
 	}
     else if (mParameter != NULL) {
         Export* exp = si->getExport();
@@ -435,7 +435,7 @@ PUBLIC void ScriptArgument::set(ScriptInterpreter* si, ExValue* value)
 		}
         
         if (vars != NULL)
-          vars->set(name, value);
+          vars->set(mVariable->getSlot(), name, value);
 	}
 	else if (mParameter != NULL) {
         const char* name = mParameter->getName();
@@ -1014,13 +1014,11 @@ PUBLIC const char* ScriptEchoStatement::getKeyword()
 
 PUBLIC ScriptStatement* ScriptEchoStatement::eval(ScriptInterpreter* si)
 {
-	ExValue v;
+	char msg[EX_MAX_STRING + 4];
 
     // could send this to MobiusThread, but it's rare
     // and shouldn't be that expensive
-    si->expand(mArgs[0], &v);
-
-	char* msg = v.getBuffer();
+    si->expand(mArgs[0], msg, EX_MAX_STRING);
 
 	// add a newline so we can use it with OutputDebugStream
 	// note that the buffer has extra padding on the end for the nul
@@ -1064,12 +1062,11 @@ PUBLIC const char* ScriptMessageStatement::getKeyword()
 
 PUBLIC ScriptStatement* ScriptMessageStatement::eval(ScriptInterpreter* si)
 {
-	ExValue v;
+	char msg[EX_MAX_STRING + 4];
 
     // could send this to MobiusThread, but it's rare
     // and shouldn't be that expensive
-    si->expand(mArgs[0], &v);
-	char* msg = v.getBuffer();
+    si->expand(mArgs[0], msg, EX_MAX_STRING);
 
     Trace(3, "Script %s: message %s\n", si->getTraceName(), msg);
 
@@ -1100,12 +1097,11 @@ PUBLIC const char* ScriptPromptStatement::getKeyword()
 
 PUBLIC ScriptStatement* ScriptPromptStatement::eval(ScriptInterpreter* si)
 {
-	ExValue v;
+	char msg[EX_MAX_STRING + 4];
 
     // could send this to MobiusThread, but it's rare
     // and shouldn't be that expensive
-    si->expand(mArgs[0], &v);
-	char* msg = v.getBuffer();
+    si->expand(mArgs[0], msg, EX_MAX_STRING);
 
 	ThreadEvent* te = new ThreadEvent(TE_PROMPT, msg);
 	si->scheduleThreadEvent(te);
@@ -1349,6 +1345,7 @@ PUBLIC ScriptVariableStatement::ScriptVariableStatement(ScriptCompiler* comp,
 {
 	mScope = SCRIPT_SCOPE_SCRIPT;
 	mName = NULL;
+	mSlot = -1;
 	mExpression = NULL;
 
 	// isolate the scope identifier and variable name
@@ -1373,6 +1370,8 @@ PUBLIC ScriptVariableStatement::ScriptVariableStatement(ScriptCompiler* comp,
 		mName = mArgs[0];
 	}
 
+	mSlot = comp->getVariableSlot(mName);
+
 	// ignore = between the name and initializer
     if (args == NULL) {
         Trace(1, "Malformed Variable statement: missing arguments\n");
@@ -1414,6 +1413,11 @@ PUBLIC ScriptVariableScope ScriptVariableStatement::getScope()
 	return mScope;
 }
 
+PUBLIC int ScriptVariableStatement::getSlot()
+{
+	return mSlot;
+}
+
 /**
  * These will have the side effect of initializing the variable, depending
  * on the scope.  For variables in global and track scope, the initialization
@@ -1454,13 +1458,14 @@ PUBLIC ScriptStatement* ScriptVariableStatement::eval(ScriptInterpreter* si)
         if (vars == NULL)  {
             Trace(1, "Script %s: Invalid variable scope!\n", si->getTraceName());
         }
-        else if (mScope == SCRIPT_SCOPE_SCRIPT || !vars->isBound(mName)) {
+        else if (mScope == SCRIPT_SCOPE_SCRIPT || 
+                 vars->getVariable(mSlot, mName) == NULL) {
             // script scope vars always initialize
             ExValue value;
             mExpression->eval(si, &value);
 
             Trace(2, tracemsg, si->getTraceName(), mName, value.getString());
-            vars->set(mName, &value);
+            vars->set(mSlot, mName, &value);
         }
 	}
 
@@ -3138,7 +3143,7 @@ PUBLIC ScriptWaitStatement::ScriptWaitStatement(WaitType type,
 	init();
 	mWaitType = type;
 	mUnit = unit;
-    mExpression = new ExLiteral((int)time);
+    mExpression = new ExProgram(new ExLiteral((int)time));
 }
 
 void ScriptWaitStatement::init()
@@ -4822,6 +4827,27 @@ PUBLIC Mobius* ScriptCompiler::getMobius()
     return mMobius;
 }
 
+/**
+ * Every variable name declared in any script gets a slot number
+ * that UserVariables uses to find the variable without a name
+ * search.  Variables in the same scope with the same name are the
+ * same variable so the slot goes with the name, not the declaration.
+ * If we run out of slots the variable is found by name.
+ */
+PUBLIC int ScriptCompiler::getVariableSlot(const char* name)
+{
+    int slot = -1;
+
+    if (name != NULL) {
+        slot = UserVariables::getSlot(name);
+        if (slot < 0)
+          Trace(2, "Script %s: No slot for variable %s\n",
+                mScript->getTraceName(), name);
+    }
+
+    return slot;
+}
+
 /**
  * Return the script currently being compiled or linked.
  */
@@ -4877,9 +4903,10 @@ PUBLIC char* ScriptCompiler::skipToken(char* args, const char* token)
  * This is only called during the link phase for ScriptFunctionStatement
  * and I'm not sure why. 
  */
-PUBLIC ExNode* ScriptCompiler::parseExpression(ScriptStatement* stmt,
-                                               const char* src)
+PUBLIC ExProgram* ScriptCompiler::parseExpression(ScriptStatement* stmt,
+                                                  const char* src)
 {
+	ExProgram* program = NULL;
 	ExNode* expr = NULL;
 
     // should have one by now
@@ -4912,7 +4939,10 @@ PUBLIC ExNode* ScriptCompiler::parseExpression(ScriptStatement* stmt,
 		Trace(1, "--> expression: %s\n", src);
 	}
 
-	return expr;
+	if (expr != NULL)
+	  program = new ExProgram(expr);
+
+	return program;
 }
 
 /**
@@ -6517,12 +6547,10 @@ PRIVATE void ScriptInterpreter::getStackArg(ScriptStack* stack,
  */
 void ScriptInterpreter::expandFile(const char* value, ExValue* retval)
 {
-	retval->setNull();
+	char buffer[EX_MAX_STRING + 4];
 
     // first do basic expansion
-    expand(value, retval);
-	
-	char* buffer = retval->getBuffer();
+    expand(value, buffer, EX_MAX_STRING);
 	size_t curlen = strlen(buffer);
 
     if (curlen > 0 && !IsAbsolute(buffer)) {
@@ -6545,20 +6573,28 @@ void ScriptInterpreter::expandFile(const char* value, ExValue* retval)
                     shiftlen++;
                 }
 
-				int i;
-				// shift down, need to check overflow!!
-				for (i = curlen ; i >= 0 ; i--)
-				  buffer[shiftlen+i] = buffer[i];
+				if (shiftlen + curlen >= EX_MAX_STRING) {
+					Trace(1, "Script %s: Path too long: %s\n", 
+						  getTraceName(), buffer);
+				}
+				else {
+					int i;
+					// shift down
+					for (i = curlen ; i >= 0 ; i--)
+					  buffer[shiftlen+i] = buffer[i];
 			
-				// insert the prefix
-				for (i = 0 ; i < insertlen ; i++)
-				  buffer[i] = dir[i];
+					// insert the prefix
+					for (i = 0 ; i < insertlen ; i++)
+					  buffer[i] = dir[i];
 
-                if (needslash)
-                  buffer[insertlen] = '/';
+					if (needslash)
+					  buffer[insertlen] = '/';
+				}
 			}
 		}
 	}
+
+	retval->setString(buffer);
 }
 
 /**
@@ -6571,16 +6607,14 @@ void ScriptInterpreter::expandFile(const char* value, ExValue* retval)
  * References to variables may look like $foo or $(foo) depending
  * on whether you have surrounding content that requries the () delimiters.
  */
-PRIVATE void ScriptInterpreter::expand(const char* value, ExValue* retval)
+PUBLIC void ScriptInterpreter::expand(const char* value, char* buffer, 
+                                      int max)
 {
     size_t len = (value != NULL) ? strlen(value) : 0;
-	char* buffer = retval->getBuffer();
     char* ptr = buffer;
-    size_t localmax = retval->getBufferMax() - 1;
+    size_t localmax = max - 1;
 	int psn = 0;
 
-	retval->setNull();
-
     // keep this terminated
     if (localmax > 0) *ptr = 0;
     
@@ -6654,6 +6688,16 @@ PRIVATE void ScriptInterpreter::expand(const char* value, ExValue* retval)
     }
 }
 
+/**
+ * Expand into a value, the result is limited to EX_MAX_STRING.
+ */
+PUBLIC void ScriptInterpreter::expand(const char* value, ExValue* retval)
+{
+	char buffer[EX_MAX_STRING + 4];
+	expand(value, buffer, EX_MAX_STRING);
+	retval->setString(buffer);
+}
+
 /****************************************************************************
  *                                                                          *
  *                                 EXCONTEXT                                *
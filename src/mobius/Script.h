@@ -492,7 +492,8 @@ class ScriptCompiler {
     Mobius *getMobius();
     Script* getScript();
     char* skipToken(char* args, const char* token);
-    class ExNode* parseExpression(ScriptStatement* stmt, const char* src);
+    class ExProgram* parseExpression(ScriptStatement* stmt, const char* src);
+    int getVariableSlot(const char* name);
     Script* resolveScript(const char* name);
     void syntaxError(ScriptStatement* stmt, const char* msg);
 
@@ -777,7 +778,7 @@ class ScriptFunctionStatement : public ScriptStatement {
     /**
      * Unparsed argument list.
      * This is captured during construction and later parsed into
-     * either ScriptArguments or an ExNode during the link phase.
+     * either ScriptArguments or an ExProgram during the link phase.
      */
     char* mUnparsedArgs;
 
@@ -792,7 +793,7 @@ class ScriptFunctionStatement : public ScriptStatement {
     /**
      * New style argument expression.
      */
-    class ExNode* mExpression;
+    class ExProgram* mExpression;
 
 };
 
@@ -843,7 +844,7 @@ class ScriptWaitStatement : public ScriptStatement {
     /**
      * Expression to calculate the wait time.
      */
-	ExNode* mExpression;
+	class ExProgram* mExpression;
 
 	/**
 	 * True if the wait advances during pause mode.
@@ -958,7 +959,7 @@ class ScriptIteratorStatement : public ScriptStatement {
     class ScriptNextStatement* mEnd;
 
 	// various expressions that determine the iteration count
-	class ExNode* mExpression;
+	class ExProgram* mExpression;
 
 };
 
@@ -1043,7 +1044,7 @@ class ScriptSetStatement : public ScriptStatement {
   protected:
 
 	ScriptArgument mName;
-	class ExNode* mExpression;
+	class ExProgram* mExpression;
 };
 
 class ScriptUseStatement : public ScriptSetStatement {
@@ -1082,13 +1083,15 @@ class ScriptVariableStatement : public ScriptStatement {
 	bool isVariable();
 	const char* getName();
 	ScriptVariableScope getScope();
+	int getSlot();
     ScriptStatement* eval(ScriptInterpreter* si);
 
   private:
 
 	ScriptVariableScope mScope;
 	const char* mName;
-	class ExNode* mExpression;
+	int mSlot;
+	class ExProgram* mExpression;
 };
 
 typedef enum {
@@ -1118,7 +1121,7 @@ class ScriptConditionalStatement : public ScriptStatement {
 
   protected:
 
-	class ExNode* mCondition;
+	class ExProgram* mCondition;
 
 };
 
@@ -1284,7 +1287,7 @@ class ScriptCallStatement : public ScriptStatement {
 
 	class ScriptProcStatement* mProc;
 	Script* mScript;
-    class ExNode* mExpression;
+    class ExProgram* mExpression;
 
 };
 
@@ -1301,7 +1304,7 @@ class ScriptStartStatement : public ScriptStatement {
   private:
 
 	Script* mScript;
-    class ExNode* mExpression;
+    class ExProgram* mExpression;
 
 };
 
@@ -1800,6 +1803,7 @@ class ScriptInterpreter : public ExContext {
 
 	void getStackArg(int arg, ExValue* retval);
 	void expand(const char* value, ExValue* retval);
+	void expand(const char* value, char* buffer, int max);
 	void expandFile(const char* value, ExValue* retval);
 
     // ExContext interface
@@ -33,8 +33,10 @@
 #include <math.h>
 
 #include "Util.h"
+#include "Thread.h"
 #include "Trace.h"
 #include "Audio.h"
+#include "AudioKernel.h"
 
 #include "Event.h"
 #include "Layer.h"
@@ -144,6 +146,21 @@ void Smoother::advance()
 	}
 }
 
+/**
+ * Store the value for each of the next frames, advancing as we go.
+ * Used to precompute a block of levels for the mix kernels.
+ */
+void Smoother::fill(float* values, long frames)
+{
+	long i = 0;
+	for ( ; i < frames && mActive ; i++) {
+		values[i] = mValue;
+		advance();
+	}
+	for ( ; i < frames ; i++)
+	  values[i] = mValue;
+}
+
 /****************************************************************************
  *                                                                          *
  *   								STREAM                                  *
@@ -338,6 +355,34 @@ PUBLIC void Stream::setTimeStretch(int degree)
     }
 }
 
+/**
+ * Set the Resampler quality, an ordinal of Preset::ResampleQuality.
+ * Called by Track on every interrupt, the Resampler only rebuilds
+ * its filter if this changes.
+ *
+ * The sinc qualities add a delay so the latency changes with them.
+ * Loop picks up the new latency the next time it calculates the
+ * play frame, normally when it is reset.
+ */
+PUBLIC void Stream::setResampleQuality(int quality)
+{
+    int delay = mResampler->getDelay();
+    mResampler->setQuality(quality);
+    if (mResampler->getDelay() != delay)
+      adjustSpeedLatency();
+}
+
+/**
+ * True if the block has to go through the Resampler.  At normal
+ * speed it still does when the Resampler has a delay, otherwise
+ * we would replay or skip that many frames whenever the speed
+ * starts or stops changing.
+ */
+PRIVATE bool Stream::isResampling()
+{
+    return (mSpeed != 1.0 || mResampler->getDelay() > 0);
+}
+
 /**
  * Adjusts latency to account for a change in playback rate.
  * 
@@ -354,12 +399,32 @@ PUBLIC void Stream::setTimeStretch(int degree)
  */
 void Stream::adjustSpeedLatency()
 {
-    if (mSpeed == 1.0)
-      latency = mNormalLatency;
-	else {
+    latency = scaleLatency(mNormalLatency, mSpeed);
+}
+
+/**
+ * Scale a latency by the speed and add the Resampler delay.
+ * The delay is in the Resampler's source frames.  For the input
+ * stream those are interrupt frames so the delay is scaled with
+ * the latency, for the output stream they are already loop frames.
+ */
+PRIVATE int Stream::scaleLatency(int latency, float speed)
+{
+    int delay = 0;
+    if (mResampler != NULL) {
+        delay = mResampler->getDelay();
+        if (mResampler->isInput()) {
+            latency += delay;
+            delay = 0;
+        }
+    }
+
+    if (speed != 1.0) {
         // round up
-        latency = (int)ceil(mNormalLatency * mSpeed);
-	}
+        latency = (int)ceil(latency * speed);
+    }
+
+    return latency + delay;
 }
 
 /**
@@ -367,9 +432,7 @@ void Stream::adjustSpeedLatency()
  */
 PUBLIC int Stream::getAdjustedLatency(int latency)
 {
-	if (mSpeed != 1.0)
-	  latency = (int)ceil(latency * mSpeed);
-	return latency;
+	return scaleLatency(latency, mSpeed);
 }
 
 /**
@@ -380,13 +443,9 @@ PUBLIC int Stream::getAdjustedLatency(int latency)
 PUBLIC int Stream::getAdjustedLatency(int octave, int semitone, int bend, 
                                       int stretch)
 {
-	int latency = mNormalLatency;
-
     float rate = Resampler::getSpeed(octave, semitone, bend, stretch);
-	if (rate != 1.0)
-	  latency = (int)ceil(latency * rate);
 
-	return latency;
+	return scaleLatency(mNormalLatency, rate);
 }
 
 //
@@ -593,6 +652,8 @@ PUBLIC void Stream::resetResampler()
  ****************************************************************************/
 /****************************************************************************/
 
+bool OutputStream::BlockMix = true;
+
 PUBLIC OutputStream::OutputStream(InputStream* in, AudioPool* aupool)
 {
 	mInput = in;
@@ -605,6 +666,7 @@ PUBLIC OutputStream::OutputStream(InputStream* in, AudioPool* aupool)
 	mLoopBuffer = NULL;
     mSpeedBuffer = NULL;
 	mMaxSample = 0.0;
+	mMixTicks = 0;
 
 	mLastLayer = NULL;
 	mLastFrame = 0;
@@ -637,6 +699,11 @@ PUBLIC OutputStream::OutputStream(InputStream* in, AudioPool* aupool)
 	long rateBufferSamples = (long)((loopBufferSamples * MAX_RATE_SHIFT) + 4);
 	mSpeedBuffer = new float[rateBufferSamples];
 
+	mLevels = new float[loopBufferFrames];
+	mLeftLevels = new float[loopBufferFrames];
+	mRightLevels = new float[loopBufferFrames];
+	mGains = new float[loopBufferSamples];
+
 	mCapture = false;
 	mCaptureAudio = NULL;
 	mCaptureTotal = 0;
@@ -649,6 +716,10 @@ PUBLIC OutputStream::~OutputStream()
 	delete mOuterTail;
 	delete mLoopBuffer;
 	delete mSpeedBuffer;
+	delete mLevels;
+	delete mLeftLevels;
+	delete mRightLevels;
+	delete mGains;
 	delete mPitchShifter;
     delete mPlugin;
 	delete mLeft;
@@ -834,6 +905,15 @@ PUBLIC void OutputStream::setOutputBuffer(AudioStream* aus, float* b, long l)
 	mAudioBufferFrames = l;
 	mAudioPtr = b;
 	mMaxSample = 0.0f;
+	mMixTicks = 0;
+}
+
+/**
+ * Time spent mixing into the interrupt buffer for InterruptProfile.
+ */
+PUBLIC long long OutputStream::getMixTicks()
+{
+	return mMixTicks;
 }
 
 /**
@@ -899,7 +979,7 @@ PUBLIC void OutputStream::play(Loop* loop, long blockFrames, bool last)
 		// If we're rate adjusting, play into the rate buffer and resample
 		// back to the loop buffer, otherwise play directly into loop buffer.
 		float* playBuffer = loopBuffer;
-        if (mSpeed != 1.0)
+        if (isResampling())
 		  playBuffer = mSpeedBuffer;
 
 		// note: now that we handle output leveling in the Stream, the
@@ -1029,7 +1109,7 @@ PUBLIC void OutputStream::play(Loop* loop, long blockFrames, bool last)
 
 			// now apply rate adjustments, note that the remainder from
 			// the previous resampler call is not included 
-			if (mSpeed == 1.0)
+			if (!isResampling())
 			  remaining = 0;
 			else {
 				// If we have an ignore count, transpose with the non
@@ -1078,7 +1158,9 @@ PUBLIC void OutputStream::play(Loop* loop, long blockFrames, bool last)
 		//capture(mLoopBuffer, blockFrames);
 		
 		// Apply panning and output level and copy to interrupt buffer
-		adjustLevel(blockFrames);
+		long long ticks = GetClockTicks();
+		adjustLevel(mLoopBuffer, blockFrames);
+		mMixTicks += GetClockTicks() - ticks;
 
 		// sanity check
 		if (getRemainingFrames() < 0)
@@ -1126,14 +1208,68 @@ PRIVATE void OutputStream::capturePitchShutdownFadeTail()
  * Copy the result of a Loop play into the interrupt buffer applying
  * output level adjustment and panning.
  *
+ * The common cases are handled a block at a time by the mix kernels
+ * in AudioKernel.  When a level or pan is ramping we precompute the
+ * Smoother values for the block first.  Mono with an off center pan
+ * has to decide which side to advance on every frame so it stays
+ * on the per-sample path.
+ */
+PUBLIC void OutputStream::adjustLevel(float* src, long frames)
+{
+	long samples = frames * channels;
+	float outLevel = mSmoother->getValue();
+
+	bool noSmoothing = 
+		!mSmoother->isActive() && !mLeft->isActive() && !mRight->isActive();
+
+	bool centered = !mLeft->isActive() && !mRight->isActive() &&
+		mLeft->getValue() == 1.0 && mRight->getValue() == 1.0;
+
+	if (!BlockMix || channels != 2 || (mMono && !centered)) {
+		adjustLevelPerSample(src, frames);
+	}
+	else {
+		if (mMono) {
+			mSmoother->fill(mLevels, frames);
+			mMaxSample = SampleMixMono(mAudioPtr, src, mLevels, frames,
+									   mMaxSample);
+		}
+		else if (mPan == 64 && outLevel == 1.0 && noSmoothing) {
+			// the usual case
+			mMaxSample = SampleMix(mAudioPtr, src, samples, mMaxSample);
+		}
+		else if (noSmoothing) {
+			float leftMod = mLeft->getValue() * outLevel;
+			float rightMod = mRight->getValue() * outLevel;
+			mMaxSample = SampleMixStereo(mAudioPtr, src, frames, 
+										 leftMod, rightMod, mMaxSample);
+		}
+		else {
+			mSmoother->fill(mLevels, frames);
+			mLeft->fill(mLeftLevels, frames);
+			mRight->fill(mRightLevels, frames);
+			for (long i = 0 ; i < frames ; i++) {
+				mGains[i * 2] = mLeftLevels[i] * mLevels[i];
+				mGains[(i * 2) + 1] = mRightLevels[i] * mLevels[i];
+			}
+			mMaxSample = SampleMixGains(mAudioPtr, src, mGains, samples,
+										mMaxSample);
+		}
+		mAudioPtr += samples;
+	}
+}
+
+/**
+ * The original sample at a time mixer, still used for mono panning.
+ * mixtest turns off BlockMix to compare the kernels against it.
+ *
  * Multiplied the logic to reduce the number of multiplies.
  * May not save much but it just feels better.
  */
-PRIVATE void OutputStream::adjustLevel(long frames)
+PRIVATE void OutputStream::adjustLevelPerSample(float* src, long frames)
 {
 	long samples = frames * channels;
 	float outLevel = mSmoother->getValue();
-	float* src = mLoopBuffer;
 
 	bool noSmoothing = 
 		!mSmoother->isActive() && !mLeft->isActive() && !mRight->isActive();
@@ -2127,7 +2263,7 @@ PRIVATE void InputStream::scaleInput()
 	float* src = &mLevelBuffer[mOriginalFramesConsumed * channels];
 	long remaining = mAudioBufferFrames - mOriginalFramesConsumed;
 
-	if (mSpeed == 1.0) {
+	if (!isResampling()) {
 		// we may be returning to 1.0 after being away to reset refs
 		mAudioPtr = src;
 		mRemainingFrames = remaining;
@@ -112,6 +112,7 @@ class Smoother {
 	float getValue();
 	float getTarget();
 	void advance();
+	void fill(float* values, long frames);
 
   private:
 
@@ -181,6 +182,8 @@ class Stream : public LayerContext {
     void setTimeStretch(int level);
     int getTimeStretch();
 
+    void setResampleQuality(int quality);
+
 	virtual void setPitchTweak(int tweak, int value);
 	virtual int getPitchTweak(int tweak);
 
@@ -218,6 +221,8 @@ class Stream : public LayerContext {
 
 	long deltaFrames(float* start, float* end);
 	void adjustSpeedLatency();
+	int scaleLatency(int latency, float speed);
+	bool isResampling();
 
 	/**
 	 * The non-adjusted latency for this stream.
@@ -441,6 +446,12 @@ class OutputStream : public Stream {
 
   public:
 
+	/**
+	 * When false adjustLevel uses the original per-sample mixer.
+	 * For testing the mix kernels.
+	 */
+	static bool BlockMix;
+
 	OutputStream(InputStream* is, class AudioPool* pool);
 	~OutputStream();
 	
@@ -475,6 +486,12 @@ class OutputStream : public Stream {
 	float getMaxSample();
     int getMonitorLevel();
 
+    // profiling
+    long long getMixTicks();
+
+	// mix a block into the output buffer, called by play
+	void adjustLevel(float* src, long frames);
+
 	void setCapture(bool b);
 
   private:
@@ -488,7 +505,7 @@ class OutputStream : public Stream {
 	float* playTailRegion(float* outbuf, long frames);
 	void checkMax(float sample);
 	void capture(float* buffer, long frames);
-	void adjustLevel(long frames);
+	void adjustLevelPerSample(float* src, long frames);
 	void captureOutsideFadeTail();
 	void capturePitchShutdownFadeTail();
 
@@ -584,6 +601,20 @@ class OutputStream : public Stream {
 	 */
 	float mMaxSample;
 
+	/**
+	 * Clock ticks spent in adjustLevel since the last setOutputBuffer.
+	 */
+	long long mMixTicks;
+
+	/**
+	 * Per-frame output and pan levels and the interleaved gains 
+	 * built from them when the levels are ramping.
+	 */
+	float* mLevels;
+	float* mLeftLevels;
+	float* mRightLevels;
+	float* mGains;
+
 	// Diagnostics
 
 	bool mCapture;
@@ -2045,6 +2045,40 @@ PRIVATE void Synchronizer::adjustBarUnit(Loop* l, SyncState* state,
  *                                                                          *
  ****************************************************************************/
 
+/**
+ * Return the time the current block started in GetClockTicks units,
+ * MidiQueue measures MIDI event offsets from this.
+ *
+ * The stream timestamps the block when the driver calls back, which
+ * can be well before we get here if the interrupt was scheduled late.
+ * Stream time is on its own clock so measure how far it has moved
+ * since the block timestamp and back the current ticks up by that
+ * much.  Plugin streams have no stream time and the offline stream
+ * doesn't advance it until the block is done, for those this is the
+ * time the callback reached us.
+ */
+PRIVATE long long Synchronizer::getBlockTicks(AudioStream* stream)
+{
+    long long ticks = GetClockTicks();
+
+    double blockTime = stream->getLastInterruptStreamTime();
+    if (blockTime > 0.0) {
+        double elapsed = stream->getStreamTime() - blockTime;
+
+        // more than a few blocks means the clocks are confused,
+        // an overrun or a stream restart
+        double max = 0.0;
+        int rate = mMobius->getSampleRate();
+        if (rate > 0)
+          max = (4.0 * mInterruptFrames) / rate;
+
+        if (elapsed > 0.0 && elapsed < max)
+          ticks -= (long long)(elapsed * GetClockFrequency());
+    }
+
+    return ticks;
+}
+
 /**
  * Called by Mobius at the beginning of a new audio interrupt.
  * Convert raw events recieved since the last interrupt into a list
@@ -2077,6 +2111,10 @@ PUBLIC void Synchronizer::interruptStart(AudioStream* stream)
 	mInterruptMsec = mMidi->getMilliseconds();
 	mInterruptFrames = stream->getInterruptFrames();
 
+    // the block start time for MIDI event offsets
+    mMidiQueue.interruptStart(mInterruptMsec, getBlockTicks(stream), 
+                              mMobius->getSampleRate());
+
     // should be empty but make sure
     flushEvents();
     mNextAvailableEvent = NULL;
@@ -2143,10 +2181,11 @@ PUBLIC void Synchronizer::interruptStart(AudioStream* stream)
     }
 
     // Host events
-    // Unlike MIDI events which are quantized by the MidiQueue, these
-    // will have been created in the *same* interrupt and will have frame
-    // values that are offsets into the current interrupt.  These must
-    // be maintained in order and interleaved with the loop events.
+    // Unlike MIDI events which the MidiQueue places where they fell in
+    // the previous interrupt, these will have been created in the *same*
+    // interrupt and will have frame values that are offsets into the
+    // current interrupt.  These must be maintained in order and
+    // interleaved with the loop events.
 
     // refresh host sync state for the status display in the UI thread
 	AudioTime* hostTime = stream->getTime();
@@ -2297,6 +2336,16 @@ PUBLIC void Synchronizer::finish(Track* t)
     }
 }
 
+/**
+ * True if there are sync events to be consumed by the tracks during
+ * this interrupt.  Tracks share our position in the event list so they
+ * can't be processed in parallel when this is true.
+ */
+PUBLIC bool Synchronizer::hasInterruptEvents()
+{
+    return (mInterruptEvents->getEvents() != NULL);
+}
+
 /**
  * Called when we're done with one audio interrupt.
  */
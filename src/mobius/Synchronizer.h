@@ -172,6 +172,7 @@ class Synchronizer {
     void prepare(class Track* t);
     void finish(class Track* t);
 	void interruptEnd();
+    bool hasInterruptEvents();
 
     void trackSyncEvent(class Track* t, class EventType* type, int offset);
 	class Event* getNextEvent(class Loop* l);
@@ -218,6 +219,7 @@ class Synchronizer {
 	/////////////////////////////////////////////////////////////////////
 
     void flushEvents();
+    long long getBlockTicks(class AudioStream* stream);
     float getSpeed(Loop* l);
     void traceTempo(Loop* l, const char* type, float tempo);
 
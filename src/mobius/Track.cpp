@@ -42,6 +42,7 @@
 #include "Event.h"
 #include "EventManager.h"
 #include "Function.h"
+#include "InterruptProfile.h"
 #include "Layer.h"
 #include "Loop.h"
 #include "Mobius.h"
@@ -118,8 +119,6 @@ void Track::init(Mobius* m, Synchronizer* sync, int number)
     mTrackSyncEvent = NULL;
 	mInterruptBreakpoint = false;
     mMidi = false;
-
-	mState.init();
     
     // Each track has it's own private Preset that can be dynamically
     // changed with scripts or bound parameters without effecting the
@@ -674,15 +673,13 @@ PUBLIC void Track::doFunction(Action* action)
  ****************************************************************************/
 
 /**
- * Return an object holding the current state of this track.
- * This may be used directly by the UI and as such must be changed
- * carefully since more than one thread may be accessing it at once.
+ * Fill in the state of this track for a StateSnapshot.
+ * This is called at the end of an interrupt, the loop and name
+ * fields must point to storage in the snapshot.
  */
-PUBLIC TrackState* Track::getState()
+PUBLIC void Track::getState(TrackState* s)
 {
-	TrackState* s = &mState;
-
-    s->name = mName;
+    CopyString(mName, s->name, STATE_MAX_NAME);
 
     // NOTE: The track has it's own private Preset object which will never
     // be freed so it's relatively safe to let it escape to the UI tier. 
@@ -724,10 +721,7 @@ PUBLIC TrackState* Track::getState()
 
 	mSynchronizer->getState(s, this);
 
-	// !! race condition, we might have just processed a parameter
-    // that changed the number of loops, the current value of mLoop
-    // could be deleted
-	s->loop = mLoop->getState();
+	mLoop->getState(s->loop);
 
     // KLUDGE: If we're switching, override the percieved mode
     Event* switche = mEventManager->getSwitchEvent();
@@ -757,8 +751,6 @@ PUBLIC TrackState* Track::getState()
 	}
 
 	s->summaryCount = max;
-
-	return s;
 }
 
 /****************************************************************************
@@ -834,6 +826,28 @@ bool Track::isPriority()
 	return priority;
 }
 
+/**
+ * Overload this so that Recorder knows whether we can be processed
+ * on a worker thread concurrently with other tracks.  This is only
+ * true when the block will be pure play/record with no events: 
+ * event processing touches the shared event and layer pools, the
+ * Synchronizer, scripts and other tracks (TrackCopy).  The sync master
+ * is always a priority track and processed serially first.
+ * 
+ * Everything we do touch in that case is either ours or read-only,
+ * the input buffer is shared but not modified and Recorder gives
+ * us a private output buffer.  Audio buffers may be allocated as
+ * the loop grows but AudioPool is lock free.
+ */
+bool Track::isIndependent(long frames)
+{
+    return (!mHalting &&
+            !mInterruptBreakpoint &&
+            mSynchronizer->getTrackSyncMaster() != this &&
+            !mSynchronizer->hasInterruptEvents() &&
+            !mEventManager->isEventInRange(frames));
+}
+
 /**
  * AudioInterface interrupt buffer handler.
  * 
@@ -900,9 +914,20 @@ void Track::processBuffers(AudioStream* stream,
    	// we're beginning a new track iteration for the synchronizer
 	mSynchronizer->prepare(this);
 
+    // the preset may have been edited since the last interrupt
+    mInput->setResampleQuality(mPreset->getResampleQuality());
+    mOutput->setResampleQuality(mPreset->getResampleQuality());
+
 	mInput->setInputBuffer(stream, inbuf, frames, echo);
     mOutput->setOutputBuffer(stream, outbuf, frames);
 
+    // profile the event loop, separating out record and play
+    long long startTicks = GetClockTicks();
+    long long recordTicks = 0;
+    long long playTicks = 0;
+    long long ticks;
+    long long recorded;
+
     // Streams do funky stuff for speed scaling, sync drift needs
     // to be done against the "external loop" so we have to stay 
     // above that mess.  The SyncState will be advanced exactly by the
@@ -942,8 +967,12 @@ void Track::processBuffers(AudioStream* stream,
         // for syncing.
         long blockFramesConsumed = mInput->getProcessedFrames();
 
+		ticks = GetClockTicks();
 		long consumed = mInput->record(mLoop, event);
+		recorded = GetClockTicks();
 		mOutput->play(mLoop, consumed, false);
+		recordTicks += recorded - ticks;
+		playTicks += GetClockTicks() - recorded;
 
 		// If there was a track sync event, remember the number of frames
 		// consumed to reach it so that slave tracks process it at the
@@ -981,8 +1010,12 @@ void Track::processBuffers(AudioStream* stream,
 		mMobius->resumeScript(this, func);
 	}
 
+	ticks = GetClockTicks();
 	long remaining = mInput->record(mLoop, NULL);
+	recorded = GetClockTicks();
 	mOutput->play(mLoop, remaining, true);
+	recordTicks += recorded - ticks;
+	playTicks += GetClockTicks() - recorded;
 
 	if (mInput->getRemainingFrames() > 0)
 	  Trace(this, 1, "Input buffer not fully consumed!\n");
@@ -999,6 +1032,16 @@ void Track::processBuffers(AudioStream* stream,
 	if (!mLoop->isReset())
 	  mResetConfig = 0;
 
+    // play includes the mix, report them separately
+    InterruptProfile* profile = mMobius->getProfile();
+    long long mixTicks = mOutput->getMixTicks();
+    long long totalTicks = GetClockTicks() - startTicks;
+    profile->addTrack(mRawNumber, ProfileTrackEvents, 
+                      totalTicks - recordTicks - playTicks);
+    profile->addTrack(mRawNumber, ProfileTrackRecord, recordTicks);
+    profile->addTrack(mRawNumber, ProfileTrackPlay, playTicks - mixTicks);
+    profile->addTrack(mRawNumber, ProfileTrackMix, mixTicks);
+
     if (TraceFrameAdvance && mRawNumber == 0) {
         long frame = mLoop->getFrame();
         long playFrame = mLoop->getPlayFrame();
@@ -143,7 +143,7 @@ class Track : public RecorderTrack, public TraceContext
 	int getOutputLatency();
 	MobiusMode* getMode();
 	long getFrame();
-    class TrackState* getState();
+    void getState(class TrackState* s);
 	int getCurrentLevel();
 	bool isTrackSyncMaster();
 
@@ -205,6 +205,7 @@ class Track : public RecorderTrack, public TraceContext
 	//
 
     bool isPriority();
+    bool isIndependent(long frames);
 
 	void prepareForInterrupt();
 	void processBuffers(AudioStream* stream, 
@@ -332,9 +333,6 @@ class Track : public RecorderTrack, public TraceContext
 
     bool mInterruptBreakpoint;
 
-	// state exposed to the outside world
-	TrackState mState;
-
     // true if this is a MIDI track
     bool mMidi;
 };
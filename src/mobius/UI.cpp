@@ -33,6 +33,7 @@
 #include "Function.h"
 #include "Preset.h"
 #include "Project.h"
+#include "ProjectFile.h"
 #include "Setup.h"
 #include "Track.h"
 
@@ -232,6 +233,7 @@ PUBLIC UI::UI(MobiusInterface* mobius)
 	mInvisible = NULL;
 
 	mLastPreset = -1;
+	mLastStateVersion = 0;
 	for (i = 0 ; i < KEY_MAX_CODE ; i++)
 	  mKeyState[i] = 0;
 
@@ -499,6 +501,7 @@ PRIVATE void UI::buildDockedTrackStrips(MobiusConfig* config)
 
 	mTracks = new TrackStrip*[count];
     mTrackCount = count;
+	mLastStateVersion = 0;
 
     for (int i = 0 ; i < count ; i++) {
 		TrackStrip* ts = new TrackStrip(mMobius, i + 1);
@@ -1066,7 +1069,7 @@ void UI::actionPerformed(void *c)
 		}
 		else if (id == IDM_OPEN_PROJECT) {
 
-			sprintf(filter, "%s (.mob)|*.mob;*.MOB", 
+			sprintf(filter, "%s (.mob, .mobp)|*.mob;*.MOB;*.mobp;*.MOBP", 
 					cat->get(MSG_DLG_OPEN_PROJECT_FILTER));
 
 			OpenDialog* od = new OpenDialog(mWindow);
@@ -1118,7 +1121,10 @@ void UI::actionPerformed(void *c)
 		else if (id == IDM_SAVE_PROJECT || id == IDM_SAVE_TEMPLATE) {
 			bool isTemplate = (id == IDM_SAVE_TEMPLATE);
 
-			sprintf(filter, "%s (.mob)|*.mob", 
+			// the single file format is the default, the XML directory
+			// and wave files are still there for other tools
+			sprintf(filter, "%s (.mobp)|*.mobp|%s (.mob)|*.mob", 
+					cat->get(MSG_DLG_SAVE_PROJECT_FILTER),
 					cat->get(MSG_DLG_SAVE_PROJECT_FILTER));
 
 			OpenDialog* od = new OpenDialog(mWindow);
@@ -1408,16 +1414,24 @@ PUBLIC void UI::updateUI()
             }
             mMessages->update();
 
-            // also state for each of the other tracks
+            // also state for each of the other tracks, only the ones
+            // that changed since the last time, the strips ignore
+            // updates while dragging so remember nothing until it stops
+            unsigned int changes = state->getChanges(mLastStateVersion);
+            long version = state->version;
             for (int i = 0 ; i < mTrackCount ; i++) {
-                state = mMobius->getState(i);
-                if (state != NULL)
-                  mTracks[i]->update(state);
-                else {
-                    // must be out of range, should have resized
-                    // our track list!
+                if (changes & state->getChangeBit(i)) {
+                    MobiusState* s = mMobius->getState(i);
+                    if (s != NULL)
+                      mTracks[i]->update(s);
+                    else {
+                        // must be out of range, should have resized
+                        // our track list!
+                    }
                 }
             }
+            if (!Space::isDragging())
+              mLastStateVersion = version;
         }
         catch (...) {
             Trace(1, "ERROR: Exception during updateUI\n");
@@ -1703,6 +1717,7 @@ void UI::updateDisplayConfig()
 
         for (int i = 0 ; i < mTrackCount ; i++)
           mTracks[i]->updateConfiguration(mUIConfig->getDockedStrip());
+        mLastStateVersion = 0;
 
 
 		// Change to the Palette colors should have been made
@@ -242,6 +242,7 @@ class PresetDialog : public SimpleDialog  {
     NumberField*    mPitchStep;
     NumberField*    mPitchBend;
     NumberField*    mTimeStretch;
+    ComboBox*       mResampleQuality;
 	Checkbox* 		mAltFeedback;
 	Checkbox* 		mVelocity;
 	Checkbox*		mNoFeedbackUndo;
@@ -2006,6 +2007,9 @@ class UI : public ActionListener,
 	// track state we maintain in order to generate status messages
 	int 			mLastPreset;
 
+	// version of the state last shown in the track strips
+	long			mLastStateVersion;
+
 	class CriticalSection* mCsect;
 
 };
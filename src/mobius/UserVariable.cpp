@@ -21,6 +21,7 @@
 
 #include "Util.h"
 #include "List.h"
+#include "SymbolTable.h"
 #include "XmlModel.h"
 #include "XmlBuffer.h"
 #include "XomParser.h"
@@ -135,50 +136,118 @@ PUBLIC void UserVariable::parseXml(XmlElement* e)
  *                                                                          *
  ****************************************************************************/
 
+/**
+ * Names given slots so far.  The position of the name in the table
+ * is the slot number.  Scripts are usually compiled in the UI thread
+ * but autoload scripts are recompiled in the interrupt, the table
+ * is lock free so that's safe.
+ */
+PRIVATE ExStringTable VariableSlots(MAX_VARIABLE_SLOTS, 
+                                    MAX_VARIABLE_SLOTS * 32);
+
 PUBLIC UserVariables::UserVariables()
 {
 	mVariables = NULL;
+    mTable = new SymbolTable(true);
+    for (int i = 0 ; i < MAX_VARIABLE_SLOTS ; i++)
+      mSlots[i] = NULL;
 }
 
 PUBLIC UserVariables::UserVariables(XmlElement* e)
 {
 	mVariables = NULL;
+    mTable = new SymbolTable(true);
+    for (int i = 0 ; i < MAX_VARIABLE_SLOTS ; i++)
+      mSlots[i] = NULL;
 	parseXml(e);
 }
 
 PUBLIC UserVariables::~UserVariables()
 {
 	delete mVariables;
+    delete mTable;
 }
 
+/**
+ * Return the slot number for a variable name, -1 if we've run out.
+ * Names are case sensitive like the variables.
+ */
+PUBLIC int UserVariables::getSlot(const char* name)
+{
+    return (name != NULL) ? VariableSlots.getSlot(name) : -1;
+}
+
+/**
+ * Names are case sensitive, this hasn't been used enough to know
+ * if that's what people expect.
+ */
 PUBLIC UserVariable* UserVariables::getVariable(const char* name)
 {
 	UserVariable* found = NULL;
-	if (name != NULL) {
-		for (UserVariable* v = mVariables ; v != NULL ; v = v->getNext()) {
-			// case insensitive?
-			const char* vname = v->getName();
-			if (vname != NULL && !strcmp(name, vname)) {
-				found = v;
-				break;
-			}
-		}
-	}
+	if (name != NULL)
+	  found = (UserVariable*)mTable->get(name);
 	return found;
 }
 
+/**
+ * Add a variable to the table.  If there is already one with this
+ * name it stays in the list but the first one is still found.
+ */
+PRIVATE void UserVariables::add(UserVariable* v)
+{
+    const char* name = v->getName();
+    if (name != NULL)
+      mTable->intern(name, v);
+}
+
+/**
+ * Find a variable by slot number, falling back to the name the
+ * first time.  A negative slot is the same as no slot.
+ */
+PUBLIC UserVariable* UserVariables::getVariable(int slot, const char* name)
+{
+    UserVariable* found = NULL;
+
+    if (slot >= 0 && slot < MAX_VARIABLE_SLOTS)
+      found = mSlots[slot];
+
+    if (found == NULL) {
+        found = getVariable(name);
+        if (found != NULL)
+          setSlot(slot, found);
+    }
+
+    return found;
+}
+
+PRIVATE void UserVariables::setSlot(int slot, UserVariable* v)
+{
+    if (slot >= 0 && slot < MAX_VARIABLE_SLOTS)
+      mSlots[slot] = v;
+}
+
 PUBLIC void UserVariables::get(const char* name, ExValue* value)
+{
+    get(-1, name, value);
+}
+
+PUBLIC void UserVariables::get(int slot, const char* name, ExValue* value)
 {
     value->setNull();
-	UserVariable* v = getVariable(name);
+	UserVariable* v = getVariable(slot, name);
 	if (v != NULL)
 	  v->getValue(value);
 }
 
 PUBLIC void UserVariables::set(const char* name, ExValue* value)
+{
+    set(-1, name, value);
+}
+
+PUBLIC void UserVariables::set(int slot, const char* name, ExValue* value)
 {
 	if (name != NULL) {
-		UserVariable* v = getVariable(name);
+		UserVariable* v = getVariable(slot, name);
 		if (v != NULL)
 		  v->setValue(value);
 		else {
@@ -188,6 +257,8 @@ PUBLIC void UserVariables::set(const char* name, ExValue* value)
 			// order these?
 			v->setNext(mVariables);
 			mVariables = v;
+            add(v);
+            setSlot(slot, v);
 		}
 	}
 }
@@ -219,20 +290,24 @@ PUBLIC void UserVariables::reset()
 {
 	delete mVariables;
     mVariables = NULL;
+    mTable->clear();
+    for (int i = 0 ; i < MAX_VARIABLE_SLOTS ; i++)
+      mSlots[i] = NULL;
 }
 
 PUBLIC void UserVariables::parseXml(XmlElement* e)
 {
 	UserVariable* last = NULL;
 
-	for (XmlElement* child = e->getChildElement() ; e != NULL ; 
-		 e = e->getNextElement()) {
+	for (XmlElement* child = e->getChildElement() ; child != NULL ; 
+		 child = child->getNextElement()) {
 		UserVariable* v = new UserVariable(child);
 		if (last == NULL)
 		  mVariables = v;
 		else
 		  last->setNext(v);
 		last = v;
+        add(v);
 	}
 }
 
@@ -17,6 +17,12 @@
 
 #define EL_VARIABLES "Variables"
 
+/**
+ * The number of variable names that can be given slots, see
+ * UserVariables::getSlot.  Must be a power of two.
+ */
+#define MAX_VARIABLE_SLOTS 256
+
 /****************************************************************************
  *                                                                          *
  *   							   VARIABLE                                 *
@@ -71,11 +77,16 @@ class UserVariables {
 	UserVariables();
 	UserVariables(class XmlElement* e);
 	~UserVariables();
+
+    static int getSlot(const char* name);
 	
 	UserVariable* getVariable(const char* name);
+	UserVariable* getVariable(int slot, const char* name);
 
 	void get(const char* name, class ExValue* value);
+	void get(int slot, const char* name, class ExValue* value);
 	void set(const char* name, class ExValue* value);
+	void set(int slot, const char* name, class ExValue* value);
 	bool isBound(const char* name);
     void reset();
 
@@ -84,8 +95,18 @@ class UserVariables {
 
   private:
 
+    void add(UserVariable* v);
+    void setSlot(int slot, UserVariable* v);
+
 	UserVariable* mVariables;
 
+    // names to UserVariables, the list keeps the order for XML
+    class SymbolTable* mTable;
+
+    // variables found by slot number, filled in as they are used,
+    // see ScriptCompiler::getVariableSlot
+    UserVariable* mSlots[MAX_VARIABLE_SLOTS];
+
 };
 
 /****************************************************************************/
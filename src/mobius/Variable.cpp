@@ -23,6 +23,7 @@
 
 #include "Util.h"
 #include "Vbuf.h"
+#include "SymbolTable.h"
 
 #include "Event.h"
 #include "EventManager.h"
@@ -3292,6 +3293,26 @@ PRIVATE ScriptInternalVariable* InternalVariables[] = {
     NULL
 };
 
+PRIVATE SymbolTable* InternalVariableTable = NULL;
+
+/**
+ * Called early during Mobius initialization to build the table
+ * of names and aliases.
+ */
+PUBLIC void ScriptInternalVariable::initVariables()
+{
+    // ignore if already initialized
+    if (InternalVariableTable == NULL) {
+        SymbolTable* table = new SymbolTable();
+        for (int i = 0 ; InternalVariables[i] != NULL ; i++) {
+            ScriptInternalVariable* v = InternalVariables[i];
+            table->intern(v->mName, v);
+            table->intern(v->mAlias, v);
+        }
+        InternalVariableTable = table;
+    }
+}
+
 /**
  * Lookup an internal variable during script parsing.
  */
@@ -3299,13 +3320,18 @@ PUBLIC ScriptInternalVariable*
 ScriptInternalVariable::getVariable(const char* name)
 {
     ScriptInternalVariable* found = NULL;
-    for (int i = 0 ; InternalVariables[i] != NULL ; i++) {
-		ScriptInternalVariable* v = InternalVariables[i];
-		if (v->isMatch(name)) {
-			found = v;
-			break;
-		}
-	}
+    if (InternalVariableTable != NULL) {
+        found = (ScriptInternalVariable*)InternalVariableTable->get(name);
+    }
+    else {
+        for (int i = 0 ; InternalVariables[i] != NULL ; i++) {
+            ScriptInternalVariable* v = InternalVariables[i];
+            if (v->isMatch(name)) {
+                found = v;
+                break;
+            }
+        }
+    }
     return found;
 }
 
@@ -27,6 +27,7 @@ class ScriptInternalVariable {
 
   public:
 
+    static void initVariables();
     static ScriptInternalVariable* getVariable(const char* name);
 
     ScriptInternalVariable();
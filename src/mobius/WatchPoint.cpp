@@ -16,6 +16,9 @@
 #include <memory.h>
 #include <ctype.h>
 
+#include "Util.h"
+#include "Trace.h"
+#include "Thread.h"
 #include "MessageCatalog.h"
 #include "List.h"
 
@@ -27,52 +30,203 @@
 
 //////////////////////////////////////////////////////////////////////
 //
-// Watchers
+// WatchPointListener
 //
 //////////////////////////////////////////////////////////////////////
 
-PUBLIC Watchers::Watchers()
+PUBLIC WatchPointListener::WatchPointListener()
 {
-    loopLocation = new List();
-    loopStart = new List();
-    loopSubcycle = new List();
-    loopCycle = new List();
-    modeRecord = new List();
+    mRemoving = false;
+    mRemoved = NULL;
 }
 
-PUBLIC Watchers::~Watchers()
+PUBLIC WatchPointListener::~WatchPointListener()
+{
+    // we're virtual, subclass needs to clean itself up
+}
+
+/**
+ * The listener stays in the array until the dispatcher notices, 
+ * it is deleted when Mobius is.
+ */
+PUBLIC void WatchPointListener::remove()
 {
-    delete loopLocation;
-    delete loopStart;
-    delete loopSubcycle;
-    delete loopCycle;
-    delete modeRecord;
+    mRemoving = true;
+}
+
+PUBLIC bool WatchPointListener::isRemoving()
+{
+    return mRemoving;
 }
 
 //////////////////////////////////////////////////////////////////////
 //
-// WatchPointListener
+// WatchListeners
 //
 //////////////////////////////////////////////////////////////////////
 
-PUBLIC WatchPointListener::WatchPointListener()
+PUBLIC WatchListeners::WatchListeners(int size)
 {
-    mRemoving = false;
+    count = 0;
+    listeners = new WatchPointListener*[(size > 0) ? size : 1];
+    retired = NULL;
 }
 
-PUBLIC WatchPointListener::~WatchPointListener()
+PUBLIC WatchListeners::~WatchListeners()
 {
-    // we're virtual, subclass needs to clean itself up
+    delete listeners;
 }
 
-PUBLIC void WatchPointListener::remove()
+//////////////////////////////////////////////////////////////////////
+//
+// Watchers
+//
+//////////////////////////////////////////////////////////////////////
+
+PUBLIC Watchers::Watchers()
 {
-    mRemoving = true;
+    mCsect = new CriticalSection("Watchers");
+    for (int i = 0 ; i < WATCH_MAX_POINTS ; i++) {
+        mListeners[i] = NULL;
+        mCounts[i] = 0;
+    }
+    mRetired = NULL;
+    mRemoved = NULL;
 }
 
-PUBLIC bool WatchPointListener::isRemoving()
+/**
+ * We own the listeners, the dispatcher must have been stopped.
+ */
+PUBLIC Watchers::~Watchers()
 {
-    return mRemoving;
+    reclaim();
+
+    for (int i = 0 ; i < WATCH_MAX_POINTS ; i++) {
+        WatchListeners* listeners = mListeners[i];
+        if (listeners != NULL) {
+            for (int j = 0 ; j < listeners->count ; j++)
+              delete listeners->listeners[j];
+            delete listeners;
+        }
+    }
+
+    WatchPointListener* next = NULL;
+    for (WatchPointListener* l = mRemoved ; l != NULL ; l = next) {
+        next = l->mRemoved;
+        delete l;
+    }
+
+    delete mCsect;
+}
+
+/**
+ * Add a listener.  Called by the UI or OSC threads, never 
+ * the interrupt.
+ */
+PUBLIC void Watchers::add(WatchPoint* wp, WatchPointListener* l)
+{
+    mCsect->enter("add");
+
+    WatchListeners* current = mListeners[wp->getOrdinal()];
+    int count = (current != NULL) ? current->count : 0;
+
+    WatchListeners* listeners = new WatchListeners(count + 1);
+    for (int i = 0 ; i < count ; i++)
+      listeners->listeners[listeners->count++] = current->listeners[i];
+    listeners->listeners[listeners->count++] = l;
+
+    Trace(2, "Adding watch point listener for %s\n", l->getWatchPointName());
+    publish(wp, listeners);
+
+    mCsect->leave();
+}
+
+/**
+ * Called by the dispatcher when it finds listeners that have been
+ * removed.  They are taken out of the array and kept until we
+ * are deleted.
+ */
+PUBLIC void Watchers::prune(WatchPoint* wp)
+{
+    mCsect->enter("prune");
+
+    WatchListeners* current = mListeners[wp->getOrdinal()];
+    if (current != NULL) {
+        WatchListeners* listeners = new WatchListeners(current->count);
+        for (int i = 0 ; i < current->count ; i++) {
+            WatchPointListener* l = current->listeners[i];
+            if (!l->isRemoving())
+              listeners->listeners[listeners->count++] = l;
+            else {
+                Trace(2, "Removing watch point listener for %s\n",
+                      l->getWatchPointName());
+                l->mRemoved = mRemoved;
+                mRemoved = l;
+            }
+        }
+        publish(wp, listeners);
+    }
+
+    mCsect->leave();
+}
+
+/**
+ * Swap in a new listener array, the old one is deleted by the
+ * dispatcher the next time it calls reclaim().
+ * Must be in the csect.
+ */
+PRIVATE void Watchers::publish(WatchPoint* wp, WatchListeners* listeners)
+{
+    int ordinal = wp->getOrdinal();
+
+    // the exchange is a barrier, the array is complete before it is seen
+    WatchListeners* old = (WatchListeners*)
+        AtomicExchangePointer((void* volatile*)&mListeners[ordinal], listeners);
+    mCounts[ordinal] = listeners->count;
+
+    if (old != NULL) {
+        WatchListeners* head;
+        do {
+            head = mRetired;
+            old->retired = head;
+        } while (!AtomicCompareAndSwapPointer((void* volatile*)&mRetired,
+                                              head, old));
+    }
+}
+
+/**
+ * Called by the dispatcher.  The array may be replaced while
+ * it is being walked, but won't be deleted until the next reclaim().
+ */
+PUBLIC WatchListeners* Watchers::getListeners(WatchPoint* wp)
+{
+    return mListeners[wp->getOrdinal()];
+}
+
+/**
+ * Called by the dispatcher between dispatches when it isn't
+ * looking at any of the arrays.
+ */
+PUBLIC void Watchers::reclaim()
+{
+    WatchListeners* retired = (WatchListeners*)
+        AtomicExchangePointer((void* volatile*)&mRetired, NULL);
+
+    WatchListeners* next = NULL;
+    for (WatchListeners* l = retired ; l != NULL ; l = next) {
+        next = l->retired;
+        delete l;
+    }
+}
+
+/**
+ * Called in the interrupt to avoid queueing changes nobody
+ * is waiting for.  Removed listeners still count so the
+ * dispatcher will find them.
+ */
+PUBLIC bool Watchers::isWatched(WatchPoint* wp)
+{
+    return (mCounts[wp->getOrdinal()] > 0);
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -81,12 +235,22 @@ PUBLIC bool WatchPointListener::isRemoving()
 //
 //////////////////////////////////////////////////////////////////////
 
+/**
+ * Ordinals are assigned as the static objects are constructed.
+ */
+static int WatchPointCount = 0;
+
 PUBLIC WatchPoint::WatchPoint(const char* name, int key) :
     SystemConstant(name, key)
 {
     mBehavior = WATCH_MOMENTARY;
     mMin = 0;
     mMax = 1;
+    mOrdinal = WatchPointCount++;
+    if (mOrdinal >= WATCH_MAX_POINTS) {
+        Trace(1, "WatchPoint: Too many watch points!\n");
+        mOrdinal = WATCH_MAX_POINTS - 1;
+    }
 }
 
 PUBLIC WatchPoint::~WatchPoint()
@@ -108,14 +272,19 @@ PUBLIC int WatchPoint::getMax(MobiusInterface* m)
     return mMax;
 }
 
+PUBLIC int WatchPoint::getOrdinal()
+{
+    return mOrdinal;
+}
+
 /**
  * Called internally to notify the listeners of a state change.
- * Delgates up to Mobius to manage the listener list.
+ * Delgates up to Mobius which queues it for the WatchDispatcher.
  */
 PUBLIC void WatchPoint::notify(Mobius* m, Loop* l)
 {
     int value = getValue(m, l);
-    m->notifyWatchers(this, value);
+    m->notifyWatchers(this, l->getTrack()->getRawNumber(), value);
 }
 
 /****************************************************************************
@@ -130,7 +299,6 @@ class LoopLocationType : public WatchPoint {
 
     LoopLocationType();
     
-    List* getListeners(Watchers* w);
     int getValue(Mobius* m, Loop* l);
 
 };
@@ -143,11 +311,6 @@ PUBLIC LoopLocationType::LoopLocationType() :
     mMax = 1000;
 }
 
-PUBLIC List* LoopLocationType::getListeners(Watchers* w)
-{
-    return w->loopLocation;
-}
-
 PUBLIC int LoopLocationType::getValue(Mobius* m, Loop* l)
 {
     int value = 0;
@@ -182,7 +345,6 @@ class LoopStartType : public WatchPoint {
 
   public:
     LoopStartType();
-    List* getListeners(Watchers* w);
     int getValue(Mobius* m, Loop* l);
 };
 
@@ -192,11 +354,6 @@ PUBLIC LoopStartType::LoopStartType() :
     mBehavior = WATCH_MOMENTARY;
 }
 
-PUBLIC List* LoopStartType::getListeners(Watchers* w)
-{
-    return w->loopStart;
-}
-
 PUBLIC int LoopStartType::getValue(Mobius* m, Loop* l)
 {
     return 1;
@@ -214,7 +371,6 @@ class LoopCycleType : public WatchPoint {
 
   public:
     LoopCycleType();
-    List* getListeners(Watchers* w);
     int getValue(Mobius* m, Loop* l);
 };
 
@@ -224,11 +380,6 @@ PUBLIC LoopCycleType::LoopCycleType() :
     mBehavior = WATCH_MOMENTARY;
 }
 
-PUBLIC List* LoopCycleType::getListeners(Watchers* w)
-{
-    return w->loopCycle;
-}
-
 PUBLIC int LoopCycleType::getValue(Mobius* m, Loop* l)
 {
     return 1;
@@ -247,7 +398,6 @@ class LoopSubcycleType : public WatchPoint {
   public:
 
     LoopSubcycleType();
-    List* getListeners(Watchers* w);
     int getValue(Mobius* m, Loop* l);
 };
 
@@ -257,11 +407,6 @@ PUBLIC LoopSubcycleType::LoopSubcycleType() :
     mBehavior = WATCH_MOMENTARY;
 }
 
-PUBLIC List* LoopSubcycleType::getListeners(Watchers* w)
-{
-    return w->loopSubcycle;
-}
-
 PUBLIC int LoopSubcycleType::getValue(Mobius* m, Loop* l)
 {
     return 1;
@@ -316,6 +461,224 @@ PUBLIC WatchPoint* WatchPoint::getWatchPoint(const char* name)
 	return found;
 }
 
+/****************************************************************************
+ *                                                                          *
+ *                                WATCH QUEUE                               *
+ *                                                                          *
+ ****************************************************************************/
+
+PUBLIC WatchQueue::WatchQueue()
+{
+    mHead = 0;
+    mTail = 0;
+    mOverflows = 0;
+}
+
+PUBLIC WatchQueue::~WatchQueue()
+{
+}
+
+/**
+ * Called by the one thread processing the track.
+ * If the dispatcher has fallen behind the change is dropped.
+ */
+PUBLIC bool WatchQueue::add(WatchPoint* wp, int track, int value)
+{
+    bool added = false;
+    int head = mHead;
+    int next = (head + 1) & (WATCH_QUEUE_SIZE - 1);
+
+    if (next == mTail)
+      mOverflows++;
+    else {
+        WatchEvent* e = &mEvents[head];
+        e->point = wp;
+        e->track = track;
+        e->value = value;
+        AtomicBarrier();
+        mHead = next;
+        added = true;
+    }
+    return added;
+}
+
+/**
+ * Called by the dispatcher.
+ */
+PUBLIC bool WatchQueue::remove(WatchEvent* e)
+{
+    bool removed = false;
+    int tail = mTail;
+
+    if (tail != mHead) {
+        AtomicBarrier();
+        *e = mEvents[tail];
+        AtomicBarrier();
+        mTail = (tail + 1) & (WATCH_QUEUE_SIZE - 1);
+        removed = true;
+    }
+    return removed;
+}
+
+PUBLIC int WatchQueue::getOverflows()
+{
+    return mOverflows;
+}
+
+/****************************************************************************
+ *                                                                          *
+ *                              WATCH DISPATCHER                            *
+ *                                                                          *
+ ****************************************************************************/
+
+PUBLIC WatchDispatcher::WatchDispatcher(Watchers* watchers) :
+    Thread("WatchDispatcher")
+{
+    setTimeout(WATCH_DISPATCH_MILLIS);
+    mWatchers = watchers;
+
+    for (int i = 0 ; i < WATCH_MAX_TRACKS ; i++)
+      mQueues[i] = new WatchQueue();
+
+    for (int i = 0 ; i < WATCH_MAX_POINTS ; i++) {
+        for (int j = 0 ; j < WATCH_MAX_TRACKS ; j++) {
+            mPending[i][j] = false;
+            mValues[i][j] = 0;
+            mSent[i][j] = false;
+            mLast[i][j] = 0;
+        }
+    }
+
+    mDropped = 0;
+    mEvents = 0;
+    mCoalesced = 0;
+    mDelivered = 0;
+    mMaxMicros = 0;
+}
+
+PUBLIC WatchDispatcher::~WatchDispatcher()
+{
+    for (int i = 0 ; i < WATCH_MAX_TRACKS ; i++)
+      delete mQueues[i];
+}
+
+/**
+ * Called in the interrupt, or by a Recorder worker processing 
+ * the track.  We don't signal the thread, it looks every
+ * WATCH_DISPATCH_MILLIS.
+ */
+PUBLIC void WatchDispatcher::add(WatchPoint* wp, int track, int value)
+{
+    if (track < 0 || track >= WATCH_MAX_TRACKS ||
+        !mQueues[track]->add(wp, track, value))
+      AtomicIncrement(&mDropped);
+}
+
+PUBLIC void WatchDispatcher::processEvent()
+{
+    dispatch();
+}
+
+PUBLIC void WatchDispatcher::eventTimeout()
+{
+    dispatch();
+}
+
+/**
+ * Drain the queues, keeping only the last value of each point in
+ * each track, then pass them to the listeners.  Momentary points
+ * are passed once per dispatch no matter how many times they
+ * happened.  Latching and continuous points are only passed when
+ * the value differs from the last one we passed.
+ */
+PUBLIC void WatchDispatcher::dispatch()
+{
+    long long start = GetClockTicks();
+    int events = 0;
+    WatchEvent e;
+
+    // anything replaced during the last dispatch is safe now
+    mWatchers->reclaim();
+
+    for (int i = 0 ; i < WATCH_MAX_TRACKS ; i++) {
+        while (mQueues[i]->remove(&e)) {
+            int point = e.point->getOrdinal();
+            if (mPending[point][i])
+              mCoalesced++;
+            mPending[point][i] = true;
+            mValues[point][i] = e.value;
+            events++;
+        }
+    }
+
+    if (events > 0) {
+        mEvents += events;
+
+        WatchPoint** points = WatchPoint::getWatchPoints();
+        for (int i = 0 ; points[i] != NULL ; i++) {
+            WatchPoint* wp = points[i];
+            int point = wp->getOrdinal();
+            for (int j = 0 ; j < WATCH_MAX_TRACKS ; j++) {
+                if (mPending[point][j]) {
+                    int value = mValues[point][j];
+                    mPending[point][j] = false;
+
+                    if (wp->getBehavior() != WATCH_MOMENTARY &&
+                        mSent[point][j] && mLast[point][j] == value) {
+                        mCoalesced++;
+                    }
+                    else {
+                        mSent[point][j] = true;
+                        mLast[point][j] = value;
+                        fire(wp, j, value);
+                    }
+                }
+            }
+        }
+
+        int micros = (int)ClockTicksToMicros(GetClockTicks() - start);
+        if (micros > mMaxMicros)
+          mMaxMicros = micros;
+    }
+}
+
+/**
+ * Pass a change to the listeners of a point that are watching
+ * this track or all tracks.  Listeners that have been removed are
+ * pruned, which replaces the array but this one stays valid until
+ * the next dispatch.
+ */
+PRIVATE void WatchDispatcher::fire(WatchPoint* wp, int track, int value)
+{
+    WatchListeners* listeners = mWatchers->getListeners(wp);
+    bool removing = false;
+
+    if (listeners != NULL) {
+        for (int i = 0 ; i < listeners->count ; i++) {
+            WatchPointListener* l = listeners->listeners[i];
+            if (l->isRemoving())
+              removing = true;
+            else {
+                int number = l->getWatchPointTrack();
+                if (number <= 0 || number == track + 1) {
+                    l->watchPointEvent(value);
+                    mDelivered++;
+                }
+            }
+        }
+    }
+
+    if (removing)
+      mWatchers->prune(wp);
+}
+
+PUBLIC void WatchDispatcher::dump()
+{
+    printf("WatchDispatcher: %d events, %d coalesced, %d delivered, %d dropped, max %d usec\n",
+           mEvents, mCoalesced, mDelivered, mDropped, mMaxMicros);
+    fflush(stdout);
+}
+
 /****************************************************************************/
 /****************************************************************************/
 /****************************************************************************/
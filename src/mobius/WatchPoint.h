@@ -24,6 +24,8 @@
 #ifndef WATCHPOINT_H
 #define WATCHPOINT_H
 
+#include "Thread.h"
+
 #include "SystemConstant.h"
 
 //////////////////////////////////////////////////////////////////////
@@ -69,6 +71,12 @@ typedef enum {
 //
 //////////////////////////////////////////////////////////////////////
 
+/**
+ * The maximum number of watch points, WatchPoint::getOrdinal
+ * is an index into arrays of this size.
+ */
+#define WATCH_MAX_POINTS 8
+
 /**
  * The definition of a watch point.
  */
@@ -77,6 +85,7 @@ class WatchPoint : public SystemConstant {
     friend class Mobius;
     friend class Export;
     friend class Loop;
+    friend class WatchDispatcher;
 
   public:
 
@@ -91,12 +100,12 @@ class WatchPoint : public SystemConstant {
     virtual int getMin(class MobiusInterface* m);
     virtual int getMax(class MobiusInterface* m);
 
+    int getOrdinal();
 
   protected:
 
     static void localizeAll(class MessageCatalog* c);
 
-    virtual class List* getListeners(class Watchers* watchers) = 0;
     virtual int getValue(class Mobius* m, class Loop* l) = 0;
 
     void notify(Mobius* m, Loop* l);
@@ -104,6 +113,7 @@ class WatchPoint : public SystemConstant {
     WatchBehavior mBehavior;
     int mMin;
     int mMax;
+    int mOrdinal;
 
 };
 
@@ -135,6 +145,10 @@ extern WatchPoint* LoopSubcyclePoint;
  * of this object is a bit unusual to avoid needing
  * a csect around the listener list traversals.  
  *
+ * Listeners are not called in the audio interrupt, the interrupt
+ * queues the changes and they are passed to the listeners by
+ * the WatchDispatcher thread a few milliseconds later.
+ *
  * A subclass of WatchPointListener is defined by the
  * Mobius cleint and must overload the three virtual methods.
  * Once the listener has been registered using 
@@ -150,6 +164,8 @@ extern WatchPoint* LoopSubcyclePoint;
 class WatchPointListener {
 
     friend class Mobius;
+    friend class Watchers;
+    friend class WatchDispatcher;
 
   public:
 
@@ -164,10 +180,8 @@ class WatchPointListener {
 
     /**
      * Return track number starting from 1 if you want the
-     * watch scoped to a track.  This method will be called
-     * as watch points are processed and must be fast and
-     * not do anything that can't be done inside the audio 
-     * interrupt.
+     * watch scoped to a track, zero for all tracks.  This method
+     * will be called as watch points are dispatched and must be fast.
      *
      * Hmm, kind of not liking this interface, but avoids a bunch
      * of arguments and a wrapper.
@@ -175,7 +189,9 @@ class WatchPointListener {
     virtual int getWatchPointTrack() = 0;
 
     /**
-     * Handle a watch point event.
+     * Handle a watch point event.  This is called by the 
+     * WatchDispatcher thread, if the value changed more than once
+     * since the last dispatch you only see the last one.
      */
     virtual void watchPointEvent(int value) = 0;
 
@@ -193,7 +209,10 @@ class WatchPointListener {
 
   private:
     
-    bool mRemoving;
+    volatile bool mRemoving;
+
+    // chain of removed listeners waiting to be deleted
+    WatchPointListener* mRemoved;
 
 };
 
@@ -203,15 +222,36 @@ class WatchPointListener {
 //
 //////////////////////////////////////////////////////////////////////
 
+/**
+ * The listeners for one watch point.  Once published these are
+ * never modified, adding or removing a listener builds a new
+ * array and swaps it in so the dispatcher can walk the array
+ * without a csect.
+ */
+class WatchListeners {
+  public:
+
+    WatchListeners(int size);
+    ~WatchListeners();
+
+    int count;
+    WatchPointListener** listeners;
+
+    // chain of arrays replaced since the dispatcher last looked
+    WatchListeners* retired;
+
+};
+
 /**
  * An object maintained by Mobius that contains the registered
  * listeners for every watch point.
  * 
- * Dispensing with the usual getters and setters here since it
- * is only used internally and we need to be able to add these
- * without much fuss.
- *
- * The Lists will contain WatchPointListeners.
+ * Registration happens in the UI or OSC threads and is serialized
+ * by our own csect which is never entered by the interrupt.  The
+ * only thread that reads the listener arrays without the csect is
+ * the WatchDispatcher, so it is also the one that deletes the
+ * arrays that were replaced, between dispatches when it can't
+ * be looking at one.
  */
 class Watchers {
   public:
@@ -219,12 +259,145 @@ class Watchers {
     Watchers();
     ~Watchers();
 
-    class List* loopLocation;
-    class List* loopStart;
-    class List* loopSubcycle;
-    class List* loopCycle;
+    // any thread but the interrupt
+    void add(WatchPoint* wp, WatchPointListener* l);
+
+    // WatchDispatcher
+    WatchListeners* getListeners(WatchPoint* wp);
+    void prune(WatchPoint* wp);
+    void reclaim();
+
+    // interrupt, true if anyone is listening
+    bool isWatched(WatchPoint* wp);
+
+  private:
+
+    void publish(WatchPoint* wp, WatchListeners* listeners);
+
+    class CriticalSection* mCsect;
+    WatchListeners* volatile mListeners[WATCH_MAX_POINTS];
+    volatile int mCounts[WATCH_MAX_POINTS];
+    WatchListeners* volatile mRetired;
+
+    // removed listeners, deleted with us
+    WatchPointListener* mRemoved;
+
+};
+
+//////////////////////////////////////////////////////////////////////
+//
+// WatchQueue
+//
+//////////////////////////////////////////////////////////////////////
+
+/**
+ * Number of changes that can be waiting for the dispatcher
+ * in one track.  Must be a power of two.
+ */
+#define WATCH_QUEUE_SIZE 64
+
+/**
+ * Tracks with their own queue, changes in tracks beyond
+ * this are dropped.
+ */
+#define WATCH_MAX_TRACKS 32
+
+/**
+ * One watch point change.  Track is the raw track number
+ * starting from zero.
+ */
+typedef struct {
+
+    class WatchPoint* point;
+    int track;
+    int value;
+
+} WatchEvent;
+
+/**
+ * Bounded lock free queue of watch point changes for one track.
+ * A track is only processed by one thread in an interrupt, either
+ * the interrupt or a Recorder worker, so each queue has one
+ * producer and the WatchDispatcher is the one consumer.
+ */
+class WatchQueue {
+
+  public:
+
+    WatchQueue();
+    ~WatchQueue();
+
+    bool add(WatchPoint* wp, int track, int value);
+    bool remove(WatchEvent* e);
+
+    int getOverflows();
+
+  private:
+
+    WatchEvent mEvents[WATCH_QUEUE_SIZE];
+
+    // only the producer advances the head and the consumer the tail
+    volatile int mHead;
+    volatile int mTail;
+
+    int mOverflows;
+
+};
+
+//////////////////////////////////////////////////////////////////////
+//
+// WatchDispatcher
+//
+//////////////////////////////////////////////////////////////////////
+
+/**
+ * Milliseconds between dispatches.  The interrupt doesn't signal
+ * us, so this is the most a listener will lag behind the change.
+ */
+#define WATCH_DISPATCH_MILLIS 10
+
+/**
+ * Thread that drains the WatchQueues and calls the listeners.
+ */
+class WatchDispatcher : public Thread {
+
+  public:
+
+    WatchDispatcher(Watchers* watchers);
+    ~WatchDispatcher();
+
+    // interrupt or Recorder worker
+    void add(WatchPoint* wp, int track, int value);
+
+    // Thread
+    void processEvent();
+    void eventTimeout();
+
+    void dispatch();
+    void dump();
+
+  private:
+
+    void fire(WatchPoint* wp, int track, int value);
+
+    Watchers* mWatchers;
+    WatchQueue* mQueues[WATCH_MAX_TRACKS];
+
+    // the latest value of each point in each track, collected from
+    // the queues before the listeners are called
+    bool mPending[WATCH_MAX_POINTS][WATCH_MAX_TRACKS];
+    int mValues[WATCH_MAX_POINTS][WATCH_MAX_TRACKS];
+
+    // the last value given to the listeners
+    bool mSent[WATCH_MAX_POINTS][WATCH_MAX_TRACKS];
+    int mLast[WATCH_MAX_POINTS][WATCH_MAX_TRACKS];
 
-    class List* modeRecord;
+    // statistics
+    volatile int mDropped;
+    int mEvents;
+    int mCoalesced;
+    int mDelivered;
+    int mMaxMicros;
 
 };
 
@@ -0,0 +1,335 @@
+/*
+ * Copyright (c) 2010 Jeffrey S. Larson  <jeff@circularlabs.com>
+ * All rights reserved.
+ * See the LICENSE file for the full copyright and license declaration.
+ *
+ * ---------------------------------------------------------------------
+ *
+ * Test for LayerCompressor, run headless with OfflineEngine.
+ *
+ *   compresstest [-config <dir>] [-install <dir>] [-block <frames>]
+ *
+ * One track builds a chain of overdub layers, then undoes deep into
+ * it, redoes all the way back and moves a window back over the
+ * history.  After every loop
+ * boundary and every undo we stop feeding the interrupt until
+ * MobiusThread has compressed or loaded what it was asked to, so the
+ * undos reach layers that are compressed, and with a cache budget of
+ * zero the layers behind the play layer are evicted again once they
+ * go cold.  This stands in for MobiusThread having a core of its own.
+ *
+ * The sequence runs once with the compressor disabled and once with
+ * it enabled.  The output must be the same.  We also require that
+ * layers were compressed, prefetched, decoded and evicted, that every
+ * block was decoded by MobiusThread before the interrupt reached it,
+ * and that no interrupt took longer than the device takes to play
+ * the block while undoing into them.  With one core the block that
+ * wakes MobiusThread includes some of its time, the percentiles show
+ * that but the decoding still isn't in the interrupt.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Util.h"
+#include "Thread.h"
+#include "Trace.h"
+
+#include "LayerCompressor.h"
+#include "Mobius.h"
+
+#include "OfflineEngine.h"
+
+/**
+ * Loop length in seconds.
+ */
+#define TEST_LOOP 1.0
+
+/**
+ * Loop passes spent overdubbing, each one is a layer.
+ */
+#define TEST_LAYERS 10
+
+/**
+ * Longest we wait for MobiusThread at a loop boundary.
+ */
+#define TEST_WAIT_MILLIS 3000
+
+typedef struct {
+
+    // hash of the output samples
+    unsigned int audio;
+
+    // interrupt times while undoing, sorted
+    long long* ticks;
+    long count;
+    long misses;
+
+    // compressor statistics at the end
+    int installed;
+    int prefetched;
+    int windowed;
+    int overflows;
+    int decodes;
+    int ahead;
+    int evicted;
+
+} RunResult;
+
+int Failures = 0;
+
+/****************************************************************************
+ *                                                                          *
+ *                                   RUNNER                                 *
+ *                                                                          *
+ ****************************************************************************/
+
+unsigned int hashSamples(unsigned int hash, float* samples, long count)
+{
+    unsigned char* bytes = (unsigned char*)samples;
+    long length = count * sizeof(float);
+    for (long i = 0 ; i < length ; i++)
+      hash = (hash ^ bytes[i]) * 16777619u;
+    return hash;
+}
+
+int compareTicks(const void* a, const void* b)
+{
+    long long t1 = *(const long long*)a;
+    long long t2 = *(const long long*)b;
+    return (t1 < t2) ? -1 : ((t1 > t2) ? 1 : 0);
+}
+
+double percentile(RunResult* r, double p)
+{
+    long index = (long)((r->count - 1) * p);
+    return ClockTicksToMicros(r->ticks[index]);
+}
+
+/**
+ * Let MobiusThread catch up.  It is signaled but give it a moment
+ * to see the requests before we ask if it is idle.
+ */
+void waitForThread(LayerCompressor* compressor)
+{
+    SleepMillis(20);
+    for (int i = 0 ; i < TEST_WAIT_MILLIS / 10 && !compressor->isIdle() ; i++)
+      SleepMillis(10);
+}
+
+/**
+ * Return true if a time falls within the block.
+ */
+bool isNow(double when, double start, double end)
+{
+    return (when >= start && when < end);
+}
+
+void run(OfflineEngine* engine, bool enabled, RunResult* result)
+{
+    Mobius* m = engine->getMobius();
+    LayerCompressor* compressor = m->getLayerCompressor();
+    int rate = engine->getSampleRate();
+    long block = engine->getBlockFrames();
+    double record = TEST_LOOP * (TEST_LAYERS + 1);
+    double undoStart = record + 0.5;
+    double seconds = undoStart + 21.0;
+    long blocks = (long)((seconds * rate) / block);
+    float* input = new float[block * 2];
+    float* output = new float[block * 2];
+    long long budget = (GetClockFrequency() * block) / rate;
+
+    LayerCompressor::Enabled = enabled;
+    compressor->setCacheBudget(0);
+
+    // start clean, and let the reset happen before we begin
+    engine->doFunction("GlobalReset", 0);
+    memset(input, 0, block * 2 * sizeof(float));
+    for (int i = 0 ; i < 4 ; i++)
+      engine->process(input, output);
+
+    int installed = compressor->getInstalled();
+    int prefetched = compressor->getPrefetched();
+    int overflows = compressor->getOverflows();
+    int decodes = compressor->getDecodes();
+    int ahead = compressor->getDecodesAhead();
+    int evicted = compressor->getEvicted();
+
+    srand(42);
+    result->audio = 2166136261u;
+    result->ticks = new long long[blocks];
+    result->count = 0;
+    result->misses = 0;
+    int windowStart = 0;
+
+    for (long b = 0 ; b < blocks ; b++) {
+        double start = (double)(b * block) / rate;
+        double end = (double)((b + 1) * block) / rate;
+
+        if (isNow(0.0, start, end))
+          engine->doFunction("Record", 1);
+        if (isNow(TEST_LOOP, start, end)) {
+            engine->doFunction("Record", 1);
+            engine->doFunction("Overdub", 1);
+        }
+        if (isNow(record, start, end))
+          engine->doFunction("Overdub", 1);
+
+        // the loop starts a new layer just after the boundary
+        double boundary = (double)(long)(start / TEST_LOOP) * TEST_LOOP;
+        bool wait = isNow(boundary + 0.1, start, end);
+
+        // undo most of the way back, redo all of it, then window
+        // back into the layers that went cold again
+        bool undoing = (start >= undoStart);
+        if (undoing) {
+            for (int i = 0 ; i < 20 ; i++) {
+                const char* function = "Undo";
+                if (i >= 8 && i < 16)
+                  function = "Redo";
+                else if (i >= 16)
+                  function = "WindowBackward";
+                if (isNow(undoStart + i, start, end)) {
+                    if (i == 16)
+                      windowStart = compressor->getPrefetched();
+                    engine->doFunction(function, 1);
+                    wait = true;
+                }
+            }
+        }
+
+        for (long i = 0 ; i < block * 2 ; i++)
+          input[i] = ((float)(rand() % 2000) / 10000.0f) - 0.1f;
+
+        long long blockStart = GetClockTicks();
+        engine->process(input, output);
+        long long ticks = GetClockTicks() - blockStart;
+        if (undoing) {
+            result->ticks[result->count++] = ticks;
+            if (ticks > budget)
+              result->misses++;
+        }
+
+        result->audio = hashSamples(result->audio, output, block * 2);
+
+        // the interrupt has asked for work
+        if (wait)
+          waitForThread(compressor);
+    }
+
+    qsort(result->ticks, result->count, sizeof(long long), compareTicks);
+
+    result->installed = compressor->getInstalled() - installed;
+    result->prefetched = compressor->getPrefetched() - prefetched;
+    result->windowed = compressor->getPrefetched() - windowStart;
+    result->overflows = compressor->getOverflows() - overflows;
+    result->decodes = compressor->getDecodes() - decodes;
+    result->ahead = compressor->getDecodesAhead() - ahead;
+    result->evicted = compressor->getEvicted() - evicted;
+
+    delete input;
+    delete output;
+}
+
+void report(const char* name, RunResult* r)
+{
+    printf("%-12s %08x %8.1f %8.1f %8.1f %8.1f %6ld %9d %10d %8d %6d %8d\n",
+           name, r->audio,
+           percentile(r, 0.50), percentile(r, 0.99), percentile(r, 0.999),
+           ClockTicksToMicros(r->ticks[r->count - 1]), r->misses,
+           r->installed, r->prefetched, r->decodes, r->ahead, r->evicted);
+    fflush(stdout);
+}
+
+void check(bool condition, const char* message)
+{
+    if (!condition) {
+        printf("FAIL: %s\n", message);
+        Failures++;
+    }
+}
+
+void usage()
+{
+    printf("usage: compresstest [-config <dir>] [-install <dir>] [-block <frames>]\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char* config = "install/config";
+    const char* install = ".";
+    long block = 256;
+
+    for (int i = 1 ; i < argc ; i++) {
+        const char* arg = argv[i];
+        if (i + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        const char* next = argv[++i];
+        if (!strcmp(arg, "-config"))
+          config = next;
+        else if (!strcmp(arg, "-install"))
+          install = next;
+        else if (!strcmp(arg, "-block"))
+          block = atol(next);
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    OfflineEngine* engine = new OfflineEngine();
+    engine->setConfigurationDirectory(config);
+    engine->setInstallationDirectory(install);
+    engine->setBlockFrames(block);
+    engine->setTracks(1);
+    engine->setParallelTracks(0);
+
+    if (!engine->start()) {
+        printf("Unable to start Mobius\n");
+        return 1;
+    }
+
+    RunResult plain;
+    RunResult compressed;
+
+    printf("%-12s %8s %8s %8s %8s %8s %6s %9s %10s %8s %6s %8s\n",
+           "run", "output", "p50 us", "p99 us", "p99.9 us", "max us",
+           "misses", "installed", "prefetched", "decoded", "ahead",
+           "evicted");
+
+    run(engine, false, &plain);
+    report("plain", &plain);
+    run(engine, true, &compressed);
+    report("compressed", &compressed);
+
+    check(plain.audio == compressed.audio, "output differs");
+    check(compressed.installed > 0, "no layers compressed");
+    check(compressed.prefetched > 0, "no layers prefetched");
+    check(compressed.windowed > 0, "no layers prefetched for the window");
+    check(compressed.overflows == 0, "no room to prefetch warm layers");
+    check(compressed.decodes > 0, "no blocks decoded");
+    check(compressed.evicted > 0, "no layers evicted");
+    check(compressed.decodes == compressed.ahead, "blocks decoded in the interrupt");
+    check(compressed.misses == 0, "interrupt missed the block time while undoing");
+    check(plain.installed == 0, "layers compressed while disabled");
+
+    engine->stop();
+    delete engine;
+    delete plain.ticks;
+    delete compressed.ticks;
+
+    FlushTrace();
+
+    if (Failures > 0)
+      printf("%d failures\n", Failures);
+
+    return (Failures > 0) ? 1 : 0;
+}
+
+/****************************************************************************/
+/****************************************************************************/
+/****************************************************************************/
@@ -0,0 +1,582 @@
+/*
+ * Copyright (c) 2010 Jeffrey S. Larson  <jeff@circularlabs.com>
+ * All rights reserved.
+ * See the LICENSE file for the full copyright and license declaration.
+ *
+ * ---------------------------------------------------------------------
+ *
+ * Microbenchmark for AudioCursor transfers.
+ *
+ * Runs each case once with AudioCursor::BlockTransfer off to get the
+ * old frame-at-a-time results and timings, then again with it on.
+ * The results must be identical, any difference is reported as a
+ * failure.
+ *
+ * Then checks that copies share buffers until they are modified
+ * and that silence is not allocated, and that an Audio with an
+ * AudioSource only loads the buffers that are touched.  Last
+ * the LayerCompressor codec must give back exactly what it was given.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <string.h>
+
+#include "Util.h"
+#include "Thread.h"
+#include "Trace.h"
+
+#include "Audio.h"
+#include "LayerCompressor.h"
+#include "ObjectPool.h"
+
+/**
+ * Size of the transfer buffer, the usual interrupt block size.
+ */
+#define BLOCK_FRAMES 256
+
+/**
+ * Length of the source Audio, a little over 4 Audio buffers
+ * so we cross buffer boundaries in the middle of blocks.
+ */
+#define AUDIO_FRAMES ((1024 * 64 * 4) + 1000)
+
+/**
+ * Number of passes over the Audio for each case.
+ */
+#define PASSES 20
+
+typedef enum {
+
+	CaseForward,
+	CaseLevel,
+	CaseReverse,
+	CaseFade,
+	CasePutAdd,
+	CasePutReplace,
+	CasePutRemove
+
+} TestCase;
+
+const char* CaseNames[] = {
+	"forward", "level", "reverse", "fade",
+	"put add", "put replace", "put remove"
+};
+
+int Failures = 0;
+
+/**
+ * Build a source Audio with some noise in it.  Leave a hole in
+ * the second buffer to exercise the sparse paths.
+ */
+Audio* makeSource(AudioPool* pool)
+{
+	Audio* a = pool->newAudio();
+	float block[BLOCK_FRAMES * 2];
+	long frames = 0;
+
+	srand(42);
+	while (frames < AUDIO_FRAMES) {
+		for (int i = 0 ; i < BLOCK_FRAMES * 2 ; i++)
+		  block[i] = ((float)(rand() % 2000) / 1000.0f) - 1.0f;
+		a->append(block, BLOCK_FRAMES);
+		frames += BLOCK_FRAMES;
+	}
+
+	// punch a sparse hole
+	a->zero();
+	frames = 0;
+	while (frames < AUDIO_FRAMES) {
+		for (int i = 0 ; i < BLOCK_FRAMES * 2 ; i++)
+		  block[i] = ((float)(rand() % 2000) / 1000.0f) - 1.0f;
+		long buffer = frames / (1024 * 64);
+		if (buffer != 1)
+		  a->put(block, BLOCK_FRAMES, frames);
+		frames += BLOCK_FRAMES;
+	}
+
+	return a;
+}
+
+/**
+ * Run one case, leaving the results in dest.
+ * For the get cases dest is a float array large enough to hold
+ * one pass, for the put cases the dest is an Audio.
+ */
+double runCase(AudioPool* pool, TestCase tcase, Audio* src,
+			   float* output, Audio* dest)
+{
+	AudioCursor cursor("Test");
+	AudioBuffer b;
+	b.channels = 2;
+	b.frames = BLOCK_FRAMES;
+
+	long long start = GetClockTicks();
+
+	for (int pass = 0 ; pass < PASSES ; pass++) {
+
+		if (tcase < CasePutAdd) {
+			memset(output, 0, AUDIO_FRAMES * 2 * sizeof(float));
+			cursor.setAudio(src);
+			cursor.setReverse(tcase == CaseReverse);
+			cursor.setFrame((tcase == CaseReverse) ? AUDIO_FRAMES - 1 : 0);
+
+			for (long f = 0 ; f + BLOCK_FRAMES <= AUDIO_FRAMES ;
+				 f += BLOCK_FRAMES) {
+				b.buffer = &output[f * 2];
+				if (tcase == CaseFade && (f % (BLOCK_FRAMES * 8)) == 0)
+				  cursor.startFadeIn();
+				cursor.get(&b, (tcase == CaseLevel) ? 0.5f : 1.0f);
+			}
+		}
+		else {
+			AudioOp op = OpAdd;
+			if (tcase == CasePutReplace)
+			  op = OpReplace;
+			else if (tcase == CasePutRemove)
+			  op = OpRemove;
+
+			dest->reset();
+			cursor.setAudio(dest);
+			cursor.setAutoExtend(true);
+			cursor.setFrame(0);
+
+			for (long f = 0 ; f + BLOCK_FRAMES <= AUDIO_FRAMES ;
+				 f += BLOCK_FRAMES) {
+				b.buffer = &output[f * 2];
+				cursor.put(&b, op);
+			}
+		}
+	}
+
+	long long end = GetClockTicks();
+	return ClockTicksToMicros(end - start) / 1000.0;
+}
+
+void check(const char* name, bool ok)
+{
+	if (!ok) {
+		printf("FAIL: %s\n", name);
+		Failures++;
+	}
+}
+
+bool same(float* expected, float* actual)
+{
+	return (memcmp(expected, actual, AUDIO_FRAMES * 2 * sizeof(float)) == 0);
+}
+
+void snapshot(Audio* a, float* dest)
+{
+	memset(dest, 0, AUDIO_FRAMES * 2 * sizeof(float));
+	a->get(dest, AUDIO_FRAMES, 0);
+}
+
+/**
+ * Copies share buffers with the source until one side is modified,
+ * and buffers of silence are never allocated.
+ */
+void checkSharing(AudioPool* pool)
+{
+	float* expected = new float[AUDIO_FRAMES * 2];
+	float* actual = new float[AUDIO_FRAMES * 2];
+	float block[BLOCK_FRAMES * 2];
+	int allocated, shared;
+	int copies = pool->getWriteCopies();
+
+	// five buffers with a hole in the second
+	Audio* src = makeSource(pool);
+	src->getBufferCounts(&allocated, &shared);
+	check("sparse source", allocated == 4 && shared == 0);
+	snapshot(src, expected);
+
+	Audio* copy = pool->newAudio();
+	copy->copy(src);
+	copy->getBufferCounts(&allocated, &shared);
+	check("copy shares buffers", allocated == 4 && shared == 4);
+	snapshot(copy, actual);
+	check("copy content", same(expected, actual));
+
+	// writing into the copy copies just the buffer written
+	for (int i = 0 ; i < BLOCK_FRAMES * 2 ; i++)
+	  block[i] = 0.25f;
+	copy->put(block, BLOCK_FRAMES, 100);
+	copy->getBufferCounts(&allocated, &shared);
+	check("write copies one buffer", allocated == 4 && shared == 3);
+	check("write copy counted", pool->getWriteCopies() == copies + 1);
+	snapshot(src, actual);
+	check("source unchanged by write", same(expected, actual));
+
+	// a fade in the source copies its last buffer
+	float* copied = new float[AUDIO_FRAMES * 2];
+	snapshot(copy, copied);
+	AudioCursor cursor("Test", src);
+	cursor.fadeOut();
+	src->getBufferCounts(&allocated, &shared);
+	check("fade copies one buffer", allocated == 4 && shared == 2);
+	check("fade copy counted", pool->getWriteCopies() == copies + 2);
+	snapshot(copy, actual);
+	check("copy unchanged by fade", same(copied, actual));
+
+	// the copy survives the source
+	delete src;
+	copy->getBufferCounts(&allocated, &shared);
+	check("released shares", allocated == 4 && shared == 0);
+	snapshot(copy, actual);
+	check("copy intact", same(copied, actual));
+	delete copy;
+
+	// recording silence extends the audio without buffers
+	Audio* quiet = pool->newAudio();
+	memset(block, 0, sizeof(block));
+	for (long f = 0 ; f + BLOCK_FRAMES <= AUDIO_FRAMES ; f += BLOCK_FRAMES)
+	  quiet->append(block, BLOCK_FRAMES);
+	quiet->getBufferCounts(&allocated, &shared);
+	check("silence not allocated", allocated == 0 &&
+		  quiet->getFrames() == (AUDIO_FRAMES / BLOCK_FRAMES) * BLOCK_FRAMES);
+	delete quiet;
+
+	// a buffer whose last reference is gone can't be shared again
+	float* loose = pool->newBuffer();
+	check("live buffer shared", pool->shareLiveBuffer(loose));
+	pool->freeBuffer(loose);
+	pool->freeBuffer(loose);
+	check("released buffer not shared", !pool->shareLiveBuffer(loose));
+
+	check("buffers returned", pool->getSamplePool()->getInUse() == 0);
+
+	delete expected;
+	delete actual;
+	delete copied;
+}
+
+/**
+ * An AudioSource over an array of samples.
+ */
+int Released = 0;
+
+class TestSource : public AudioSource {
+  public:
+
+	TestSource(float* samples, long frames) {
+		mSamples = samples;
+		mFrames = frames;
+	}
+
+	int getSampleRate() { return 44100; }
+	int getChannels() { return 2; }
+	long getFrames() { return mFrames; }
+	long getBlockFrames() { return 1024 * 64; }
+	int getBlockCount() { 
+		return (int)((mFrames + getBlockFrames() - 1) / getBlockFrames());
+	}
+
+	bool isZeroBlock(int block) {
+		float* dest = new float[1024 * 64 * 2];
+		readBlock(block, dest);
+		bool zero = true;
+		for (int i = 0 ; i < 1024 * 64 * 2 && zero ; i++)
+		  zero = (dest[i] == 0.0f);
+		delete dest;
+		return zero;
+	}
+
+	void readBlock(int block, float* dest) {
+		long frame = block * getBlockFrames();
+		long frames = mFrames - frame;
+		if (frames > getBlockFrames())
+		  frames = getBlockFrames();
+		memset(dest, 0, getBlockFrames() * 2 * sizeof(float));
+		memcpy(dest, &mSamples[frame * 2], frames * 2 * sizeof(float));
+	}
+
+	void release() {
+		Released++;
+		delete this;
+	}
+
+  private:
+	float* mSamples;
+	long mFrames;
+};
+
+/**
+ * Buffers are loaded from the source when they are touched
+ * and blocks that are never touched are never loaded.
+ */
+void checkSource(AudioPool* pool)
+{
+	float* expected = new float[AUDIO_FRAMES * 2];
+	float* actual = new float[AUDIO_FRAMES * 2];
+	float block[BLOCK_FRAMES * 2];
+	int allocated, shared;
+
+	Audio* src = makeSource(pool);
+	snapshot(src, expected);
+	delete src;
+
+	Audio* lazy = pool->newAudio();
+	check("source accepted", 
+		  lazy->setSource(new TestSource(expected, AUDIO_FRAMES)));
+	lazy->getBufferCounts(&allocated, &shared);
+	check("source not loaded", allocated == 0 && !lazy->isEmpty() &&
+		  lazy->getPendingBlocks() == 4 && 
+		  lazy->getFrames() == AUDIO_FRAMES);
+
+	memset(block, 0, sizeof(block));
+	lazy->get(block, BLOCK_FRAMES, 0);
+	lazy->getBufferCounts(&allocated, &shared);
+	check("first touch loads one buffer", 
+		  allocated == 1 && lazy->getPendingBlocks() == 3);
+
+	snapshot(lazy, actual);
+	lazy->getBufferCounts(&allocated, &shared);
+	check("source content", same(expected, actual));
+	check("source loaded", allocated == 4 && lazy->getPendingBlocks() == 0);
+	delete lazy;
+	check("source released", Released == 1);
+
+	// preloading starts at a frame and wraps to the front
+	lazy = pool->newAudio();
+	lazy->setSource(new TestSource(expected, AUDIO_FRAMES));
+	lazy->loadPendingBlocks(1024 * 64 * 4, 2);
+	lazy->getBufferCounts(&allocated, &shared);
+	check("preload wraps", allocated == 2 && lazy->getPendingBlocks() == 2);
+	snapshot(lazy, actual);
+	check("preload content", same(expected, actual));
+	delete lazy;
+
+	// truncating throws away blocks that were never loaded
+	lazy = pool->newAudio();
+	lazy->setSource(new TestSource(expected, AUDIO_FRAMES));
+	lazy->setFrames(1024 * 64);
+	lazy->getBufferCounts(&allocated, &shared);
+	check("truncate discards blocks", 
+		  allocated == 0 && lazy->getPendingBlocks() == 1);
+	lazy->reset();
+	check("reset releases source", 
+		  Released == 3 && lazy->getPendingBlocks() == 0 && lazy->isEmpty());
+	delete lazy;
+
+	check("source buffers returned", pool->getSamplePool()->getInUse() == 0);
+
+	delete expected;
+	delete actual;
+}
+
+/**
+ * Code each block of an Audio the way LayerCompressor does and
+ * return the source.  Shared buffers are kept by reference.
+ */
+CompressedAudio* compress(AudioPool* pool, Audio* audio, long* size)
+{
+	long samples = audio->getBlockFrames() * 2;
+	float* copy = new float[samples];
+	unsigned char* work = 
+		new unsigned char[CompressedAudio::getMaxEncodedSize(samples)];
+	CompressedAudio* source = new CompressedAudio(NULL, audio);
+
+	*size = 0;
+	for (int i = 0 ; i < audio->getBlockCount() ; i++) {
+		float* block = audio->getBlock(i, copy);
+		if (block != NULL) {
+			if (block != copy && pool->isShared(block))
+			  source->setSharedBlock(i, block);
+			else {
+				long bytes = CompressedAudio::encode(block, samples, 2, work);
+				long max = CompressedAudio::getMaxEncodedSize(samples);
+				unsigned char* data = new unsigned char[max];
+				memcpy(data, work, max);
+				source->setBlock(i, data, bytes);
+				*size += bytes;
+			}
+		}
+	}
+
+	delete copy;
+	delete work;
+	return source;
+}
+
+/**
+ * Decompress into a new Audio and compare.
+ */
+void checkCodec(AudioPool* pool, const char* name, Audio* src, 
+				float* expected, float* actual)
+{
+	long size;
+	long frames = src->getFrames();
+	// makeSource rounds up to a whole block
+	if (frames > AUDIO_FRAMES)
+	  frames = AUDIO_FRAMES;
+	memset(expected, 0, AUDIO_FRAMES * 2 * sizeof(float));
+	src->get(expected, frames, 0);
+	CompressedAudio* source = compress(pool, src, &size);
+	source->share();
+
+	Audio* lazy = pool->newAudio();
+	check(name, lazy->setSource(source) && 
+		  lazy->getFrames() == src->getFrames());
+	memset(actual, 0, AUDIO_FRAMES * 2 * sizeof(float));
+	lazy->get(actual, frames, 0);
+	check(name, same(expected, actual));
+	delete lazy;
+
+	printf("%-12s ratio %.2f\n", name, 
+		   (size > 0) ? (AUDIO_FRAMES * 2 * sizeof(float)) / (double)size : 0.0);
+}
+
+/**
+ * The codec is lossless for noise, for samples from a 16 bit converter,
+ * for odd floats, for an Audio that doesn't start on a buffer boundary,
+ * and for shared buffers.
+ */
+void checkCompressed(AudioPool* pool)
+{
+	float* expected = new float[AUDIO_FRAMES * 2];
+	float* actual = new float[AUDIO_FRAMES * 2];
+	float block[BLOCK_FRAMES * 2];
+
+	Audio* src = makeSource(pool);
+	checkCodec(pool, "noise", src, expected, actual);
+
+	// pcm
+	src->reset();
+	for (long f = 0 ; f + BLOCK_FRAMES <= AUDIO_FRAMES ; f += BLOCK_FRAMES) {
+		for (int i = 0 ; i < BLOCK_FRAMES * 2 ; i++)
+		  block[i] = (float)((rand() % 2000) + ((f + i) % 20000)) / 32768.0f;
+		src->append(block, BLOCK_FRAMES);
+	}
+	checkCodec(pool, "pcm", src, expected, actual);
+
+	// negative zero, denormals, infinity, and silence
+	src->reset();
+	for (long f = 0 ; f + BLOCK_FRAMES <= AUDIO_FRAMES ; f += BLOCK_FRAMES) {
+		for (int i = 0 ; i < BLOCK_FRAMES * 2 ; i++) {
+			int n = rand() % 5;
+			block[i] = (n == 0) ? -0.0f : (n == 1) ? 1.0e-40f : 
+				(n == 2) ? 1.0e30f * 1.0e30f : 0.0f;
+		}
+		src->append(block, BLOCK_FRAMES);
+	}
+	checkCodec(pool, "odd", src, expected, actual);
+	delete src;
+
+	// blocks straddling buffers
+	src = makeSource(pool);
+	src->splice(1000, AUDIO_FRAMES - 2000);
+	checkCodec(pool, "unaligned", src, expected, actual);
+	delete src;
+
+	// shared buffers outlive the Audio they came from
+	src = makeSource(pool);
+	Audio* copy = pool->newAudio();
+	copy->copy(src);
+	checkCodec(pool, "shared", copy, expected, actual);
+	long size;
+	CompressedAudio* source = compress(pool, copy, &size);
+	check("shared not coded", size == 0 && source->getSharedBlocks() == 4);
+	source->share();
+	delete src;
+	delete copy;
+	Audio* lazy = pool->newAudio();
+	lazy->setSource(source);
+	snapshot(lazy, actual);
+	check("shared content", same(expected, actual));
+	delete lazy;
+
+	check("compressed buffers returned", 
+		  pool->getSamplePool()->getInUse() == 0);
+
+	delete expected;
+	delete actual;
+}
+
+void compare(TestCase tcase, float* expected, float* actual)
+{
+	for (long i = 0 ; i < AUDIO_FRAMES * 2 ; i++) {
+		if (expected[i] != actual[i]) {
+			printf("FAIL: %s differs at sample %ld: %f %f\n",
+				   CaseNames[tcase], i, expected[i], actual[i]);
+			Failures++;
+			break;
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	AudioPool* pool = new AudioPool();
+	Audio* src = makeSource(pool);
+	Audio* dest = pool->newAudio();
+
+	float* oldOutput = new float[AUDIO_FRAMES * 2];
+	float* newOutput = new float[AUDIO_FRAMES * 2];
+
+	printf("%-12s %10s %10s %8s\n", "case", "old ms", "new ms", "speedup");
+
+	for (int i = CaseForward ; i <= CasePutRemove ; i++) {
+		TestCase tcase = (TestCase)i;
+
+		if (tcase >= CasePutAdd) {
+			// source for the put cases is the forward result
+			AudioCursor::BlockTransfer = false;
+			runCase(pool, CaseForward, src, oldOutput, NULL);
+			memcpy(newOutput, oldOutput, AUDIO_FRAMES * 2 * sizeof(float));
+		}
+
+		AudioCursor::BlockTransfer = false;
+		double oldTime = runCase(pool, tcase, src, oldOutput, dest);
+		float* oldResult = oldOutput;
+		if (tcase >= CasePutAdd) {
+			oldResult = new float[AUDIO_FRAMES * 2];
+			memset(oldResult, 0, AUDIO_FRAMES * 2 * sizeof(float));
+			dest->get(oldResult, dest->getFrames(), 0);
+		}
+
+		AudioCursor::BlockTransfer = true;
+		double newTime = runCase(pool, tcase, src, newOutput, dest);
+		float* newResult = newOutput;
+		if (tcase >= CasePutAdd) {
+			newResult = new float[AUDIO_FRAMES * 2];
+			memset(newResult, 0, AUDIO_FRAMES * 2 * sizeof(float));
+			// read back with the old path so we're only testing put
+			AudioCursor::BlockTransfer = false;
+			dest->get(newResult, dest->getFrames(), 0);
+			AudioCursor::BlockTransfer = true;
+		}
+
+		compare(tcase, oldResult, newResult);
+
+		printf("%-12s %10.2f %10.2f %7.2fx\n", CaseNames[tcase],
+			   oldTime, newTime,
+			   (newTime > 0.0) ? oldTime / newTime : 0.0);
+
+		if (oldResult != oldOutput)
+		  delete oldResult;
+		if (newResult != newOutput)
+		  delete newResult;
+	}
+
+	delete oldOutput;
+	delete newOutput;
+	delete src;
+	delete dest;
+
+	checkSharing(pool);
+	checkSource(pool);
+	checkCompressed(pool);
+
+	delete pool;
+
+	if (Failures > 0)
+	  printf("%d failures\n", Failures);
+
+	return (Failures > 0) ? 1 : 0;
+}
+
+/****************************************************************************/
+/****************************************************************************/
+/****************************************************************************/
@@ -7,14 +7,18 @@
  * 
  * Tests for the expression parser and evaluator.
  *
+ * Every evaluation test is run both as a node tree and compiled
+ * to an ExProgram, the results must be the same.
+ *
  */
 
 #include <stdio.h>
 #include <memory.h>
 #include <string.h>
 
-#include "util.h"
-#include "vbuf.h"
+#include "Util.h"
+#include "Vbuf.h"
+#include "Thread.h"
 
 #include "Expr.h"
 
@@ -126,6 +130,34 @@ Test EvalTests[] = {
     {"1 2 3", "[i(1),i(2),i(3)]"},
     {"(1 (2 3))", "[i(1),[i(2),i(3)]]"},
     {"((1 2) (3 4) (5 6))", "[[i(1),i(2)],[i(3),i(4)],[i(5),i(6)]]"},
+	{"1.5 + 2", "f(3.500000)"},
+	{"2 + 1.5", "f(3.500000)"},
+	{"10 - 2 - 3", "i(5)"},
+	{"7.0 / 2", "f(3.500000)"},
+	{"7 / 0", "i(0)"},
+	{"7 % 0", "i(0)"},
+	{"2 > 1", "b(true)"},
+	{"\"10\" > 9", "b(true)"},
+	{"1 >= 2", "b(false)"},
+	{"1 <= 1", "b(true)"},
+	{"1 < 2", "b(true)"},
+	{"i != 42", "b(false)"},
+	{"s == \"a value\"", "b(true)"},
+	{"b && i == 42 && s", "b(false)"},
+	{"x || i", "b(true)"},
+	{"!b", "b(false)"},
+	{"-i", "i(-42)"},
+	{"int(f)", "i(123)"},
+	{"float(i)", "f(42.000000)"},
+	{"string(i)", "s(42)"},
+	{"string(f)", "s(123.000000)"},
+	{"rand(3,3)", "i(3)"},
+	{"abs(i - 50)", "i(8)"},
+	{"\"a string longer than the inline buffer\"", 
+	 "s(a string longer than the inline buffer)"},
+	{"int(\"     00000000000000000000000042\")", "i(42)"},
+	{"l", "s(a runtime string that is never interned)"},
+	{"i, s, (1 2)", "[i(42),s(a value),[i(1),i(2)]]"},
 	{NULL, NULL}
 };
 
@@ -156,6 +188,8 @@ class TestResolver : public ExResolver {
 			  value->setBool(true);
 			else if (!strcmp(name, "s"))
 			  value->setString("a value");
+			else if (!strcmp(name, "l"))
+			  value->setString("a runtime string that is never interned");
 			else
 			  value->setString(NULL);
 		}
@@ -182,6 +216,8 @@ class TestContext : public ExContext {
 };
 	
 
+int Errors = 0;
+
 void parse(const char* source, const char* expected)
 {
 	printf("Parsing: %s\n", source);
@@ -228,15 +264,85 @@ void eval(const char* source, const char* expected)
 		printf("Evaluated: %s\n", res);
 
 		if (expected != NULL) {
-			if (res == NULL || strcmp(res, expected))
-			  printf("!!!ERROR: expected %s\n", expected);
+			if (res == NULL || strcmp(res, expected)) {
+				printf("!!!ERROR: expected %s\n", expected);
+				Errors++;
+			}
+		}
+
+		// the program takes ownership of a second tree
+		ExProgram* program = new ExProgram(p->parse(source));
+		Vbuf* pbuf = new Vbuf();
+		program->toString(pbuf);
+		printf("Compiled: %s\n", pbuf->getString());
+
+		ExValue pv;
+		program->eval(context, &pv);
+		pbuf->clear();
+		pv.toString(pbuf);
+		const char* pres = pbuf->getString();
+		if (res == NULL || pres == NULL || strcmp(res, pres)) {
+			printf("!!!ERROR: compiled result %s\n", pres);
+			Errors++;
 		}
 
+		delete pbuf;
+		delete program;
 		delete buf;
 		delete context;
 	}
 }
 
+/**
+ * Strings made while evaluating are copied into the value, there
+ * can be any number of them without filling ExStrings.
+ */
+void runtimeStrings()
+{
+	char buffer[EX_MAX_STRING];
+	int bad = 0;
+	for (int i = 0 ; i < 10000 ; i++) {
+		ExValue v;
+		sprintf(buffer, "runtime string %d longer than the interned ones", i);
+		v.setString(buffer);
+		v.addString(" and then some");
+		strcat(buffer, " and then some");
+		if (strcmp(v.getString(), buffer))
+		  bad++;
+	}
+	if (bad > 0) {
+		printf("!!!ERROR: %d runtime strings changed\n", bad);
+		Errors++;
+	}
+}
+
+/**
+ * Time a typical script condition as a tree and as a program.
+ */
+void bench(const char* source)
+{
+	const int runs = 1000000;
+	ExParser* p = new ExParser();
+	ExContext* context = new TestContext();
+	ExProgram* program = new ExProgram(p->parse(source));
+
+	printf("%s\n", source);
+	for (int pass = 0 ; pass < 2 ; pass++) {
+		ExProgram::Compiled = (pass == 1);
+		long long start = GetClockTicks();
+		for (int i = 0 ; i < runs ; i++)
+		  program->evalToBool(context);
+		double usec = ClockTicksToMicros(GetClockTicks() - start);
+		printf("%-8s %8.1f ns\n", (pass == 1) ? "compiled" : "tree",
+			   (usec * 1000.0) / runs);
+	}
+	ExProgram::Compiled = true;
+
+	delete program;
+	delete context;
+	delete p;
+}
+
 void parse(Test* tests)
 {
     printf("-------- Parsing ------------------------------\n");
@@ -258,12 +364,19 @@ void eval(Test* tests)
 int main(int argc, char** argv)
 {
 	if (argc == 1) {
-	  printf("expr test | parse | eval | <expression>\n");
+	  printf("expr test | bench | parse | eval | <expression>\n");
 	}
 	else if (!strcmp(argv[1], "test")) {
         parse(ParseTests);
         eval(EvalTests);
+		runtimeStrings();
+		if (Errors > 0)
+		  printf("%d evaluation errors\n", Errors);
     }
+	else if (!strcmp(argv[1], "bench")) {
+		bench("mode == reset && track == 2 && autoRecord == false");
+		bench("i + 1 > 40 && s != x");
+	}
 	else if (!strcmp(argv[1], "unitparse")) {
         parse(UnitParseTests);
     }
@@ -280,7 +393,7 @@ int main(int argc, char** argv)
 		delete buf;
 	}
 
-	return 0;
+	return (Errors > 0) ? 1 : 0;
 }
 
 /****************************************************************************/
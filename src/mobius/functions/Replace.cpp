@@ -47,7 +47,7 @@
 
 #include "Action.h"
 #include "Event.h"
-#include "Eventmanager.h"
+#include "EventManager.h"
 #include "Function.h"
 #include "Layer.h"
 #include "Loop.h"
@@ -27,6 +27,7 @@
 #include "EventManager.h"
 #include "Function.h"
 #include "Layer.h"
+#include "LayerCompressor.h"
 #include "Loop.h"
 #include "Mobius.h"
 #include "Mode.h"
@@ -873,6 +874,12 @@ PRIVATE void WindowFunction::installSegments(Segment* segments)
     // handle this like undo, possible resize
     Synchronizer* sync = mLoop->getSynchronizer();
     sync->loopResize(mLoop, false);
+
+    // the window layer object is reused when it moves so Loop won't
+    // see a new play layer, load what the segments reach into now
+    LayerCompressor* compressor = mLoop->getMobius()->getLayerCompressor();
+    if (compressor != NULL)
+      compressor->check(mLayer, mNewFrame);
 }
 
 /**
@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2010 Jeffrey S. Larson  <jeff@circularlabs.com>
+ * All rights reserved.
+ * See the LICENSE file for the full copyright and license declaration.
+ *
+ * ---------------------------------------------------------------------
+ *
+ * Regression test and microbenchmark for the OutputStream mixer.
+ *
+ * Each case runs the same sequence of level and pan changes through
+ * two OutputStreams, one with OutputStream::BlockMix off to get the
+ * original per-sample results and timings, then one with it on.
+ * The mixed output and the peak level must match within TOLERANCE.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <string.h>
+#include <math.h>
+
+#include "Util.h"
+#include "Thread.h"
+#include "Trace.h"
+
+#include "AudioInterface.h"
+#include "Audio.h"
+#include "Stream.h"
+
+/**
+ * The usual interrupt block size.
+ */
+#define BLOCK_FRAMES 256
+
+/**
+ * Blocks in each case, about six seconds.
+ */
+#define BLOCKS 1000
+
+/**
+ * Largest difference allowed in any sample.  The kernels do the
+ * same operations in the same order so this should be exact
+ * unless the compiler fuses a multiply and add.
+ */
+#define TOLERANCE 1.0e-6f
+
+typedef enum {
+
+	CaseUnity,
+	CaseLevel,
+	CasePan,
+	CaseRamp,
+	CaseMono,
+	CaseMonoPan
+
+} TestCase;
+
+const char* CaseNames[] = {
+	"unity", "level", "pan", "ramp", "mono", "mono pan"
+};
+
+int Failures = 0;
+
+/**
+ * Apply the level and pan changes for a case before a block.
+ */
+void prepare(OutputStream* out, TestCase tcase, int block)
+{
+	if (block == 0) {
+		if (tcase == CaseMono || tcase == CaseMonoPan)
+		  out->setMono(true);
+		if (tcase == CaseLevel || tcase == CaseMono)
+		  out->setTargetLevel(90);
+		else if (tcase == CasePan)
+		  out->setPan(32);
+		else if (tcase == CaseMonoPan)
+		  out->setPan(100);
+	}
+	else if (tcase == CaseRamp && (block % 4) == 0) {
+		// keep something ramping most of the time
+		int step = (block / 4) % 4;
+		if (step == 0)
+		  out->setTargetLevel(60);
+		else if (step == 1)
+		  out->setPan(20);
+		else if (step == 2)
+		  out->setTargetLevel(127);
+		else
+		  out->setPan(64);
+	}
+}
+
+/**
+ * Run one case, leaving the mix of every block in output.
+ * Returns the elapsed milliseconds spent mixing.
+ */
+double runCase(AudioPool* pool, TestCase tcase, bool blockMix,
+			   float* input, float* output, float* peaks)
+{
+	InputStream* in = new InputStream(NULL, CD_SAMPLE_RATE);
+	OutputStream* out = new OutputStream(in, pool);
+	long long ticks = 0;
+
+	OutputStream::BlockMix = blockMix;
+
+	for (int b = 0 ; b < BLOCKS ; b++) {
+		float* dest = &output[b * BLOCK_FRAMES * 2];
+		float* src = &input[b * BLOCK_FRAMES * 2];
+
+		prepare(out, tcase, b);
+
+		// the interrupt buffer already has other tracks in it
+		for (int i = 0 ; i < BLOCK_FRAMES * 2 ; i++)
+		  dest[i] = 0.125f;
+
+		out->setOutputBuffer(NULL, dest, BLOCK_FRAMES);
+
+		long long start = GetClockTicks();
+		out->adjustLevel(src, BLOCK_FRAMES);
+		ticks += GetClockTicks() - start;
+
+		peaks[b] = out->getMaxSample();
+	}
+
+	OutputStream::BlockMix = true;
+
+	delete out;
+	delete in;
+
+	return ClockTicksToMicros(ticks) / 1000.0;
+}
+
+void compare(TestCase tcase, float* expected, float* actual,
+			 float* expectedPeaks, float* actualPeaks)
+{
+	float worst = 0.0f;
+	long worstIndex = 0;
+
+	for (long i = 0 ; i < BLOCKS * BLOCK_FRAMES * 2 ; i++) {
+		float diff = (float)fabs(expected[i] - actual[i]);
+		if (diff > worst) {
+			worst = diff;
+			worstIndex = i;
+		}
+	}
+
+	if (worst > TOLERANCE) {
+		printf("FAIL: %s differs at sample %ld: %f %f\n",
+			   CaseNames[tcase], worstIndex,
+			   expected[worstIndex], actual[worstIndex]);
+		Failures++;
+	}
+
+	for (int b = 0 ; b < BLOCKS ; b++) {
+		if (fabs(expectedPeaks[b] - actualPeaks[b]) > TOLERANCE) {
+			printf("FAIL: %s peak differs in block %d: %f %f\n",
+				   CaseNames[tcase], b, expectedPeaks[b], actualPeaks[b]);
+			Failures++;
+			break;
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	AudioPool* pool = new AudioPool();
+	long samples = BLOCKS * BLOCK_FRAMES * 2;
+
+	float* input = new float[samples];
+	float* oldOutput = new float[samples];
+	float* newOutput = new float[samples];
+	float* oldPeaks = new float[BLOCKS];
+	float* newPeaks = new float[BLOCKS];
+
+	srand(42);
+	for (long i = 0 ; i < samples ; i++)
+	  input[i] = ((float)(rand() % 2000) / 1000.0f) - 1.0f;
+
+	printf("%-12s %10s %10s %8s\n", "case", "old ms", "new ms", "speedup");
+
+	for (int i = CaseUnity ; i <= CaseMonoPan ; i++) {
+		TestCase tcase = (TestCase)i;
+
+		double oldTime = runCase(pool, tcase, false, input, oldOutput, oldPeaks);
+		double newTime = runCase(pool, tcase, true, input, newOutput, newPeaks);
+
+		compare(tcase, oldOutput, newOutput, oldPeaks, newPeaks);
+
+		printf("%-12s %10.2f %10.2f %7.2fx\n", CaseNames[tcase],
+			   oldTime, newTime,
+			   (newTime > 0.0) ? oldTime / newTime : 0.0);
+	}
+
+	delete input;
+	delete oldOutput;
+	delete newOutput;
+	delete oldPeaks;
+	delete newPeaks;
+	delete pool;
+
+	if (Failures > 0)
+	  printf("%d failures\n", Failures);
+
+	return (Failures > 0) ? 1 : 0;
+}
+
+/****************************************************************************/
+/****************************************************************************/
+/****************************************************************************/
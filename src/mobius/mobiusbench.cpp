@@ -0,0 +1,348 @@
+/*
+ * Copyright (c) 2010 Jeffrey S. Larson  <jeff@circularlabs.com>
+ * All rights reserved.
+ * See the LICENSE file for the full copyright and license declaration.
+ *
+ * ---------------------------------------------------------------------
+ *
+ * Benchmarks for the Mobius core, run headless with OfflineEngine.
+ *
+ *   mobiusbench [-block <frames>] [-seconds <n>] [-config <dir>]
+ *               [-install <dir>] [-parallel <workers>] [scenario...]
+ *
+ * Each scenario is a fixed sequence of actions against a noise
+ * input.  For each one we report how many frames per second we
+ * can process, how much faster than real time that is, and
+ * percentiles of the time spent in each interrupt block.  Blocks
+ * that took longer than the time it takes a device to play them
+ * are counted as misses.
+ *
+ * The scenarios run one after another in the same Mobius with
+ * a GlobalReset in between.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Util.h"
+#include "Thread.h"
+#include "Trace.h"
+
+#include "OfflineEngine.h"
+
+/**
+ * Tracks configured for all scenarios.
+ */
+#define BENCH_TRACKS 8
+
+/**
+ * Maximum actions in one scenario.
+ */
+#define MAX_BENCH_ACTIONS 256
+
+typedef struct {
+
+    double seconds;
+    const char* function;
+    int track;
+
+    // when non-NULL function is a parameter name
+    const char* value;
+
+} BenchAction;
+
+typedef struct {
+
+    const char* name;
+    const char* description;
+    double seconds;
+    BenchAction actions[MAX_BENCH_ACTIONS];
+    int actionCount;
+
+} Scenario;
+
+Scenario Scenarios[4];
+int ScenarioCount = 0;
+
+/****************************************************************************
+ *                                                                          *
+ *                                 SCENARIOS                                *
+ *                                                                          *
+ ****************************************************************************/
+
+void add(Scenario* s, double seconds, const char* function, int track)
+{
+    if (s->actionCount < MAX_BENCH_ACTIONS) {
+        BenchAction* a = &s->actions[s->actionCount++];
+        a->seconds = seconds;
+        a->function = function;
+        a->track = track;
+        a->value = NULL;
+    }
+}
+
+void set(Scenario* s, double seconds, const char* param, const char* value,
+         int track)
+{
+    add(s, seconds, param, track);
+    s->actions[s->actionCount - 1].value = value;
+}
+
+Scenario* newScenario(const char* name, const char* desc, double seconds)
+{
+    Scenario* s = &Scenarios[ScenarioCount++];
+    memset(s, 0, sizeof(Scenario));
+    s->name = name;
+    s->description = desc;
+    s->seconds = seconds;
+    return s;
+}
+
+/**
+ * Actions must be added in time order.
+ */
+void buildScenarios(double seconds)
+{
+    Scenario* s;
+    int t;
+
+    // eight free running tracks all overdubbing
+    s = newScenario("overdub", "8 tracks overdubbing", seconds);
+    for (t = 1 ; t <= BENCH_TRACKS ; t++)
+      set(s, 0.0, "syncSource", "none", t);
+    for (t = 1 ; t <= BENCH_TRACKS ; t++)
+      add(s, 0.0, "Record", t);
+    // stagger the lengths so the loop boundaries don't line up
+    for (t = 1 ; t <= BENCH_TRACKS ; t++) {
+        double end = 1.0 + (t * 0.25);
+        add(s, end, "Record", t);
+        add(s, end, "Overdub", t);
+    }
+
+    // one track building up a long layer list then walking it back
+    s = newScenario("undo", "deep undo chain", seconds);
+    set(s, 0.0, "syncSource", "none", 1);
+    add(s, 0.0, "Record", 1);
+    add(s, 0.5, "Record", 1);
+    add(s, 0.5, "Overdub", 1);
+    for (int i = 0 ; i < 40 ; i++) {
+        double when = (seconds * 0.6) + (i * (seconds * 0.3) / 40.0);
+        add(s, when, (i < 30) ? "Undo" : "Redo", 1);
+    }
+
+    // rate and pitch shifting on four tracks
+    s = newScenario("shift", "speed and pitch shifting", seconds);
+    for (t = 1 ; t <= 4 ; t++)
+      set(s, 0.0, "syncSource", "none", t);
+    for (t = 1 ; t <= 4 ; t++)
+      add(s, 0.0, "Record", t);
+    for (t = 1 ; t <= 4 ; t++)
+      add(s, 2.0, "Record", t);
+    add(s, 2.5, "SpeedUp", 1);
+    add(s, 2.5, "Halfspeed", 2);
+    add(s, 2.5, "PitchUp", 3);
+    add(s, 2.5, "PitchDown", 4);
+    add(s, 2.5, "SpeedDown", 4);
+    for (t = 1 ; t <= 4 ; t++)
+      add(s, 3.0, "Overdub", t);
+
+    // tracks locked to the first one with track sync
+    s = newScenario("sync", "track sync with 8 tracks", seconds);
+    for (t = 1 ; t <= BENCH_TRACKS ; t++)
+      set(s, 0.0, "syncSource", (t == 1) ? "none" : "track", t);
+    add(s, 0.0, "Record", 1);
+    add(s, 2.0, "Record", 1);
+    for (t = 2 ; t <= BENCH_TRACKS ; t++)
+      add(s, 2.0 + (t * 0.1), "Record", t);
+    for (t = 2 ; t <= BENCH_TRACKS ; t++)
+      add(s, 6.0 + (t * 0.1), "Record", t);
+    for (t = 1 ; t <= BENCH_TRACKS ; t++)
+      add(s, 10.0, "Overdub", t);
+}
+
+/****************************************************************************
+ *                                                                          *
+ *                                   RUNNER                                 *
+ *                                                                          *
+ ****************************************************************************/
+
+int compareTicks(const void* a, const void* b)
+{
+    long long t1 = *(const long long*)a;
+    long long t2 = *(const long long*)b;
+    return (t1 < t2) ? -1 : ((t1 > t2) ? 1 : 0);
+}
+
+double percentile(long long* sorted, long count, double p)
+{
+    long index = (long)((count - 1) * p);
+    return ClockTicksToMicros(sorted[index]);
+}
+
+void runScenario(OfflineEngine* engine, Scenario* s)
+{
+    int rate = engine->getSampleRate();
+    long block = engine->getBlockFrames();
+    long blocks = (long)((s->seconds * rate) / block);
+    float* input = new float[block * 2];
+    float* output = new float[block * 2];
+    long long* ticks = new long long[blocks];
+    long long budget = (GetClockFrequency() * block) / rate;
+    long misses = 0;
+    int nextAction = 0;
+
+    // start clean, and let the reset happen before we time anything
+    engine->doFunction("GlobalReset", 0);
+    memset(input, 0, block * 2 * sizeof(float));
+    for (int i = 0 ; i < 4 ; i++)
+      engine->process(input, output);
+
+    srand(42);
+    long long start = GetClockTicks();
+
+    for (long b = 0 ; b < blocks ; b++) {
+        long long frame = (long long)b * block;
+
+        while (nextAction < s->actionCount &&
+               (long long)(s->actions[nextAction].seconds * rate) <
+               frame + block) {
+            BenchAction* a = &s->actions[nextAction++];
+            if (a->value != NULL)
+              engine->setParameter(a->function, a->value, a->track);
+            else
+              engine->doFunction(a->function, a->track);
+        }
+
+        // quiet noise, enough to keep the loops from being silent
+        for (long i = 0 ; i < block * 2 ; i++)
+          input[i] = ((float)(rand() % 2000) / 10000.0f) - 0.1f;
+
+        long long blockStart = GetClockTicks();
+        engine->process(input, output);
+        ticks[b] = GetClockTicks() - blockStart;
+        if (ticks[b] > budget)
+          misses++;
+    }
+
+    long long end = GetClockTicks();
+
+    qsort(ticks, blocks, sizeof(long long), compareTicks);
+
+    double elapsed = ClockTicksToMicros(end - start) / 1000000.0;
+    double frames = (double)blocks * block;
+    double fps = (elapsed > 0.0) ? frames / elapsed : 0.0;
+
+    printf("%-8s %-28s %12.0f %8.1fx %8.1f %8.1f %8.1f %8.1f %8.1f %6ld\n",
+           s->name, s->description, fps, fps / rate,
+           percentile(ticks, blocks, 0.50),
+           percentile(ticks, blocks, 0.90),
+           percentile(ticks, blocks, 0.99),
+           percentile(ticks, blocks, 0.999),
+           ClockTicksToMicros(ticks[blocks - 1]),
+           misses);
+    fflush(stdout);
+
+    delete input;
+    delete output;
+    delete ticks;
+}
+
+void usage()
+{
+    printf("usage: mobiusbench [-block <frames>] [-seconds <n>] [-config <dir>]\n");
+    printf("                   [-install <dir>] [-parallel <workers>] [scenario...]\n");
+    printf("scenarios:");
+    for (int i = 0 ; i < ScenarioCount ; i++)
+      printf(" %s", Scenarios[i].name);
+    printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char* config = "install/config";
+    const char* install = ".";
+    const char* selected[16];
+    int selectedCount = 0;
+    double seconds = 30.0;
+    long block = 256;
+    int parallel = -1;
+    int i;
+
+    // parse seconds first since it shapes the scenarios
+    for (i = 1 ; i < argc - 1 ; i++) {
+        if (!strcmp(argv[i], "-seconds"))
+          seconds = atof(argv[i + 1]);
+    }
+    if (seconds < 12.0)
+      seconds = 12.0;
+    buildScenarios(seconds);
+
+    for (i = 1 ; i < argc ; i++) {
+        const char* arg = argv[i];
+        if (arg[0] != '-') {
+            if (selectedCount < 16)
+              selected[selectedCount++] = arg;
+        }
+        else if (i + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        else {
+            const char* next = argv[++i];
+            if (!strcmp(arg, "-block"))
+              block = atol(next);
+            else if (!strcmp(arg, "-config"))
+              config = next;
+            else if (!strcmp(arg, "-install"))
+              install = next;
+            else if (!strcmp(arg, "-parallel"))
+              parallel = atoi(next);
+            else if (strcmp(arg, "-seconds")) {
+                usage();
+                return 1;
+            }
+        }
+    }
+
+    OfflineEngine* engine = new OfflineEngine();
+    engine->setConfigurationDirectory(config);
+    engine->setInstallationDirectory(install);
+    engine->setBlockFrames(block);
+    engine->setTracks(BENCH_TRACKS);
+    engine->setParallelTracks(parallel);
+
+    if (!engine->start()) {
+        printf("Unable to start Mobius\n");
+        return 1;
+    }
+
+    printf("Block %ld frames, %d Hz, budget %.1f usec, %.0f seconds per scenario\n",
+           engine->getBlockFrames(), engine->getSampleRate(),
+           (1000000.0 * engine->getBlockFrames()) / engine->getSampleRate(),
+           seconds);
+    printf("%-8s %-28s %12s %9s %8s %8s %8s %8s %8s %6s\n",
+           "name", "scenario", "frames/sec", "realtime",
+           "p50 us", "p90 us", "p99 us", "p99.9 us", "max us", "misses");
+
+    for (i = 0 ; i < ScenarioCount ; i++) {
+        Scenario* s = &Scenarios[i];
+        bool run = (selectedCount == 0);
+        for (int j = 0 ; j < selectedCount && !run ; j++)
+          run = StringEqualNoCase(selected[j], s->name);
+        if (run)
+          runScenario(engine, s);
+    }
+
+    engine->stop();
+    delete engine;
+
+    FlushTrace();
+
+    return 0;
+}
+
+/****************************************************************************/
+/****************************************************************************/
+/****************************************************************************/
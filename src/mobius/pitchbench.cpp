@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2010 Jeffrey S. Larson  <jeff@circularlabs.com>
+ * All rights reserved.
+ * See the LICENSE file for the full copyright and license declaration.
+ *
+ * ---------------------------------------------------------------------
+ *
+ * Benchmark for the SoundTouch pitch shifter.
+ *
+ *   pitchbench [-block <frames>] [-seconds <n>] [-seek <msec>]
+ *
+ * Runs noise through SoundTouch configured the way SoundTouchPlugin
+ * configures it, once for each pitch setting and each instruction set
+ * the CPU supports, and reports the average and 99th percentile time
+ * to process one interrupt block.  The last column uses the FFT overlap
+ * seek, which only pays off over the SIMD search with much longer seek
+ * windows than the plugin uses, -seek sets the window for all columns.
+ *
+ * The time-stretch search is where most of the time goes and
+ * everything it does is proportional to the seek window, so the
+ * cost changes little with the size of the shift.  Unison is still
+ * run through the stretcher, SoundTouch doesn't bypass it.
+ *
+ * We also report the largest difference between the output of each
+ * column and the plain C column.  The overlap position is chosen by
+ * comparing sums that are added in a different order so an
+ * occasional sequence may join at a different place, small
+ * differences are expected.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "Util.h"
+#include "Thread.h"
+#include "Trace.h"
+
+#include "SoundTouch.h"
+#include "cpu_detect.h"
+using namespace soundtouch;
+
+#define SAMPLE_RATE 44100
+
+/**
+ * Instruction sets we can force with disableExtensions.
+ */
+typedef enum {
+
+    ModeC,
+    ModeSSE,
+    ModeAVX,
+    ModeFFT
+
+} BenchMode;
+
+#define MODES 4
+
+const char* ModeNames[] = {
+    "c", "sse", "avx", "fft"
+};
+
+int Pitches[] = {
+    -12, -7, -5, -2, 0, 2, 5, 7, 12
+};
+
+#define PITCHES 9
+
+int compareTicks(const void* a, const void* b)
+{
+    long long t1 = *(const long long*)a;
+    long long t2 = *(const long long*)b;
+    return (t1 < t2) ? -1 : ((t1 > t2) ? 1 : 0);
+}
+
+/**
+ * Mask for disableExtensions that leaves the mode's instruction
+ * set as the best one available.  FFT uses whatever is best.
+ */
+uint getDisableMask(BenchMode mode)
+{
+    uint mask = 0;
+    if (mode == ModeC)
+      mask = 0xffffffff;
+    else if (mode == ModeSSE)
+      mask = SUPPORT_AVX;
+    return mask;
+}
+
+/**
+ * Run one pitch through one mode, leaving the output in output.
+ * Returns the average block time in microseconds and the 99th
+ * percentile in p99.
+ */
+double run(BenchMode mode, int pitch, int seek, float* input, float* output,
+           long block, long blocks, double* p99)
+{
+    long long* ticks = new long long[blocks];
+    long long total = 0;
+
+    // newInstance checks the CPU when the SoundTouch is constructed
+    disableExtensions(getDisableMask(mode));
+    SoundTouch* st = new SoundTouch();
+    disableExtensions(0);
+
+    st->setSampleRate(SAMPLE_RATE);
+    st->setChannels(2);
+    st->setSetting(SETTING_USE_AA_FILTER, 1);
+    st->setSetting(SETTING_SEQUENCE_MS, 82);
+    st->setSetting(SETTING_SEEKWINDOW_MS, seek);
+    st->setSetting(SETTING_OVERLAP_MS, 12);
+    if (mode == ModeFFT)
+      st->setSetting(SETTING_USE_FFTSEEK, 1);
+    st->setPitchSemiTones(pitch);
+
+    memset(output, 0, blocks * block * 2 * sizeof(float));
+
+    for (long b = 0 ; b < blocks ; b++) {
+        float* src = &input[b * block * 2];
+        float* dest = &output[b * block * 2];
+
+        long long start = GetClockTicks();
+        st->putSamples(src, block);
+        st->receiveSamples(dest, block);
+        ticks[b] = GetClockTicks() - start;
+        total += ticks[b];
+    }
+
+    delete st;
+
+    qsort(ticks, blocks, sizeof(long long), compareTicks);
+    *p99 = ClockTicksToMicros(ticks[(long)((blocks - 1) * 0.99)]);
+    delete ticks;
+
+    return ClockTicksToMicros(total) / (double)blocks;
+}
+
+float maxDifference(float* a, float* b, long samples)
+{
+    float max = 0.0f;
+    for (long i = 0 ; i < samples ; i++) {
+        float diff = (float)fabs(a[i] - b[i]);
+        if (diff > max)
+          max = diff;
+    }
+    return max;
+}
+
+void usage()
+{
+    printf("usage: pitchbench [-block <frames>] [-seconds <n>] [-seek <msec>]\n");
+}
+
+int main(int argc, char *argv[])
+{
+    long block = 256;
+    double seconds = 10.0;
+    int seek = 14;
+    bool modes[MODES];
+    int i, m;
+
+    for (i = 1 ; i < argc ; i++) {
+        const char* arg = argv[i];
+        if (i + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        const char* next = argv[++i];
+        if (!strcmp(arg, "-block"))
+          block = atol(next);
+        else if (!strcmp(arg, "-seconds"))
+          seconds = atof(next);
+        else if (!strcmp(arg, "-seek"))
+          seek = atoi(next);
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    uint extensions = detectCPUextensions();
+    modes[ModeC] = true;
+    modes[ModeSSE] = ((extensions & SUPPORT_SSE) != 0);
+    modes[ModeAVX] = ((extensions & SUPPORT_AVX) != 0);
+    modes[ModeFFT] = true;
+
+    long blocks = (long)((seconds * SAMPLE_RATE) / block);
+    long samples = blocks * block * 2;
+    float* input = new float[samples];
+    float* reference = new float[samples];
+    float* output = new float[samples];
+
+    srand(42);
+    for (long s = 0 ; s < samples ; s++)
+      input[s] = ((float)(rand() % 2000) / 1000.0f) - 1.0f;
+
+    printf("Block %ld frames, %d Hz, budget %.1f usec, seek window %d msec\n",
+           block, SAMPLE_RATE, (1000000.0 * block) / SAMPLE_RATE, seek);
+    printf("Average/p99 usec per block, max difference from c\n");
+    printf("%6s", "pitch");
+    for (m = 0 ; m < MODES ; m++) {
+        if (modes[m])
+          printf(" %24s", ModeNames[m]);
+    }
+    printf("\n");
+
+    for (i = 0 ; i < PITCHES ; i++) {
+        printf("%6d", Pitches[i]);
+        for (m = 0 ; m < MODES ; m++) {
+            if (modes[m]) {
+                double p99;
+                float* dest = (m == ModeC) ? reference : output;
+                double avg = run((BenchMode)m, Pitches[i], seek, input, dest,
+                                 block, blocks, &p99);
+                if (m == ModeC)
+                  printf(" %7.1f %7.1f %8s", avg, p99, "");
+                else
+                  printf(" %7.1f %7.1f %8.1e", avg, p99,
+                         maxDifference(reference, output, samples));
+                fflush(stdout);
+            }
+        }
+        printf("\n");
+    }
+
+    delete input;
+    delete reference;
+    delete output;
+
+    return 0;
+}
+
+/****************************************************************************/
+/****************************************************************************/
+/****************************************************************************/
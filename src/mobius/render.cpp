@@ -0,0 +1,338 @@
+/*
+ * Copyright (c) 2010 Jeffrey S. Larson  <jeff@circularlabs.com>
+ * All rights reserved.
+ * See the LICENSE file for the full copyright and license declaration.
+ *
+ * ---------------------------------------------------------------------
+ *
+ * Offline renderer.  Runs Mobius headless as fast as possible,
+ * feeding it a wave file (or silence) and writing the output to
+ * another wave file.  Functions, parameters, and scripts are
+ * triggered at times given in an action file.
+ *
+ *   render [options] <output.wav>
+ *
+ *   -in <file>        input wave file, silence after it runs out
+ *   -seconds <n>      length of the render, default is the length
+ *                     of the input or 10 seconds
+ *   -block <frames>   interrupt block size, default 256
+ *   -rate <rate>      44100 or 48000
+ *   -tracks <n>       override the track count in mobius.xml
+ *   -config <dir>     directory containing mobius.xml,
+ *                     default install/config
+ *   -install <dir>    directory containing the message catalog,
+ *                     default is the current directory
+ *   -script <file>    load a .mos script, may be repeated
+ *   -actions <file>   action file, see below
+ *   -run <name>       function or script to run at time zero
+ *   -trace <level>    trace print level, default 1
+ *
+ * Action files have one action per line, blank lines and lines
+ * starting with # are ignored:
+ *
+ *   <seconds> <function> [track] [down|up]
+ *   <seconds> set <parameter> <value> [track]
+ *
+ * Tracks start from 1, zero or missing means the active track.
+ * Functions are a simple press unless down or up is given, down
+ * starts a sustain or long press and up ends it.
+ * Scripts are called by name like functions.  Actions at the same
+ * time happen in file order at the start of the block containing
+ * that time, so timing is quantized to the block size.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Util.h"
+#include "Thread.h"
+#include "Trace.h"
+#include "WaveFile.h"
+
+#include "OfflineEngine.h"
+
+/**
+ * Maximum number of actions in the action file.
+ */
+#define MAX_ACTIONS 1024
+
+#define MAX_ACTION_ARG 128
+
+typedef struct {
+
+    long long frame;
+    bool parameter;
+    bool sustain;
+    bool down;
+    int track;
+    char name[MAX_ACTION_ARG];
+    char value[MAX_ACTION_ARG];
+
+} RenderAction;
+
+RenderAction Actions[MAX_ACTIONS];
+int ActionCount = 0;
+
+void usage()
+{
+    printf("usage: render [-in <file>] [-seconds <n>] [-block <frames>]\n");
+    printf("              [-rate <rate>] [-tracks <n>] [-config <dir>]\n");
+    printf("              [-install <dir>] [-script <file>]...\n");
+    printf("              [-actions <file>] [-run <name>] [-trace <level>]\n");
+    printf("              <output.wav>\n");
+}
+
+/**
+ * Read the action file.  Actions are expected to be in time order,
+ * we don't sort.
+ */
+bool readActions(const char* file, int rate)
+{
+    char line[1024];
+    char time[MAX_ACTION_ARG];
+    char arg1[MAX_ACTION_ARG];
+    char arg2[MAX_ACTION_ARG];
+    char arg3[MAX_ACTION_ARG];
+    char arg4[MAX_ACTION_ARG];
+    int lineno = 0;
+
+    FILE* fp = fopen(file, "r");
+    if (fp == NULL) {
+        printf("Unable to open action file %s\n", file);
+        return false;
+    }
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        lineno++;
+        char* ptr = line;
+        while (*ptr == ' ' || *ptr == '\t') ptr++;
+        if (*ptr == '#' || *ptr == '\n' || *ptr == '\r' || *ptr == 0)
+          continue;
+
+        if (ActionCount >= MAX_ACTIONS) {
+            printf("Too many actions in %s\n", file);
+            break;
+        }
+
+        strcpy(arg2, "");
+        strcpy(arg3, "");
+        strcpy(arg4, "");
+        int fields = sscanf(ptr, "%127s %127s %127s %127s %127s",
+                            time, arg1, arg2, arg3, arg4);
+        if (fields < 2) {
+            printf("%s:%d: malformed action\n", file, lineno);
+            continue;
+        }
+
+        RenderAction* a = &Actions[ActionCount++];
+        memset(a, 0, sizeof(RenderAction));
+        a->frame = (long long)(atof(time) * rate);
+
+        if (StringEqualNoCase(arg1, "set")) {
+            if (fields < 4) {
+                printf("%s:%d: set needs a parameter and value\n",
+                       file, lineno);
+                ActionCount--;
+                continue;
+            }
+            a->parameter = true;
+            CopyString(arg2, a->name, sizeof(a->name));
+            CopyString(arg3, a->value, sizeof(a->value));
+            a->track = atoi(arg4);
+        }
+        else {
+            CopyString(arg1, a->name, sizeof(a->name));
+            a->track = atoi(arg2);
+            a->down = StringEqualNoCase(arg3, "down");
+            a->sustain = (a->down || StringEqualNoCase(arg3, "up"));
+        }
+    }
+
+    fclose(fp);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    const char* infile = NULL;
+    const char* outfile = NULL;
+    const char* actionfile = NULL;
+    const char* run = NULL;
+    const char* config = "install/config";
+    const char* install = ".";
+    double seconds = 0.0;
+    long block = 256;
+    int rate = 44100;
+    int tracks = 0;
+    int status = 0;
+    int i;
+
+    OfflineEngine* engine = new OfflineEngine();
+
+    for (i = 1 ; i < argc ; i++) {
+        const char* arg = argv[i];
+        const char* next = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (arg[0] != '-')
+          outfile = arg;
+        else if (next == NULL) {
+            usage();
+            return 1;
+        }
+        else {
+            i++;
+            if (!strcmp(arg, "-in"))
+              infile = next;
+            else if (!strcmp(arg, "-seconds"))
+              seconds = atof(next);
+            else if (!strcmp(arg, "-block"))
+              block = atol(next);
+            else if (!strcmp(arg, "-rate"))
+              rate = atoi(next);
+            else if (!strcmp(arg, "-tracks"))
+              tracks = atoi(next);
+            else if (!strcmp(arg, "-config"))
+              config = next;
+            else if (!strcmp(arg, "-install"))
+              install = next;
+            else if (!strcmp(arg, "-script"))
+              engine->addScript(next);
+            else if (!strcmp(arg, "-actions"))
+              actionfile = next;
+            else if (!strcmp(arg, "-run"))
+              run = next;
+            else if (!strcmp(arg, "-trace"))
+              engine->setTraceLevel(atoi(next));
+            else {
+                usage();
+                return 1;
+            }
+        }
+    }
+
+    if (outfile == NULL) {
+        usage();
+        return 1;
+    }
+
+    engine->setConfigurationDirectory(config);
+    engine->setInstallationDirectory(install);
+    engine->setSampleRate(rate);
+    engine->setBlockFrames(block);
+    engine->setTracks(tracks);
+    rate = engine->getSampleRate();
+    block = engine->getBlockFrames();
+
+    // input, converted to interleaved stereo
+    float* input = NULL;
+    long inputFrames = 0;
+    if (infile != NULL) {
+        WaveFile* wav = new WaveFile();
+        int error = wav->read(infile);
+        if (error) {
+            wav->printError(error);
+            return 1;
+        }
+        int channels = wav->getChannels();
+        float* data = wav->getData();
+        inputFrames = wav->getFrames();
+        input = new float[inputFrames * 2];
+        for (long f = 0 ; f < inputFrames ; f++) {
+            input[f * 2] = data[f * channels];
+            input[(f * 2) + 1] = data[(f * channels) + (channels > 1 ? 1 : 0)];
+        }
+        delete wav;
+    }
+
+    if (seconds <= 0.0)
+      seconds = (inputFrames > 0) ? (double)inputFrames / rate : 10.0;
+
+    long long totalFrames = (long long)(seconds * rate);
+    long long blocks = (totalFrames + block - 1) / block;
+    totalFrames = blocks * block;
+
+    if (actionfile != NULL && !readActions(actionfile, rate))
+      return 1;
+
+    if (!engine->start()) {
+        printf("Unable to start Mobius\n");
+        return 1;
+    }
+
+    if (run != NULL)
+      engine->doFunction(run, 0);
+
+    WaveFile* out = new WaveFile();
+    out->setFile(outfile);
+    out->setChannels(2);
+    out->setSampleRate(rate);
+    out->setFrames((long)totalFrames);
+    int error = out->writeStart();
+    if (error) {
+        out->printError(error);
+        return 1;
+    }
+
+    float* inblock = new float[block * 2];
+    float* outblock = new float[block * 2];
+    int nextAction = 0;
+
+    long long start = GetClockTicks();
+
+    for (long long b = 0 ; b < blocks ; b++) {
+        long long frame = b * block;
+
+        // actions that fall within this block
+        while (nextAction < ActionCount &&
+               Actions[nextAction].frame < frame + block) {
+            RenderAction* a = &Actions[nextAction++];
+            if (a->parameter)
+              engine->setParameter(a->name, a->value, a->track);
+            else if (a->sustain)
+              engine->doFunction(a->name, a->track, a->down);
+            else
+              engine->doFunction(a->name, a->track);
+        }
+
+        for (long f = 0 ; f < block ; f++) {
+            long long src = frame + f;
+            if (src < inputFrames) {
+                inblock[f * 2] = input[src * 2];
+                inblock[(f * 2) + 1] = input[(src * 2) + 1];
+            }
+            else {
+                inblock[f * 2] = 0.0f;
+                inblock[(f * 2) + 1] = 0.0f;
+            }
+        }
+
+        engine->process(inblock, outblock);
+        out->write(outblock, block);
+    }
+
+    long long end = GetClockTicks();
+
+    out->writeFinish();
+    delete out;
+
+    double elapsed = ClockTicksToMicros(end - start) / 1000000.0;
+    printf("Rendered %.2f seconds in %.2f seconds (%.1fx real time)\n",
+           (double)totalFrames / rate, elapsed,
+           (elapsed > 0.0) ? ((double)totalFrames / rate) / elapsed : 0.0);
+
+    engine->stop();
+    delete engine;
+
+    delete input;
+    delete inblock;
+    delete outblock;
+
+    FlushTrace();
+
+    return status;
+}
+
+/****************************************************************************/
+/****************************************************************************/
+/****************************************************************************/
@@ -0,0 +1,314 @@
+/*
+ * Copyright (c) 2010 Jeffrey S. Larson  <jeff@circularlabs.com>
+ * All rights reserved.
+ * See the LICENSE file for the full copyright and license declaration.
+ *
+ * ---------------------------------------------------------------------
+ *
+ * Benchmark for the Resampler.
+ *
+ *   resamplebench [-block <frames>] [-seconds <n>]
+ *
+ * Plays noise through a Resampler the way OutputStream does, asking
+ * for one interrupt block of output at a time, once for each quality
+ * and a range of speed shifts.  Reports the average and 99th percentile
+ * time to produce one block.  The last row sweeps the speed up an
+ * octave and back with a new speed every block, the way a pitch bend
+ * does.
+ *
+ * The last column for each quality is the level of an 18K tone after
+ * resampling, relative to the input.  At the speeds where the shifted
+ * tone lands above Nyquist anything that comes out is aliasing and
+ * should be as low as possible, at the others it should be close to 0dB.
+ * Linear interpolation has a high frequency droop so expect a few dB
+ * of loss there even when slowing down.
+ *
+ * Finally each quality switches between normal speed and a shift
+ * every few blocks with a ramp as input, so each output sample is the
+ * position in the source it came from.  The sinc filters delay the
+ * ramp but it must not jump back or ahead when the speed changes.
+ * The exit status is 1 if it does.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "Util.h"
+#include "Thread.h"
+#include "Trace.h"
+
+#include "Resampler.h"
+
+#define SAMPLE_RATE 44100
+#define TONE 18000.0
+#define TWO_PI (6.283185307179586)
+
+const char* QualityNames[] = {
+    "linear", "sinc8", "sinc32"
+};
+
+int Steps[] = {
+    -24, -12, -7, -1, 1, 7, 12, 24
+};
+
+#define STEPS 8
+
+/**
+ * Blocks in one sweep of the bend row.
+ */
+#define BEND_BLOCKS 200
+
+/**
+ * Blocks at each speed in the transition check, and the shift.
+ */
+#define TRANSITION_BLOCKS 20
+#define TRANSITION_STEP 7
+
+/**
+ * Largest change from one output frame to the next in the transition
+ * check, beyond the speed.  The speed changes drop the remainder,
+ * which can skip a frame or two, but the filter delay is 31 frames.
+ */
+#define TRANSITION_TOLERANCE 3.0
+
+int compareTicks(const void* a, const void* b)
+{
+    long long t1 = *(const long long*)a;
+    long long t2 = *(const long long*)b;
+    return (t1 < t2) ? -1 : ((t1 > t2) ? 1 : 0);
+}
+
+/**
+ * Resample input to fill blocks of output at one speed and quality.
+ * The input must be long enough for the highest speed.
+ * If bend is true the step is ignored and the speed changes
+ * every block.  Returns the average block time in microseconds and
+ * the 99th percentile in p99.
+ */
+double run(int quality, int step, bool bend, float* input, float* output,
+           long block, long blocks, double* p99)
+{
+    long long* ticks = new long long[blocks];
+    long long total = 0;
+    long consumed = 0;
+
+    Resampler* r = new Resampler(false);
+    r->setQuality(quality);
+    r->setSpeedSemitone(step);
+
+    for (long b = 0 ; b < blocks ; b++) {
+        float* dest = &output[b * block * 2];
+
+        if (bend) {
+            long pos = b % BEND_BLOCKS;
+            if (pos > BEND_BLOCKS / 2)
+              pos = BEND_BLOCKS - pos;
+            r->setSpeed((float)pow(2.0, pos / (BEND_BLOCKS / 2.0)));
+        }
+
+        long long start = GetClockTicks();
+        long remainder = r->addRemainder(dest, block);
+        long needed = block - remainder;
+        if (needed > 0) {
+            long frames = r->scaleOutputFrames(needed);
+            r->resample(&input[consumed * 2], frames,
+                        &dest[remainder * 2], needed);
+            consumed += frames;
+        }
+        ticks[b] = GetClockTicks() - start;
+        total += ticks[b];
+    }
+
+    delete r;
+
+    qsort(ticks, blocks, sizeof(long long), compareTicks);
+    *p99 = ClockTicksToMicros(ticks[(long)((blocks - 1) * 0.99)]);
+    delete ticks;
+
+    return ClockTicksToMicros(total) / (double)blocks;
+}
+
+/**
+ * Alternate between normal speed and a shift with a ramp as input.
+ * Returns the largest difference between the step from one output
+ * frame to the next and the speed it was made at.
+ */
+double transitions(int quality, long block)
+{
+    long blocks = TRANSITION_BLOCKS * 8;
+    long inFrames = (blocks * block * 2) + (block * 8);
+    float* ramp = new float[inFrames * 2];
+    float* output = new float[blocks * block * 2];
+    float* speeds = new float[blocks * block];
+    float shift = (float)pow(SEMITONE_FACTOR, TRANSITION_STEP);
+    long consumed = 0;
+    long b;
+
+    for (long f = 0 ; f < inFrames ; f++) {
+        ramp[f * 2] = (float)f;
+        ramp[(f * 2) + 1] = (float)f;
+    }
+
+    Resampler* r = new Resampler(false);
+    r->setQuality(quality);
+
+    for (b = 0 ; b < blocks ; b++) {
+        float* dest = &output[b * block * 2];
+        float speed = ((b / TRANSITION_BLOCKS) % 2) ? shift : 1.0f;
+        r->setSpeed(speed);
+        for (long f = 0 ; f < block ; f++)
+          speeds[(b * block) + f] = speed;
+
+        // what OutputStream does, it only resamples at normal
+        // speed when the Resampler has a delay
+        if (speed == 1.0f && r->getDelay() == 0) {
+            memcpy(dest, &ramp[consumed * 2], block * 2 * sizeof(float));
+            consumed += block;
+        }
+        else {
+            long remainder = r->addRemainder(dest, block);
+            long needed = block - remainder;
+            if (needed > 0) {
+                long frames = r->scaleOutputFrames(needed);
+                r->resample(&ramp[consumed * 2], frames,
+                            &dest[remainder * 2], needed);
+                consumed += frames;
+            }
+        }
+    }
+
+    // start after the history has filled
+    double worst = 0.0;
+    for (long f = block * 2 ; f < blocks * block ; f++) {
+        double step = output[f * 2] - output[(f - 1) * 2];
+        double error = fabs(step - speeds[f]);
+        if (error > worst)
+          worst = error;
+    }
+
+    delete r;
+    delete ramp;
+    delete output;
+    delete speeds;
+
+    return worst;
+}
+
+double rms(float* samples, long count)
+{
+    double sum = 0.0;
+    for (long i = 0 ; i < count ; i++)
+      sum += samples[i] * samples[i];
+    return sqrt(sum / count);
+}
+
+void usage()
+{
+    printf("usage: resamplebench [-block <frames>] [-seconds <n>]\n");
+}
+
+int main(int argc, char *argv[])
+{
+    long block = 256;
+    double seconds = 10.0;
+    int i, q;
+
+    for (i = 1 ; i < argc ; i++) {
+        const char* arg = argv[i];
+        if (i + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        const char* next = argv[++i];
+        if (!strcmp(arg, "-block"))
+          block = atol(next);
+        else if (!strcmp(arg, "-seconds"))
+          seconds = atof(next);
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    // enough input for two octaves up with a few blocks to spare
+    long blocks = (long)((seconds * SAMPLE_RATE) / block);
+    long outSamples = blocks * block * 2;
+    long inSamples = (outSamples * 4) + (block * 8);
+    float* noise = new float[inSamples];
+    float* tone = new float[inSamples];
+    float* output = new float[outSamples];
+
+    srand(42);
+    double magic = (TWO_PI * TONE) / SAMPLE_RATE;
+    for (long s = 0 ; s < inSamples ; s += 2) {
+        noise[s] = ((float)(rand() % 2000) / 1000.0f) - 1.0f;
+        noise[s + 1] = ((float)(rand() % 2000) / 1000.0f) - 1.0f;
+        tone[s] = (float)(0.5 * sin(magic * (s / 2)));
+        tone[s + 1] = tone[s];
+    }
+    double toneLevel = rms(tone, outSamples);
+
+    // skip the first second so the filter history has filled
+    long settle = SAMPLE_RATE * 2;
+    if (settle > outSamples / 2)
+      settle = outSamples / 2;
+
+    printf("Block %ld frames, %d Hz, budget %.1f usec\n",
+           block, SAMPLE_RATE, (1000000.0 * block) / SAMPLE_RATE);
+    printf("Average/p99 usec per block, %dHz tone level in dB\n", (int)TONE);
+    printf("%6s %6s", "step", "speed");
+    for (q = 0 ; q < RESAMPLER_QUALITIES ; q++)
+      printf(" %23s", QualityNames[q]);
+    printf("\n");
+
+    for (i = 0 ; i <= STEPS ; i++) {
+        bool bend = (i == STEPS);
+        int step = (bend) ? 0 : Steps[i];
+        float speed = (float)pow(SEMITONE_FACTOR, step);
+        bool aliased = (!bend && TONE * speed > SAMPLE_RATE / 2);
+
+        if (bend)
+          printf("%6s %6s", "bend", "1-2");
+        else
+          printf("%6d %6.3f", step, speed);
+        for (q = 0 ; q < RESAMPLER_QUALITIES ; q++) {
+            double p99, ignore;
+            double avg = run(q, step, bend, noise, output, block, blocks, &p99);
+
+            run(q, step, bend, tone, output, block, blocks, &ignore);
+            double level = rms(&output[settle], outSamples - settle);
+            double db = (level > 0.0) ? 20.0 * log10(level / toneLevel) : -999.0;
+
+            printf(" %6.1f %6.1f %7.1f%c", avg, p99, db, (aliased ? '*' : ' '));
+            fflush(stdout);
+        }
+        printf("\n");
+    }
+
+    printf("* the shifted tone is above Nyquist, output is aliasing\n");
+
+    int failures = 0;
+    printf("Largest jump when shifting %d semitones and back:", TRANSITION_STEP);
+    for (q = 0 ; q < RESAMPLER_QUALITIES ; q++) {
+        double jump = transitions(q, block);
+        printf(" %s %.2f", QualityNames[q], jump);
+        if (jump > TRANSITION_TOLERANCE)
+          failures++;
+    }
+    printf("\n");
+    if (failures > 0)
+      printf("FAIL: the ramp jumped at a speed change\n");
+
+    delete noise;
+    delete tone;
+    delete output;
+
+    return (failures > 0) ? 1 : 0;
+}
+
+/****************************************************************************/
+/****************************************************************************/
+/****************************************************************************/
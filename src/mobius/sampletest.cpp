@@ -0,0 +1,306 @@
+/*
+ * Copyright (c) 2010 Jeffrey S. Larson  <jeff@circularlabs.com>
+ * All rights reserved.
+ * See the LICENSE file for the full copyright and license declaration.
+ *
+ * ---------------------------------------------------------------------
+ *
+ * Test for SampleCache.
+ *
+ *   sampletest [-dir <dir>]
+ *
+ * Writes a few sample files to the directory and loads them as the
+ * SamplePacks would.  Loading the same files again must reuse
+ * the decoded audio, a file changed on disk must be decoded again
+ * while the players that have the old one keep it, and files must
+ * be pruned once the last reference is released.
+ *
+ * The files are bigger than the AudioPool's allocation ring, the
+ * SampleWorkers must read them without taking anything from it.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <utime.h>
+
+#include "Util.h"
+#include "Thread.h"
+#include "Trace.h"
+
+#include "Audio.h"
+#include "MobiusConfig.h"
+#include "ObjectPool.h"
+#include "Sample.h"
+
+/**
+ * Number of different files, one more Sample uses the first again.
+ */
+#define TEST_FILES 3
+
+/**
+ * Frames in each file, together they need more buffers than
+ * the allocation ring holds.
+ */
+#define TEST_FRAMES (1024 * 64 * 6 + 500)
+
+int Failures = 0;
+
+/****************************************************************************
+ *                                                                          *
+ *                                   FILES                                  *
+ *                                                                          *
+ ****************************************************************************/
+
+void check(bool condition, const char* message)
+{
+    if (!condition) {
+        printf("FAIL: %s\n", message);
+        Failures++;
+    }
+}
+
+void getFileName(int i, char* name)
+{
+    sprintf(name, "sampletest%d.wav", i + 1);
+}
+
+/**
+ * Write a file of noise, none of the buffers are silent so
+ * every one of them is allocated when it is read.
+ */
+void writeFile(AudioPool* pool, const char* dir, int i, long frames)
+{
+    char name[128];
+    char path[1024];
+
+    getFileName(i, name);
+    MergePaths(dir, name, path, sizeof(path));
+
+    float* samples = new float[frames * 2];
+    for (long j = 0 ; j < frames * 2 ; j++)
+      samples[j] = ((float)(rand() % 2000) / 10000.0f) - 0.1f;
+
+    Audio* audio = pool->newAudio();
+    audio->append(samples, frames);
+    if (audio->write(path))
+      printf("Unable to write %s\n", path);
+    delete audio;
+    delete samples;
+}
+
+/**
+ * Move the modification time without changing the size.
+ */
+void touchFile(const char* dir, int i)
+{
+    char name[128];
+    char path[1024];
+    struct stat sb;
+
+    getFileName(i, name);
+    MergePaths(dir, name, path, sizeof(path));
+
+    if (stat(path, &sb) == 0) {
+        struct utimbuf times;
+        times.actime = sb.st_atime;
+        times.modtime = sb.st_mtime + 10;
+        utime(path, &times);
+    }
+}
+
+Samples* makeSamples()
+{
+    Samples* samples = new Samples();
+    char name[128];
+
+    for (int i = 0 ; i < TEST_FILES ; i++) {
+        getFileName(i, name);
+        samples->add(new Sample(name));
+    }
+
+    // the same file twice is read once
+    getFileName(0, name);
+    samples->add(new Sample(name));
+
+    return samples;
+}
+
+void release(SampleFile** files)
+{
+    for (int i = 0 ; i <= TEST_FILES ; i++) {
+        if (files[i] != NULL)
+          files[i]->release();
+    }
+}
+
+/**
+ * Refill the allocation ring after writing the files and start
+ * counting again.
+ */
+void resetPool(AudioPool* pool)
+{
+    ObjectPool* samples = pool->getSamplePool();
+    samples->maintain();
+    samples->resetStatistics();
+}
+
+/****************************************************************************
+ *                                                                          *
+ *                                    TEST                                  *
+ *                                                                          *
+ ****************************************************************************/
+
+void test(const char* dir)
+{
+    AudioPool* pool = new AudioPool();
+    pool->init(0);
+    ObjectPool* buffers = pool->getSamplePool();
+    SampleCache* cache = new SampleCache(pool);
+    Samples* samples = makeSamples();
+    SampleFile* first[TEST_FILES + 1];
+    SampleFile* second[TEST_FILES + 1];
+    SampleFile* third[TEST_FILES + 1];
+    SampleFile* fourth[TEST_FILES + 1];
+    char message[256];
+
+    srand(42);
+    for (int i = 0 ; i < TEST_FILES ; i++)
+      writeFile(pool, dir, i, TEST_FRAMES);
+    resetPool(pool);
+
+    // everything is new
+    int ring = buffers->getLowWater();
+    int direct = buffers->getDirect();
+    cache->acquire(dir, samples, first);
+    check(cache->getDecoded() == TEST_FILES, "files not decoded");
+    check(cache->getReused() == 0, "files reused before they were read");
+    check(first[0] == first[TEST_FILES], "same file decoded twice");
+    for (int i = 0 ; i < TEST_FILES ; i++) {
+        Audio* audio = first[i]->getAudio();
+        check(audio != NULL && audio->getFrames() == TEST_FRAMES,
+              "file not read");
+    }
+
+    // the workers left the ring alone
+    sprintf(message, "ring fell to %d of %d while reading",
+            buffers->getLowWater(), ring);
+    check(buffers->getLowWater() == ring, message);
+    check(buffers->getMisses() == 0, "ring missed while reading");
+    check(buffers->getDirect() - direct >= TEST_FILES * 7,
+          "buffers not allocated outside the ring");
+
+    // nothing changed, everything is reused
+    cache->acquire(dir, samples, second);
+    check(cache->getDecoded() == TEST_FILES, "unchanged files decoded");
+    check(cache->getReused() == TEST_FILES + 1, "unchanged files not reused");
+    for (int i = 0 ; i <= TEST_FILES ; i++)
+      check(second[i] == first[i], "unchanged file replaced");
+
+    // a new size is noticed, the old one is kept for the
+    // players that still have it
+    writeFile(pool, dir, 1, TEST_FRAMES / 2);
+    resetPool(pool);
+    check(first[1]->isModified(), "modified file not detected");
+    check(!first[0]->isModified(), "unmodified file detected");
+    cache->acquire(dir, samples, third);
+    check(cache->getDecoded() == TEST_FILES + 1, "modified file not decoded");
+    check(third[1] != first[1], "modified file reused");
+    check(third[0] == first[0] && third[2] == first[2],
+          "unchanged file replaced");
+    check(third[1]->getAudio()->getFrames() == TEST_FRAMES / 2,
+          "modified file not read");
+    check(first[1]->getAudio()->getFrames() == TEST_FRAMES,
+          "stale file changed while in use");
+    check(cache->getFileCount() == TEST_FILES + 1, "stale file not kept");
+
+    // so is a new time with the same size
+    touchFile(dir, 2);
+    check(third[2]->isModified(), "touched file not detected");
+    cache->acquire(dir, samples, fourth);
+    check(cache->getDecoded() == TEST_FILES + 2, "touched file not decoded");
+    check(fourth[2] != third[2], "touched file reused");
+    check(fourth[1] == third[1], "unchanged file replaced");
+
+    // nothing is pruned while it is referenced
+    cache->prune();
+    check(cache->getPruned() == 0, "referenced files pruned");
+
+    // the first two packs go, the stale second file goes with them
+    release(first);
+    release(second);
+    cache->prune();
+    sprintf(message, "%d files pruned after the first packs",
+            cache->getPruned());
+    check(cache->getPruned() == 1, message);
+    check(cache->getFileCount() == TEST_FILES + 1, "wrong files pruned");
+
+    // then the third, leaving the newest third file
+    release(third);
+    cache->prune();
+    check(cache->getPruned() == 2, "stale third file not pruned");
+    check(cache->getFileCount() == TEST_FILES, "wrong files pruned");
+
+    // and the last one
+    release(fourth);
+    cache->prune();
+    check(cache->getPruned() == 5, "files not pruned");
+    check(cache->getFileCount() == 0, "files left after pruning");
+    check(buffers->getInUse() == 0, "buffers not returned to the pool");
+
+    cache->dump();
+    pool->dump();
+
+    delete samples;
+    delete cache;
+    delete pool;
+}
+
+/****************************************************************************
+ *                                                                          *
+ *                                    MAIN                                  *
+ *                                                                          *
+ ****************************************************************************/
+
+void usage()
+{
+    printf("usage: sampletest [-dir <dir>]\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char* dir = "/tmp";
+
+    for (int i = 1 ; i < argc ; i++) {
+        const char* arg = argv[i];
+        if (i + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        const char* next = argv[++i];
+        if (!strcmp(arg, "-dir"))
+          dir = next;
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    test(dir);
+
+    FlushTrace();
+
+    if (Failures > 0)
+      printf("%d failures\n", Failures);
+    else
+      printf("All tests passed\n");
+
+    return (Failures > 0) ? 1 : 0;
+}
+
+/****************************************************************************/
+/****************************************************************************/
+/****************************************************************************/
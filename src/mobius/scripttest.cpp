@@ -0,0 +1,329 @@
+/*
+ * Copyright (c) 2010 Jeffrey S. Larson  <jeff@circularlabs.com>
+ * All rights reserved.
+ * See the LICENSE file for the full copyright and license declaration.
+ *
+ * ---------------------------------------------------------------------
+ *
+ * Regression test for script evaluation, run headless with OfflineEngine.
+ *
+ *   scripttest [-dir <scripts>] [-config <dir>] [-install <dir>]
+ *              [script...]
+ *
+ * Every .mos file in the directory is loaded and run twice, once with
+ * expressions evaluated as node trees and once compiled to ExPrograms.
+ * Each run starts from a GlobalReset with the variables cleared,
+ * records a loop in the first track, then presses, releases and
+ * presses the script again so sustain and multi click labels are
+ * reached.  The output audio, the state of every track and the
+ * variables must be the same both ways.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Util.h"
+#include "List.h"
+#include "Thread.h"
+#include "Trace.h"
+#include "XmlBuffer.h"
+
+#include "Expr.h"
+#include "Function.h"
+#include "Loop.h"
+#include "Mobius.h"
+#include "Mode.h"
+#include "Track.h"
+#include "UserVariable.h"
+
+#include "OfflineEngine.h"
+
+/**
+ * Tracks configured for the test, enough for the For statements
+ * to have something to iterate over.
+ */
+#define TEST_TRACKS 4
+
+/**
+ * Seconds in each run.
+ */
+#define TEST_SECONDS 8.0
+
+typedef struct {
+
+    // hash of the output samples
+    unsigned int audio;
+
+    // track and variable state at the end
+    char state[1024 * 8];
+
+    // time spent in the interrupt
+    double millis;
+
+} RunResult;
+
+int Failures = 0;
+
+/****************************************************************************
+ *                                                                          *
+ *                                   SCRIPTS                                *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * Derive the function name the way Script does, the !name
+ * directive or the leaf file name.
+ */
+void getScriptName(const char* path, char* name)
+{
+    GetLeafName(path, name, false);
+
+    char* src = ReadFile(path);
+    if (src != NULL) {
+        char* line = src;
+        while (line != NULL && *line != 0) {
+            char* next = strchr(line, '\n');
+            if (StartsWithNoCase(line, "!name ")) {
+                const char* start = line + 6;
+                int len = 0;
+                while (start[len] != 0 && start[len] != '\r' &&
+                       start[len] != '\n' && len < MAX_SCRIPT_NAME - 1) {
+                    name[len] = start[len];
+                    len++;
+                }
+                // trailing spaces aren't part of the name
+                while (len > 0 && name[len - 1] == ' ')
+                  len--;
+                name[len] = 0;
+                break;
+            }
+            line = (next != NULL) ? next + 1 : NULL;
+        }
+        delete src;
+    }
+}
+
+/****************************************************************************
+ *                                                                          *
+ *                                   RUNNER                                 *
+ *                                                                          *
+ ****************************************************************************/
+
+unsigned int hashSamples(unsigned int hash, float* samples, long count)
+{
+    unsigned char* bytes = (unsigned char*)samples;
+    long length = count * sizeof(float);
+    for (long i = 0 ; i < length ; i++)
+      hash = (hash ^ bytes[i]) * 16777619u;
+    return hash;
+}
+
+void resetVariables(Mobius* m)
+{
+    m->getVariables()->reset();
+    for (int i = 0 ; i < m->getTrackCount() ; i++)
+      m->getTrack(i)->getVariables()->reset();
+}
+
+void captureState(Mobius* m, char* state, int max)
+{
+    XmlBuffer* b = new XmlBuffer();
+
+    for (int i = 0 ; i < m->getTrackCount() ; i++) {
+        Track* t = m->getTrack(i);
+        Loop* l = t->getLoop();
+        char line[256];
+        sprintf(line, "track %d %s frames %ld frame %ld cycles %ld output %d feedback %d pan %d focus %d\n",
+                i + 1, t->getMode()->getName(), l->getFrames(), l->getFrame(),
+                l->getCycles(), t->getOutputLevel(), t->getFeedback(),
+                t->getPan(), (int)t->isFocusLock());
+        b->add(line);
+        t->getVariables()->toXml(b);
+    }
+    m->getVariables()->toXml(b);
+
+    CopyString(b->getString(), state, max);
+    delete b;
+}
+
+void runScript(OfflineEngine* engine, const char* name, RunResult* result)
+{
+    Mobius* m = engine->getMobius();
+    int rate = engine->getSampleRate();
+    long block = engine->getBlockFrames();
+    long blocks = (long)((TEST_SECONDS * rate) / block);
+    float* input = new float[block * 2];
+    float* output = new float[block * 2];
+    long long ticks = 0;
+
+    // start clean, let the reset happen before we begin
+    engine->doFunction("GlobalReset", 0);
+    memset(input, 0, block * 2 * sizeof(float));
+    for (int i = 0 ; i < 4 ; i++)
+      engine->process(input, output);
+    resetVariables(m);
+
+    // the same noise and the same rand() both times
+    srand(42);
+    result->audio = 2166136261u;
+
+    for (long b = 0 ; b < blocks ; b++) {
+        double start = (double)(b * block) / rate;
+        double end = (double)((b + 1) * block) / rate;
+
+        // a two second loop in the first track
+        if (start <= 0.0 && end > 0.0)
+          engine->doFunction("Record", 1);
+        if (start <= 2.0 && end > 2.0)
+          engine->doFunction("Record", 1);
+
+        // press long enough to sustain, then click again
+        if (start <= 2.5 && end > 2.5)
+          engine->doFunction(name, 1, true);
+        if (start <= 4.0 && end > 4.0)
+          engine->doFunction(name, 1, false);
+        if (start <= 4.2 && end > 4.2)
+          engine->doFunction(name, 1, true);
+        if (start <= 4.3 && end > 4.3)
+          engine->doFunction(name, 1, false);
+
+        for (long i = 0 ; i < block * 2 ; i++)
+          input[i] = ((float)(rand() % 2000) / 10000.0f) - 0.1f;
+
+        long long blockStart = GetClockTicks();
+        engine->process(input, output);
+        ticks += GetClockTicks() - blockStart;
+
+        result->audio = hashSamples(result->audio, output, block * 2);
+    }
+
+    captureState(m, result->state, sizeof(result->state));
+    result->millis = ClockTicksToMicros(ticks) / 1000.0;
+
+    delete input;
+    delete output;
+}
+
+void testScript(OfflineEngine* engine, const char* path)
+{
+    char name[MAX_SCRIPT_NAME];
+    RunResult tree;
+    RunResult compiled;
+
+    getScriptName(path, name);
+    if (engine->getMobius()->getFunction(name) == NULL) {
+        printf("FAIL: no function for %s\n", path);
+        Failures++;
+        return;
+    }
+
+    ExProgram::Compiled = false;
+    runScript(engine, name, &tree);
+    ExProgram::Compiled = true;
+    runScript(engine, name, &compiled);
+
+    bool same = true;
+    if (tree.audio != compiled.audio) {
+        printf("FAIL: %s output differs\n", name);
+        same = false;
+    }
+    if (strcmp(tree.state, compiled.state)) {
+        printf("FAIL: %s state differs\n", name);
+        printf("tree:\n%s\ncompiled:\n%s\n", tree.state, compiled.state);
+        same = false;
+    }
+    if (!same)
+      Failures++;
+
+    printf("%-28s %08x %10.2f %10.2f %s\n", name, compiled.audio,
+           tree.millis, compiled.millis, same ? "ok" : "FAIL");
+    fflush(stdout);
+}
+
+void usage()
+{
+    printf("usage: scripttest [-dir <scripts>] [-config <dir>] [-install <dir>]\n");
+    printf("                  [script...]\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char* dir = "scripts";
+    const char* config = "install/config";
+    const char* install = ".";
+    StringList* files = new StringList();
+    int i;
+
+    for (i = 1 ; i < argc ; i++) {
+        const char* arg = argv[i];
+        if (arg[0] != '-')
+          files->add(arg);
+        else if (i + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        else {
+            const char* next = argv[++i];
+            if (!strcmp(arg, "-dir"))
+              dir = next;
+            else if (!strcmp(arg, "-config"))
+              config = next;
+            else if (!strcmp(arg, "-install"))
+              install = next;
+            else {
+                usage();
+                return 1;
+            }
+        }
+    }
+
+    if (files->size() == 0) {
+        delete files;
+        files = GetDirectoryFiles(dir, ".mos");
+        if (files == NULL) {
+            printf("No scripts in %s\n", dir);
+            return 1;
+        }
+        files->sort();
+    }
+
+    // Random seeds itself the first time, get that out of the way
+    // so it doesn't happen in the middle of a run
+    Random(0, 0);
+
+    OfflineEngine* engine = new OfflineEngine();
+    engine->setConfigurationDirectory(config);
+    engine->setInstallationDirectory(install);
+    engine->setTracks(TEST_TRACKS);
+    engine->setParallelTracks(0);
+    engine->setTraceLevel(0);
+    for (i = 0 ; i < files->size() ; i++)
+      engine->addScript(files->getString(i));
+
+    if (!engine->start()) {
+        printf("Unable to start Mobius\n");
+        return 1;
+    }
+
+    printf("%-28s %8s %10s %10s\n", "script", "output", "tree ms", "compiled ms");
+
+    for (i = 0 ; i < files->size() ; i++)
+      testScript(engine, files->getString(i));
+
+    engine->stop();
+    delete engine;
+    delete files;
+
+    FlushTrace();
+
+    if (Failures > 0)
+      printf("%d failures\n", Failures);
+
+    return (Failures > 0) ? 1 : 0;
+}
+
+/****************************************************************************/
+/****************************************************************************/
+/****************************************************************************/
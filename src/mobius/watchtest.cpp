@@ -0,0 +1,402 @@
+/*
+ * Copyright (c) 2010 Jeffrey S. Larson  <jeff@circularlabs.com>
+ * All rights reserved.
+ * See the LICENSE file for the full copyright and license declaration.
+ *
+ * ---------------------------------------------------------------------
+ *
+ * Test for watch point dispatching.
+ *
+ *   watchtest [-config <dir>] [-install <dir>]
+ *
+ * The first part drives a Watchers and a WatchDispatcher directly,
+ * calling dispatch() ourselves rather than starting the thread so
+ * every step is repeatable.  It checks that repeated values are
+ * coalesced, that listeners only see the tracks they asked for,
+ * and that removed listeners are pruned from the arrays, never
+ * called again, and deleted with the Watchers.
+ *
+ * The second part registers listeners with a running Mobius through
+ * OfflineEngine and records a loop in the first track to see the
+ * loopStart events arrive from the dispatcher thread.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Util.h"
+#include "Thread.h"
+#include "Trace.h"
+
+#include "Mobius.h"
+#include "WatchPoint.h"
+
+#include "OfflineEngine.h"
+
+/**
+ * Most events we remember for one listener.
+ */
+#define MAX_TEST_EVENTS 64
+
+int Failures = 0;
+
+/**
+ * Listeners deleted by Watchers, to check that the removed
+ * ones are deleted with it.
+ */
+int Deleted = 0;
+
+/****************************************************************************
+ *                                                                          *
+ *                                  LISTENER                                *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * What a listener saw.  Kept outside the listener since Watchers
+ * owns the listener and deletes it.
+ */
+typedef struct {
+
+    int count;
+    int values[MAX_TEST_EVENTS];
+
+} Received;
+
+class TestListener : public WatchPointListener {
+
+  public:
+
+    TestListener(const char* point, int track, Received* received) {
+        mPoint = point;
+        mTrack = track;
+        mReceived = received;
+        memset(received, 0, sizeof(Received));
+    }
+
+    ~TestListener() {
+        Deleted++;
+    }
+
+    const char* getWatchPointName() {
+        return mPoint;
+    }
+
+    int getWatchPointTrack() {
+        return mTrack;
+    }
+
+    void watchPointEvent(int value) {
+        if (mReceived->count < MAX_TEST_EVENTS)
+          mReceived->values[mReceived->count] = value;
+        mReceived->count++;
+    }
+
+  private:
+
+    const char* mPoint;
+    int mTrack;
+    Received* mReceived;
+
+};
+
+/****************************************************************************
+ *                                                                          *
+ *                                   CHECKS                                 *
+ *                                                                          *
+ ****************************************************************************/
+
+void check(bool condition, const char* message)
+{
+    if (!condition) {
+        printf("FAIL: %s\n", message);
+        Failures++;
+    }
+}
+
+/**
+ * Check the events a listener has received since the last check.
+ */
+void expect(const char* name, Received* r, int count, int last)
+{
+    char message[256];
+
+    if (r->count != count) {
+        sprintf(message, "%s received %d events, expected %d",
+                name, r->count, count);
+        check(false, message);
+    }
+    else if (count > 0 && r->values[count - 1] != last) {
+        sprintf(message, "%s received %d, expected %d",
+                name, r->values[count - 1], last);
+        check(false, message);
+    }
+    r->count = 0;
+}
+
+int countListeners(Watchers* w, WatchPoint* wp)
+{
+    WatchListeners* listeners = w->getListeners(wp);
+    return (listeners != NULL) ? listeners->count : 0;
+}
+
+/****************************************************************************
+ *                                                                          *
+ *                                 DISPATCHER                               *
+ *                                                                          *
+ ****************************************************************************/
+
+void testDispatcher()
+{
+    Watchers* watchers = new Watchers();
+    WatchDispatcher* dispatcher = new WatchDispatcher(watchers);
+    Received all;
+    Received second;
+    Received starts;
+    Received removed;
+
+    printf("Dispatcher\n");
+
+    check(!watchers->isWatched(LoopLocationPoint),
+          "point watched with no listeners");
+
+    watchers->add(LoopLocationPoint,
+                  new TestListener("loopLocation", 0, &all));
+    watchers->add(LoopLocationPoint,
+                  new TestListener("loopLocation", 2, &second));
+    watchers->add(LoopStartPoint,
+                  new TestListener("loopStart", 0, &starts));
+    TestListener* doomed = new TestListener("loopStart", 1, &removed);
+    watchers->add(LoopStartPoint, doomed);
+
+    check(watchers->isWatched(LoopLocationPoint), "point not watched");
+    check(countListeners(watchers, LoopLocationPoint) == 2,
+          "loopLocation listeners not added");
+    check(countListeners(watchers, LoopStartPoint) == 2,
+          "loopStart listeners not added");
+
+    // several changes in one dispatch, only the last one is passed
+    dispatcher->add(LoopLocationPoint, 0, 5);
+    dispatcher->add(LoopLocationPoint, 0, 6);
+    dispatcher->add(LoopLocationPoint, 0, 7);
+    dispatcher->dispatch();
+    expect("coalesced", &all, 1, 7);
+    expect("other track", &second, 0, 0);
+
+    // the same continuous value again is not passed
+    dispatcher->add(LoopLocationPoint, 0, 7);
+    dispatcher->dispatch();
+    expect("unchanged", &all, 0, 0);
+
+    // a change back and forth within a dispatch is not passed
+    dispatcher->add(LoopLocationPoint, 0, 9);
+    dispatcher->add(LoopLocationPoint, 0, 7);
+    dispatcher->dispatch();
+    expect("restored", &all, 0, 0);
+
+    // tracks are coalesced separately, the scoped listener
+    // only sees its own
+    dispatcher->add(LoopLocationPoint, 0, 8);
+    dispatcher->add(LoopLocationPoint, 1, 3);
+    dispatcher->add(LoopLocationPoint, 2, 4);
+    dispatcher->dispatch();
+    expect("all tracks", &all, 3, 4);
+    expect("track 2", &second, 1, 3);
+
+    // the last value is remembered for each track
+    dispatcher->add(LoopLocationPoint, 1, 3);
+    dispatcher->add(LoopLocationPoint, 2, 5);
+    dispatcher->dispatch();
+    expect("all tracks unchanged", &all, 1, 5);
+    expect("track 2 unchanged", &second, 0, 0);
+
+    // momentary points are passed once per dispatch even
+    // with the same value
+    dispatcher->add(LoopStartPoint, 0, 1);
+    dispatcher->add(LoopStartPoint, 0, 1);
+    dispatcher->add(LoopStartPoint, 0, 1);
+    dispatcher->dispatch();
+    expect("momentary", &starts, 1, 1);
+    expect("momentary track 1", &removed, 1, 1);
+    dispatcher->add(LoopStartPoint, 0, 1);
+    dispatcher->dispatch();
+    expect("momentary again", &starts, 1, 1);
+    expect("momentary track 1 again", &removed, 1, 1);
+
+    // nothing queued, nothing passed
+    dispatcher->dispatch();
+    expect("idle", &starts, 0, 0);
+
+    // a removed listener isn't called, and is pruned the next
+    // time its point fires
+    doomed->remove();
+    check(countListeners(watchers, LoopStartPoint) == 2,
+          "listener pruned before dispatch");
+    dispatcher->add(LoopStartPoint, 0, 1);
+    dispatcher->dispatch();
+    expect("survivor", &starts, 1, 1);
+    expect("removed", &removed, 0, 0);
+    check(countListeners(watchers, LoopStartPoint) == 1,
+          "removed listener not pruned");
+    check(Deleted == 0, "removed listener deleted while in use");
+
+    // it stays gone, and the replaced array is reclaimed
+    dispatcher->add(LoopStartPoint, 0, 1);
+    dispatcher->dispatch();
+    expect("survivor again", &starts, 1, 1);
+    expect("removed again", &removed, 0, 0);
+
+    // removing the last listener leaves the point unwatched
+    WatchListeners* listeners = watchers->getListeners(LoopStartPoint);
+    listeners->listeners[0]->remove();
+    dispatcher->add(LoopStartPoint, 0, 1);
+    dispatcher->dispatch();
+    expect("none left", &starts, 0, 0);
+    check(!watchers->isWatched(LoopStartPoint),
+          "point still watched with no listeners");
+
+    dispatcher->dump();
+    delete dispatcher;
+
+    // the two pruned listeners and the two still registered
+    delete watchers;
+    check(Deleted == 4, "listeners not deleted with Watchers");
+}
+
+/****************************************************************************
+ *                                                                          *
+ *                                   MOBIUS                                 *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * Process audio in real time sized steps so the dispatcher
+ * thread gets to run between them.
+ */
+void play(OfflineEngine* engine, double seconds)
+{
+    int rate = engine->getSampleRate();
+    long block = engine->getBlockFrames();
+    long blocks = (long)((seconds * rate) / block);
+    float* input = new float[block * 2];
+    float* output = new float[block * 2];
+    long step = (long)((0.1 * rate) / block);
+
+    for (long b = 0 ; b < blocks ; b++) {
+        for (long i = 0 ; i < block * 2 ; i++)
+          input[i] = ((float)(rand() % 2000) / 10000.0f) - 0.1f;
+        engine->process(input, output);
+        if (step > 0 && (b % step) == 0)
+          SleepMillis(WATCH_DISPATCH_MILLIS * 2);
+    }
+
+    // and let the last changes through
+    SleepMillis(WATCH_DISPATCH_MILLIS * 5);
+
+    delete input;
+    delete output;
+}
+
+void testMobius(const char* config, const char* install)
+{
+    Received first;
+    Received second;
+
+    printf("Mobius\n");
+
+    OfflineEngine* engine = new OfflineEngine();
+    engine->setConfigurationDirectory(config);
+    engine->setInstallationDirectory(install);
+    engine->setTracks(2);
+
+    if (!engine->start()) {
+        printf("Unable to start Mobius\n");
+        Failures++;
+        return;
+    }
+
+    Mobius* m = engine->getMobius();
+    TestListener* listener = new TestListener("loopStart", 1, &first);
+    check(m->addWatcher(listener) == LoopStartPoint,
+          "loopStart not found");
+    check(m->addWatcher(new TestListener("loopStart", 2, &second)) ==
+          LoopStartPoint, "loopStart not found");
+
+    // start clean, and let the reset happen before we begin
+    srand(42);
+    engine->doFunction("GlobalReset", 0);
+    play(engine, 0.1);
+
+    engine->doFunction("Record", 1);
+    play(engine, 1.0);
+    engine->doFunction("Record", 1);
+    play(engine, 3.5);
+
+    // the loop came around at least three times
+    char message[256];
+    sprintf(message, "track 1 listener received %d loopStart events",
+            first.count);
+    check(first.count >= 3, message);
+    check(second.count == 0, "track 2 listener received track 1 events");
+
+    // once removed it hears nothing
+    listener->remove();
+    first.count = 0;
+    play(engine, 2.5);
+    check(first.count == 0, "removed listener called");
+
+    engine->stop();
+    delete engine;
+}
+
+/****************************************************************************
+ *                                                                          *
+ *                                    MAIN                                  *
+ *                                                                          *
+ ****************************************************************************/
+
+void usage()
+{
+    printf("usage: watchtest [-config <dir>] [-install <dir>]\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char* config = "install/config";
+    const char* install = ".";
+
+    for (int i = 1 ; i < argc ; i++) {
+        const char* arg = argv[i];
+        if (i + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        const char* next = argv[++i];
+        if (!strcmp(arg, "-config"))
+          config = next;
+        else if (!strcmp(arg, "-install"))
+          install = next;
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    testDispatcher();
+    testMobius(config, install);
+
+    FlushTrace();
+
+    if (Failures > 0)
+      printf("%d failures\n", Failures);
+    else
+      printf("All tests passed\n");
+
+    return (Failures > 0) ? 1 : 0;
+}
+
+/****************************************************************************/
+/****************************************************************************/
+/****************************************************************************/
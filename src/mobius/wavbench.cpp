@@ -0,0 +1,367 @@
+/*
+ * Copyright (c) 2010 Jeffrey S. Larson  <jeff@circularlabs.com>
+ * All rights reserved.
+ * See the LICENSE file for the full copyright and license declaration.
+ *
+ * ---------------------------------------------------------------------
+ *
+ * Benchmark for reading and writing Audio as wave files.
+ *
+ *   wavbench [-seconds <n>] [-dir <directory>]
+ *
+ * Builds an Audio of noise with every third buffer silent and
+ * compares the old way of moving it through WaveFile with the
+ * streaming one Audio now uses.
+ *
+ * The old read loads the whole data chunk into one array then appends
+ * a buffer's worth at a time into the Audio.  The old write gets one
+ * frame at a time from the Audio and writes it.  The new read decodes
+ * each buffer directly from the file, the new write hands WaveFile
+ * the buffers themselves.
+ *
+ * Reports MB/s of file data, best of several runs so the file cache
+ * is warm, and checks that both reads load the same samples with the
+ * same number of buffers.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "Util.h"
+#include "Thread.h"
+#include "Trace.h"
+#include "WaveFile.h"
+
+#include "Audio.h"
+
+#define SAMPLE_RATE 44100
+#define RUNS 3
+
+/**
+ * Must match the Audio buffer size, silent regions are laid out
+ * on these boundaries.
+ */
+#define BUFFER_FRAMES (1024 * 64)
+
+typedef struct {
+    const char* name;
+    int format;
+    int depth;
+    float tolerance;
+} BenchFormat;
+
+BenchFormat Formats[] = {
+    {"pcm16", WAV_FORMAT_PCM, 16, 1.0f / 16384.0f},
+    {"pcm24", WAV_FORMAT_PCM, 24, 1.0f / 4194304.0f},
+    {"pcm32", WAV_FORMAT_PCM, 32, 1.0f / 1048576.0f},
+    {"float", WAV_FORMAT_IEEE, 32, 0.0f},
+    {NULL, 0, 0, 0.0f}
+};
+
+bool Failed = false;
+
+void check(bool condition, const char* name, const char* msg)
+{
+    if (!condition) {
+        printf("FAIL: %s %s\n", name, msg);
+        Failed = true;
+    }
+}
+
+bool isEmpty(float* buffer, long samples)
+{
+    for (long i = 0 ; i < samples ; i++) {
+        if (buffer[i] != 0.0f)
+          return false;
+    }
+    return true;
+}
+
+/**
+ * Read the way Audio::read used to.
+ */
+int oldRead(Audio* a, const char* path)
+{
+    WaveFile* wav = new WaveFile();
+    int error = wav->read(path);
+    if (!error) {
+        AudioBuffer b;
+        a->reset();
+        a->setSampleRate(wav->getSampleRate());
+
+        float* data = wav->getData();
+        long frames = wav->getFrames();
+        b.channels = 2;
+
+        for (long frame = 0 ; frame < frames ; frame += BUFFER_FRAMES) {
+            b.buffer = &data[frame * 2];
+            b.frames = frames - frame;
+            if (b.frames > BUFFER_FRAMES)
+              b.frames = BUFFER_FRAMES;
+            if (isEmpty(b.buffer, b.frames * 2))
+              b.buffer = NULL;
+            a->append(&b);
+        }
+    }
+    delete wav;
+    return error;
+}
+
+/**
+ * Write the way Audio::write used to.
+ */
+int oldWrite(Audio* a, const char* path, int format)
+{
+    WaveFile* wav = new WaveFile();
+    wav->setChannels(2);
+    wav->setFrames(a->getFrames());
+    wav->setFormat(format);
+    wav->setFile(path);
+
+    int error = wav->writeStart();
+    if (!error) {
+        AudioBuffer b;
+        float buffer[2];
+        b.buffer = buffer;
+        b.frames = 1;
+        b.channels = 2;
+
+        long frames = a->getFrames();
+        for (long i = 0 ; i < frames ; i++) {
+            memset(buffer, 0, sizeof(buffer));
+            a->get(&b, i);
+            wav->write(buffer, 1);
+        }
+        error = wav->writeFinish();
+    }
+    delete wav;
+    return error;
+}
+
+/**
+ * Write the reference samples in a format Audio can't write.
+ */
+int writeSamples(float* samples, long frames, const char* path,
+                 BenchFormat* f)
+{
+    WaveFile* wav = new WaveFile();
+    wav->setChannels(2);
+    wav->setFrames(frames);
+    wav->setFormat(f->format);
+    wav->setSampleDepth(f->depth);
+    wav->setFile(path);
+
+    int error = wav->writeStart();
+    if (!error) {
+        wav->write(samples, frames);
+        error = wav->writeFinish();
+    }
+    delete wav;
+    return error;
+}
+
+long long fileSize(const char* path)
+{
+    long long size = 0;
+    FILE* fp = fopen(path, "rb");
+    if (fp != NULL) {
+        fseek(fp, 0, SEEK_END);
+        size = ftell(fp);
+        fclose(fp);
+    }
+    return size;
+}
+
+double megabytesPerSecond(long long bytes, long long ticks)
+{
+    double seconds = ClockTicksToMicros(ticks) / 1000000.0;
+    return (seconds > 0.0) ? (bytes / (1024.0 * 1024.0)) / seconds : 0.0;
+}
+
+/**
+ * Compare an Audio with the reference samples.
+ * Returns the largest sample difference.
+ */
+float compare(Audio* a, float* samples, long frames, float* block)
+{
+    float max = 0.0f;
+    for (long frame = 0 ; frame < frames ; frame += BUFFER_FRAMES) {
+        long count = frames - frame;
+        if (count > BUFFER_FRAMES)
+          count = BUFFER_FRAMES;
+        memset(block, 0, count * 2 * sizeof(float));
+        a->get(block, count, frame);
+        float* expected = &samples[frame * 2];
+        for (long i = 0 ; i < count * 2 ; i++) {
+            float diff = fabs(block[i] - expected[i]);
+            if (diff > max)
+              max = diff;
+        }
+    }
+    return max;
+}
+
+int bufferCount(Audio* a)
+{
+    int allocated, shared;
+    a->getBufferCounts(&allocated, &shared);
+    return allocated;
+}
+
+void usage()
+{
+    printf("usage: wavbench [-seconds <n>] [-dir <directory>]\n");
+}
+
+int main(int argc, char *argv[])
+{
+    double seconds = 60.0;
+    const char* dir = ".";
+    char path[1024];
+    int i, run;
+
+    for (i = 1 ; i < argc ; i++) {
+        const char* arg = argv[i];
+        if (i + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        const char* next = argv[++i];
+        if (!strcmp(arg, "-seconds"))
+          seconds = atof(next);
+        else if (!strcmp(arg, "-dir"))
+          dir = next;
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    // not a multiple of the buffer size so the last one is partial
+    long frames = (long)(seconds * SAMPLE_RATE) + 1234;
+    float* samples = new float[frames * 2];
+    float* block = new float[BUFFER_FRAMES * 2];
+    int total = 0;
+    int silent = 0;
+
+    srand(42);
+    for (long f = 0 ; f < frames ; f++) {
+        float* frame = &samples[f * 2];
+        if ((f / BUFFER_FRAMES) % 3 == 2) {
+            frame[0] = 0.0f;
+            frame[1] = 0.0f;
+        }
+        else {
+            frame[0] = ((float)(rand() % 2000) / 1000.0f) - 1.0f;
+            frame[1] = ((float)(rand() % 2000) / 1000.0f) - 1.0f;
+        }
+    }
+    for (long f = 0 ; f < frames ; f += BUFFER_FRAMES) {
+        total++;
+        if ((f / BUFFER_FRAMES) % 3 == 2)
+          silent++;
+    }
+
+    AudioPool* pool = new AudioPool();
+    Audio* src = pool->newAudio();
+    src->append(samples, frames);
+    Audio* oldAudio = pool->newAudio();
+    Audio* newAudio = pool->newAudio();
+
+    printf("%.1f seconds, %ld frames, %d silent buffers\n",
+           seconds, frames, silent);
+    printf("%-6s %-5s %10s %10s %8s %8s %10s\n",
+           "format", "op", "old MB/s", "new MB/s", "speedup",
+           "buffers", "max diff");
+
+    for (BenchFormat* f = Formats ; f->name != NULL ; f++) {
+        sprintf(path, "%s/wavbench-%s.wav", dir, f->name);
+
+        // Audio only writes 16 bit PCM and float
+        bool audioWrites = (f->format == WAV_FORMAT_IEEE || f->depth == 16);
+        long long oldTicks = 0;
+        long long newTicks = 0;
+
+        if (audioWrites) {
+            for (run = 0 ; run < RUNS ; run++) {
+                long long start = GetClockTicks();
+                oldWrite(src, path, f->format);
+                long long ticks = GetClockTicks() - start;
+                if (run == 0 || ticks < oldTicks)
+                  oldTicks = ticks;
+
+                start = GetClockTicks();
+                check(src->write(path, f->format) == 0, f->name, "write");
+                ticks = GetClockTicks() - start;
+                if (run == 0 || ticks < newTicks)
+                  newTicks = ticks;
+            }
+
+            long long bytes = fileSize(path);
+            double oldRate = megabytesPerSecond(bytes, oldTicks);
+            double newRate = megabytesPerSecond(bytes, newTicks);
+            printf("%-6s %-5s %10.1f %10.1f %7.1fx\n", f->name, "write",
+                   oldRate, newRate, (oldRate > 0.0) ? newRate / oldRate : 0.0);
+        }
+        else {
+            check(writeSamples(samples, frames, path, f) == 0, f->name,
+                  "write");
+        }
+
+        for (run = 0 ; run < RUNS ; run++) {
+            long long start = GetClockTicks();
+            check(oldRead(oldAudio, path) == 0, f->name, "old read");
+            long long ticks = GetClockTicks() - start;
+            if (run == 0 || ticks < oldTicks)
+              oldTicks = ticks;
+
+            start = GetClockTicks();
+            check(newAudio->read(path) == 0, f->name, "read");
+            ticks = GetClockTicks() - start;
+            if (run == 0 || ticks < newTicks)
+              newTicks = ticks;
+        }
+
+        long long bytes = fileSize(path);
+        double oldRate = megabytesPerSecond(bytes, oldTicks);
+        double newRate = megabytesPerSecond(bytes, newTicks);
+        int buffers = bufferCount(newAudio);
+        float diff = compare(newAudio, samples, frames, block);
+
+        printf("%-6s %-5s %10.1f %10.1f %7.1fx %8d %10.2g\n", f->name, "read",
+               oldRate, newRate, (oldRate > 0.0) ? newRate / oldRate : 0.0,
+               buffers, diff);
+
+        check(newAudio->getFrames() == frames, f->name, "frames");
+        check(oldAudio->getFrames() == frames, f->name, "old frames");
+        check(buffers == bufferCount(oldAudio), f->name, "buffer count");
+        check(buffers == total - silent, f->name, "sparse");
+        check(diff <= f->tolerance, f->name, "samples");
+        check(compare(oldAudio, samples, frames, block) <= f->tolerance,
+              f->name, "old samples");
+
+        remove(path);
+        fflush(stdout);
+    }
+
+    src->free();
+    oldAudio->free();
+    newAudio->free();
+    delete samples;
+    delete block;
+
+    if (Failed) {
+        printf("FAILED\n");
+        return 1;
+    }
+
+    printf("PASS\n");
+    return 0;
+}
+
+/****************************************************************************/
+/****************************************************************************/
+/****************************************************************************/
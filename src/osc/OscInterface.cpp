@@ -8,18 +8,31 @@
 
 #include <stdexcept>
 #include <iostream>
+#include <string.h>
 
 #include "oscpack/osc/OscPacketListener.h"
 #include "oscpack/osc/OscOutboundPacketStream.h"
 #include "oscpack/ip/UdpSocket.h"
 #include "oscpack/ip/PacketListener.h"
 
-#include "port.h"
-#include "util.h"
+#include "Port.h"
+#include "Util.h"
 #include "Trace.h"
 #include "Thread.h"
 #include "OscInterface.h"
 
+/**
+ * Size of the bundle header, "#bundle" and the time tag.
+ * Each message in the bundle is preceeded by a 4 byte size.
+ */
+#define OSC_BUNDLE_HEADER 16
+#define OSC_BUNDLE_ELEMENT 4
+
+/**
+ * Strings are null terminated and padded to a multiple of 4.
+ */
+#define OSC_PAD(n) (((n) + 3) & ~3)
+
 //////////////////////////////////////////////////////////////////////
 //
 // OscMessage
@@ -273,6 +286,7 @@ class OscpackDevice : public OscDevice
     // these are required by the OscDevice interface
     const char* getHost();
     int getPort();
+    OscStatistics* getStatistics();
 
   private:
 
@@ -280,6 +294,7 @@ class OscpackDevice : public OscDevice
     char* mHost;
     int mPort;
     UdpTransmitSocket* mSocket;
+    OscStatistics mStatistics;
 
 };
 
@@ -290,6 +305,7 @@ PUBLIC OscpackDevice::OscpackDevice(const char* host, int port,
     mHost = CopyString(host);
     mPort = port;
     mSocket = socket;
+    memset(&mStatistics, 0, sizeof(mStatistics));
 }
 
 PUBLIC OscpackDevice::~OscpackDevice()
@@ -331,6 +347,11 @@ PUBLIC UdpTransmitSocket* OscpackDevice::getSocket()
     return mSocket;
 }
 
+PUBLIC OscStatistics* OscpackDevice::getStatistics()
+{
+    return &mStatistics;
+}
+
 //////////////////////////////////////////////////////////////////////
 //
 // OscpackInterface
@@ -354,12 +375,16 @@ class OscpackInterface : public OscInterface
 
     OscDevice* registerDevice(const char* host, int port);
     void send(OscDevice* dev, OscMessage* m);
+    void send(OscDevice* dev, OscMessage** messages, int count);
 	void send(const char* host, int port, OscMessage* m);
+    void getStatistics(OscStatistics* stats);
 
   private:
    
     UdpTransmitSocket* openSocket(const char* host, int port);
-    void send(UdpTransmitSocket* socket, OscMessage* msg);
+    int send(UdpTransmitSocket* socket, OscMessage* msg);
+    int getSize(OscMessage* msg);
+    void addMessage(osc::OutboundPacketStream& p, OscMessage* msg);
 
 	OscThread* mThread;
 	OscListener* mListener;
@@ -518,7 +543,13 @@ PUBLIC void OscpackInterface::send(OscDevice* dev, OscMessage* msg)
 	if (dev != NULL && msg != NULL) {
 
         OscpackDevice* packdev = (OscpackDevice*)dev;
-        send(packdev->getSocket(), msg);
+        int size = send(packdev->getSocket(), msg);
+        if (size > 0) {
+            OscStatistics* stats = packdev->getStatistics();
+            stats->messages++;
+            stats->packets++;
+            stats->bytes += size;
+        }
 
 		// should we be allowed to take ownership?
         // NO! common for the caller to have stack allocated this
@@ -543,28 +574,144 @@ PUBLIC void OscpackInterface::send(const char* host, int port, OscMessage* msg)
 	}
 }
 
-PRIVATE void OscpackInterface::send(UdpTransmitSocket* socket, OscMessage* msg)
+/**
+ * Send a message in its own packet and return the size of the packet.
+ */
+PRIVATE int OscpackInterface::send(UdpTransmitSocket* socket, OscMessage* msg)
 {
+    int size = 0;
+
 	if (socket != NULL && msg != NULL) {
 
         char buffer[OSC_MAX_OUTPUT];
         osc::OutboundPacketStream p(buffer, OSC_MAX_OUTPUT);
     
-        // god I fucking hate C++
-        p << osc::BeginMessage(msg->getAddress());
-        for (int i = 0 ; i < msg->getNumArgs() ; i++) {
-            p << msg->getArg(i);
-        }
-        p << osc::EndMessage;
+        addMessage(p, msg);
+
+        socket->Send(p.Data(), p.Size());
+        size = (int)p.Size();
+	}
+
+    return size;
+}
+
+/**
+ * Add one message to a packet.
+ */
+PRIVATE void OscpackInterface::addMessage(osc::OutboundPacketStream& p, 
+                                          OscMessage* msg)
+{
+    // god I fucking hate C++
+    p << osc::BeginMessage(msg->getAddress());
+    for (int i = 0 ; i < msg->getNumArgs() ; i++) {
+        p << msg->getArg(i);
+    }
+    p << osc::EndMessage;
+
+    if (mTrace) {
+        printf("OSC sending: %s %f\n", msg->getAddress(), msg->getArg(0));
+        fflush(stdout);
+    }
+}
+
+/**
+ * Calculate the size of a message when it is encoded, the address,
+ * the type tags, and 4 bytes for each float argument.
+ */
+PRIVATE int OscpackInterface::getSize(OscMessage* msg)
+{
+    int nargs = msg->getNumArgs();
+    int size = OSC_PAD(strlen(msg->getAddress()) + 1);
+    // comma, one tag per argument, and the terminator
+    size += OSC_PAD(nargs + 2);
+    size += nargs * 4;
+    return size;
+}
 
+/**
+ * Send a batch of messages to a registered device.
+ * 
+ * Messages are added to a bundle until the next one would take it
+ * over OSC_MAX_BUNDLE, then the bundle is sent and another one
+ * started.  A message that would be alone in a bundle is sent by
+ * itself, there is no point in the extra 20 bytes.  The bundles have
+ * the "immediate" time tag, the receiver applies them when they arrive.
+ */
+PUBLIC void OscpackInterface::send(OscDevice* dev, OscMessage** messages,
+                                   int count)
+{
+	if (dev != NULL && messages != NULL) {
 
-        if (mTrace) {
-            printf("OSC sending: %s %f\n", msg->getAddress(), msg->getArg(0));
-            fflush(stdout);
+        OscpackDevice* packdev = (OscpackDevice*)dev;
+        UdpTransmitSocket* socket = packdev->getSocket();
+        OscStatistics* stats = packdev->getStatistics();
+        char buffer[OSC_MAX_BUNDLE];
+        int next = 0;
+
+        while (next < count) {
+
+            // find the messages that will fit
+            int size = OSC_BUNDLE_HEADER;
+            int last = next;
+            while (last < count) {
+                int msize = OSC_BUNDLE_ELEMENT + getSize(messages[last]);
+                if (last > next && size + msize > OSC_MAX_BUNDLE)
+                  break;
+                size += msize;
+                last++;
+            }
+
+            if (last - next == 1) {
+                size = send(socket, messages[next]);
+                if (size > 0) {
+                    stats->messages++;
+                    stats->packets++;
+                    stats->bytes += size;
+                }
+            }
+            else {
+                try {
+                    osc::OutboundPacketStream p(buffer, OSC_MAX_BUNDLE);
+                    p << osc::BeginBundleImmediate;
+                    for (int i = next ; i < last ; i++)
+                      addMessage(p, messages[i]);
+                    p << osc::EndBundle;
+
+                    socket->Send(p.Data(), p.Size());
+
+                    stats->messages += (last - next);
+                    stats->bundles++;
+                    stats->packets++;
+                    stats->bytes += p.Size();
+                }
+                catch (osc::Exception& e) {
+                    // should only happen if getSize is wrong
+                    Trace(1, "ERROR: OscInterface: unable to build bundle\n");
+                    // avoid a warning
+                    e = e;
+                }
+            }
+
+            next = last;
         }
+    }
+}
 
-        socket->Send(p.Data(), p.Size());
-	}
+/**
+ * Add up the statistics for all registered devices.
+ * Messages sent to unregistered devices aren't counted.
+ */
+PUBLIC void OscpackInterface::getStatistics(OscStatistics* stats)
+{
+    memset(stats, 0, sizeof(OscStatistics));
+
+    for (OscpackDevice* d = mDevices ; d != NULL ; d = d->getNext()) {
+        OscStatistics* ds = d->getStatistics();
+        stats->messages += ds->messages;
+        stats->bundles += ds->bundles;
+        stats->packets += ds->packets;
+        stats->bytes += ds->bytes;
+    }
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -18,6 +18,13 @@
 #define OSC_MAX_ARGS 4
 #define OSC_MAX_OUTPUT 1024
 
+/**
+ * The largest bundle we will send.  This keeps the datagram within
+ * an ethernet MTU of 1500 after the IP and UDP headers so it won't
+ * be fragmented.
+ */
+#define OSC_MAX_BUNDLE 1472
+
 /**
  * We're going to simplify the message structure by only allowing a fixed
  * number of float arguments.  Need to extend this eventually to at least
@@ -76,6 +83,20 @@ class OscListener {
 //
 //////////////////////////////////////////////////////////////////////
 
+/**
+ * Counters for what has been sent to a device.
+ * A packet is one UDP datagram holding either a bundle or a single
+ * message, bytes are the size of the packets.
+ */
+typedef struct {
+
+    long messages;
+    long bundles;
+    long packets;
+    long long bytes;
+
+} OscStatistics;
+
 /**
  * An object describing an OSC device that messages may be sent to.
  * These are created and owned by the OscInterface.
@@ -86,6 +107,7 @@ class OscDevice {
 	virtual ~OscDevice() {}
     virtual const char* getHost() = 0;
     virtual int getPort() = 0;
+    virtual OscStatistics* getStatistics() = 0;
 
 };
 
@@ -143,6 +165,17 @@ class OscInterface {
      */
     virtual void send(OscDevice* dev, OscMessage* m) = 0;
 
+    /**
+     * Send several messages to a registered device.  They are packed
+     * into as few bundles of OSC_MAX_BUNDLE bytes as they will fit.
+     */
+    virtual void send(OscDevice* dev, OscMessage** messages, int count) = 0;
+
+    /**
+     * Add up the statistics for all registered devices.
+     */
+    virtual void getStatistics(OscStatistics* stats) = 0;
+
 	/**
 	 * Send a message to an unregistered device.
 	 */
@@ -49,6 +49,11 @@ typedef unsigned long long uint64;
 
 
 
+// long is 64 bits on LP64 hosts, x86_64 was only defined by hand
+#if defined(__LP64__) && !defined(x86_64)
+#define x86_64
+#endif
+
 #ifdef x86_64
 
 typedef signed int int32;
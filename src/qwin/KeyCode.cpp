@@ -407,10 +407,11 @@ PUBLIC int GetKeyCode(const char* name)
 //
 //////////////////////////////////////////////////////////////////////
 
-#ifdef _WIN32
+#if defined(_WIN32) || defined(LINUX)
 
 /**
- * No translation necessary.
+ * No translation necessary.  There are no keyboard events on
+ * Linux, but bindings still need to link.
  */
 PUBLIC int TranslateKeyCode(int raw)
 {
@@ -9,6 +9,8 @@
  * 
  */
 
+#include <stdio.h>
+#include <string.h>
 #include <map>
 
 #include "Port.h"
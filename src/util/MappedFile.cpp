@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2010 Jeffrey S. Larson  <jeff@circularlabs.com>
+ * All rights reserved.
+ * See the LICENSE file for the full copyright and license declaration.
+ *
+ * ---------------------------------------------------------------------
+ *
+ * A read-only file mapped into memory.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
+#include "Util.h"
+#include "Trace.h"
+#include "MappedFile.h"
+
+/****************************************************************************
+ *                                                                          *
+ *                                MAPPED FILE                               *
+ *                                                                          *
+ ****************************************************************************/
+
+PUBLIC MappedFile::MappedFile()
+{
+	mData = NULL;
+	mSize = 0;
+#ifdef _WIN32
+	mFile = INVALID_HANDLE_VALUE;
+	mMapping = NULL;
+#else
+	mFile = -1;
+#endif
+}
+
+PUBLIC MappedFile::~MappedFile()
+{
+	close();
+}
+
+/**
+ * Map the entire file.  Returns false if the file could not be
+ * opened or is empty.
+ */
+PUBLIC bool MappedFile::open(const char* path)
+{
+	close();
+
+#ifdef _WIN32
+	// share delete so the file can be replaced while we have it mapped,
+	// see ProjectFile::replace
+	HANDLE file = CreateFile(path, GENERIC_READ, 
+							 FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+							 OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		Trace(1, "MappedFile: Unable to open %s\n", path);
+	}
+	else {
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+			Trace(1, "MappedFile: Empty file %s\n", path);
+			CloseHandle(file);
+		}
+		else {
+			HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY,
+											   0, 0, NULL);
+			void* data = NULL;
+			if (mapping != NULL)
+			  data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+
+			if (data == NULL) {
+				Trace(1, "MappedFile: Unable to map %s\n", path);
+				if (mapping != NULL)
+				  CloseHandle(mapping);
+				CloseHandle(file);
+			}
+			else {
+				mFile = file;
+				mMapping = mapping;
+				mData = (const char*)data;
+				mSize = size.QuadPart;
+			}
+		}
+	}
+#else
+	int file = ::open(path, O_RDONLY);
+	if (file < 0) {
+		Trace(1, "MappedFile: Unable to open %s\n", path);
+	}
+	else {
+		struct stat st;
+		if (fstat(file, &st) != 0 || st.st_size == 0) {
+			Trace(1, "MappedFile: Empty file %s\n", path);
+			::close(file);
+		}
+		else {
+			void* data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED,
+							  file, 0);
+			if (data == MAP_FAILED) {
+				Trace(1, "MappedFile: Unable to map %s\n", path);
+				::close(file);
+			}
+			else {
+				mFile = file;
+				mData = (const char*)data;
+				mSize = st.st_size;
+			}
+		}
+	}
+#endif
+
+	return (mData != NULL);
+}
+
+PUBLIC void MappedFile::close()
+{
+#ifdef _WIN32
+	if (mData != NULL)
+	  UnmapViewOfFile(mData);
+	if (mMapping != NULL)
+	  CloseHandle(mMapping);
+	if (mFile != INVALID_HANDLE_VALUE)
+	  CloseHandle(mFile);
+	mMapping = NULL;
+	mFile = INVALID_HANDLE_VALUE;
+#else
+	if (mData != NULL)
+	  munmap((void*)mData, mSize);
+	if (mFile >= 0)
+	  ::close(mFile);
+	mFile = -1;
+#endif
+
+	mData = NULL;
+	mSize = 0;
+}
+
+PUBLIC bool MappedFile::isOpen()
+{
+	return (mData != NULL);
+}
+
+PUBLIC const char* MappedFile::getData()
+{
+	return mData;
+}
+
+PUBLIC long long MappedFile::getSize()
+{
+	return mSize;
+}
+
+/**
+ * Ask the OS to start reading the file in the background so the
+ * first touch of a page is less likely to wait for the disk.
+ * This is only a hint, the pages belong to the file cache and may
+ * be dropped again under memory pressure.
+ */
+PUBLIC void MappedFile::prefetch()
+{
+#ifndef _WIN32
+	if (mData != NULL)
+	  madvise((void*)mData, mSize, MADV_WILLNEED);
+#endif
+}
+
+/****************************************************************************/
+/****************************************************************************/
+/****************************************************************************/
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2010 Jeffrey S. Larson  <jeff@circularlabs.com>
+ * All rights reserved.
+ * See the LICENSE file for the full copyright and license declaration.
+ *
+ * ---------------------------------------------------------------------
+ *
+ * A read-only file mapped into memory.
+ *
+ */
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+/****************************************************************************
+ *                                                                          *
+ *                                MAPPED FILE                               *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * Wrapper around the host-specific calls to map a file into memory.
+ * The file is mapped read-only in its entirety, pages are read from
+ * the disk by the OS the first time they are touched.
+ */
+class MappedFile {
+
+  public:
+
+	MappedFile();
+	~MappedFile();
+
+	bool open(const char* path);
+	void close();
+
+	bool isOpen();
+	const char* getData();
+	long long getSize();
+
+	void prefetch();
+
+  private:
+
+	const char* mData;
+	long long mSize;
+
+#ifdef _WIN32
+	void* mFile;
+	void* mMapping;
+#else
+	int mFile;
+#endif
+
+};
+
+/****************************************************************************/
+/****************************************************************************/
+/****************************************************************************/
+#endif
@@ -135,9 +135,12 @@
  * /Developer/SDKs/MacOSX10.5.sdk/System/Library/Frameworks/Security.framework/Headers/cssmconfig.h
  *
  * Avoid using the same names...
+ *
+ * long is 64 bits on LP64 platforms, int is 32 bits on everything
+ * we build for.
  */
 
-#define myuint32 unsigned long
+#define myuint32 unsigned int
 #define myuint16 unsigned short
 #define myint16 short
 
@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2010 Jeffrey S. Larson  <jeff@circularlabs.com>
+ * All rights reserved.
+ * See the LICENSE file for the full copyright and license declaration.
+ *
+ * ---------------------------------------------------------------------
+ *
+ * A hash table of interned names for fast lookup of the system
+ * objects by name.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "Port.h"
+#include "Util.h"
+#include "SymbolTable.h"
+
+/**
+ * Initial number of slots, must be a power of two.
+ */
+#define SYMBOL_TABLE_SLOTS 64
+
+/****************************************************************************
+ *                                                                          *
+ *                               SYMBOL TABLE                               *
+ *                                                                          *
+ ****************************************************************************/
+
+PUBLIC SymbolTable::SymbolTable()
+{
+    init(false);
+}
+
+PUBLIC SymbolTable::SymbolTable(bool caseSensitive)
+{
+    init(caseSensitive);
+}
+
+PRIVATE void SymbolTable::init(bool caseSensitive)
+{
+    mCaseSensitive = caseSensitive;
+    mSlots = NULL;
+    mSlotCount = 0;
+    mNames = NULL;
+    mHashes = NULL;
+    mValues = NULL;
+    mCount = 0;
+    mMax = 0;
+}
+
+PUBLIC SymbolTable::~SymbolTable()
+{
+    clear();
+}
+
+/**
+ * Remove all of the names.
+ */
+PUBLIC void SymbolTable::clear()
+{
+    for (int i = 0 ; i < mCount ; i++)
+      delete mNames[i];
+
+    delete mSlots;
+    delete mNames;
+    delete mHashes;
+    delete mValues;
+
+    mSlots = NULL;
+    mSlotCount = 0;
+    mNames = NULL;
+    mHashes = NULL;
+    mValues = NULL;
+    mCount = 0;
+    mMax = 0;
+}
+
+/**
+ * FNV-1a, folding case unless we're case sensitive.
+ */
+PRIVATE unsigned int SymbolTable::hash(const char* name)
+{
+    unsigned int h = 2166136261u;
+    for (const char* ptr = name ; *ptr ; ptr++) {
+        unsigned char ch = (unsigned char)*ptr;
+        if (!mCaseSensitive)
+          ch = (unsigned char)tolower(ch);
+        h = (h ^ ch) * 16777619u;
+    }
+    return h;
+}
+
+PRIVATE bool SymbolTable::isEqual(const char* name1, const char* name2)
+{
+    return (mCaseSensitive) ? !strcmp(name1, name2) :
+        StringEqualNoCase(name1, name2);
+}
+
+/**
+ * Return the slot containing the name, or the empty slot where
+ * it would go.  There is always at least one empty slot.
+ */
+PRIVATE int SymbolTable::findSlot(const char* name, unsigned int h)
+{
+    int mask = mSlotCount - 1;
+    int slot = (int)(h & mask);
+
+    while (mSlots[slot] != 0) {
+        int id = mSlots[slot] - 1;
+        if (mHashes[id] == h && isEqual(mNames[id], name))
+          break;
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
+
+/**
+ * Double the number of slots and the id arrays and rehash.
+ */
+PRIVATE void SymbolTable::grow()
+{
+    int max = (mMax == 0) ? (SYMBOL_TABLE_SLOTS / 2) : mMax * 2;
+    int slotCount = max * 2;
+
+    char** names = new char*[max];
+    unsigned int* hashes = new unsigned int[max];
+    void** values = new void*[max];
+    int* slots = new int[slotCount];
+
+    for (int i = 0 ; i < mCount ; i++) {
+        names[i] = mNames[i];
+        hashes[i] = mHashes[i];
+        values[i] = mValues[i];
+    }
+    memset(slots, 0, slotCount * sizeof(int));
+
+    delete mNames;
+    delete mHashes;
+    delete mValues;
+    delete mSlots;
+
+    mNames = names;
+    mHashes = hashes;
+    mValues = values;
+    mSlots = slots;
+    mSlotCount = slotCount;
+    mMax = max;
+
+    int mask = slotCount - 1;
+    for (int i = 0 ; i < mCount ; i++) {
+        int slot = (int)(mHashes[i] & mask);
+        while (mSlots[slot] != 0)
+          slot = (slot + 1) & mask;
+        mSlots[slot] = i + 1;
+    }
+}
+
+/**
+ * Add a name and return its id.  If the name is already in the
+ * table the existing id is returned and the value is not changed,
+ * so when several objects share a name the first one added wins.
+ */
+PUBLIC int SymbolTable::intern(const char* name, void* value)
+{
+    int id = -1;
+
+    if (name != NULL) {
+        if (mCount >= mMax)
+          grow();
+
+        unsigned int h = hash(name);
+        int slot = findSlot(name, h);
+        if (mSlots[slot] != 0)
+          id = mSlots[slot] - 1;
+        else {
+            id = mCount++;
+            mNames[id] = CopyString(name);
+            mHashes[id] = h;
+            mValues[id] = value;
+            mSlots[slot] = id + 1;
+        }
+    }
+
+    return id;
+}
+
+/**
+ * Return the id of a name, -1 if it isn't in the table.
+ */
+PUBLIC int SymbolTable::find(const char* name)
+{
+    int id = -1;
+
+    if (name != NULL && mCount > 0) {
+        int slot = findSlot(name, hash(name));
+        id = mSlots[slot] - 1;
+    }
+
+    return id;
+}
+
+/**
+ * Return the value of a name, NULL if it isn't in the table.
+ */
+PUBLIC void* SymbolTable::get(const char* name)
+{
+    return getValue(find(name));
+}
+
+PUBLIC int SymbolTable::size()
+{
+    return mCount;
+}
+
+PUBLIC const char* SymbolTable::getName(int id)
+{
+    return (id >= 0 && id < mCount) ? mNames[id] : NULL;
+}
+
+PUBLIC void* SymbolTable::getValue(int id)
+{
+    return (id >= 0 && id < mCount) ? mValues[id] : NULL;
+}
+
+PUBLIC void SymbolTable::setValue(int id, void* value)
+{
+    if (id >= 0 && id < mCount)
+      mValues[id] = value;
+}
+
+/****************************************************************************/
+/****************************************************************************/
+/****************************************************************************/
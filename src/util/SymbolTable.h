@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2010 Jeffrey S. Larson  <jeff@circularlabs.com>
+ * All rights reserved.
+ * See the LICENSE file for the full copyright and license declaration.
+ *
+ * ---------------------------------------------------------------------
+ *
+ * A hash table of interned names for fast lookup of the system
+ * objects by name.
+ *
+ */
+
+#ifndef SYMBOL_TABLE_H
+#define SYMBOL_TABLE_H
+
+/****************************************************************************
+ *                                                                          *
+ *                               SYMBOL TABLE                               *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * Each name added to the table is copied and given an id, ids are
+ * assigned in order starting from zero and never change.  Each id
+ * has a value, usually the object the name refers to.
+ *
+ * Names are found with open addressing in a power of two array of
+ * slots kept at most half full, so a search is normally one or two
+ * probes no matter how many names there are.
+ *
+ * Names are compared without regard to case unless the table was
+ * created case sensitive.
+ *
+ * This is not thread safe.  Several threads may search at the same
+ * time but nothing can be added while they do.  Tables used by the
+ * interrupt are built completely then installed.
+ */
+class SymbolTable {
+
+  public:
+
+    SymbolTable();
+    SymbolTable(bool caseSensitive);
+    ~SymbolTable();
+
+    int intern(const char* name, void* value);
+    int find(const char* name);
+    void* get(const char* name);
+
+    int size();
+    const char* getName(int id);
+    void* getValue(int id);
+    void setValue(int id, void* value);
+
+    void clear();
+
+  private:
+
+    void init(bool caseSensitive);
+    unsigned int hash(const char* name);
+    bool isEqual(const char* name1, const char* name2);
+    int findSlot(const char* name, unsigned int hash);
+    void grow();
+
+    bool mCaseSensitive;
+
+    // id + 1 of the name in each slot, zero if empty
+    int* mSlots;
+    int mSlotCount;
+
+    // by id
+    char** mNames;
+    unsigned int* mHashes;
+    void** mValues;
+    int mCount;
+    int mMax;
+
+};
+
+/****************************************************************************/
+/****************************************************************************/
+/****************************************************************************/
+#endif
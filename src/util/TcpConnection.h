@@ -24,7 +24,7 @@
 #include <netinet/in.h>
 #endif
 
-#include "port.h"
+#include "Port.h"
 
 /****************************************************************************
  * TcpConnection
@@ -31,20 +31,26 @@
 #include <pthread.h>
 #include <errno.h>
 #include <time.h>
+#include <sched.h>
+#include <sys/time.h>
 
+#ifdef __APPLE__
 // mac stuff for real-time threads
 extern "C" {
 #include <mach/thread_policy.h>
 #include <mach/thread_act.h>
 #include <mach/mach_init.h>
+#include <mach/mach_time.h>
 // to get bus speed
 #include <sys/sysctl.h>
 }
+#endif
 
 #endif
 
-#include "util.h"
+#include "Util.h"
 #include "Thread.h"
+#include "Trace.h"
 
 #define DEFAULT_TIMEOUT 1000
 
@@ -69,6 +75,249 @@ INTERFACE void SleepMillis(int millis)
 #endif
 }
 
+INTERFACE void YieldThread()
+{
+#ifdef _WIN32	
+	SwitchToThread();
+#else
+	sched_yield();
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// CLOCK
+// 
+//////////////////////////////////////////////////////////////////////
+
+/**
+ * Return the current value of a monotonic high resolution clock.
+ * The units are platform specific, use GetClockFrequency or
+ * ClockTicksToMicros to convert.  This is cheap enough to call 
+ * from the audio interrupt.
+ */
+INTERFACE long long GetClockTicks()
+{
+#ifdef _WIN32
+	LARGE_INTEGER count;
+	QueryPerformanceCounter(&count);
+	return (long long)count.QuadPart;
+#elif defined(__APPLE__)
+	return (long long)mach_absolute_time();
+#else
+	// Linux is only used for the offline render tools
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((long long)ts.tv_sec * 1000000000LL) + (long long)ts.tv_nsec;
+#endif
+}
+
+/**
+ * Return the number of clock ticks per second.
+ */
+INTERFACE long long GetClockFrequency()
+{
+	static long long Frequency = 0;
+
+	if (Frequency == 0) {
+#ifdef _WIN32
+		LARGE_INTEGER freq;
+		QueryPerformanceFrequency(&freq);
+		Frequency = (long long)freq.QuadPart;
+#elif !defined(__APPLE__)
+		// clock_gettime nanoseconds
+		Frequency = 1000000000LL;
+#else
+		// mach time is in units of numer/denom nanoseconds
+		mach_timebase_info_data_t info;
+		mach_timebase_info(&info);
+		Frequency = (long long)((1000000000.0 * info.denom) / info.numer);
+#endif
+	}
+	return Frequency;
+}
+
+INTERFACE double ClockTicksToMicros(long long ticks)
+{
+	return ((double)ticks * 1000000.0) / (double)GetClockFrequency();
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// ATOMIC OPERATIONS
+// 
+//////////////////////////////////////////////////////////////////////
+
+/*
+ * Thin wrappers around the compiler intrinsics so the lock free
+ * structures used between the interrupt and the application threads
+ * don't have to be littered with #ifdefs.  All of these are
+ * full memory barriers.
+ */
+
+/**
+ * Increment and return the new value.
+ */
+INTERFACE int AtomicIncrement(volatile int* value)
+{
+#ifdef _WIN32
+	return (int)InterlockedIncrement((volatile LONG*)value);
+#else
+	return __sync_add_and_fetch(value, 1);
+#endif
+}
+
+/**
+ * Decrement and return the new value.
+ */
+INTERFACE int AtomicDecrement(volatile int* value)
+{
+#ifdef _WIN32
+	return (int)InterlockedDecrement((volatile LONG*)value);
+#else
+	return __sync_sub_and_fetch(value, 1);
+#endif
+}
+
+/**
+ * Add and return the new value.
+ */
+INTERFACE int AtomicAdd(volatile int* value, int amount)
+{
+#ifdef _WIN32
+	return (int)InterlockedExchangeAdd((volatile LONG*)value, amount) + amount;
+#else
+	return __sync_add_and_fetch(value, amount);
+#endif
+}
+
+/**
+ * Store the replacement if the current value is the expected value.
+ * Returns true if the swap happened.
+ */
+INTERFACE bool AtomicCompareAndSwap(volatile int* value, int expected, 
+									int replacement)
+{
+#ifdef _WIN32
+	return (InterlockedCompareExchange((volatile LONG*)value, replacement, 
+									   expected) == expected);
+#else
+	return __sync_bool_compare_and_swap(value, expected, replacement);
+#endif
+}
+
+INTERFACE bool AtomicCompareAndSwapPointer(void* volatile* location, 
+										   void* expected, void* replacement)
+{
+#ifdef _WIN32
+	return (InterlockedCompareExchangePointer(location, replacement, 
+											  expected) == expected);
+#else
+	return __sync_bool_compare_and_swap(location, expected, replacement);
+#endif
+}
+
+/**
+ * Store a new pointer and return the previous one.
+ */
+INTERFACE void* AtomicExchangePointer(void* volatile* location, 
+									  void* replacement)
+{
+#ifdef _WIN32
+	return InterlockedExchangePointer(location, replacement);
+#else
+	// test_and_set is only an acquire barrier, make it full
+	__sync_synchronize();
+	return __sync_lock_test_and_set(location, replacement);
+#endif
+}
+
+/**
+ * Full memory barrier, used when publishing ring buffer indexes
+ * after the contents have been written.
+ */
+INTERFACE void AtomicBarrier()
+{
+#ifdef _WIN32
+	MemoryBarrier();
+#else
+	__sync_synchronize();
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// Thread Local Storage
+//
+//////////////////////////////////////////////////////////////////////
+
+/*
+ * We don't use compiler thread local variables because they don't
+ * work in DLLs loaded with LoadLibrary on older Windows, which is how
+ * VST hosts load us, and Apple's gcc doesn't support them at all.
+ */
+
+/**
+ * Allocate a key for a thread local value.  Returns -1 if we're out.
+ */
+INTERFACE int ThreadLocalAlloc()
+{
+	int key = -1;
+#ifdef _WIN32
+	DWORD index = TlsAlloc();
+	if (index != TLS_OUT_OF_INDEXES)
+	  key = (int)index;
+#else
+	pthread_key_t pkey;
+	if (pthread_key_create(&pkey, NULL) == 0)
+	  key = (int)pkey;
+#endif
+	if (key < 0) {
+		printf("ERROR: ThreadLocalAlloc unable to allocate key\n");
+		fflush(stdout);
+	}
+	return key;
+}
+
+/**
+ * Release a key.  Values other threads still have for it are
+ * forgotten, they are not deleted.
+ */
+INTERFACE void ThreadLocalFree(int key)
+{
+	if (key >= 0) {
+#ifdef _WIN32
+		TlsFree((DWORD)key);
+#else
+		pthread_key_delete((pthread_key_t)key);
+#endif
+	}
+}
+
+INTERFACE void* ThreadLocalGet(int key)
+{
+	void* value = NULL;
+	if (key >= 0) {
+#ifdef _WIN32
+		value = TlsGetValue((DWORD)key);
+#else
+		value = pthread_getspecific((pthread_key_t)key);
+#endif
+	}
+	return value;
+}
+
+INTERFACE void ThreadLocalSet(int key, void* value)
+{
+	if (key >= 0) {
+#ifdef _WIN32
+		TlsSetValue((DWORD)key, value);
+#else
+		pthread_setspecific((pthread_key_t)key, value);
+#endif
+	}
+}
+
 //////////////////////////////////////////////////////////////////////
 //
 // Critical Sections
@@ -280,6 +529,11 @@ PUBLIC void Thread::init()
 	mEvent = NULL;
 #else
 	mThread = NULL;
+	// initialize these here rather than in run() so signal() and
+	// stop() are safe before the thread starts waiting, or if
+	// the subclass overrides run()
+	pthread_mutex_init(&mConditionMutex, NULL);
+	pthread_cond_init(&mCondition, NULL);
 #endif
 }
 
@@ -398,7 +652,7 @@ PUBLIC void Thread::start()
  */
 PRIVATE void Thread::configurePriority(bool inside)
 {
-#ifndef _WIN32
+#ifdef __APPLE__
 
 	thread_act_t thread;
 
@@ -533,6 +787,31 @@ PRIVATE void Thread::configurePriority(bool inside)
 		}
 				
 	}
+
+#elif defined(_WIN32)
+
+	if (mPriority > 0) {
+		if (!SetThreadPriority(GetCurrentThread(), 
+							   THREAD_PRIORITY_TIME_CRITICAL)) {
+			fprintf(stderr, "ERROR: Thread::start unable to set thread priority %d\n",
+					(int)GetLastError());
+			fflush(stderr);
+		}
+	}
+
+#else
+
+	if (mPriority > 0) {
+		// FIFO scheduling needs an rtprio limit or CAP_SYS_NICE,
+		// without them we keep the normal policy
+		struct sched_param param;
+		param.sched_priority = sched_get_priority_max(SCHED_FIFO) - 1;
+		int status = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+		if (status != 0)
+		  Trace(2, "Thread: Unable to set real time priority for %s, error %ld\n",
+				((mName != NULL) ? mName : ""), (long)status);
+	}
+
 #endif
 }
 
@@ -590,6 +869,9 @@ PUBLIC void Thread::runOuter()
 	// let the subclass know in case it has resources to release
 	threadEnding();
 
+	// give back the trace ring if we had one
+	TraceThreadEnding();
+
     // this will cease to be relevant as soon as the thread function retrns
 	// isRunning test this
 	// !! hmm, may be a slight delay between now and when the thread actually
@@ -649,9 +931,6 @@ PUBLIC void Thread::run()
 		}
 	}
 #else
-	pthread_mutex_init(&mConditionMutex, NULL);
-	pthread_cond_init(&mCondition, NULL);
-
 	// sigh, OSX doesn't have clock_gettime, have to use gettimeofday and convert
 	timeval  tval;
 	timespec tspec;
@@ -23,7 +23,7 @@
 #include <pthread.h>
 #endif
 
-#include "port.h"
+#include "Port.h"
 
 //////////////////////////////////////////////////////////////////////
 //
@@ -34,6 +34,47 @@
 INTERFACE void SleepSeconds(int seconds);
 INTERFACE void SleepMillis(int millis);
 
+// give up the rest of the time slice to another ready thread
+INTERFACE void YieldThread();
+
+//////////////////////////////////////////////////////////////////////
+//
+// Clock
+//
+//////////////////////////////////////////////////////////////////////
+
+// monotonic high resolution time for profiling and timestamps
+INTERFACE long long GetClockTicks();
+INTERFACE long long GetClockFrequency();
+INTERFACE double ClockTicksToMicros(long long ticks);
+
+//////////////////////////////////////////////////////////////////////
+//
+// Atomic Operations
+//
+//////////////////////////////////////////////////////////////////////
+
+// all of these imply a full memory barrier
+INTERFACE int AtomicIncrement(volatile int* value);
+INTERFACE int AtomicDecrement(volatile int* value);
+INTERFACE int AtomicAdd(volatile int* value, int amount);
+INTERFACE bool AtomicCompareAndSwap(volatile int* value, int expected, int replacement);
+INTERFACE bool AtomicCompareAndSwapPointer(void* volatile* location, void* expected, void* replacement);
+INTERFACE void* AtomicExchangePointer(void* volatile* location, void* replacement);
+INTERFACE void AtomicBarrier();
+
+//////////////////////////////////////////////////////////////////////
+//
+// Thread Local Storage
+//
+//////////////////////////////////////////////////////////////////////
+
+// values start out NULL, including for keys reused after a free
+INTERFACE int ThreadLocalAlloc();
+INTERFACE void ThreadLocalFree(int key);
+INTERFACE void* ThreadLocalGet(int key);
+INTERFACE void ThreadLocalSet(int key, void* value);
+
 //////////////////////////////////////////////////////////////////////
 //
 // Critical Section
@@ -167,7 +208,8 @@ class Thread {
 	int mTimeout;
 
     /**
-     * Desired priority (currently ignored)
+     * Desired priority, non-zero asks for real time scheduling
+     * when the thread starts.
      */
     int mPriority;
 
@@ -7,15 +7,16 @@
  * 
  * Trace utilities.
  * 
- * Trace records are accumulated in a global array.
- * In theory there could be thread synchronization problems, 
- * but in practice that would be rare as almost all trace messages
- * come from the interrupt thread.  I don't want to mess with
- * csects here, the only potential problem is loss of a message.
+ * Trace records are accumulated in ring buffers, one per thread
+ * so the audio interrupt never has to wait on a csect to add one.
+ * Each ring has a tail advanced as trace messages are added, and 
+ * a head advanced as messages are displayed.  The flusher merges
+ * the rings back together using the clock tick count stored in
+ * each record.
  *
- * The records are normally acumulated as a ring buffer with a head
- * pointer advanced as trace messages are added, and a tail pointer advanced
- * as messages are displayed.  
+ * Formatting is deferred until the flush, the record just holds
+ * the format pointer and arguments.  String arguments are interned
+ * so we don't copy them every time.
  */
 
 #include <stdio.h>
@@ -34,7 +35,7 @@
 
 #include "Util.h"
 #include "Thread.h"
-#include "trace.h"
+#include "Trace.h"
 
 /****************************************************************************
  *                                                                          *
@@ -153,32 +154,60 @@ PUBLIC int TraceDebugLevel = 0;
  */
 PUBLIC TraceListener* NewTraceListener = NULL;
 
+/****************************************************************************
+ *                                                                          *
+ *   							 TRACE RINGS                                *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * A ring of trace records with one producer and one consumer.
+ * Head and tail are free running counters, masked with 
+ * TRACE_RING_SIZE - 1 when indexing.
+ */
+class TraceRing {
+  public:
+
+	TraceRecord records[TRACE_RING_SIZE];
+
+	// index of the next record to flush, only changed by the flusher
+	volatile int head;
+
+	// index of the next record to fill, only changed by the producer
+	volatile int tail;
+
+	// non-zero when a thread has claimed this ring
+	volatile int owned;
+
+	// records dropped because the ring was full
+	volatile int lost;
+
+	// value of lost at the last flush
+	int reported;
+};
+
 /**
- * Trace records are accumulated in a global array.
- * In theory there could be thread synchronization problems, 
- * but in practice that would be rare as almost all trace messages
- * come from the interrupt thread.  I don't want to mess with
- * csects here, the only potential problem is loss of a message.
+ * Ring zero is shared and protected by TraceCsect, the rest
+ * are claimed by one thread each.
  */
-PRIVATE TraceRecord TraceRecords[MAX_TRACE_RECORDS];
+PRIVATE TraceRing TraceRings[MAX_TRACE_RINGS];
 
 /**
- * Csect needed for the head pointer since we can be adding
- * trace from several threads.
- * You must only flush trace from one thread.
+ * Csect for the producers of the shared ring.
  */
 PRIVATE CriticalSection* TraceCsect = new CriticalSection("Trace");
 
 /**
- * Index into TraceRecords of the first active record.
- * If this is equal to TraceTail, then the message queue is empty.
+ * Csect held while flushing, there can only be one consumer
+ * for each ring.  Producers never enter this.
  */
-PRIVATE int TraceHead = 0;
+PRIVATE CriticalSection* TraceFlushCsect = new CriticalSection("TraceFlush");
 
 /**
- * The index into TraceRecords of the next available record.
+ * Thread local key holding the TraceRing claimed by this thread.
+ * -2 until we try to allocate one, -1 if that failed.
  */
-PRIVATE int TraceTail = 0;
+PRIVATE volatile int TraceRingKey = -2;
 
 /**
  * A default object that may be registered to provide context and time
@@ -186,143 +215,313 @@ PRIVATE int TraceTail = 0;
  */
 PUBLIC TraceContext* DefaultTraceContext = NULL;
 
-PRIVATE bool TraceInitialized = false;
-
 PUBLIC void TraceBreakpoint()
 {
 	int x = 0;
 }
 
+/**
+ * Locate the ring for this thread, claiming one if this is the 
+ * first trace record we've added.  Returns NULL if all the rings
+ * are taken and we have to share.
+ */
+PRIVATE TraceRing* GetTraceRing()
+{
+	TraceRing* ring = NULL;
+
+	int key = TraceRingKey;
+	if (key == -2) {
+		// first time, must not let two threads allocate keys
+		TraceCsect->enter();
+		if (TraceRingKey == -2)
+		  TraceRingKey = ThreadLocalAlloc();
+		key = TraceRingKey;
+		TraceCsect->leave();
+	}
+
+	if (key >= 0) {
+		ring = (TraceRing*)ThreadLocalGet(key);
+		if (ring == NULL) {
+			for (int i = 1 ; i < MAX_TRACE_RINGS && ring == NULL ; i++) {
+				TraceRing* r = &TraceRings[i];
+				if (r->owned == 0 && AtomicCompareAndSwap(&(r->owned), 0, 1))
+				  ring = r;
+			}
+			// if we're out, remember the shared ring so we 
+			// don't search every time
+			if (ring == NULL)
+			  ring = &TraceRings[0];
+			ThreadLocalSet(key, ring);
+		}
+	}
+
+	return (ring == &TraceRings[0]) ? NULL : ring;
+}
+
+/**
+ * Release the ring owned by this thread.  Anything still in the ring 
+ * will be flushed normally, the next thread to claim it simply
+ * continues from the current tail.
+ */
+PUBLIC void TraceThreadEnding()
+{
+	int key = TraceRingKey;
+	if (key >= 0) {
+		TraceRing* ring = (TraceRing*)ThreadLocalGet(key);
+		if (ring != NULL) {
+			ThreadLocalSet(key, NULL);
+			if (ring != &TraceRings[0]) {
+				AtomicBarrier();
+				ring->owned = 0;
+			}
+		}
+	}
+}
+
 PUBLIC void ResetTrace()
 {
-    TraceCsect->enter();
-	TraceHead = 0;
-	TraceTail = 0;
-    TraceCsect->leave();
+    TraceFlushCsect->enter();
+	for (int i = 0 ; i < MAX_TRACE_RINGS ; i++) {
+		TraceRing* ring = &TraceRings[i];
+		ring->head = ring->tail;
+		ring->reported = ring->lost;
+	}
+    TraceFlushCsect->leave();
 }
 
 /**
- * Fix an argument to it is safe to copy.
+ * True if any of the rings have something in them.
+ */
+PRIVATE bool IsTracePending()
+{
+	bool pending = false;
+	for (int i = 0 ; i < MAX_TRACE_RINGS && !pending ; i++)
+	  pending = (TraceRings[i].head != TraceRings[i].tail);
+	return pending;
+}
+
+/****************************************************************************
+ *                                                                          *
+ *   						   INTERNED STRINGS                             *
+ *                                                                          *
+ ****************************************************************************/
+/*
+ * String arguments are almost always names of things: loops, functions,
+ * modes, parameters.  Rather than copy them into every record we keep
+ * a table of the ones we've seen and store a pointer.  The table only
+ * grows, entries are added with a CAS so any thread can add them 
+ * without locking.  Once it fills we go back to copying.
+ */
+
+/**
+ * Slots in the hash table, must be a power of two.
+ */
+#define TRACE_STRING_SLOTS 2048
+
+/**
+ * Number of slots we'll probe before giving up.
+ */
+#define TRACE_STRING_PROBES 8
+
+/**
+ * Size of the block the strings are copied into.
+ */
+#define TRACE_STRING_ARENA (1024 * 64)
+
+PRIVATE char* volatile TraceStrings[TRACE_STRING_SLOTS];
+
+PRIVATE char TraceStringArena[TRACE_STRING_ARENA];
+
+PRIVATE volatile int TraceStringArenaUsed = 0;
+
+/**
+ * Return the interned copy of a string, adding it if necessary.
+ * Strings are truncated to MAX_ARG - 1 like they were when we copied
+ * them into the record.  Returns NULL if the table is full.
+ */
+PRIVATE const char* InternTraceString(const char* src)
+{
+	const char* interned = NULL;
+
+	int len = 0;
+	unsigned int hash = 2166136261u;
+	while (len < MAX_ARG - 1 && src[len] != 0) {
+		hash = (hash ^ (unsigned char)src[len]) * 16777619u;
+		len++;
+	}
+
+	for (int i = 0 ; i < TRACE_STRING_PROBES && interned == NULL ; i++) {
+		int slot = (int)((hash + i) & (TRACE_STRING_SLOTS - 1));
+		char* s = TraceStrings[slot];
+		if (s == NULL) {
+			if (TraceStringArenaUsed >= TRACE_STRING_ARENA)
+			  break;
+			int end = AtomicAdd(&TraceStringArenaUsed, len + 1);
+			if (end > TRACE_STRING_ARENA) {
+				// arena is full, stop trying
+				break;
+			}
+			char* copy = &TraceStringArena[end - len - 1];
+			memcpy(copy, src, len);
+			copy[len] = 0;
+			if (AtomicCompareAndSwapPointer((void* volatile*)&TraceStrings[slot], NULL, copy))
+			  interned = copy;
+			else {
+				// someone beat us to it, the copy is wasted
+				// but it could be the same string
+				s = TraceStrings[slot];
+			}
+		}
+
+		if (interned == NULL && s != NULL && 
+			memcmp(s, src, len) == 0 && s[len] == 0)
+		  interned = s;
+	}
+
+	return interned;
+}
+
+/**
+ * Fix an argument so it is safe to save.
  * 
- * Note that we can't tell the difference between NULL and 
- * empty string once we copy, which is important in order to select
- * the right sprintf argument list.  If either of these are 
- * non-null but empty, convert them to a single space so we know
- * that a string is expected at this position.
+ * Note that we use NULL to mean the argument wasn't passed, which 
+ * is important in order to select the right sprintf argument list.
+ * If the argument is non-null but empty, convert it to a single space
+ * so we know that a string is expected at this position.
+ *
+ * The buffer is used for the first string we can't intern, after
+ * that we lose.
  */
-PRIVATE void SaveArgument(const char* src, char* dest)
+PRIVATE const char* SaveArgument(const char* src, char* buffer, bool* bufferUsed)
 {
-    dest[0] = 0;
+    const char* saved = NULL;
     if (src != NULL) {
-        if (strlen(src) == 0) 
-          src = " ";
-        else if ((size_t)src < 65535)
-          src = "INVALID";
-        CopyString(src, dest, MAX_ARG);
+        if ((size_t)src < 65535)
+          saved = "INVALID";
+        else if (src[0] == 0) 
+          saved = " ";
+        else {
+            saved = InternTraceString(src);
+            if (saved == NULL) {
+                if (!*bufferUsed) {
+                    CopyString(src, buffer, MAX_ARG);
+                    saved = buffer;
+                    *bufferUsed = true;
+                }
+                else
+                  saved = "???";
+            }
+        }
+    }
+    return saved;
+}
+
+/****************************************************************************
+ *                                                                          *
+ *   							  ADD TRACE                                 *
+ *                                                                          *
+ ****************************************************************************/
+
+/**
+ * Fill in a trace record.
+ */
+PRIVATE void InitTraceRecord(TraceRecord* r, 
+                             TraceContext* context, int level, 
+                             const char* msg, 
+                             const char* string1, 
+                             const char* string2,
+                             const char* string3,
+                             long l1, long l2, long l3, long l4, long l5)
+{
+    // use the default context if none explictily passedn
+    if (context == NULL)
+      context = DefaultTraceContext;
+
+    if (context != NULL)
+      context->getTraceContext(&(r->context), &(r->time));
+    else {
+        r->context = 0;
+        r->time = 0;
     }
+
+    r->level = level;
+    r->ticks = GetClockTicks();
+    r->msg = msg;
+    r->long1 = l1;
+    r->long2 = l2;
+    r->long3 = l3;
+    r->long4 = l4;
+    r->long5 = l5;
+
+    bool bufferUsed = false;
+    r->string = SaveArgument(string1, r->buffer, &bufferUsed);
+    r->string2 = SaveArgument(string2, r->buffer, &bufferUsed);
+    r->string3 = SaveArgument(string3, r->buffer, &bufferUsed);
 }
 
 /**
- * Add a trace record to the trace array.
- * If we're queueing and we fill the record array, we can either lose
- * old records or new ones.  New ones are more important, but we're not
- * supposed to increment TraceHead if TraceQueued is on.
- * 
+ * Add a trace record to this thread's ring, or the shared ring
+ * if we don't have one.  
+ *
+ * If the ring is full the record is dropped and we bump a counter,
+ * the flusher will mention how many were lost.  We used to print
+ * a warning here but that's not something you want to do in
+ * the audio interrupt.
+ *
+ * Returns true if the listener should be notified.  Since the flusher
+ * drains everything, we only need to do that when the ring goes from
+ * empty to non-empty, the listener also flushes periodically in case
+ * a notification gets lost.
  */
-PRIVATE TraceRecord* AddTrace(TraceContext* context, int level, 
-							  const char* msg, 
-							  const char* string1, 
-							  const char* string2,
-                              const char* string3,
-							  long l1, long l2, long l3, long l4, long l5)
-{
-	TraceRecord* r = NULL;
-
-	// kludge: trying to track down a problem, make sure the 
-	// records are initialized
-	if (!TraceInitialized) {
-		for (int i = 0 ; i < MAX_TRACE_RECORDS ; i++)
-			TraceRecords[i].msg = NULL;
-		TraceInitialized =  true;
-	}
+PRIVATE bool AddTrace(TraceContext* context, int level, 
+                      const char* msg, 
+                      const char* string1, 
+                      const char* string2,
+                      const char* string3,
+                      long l1, long l2, long l3, long l4, long l5)
+{
+	bool notify = false;
 
 	// only queue if it falls within the interesting levels
 	if (level <= TracePrintLevel || level <= TraceDebugLevel) {
 
-        // must csect this, the TraceTail can't advance
-        // until we've fully initialized the record or else
-        // the flush thread can try to render a partially
-        // initialized record
-        TraceCsect->enter();
-
-		TraceRecord* r = &TraceRecords[TraceTail];
-
-		int nextTail = TraceTail + 1;
-		if (nextTail >= MAX_TRACE_RECORDS)
-		  nextTail = 0;
-
-		if (nextTail == TraceHead) {
-            // overflow
-            // originally we bumped the head but that causes
-            // problems if the flush thread is active at the moment,
-            // we can overwtite the record being flushed causing
-            // a sprintf format/argument mismatch.  This can
-            // only happen when the refresh thread is bogged down 
-            // or excessive trace is being generated
-            TraceCsect->leave();
-            const char* msg = "WARNING: Trace record buffer overflow!!\n";
-#ifdef _WIN32
-			OutputDebugString(msg);
-            fprintf(stdout, msg);
-            fflush(stdout);
-#else
-            fprintf(stderr, msg);
-            fflush(stderr);
-#endif
+		TraceRing* ring = GetTraceRing();
+		bool shared = (ring == NULL);
+		if (shared) {
+			ring = &TraceRings[0];
+			TraceCsect->enter();
 		}
-        else {
-            // use the default context if none explictily passedn
-            if (context == NULL)
-              context = DefaultTraceContext;
-
-            if (context != NULL)
-              context->getTraceContext(&(r->context), &(r->time));
-            else {
-                r->context = 0;
-                r->time = 0;
-            }
 
-            r->level = level;
-            r->msg = msg;
-            r->long1 = l1;
-            r->long2 = l2;
-            r->long3 = l3;
-            r->long4 = l4;
-            r->long5 = l5;
-            r->string[0] = 0;
-            r->string2[0] = 0;
-            r->string3[0] = 0;
-
-            try {
-                SaveArgument(string1, r->string);
-                SaveArgument(string2, r->string2);
-                SaveArgument(string3, r->string3);
-            }
-            catch (...) {
-                printf("Trace: Unable to copy string arguments!\n");
-            }
+		int tail = ring->tail;
+		int head = ring->head;
 
-            // only change the tail after the record is fully initialized
-            TraceTail = nextTail;
-            TraceCsect->leave();
-        }
+		if ((int)((unsigned)tail - (unsigned)head) >= TRACE_RING_SIZE) {
+			// overflow, the flusher is bogged down or excessive
+			// trace is being generated
+			ring->lost++;
+		}
+		else {
+			TraceRecord* r = &(ring->records[tail & (TRACE_RING_SIZE - 1)]);
+			InitTraceRecord(r, context, level, msg, string1, string2, string3,
+							l1, l2, l3, l4, l5);
+
+			// only change the tail after the record is fully initialized
+			// or else the flusher can render a partial record
+			AtomicBarrier();
+			ring->tail = tail + 1;
+
+			notify = (tail == head || level <= 1);
+		}
+
+		if (shared)
+		  TraceCsect->leave();
 
 		// spot to hang a breakpoint
 		if (level <= 1)
 		  TraceBreakpoint();
 	}
 
-	return r;
+	return notify;
 }
 
 /**
@@ -340,15 +539,15 @@ PRIVATE void RenderTrace(TraceRecord* r, char* buffer)
             buffer += strlen(buffer);
 	
 
-            if (strlen(r->string3) > 0) {
+            if (r->string3 != NULL) {
                 sprintf(buffer, r->msg, r->string, r->string2, r->string3,
                         r->long1, r->long2, r->long3, r->long4, r->long5);
             }
-            else if (strlen(r->string2) > 0) {
+            else if (r->string2 != NULL) {
                 sprintf(buffer, r->msg, r->string, r->string2, 
                         r->long1, r->long2, r->long3, r->long4, r->long5);
             }
-            else if (strlen(r->string) > 0)
+            else if (r->string != NULL)
               sprintf(buffer, r->msg, r->string, 
                       r->long1, r->long2, r->long3, r->long4, r->long5);
             else
@@ -383,24 +582,92 @@ PRIVATE void RenderTrace(TraceRecord* r, char* buffer)
  *                                                                          *
  ****************************************************************************/
 
+/**
+ * Find the ring whose next record is the oldest.
+ * Returns NULL if they're all empty.  Must be in TraceFlushCsect.
+ */
+PRIVATE TraceRing* NextTraceRing()
+{
+	TraceRing* next = NULL;
+	long long oldest = 0;
+
+	for (int i = 0 ; i < MAX_TRACE_RINGS ; i++) {
+		TraceRing* ring = &TraceRings[i];
+		if (ring->head != ring->tail) {
+			// make sure we see the record the tail was advanced over
+			AtomicBarrier();
+			TraceRecord* r = &(ring->records[ring->head & (TRACE_RING_SIZE - 1)]);
+			if (next == NULL || r->ticks < oldest) {
+				next = ring;
+				oldest = r->ticks;
+			}
+		}
+	}
+
+	return next;
+}
+
+/**
+ * Render the next record from a ring and let the producer have it back.
+ * Returns the record level, the record itself may be reused as soon
+ * as the head moves.
+ */
+PRIVATE int RenderNextTrace(TraceRing* ring, char* buffer)
+{
+	int head = ring->head;
+	TraceRecord* r = &(ring->records[head & (TRACE_RING_SIZE - 1)]);
+	int level = r->level;
+	RenderTrace(r, buffer);
+
+	AtomicBarrier();
+	ring->head = head + 1;
+	return level;
+}
+
+/**
+ * Render a warning for records that were dropped since the last flush.
+ * Returns false if there is nothing to say.
+ */
+PRIVATE bool RenderLostTrace(char* buffer)
+{
+	int lost = 0;
+	for (int i = 0 ; i < MAX_TRACE_RINGS ; i++) {
+		TraceRing* ring = &TraceRings[i];
+		int current = ring->lost;
+		lost += current - ring->reported;
+		ring->reported = current;
+	}
+
+	if (lost > 0)
+	  sprintf(buffer, "WARNING: %d trace records lost to ring overflow\n", lost);
+
+	return (lost > 0);
+}
+
 PRIVATE void WriteTrace(FILE* fp)
 {
 	char buffer[1024 * 8];
 
+    TraceFlushCsect->enter();
+
     fprintf(fp, "=========================================================\n");
-	while (TraceHead != TraceTail) {
-        TraceRecord* r = &TraceRecords[TraceHead];
-		RenderTrace(r, buffer);
+
+	if (RenderLostTrace(buffer))
+	  fprintf(fp, "%s", buffer);
+
+	TraceRing* ring = NextTraceRing();
+	while (ring != NULL) {
+		RenderNextTrace(ring, buffer);
 		fprintf(fp, "%s", buffer);
-		TraceHead++;
-		if (TraceHead >= MAX_TRACE_RECORDS)
-		  TraceHead = 0;
+		ring = NextTraceRing();
     }
+
+    TraceFlushCsect->leave();
 }
 
 PUBLIC void WriteTrace(const char* file)
 {
-	if (TraceHead != TraceTail > 0) {
+	if (IsTracePending()) {
 		FILE* fp = fopen(file, "w");
 		if (fp != NULL) {
 			WriteTrace(fp);
@@ -413,7 +680,7 @@ PUBLIC void WriteTrace(const char* file)
 
 PUBLIC void AppendTrace(const char* file)
 {
-	if (TraceHead != TraceTail) {
+	if (IsTracePending()) {
 		FILE* fp = fopen(file, "a");
 		if (fp != NULL) {
 			WriteTrace(fp);
@@ -429,43 +696,55 @@ PUBLIC void PrintTrace()
     WriteTrace(stdout);
 }
 
-PUBLIC void FlushTrace()
+/**
+ * Send one rendered record to the print and debug streams.
+ */
+PRIVATE void EmitTrace(int level, const char* buffer)
 {
-	char buffer[1024 * 8];
-	
-	// guard against mods during the flush, really that safe?
-	int head = TraceHead;
-	int tail = TraceTail;
-
-	while (head != tail) {
-        TraceRecord* r = &TraceRecords[head];
-		RenderTrace(r, buffer);
-
-		if (r->level <= TracePrintLevel) {
-			printf("%s", buffer);
-			fflush(stdout);
-		}
+	if (level <= TracePrintLevel) {
+		printf("%s", buffer);
+		fflush(stdout);
+	}
 
-		if (r->level <= TraceDebugLevel) {
+	if (level <= TraceDebugLevel) {
 
 #ifdef _WIN32
-			OutputDebugString(buffer);
+		OutputDebugString(buffer);
 #else
-			// OSX sadly doesn't seem to have anything equivalent emit to stderr
-			// if we're not already emitting to stdout
-			if (!(r->level <= TracePrintLevel)) {
-				fprintf(stderr, "%s", buffer);
-				fflush(stderr);
-			}
-#endif
+		// OSX sadly doesn't seem to have anything equivalent emit to stderr
+		// if we're not already emitting to stdout
+		if (!(level <= TracePrintLevel)) {
+			fprintf(stderr, "%s", buffer);
+			fflush(stderr);
 		}
+#endif
+	}
+}
 
-		head++;
-		if (head >= MAX_TRACE_RECORDS)
-		  head = 0;
-    }
+/**
+ * Render everything in the rings, oldest first.
+ * There is a limit so a thread that is adding as fast as we can
+ * flush can't keep us here forever.
+ */
+PUBLIC void FlushTrace()
+{
+	char buffer[1024 * 8];
+	int limit = MAX_TRACE_RINGS * TRACE_RING_SIZE;
+	
+	TraceFlushCsect->enter();
+
+	if (RenderLostTrace(buffer))
+	  EmitTrace(1, buffer);
+
+	TraceRing* ring = NextTraceRing();
+	while (ring != NULL && limit > 0) {
+		int level = RenderNextTrace(ring, buffer);
+		EmitTrace(level, buffer);
+		ring = NextTraceRing();
+		limit--;
+	}
 
-	TraceHead = head;
+	TraceFlushCsect->leave();
 }
 
 /**
@@ -508,8 +787,8 @@ PUBLIC void Trace(int level, const char* msg)
 
 PUBLIC void Trace(TraceContext* context, int level, const char* msg)
 {
-    AddTrace(context, level, msg, NULL, NULL, NULL, 0, 0, 0, 0, 0);
-	FlushOrNotify();
+    if (AddTrace(context, level, msg, NULL, NULL, NULL, 0, 0, 0, 0, 0))
+      FlushOrNotify();
 }
 
 PUBLIC void Trace(int level, const char* msg, const char* arg)
@@ -521,8 +800,8 @@ PUBLIC void Trace(TraceContext* context, int level, const char* msg,
 				  const char* arg)
 {
     arg = CheckString(arg);
-	AddTrace(context, level, msg, arg, NULL, NULL, 0, 0, 0, 0, 0);
-	FlushOrNotify();
+	if (AddTrace(context, level, msg, arg, NULL, NULL, 0, 0, 0, 0, 0))
+	  FlushOrNotify();
 }
 
 PUBLIC void Trace(int level, const char* msg, const char* arg,
@@ -536,8 +815,8 @@ PUBLIC void Trace(TraceContext* context, int level, const char* msg,
 {
     arg = CheckString(arg);
     arg2 = CheckString(arg2);
-    AddTrace(context, level, msg, arg, arg2, NULL, 0, 0, 0, 0, 0);
-	FlushOrNotify();
+    if (AddTrace(context, level, msg, arg, arg2, NULL, 0, 0, 0, 0, 0))
+      FlushOrNotify();
 }
 
 PUBLIC void Trace(int level, const char* msg, const char* arg,
@@ -552,8 +831,8 @@ PUBLIC void Trace(TraceContext* context, int level, const char* msg,
     arg = CheckString(arg);
     arg2 = CheckString(arg2);
     arg3 = CheckString(arg3);
-    AddTrace(context, level, msg, arg, arg2, arg3, 0, 0, 0, 0, 0);
-	FlushOrNotify();
+    if (AddTrace(context, level, msg, arg, arg2, arg3, 0, 0, 0, 0, 0))
+      FlushOrNotify();
 }
 
 PUBLIC void Trace(int level, const char* msg, const char* arg, long l1)
@@ -565,8 +844,8 @@ PUBLIC void Trace(TraceContext* context, int level, const char* msg,
 				  const char* arg, long l1)
 {
     arg = CheckString(arg);
-    AddTrace(context, level, msg, arg, NULL, NULL, l1, 0, 0, 0, 0);
-	FlushOrNotify();
+    if (AddTrace(context, level, msg, arg, NULL, NULL, l1, 0, 0, 0, 0))
+      FlushOrNotify();
 }
 
 PUBLIC void Trace(int level, const char* msg, 
@@ -592,8 +871,8 @@ PUBLIC void Trace(TraceContext* context, int level, const char* msg,
 {
     arg = CheckString(arg);
     arg2 = CheckString(arg2);
-    AddTrace(context, level, msg, arg, arg2, NULL, l1, 0, 0, 0, 0);
-	FlushOrNotify();
+    if (AddTrace(context, level, msg, arg, arg2, NULL, l1, 0, 0, 0, 0))
+      FlushOrNotify();
 }
 
 PUBLIC void Trace(TraceContext* context, int level, const char* msg, 
@@ -601,8 +880,8 @@ PUBLIC void Trace(TraceContext* context, int level, const char* msg,
 {
     arg = CheckString(arg);
     arg2 = CheckString(arg2);
-    AddTrace(context, level, msg, arg, arg2, NULL, l1, l2, 0, 0, 0);
-	FlushOrNotify();
+    if (AddTrace(context, level, msg, arg, arg2, NULL, l1, l2, 0, 0, 0))
+      FlushOrNotify();
 }
 
 PUBLIC void Trace(TraceContext* context, int level, const char* msg, 
@@ -610,8 +889,8 @@ PUBLIC void Trace(TraceContext* context, int level, const char* msg,
 {
     arg = CheckString(arg);
     arg2 = CheckString(arg2);
-    AddTrace(context, level, msg, arg, arg2, NULL, l1, l2, l3, 0, 0);
-	FlushOrNotify();
+    if (AddTrace(context, level, msg, arg, arg2, NULL, l1, l2, l3, 0, 0))
+      FlushOrNotify();
 }
 
 PUBLIC void Trace(int level, const char* msg, 
@@ -624,8 +903,8 @@ PUBLIC void Trace(TraceContext* context, int level, const char* msg,
 				  const char* arg, long l1, long l2)
 {
     arg = CheckString(arg);
-    AddTrace(context, level, msg, arg, NULL, NULL, l1, l2, 0, 0, 0);
-	FlushOrNotify();
+    if (AddTrace(context, level, msg, arg, NULL, NULL, l1, l2, 0, 0, 0))
+      FlushOrNotify();
 }
 
 PUBLIC void Trace(int level, const char* msg, long l1)
@@ -635,8 +914,8 @@ PUBLIC void Trace(int level, const char* msg, long l1)
 
 PUBLIC void Trace(TraceContext* context, int level, const char* msg, long l1)
 {
-    AddTrace(context, level, msg, NULL, NULL, NULL, l1, 0, 0, 0, 0);
-	FlushOrNotify();
+    if (AddTrace(context, level, msg, NULL, NULL, NULL, l1, 0, 0, 0, 0))
+      FlushOrNotify();
 }
 
 PUBLIC void Trace(int level, const char* msg, long l1, long l2)
@@ -647,8 +926,8 @@ PUBLIC void Trace(int level, const char* msg, long l1, long l2)
 PUBLIC void Trace(TraceContext* context, int level, const char* msg, 
 				  long l1, long l2)
 {
-    AddTrace(context, level, msg, NULL, NULL, NULL, l1, l2, 0, 0, 0);
-	FlushOrNotify();
+    if (AddTrace(context, level, msg, NULL, NULL, NULL, l1, l2, 0, 0, 0))
+      FlushOrNotify();
 }
 
 PUBLIC void Trace(int level, const char* msg, 
@@ -660,8 +939,8 @@ PUBLIC void Trace(int level, const char* msg,
 PUBLIC void Trace(TraceContext* context, int level, const char* msg, 
 				  long l1, long l2, long l3)
 {
-    AddTrace(context, level, msg, NULL, NULL, NULL, l1, l2, l3, 0, 0);
-	FlushOrNotify();
+    if (AddTrace(context, level, msg, NULL, NULL, NULL, l1, l2, l3, 0, 0))
+      FlushOrNotify();
 }
 
 PUBLIC void Trace(int level, const char* msg, const char* arg,
@@ -675,8 +954,8 @@ PUBLIC void Trace(TraceContext* context, int level, const char* msg,
 				  long l1, long l2, long l3)
 {
     arg = CheckString(arg);
-    AddTrace(context, level, msg, arg, NULL, NULL, l1, l2, l3, 0, 0);
-	FlushOrNotify();
+    if (AddTrace(context, level, msg, arg, NULL, NULL, l1, l2, l3, 0, 0))
+      FlushOrNotify();
 }
 
 PUBLIC void Trace(int level, const char* msg, 
@@ -688,8 +967,8 @@ PUBLIC void Trace(int level, const char* msg,
 PUBLIC void Trace(TraceContext* context, int level, const char* msg, 
 				  long l1, long l2, long l3, long l4)
 {
-    AddTrace(context, level, msg, NULL, NULL, NULL, l1, l2, l3, l4, 0);
-	FlushOrNotify();
+    if (AddTrace(context, level, msg, NULL, NULL, NULL, l1, l2, l3, l4, 0))
+      FlushOrNotify();
 }
 
 PUBLIC void Trace(TraceContext* context, int level, const char* msg, 
@@ -697,8 +976,8 @@ PUBLIC void Trace(TraceContext* context, int level, const char* msg,
 				  long l1, long l2, long l3, long l4)
 {
     arg = CheckString(arg);
-    AddTrace(context, level, msg, arg, NULL, NULL, l1, l2, l3, l4, 0);
-	FlushOrNotify();
+    if (AddTrace(context, level, msg, arg, NULL, NULL, l1, l2, l3, l4, 0))
+      FlushOrNotify();
 }
 
 PUBLIC void Trace(int level, const char* msg, 
@@ -731,8 +1010,8 @@ PUBLIC void Trace(TraceContext* context, int level, const char* msg,
                   long l1, long l2, long l3, long l4, long l5)
 {
     arg = CheckString(arg);
-    AddTrace(context, level, msg, arg, NULL, NULL, l1, l2, l3, l4, l5);
-	FlushOrNotify();
+    if (AddTrace(context, level, msg, arg, NULL, NULL, l1, l2, l3, l4, l5))
+      FlushOrNotify();
 }
 
 /****************************************************************************/
@@ -13,7 +13,7 @@
 #define TRACE_H
 
 #include <stdarg.h>
-#include "port.h"
+#include "Port.h"
 
 extern bool TraceToDebug;
 extern bool TraceToStdout;
@@ -83,7 +83,17 @@ class TraceBuffer
  *                                                                          *
  ****************************************************************************/
 
-#define MAX_TRACE_RECORDS 10000
+/**
+ * Number of trace rings.  Ring zero is shared by any thread that
+ * couldn't get one of its own, the others are claimed by
+ * one thread each.
+ */
+#define MAX_TRACE_RINGS 16
+
+/**
+ * Records in each ring, must be a power of two.
+ */
+#define TRACE_RING_SIZE 1024
 
 #define MAX_ARG 64
 
@@ -93,8 +103,12 @@ class TraceBuffer
  * in high volume time sensitive environments like digitial audio processing.
  *
  * This isn't very flexible but it gets the job done.  We allow
- * one string argument and four long arguments.  If the string argument
- * is non-NULL it is expected to be the first argument in the message.
+ * up to three string arguments and five long arguments.  If a string 
+ * argument is non-NULL it is expected to come before the longs.
+ *
+ * String arguments are not copied, they point into the table of
+ * interned strings maintained by Trace.cpp.  If the table is full
+ * the first string is copied into the record.
  */
 class TraceRecord {
 
@@ -118,13 +132,22 @@ class TraceRecord {
 	 */
 	long time;
 
+    /**
+     * GetClockTicks when the record was added, used to merge
+     * the per-thread rings back into one stream.
+     */
+    long long ticks;
+
     // an sprintf format string
     const char* msg;
 
     // optional string arguments
-    char string[MAX_ARG];
-	char string2[MAX_ARG];
-	char string3[MAX_ARG];
+    const char* string;
+    const char* string2;
+    const char* string3;
+
+    // copy of a string argument we couldn't intern
+    char buffer[MAX_ARG];
 
     // optional long arguments
     long long1;
@@ -182,6 +205,11 @@ PUBLIC void AppendTrace(const char* file);
 PUBLIC void PrintTrace();
 PUBLIC void FlushTrace();
 
+/**
+ * Called by Thread as it terminates to release the trace ring.
+ */
+PUBLIC void TraceThreadEnding();
+
 /****************************************************************************
  *                                                                          *
  *   						   TRACE FUNCTIONS                              *
@@ -27,8 +27,8 @@
 #include <windows.h>
 #endif
 
-#include "util.h"
-#include "vbuf.h"
+#include "Util.h"
+#include "Vbuf.h"
 #include "Trace.h"
 #include "List.h"
 
@@ -22,8 +22,8 @@
 #include <stdio.h>
 #include <string.h>
 
-#include "port.h"
-#include "vbuf.h"
+#include "Port.h"
+#include "Vbuf.h"
 
 /****************************************************************************
  * Vbuf::Vbuf
@@ -13,7 +13,7 @@
 #ifndef VBUF_H
 #define VBUF_H
 
-#include "port.h"
+#include "Port.h"
 
 /****************************************************************************
  * VBUF_INITIAL_SIZE
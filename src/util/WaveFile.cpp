@@ -20,7 +20,7 @@
 //#include <sys/stat.h>
 //#include <io.h>
 
-#include "util.h"
+#include "Util.h"
 #include "WaveFile.h"
 
 /****************************************************************************
@@ -133,11 +133,16 @@ PRIVATE void WaveFile::init()
 	mData = NULL;
     mFrames = 0;
 	mDataChunkBytes = 0;
+	mDataFrames = 0;
+	mBuffer = NULL;
+	mBufferBytes = 0;
 }
 
 PRIVATE void WaveFile::clear()
 {
 	mError = 0;
+	if (mHandle != NULL)
+	  fclose(mHandle);
 	mHandle = NULL;
 	mFormat = WAV_FORMAT_IEEE;
 	mChannels = 2;
@@ -147,6 +152,7 @@ PRIVATE void WaveFile::clear()
     mBlockAlign = 0;
     mFrames = 0;
 	mDataChunkBytes = 0;
+	mDataFrames = 0;
 
 	delete mData;
 	mData = NULL;
@@ -154,8 +160,11 @@ PRIVATE void WaveFile::clear()
 
 PUBLIC WaveFile::~WaveFile()
 {
+	if (mHandle != NULL)
+	  fclose(mHandle);
 	delete mFile;
 	delete mData;
+	delete mBuffer;
 }
 
 PUBLIC void WaveFile::setFile(const char* file)
@@ -355,17 +364,53 @@ PUBLIC int WaveFile::read(const char* path)
 	return read();
 }
 
+/**
+ * Read the entire file into one interleaved stereo array.
+ * This is now just a streaming read of all the frames, when the
+ * samples are going somewhere else it is better to use readStart
+ * and read them in smaller blocks.
+ */
 PUBLIC int WaveFile::read()
+{
+	if (readStart() == 0) {
+		// convert everything to stereo, add other options someday
+		mData = new float[mFrames * 2];
+		read(mData, mFrames);
+		readFinish();
+
+		// the data no longer has the channels in the file, make
+		// them match so it can be written back out
+		mChannels = 2;
+		mBlockAlign = (myuint16)(mChannels * (mSampleDepth / 8));
+	}
+
+	return mError;
+}
+
+PUBLIC int WaveFile::readStart(const char* path)
+{
+	setFile(path);
+	return readStart();
+}
+
+/**
+ * Prepare to read a wave file incrementally.
+ * The headers are processed and the file is left positioned at the
+ * start of the data chunk.  The frames are then read with one or
+ * more calls to read(float*, long) followed by readFinish.
+ */
+PUBLIC int WaveFile::readStart()
 {
 	clear();
 
 	if (mFile == NULL)
 	  mError = AUF_ERROR_NO_INPUT_FILE;
 	else {
-		FILE* fp = fopen(mFile, "rb");
-		if (fp == NULL)
+		mHandle = fopen(mFile, "rb");
+		if (mHandle == NULL)
 		  mError = AUF_ERROR_INPUT_FILE;
 		else {
+			FILE* fp = mHandle;
 			// riff header
 			char id[4];
 			readId(fp, id);
@@ -382,7 +427,8 @@ PUBLIC int WaveFile::read()
 				  mError = AUF_ERROR_NOT_WAVE;
 				else {
 					myuint32 chunkSize;
-					while (mError == 0 && mData == NULL) {
+					bool data = false;
+					while (mError == 0 && !data) {
 						// read chunk header
 						readId(fp, id);
 						if (!mError) {
@@ -393,8 +439,10 @@ PUBLIC int WaveFile::read()
 								  printf("Chunk size %d\n", (int)chunkSize);
 								if (!strncmp(id, "fmt ", 4)) 
 								  processFormatChunk(fp, chunkSize);
-								else if (!strncmp(id, "data", 4))
-								  processDataChunk(fp, chunkSize);
+								else if (!strncmp(id, "data", 4)) {
+									processDataChunk(fp, chunkSize);
+									data = true;
+								}
 								else if (chunkSize > 0) {
 									// ignore this chunk, pad to even boundary
 									if (chunkSize & 1)
@@ -407,13 +455,79 @@ PUBLIC int WaveFile::read()
 					}
 				}
 			}
-			fclose(fp);
+			if (mError) {
+				fclose(mHandle);
+				mHandle = NULL;
+			}
 		}
 	}
 
 	return mError;
 }
 
+/**
+ * Read a block of frames.  A call to readStart must have been made first.
+ * The frames are always converted to interleaved stereo so the buffer
+ * must be large enough for frames * 2 samples.  Returns the number
+ * of frames read which will be less than requested at the end of
+ * the data chunk or if there was an error.
+ */
+PUBLIC long WaveFile::read(float* buffer, long frames)
+{
+	long read = 0;
+
+	if (!mError) {
+		if (mHandle == NULL)
+		  mError = AUF_ERROR_NO_INPUT_FILE;
+		else {
+			if (frames > mDataFrames)
+			  frames = mDataFrames;
+			if (frames > 0) {
+				unsigned char* raw = getBuffer(frames * mBlockAlign);
+				// read the raw bytes all at once, we'll convert them after
+				size_t count = fread(raw, mBlockAlign, frames, mHandle);
+				if (count != (size_t)frames)
+				  mError = AUF_ERROR_EOF;
+				read = (long)count;
+				decode(raw, buffer, read);
+				mDataFrames -= read;
+			}
+		}
+	}
+
+	return read;
+}
+
+/**
+ * Finish up an incremental read.
+ */
+PUBLIC int WaveFile::readFinish()
+{
+	if (mHandle != NULL) {
+		fclose(mHandle);
+		mHandle = NULL;
+	}
+	delete mBuffer;
+	mBuffer = NULL;
+	mBufferBytes = 0;
+
+	return mError;
+}
+
+/**
+ * Return a buffer for raw sample bytes, reused between calls
+ * to read and write.
+ */
+PRIVATE unsigned char* WaveFile::getBuffer(long bytes)
+{
+	if (bytes > mBufferBytes) {
+		delete mBuffer;
+		mBuffer = new unsigned char[bytes];
+		mBufferBytes = bytes;
+	}
+	return mBuffer;
+}
+
 /**
  * Read a chunk id.
  * These are 4 bytes and do not need byte translation, I guess because we read
@@ -526,6 +640,17 @@ PRIVATE void WaveFile::processFormatChunk(FILE* fp, long size)
 	mBlockAlign = read16(fp);
 	mSampleDepth = read16(fp);
 
+	long extra = size - 16;
+	if (mFormat == WAV_FORMAT_EXTENSIBLE && extra >= 24) {
+		// extension size, valid bits, channel mask, then the sub format
+		// GUID whose first two bytes are the usual format tag
+		read16(fp);
+		read16(fp);
+		read32(fp);
+		mFormat = read16(fp);
+		extra -= 10;
+	}
+
 	if (mDebug) {
 		printf("Format %d\n", mFormat);
 		printf("Channels %d\n", mChannels);
@@ -556,215 +681,241 @@ PRIVATE void WaveFile::processFormatChunk(FILE* fp, long size)
 		else if (mChannels <= 0 || mChannels == 5 || mChannels > 6)
 		  mError = AUF_ERROR_CHANNELS;
 
-		else if (size > 16) {
+		else if (extra > 0) {
 			// extra stuff, but not compressed, ignore
 			// this should be zero for PCM, for IEEE it shoudl have at
 			// least a 16 bits of extension size, not sure what if anything
 			// is interesting in here
-			if (fseek(fp, size - 16, SEEK_CUR))
+			if (fseek(fp, extra, SEEK_CUR))
 			  mError = AUF_ERROR_SEEK;
 		}
 	}
 }
 
 /**
- * Frame formats:
- * stereo: left, right
- * 3 channel: left, right, center
- * quad: front left, front right, rear left, rear right
- * 4 channel: left, center, right, surround
- * 6 channel: left center, left, center, right center, right, surround
+ * We've reached the data chunk, the file is left positioned
+ * at the first frame.
  */
 PRIVATE void WaveFile::processDataChunk(FILE* fp, long size)
 {
-	unsigned char* data = (unsigned char*)new unsigned char[size];
-
-	// purify giving an uninitialized memory read on the source buffer
-	// sometimes, not sure why
-	memset(data, 0, size);
-
-	// read the raw bytes all at once, we'll swap them later if necessary
-	size_t count = fread(data, 1, size, fp);
+	if (mBlockAlign == 0) {
+		// data before the format chunk
+		mError = AUF_ERROR_BLOCK_ALIGN;
+	}
+	else {
+		checkSampleDepth();
+		if (!mError) {
+			// blockAlign is bytesPerSample * channels, effectively the
+			// frame size, may be padding to bring this up to an even
+			// number of bytes?
+			mDataChunkBytes = size;
+			mFrames = size / mBlockAlign;
+			mDataFrames = mFrames;
+		}
+	}
+}
 
-	if (count != size) {
-        mError = AUF_ERROR_EOF;
-    }
-	else if (mFormat == WAV_FORMAT_PCM) {
-		processPcmDataChunk(data, size);
+/**
+ * PCM may be 16, 24 or 32 bit signed integers, IEEE may be
+ * single or double floats.  8 bit PCM is unsigned and rare
+ * enough that we haven't bothered.
+ */
+PRIVATE void WaveFile::checkSampleDepth()
+{
+	if (mFormat == WAV_FORMAT_PCM) {
+		if (mSampleDepth != 16 && mSampleDepth != 24 && mSampleDepth != 32)
+		  mError = AUF_ERROR_SAMPLE_BITS;
 	}
 	else if (mFormat == WAV_FORMAT_IEEE) {
-		processIEEEDataChunk(data, size);
+		if (mSampleDepth != 32 && mSampleDepth != 64)
+		  mError = AUF_ERROR_SAMPLE_BITS;
 	}
 	else {
 		// should have caught this by now
 		mError = AUF_ERROR_COMPRESSED;
 	}
+}
+
+/****************************************************************************
+ *                                                                          *
+ *                             SAMPLE DECODING                              *
+ *                                                                          *
+ ****************************************************************************/
+
+/*
+ * Samples are always little endian, assemble them a byte at a
+ * time so we don't have to swap on PPC.  The compiler turns most
+ * of these into a single load.
+ */
 
-	delete data;
+inline float decodePcm16(unsigned char* src)
+{
+	myint16 value = (myint16)(src[0] | (src[1] << 8));
+	return (value * (1.0f / 32768.0f));
 }
 
-PRIVATE void WaveFile::processPcmDataChunk(unsigned char* data, long size)
+inline float decodePcm24(unsigned char* src)
 {
-	if (mSampleDepth <= 8) {
-        // always one UNSIGNED byte per sample
-        mError = AUF_ERROR_SAMPLE_BITS;
-    }
-    else if (mSampleDepth < 16) {
-        // always two signed bytes, left justified
-        mError = AUF_ERROR_SAMPLE_BITS;
-    }
-    else if (mSampleDepth > 16 && mSampleDepth <= 24) {
-        // three signed bytes, left justified
-        mError = AUF_ERROR_SAMPLE_BITS;
-    }
-    else if (mSampleDepth > 24 && mSampleDepth <= 32) {
-        // four signed bytes, left justified
-        mError = AUF_ERROR_SAMPLE_BITS;
-    }
-    else if (mSampleDepth != 16) {
-        // invalid depth
-        mError = AUF_ERROR_SAMPLE_BITS;
-    }
-    else {
-        // ahh, we're here
-		// blockAlign is bytesPerSample * channels, effectively the frame size
-        // may be padding to bring this up to an even number of bytes?
-        mFrames = size / mBlockAlign;
-
-        // convert everything to stereo, add other options someday
-        mData = new float[mFrames * 2];
-        myuint16* src = (myuint16*)data;
-        
-        int srcSample = 0;
-        int destSample = 0;
-
-        for (int i = 0 ; i < mFrames ; i++) {
-            if (mChannels == 1) {
-                mData[destSample++] = toFloat(read16(src, srcSample));
-                mData[destSample++] = toFloat(read16(src, srcSample));
-            }
-            else if (mChannels == 2 || mChannels == 3) {
-                mData[destSample++] = toFloat(read16(src, srcSample));
-                mData[destSample++] = toFloat(read16(src, srcSample + 1));
-            }
-            else if (mChannels == 4) {
-                // assume 4 channel surround rather than quad
-                mData[destSample++] = toFloat(read16(src, srcSample));
-                mData[destSample++] = toFloat(read16(src, srcSample + 2));
-            }
-            else if (mChannels == 6) {
-                mData[destSample++] = toFloat(read16(src, srcSample + 1));
-                mData[destSample++] = toFloat(read16(src, srcSample + 4));
-            }
-            srcSample += mChannels;
-        }
-    }
+	// shift into the top of an int then back down to extend the sign
+	int value = (int)((src[0] << 8) | (src[1] << 16) | 
+					  ((myuint32)src[2] << 24)) >> 8;
+	return (value * (1.0f / 8388608.0f));
 }
 
-/**
- * Extract a 2 byte integer from a raw data block.
- */
-PRIVATE myuint16 WaveFile::read16(myuint16* src, int index)
+inline float decodePcm32(unsigned char* src)
 {
-	myuint16 value = src[index];
-#if __BIG_ENDIAN__
-	swap16((unsigned char*)&value);
-#endif
-	return value;
+	int value = (int)(src[0] | (src[1] << 8) | (src[2] << 16) | 
+					  ((myuint32)src[3] << 24));
+	return (float)(value * (1.0 / 2147483648.0));
 }
 
-/**
- * Extract a 4 byte float from a raw data block.
- */
-PRIVATE float WaveFile::readFloat(float* src, int index)
+inline float decodeFloat(unsigned char* src)
 {
-	float value = src[index];
-#if __BIG_ENDIAN__
-	swap32((unsigned char*)&value);
-#endif
+	myuint32 bits = src[0] | (src[1] << 8) | (src[2] << 16) | 
+		((myuint32)src[3] << 24);
+	float value;
+	memcpy(&value, &bits, 4);
 	return value;
 }
 
+inline float decodeDouble(unsigned char* src)
+{
+	unsigned long long bits = 0;
+	for (int i = 7 ; i >= 0 ; i--)
+	  bits = (bits << 8) | src[i];
+	double value;
+	memcpy(&value, &bits, 8);
+	return (float)value;
+}
+
 /**
- * Extract an 8 byte double float from a raw data block.
- * We don't write these but I suppose we could read them.
+ * Decode one frame format, with the channel offsets in bytes.
+ */
+#define DECODE_FRAMES(decoder)						\
+	for (long i = 0 ; i < frames ; i++) {			\
+		*dest++ = decoder(&src[left]);				\
+		*dest++ = decoder(&src[right]);				\
+		src += mBlockAlign;							\
+	}
+
+/**
+ * Convert raw frames from the data chunk to interleaved stereo floats.
+ *
+ * Frame formats:
+ * stereo: left, right
+ * 3 channel: left, right, center
+ * quad: front left, front right, rear left, rear right
+ * 4 channel: left, center, right, surround
+ * 6 channel: left center, left, center, right center, right, surround
  */
-PRIVATE double WaveFile::readDouble(double* src, int index)
+PRIVATE void WaveFile::decode(unsigned char* src, float* dest, long frames)
 {
-	double value = src[index];
-#if __BIG_ENDIAN__
-	swap64((unsigned char*)&value);
-#endif
-	return value;
+	int bytes = mSampleDepth / 8;
+	int left = 0;
+	int right = 0;
+
+	if (mChannels == 2 || mChannels == 3) {
+		right = bytes;
+	}
+	else if (mChannels == 4) {
+		// assume 4 channel surround rather than quad
+		right = bytes * 2;
+	}
+	else if (mChannels == 6) {
+		left = bytes;
+		right = bytes * 4;
+	}
+
+	if (mFormat == WAV_FORMAT_PCM) {
+		if (mSampleDepth == 16) {
+			DECODE_FRAMES(decodePcm16);
+		}
+		else if (mSampleDepth == 24) {
+			DECODE_FRAMES(decodePcm24);
+		}
+		else {
+			DECODE_FRAMES(decodePcm32);
+		}
+	}
+	else if (mSampleDepth == 32) {
+		DECODE_FRAMES(decodeFloat);
+	}
+	else {
+		DECODE_FRAMES(decodeDouble);
+	}
 }
 
-PRIVATE void WaveFile::processIEEEDataChunk(unsigned char* data, long size)
+/****************************************************************************
+ *                                                                          *
+ *                             SAMPLE ENCODING                              *
+ *                                                                          *
+ ****************************************************************************/
+
+inline void encodePcm16(float sample, unsigned char* dest)
 {
-	if (mSampleDepth != 32 && mSampleDepth != 64) {
-        mError = AUF_ERROR_SAMPLE_BITS;
-    }
-    else {
-        mFrames = size / mBlockAlign;
-
-        // convert everything to stereo, add other options someday
-		// optimization: if mChannels == 2 which it almost always will be, 
-		// we don't have to allocate another block and copy, just use
-		// the original block, I want to force it through the logic though
-		// for testing
-        mData = new float[mFrames * 2];
-
-		if (mSampleDepth == 32) {
-			float* src = (float*)data;
-			int srcSample = 0;
-			int destSample = 0;
-			for (int i = 0 ; i < mFrames ; i++) {
-				if (mChannels == 1) {
-					mData[destSample++] = readFloat(src, srcSample);
-					mData[destSample++] = readFloat(src, srcSample);
-				}
-				else if (mChannels == 2 || mChannels == 3) {
-					mData[destSample++] = readFloat(src, srcSample);
-					mData[destSample++] = readFloat(src, srcSample + 1);
-				}
-				else if (mChannels == 4) {
-					// assume 4 channel surround rather than quad
-					mData[destSample++] = readFloat(src, srcSample);
-					mData[destSample++] = readFloat(src, srcSample + 2);
-				}
-				else if (mChannels == 6) {
-					mData[destSample++] = readFloat(src, srcSample + 1);
-					mData[destSample++] = readFloat(src, srcSample + 4);
-				}
-				srcSample += mChannels;
-			}
+	myuint16 value = (myuint16)toInt16(sample);
+	dest[0] = (unsigned char)value;
+	dest[1] = (unsigned char)(value >> 8);
+}
+
+inline void encodePcm24(float sample, unsigned char* dest)
+{
+	long value = (long)(sample * 8388607.0f);
+	CLIP(value, -0x800000, 0x7FFFFF);
+	dest[0] = (unsigned char)value;
+	dest[1] = (unsigned char)(value >> 8);
+	dest[2] = (unsigned char)(value >> 16);
+}
+
+inline void encodePcm32(float sample, unsigned char* dest)
+{
+	double scaled = sample * 2147483647.0;
+	CLIP(scaled, -2147483648.0, 2147483647.0);
+	myuint32 value = (myuint32)(int)scaled;
+	dest[0] = (unsigned char)value;
+	dest[1] = (unsigned char)(value >> 8);
+	dest[2] = (unsigned char)(value >> 16);
+	dest[3] = (unsigned char)(value >> 24);
+}
+
+inline void encodeFloat(float sample, unsigned char* dest)
+{
+	myuint32 value;
+	memcpy(&value, &sample, 4);
+	dest[0] = (unsigned char)value;
+	dest[1] = (unsigned char)(value >> 8);
+	dest[2] = (unsigned char)(value >> 16);
+	dest[3] = (unsigned char)(value >> 24);
+}
+
+#define ENCODE_SAMPLES(encoder, bytes)				\
+	for (long i = 0 ; i < samples ; i++) {			\
+		encoder(src[i], dest);						\
+		dest += bytes;								\
+	}
+
+/**
+ * Convert interleaved floats to the raw data chunk format.
+ * Unlike reading, we write however many channels we were given.
+ */
+PRIVATE void WaveFile::encode(float* src, unsigned char* dest, long frames)
+{
+	long samples = frames * mChannels;
+
+	if (mFormat == WAV_FORMAT_PCM) {
+		if (mSampleDepth == 16) {
+			ENCODE_SAMPLES(encodePcm16, 2);
+		}
+		else if (mSampleDepth == 24) {
+			ENCODE_SAMPLES(encodePcm24, 3);
 		}
 		else {
-			double* src = (double*)data;
-			int srcSample = 0;
-			int destSample = 0;
-
-			for (int i = 0 ; i < mFrames ; i++) {
-				if (mChannels == 1) {
-					mData[destSample++] = (float)(readDouble(src, srcSample));
-					mData[destSample++] = (float)(readDouble(src, srcSample));
-				}
-				else if (mChannels == 2 || mChannels == 3) {
-					mData[destSample++] = (float)(readDouble(src, srcSample));
-					mData[destSample++] = (float)(readDouble(src, srcSample + 1));
-				}
-				else if (mChannels == 4) {
-					// assume 4 channel surround rather than quad
-					mData[destSample++] = (float)(readDouble(src, srcSample));
-					mData[destSample++] = (float)(readDouble(src, srcSample + 2));
-				}
-				else if (mChannels == 6) {
-					mData[destSample++] = (float)(readDouble(src, srcSample + 1));
-					mData[destSample++] = (float)(readDouble(src, srcSample + 4));
-				}
-				srcSample += mChannels;
-			}
+			ENCODE_SAMPLES(encodePcm32, 4);
 		}
 	}
+	else {
+		ENCODE_SAMPLES(encodeFloat, 4);
+	}
 }
 
 /****************************************************************************
@@ -811,7 +962,7 @@ PUBLIC int WaveFile::writeStart()
 	if (mFile == NULL)
 	  mError = AUF_ERROR_NO_OUTPUT_FILE;
 
-    if (mChannels <= 0 || mChannels == 5 || mChannels > 6)
+    else if (mChannels <= 0 || mChannels == 5 || mChannels > 6)
         mError = AUF_ERROR_CHANNELS;
 
     else {
@@ -819,7 +970,8 @@ PUBLIC int WaveFile::writeStart()
 	
 		// try to preserve format, but init if we can't
 		if (mFormat == WAV_FORMAT_PCM) {
-			mSampleDepth = 16;
+			if (mSampleDepth != 24 && mSampleDepth != 32)
+			  mSampleDepth = 16;
 		}
 		else if (mFormat == WAV_FORMAT_IEEE) {
 			mSampleDepth = 32;
@@ -838,26 +990,17 @@ PUBLIC int WaveFile::writeStart()
             myuint32 fmtChunkSize;
 			myuint32 fileSize;
 
-			if (mFormat == WAV_FORMAT_PCM) {
-				// WAVE, header/chunksize format, header/chunksize data, pad
-				fmtChunkSize = 16;
-				mDataChunkBytes = (mFrames * mChannels) * 2;
-				fileSize = 4 + 8 + fmtChunkSize + 8 + mDataChunkBytes;
-				if (mDataChunkBytes & 1)
-				  fileSize++;
-			}
-			else {
-				// according to some interpretations of the spec,
-				// IEEE is supposed to have an "extension" in the
-				// format chunk, just to contain the size of the
-				// extension, which will be zero, most applications
-				// seem to tolerate not having this
-				fmtChunkSize = 16;
-				mDataChunkBytes = (mFrames * mChannels) * 4;
-				fileSize = 4 + 8 + fmtChunkSize + 8 + mDataChunkBytes;
-				if (mDataChunkBytes & 1)
-				  fileSize++;
-			}
+			// WAVE, header/chunksize format, header/chunksize data, pad
+			// according to some interpretations of the spec,
+			// IEEE is supposed to have an "extension" in the
+			// format chunk, just to contain the size of the
+			// extension, which will be zero, most applications
+			// seem to tolerate not having this
+			fmtChunkSize = 16;
+			mDataChunkBytes = (mFrames * mChannels) * (mSampleDepth / 8);
+			fileSize = 4 + 8 + fmtChunkSize + 8 + mDataChunkBytes;
+			if (mDataChunkBytes & 1)
+			  fileSize++;
 
 			writeId(mHandle, "RIFF");				// RIFF header
 			write32(mHandle, fileSize);
@@ -912,17 +1055,6 @@ PRIVATE void WaveFile::write32(FILE* fp, myuint32 value)
 	fwrite(&value, 4, 1, fp);
 }
 
-/**
- * Write a 4 byte float.
- */
-PRIVATE void WaveFile::writeFloat(FILE* fp, float value)
-{
-#ifdef __BIG_ENDIAN__
-	swap32((unsigned char*)&value);
-#endif
-	fwrite(&value, 4, 1, fp);
-}
-
 /**
  * Write a 2 byte integer.
  */
@@ -936,29 +1068,25 @@ PRIVATE void WaveFile::write16(FILE* fp, myuint16 value)
 
 /**
  * Write a block of frames.  A call to writeStart must
- * have been made first.
+ * have been made first.  The frames are converted into one
+ * block of bytes and written all at once.  A null buffer
+ * writes silence.
  */
 PUBLIC int WaveFile::write(float* buffer, long frames)
 {
 	if (!mError) {
 		if (mHandle == NULL)
 		  mError = AUF_ERROR_NO_OUTPUT_FILE;
-		else {
-			int samples = frames * mChannels;
-			if (mFormat == WAV_FORMAT_PCM) {
-				for (int i = 0 ; i < samples ; i++) {
-					float sample = buffer[i];
-					myint16 isample = toInt16(sample);
-					write16(mHandle, isample);
-				}
-			}
-			else {
-				// foo, would be simpler just to blast out the entire block
-				for (int i = 0 ; i < samples ; i++) {
-					float sample = buffer[i];
-					writeFloat(mHandle, sample);
-				}
-			}
+		else if (frames > 0) {
+			long bytes = (frames * mChannels) * (mSampleDepth / 8);
+			unsigned char* raw = getBuffer(bytes);
+			if (buffer == NULL)
+			  memset(raw, 0, bytes);
+			else
+			  encode(buffer, raw, frames);
+
+			if (fwrite(raw, 1, bytes, mHandle) != (size_t)bytes)
+			  mError = AUF_ERROR_OUTPUT_FILE;
         }
     }
 
@@ -978,7 +1106,11 @@ PUBLIC int WaveFile::writeFinish()
 			fwrite(&pad, 1, 1, mHandle);
 		}
 		fclose(mHandle);
+		mHandle = NULL;
 	}
+	delete mBuffer;
+	mBuffer = NULL;
+	mBufferBytes = 0;
 
 	return mError;
 }
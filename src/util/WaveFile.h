@@ -8,11 +8,18 @@
 #ifndef WAVE_FILE_H
 #define WAVE_FILE_H
 
-#include "port.h"
+#include "Port.h"
 
 #define WAV_FORMAT_PCM 1
 #define WAV_FORMAT_IEEE 3
 
+/**
+ * WAVE_FORMAT_EXTENSIBLE, the real format is in the first two
+ * bytes of the sub format GUID in the format chunk extension.
+ * Common for 24 bit files.
+ */
+#define WAV_FORMAT_EXTENSIBLE 0xFFFE
+
 #define AUF_ERROR_INPUT_FILE 1
 #define AUF_ERROR_NOT_RIFF 2
 #define AUF_ERROR_NOT_WAVE 3
@@ -44,6 +51,11 @@ PUBLIC class WaveFile {
 	int read();
 	int read(const char* file);
 
+	int readStart();
+	int readStart(const char* file);
+	long read(float* buffer, long frames);
+	int readFinish();
+
     int write();
     int write(const char* file);
 	int writeStart();
@@ -83,24 +95,21 @@ PUBLIC class WaveFile {
 	void init();
 	void processFormatChunk(FILE* fp, long size);
 	void processDataChunk(FILE* fp, long size);
-	void processPcmDataChunk(unsigned char* data, long size);
-	void processIEEEDataChunk(unsigned char* data, long size);
+	void checkSampleDepth();
+	unsigned char* getBuffer(long bytes);
+	void decode(unsigned char* src, float* dest, long frames);
+	void encode(float* src, unsigned char* dest, long frames);
 
 	void readId(FILE* fp, char* buffer);
 	myuint32 read32(FILE* fp);
 	myuint16 read16(FILE* fp);
 
-	myuint16 read16(myuint16* src, int index);
-	float readFloat(float* src, int index);
-	double readDouble(double* src, int index);
-
 	void swap64(unsigned char* bytes);
 	void swap32(unsigned char* bytes);
 	void swap16(unsigned char* bytes);
 
 	void writeId(FILE* fp, const char* id);
 	void write32(FILE* fp, myuint32 value);
-	void writeFloat(FILE* fp, float value);
 	void write16(FILE* fp, myuint16 value);
 
 	char* mFile;
@@ -118,8 +127,11 @@ PUBLIC class WaveFile {
 	float* mData;
     long mFrames;
 
-	// transient write state
+	// transient read/write state
 	long mDataChunkBytes;
+	long mDataFrames;
+	unsigned char* mBuffer;
+	long mBufferBytes;
 
 
 };
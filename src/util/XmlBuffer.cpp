@@ -14,7 +14,7 @@
 #include <ctype.h>
 #include <string.h>
 
-#include "util.h"
+#include "Util.h"
 
 #include "XmlBuffer.h"
 
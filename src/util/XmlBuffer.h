@@ -12,8 +12,8 @@
 #ifndef XML_BUFFER_H
 #define XML_BUFFER_H
 
-#include "port.h"
-#include "vbuf.h"
+#include "Port.h"
+#include "Vbuf.h"
 
 #define XML_HEADER "<?xml version='1.0' encoding='UTF-8'?>"
 
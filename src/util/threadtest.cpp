@@ -2,7 +2,7 @@
 #include <stdio.h>
 #include <string.h>
 
-#include "util.h"
+#include "Util.h"
 #include "Thread.h"
 
 class TestThread : public Thread {